@@ -0,0 +1,150 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "activitymeter.h"
+#include <QCoreApplication>
+#include <QPointer>
+#include <IrcNetwork>
+#include <IrcBuffer>
+#include <algorithm>
+#include <cmath>
+
+// the rate is a count over a sliding minute, older messages fade out smoothly
+static const double TimeConstant = 60 * 1000.0;
+static const int TopBuffers = 10;
+
+// messages per minute that switch a buffer to firehose mode, 0 never does
+static int busyThreshold = 0;
+
+static double decayed(double rate, qint64 last, qint64 now)
+{
+    // e^(-t/T) per message keeps the sum at messages per minute for a steady stream
+    if (rate <= 0)
+        return 0;
+    return rate * std::exp(-(now - last) / TimeConstant);
+}
+
+ActivityMeter::ActivityMeter(QObject* parent) : QObject(parent)
+{
+    d.clock.start();
+}
+
+ActivityMeter* ActivityMeter::instance()
+{
+    static QPointer<ActivityMeter> meter;
+    if (!meter)
+        meter = new ActivityMeter(QCoreApplication::instance());
+    return meter;
+}
+
+int ActivityMeter::busyRate()
+{
+    return busyThreshold;
+}
+
+void ActivityMeter::setBusyRate(int rate)
+{
+    busyThreshold = qMax(0, rate);
+}
+
+void ActivityMeter::addBuffer(IrcBuffer* buffer)
+{
+    if (d.meters.contains(buffer))
+        return;
+    d.meters.insert(buffer, Meter());
+    connect(buffer, SIGNAL(messageReceived(IrcMessage*)), this, SLOT(countMessage()));
+}
+
+void ActivityMeter::removeBuffer(IrcBuffer* buffer)
+{
+    // only the key is used, the buffer may be half destroyed
+    d.meters.remove(buffer);
+    disconnect(buffer, SIGNAL(messageReceived(IrcMessage*)), this, SLOT(countMessage()));
+}
+
+double ActivityMeter::rate(IrcBuffer* buffer) const
+{
+    QHash<IrcBuffer*, Meter>::const_iterator it = d.meters.constFind(buffer);
+    if (it == d.meters.constEnd())
+        return 0;
+    return decayed(it->rate, it->last, d.clock.elapsed());
+}
+
+static bool rateGreaterThan(const QPair<double, IrcBuffer*>& one, const QPair<double, IrcBuffer*>& another)
+{
+    return one.first > another.first;
+}
+
+QList<QPair<double, IrcBuffer*> > ActivityMeter::busiest(int count) const
+{
+    const qint64 now = d.clock.elapsed();
+    QList<QPair<double, IrcBuffer*> > rates;
+    QHash<IrcBuffer*, Meter>::const_iterator it;
+    for (it = d.meters.constBegin(); it != d.meters.constEnd(); ++it) {
+        const double rate = decayed(it->rate, it->last, now);
+        if (rate >= 0.1)
+            rates += qMakePair(rate, it.key());
+    }
+    std::sort(rates.begin(), rates.end(), rateGreaterThan);
+    return rates.mid(0, count);
+}
+
+// computed on demand, a message only touches its own meter
+QStringList ActivityMeter::report() const
+{
+    QStringList lines;
+    typedef QPair<double, IrcBuffer*> Rate;
+    foreach (const Rate& rate, busiest(TopBuffers)) {
+        IrcBuffer* buffer = rate.second;
+        lines += tr("%1 (%2): %3 msg/min%4").arg(buffer->title(), buffer->network()->name())
+                                            .arg(rate.first, 0, 'f', 1)
+                                            .arg(d.meters.value(buffer).busy ? tr(", busy") : QString());
+    }
+    if (lines.isEmpty())
+        lines += tr("No buffer activity in the last minutes.");
+    return lines;
+}
+
+void ActivityMeter::countMessage()
+{
+    IrcBuffer* buffer = static_cast<IrcBuffer*>(sender());
+    QHash<IrcBuffer*, Meter>::iterator it = d.meters.find(buffer);
+    if (it == d.meters.end())
+        return;
+
+    const qint64 now = d.clock.elapsed();
+    it->rate = decayed(it->rate, it->last, now) + 1.0;
+    it->last = now;
+
+    // half the threshold to calm down again, so that a buffer does not flap
+    const bool busy = busyThreshold > 0 && (it->busy ? it->rate >= busyThreshold / 2.0 : it->rate >= busyThreshold);
+    if (busy != it->busy) {
+        it->busy = busy;
+        emit busyChanged(buffer, busy);
+    }
+}
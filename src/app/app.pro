@@ -72,31 +72,47 @@ OTHER_FILES += ../../communi.desktop
 FORMS += $$PWD/connectpage.ui
 FORMS += $$PWD/settingspage.ui
 
+HEADERS += $$PWD/activitymeter.h
 HEADERS += $$PWD/chatpage.h
 HEADERS += $$PWD/connectpage.h
 HEADERS += $$PWD/helppopup.h
 HEADERS += $$PWD/mainwindow.h
+HEADERS += $$PWD/perfstats.h
 HEADERS += $$PWD/pluginloader.h
+HEADERS += $$PWD/pluginthread.h
 HEADERS += $$PWD/scrollbarstyle.h
+HEADERS += $$PWD/seenstore.h
+HEADERS += $$PWD/sessionsnapshot.h
 HEADERS += $$PWD/settingspage.h
 HEADERS += $$PWD/splitview.h
+HEADERS += $$PWD/stallwatchdog.h
+HEADERS += $$PWD/startuptimeline.h
 HEADERS += $$PWD/overlay.h
 
+SOURCES += $$PWD/activitymeter.cpp
 SOURCES += $$PWD/chatpage.cpp
 SOURCES += $$PWD/connectpage.cpp
 SOURCES += $$PWD/helppopup.cpp
 SOURCES += $$PWD/main.cpp
 SOURCES += $$PWD/mainwindow.cpp
+SOURCES += $$PWD/perfstats.cpp
 SOURCES += $$PWD/pluginloader.cpp
+SOURCES += $$PWD/pluginthread.cpp
 SOURCES += $$PWD/scrollbarstyle.cpp
+SOURCES += $$PWD/seenstore.cpp
+SOURCES += $$PWD/sessionsnapshot.cpp
 SOURCES += $$PWD/settingspage.cpp
 SOURCES += $$PWD/splitview.cpp
+SOURCES += $$PWD/stallwatchdog.cpp
+SOURCES += $$PWD/startuptimeline.cpp
 SOURCES += $$PWD/overlay.cpp
 
 include(3rdparty/3rdparty.pri)
+include(core/core.pri)
 include(dock/dock.pri)
 include(finder/finder.pri)
 include(monitor/monitor.pri)
+include(replay/replay.pri)
 include(theme/theme.pri)
 include(tree/tree.pri)
 include(../../themes/themes.pri)
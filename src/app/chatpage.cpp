@@ -27,12 +27,15 @@
 */
 
 #include "chatpage.h"
+#include "activitymeter.h"
 #include "treeitem.h"
 #include "treerole.h"
 #include "treewidget.h"
 #include "themeloader.h"
 #include "textdocument.h"
+#include "documentstub.h"
 #include "pluginloader.h"
+#include "badgecounter.h"
 #include "textbrowser.h"
 #include "bufferview.h"
 #include "textinput.h"
@@ -41,9 +44,29 @@
 #include "titlebar.h"
 #include "overlay.h"
 #include "finder.h"
+#include "abstractfinder.h"
 #include "mainwindow.h"
 #include "scrollbarstyle.h"
 #include "messagehandler.h"
+#include "memorybudget.h"
+#include "flushscheduler.h"
+#include "hookstats.h"
+#include "perfstats.h"
+#include "coreserver.h"
+#include "tracer.h"
+#include "allocstats.h"
+#include "inputlatency.h"
+#include "sendqueue.h"
+#include "joinpacer.h"
+#include "handshake.h"
+#include "highlightmatcher.h"
+#include "linkpreview.h"
+#include "seenstore.h"
+#include "sessionsnapshot.h"
+#include "settingscache.h"
+#include "stallwatchdog.h"
+#include "taskscheduler.h"
+#include "startuptimeline.h"
 #include <QCoreApplication>
 #include <IrcCommandParser>
 #include <IrcBufferModel>
@@ -53,9 +76,21 @@
 #include <QScrollBar>
 #include <IrcChannel>
 #include <IrcBuffer>
-#include <QSettings>
+#include <QRegExp>
+#include <QStandardPaths>
+#include <QTimer>
 #include <Irc>
 
+// rows per buffer kept in the session snapshot
+static const int SnapshotRows = 200;
+static const int PrewarmCount = 2;
+static const int PrewarmDelay = 1000;
+
+static QString stateKey(IrcBuffer* buffer)
+{
+    return buffer->connection()->userData().value("uuid").toString() + "/" + buffer->title();
+}
+
 ChatPage::ChatPage(QWidget* parent) : QSplitter(parent)
 {
     d.currentBuffer = 0;
@@ -77,12 +112,42 @@ ChatPage::ChatPage(QWidget* parent) : QSplitter(parent)
 
     connect(d.splitView, SIGNAL(viewAdded(BufferView*)), this, SLOT(addView(BufferView*)));
     connect(d.splitView, SIGNAL(viewRemoved(BufferView*)), this, SLOT(removeView(BufferView*)));
+    connect(d.splitView, SIGNAL(viewPooled(BufferView*)), PluginLoader::instance(), SLOT(viewPooled(BufferView*)));
+    connect(d.splitView, SIGNAL(viewRecycled(BufferView*)), PluginLoader::instance(), SLOT(viewRecycled(BufferView*)));
     connect(d.splitView, SIGNAL(currentBufferChanged(IrcBuffer*)), this, SLOT(onCurrentBufferChanged(IrcBuffer*)));
     connect(d.splitView, SIGNAL(currentViewChanged(BufferView*,BufferView*)), this, SLOT(onCurrentViewChanged(BufferView*,BufferView*)));
 
+    connect(BadgeCounter::instance(), SIGNAL(documentsChanged(QList<TextDocument*>)), this, SLOT(updateBadges(QList<TextDocument*>)));
+
     setStretchFactor(1, 1);
 
     addView(d.splitView->currentView());
+
+    // documents that have not been shown for a while give up their layout
+    d.hibernateAfter = 15;
+    d.hibernateTimer = new QTimer(this);
+    d.hibernateTimer->setInterval(60 * 1000);
+    connect(d.hibernateTimer, SIGNAL(timeout()), this, SLOT(hibernateIdleDocuments()));
+    d.hibernateTimer->start();
+
+    connect(ActivityMeter::instance(), SIGNAL(busyChanged(IrcBuffer*,bool)), this, SLOT(onBufferBusy(IrcBuffer*,bool)));
+
+#if QT_VERSION >= 0x050400
+    const QString dataDir = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+#else
+    const QString dataDir = QStandardPaths::writableLocation(QStandardPaths::DataLocation);
+#endif
+    d.seen = new SeenStore(dataDir + "/seen.log", this);
+
+    // optional, the formatted tails of the buffers for a warm start
+    d.snapshot = new SessionSnapshot(dataDir + "/session.snapshot", this);
+    d.snapshotInterval = 0;
+    d.snapshotTimer = new QTimer(this);
+    connect(d.snapshotTimer, SIGNAL(timeout()), this, SLOT(saveSnapshot()));
+
+    // stalls are logged with what was going on while they last
+    d.watchdog = new StallWatchdog(this);
+    connect(this, SIGNAL(currentBufferChanged(IrcBuffer*)), d.watchdog, SLOT(setCurrentBuffer(IrcBuffer*)));
 }
 
 ChatPage::~ChatPage()
@@ -109,6 +174,16 @@ IrcBuffer* ChatPage::currentBuffer() const
     return d.treeWidget->currentBuffer();
 }
 
+QList<TextDocument*> ChatPage::documents() const
+{
+    QList<TextDocument*> documents;
+    foreach (TextDocument* doc, d.documents) {
+        if (!doc->isClone())
+            documents += doc;
+    }
+    return documents;
+}
+
 QString ChatPage::theme() const
 {
     return d.theme.name();
@@ -124,11 +199,17 @@ void ChatPage::setTheme(const QString& theme)
         if (!font.isEmpty())
             QFontDatabase::addApplicationFont(QDir(d.theme.path()).filePath(font));
 
+        // hidden documents are only marked stale and restyle once shown
+        const QString style = d.theme.style();
+        const QString documentStyle = d.theme.documentStyle();
         foreach (TextDocument* doc, d.documents)
-            setupDocument(doc);
-        foreach (BufferView* view, d.splitView->views())
-            view->titleBar()->setStyleSheet(d.theme.style());
-        window()->setStyleSheet(d.theme.style());
+            doc->setStyleSheet(documentStyle);
+        foreach (BufferView* view, d.splitView->views()) {
+            if (view->titleBar()->styleSheet() != style)
+                view->titleBar()->setStyleSheet(style);
+        }
+        if (window()->styleSheet() != style)
+            window()->setStyleSheet(style);
 
         // TODO: because of theme preview
         if (window()->inherits("QMainWindow"))
@@ -142,6 +223,20 @@ QByteArray ChatPage::saveSettings() const
     settings.insert("theme", d.theme.name());
     settings.insert("timestamp", d.timestamp);
     settings.insert("tree", d.treeWidget->saveState());
+    settings.insert("hibernate", d.hibernateAfter);
+    settings.insert("memory", MemoryBudget::instance()->budget() / (1024 * 1024));
+    settings.insert("stall", d.watchdog->threshold());
+    settings.insert("highlight", HighlightMatcher::keywords());
+    settings.insert("raw", MessageData::rawPolicy() == MessageData::KeepEventRaw ? "events" : "all");
+    settings.insert("group", TextDocument::groupWindow());
+    settings.insert("runs", TextDocument::directInsert());
+    settings.insert("firehose", QStringList(d.firehoses.toList()));
+    settings.insert("snapshot", d.snapshotInterval);
+    settings.insert("preview", LinkPreview::isEnabled());
+    settings.insert("gpu", TextBrowser::acceleration());
+    settings.insert("heat", d.treeWidget->isHeatVisible());
+    settings.insert("motion", AbstractFinder::isAnimated());
+    settings.insert("busy", ActivityMeter::busyRate());
 
     QByteArray data;
     QDataStream out(&data, QIODevice::WriteOnly);
@@ -159,6 +254,28 @@ void ChatPage::restoreSettings(const QByteArray& data)
         d.treeWidget->restoreState(settings.value("tree").toByteArray());
 
     d.timestamp = settings.value("timestamp", "[hh:mm:ss]").toString();
+    d.hibernateAfter = qMax(1, settings.value("hibernate", 15).toInt());
+    MemoryBudget::instance()->setBudget(settings.value("memory", 512).toLongLong() * 1024 * 1024);
+    d.watchdog->setThreshold(settings.value("stall", 2000).toInt());
+    HighlightMatcher::setKeywords(settings.value("highlight").toStringList());
+    MessageData::setRawPolicy(settings.value("raw").toString() == "events" ? MessageData::KeepEventRaw : MessageData::KeepAllRaw);
+    TextDocument::setGroupWindow(settings.value("group", 0).toInt());
+    TextDocument::setDirectInsert(settings.value("runs", true).toBool());
+    d.firehoses = settings.value("firehose").toStringList().toSet();
+    d.treeWidget->setHeatVisible(settings.value("heat", false).toBool());
+    AbstractFinder::setAnimated(settings.value("motion", true).toBool());
+    ActivityMeter::setBusyRate(settings.value("busy", 0).toInt());
+    LinkPreview::setEnabled(settings.value("preview", false).toBool());
+    TextBrowser::setAcceleration(settings.value("gpu", false).toBool());
+    foreach (BufferView* view, d.splitView->views())
+        view->textBrowser()->setAccelerated(TextBrowser::acceleration());
+    d.snapshotInterval = qMax(0, settings.value("snapshot", 0).toInt());
+    if (d.snapshotInterval > 0) {
+        d.snapshotTimer->start(d.snapshotInterval * 60 * 1000);
+    } else {
+        d.snapshotTimer->stop();
+        d.snapshot->clear();
+    }
     setTheme(settings.value("theme", "Cute").toString());
 }
 
@@ -168,16 +285,13 @@ QByteArray ChatPage::saveState() const
     state.insert("splitter", QSplitter::saveState());
     state.insert("views", d.splitView->saveState());
 
-    QVariantMap timestamps;
-    foreach (TextDocument* doc, d.documents) {
-        if (doc->latestMessageSeen().isValid()) {
-            IrcBuffer* buffer = doc->buffer();
-            QString id = buffer->connection()->userData().value("uuid").toString();
-            id += "/" + buffer->title();
-            timestamps[id] = doc->latestMessageSeen();
-        }
-    }
-    state.insert("timestamps", timestamps);
+    // read markers live in the seen store, written as they change,
+    // stubs are not tracked so whatever they picked up goes in here
+    foreach (DocumentStub* stub, d.stubs)
+        d.seen->setValue(stateKey(stub->buffer()), stub->latestMessageSeen());
+    d.seen->flush();
+    if (d.snapshotInterval > 0)
+        writeSnapshot(true);
 
     QByteArray data;
     QDataStream out(&data, QIODevice::WriteOnly);
@@ -198,7 +312,12 @@ void ChatPage::restoreState(const QByteArray& data)
     if (state.contains("views"))
         d.splitView->restoreState(state.value("views").toByteArray());
 
-    d.timestamps = state.value("timestamps").toMap();
+    // older versions kept the read markers in the state blob
+    const QVariantMap timestamps = state.value("timestamps").toMap();
+    for (QVariantMap::const_iterator it = timestamps.constBegin(); it != timestamps.constEnd(); ++it) {
+        if (!d.seen->contains(it.key()))
+            d.seen->setValue(it.key(), it.value().toDateTime());
+    }
 
     // restore server buffers
     QList<IrcConnection*> connections = findChildren<IrcConnection*>();
@@ -213,7 +332,53 @@ void ChatPage::restoreState(const QByteArray& data)
 
 bool ChatPage::commandFilter(IrcCommand* command)
 {
-    if (command->type() == IrcCommand::Join) {
+    const QString query = command->parameters().value(0).toLower();
+    if (command->type() == IrcCommand::Stats && query == "overlay") {
+        BufferView* view = d.splitView->currentView();
+        Overlay* overlay = view ? view->findChild<Overlay*>() : 0;
+        if (overlay)
+            overlay->setStatsVisible(!overlay->isStatsVisible());
+        return true;
+    } else if (command->type() == IrcCommand::Stats && (query == "plugins" || query == "perf" || query == "memory" || query == "activity" || query == "startup" || query == "trace" || query == "allocs" || query == "input")) {
+        // answered locally, the server knows nothing about our plugins
+        IrcBuffer* buffer = currentBuffer();
+        if (!buffer)
+            return true;
+        QStringList lines;
+        if (query == "perf") {
+            lines = PerfStats::instance()->report();
+        } else if (query == "memory") {
+            lines = PerfStats::instance()->memoryReport();
+        } else if (query == "activity") {
+            lines = ActivityMeter::instance()->report();
+        } else if (query == "startup") {
+            lines = StartupTimeline::report();
+        } else if (query == "input") {
+            lines = InputLatency::report();
+        } else if (query == "allocs") {
+            lines = AllocStats::report();
+        } else if (query == "trace") {
+            const QString filePath = PerfStats::traceFilePath();
+            if (!Tracer::isEnabled())
+                lines += tr("Tracing is not built in, rebuild with CONFIG+=trace.");
+            else if (Tracer::dump(filePath))
+                lines += tr("Trace written to %1").arg(filePath);
+            else
+                lines += tr("Unable to write %1").arg(filePath);
+        } else {
+            lines = HookStats::instance()->report();
+            if (lines.isEmpty())
+                lines += tr("No plugin calls recorded.");
+        }
+        IrcConnection* connection = buffer->connection();
+        foreach (const QString& line, lines) {
+            IrcMessage* message = IrcMessage::fromParameters("communi", "NOTICE", QStringList() << connection->nickName() << line, connection);
+            foreach (TextDocument* doc, buffer->findChildren<TextDocument*>())
+                doc->receiveMessage(message);
+            delete message;
+        }
+        return true;
+    } else if (command->type() == IrcCommand::Join) {
         if (command->property("TextInput").toBool())
             d.chans += command->toString().split(" ", QString::SkipEmptyParts).value(1);
     } else if (command->type() == IrcCommand::Custom) {
@@ -233,17 +398,27 @@ bool ChatPage::commandFilter(IrcCommand* command)
             const QString target = params.value(0);
             const QString message = QStringList(params.mid(1)).join(" ");
             if (!message.isEmpty()) {
-                IrcCommand* command = IrcCommand::createMessage(target, message);
-                IrcConnection* connection = currentBuffer()->connection();
-                if (connection->sendCommand(command)) {
-                    IrcMessage* msg = command->toMessage(connection->nickName(), connection);
+                IrcBuffer* current = currentBuffer();
+                IrcConnection* connection = current->connection();
+                // one message per target, paced by the connection's send queue
+                const QStringList targets = target.split(",", QString::SkipEmptyParts);
+                SendQueue* queue = SendQueue::instance(connection);
+                const SendQueue::Lane lane = targets.count() > 1 ? SendQueue::Bulk : SendQueue::Interactive;
+                IrcBuffer* first = 0;
+                foreach (const QString& t, targets) {
+                    IrcCommand* command = IrcCommand::createMessage(t, message);
+                    IrcMessage* msg = connection->isConnected() ? queue->echo(command) : 0;
                     if (msg) {
-                        IrcBuffer* buffer = currentBuffer()->model()->add(msg->property("target").toString());
-                        d.splitView->setCurrentBuffer(buffer);
+                        IrcBuffer* buffer = current->model()->add(msg->property("target").toString());
+                        if (!first)
+                            first = buffer;
                         buffer->receiveMessage(msg);
                         msg->deleteLater();
                     }
+                    queue->send(command, lane);
                 }
+                if (first)
+                    d.splitView->setCurrentBuffer(first);
                 d.splitView->currentView()->textInput()->clear();
                 return true;
             }
@@ -253,18 +428,31 @@ bool ChatPage::commandFilter(IrcCommand* command)
             IrcBuffer* buffer = currentBuffer()->model()->add(target);
             if (!message.isEmpty()) {
                 IrcCommand* command = IrcCommand::createMessage(target, message);
-                if (buffer->sendCommand(command)) {
-                    IrcConnection* connection = buffer->connection();
-                    IrcMessage* msg = command->toMessage(connection->nickName(), connection);
-                    if (msg) {
-                        buffer->receiveMessage(msg);
-                        msg->deleteLater();
-                    }
+                SendQueue* queue = SendQueue::instance(buffer->connection());
+                IrcMessage* msg = buffer->connection()->isConnected() ? queue->echo(command) : 0;
+                if (msg) {
+                    buffer->receiveMessage(msg);
+                    msg->deleteLater();
                 }
+                queue->send(command);
             }
             d.splitView->currentView()->textInput()->clear();
             d.splitView->setCurrentBuffer(buffer);
             return true;
+        } else if (cmd == "FIREHOSE") {
+            // bot feeds are shown a few frames a second, see TextDocument::setFirehose()
+            IrcBuffer* buffer = currentBuffer();
+            const QString value = params.value(0).toLower();
+            const bool firehose = value.isEmpty() ? !buffer->property("firehose").toBool() : value != "off";
+            if (firehose)
+                d.firehoses.insert(stateKey(buffer));
+            else
+                d.firehoses.remove(stateKey(buffer));
+            buffer->setProperty("firehose", firehose);
+            foreach (TextDocument* doc, buffer->findChildren<TextDocument*>())
+                doc->setFirehose(firehose);
+            d.splitView->currentView()->textInput()->clear();
+            return true;
         } else if (cmd == "SET") {
             const QString key = params.value(0).toLower();
             const QString value = QStringList(params.mid(1)).join(" ");
@@ -281,6 +469,44 @@ bool ChatPage::commandFilter(IrcCommand* command)
                 else
                     f.setFamily(value);
                 d.splitView->currentView()->textBrowser()->setFont(f);
+            } else if (!key.compare("highlight")) {
+                // highlights on the nick plus these, as whole words
+                HighlightMatcher::setKeywords(value.split(QRegExp("[\\s,]+"), QString::SkipEmptyParts));
+            } else if (!key.compare("raw")) {
+                // "events" keeps raw lines only where a tooltip can expand them
+                MessageData::setRawPolicy(!value.compare("events", Qt::CaseInsensitive) ? MessageData::KeepEventRaw : MessageData::KeepAllRaw);
+            } else if (!key.compare("group")) {
+                // seconds within which a sender's lines share a block, 0 turns it off
+                TextDocument::setGroupWindow(value.toInt() * 1000);
+            } else if (!key.compare("runs")) {
+                // "off" hands every line to the html importer instead of inserting text runs
+                TextDocument::setDirectInsert(value.compare("off", Qt::CaseInsensitive));
+            } else if (!key.compare("gpu")) {
+                // opengl viewports for the text browsers
+                TextBrowser::setAcceleration(!value.compare("on", Qt::CaseInsensitive));
+                foreach (BufferView* view, d.splitView->views())
+                    view->textBrowser()->setAccelerated(TextBrowser::acceleration());
+            } else if (!key.compare("motion")) {
+                // "off" shows and hides the finders without sliding
+                AbstractFinder::setAnimated(value.compare("off", Qt::CaseInsensitive));
+            } else if (!key.compare("heat")) {
+                // tints the views in the tree by their message rate
+                d.treeWidget->setHeatVisible(!value.compare("on", Qt::CaseInsensitive));
+            } else if (!key.compare("busy")) {
+                // messages per minute that put a view in firehose mode, 0 turns it off
+                ActivityMeter::setBusyRate(value.toInt());
+            } else if (!key.compare("preview")) {
+                // titles and thumbnails below the first link of a message
+                LinkPreview::setEnabled(!value.compare("on", Qt::CaseInsensitive));
+            } else if (!key.compare("snapshot")) {
+                // minutes between session snapshots, 0 turns warm starts off
+                d.snapshotInterval = qMax(0, value.toInt());
+                if (d.snapshotInterval > 0) {
+                    d.snapshotTimer->start(d.snapshotInterval * 60 * 1000);
+                } else {
+                    d.snapshotTimer->stop();
+                    d.snapshot->clear();
+                }
             }
             return true;
         }
@@ -319,9 +545,13 @@ void ChatPage::addConnection(IrcConnection* connection)
         d.treeWidget->setCurrentBuffer(serverBuffer);
 
     connection->installCommandFilter(this);
-    if (!connection->isActive() && connection->isEnabled() && !QSettings().value("offline", false).toBool())
+    JoinPacer::instance(connection);
+    Handshake::instance(connection);
+    if (!connection->isActive() && connection->isEnabled() && !SettingsCache::instance()->value("offline", false).toBool())
         connection->open();
 
+    PerfStats::instance()->addConnection(connection);
+    CoreServer::instance()->addConnection(connection);
     PluginLoader::instance()->connectionAdded(connection);
 }
 
@@ -336,6 +566,8 @@ void ChatPage::removeConnection(IrcConnection* connection)
     }
     connection->deleteLater();
 
+    PerfStats::instance()->removeConnection(connection);
+    CoreServer::instance()->removeConnection(connection);
     PluginLoader::instance()->connectionRemoved(connection);
 }
 
@@ -352,20 +584,28 @@ void ChatPage::closeBuffer(IrcBuffer* buffer)
 
 void ChatPage::addBuffer(IrcBuffer* buffer)
 {
-    TextDocument* doc = new TextDocument(buffer);
+    // the document is created on first view or first message worth a line,
+    // until then the stub holds the seen time and whatever trickles in
+    DocumentStub* stub = new DocumentStub(buffer);
     buffer->setPersistent(true);
+    if (d.firehoses.contains(stateKey(buffer)))
+        buffer->setProperty("firehose", true);
 
-    d.treeWidget->addBuffer(buffer);
-    d.splitView->addBuffer(buffer);
+    stub->setLatestMessageSeen(d.seen->value(stateKey(buffer)));
+    d.stubs.insert(stub);
+    connect(stub, SIGNAL(documentRequested(IrcBuffer*)), this, SLOT(createDocument(IrcBuffer*)));
 
+    // plugins see the buffer before any of its documents
     PluginLoader::instance()->bufferAdded(buffer);
 
-    QString id = buffer->connection()->userData().value("uuid").toString();
-    id += "/" + buffer->title();
-    doc->setLatestMessageSeen(d.timestamps.value(id).toDateTime());
+    // server buffers get the connection errors and are shown first anyway
+    if (buffer->isSticky())
+        stub->request();
 
-    setupDocument(doc);
-    PluginLoader::instance()->documentAdded(doc);
+    d.treeWidget->addBuffer(buffer);
+    d.splitView->addBuffer(buffer);
+    d.finder->addBuffer(buffer);
+    ActivityMeter::instance()->addBuffer(buffer);
 
     connect(buffer, SIGNAL(destroyed(IrcBuffer*)), this, SLOT(removeBuffer(IrcBuffer*)));
 
@@ -375,16 +615,46 @@ void ChatPage::addBuffer(IrcBuffer* buffer)
     }
 }
 
+void ChatPage::createDocument(IrcBuffer* buffer)
+{
+    DocumentStub* stub = DocumentStub::find(buffer);
+    if (!stub || !buffer->findChildren<TextDocument*>().isEmpty())
+        return;
+
+    TextDocument* doc = new TextDocument(buffer);
+    doc->setLatestMessageSeen(stub->latestMessageSeen());
+
+    // the snapshot goes in first, so that the log tail skips what it holds
+    const QString key = stateKey(buffer);
+    if (d.snapshotInterval > 0 && d.snapshot->contains(key)) {
+        QList<int> highlights;
+        const QList<MessageData> rows = d.snapshot->take(key, &highlights);
+        doc->restoreSnapshot(rows, highlights);
+    }
+
+    setupDocument(doc);
+    PluginLoader::instance()->documentAdded(doc);
+
+    d.stubs.remove(stub);
+    stub->replay(doc);
+}
+
 void ChatPage::removeBuffer(IrcBuffer* buffer)
 {
+    d.stubs.remove(DocumentStub::find(buffer));
+
     QList<TextDocument*> documents = buffer->findChildren<TextDocument*>();
     foreach (TextDocument* doc, documents) {
         d.documents.remove(doc);
+        BadgeCounter::instance()->remove(doc);
+        doc->releaseCaches();
         PluginLoader::instance()->documentRemoved(doc);
     }
 
     d.treeWidget->removeBuffer(buffer);
     d.splitView->removeBuffer(buffer);
+    d.finder->removeBuffer(buffer);
+    ActivityMeter::instance()->removeBuffer(buffer);
 
     if (buffer->isSticky())
         buffer->connection()->deleteLater();
@@ -397,18 +667,31 @@ void ChatPage::setupDocument(TextDocument* document)
     d.documents.insert(document);
 
     document->setTimeStampFormat(d.timestamp);
-    document->setStyleSheet(d.theme.style());
+    document->setStyleSheet(d.theme.documentStyle());
 
     connect(document, SIGNAL(messageReceived(IrcMessage*)), this, SLOT(onMessageReceived(IrcMessage*)));
     connect(document, SIGNAL(messageHighlighted(IrcMessage*)), this, SLOT(onAlert(IrcMessage*)));
     connect(document, SIGNAL(privateMessageReceived(IrcMessage*)), this, SLOT(onAlert(IrcMessage*)));
     connect(document, SIGNAL(latestMessageSeenChanged(const QDateTime&)), this, SLOT(onLatestMessageSeenChanged()));
+    connect(document, SIGNAL(cachesReleased()), this, SLOT(onCachesReleased()));
+}
+
+void ChatPage::onCachesReleased()
+{
+    // /CLEAR, hibernation and closing all end up here
+    TextDocument* document = qobject_cast<TextDocument*>(sender());
+    if (document) {
+        d.finder->releaseDocument(document);
+        PluginLoader::instance()->documentReleased(document);
+    }
 }
 
 void ChatPage::addView(BufferView* view)
 {
     TitleBar* bar = view->titleBar();
     bar->setStyleSheet(d.theme.style());
+    // pooled views may come back from before a /SET gpu
+    view->textBrowser()->setAccelerated(TextBrowser::acceleration());
 
 #if QT_VERSION >= 0x050300 && !defined(Q_OS_MAC)
     view->textBrowser()->verticalScrollBar()->setStyle(ScrollBarStyle::expanding());
@@ -444,6 +727,9 @@ void ChatPage::onCurrentBufferChanged(IrcBuffer* buffer)
                 handler->setCurrentBuffer(buffer);
         }
         d.currentBuffer = buffer;
+        d.finder->visitBuffer(buffer);
+        FlushScheduler::instance()->setCurrentBuffer(buffer);
+        TaskScheduler::instance()->schedule(TaskScheduler::Pacing, this, "prewarmDocuments", PrewarmDelay);
     }
 }
 
@@ -454,6 +740,83 @@ void ChatPage::onCurrentViewChanged(BufferView* current, BufferView* previous)
     emit currentViewChanged(current);
 }
 
+void ChatPage::hibernateIdleDocuments()
+{
+    // busy buffers pile up layout the fastest, hidden ones sleep after a minute
+    const qint64 idle = d.hibernateAfter * 60 * 1000;
+    const int busy = ActivityMeter::busyRate();
+    foreach (TextDocument* doc, d.documents) {
+        if (doc->isClone() || doc->isHibernated())
+            continue;
+        const bool busier = busy > 0 && ActivityMeter::instance()->rate(doc->buffer()) >= busy;
+        if (doc->idleTime() > (busier ? qMin<qint64>(idle, 60 * 1000) : idle))
+            doc->hibernate();
+    }
+}
+
+void ChatPage::prewarmDocuments()
+{
+    // idle time only, what is still queued goes first
+    FlushScheduler* scheduler = FlushScheduler::instance();
+    if (scheduler->isSuspended())
+        return;
+    if (scheduler->queueDepth() > 0) {
+        TaskScheduler::instance()->schedule(TaskScheduler::Pacing, this, "prewarmDocuments", PrewarmDelay);
+        return;
+    }
+
+    // highlights and unread first, then alt+up/down and the usual suspects
+    QList<IrcBuffer*> buffers;
+    const QList<IrcBuffer*> candidates = d.treeWidget->likelyBuffers(PrewarmCount) + d.finder->frequentBuffers(PrewarmCount + 1);
+    foreach (IrcBuffer* buffer, candidates) {
+        if (buffer && buffer != d.currentBuffer && !buffers.contains(buffer) && buffers.count() < PrewarmCount)
+            buffers += buffer;
+    }
+
+    QList<QPointer<TextDocument> > warmed;
+    foreach (IrcBuffer* buffer, buffers) {
+        DocumentStub* stub = DocumentStub::find(buffer);
+        if (stub)
+            stub->request();
+        foreach (TextDocument* doc, buffer->findChildren<TextDocument*>()) {
+            if (!doc->isClone()) {
+                doc->setWarm(true);
+                warmed += doc;
+            }
+        }
+    }
+    foreach (const QPointer<TextDocument>& doc, d.warmed) {
+        if (doc && !warmed.contains(doc))
+            doc->setWarm(false);
+    }
+    d.warmed = warmed;
+}
+
+void ChatPage::onBufferBusy(IrcBuffer* buffer, bool busy)
+{
+    // views put in firehose mode by hand stay there
+    if (d.firehoses.contains(stateKey(buffer)))
+        return;
+    buffer->setProperty("firehose", busy);
+    foreach (TextDocument* doc, buffer->findChildren<TextDocument*>())
+        doc->setFirehose(busy);
+}
+
+void ChatPage::saveSnapshot()
+{
+    writeSnapshot(false);
+}
+
+void ChatPage::writeSnapshot(bool wait) const
+{
+    foreach (TextDocument* doc, documents()) {
+        QList<int> highlights;
+        const QList<MessageData> rows = doc->snapshot(SnapshotRows, &highlights);
+        d.snapshot->insert(stateKey(doc->buffer()), rows, highlights);
+    }
+    d.snapshot->save(wait);
+}
+
 void ChatPage::onLatestMessageSeenChanged()
 {
     TextDocument* doc = qobject_cast<TextDocument*>(sender());
@@ -461,8 +824,11 @@ void ChatPage::onLatestMessageSeenChanged()
         return;
 
     IrcBuffer* buffer = doc->buffer();
+    d.seen->setValue(stateKey(buffer), doc->latestMessageSeen());
+
     TreeItem* item = d.treeWidget->bufferItem(buffer);
     item->setData(1, TreeRole::Badge, doc->unreadMessages());
+    BadgeCounter::instance()->update(doc);
     if (!doc->unreadMessages()) {
         d.treeWidget->unhighlightItem(item);
         d.treeWidget->noticeItem(item, false);
@@ -477,7 +843,8 @@ void ChatPage::onMessageReceived(IrcMessage* message)
             IrcBuffer* buffer = doc->buffer();
             TreeItem* item = d.treeWidget->bufferItem(buffer);
             if (buffer && item != d.treeWidget->currentItem()) {
-                item->setData(1, TreeRole::Badge, doc->unreadMessages());
+                // the badge follows with the next BadgeCounter snapshot
+                BadgeCounter::instance()->update(doc);
                 if (message->type() == IrcMessage::Notice)
                     d.treeWidget->noticeItem(item);
             }
@@ -485,6 +852,15 @@ void ChatPage::onMessageReceived(IrcMessage* message)
     }
 }
 
+void ChatPage::updateBadges(const QList<TextDocument*>& documents)
+{
+    foreach (TextDocument* doc, documents) {
+        TreeItem* item = d.treeWidget->bufferItem(doc->buffer());
+        if (item && item != d.treeWidget->currentItem())
+            item->setData(1, TreeRole::Badge, doc->unreadMessages());
+    }
+}
+
 void ChatPage::onAlert(IrcMessage* message)
 {
     if (message->type() == IrcMessage::Private || message->type() == IrcMessage::Notice) {
@@ -493,8 +869,10 @@ void ChatPage::onAlert(IrcMessage* message)
         if (doc && !doc->isVisible()) {
             IrcBuffer* buffer = doc->buffer();
             TreeItem* item = d.treeWidget->bufferItem(buffer);
-            if (buffer && item != d.treeWidget->currentItem())
+            if (buffer && item != d.treeWidget->currentItem()) {
                 d.treeWidget->highlightItem(item);
+                TaskScheduler::instance()->schedule(TaskScheduler::Pacing, this, "prewarmDocuments", PrewarmDelay);
+            }
         }
     }
 }
@@ -548,6 +926,18 @@ void ChatPage::onConnected()
             d.treeWidget->unhighlightItem(item);
             d.treeWidget->noticeItem(item, false);
         }
+
+        // restored channels on screen are joined before the rest
+        QStringList visible;
+        IrcBuffer* current = d.treeWidget->currentBuffer();
+        if (current && current->connection() == connection)
+            visible += current->title();
+        foreach (BufferView* view, d.splitView->views()) {
+            IrcBuffer* buffer = view->buffer();
+            if (buffer && buffer->connection() == connection)
+                visible += buffer->title();
+        }
+        JoinPacer::instance(connection)->setPriority(visible);
     }
 }
 
@@ -589,6 +979,7 @@ IrcCommandParser* ChatPage::createParser(QObject *parent)
 
     parser->addCommand(IrcCommand::Custom, "CLEAR");
     parser->addCommand(IrcCommand::Custom, "CLOSE");
+    parser->addCommand(IrcCommand::Custom, "FIREHOSE (<on/off>)");
     parser->addCommand(IrcCommand::Custom, "MSG <user/channel> <message...>");
     parser->addCommand(IrcCommand::Custom, "QUERY <user> (<message...>)");
     parser->addCommand(IrcCommand::Custom, "SET <key> (<value...>)");
@@ -30,18 +30,24 @@
 #define CHATPAGE_H
 
 #include <QSet>
+#include <QPointer>
 #include <QSplitter>
 #include <QDateTime>
 #include <QVariantMap>
 #include <IrcCommandFilter>
 #include "themeinfo.h"
 
+class QTimer;
 class Finder;
+class SeenStore;
+class SessionSnapshot;
+class StallWatchdog;
 class IrcBuffer;
 class SplitView;
 class TreeWidget;
 class BufferView;
 class TextDocument;
+class DocumentStub;
 class IrcConnection;
 class IrcCommandParser;
 
@@ -63,6 +69,8 @@ public:
     BufferView* currentView() const;
     IrcBuffer* currentBuffer() const;
 
+    QList<TextDocument*> documents() const;
+
     QByteArray saveSettings() const;
     void restoreSettings(const QByteArray& data);
 
@@ -88,7 +96,9 @@ private slots:
     void removeConnection(IrcConnection* connection);
     void addView(BufferView* view);
     void removeView(BufferView* view);
+    void createDocument(IrcBuffer* buffer);
     void setupDocument(TextDocument* document);
+    void onCachesReleased();
     void onCurrentBufferChanged(IrcBuffer* buffer);
     void onCurrentViewChanged(BufferView* current, BufferView* previous);
     void onMessageReceived(IrcMessage* message);
@@ -97,9 +107,15 @@ private slots:
     void onSecureError();
     void onConnected();
     void onLatestMessageSeenChanged();
+    void updateBadges(const QList<TextDocument*>& documents);
+    void hibernateIdleDocuments();
+    void prewarmDocuments();
+    void onBufferBusy(IrcBuffer* buffer, bool busy);
+    void saveSnapshot();
 
 private:
     static IrcCommandParser* createParser(QObject* parent);
+    void writeSnapshot(bool wait) const;
 
     struct Private {
         Finder* finder;
@@ -108,9 +124,18 @@ private:
         QStringList chans;
         SplitView* splitView;
         TreeWidget* treeWidget;
-        QVariantMap timestamps;
+        SeenStore* seen;
+        SessionSnapshot* snapshot;
+        QTimer* snapshotTimer;
+        int snapshotInterval;
+        StallWatchdog* watchdog;
         IrcBuffer* currentBuffer;
         QSet<TextDocument*> documents;
+        QSet<DocumentStub*> stubs;
+        QList<QPointer<TextDocument> > warmed;
+        QSet<QString> firehoses;
+        QTimer* hibernateTimer;
+        int hibernateAfter;
     } d;
 };
 
@@ -0,0 +1,15 @@
+######################################################################
+# Communi
+######################################################################
+
+DEPENDPATH += $$PWD
+INCLUDEPATH += $$PWD
+QT += network
+
+HEADERS += $$PWD/coreclient.h
+HEADERS += $$PWD/coreprotocol.h
+HEADERS += $$PWD/coreserver.h
+
+SOURCES += $$PWD/coreclient.cpp
+SOURCES += $$PWD/coreprotocol.cpp
+SOURCES += $$PWD/coreserver.cpp
@@ -0,0 +1,165 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "coreclient.h"
+#include "coreprotocol.h"
+#include <QTextStream>
+#include <QDataStream>
+
+CoreClient::CoreClient(QObject* parent) : QObject(parent)
+{
+    d.synced = false;
+    d.replayed = 0;
+    d.live = 0;
+    d.syncTime = 0;
+    connect(&d.socket, SIGNAL(connected()), this, SLOT(onConnected()));
+    connect(&d.socket, SIGNAL(disconnected()), this, SLOT(onDisconnected()));
+    connect(&d.socket, SIGNAL(error(QLocalSocket::LocalSocketError)), this, SLOT(onDisconnected()));
+    connect(&d.socket, SIGNAL(readyRead()), this, SLOT(receive()));
+}
+
+bool CoreClient::isSynced() const
+{
+    return d.synced;
+}
+
+void CoreClient::attach(const QString& name)
+{
+    d.synced = false;
+    d.replayed = 0;
+    d.live = 0;
+    d.clock.start();
+    d.socket.abort();
+    d.socket.connectToServer(name);
+}
+
+void CoreClient::detach()
+{
+    d.socket.disconnectFromServer();
+}
+
+void CoreClient::report()
+{
+    QTextStream out(stdout);
+    out << "attached to " << d.socket.serverName() << " in " << d.syncTime << " ms" << endl;
+    out << "  connections: " << d.names.count() << endl;
+    foreach (const QString& uuid, d.names.keys())
+        out << "    " << d.names.value(uuid) << ": up to line " << d.since.value(uuid) << endl;
+    out << "  backlog lines: " << d.replayed << endl;
+    out << "  live lines: " << d.live << endl;
+}
+
+void CoreClient::onConnected()
+{
+    QByteArray frame;
+    QDataStream out(&frame, QIODevice::WriteOnly);
+    out << quint8(CoreProtocol::Attach) << CoreProtocol::Version << d.session << d.since;
+    CoreProtocol::writeFrame(&d.socket, frame);
+}
+
+void CoreClient::onDisconnected()
+{
+    // a failed attach reports both an error and a disconnect
+    if (d.socket.state() == QLocalSocket::ConnectedState || !d.clock.isValid())
+        return;
+    d.clock.invalidate();
+    d.synced = false;
+    emit detached();
+}
+
+void CoreClient::receive()
+{
+    QByteArray frame;
+    bool invalid = false;
+    while (CoreProtocol::readFrame(&d.socket, &frame, &invalid)) {
+        QDataStream in(frame);
+        quint8 type = 0;
+        in >> type;
+        switch (type) {
+        case CoreProtocol::Welcome: {
+            quint16 version = 0;
+            QString session;
+            in >> version >> session;
+            // a restarted core numbers its lines from scratch
+            if (session != d.session) {
+                d.session = session;
+                d.since.clear();
+                d.names.clear();
+            }
+            break;
+        }
+        case CoreProtocol::ConnectionAdded: {
+            QString uuid, name;
+            in >> uuid >> name;
+            d.names.insert(uuid, name);
+            emit connectionAdded(uuid, name);
+            break;
+        }
+        case CoreProtocol::ConnectionRemoved: {
+            QString uuid;
+            in >> uuid;
+            d.names.remove(uuid);
+            d.since.remove(uuid);
+            emit connectionRemoved(uuid);
+            break;
+        }
+        case CoreProtocol::Message: {
+            QString uuid;
+            qint64 serial = 0;
+            QByteArray data;
+            in >> uuid >> serial >> data;
+            if (serial <= d.since.value(uuid, 0))
+                break;
+            d.since.insert(uuid, serial);
+            if (d.synced)
+                ++d.live;
+            else
+                ++d.replayed;
+            emit messageReceived(uuid, data);
+            break;
+        }
+        case CoreProtocol::Synced:
+            d.synced = true;
+            d.syncTime = d.clock.elapsed();
+            emit synced();
+            break;
+        default:
+            invalid = true;
+            break;
+        }
+        if (invalid || in.status() != QDataStream::Ok) {
+            invalid = true;
+            break;
+        }
+    }
+
+    if (invalid) {
+        qWarning("Detaching from a core that sent an invalid frame");
+        d.socket.abort();
+    }
+}
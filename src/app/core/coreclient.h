@@ -0,0 +1,81 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CORECLIENT_H
+#define CORECLIENT_H
+
+#include <QHash>
+#include <QObject>
+#include <QByteArray>
+#include <QLocalSocket>
+#include <QElapsedTimer>
+
+// attaches to a core over a local socket, attaching again after a detach
+// only fetches the lines that arrived in the meantime
+class CoreClient : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit CoreClient(QObject* parent = 0);
+
+    bool isSynced() const;
+
+    void attach(const QString& name);
+    void detach();
+
+public slots:
+    void report();
+
+signals:
+    void connectionAdded(const QString& uuid, const QString& name);
+    void connectionRemoved(const QString& uuid);
+    void messageReceived(const QString& uuid, const QByteArray& data);
+    void synced();
+    void detached();
+
+private slots:
+    void onConnected();
+    void onDisconnected();
+    void receive();
+
+private:
+    struct Private {
+        QLocalSocket socket;
+        QString session;
+        QHash<QString, qint64> since;
+        QHash<QString, QString> names;
+        bool synced;
+        int replayed;
+        int live;
+        QElapsedTimer clock;
+        qint64 syncTime;
+    } d;
+};
+
+#endif // CORECLIENT_H
@@ -0,0 +1,58 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "coreprotocol.h"
+#include <QtEndian>
+
+void CoreProtocol::writeFrame(QIODevice* device, const QByteArray& frame)
+{
+    uchar size[4];
+    qToBigEndian<quint32>(frame.size(), size);
+    device->write(reinterpret_cast<const char*>(size), 4);
+    device->write(frame);
+}
+
+bool CoreProtocol::readFrame(QIODevice* device, QByteArray* frame, bool* invalid)
+{
+    *invalid = false;
+    if (device->bytesAvailable() < 4)
+        return false;
+
+    const QByteArray header = device->peek(4);
+    const quint32 size = qFromBigEndian<quint32>(reinterpret_cast<const uchar*>(header.constData()));
+    if (size > MaximumFrame) {
+        *invalid = true;
+        return false;
+    }
+    if (device->bytesAvailable() < 4 + size)
+        return false;
+
+    device->read(4);
+    *frame = device->read(size);
+    return true;
+}
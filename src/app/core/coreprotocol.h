@@ -0,0 +1,59 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef COREPROTOCOL_H
+#define COREPROTOCOL_H
+
+#include <QByteArray>
+#include <QIODevice>
+
+// frames on the local socket are a quint32 size followed by a QDataStream
+// payload that starts with a quint8 type and carries the fields below
+class CoreProtocol
+{
+public:
+    enum Type {
+        Attach = 1,         // quint16 version, QString session, QHash<QString, qint64> last serial per connection
+        Welcome,            // quint16 version, QString session
+        ConnectionAdded,    // QString uuid, QString display name
+        ConnectionRemoved,  // QString uuid
+        Message,            // QString uuid, qint64 serial, QByteArray IrcMessage::toData()
+        Synced              // the backlog is over, live lines follow
+    };
+
+    static const quint16 Version = 1;
+    static const quint32 MaximumFrame = 1 << 20;
+
+    static void writeFrame(QIODevice* device, const QByteArray& frame);
+
+    // false until a whole frame has arrived, or with *invalid set when the
+    // peer announced a frame larger than MaximumFrame
+    static bool readFrame(QIODevice* device, QByteArray* frame, bool* invalid);
+};
+
+#endif // COREPROTOCOL_H
@@ -0,0 +1,242 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "coreserver.h"
+#include "coreprotocol.h"
+#include <QCoreApplication>
+#include <IrcConnection>
+#include <IrcMessage>
+#include <QDataStream>
+#include <QDateTime>
+#include <QUuid>
+
+// lines kept per connection for GUIs that attach later
+static const int BacklogLines = 4096;
+// a GUI that falls this far behind is dropped, it attaches again incrementally
+static const qint64 MaximumPending = 8 * 1024 * 1024;
+
+static QString connectionId(IrcConnection* connection)
+{
+    return connection->userData().value("uuid").toString();
+}
+
+static QByteArray messageFrame(const QString& uuid, qint64 serial, const QByteArray& data)
+{
+    QByteArray frame;
+    QDataStream out(&frame, QIODevice::WriteOnly);
+    out << quint8(CoreProtocol::Message) << uuid << serial << data;
+    return frame;
+}
+
+CoreServer* CoreServer::instance()
+{
+    static QPointer<CoreServer> server;
+    if (!server)
+        server = new CoreServer(QCoreApplication::instance());
+    return server;
+}
+
+CoreServer::CoreServer(QObject* parent) : QObject(parent)
+{
+    d.session = QUuid::createUuid().toString();
+    connect(&d.server, SIGNAL(newConnection()), this, SLOT(accept()));
+}
+
+bool CoreServer::listen(const QString& name)
+{
+    // a core that crashed leaves its socket file behind
+    QLocalServer::removeServer(name);
+    d.server.setSocketOptions(QLocalServer::UserAccessOption);
+    if (!d.server.listen(name)) {
+        qWarning("Unable to listen on %s: %s", qPrintable(name), qPrintable(d.server.errorString()));
+        return false;
+    }
+    return true;
+}
+
+bool CoreServer::isListening() const
+{
+    return d.server.isListening();
+}
+
+void CoreServer::addConnection(IrcConnection* connection)
+{
+    if (d.backlogs.contains(connection))
+        return;
+
+    Backlog backlog;
+    backlog.uuid = connectionId(connection);
+    backlog.serial = 0;
+    d.backlogs.insert(connection, backlog);
+    d.connections += connection;
+    connect(connection, SIGNAL(messageReceived(IrcMessage*)), this, SLOT(record(IrcMessage*)));
+
+    QByteArray frame;
+    QDataStream out(&frame, QIODevice::WriteOnly);
+    out << quint8(CoreProtocol::ConnectionAdded) << backlog.uuid << connection->displayName();
+    broadcast(frame);
+}
+
+void CoreServer::removeConnection(IrcConnection* connection)
+{
+    if (!d.backlogs.contains(connection))
+        return;
+
+    const QString uuid = d.backlogs.take(connection).uuid;
+    d.connections.removeAll(connection);
+    disconnect(connection, SIGNAL(messageReceived(IrcMessage*)), this, SLOT(record(IrcMessage*)));
+
+    QByteArray frame;
+    QDataStream out(&frame, QIODevice::WriteOnly);
+    out << quint8(CoreProtocol::ConnectionRemoved) << uuid;
+    broadcast(frame);
+}
+
+void CoreServer::accept()
+{
+    while (QLocalSocket* client = d.server.nextPendingConnection()) {
+        connect(client, SIGNAL(readyRead()), this, SLOT(receive()));
+        connect(client, SIGNAL(disconnected()), this, SLOT(drop()));
+    }
+}
+
+void CoreServer::receive()
+{
+    QLocalSocket* client = qobject_cast<QLocalSocket*>(sender());
+    if (!client)
+        return;
+
+    QByteArray frame;
+    bool invalid = false;
+    while (CoreProtocol::readFrame(client, &frame, &invalid)) {
+        QDataStream in(frame);
+        quint8 type = 0;
+        in >> type;
+        if (type != CoreProtocol::Attach || d.attached.contains(client)) {
+            invalid = true;
+            break;
+        }
+
+        quint16 version = 0;
+        QString session;
+        QHash<QString, qint64> since;
+        in >> version >> session >> since;
+        if (in.status() != QDataStream::Ok || version != CoreProtocol::Version) {
+            invalid = true;
+            break;
+        }
+        attach(client, session, since);
+    }
+
+    if (invalid) {
+        qWarning("Dropping a GUI that sent an invalid frame");
+        client->disconnectFromServer();
+    }
+}
+
+void CoreServer::drop()
+{
+    QLocalSocket* client = qobject_cast<QLocalSocket*>(sender());
+    if (client) {
+        d.attached.removeAll(client);
+        client->deleteLater();
+    }
+}
+
+void CoreServer::record(IrcMessage* message)
+{
+    if (!isListening())
+        return;
+
+    IrcConnection* connection = qobject_cast<IrcConnection*>(sender());
+    if (!connection || !d.backlogs.contains(connection))
+        return;
+
+    // MessageData may release the raw bytes once formatted, keep our own copy
+    Backlog& backlog = d.backlogs[connection];
+    Line line;
+    line.serial = ++backlog.serial;
+    line.data = message->toData();
+    backlog.lines.enqueue(line);
+    while (backlog.lines.count() > BacklogLines)
+        backlog.lines.dequeue();
+
+    broadcast(messageFrame(backlog.uuid, line.serial, line.data));
+}
+
+void CoreServer::attach(QLocalSocket* client, const QString& session, const QHash<QString, qint64>& since)
+{
+    QByteArray welcome;
+    QDataStream out(&welcome, QIODevice::WriteOnly);
+    out << quint8(CoreProtocol::Welcome) << CoreProtocol::Version << d.session;
+    send(client, welcome);
+
+    // serials from another core session mean nothing here, replay everything
+    const bool incremental = session == d.session;
+    foreach (IrcConnection* connection, d.connections) {
+        if (!connection)
+            continue;
+        const Backlog& backlog = d.backlogs[connection];
+
+        QByteArray added;
+        QDataStream stream(&added, QIODevice::WriteOnly);
+        stream << quint8(CoreProtocol::ConnectionAdded) << backlog.uuid << connection->displayName();
+        send(client, added);
+
+        const qint64 last = incremental ? since.value(backlog.uuid, 0) : 0;
+        foreach (const Line& line, backlog.lines) {
+            if (line.serial > last)
+                send(client, messageFrame(backlog.uuid, line.serial, line.data));
+        }
+    }
+
+    QByteArray synced;
+    QDataStream end(&synced, QIODevice::WriteOnly);
+    end << quint8(CoreProtocol::Synced);
+    send(client, synced);
+    d.attached += client;
+}
+
+void CoreServer::send(QLocalSocket* client, const QByteArray& frame)
+{
+    CoreProtocol::writeFrame(client, frame);
+}
+
+void CoreServer::broadcast(const QByteArray& frame)
+{
+    foreach (QLocalSocket* client, d.attached) {
+        if (client->bytesToWrite() > MaximumPending) {
+            qWarning("Dropping a GUI that fell behind");
+            d.attached.removeAll(client);
+            client->abort();
+            client->deleteLater();
+            continue;
+        }
+        send(client, frame);
+    }
+}
@@ -0,0 +1,92 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CORESERVER_H
+#define CORESERVER_H
+
+#include <QHash>
+#include <QList>
+#include <QQueue>
+#include <QObject>
+#include <QPointer>
+#include <QByteArray>
+#include <QLocalServer>
+#include <QLocalSocket>
+
+class IrcMessage;
+class IrcConnection;
+
+// keeps a backlog of the raw lines per connection and serves it to GUIs
+// attaching over a local socket, followed by the live lines
+class CoreServer : public QObject
+{
+    Q_OBJECT
+
+public:
+    static CoreServer* instance();
+
+    bool listen(const QString& name);
+    bool isListening() const;
+
+    void addConnection(IrcConnection* connection);
+    void removeConnection(IrcConnection* connection);
+
+private slots:
+    void accept();
+    void receive();
+    void drop();
+    void record(IrcMessage* message);
+
+private:
+    CoreServer(QObject* parent = 0);
+
+    void attach(QLocalSocket* client, const QString& session, const QHash<QString, qint64>& since);
+    void send(QLocalSocket* client, const QByteArray& frame);
+    void broadcast(const QByteArray& frame);
+
+    struct Line {
+        qint64 serial;
+        QByteArray data;
+    };
+
+    struct Backlog {
+        QString uuid;
+        qint64 serial;
+        QQueue<Line> lines;
+    };
+
+    struct Private {
+        QString session;
+        QLocalServer server;
+        QHash<IrcConnection*, Backlog> backlogs;
+        QList<QPointer<IrcConnection> > connections;
+        QList<QLocalSocket*> attached;
+    } d;
+};
+
+#endif // CORESERVER_H
@@ -29,12 +29,14 @@
 
 #ifdef QT_MULTIMEDIA_LIB
 #include <QMediaPlayer>
+#include <QSoundEffect>
 #endif
 
-Alert::Alert(QObject* parent) : QObject(parent), player(0)
+Alert::Alert(QObject* parent) : QObject(parent), player(0), effect(0)
 {
 #ifdef QT_MULTIMEDIA_LIB
     player = new QMediaPlayer(this);
+    effect = new QSoundEffect(this);
 #endif
 }
 
@@ -57,7 +59,15 @@ void Alert::setFilePath(const QString& filePath)
     if (fp != filePath) {
         fp = filePath;
 #if defined(QT_MULTIMEDIA_LIB)
-        player->setMedia(QUrl::fromLocalFile(fp));
+        // wave samples are decoded once up front and play with low latency,
+        // anything else goes through the media player
+        if (fp.endsWith(".wav", Qt::CaseInsensitive)) {
+            player->setMedia(QMediaContent());
+            effect->setSource(QUrl::fromLocalFile(fp));
+        } else {
+            effect->setSource(QUrl());
+            player->setMedia(QUrl::fromLocalFile(fp));
+        }
 #endif
     }
 }
@@ -65,6 +75,12 @@ void Alert::setFilePath(const QString& filePath)
 void Alert::play()
 {
 #ifdef QT_MULTIMEDIA_LIB
-    player->play();
+    // an alert that is still playing is not restarted or overlapped
+    if (effect->source().isValid()) {
+        if (!effect->isPlaying())
+            effect->play();
+    } else if (player->state() != QMediaPlayer::PlayingState) {
+        player->play();
+    }
 #endif
 }
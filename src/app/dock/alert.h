@@ -31,6 +31,7 @@
 #include <QObject>
 
 QT_FORWARD_DECLARE_CLASS(QMediaPlayer)
+QT_FORWARD_DECLARE_CLASS(QSoundEffect)
 
 class Alert : public QObject
 {
@@ -51,6 +52,7 @@ public slots:
 private:
     QString fp;
     QMediaPlayer* player;
+    QSoundEffect* effect;
 };
 
 #endif // ALERT_H
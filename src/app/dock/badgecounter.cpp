@@ -0,0 +1,114 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "badgecounter.h"
+#include "textdocument.h"
+#include "taskscheduler.h"
+#include <QCoreApplication>
+
+// snapshots are published at most four times per second
+static const int PublishInterval = 250;
+
+BadgeCounter::BadgeCounter(QObject* parent) : QObject(parent)
+{
+    d.unread = 0;
+    d.alerts = 0;
+    d.changed = false;
+}
+
+BadgeCounter* BadgeCounter::instance()
+{
+    static BadgeCounter* counter = new BadgeCounter(qApp);
+    return counter;
+}
+
+int BadgeCounter::unreadCount() const
+{
+    return d.unread;
+}
+
+int BadgeCounter::alertCount() const
+{
+    return d.alerts;
+}
+
+void BadgeCounter::update(TextDocument* document)
+{
+    if (!document || document->isClone())
+        return;
+
+    int& count = d.counts[document];
+    const int unread = document->unreadMessages();
+    d.unread += unread - count;
+    count = unread;
+    d.dirty.insert(document);
+    schedule();
+}
+
+void BadgeCounter::remove(TextDocument* document)
+{
+    if (d.counts.contains(document)) {
+        d.unread -= d.counts.take(document);
+        d.dirty.remove(document);
+        schedule();
+    }
+}
+
+void BadgeCounter::alert()
+{
+    ++d.alerts;
+    schedule();
+}
+
+void BadgeCounter::clearAlerts()
+{
+    if (d.alerts) {
+        d.alerts = 0;
+        schedule();
+    }
+}
+
+void BadgeCounter::schedule()
+{
+    // a pending publish is not pushed back, so a steady stream still gets published
+    d.changed = true;
+    TaskScheduler::instance()->schedule(TaskScheduler::Pacing, this, "publish", PublishInterval);
+}
+
+void BadgeCounter::publish()
+{
+    if (!d.dirty.isEmpty()) {
+        QList<TextDocument*> documents = d.dirty.toList();
+        d.dirty.clear();
+        emit documentsChanged(documents);
+    }
+    if (d.changed) {
+        d.changed = false;
+        emit countsChanged(d.unread, d.alerts);
+    }
+}
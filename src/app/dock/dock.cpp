@@ -30,24 +30,30 @@
 #include "alert.h"
 #include "mainwindow.h"
 #include "sharedtimer.h"
+#include "badgecounter.h"
 #include "qtdocktile.h"
 #include "pluginloader.h"
+#include "taskscheduler.h"
+#include "settingscache.h"
 #include <QStandardPaths>
 #include <IrcTextFormat>
 #include <IrcConnection>
 #include <QApplication>
 #include <IrcMessage>
-#include <QSettings>
 #include <QMenu>
 #include <QFile>
 #include <QDir>
 
+// alerts of a burst are gathered this long before they are shown
+static const int NotifyDelay = 500;
+
 Dock::Dock(MainWindow* window) : QObject(window)
 {
     d.tray = 0;
     d.muteAction = 0;
     d.offlineAction = 0;
     d.alert = 0;
+    d.icon = 0;
     d.blink = false;
     d.blinking = false;
     d.window = window;
@@ -56,11 +62,13 @@ Dock::Dock(MainWindow* window) : QObject(window)
     connect(window, SIGNAL(activated()), this, SLOT(onWindowActivated()));
     connect(window, SIGNAL(connectionAdded(IrcConnection*)), this, SLOT(onConnectionAdded(IrcConnection*)));
     connect(window, SIGNAL(connectionRemoved(IrcConnection*)), this, SLOT(onConnectionRemoved(IrcConnection*)));
+    connect(BadgeCounter::instance(), SIGNAL(countsChanged(int,int)), this, SLOT(updateBadge(int,int)));
 
     if (QtDockTile::isAvailable())
         d.dock = new QtDockTile(window);
 
-    QSettings settings;
+    SettingsCache* settings = SettingsCache::instance();
+    d.alertInterval = settings->value("alertInterval", 3000).toInt();
 
     if (QSystemTrayIcon::isSystemTrayAvailable()) {
         d.tray = new QSystemTrayIcon(this);
@@ -76,12 +84,13 @@ Dock::Dock(MainWindow* window) : QObject(window)
         d.offlineAction = menu->addAction(tr("Offline"));
         d.offlineAction->setCheckable(true);
 
-        d.muteAction->setChecked(settings.value("mute", false).toBool());
+        d.muteAction->setChecked(settings->value("mute", false).toBool());
         connect(d.muteAction, SIGNAL(toggled(bool)), this, SLOT(onMuteToggled(bool)));
-        d.offlineAction->setChecked(settings.value("offline", false).toBool());
+        d.offlineAction->setChecked(settings->value("offline", false).toBool());
         connect(d.offlineAction, SIGNAL(toggled(bool)), this, SLOT(onOfflineToggled(bool)));
 
         d.tray->setIcon(d.offlineIcon);
+        d.icon = &d.offlineIcon;
         d.tray->setVisible(true);
 
         connect(d.tray, SIGNAL(activated(QSystemTrayIcon::ActivationReason)),
@@ -96,7 +105,7 @@ Dock::Dock(MainWindow* window) : QObject(window)
         // Set up mute action even when system tray is not available, for plugins that may rely on it.
         QAction *muteAction = new QAction("Mute", this);
         muteAction->setCheckable(true);
-        muteAction->setChecked(settings.value("mute", false).toBool());
+        muteAction->setChecked(settings->value("mute", false).toBool());
         connect(muteAction, SIGNAL(toggled(bool)), this, SLOT(onMuteToggled(bool)));
         PluginLoader::instance()->setupMuteAction(muteAction);
     }
@@ -107,9 +116,13 @@ Dock::Dock(MainWindow* window) : QObject(window)
         QDir dataDir(QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation) +
             QStringLiteral("/data/%1/%2").arg(QCoreApplication::organizationName(), QCoreApplication::applicationName()));
         if (dataDir.exists() || dataDir.mkpath(".")) {
-            QString filePath = dataDir.filePath("alert.mp3");
-            if (!QFile::exists(filePath))
-                QFile::copy(":/alert.mp3", filePath);
+            // a wave sample dropped next to it is preferred, see Alert
+            QString filePath = dataDir.filePath("alert.wav");
+            if (!QFile::exists(filePath)) {
+                filePath = dataDir.filePath("alert.mp3");
+                if (!QFile::exists(filePath))
+                    QFile::copy(":/alert.mp3", filePath);
+            }
             d.alert->setFilePath(filePath);
         }
     }
@@ -123,49 +136,124 @@ Dock::~Dock()
 void Dock::alert(IrcMessage* message)
 {
     if (!d.window->isActiveWindow() || d.active) {
+        BadgeCounter::instance()->alert();
+        if (d.tray)
+            queueNotification(message);
+
+        // a burst only plays and blinks once per interval
+        if (d.alertTime.isValid() && d.alertTime.elapsed() < d.alertInterval)
+            return;
+        d.alertTime.start();
+
         QApplication::alert(d.window);
         if (d.alert && (!d.muteAction || !d.muteAction->isChecked()))
             d.alert->play();
         if (d.tray && !d.blinking) {
-            PluginLoader::instance()->dockAlert(message);
             SharedTimer::instance()->registerReceiver(this, "updateTray");
             d.blinking = true;
             d.blink = true;
             updateTray();
         }
-        updateBadge();
+    }
+}
+
+void Dock::queueNotification(IrcMessage* message)
+{
+    // one notification per buffer, about its latest alert
+    QString buffer = message->nick();
+    if (message->type() == IrcMessage::Private && !static_cast<IrcPrivateMessage*>(message)->isPrivate())
+        buffer = static_cast<IrcPrivateMessage*>(message)->target();
+    else if (message->type() == IrcMessage::Notice && !static_cast<IrcNoticeMessage*>(message)->isPrivate())
+        buffer = static_cast<IrcNoticeMessage*>(message)->target();
+
+    int index = 0;
+    while (index < d.notifications.count() && (d.notifications.at(index).connection != message->connection()
+                                                || d.notifications.at(index).buffer != buffer))
+        ++index;
+    if (index == d.notifications.count()) {
+        Notification notification;
+        notification.buffer = buffer;
+        notification.connection = message->connection();
+        notification.count = 0;
+        d.notifications += notification;
+    }
+    d.notifications[index].data = message->toData();
+    ++d.notifications[index].count;
+
+    // native notifications go out at most once per alert interval
+    int delay = NotifyDelay;
+    if (d.notifyTime.isValid())
+        delay = qMax<qint64>(delay, d.alertInterval - d.notifyTime.elapsed());
+    TaskScheduler::instance()->schedule(TaskScheduler::Pacing, this, "notify", delay);
+}
+
+void Dock::notify()
+{
+    d.notifyTime.start();
+    const QList<Notification> notifications = d.notifications;
+    d.notifications.clear();
+
+    // plugins tell "n new messages in buffer" from the collapsed count
+    foreach (const Notification& notification, notifications) {
+        if (!notification.connection)
+            continue;
+        IrcMessage* message = IrcMessage::fromData(notification.data, notification.connection);
+        if (message) {
+            message->setProperty("buffer", notification.buffer);
+            message->setProperty("collapsed", notification.count - 1);
+            PluginLoader::instance()->dockAlert(message);
+            delete message;
+        }
     }
 }
 
 void Dock::onConnectionAdded(IrcConnection* connection)
 {
-    connect(connection, SIGNAL(statusChanged(IrcConnection::Status)), this, SLOT(updateTray()));
+    connect(connection, SIGNAL(statusChanged(IrcConnection::Status)), this, SLOT(onStatusChanged()));
+    if (connection->isConnected())
+        d.online.insert(connection);
     updateTray();
 }
 
 void Dock::onConnectionRemoved(IrcConnection* connection)
 {
-    disconnect(connection, SIGNAL(statusChanged(IrcConnection::Status)), this, SLOT(updateTray()));
+    disconnect(connection, SIGNAL(statusChanged(IrcConnection::Status)), this, SLOT(onStatusChanged()));
+    d.online.remove(connection);
     updateTray();
 }
 
-void Dock::updateBadge()
+void Dock::onStatusChanged()
 {
-    if (d.dock)
-        d.dock->setBadge(d.dock->badge() + 1);
+    IrcConnection* connection = qobject_cast<IrcConnection*>(sender());
+    if (!connection)
+        return;
+
+    const int count = d.online.count();
+    if (connection->isConnected())
+        d.online.insert(connection);
+    else
+        d.online.remove(connection);
+    if (d.online.count() != count)
+        updateTray();
+}
+
+void Dock::updateBadge(int unread, int alerts)
+{
+    // published by BadgeCounter, which coalesces alert storms
+    if (d.dock && d.dock->badge() != alerts)
+        d.dock->setBadge(alerts);
+    PluginLoader::instance()->dockBadgeChanged(unread, alerts);
 }
 
 void Dock::updateTray()
 {
     if (d.tray) {
-        bool online = false;
-        foreach (IrcConnection* connection, d.window->connections()) {
-            if (connection->isConnected()) {
-                online = true;
-                break;
-            }
+        // runs on every blink tick, the online set is kept by onStatusChanged()
+        const QIcon* icon = d.blinking && d.blink ? &d.alertIcon : !d.online.isEmpty() ? &d.onlineIcon : &d.offlineIcon;
+        if (icon != d.icon) {
+            d.tray->setIcon(*icon);
+            d.icon = icon;
         }
-        d.tray->setIcon(d.blinking && d.blink ? d.alertIcon : online ? d.onlineIcon : d.offlineIcon);
         d.blink = !d.blink;
     }
 }
@@ -182,26 +270,30 @@ void Dock::deactivateAlert()
 
 void Dock::onWindowActivated()
 {
+    // whatever was about to be shown is seen now
+    TaskScheduler::instance()->unschedule(this, "notify");
+    d.notifications.clear();
     if (d.tray && d.blinking) {
         SharedTimer::instance()->unregisterReceiver(this, "updateTray");
         d.blinking = false;
         d.blink = false;
         updateTray();
     }
+    BadgeCounter::instance()->clearAlerts();
     if (d.dock)
         d.dock->setBadge(0);
 }
 
 void Dock::onMuteToggled(bool mute)
 {
-    QSettings settings;
-    settings.setValue("mute", mute);
+    SettingsCache* settings = SettingsCache::instance();
+    settings->setValue("mute", mute);
 }
 
 void Dock::onOfflineToggled(bool offline)
 {
-    QSettings settings;
-    settings.setValue("offline", offline);
+    SettingsCache* settings = SettingsCache::instance();
+    settings->setValue("offline", offline);
     if (d.window) {
         foreach (IrcConnection* connection, d.window->connections()) {
             if (offline) {
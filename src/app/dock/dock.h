@@ -31,6 +31,9 @@
 
 #include <QObject>
 #include <QAction>
+#include <QSet>
+#include <QPointer>
+#include <QElapsedTimer>
 #include <QSystemTrayIcon>
 
 class Alert;
@@ -56,8 +59,9 @@ public slots:
 private slots:
     void onConnectionAdded(IrcConnection* connection);
     void onConnectionRemoved(IrcConnection* connection);
+    void onStatusChanged();
 
-    void updateBadge();
+    void updateBadge(int unread, int alerts);
     void updateTray();
 
     void activateAlert();
@@ -69,13 +73,26 @@ private slots:
     void onTrayActivated(QSystemTrayIcon::ActivationReason reason);
     void onTrayMessageClicked();
 
+    void notify();
+
 private:
+    void queueNotification(IrcMessage* message);
+
+    struct Notification {
+        QString buffer;
+        QByteArray data;
+        QPointer<IrcConnection> connection;
+        int count;
+    };
+
     struct Private {
         bool blink;
         bool blinking;
         QIcon alertIcon;
         QIcon onlineIcon;
         QIcon offlineIcon;
+        const QIcon* icon;
+        QSet<IrcConnection*> online;
         MainWindow* window;
         QSystemTrayIcon* tray;
         QtDockTile* dock;
@@ -83,6 +100,10 @@ private:
         QAction* offlineAction;
         Alert* alert;
         bool active;
+        int alertInterval;
+        QElapsedTimer alertTime;
+        QElapsedTimer notifyTime;
+        QList<Notification> notifications;
     } d;
 };
 
@@ -8,8 +8,10 @@ INCLUDEPATH += $$PWD
 RESOURCES += $$PWD/alert.qrc
 
 HEADERS += $$PWD/alert.h
+HEADERS += $$PWD/badgecounter.h
 HEADERS += $$PWD/dock.h
 
 SOURCES += $$PWD/alert.cpp
+SOURCES += $$PWD/badgecounter.cpp
 SOURCES += $$PWD/dock.cpp
 OBJECTIVE_SOURCES += $$PWD/dock_mac.mm
@@ -77,6 +77,8 @@ void Dock::init()
         d.onlineIcon.addFile(":/images/tray/black/black.png");
         d.offlineIcon.addFile(":/images/tray/black/transparent.png");
     }
+    // the next updateTray() sets the restyled icon
+    d.icon = 0;
 }
 
 void Dock::uninit()
@@ -27,8 +27,8 @@
 */
 
 #include "abstractfinder.h"
+#include "taskscheduler.h"
 #include <QPropertyAnimation>
-#include <QGraphicsOpacityEffect>
 #include <QStylePainter>
 #include <QStyleOption>
 #include <QApplication>
@@ -36,6 +36,9 @@
 #include <QKeyEvent>
 #include <QEvent>
 
+// reduced motion, the finders appear and vanish in place
+static bool animations = true;
+
 AbstractFinder::AbstractFinder(QWidget* parent) : QWidget(parent)
 {
     d.offset = -1;
@@ -43,7 +46,6 @@ AbstractFinder::AbstractFinder(QWidget* parent) : QWidget(parent)
     d.filter = false;
 
     parent->installEventFilter(this);
-    setGraphicsEffect(new QGraphicsOpacityEffect(this));
 
     d.lineEdit = new QLineEdit(this);
     d.lineEdit->setAttribute(Qt::WA_MacShowFocusRect, false);
@@ -68,6 +70,13 @@ AbstractFinder::AbstractFinder(QWidget* parent) : QWidget(parent)
 
     connect(d.lineEdit, SIGNAL(returnPressed()), this, SIGNAL(returnPressed()));
     connect(d.lineEdit, SIGNAL(textEdited(QString)), this, SLOT(textEdited()));
+
+    // while sliding, an opaque snapshot covers the children so that
+    // only a pixmap is blitted per frame instead of a full repaint
+    d.cover = new QLabel(this);
+    d.cover->setAttribute(Qt::WA_OpaquePaintEvent);
+    d.cover->setAttribute(Qt::WA_TransparentForMouseEvents);
+    d.cover->hide();
 }
 
 AbstractFinder::~AbstractFinder()
@@ -123,6 +132,16 @@ bool AbstractFinder::isFilter() const
     return d.filter;
 }
 
+bool AbstractFinder::isAnimated()
+{
+    return animations;
+}
+
+void AbstractFinder::setAnimated(bool animated)
+{
+    animations = animated;
+}
+
 void AbstractFinder::setFilter(bool enabled)
 {
     if (d.filter != enabled) {
@@ -174,21 +193,42 @@ void AbstractFinder::reFind()
 
 void AbstractFinder::animateShow()
 {
-    QPropertyAnimation *animation = new QPropertyAnimation(this, "offset");
-    animation->setDuration(50);
-    animation->setEndValue(-1);
-    animation->start(QAbstractAnimation::DeleteWhenStopped);
+    // on battery or in the background, the slide is not worth the frames
+    if (!animations || TaskScheduler::instance()->isThrottled()) {
+        setOffset(-1);
+        setVisible(true);
+        return;
+    }
+    slide(-1);
     setVisible(true);
 }
 
 void AbstractFinder::animateHide()
 {
+    if (!animations || TaskScheduler::instance()->isThrottled()) {
+        hide();
+        deleteLater();
+        return;
+    }
+    QPropertyAnimation* animation = slide(-sizeHint().height());
+    connect(animation, SIGNAL(destroyed()), this, SLOT(hide()));
+    connect(animation, SIGNAL(destroyed()), this, SLOT(deleteLater()));
+}
+
+QPropertyAnimation* AbstractFinder::slide(int offset)
+{
+    d.cover->hide();
+    d.cover->setGeometry(rect());
+    d.cover->setPixmap(grab());
+    d.cover->raise();
+    d.cover->show();
+
     QPropertyAnimation *animation = new QPropertyAnimation(this, "offset");
     animation->setDuration(50);
-    animation->setEndValue(-sizeHint().height());
+    animation->setEndValue(offset);
+    connect(animation, SIGNAL(finished()), d.cover, SLOT(hide()));
     animation->start(QAbstractAnimation::DeleteWhenStopped);
-    connect(animation, SIGNAL(destroyed()), this, SLOT(hide()));
-    connect(animation, SIGNAL(destroyed()), this, SLOT(deleteLater()));
+    return animation;
 }
 
 void AbstractFinder::textEdited()
@@ -29,9 +29,12 @@
 #ifndef ABSTRACTFINDER_H
 #define ABSTRACTFINDER_H
 
+#include <QLabel>
 #include <QLineEdit>
 #include <QToolButton>
 
+class QPropertyAnimation;
+
 class AbstractFinder : public QWidget
 {
     Q_OBJECT
@@ -56,6 +59,9 @@ public:
 
     bool isFilter() const;
 
+    static bool isAnimated();
+    static void setAnimated(bool animated);
+
 public slots:
     void setFilter(bool filter);
 
@@ -85,6 +91,8 @@ private slots:
     void textEdited();
 
 private:
+    QPropertyAnimation* slide(int offset);
+
     struct Private {
         int offset;
         bool error;
@@ -92,6 +100,7 @@ private:
         QLineEdit* lineEdit;
         QToolButton* prevButton;
         QToolButton* nextButton;
+        QLabel* cover;
     } d;
 };
 
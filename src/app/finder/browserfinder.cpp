@@ -28,16 +28,27 @@
 #include "browserfinder.h"
 #include "textbrowser.h"
 #include "textdocument.h"
+#include "searchquery.h"
 #include <QWidgetAction>
 #include <QActionGroup>
+#include <QTimerEvent>
 #include <QTextBlock>
+#include <QScrollBar>
 #include <QDebug>
 #include <QMenu>
+#include <algorithm>
+
+// keystrokes within this many milliseconds are searched at once
+static const int DebounceInterval = 150;
 
 BrowserFinder::BrowserFinder(TextBrowser* browser) : AbstractFinder(browser)
 {
     d.textBrowser = browser;
+    d.stale = true;
+    d.plainQuery = true;
     connect(browser, SIGNAL(documentChanged(TextDocument*)), this, SLOT(deleteLater()));
+    connect(browser->document(), SIGNAL(contentsChanged()), this, SLOT(invalidate()));
+    connect(browser->verticalScrollBar(), SIGNAL(valueChanged(int)), this, SLOT(updateSelections()));
     connect(this, SIGNAL(returnPressed()), this, SLOT(findNext()));
 
     QMenu *menu = new QMenu(this);
@@ -60,6 +71,12 @@ BrowserFinder::BrowserFinder(TextBrowser* browser) : AbstractFinder(browser)
     QWidgetAction *action = new QWidgetAction(this);
     action->setDefaultWidget(d.menuButton);
     lineEdit()->addAction(action, QLineEdit::LeadingPosition);
+
+    d.countLabel = new QLabel(lineEdit());
+    d.countLabel->setObjectName("count");
+    QWidgetAction *count = new QWidgetAction(this);
+    count->setDefaultWidget(d.countLabel);
+    lineEdit()->addAction(count, QLineEdit::TrailingPosition);
 }
 
 BrowserFinder::~BrowserFinder()
@@ -69,6 +86,10 @@ BrowserFinder::~BrowserFinder()
 void BrowserFinder::setVisible(bool visible)
 {
     AbstractFinder::setVisible(visible);
+
+    // the matches are searched in the text of the blocks, so every row is filled meanwhile
+    if (d.textBrowser)
+        d.textBrowser->setViewportLimited(!visible);
     if (!visible && d.textBrowser) {
         QTextCursor cursor = d.textBrowser->textCursor();
         if (cursor.hasSelection()) {
@@ -76,14 +97,12 @@ void BrowserFinder::setVisible(bool visible)
             d.textBrowser->setTextCursor(cursor);
         }
         d.textBrowser->setExtraSelections(QList<QTextEdit::ExtraSelection>());
-
-        QTextDocument* doc = d.textBrowser->document();
-        for (QTextBlock block = doc->begin(); block != doc->end(); block = block.next()) {
-            if (!block.isVisible()) {
-                block.setVisible(true);
-                doc->markContentsDirty(block.position(), block.length());
-            }
-        }
+        d.debounce.stop();
+        d.query.clear();
+        d.matches.clear();
+        d.lengths.clear();
+        d.textBrowser->setSearchRows(QList<int>());
+        updateVisibility(true);
     }
 }
 
@@ -92,105 +111,197 @@ void BrowserFinder::find(const QString& text, bool forward, bool backward, bool
     if (!d.textBrowser)
         return;
 
+    // typing is coalesced, stepping through the matches is not
+    if (typed && !forward && !backward) {
+        d.pending = text;
+        d.debounce.start(DebounceInterval, this);
+        return;
+    }
+    search(text, forward, backward, typed);
+}
+
+void BrowserFinder::timerEvent(QTimerEvent* event)
+{
+    if (event->timerId() == d.debounce.timerId()) {
+        d.debounce.stop();
+        if (d.textBrowser)
+            search(d.pending, false, false, true);
+        return;
+    }
+    AbstractFinder::timerEvent(event);
+}
+
+void BrowserFinder::search(const QString& text, bool forward, bool backward, bool typed)
+{
     QTextDocument* doc = d.textBrowser->document();
     QTextCursor cursor = d.textBrowser->textCursor();
 
     bool error = false;
-    QTextDocument::FindFlags options;
 
     if (cursor.hasSelection())
         cursor.setPosition(typed ? cursor.selectionEnd() : forward ? cursor.position() : cursor.anchor(), QTextCursor::MoveAnchor);
 
-    QTextCursor newCursor = cursor;
-    QList<QTextEdit::ExtraSelection> extraSelections;
+    updateMatches(text);
 
+    QTextCursor newCursor = cursor;
     if (!text.isEmpty()) {
-        if (typed || backward)
-            options |= QTextDocument::FindBackward;
-
-        newCursor = doc->find(text, cursor, options);
-
-        if (newCursor.isNull()) {
-            QTextCursor ac(doc);
-            ac.movePosition(options & QTextDocument::FindBackward
-                            ? QTextCursor::End : QTextCursor::Start);
-            newCursor = doc->find(text, ac, options);
-            if (newCursor.isNull()) {
-                error = true;
-                newCursor = cursor;
+        if (d.matches.isEmpty()) {
+            error = true;
+        } else {
+            // the index is sorted by position, so the next match is a binary search away
+            const int from = cursor.position();
+            int index = 0;
+            if (typed || backward) {
+                index = int(std::lower_bound(d.matches.constBegin(), d.matches.constEnd(), from) - d.matches.constBegin()) - 1;
+                if (index < 0)
+                    index = d.matches.count() - 1;
+            } else {
+                index = int(std::lower_bound(d.matches.constBegin(), d.matches.constEnd(), from) - d.matches.constBegin());
+                if (index >= d.matches.count())
+                    index = 0;
             }
-        }
-
-        QTextCursor findCursor(doc);
-        while (!(findCursor = doc->find(text, findCursor)).isNull()) {
-            QTextEdit::ExtraSelection extra;
-            extra.format.setBackground(Qt::yellow);
-            extra.cursor = findCursor;
-            extraSelections.append(extra);
+            newCursor = QTextCursor(doc);
+            newCursor.setPosition(d.matches.at(index));
+            newCursor.setPosition(d.matches.at(index) + d.lengths.at(index), QTextCursor::KeepAnchor);
         }
     }
 
     if (!isVisible())
         animateShow();
     d.textBrowser->setTextCursor(newCursor);
-    d.textBrowser->setExtraSelections(extraSelections);
+    updateSelections();
     setError(error);
 }
 
-void BrowserFinder::filter(const QString& text)
+void BrowserFinder::updateMatches(const QString& text)
+{
+    if (d.stale) {
+        d.plainText = d.textBrowser->document()->toPlainText();
+        d.query.clear();
+        d.stale = false;
+    }
+
+    const SearchQuery query(text);
+    if (text.isEmpty() || !query.isValid()) {
+        d.matches.clear();
+        d.lengths.clear();
+    } else if (!query.isPlain()) {
+        // field filters are checked against the rows, terms against the plain block text
+        d.matches.clear();
+        d.lengths.clear();
+        TextDocument* doc = d.textBrowser->document();
+        for (QTextBlock block = doc->begin(); block.isValid(); block = block.next()) {
+            const QString blockText = block.text();
+            if (!query.matches(doc->message(block.blockNumber()), blockText))
+                continue;
+            QList<QPair<int, int> > spans = query.ranges(blockText);
+            if (spans.isEmpty())
+                spans += qMakePair(0, blockText.length());
+            for (int i = 0; i < spans.count(); ++i) {
+                d.matches += block.position() + spans.at(i).first;
+                d.lengths += spans.at(i).second;
+            }
+        }
+    } else if (d.plainQuery && !d.query.isEmpty() && text.startsWith(d.query, Qt::CaseInsensitive)) {
+        // an extended query can only match where the previous one did
+        QVector<int> matches;
+        foreach (int pos, d.matches) {
+            if (d.plainText.midRef(pos, text.length()).compare(text, Qt::CaseInsensitive) == 0)
+                matches += pos;
+        }
+        d.matches = matches;
+        d.lengths.fill(text.length(), matches.count());
+    } else {
+        // overlapping matches are kept so that narrowing stays exact
+        d.matches.clear();
+        int pos = 0;
+        while ((pos = d.plainText.indexOf(text, pos, Qt::CaseInsensitive)) != -1)
+            d.matches += pos++;
+        d.lengths.fill(text.length(), d.matches.count());
+    }
+    d.query = text;
+    d.plainQuery = query.isPlain();
+    d.countLabel->setText(text.isEmpty() ? QString() : QString::number(d.matches.count()));
+
+    // the matches are sorted, so each block is looked up once for the scroll bar
+    QList<int> rows;
+    QTextBlock block;
+    foreach (int pos, d.matches) {
+        if (!block.isValid() || pos >= block.position() + block.length()) {
+            block = d.textBrowser->document()->findBlock(pos);
+            if (block.isValid())
+                rows += block.blockNumber();
+        }
+    }
+    d.textBrowser->setSearchRows(rows);
+}
+
+void BrowserFinder::invalidate()
+{
+    // positions shift as blocks come and go, the mirror is rebuilt on demand
+    d.stale = true;
+}
+
+void BrowserFinder::updateSelections()
 {
     if (!d.textBrowser)
         return;
+    if (d.stale && !d.query.isEmpty())
+        updateMatches(d.query);
 
-    QTextDocument* doc = d.textBrowser->document();
-
-    bool error = true;
     QList<QTextEdit::ExtraSelection> extraSelections;
+    if (!d.matches.isEmpty()) {
+        QWidget* viewport = d.textBrowser->viewport();
+        const int first = d.textBrowser->cursorForPosition(QPoint(0, 0)).block().position();
+        const QTextBlock end = d.textBrowser->cursorForPosition(QPoint(viewport->width(), viewport->height())).block();
+        const int last = end.position() + end.length();
 
-    if (!text.isEmpty()) {
-        QTextCursor prevCursor(doc);
-        QTextCursor findCursor(doc);
-        while (!(findCursor = doc->find(text, findCursor)).isNull()) {
-            error = false;
-            findCursor.block().setVisible(true);
-            doc->markContentsDirty(findCursor.block().position(), findCursor.block().length());
+        QTextDocument* doc = d.textBrowser->document();
+        int index = int(std::lower_bound(d.matches.constBegin(), d.matches.constEnd(), first) - d.matches.constBegin());
+        for (; index < d.matches.count() && d.matches.at(index) < last; ++index) {
             QTextEdit::ExtraSelection extra;
             extra.format.setBackground(Qt::yellow);
-            extra.cursor = findCursor;
+            extra.cursor = QTextCursor(doc);
+            extra.cursor.setPosition(d.matches.at(index));
+            extra.cursor.setPosition(d.matches.at(index) + d.lengths.at(index), QTextCursor::KeepAnchor);
             extraSelections.append(extra);
-            while (prevCursor.blockNumber() < findCursor.blockNumber()) {
-                QTextBlock block = prevCursor.block();
-                block.setVisible(false);
-                doc->markContentsDirty(block.position(), block.length());
-                if (!prevCursor.movePosition(QTextCursor::NextBlock))
-                    break;
-            }
-            prevCursor = findCursor;
-            prevCursor.movePosition(QTextCursor::NextBlock);
-        }
-        while (!prevCursor.atEnd()) {
-            QTextBlock block = prevCursor.block();
-            if (block.isVisible()) {
-                block.setVisible(false);
-                doc->markContentsDirty(block.position(), block.length());
-            }
-            if (!prevCursor.movePosition(QTextCursor::NextBlock))
-                break;
-        }
-    } else {
-        error = false;
-        for (QTextBlock block = doc->begin(); block != doc->end(); block = block.next()) {
-            if (!block.isVisible()) {
-                block.setVisible(true);
-                doc->markContentsDirty(block.position(), block.length());
-            }
         }
     }
+    d.textBrowser->setExtraSelections(extraSelections);
+}
+
+void BrowserFinder::filter(const QString& text)
+{
+    if (!d.textBrowser)
+        return;
+
+    updateMatches(text);
+    updateVisibility(text.isEmpty());
 
     if (!isVisible())
         animateShow();
-    d.textBrowser->setExtraSelections(extraSelections);
-    setError(error);
+    updateSelections();
+    setError(!text.isEmpty() && d.matches.isEmpty());
+}
+
+void BrowserFinder::updateVisibility(bool all)
+{
+    // one pass over the blocks and the sorted matches, and a single relayout
+    QTextDocument* doc = d.textBrowser->document();
+    QVector<int>::const_iterator it = d.matches.constBegin();
+    bool changed = false;
+    for (QTextBlock block = doc->begin(); block.isValid(); block = block.next()) {
+        const int end = block.position() + block.length();
+        bool visible = all;
+        for (; it != d.matches.constEnd() && *it < end; ++it)
+            visible = true;
+        if (block.isVisible() != visible) {
+            block.setVisible(visible);
+            changed = true;
+        }
+    }
+    if (changed)
+        doc->markContentsDirty(0, doc->characterCount());
 }
 
 void BrowserFinder::relocate()
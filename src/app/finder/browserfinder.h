@@ -30,6 +30,9 @@
 #define BROWSERFINDER_H
 
 #include "abstractfinder.h"
+#include <QBasicTimer>
+#include <QVector>
+#include <QLabel>
 
 class TextBrowser;
 
@@ -48,10 +51,30 @@ protected slots:
     void filter(const QString &text);
     void relocate();
 
+protected:
+    void timerEvent(QTimerEvent* event);
+
+private slots:
+    void invalidate();
+    void updateSelections();
+
 private:
+    void search(const QString& text, bool forward, bool backward, bool typed);
+    void updateMatches(const QString& text);
+    void updateVisibility(bool all);
+
     struct Private {
         TextBrowser* textBrowser;
         QToolButton* menuButton;
+        QLabel* countLabel;
+        QBasicTimer debounce;
+        QString pending;
+        bool stale;
+        QString plainText;
+        QString query;
+        bool plainQuery;
+        QVector<int> matches;
+        QVector<int> lengths;
     } d;
 };
 
@@ -27,6 +27,9 @@
 */
 
 #include "finder.h"
+#include "globalsearch.h"
+#include "quickswitcher.h"
+#include "switchindex.h"
 #include "chatpage.h"
 #include "browserfinder.h"
 #include "textbrowser.h"
@@ -37,6 +40,7 @@
 #include "textinput.h"
 #include "listview.h"
 #include <QApplication>
+#include <QDateTime>
 #include <QTimer>
 
 Finder::Finder(ChatPage* page) : QObject(page)
@@ -46,6 +50,9 @@ Finder::Finder(ChatPage* page) : QObject(page)
     d.nextShortcut = 0;
     d.prevShortcut = 0;
     d.lastSearch = NoSearch;
+    d.globalSearch = 0;
+    d.switchIndex = new SwitchIndex(this);
+    d.quickSwitcher = 0;
 
     QShortcut* shortcut = new QShortcut(QKeySequence::Find, page);
     connect(shortcut, SIGNAL(activated()), this, SLOT(searchBrowser()));
@@ -56,6 +63,12 @@ Finder::Finder(ChatPage* page) : QObject(page)
     shortcut = new QShortcut(QKeySequence("Ctrl+U"), page);
     connect(shortcut, SIGNAL(activated()), this, SLOT(searchList()));
 
+    shortcut = new QShortcut(QKeySequence("Ctrl+Shift+F"), page);
+    connect(shortcut, SIGNAL(activated()), this, SLOT(searchAll()));
+
+    shortcut = new QShortcut(QKeySequence("Ctrl+K"), page);
+    connect(shortcut, SIGNAL(activated()), this, SLOT(switchBuffer()));
+
     d.cancelShortcut = new QShortcut(Qt::Key_Escape, page);
     d.cancelShortcut->setEnabled(false);
     connect(d.cancelShortcut, SIGNAL(activated()), this, SLOT(cancelTreeSearch()));
@@ -112,6 +125,56 @@ void Finder::searchBrowser(BufferView* view)
     }
 }
 
+void Finder::searchAll()
+{
+    cancelTreeSearch();
+    cancelListSearch();
+    cancelBrowserSearch();
+    if (!d.globalSearch)
+        d.globalSearch = new GlobalSearch(d.page);
+    d.globalSearch->popup();
+}
+
+void Finder::switchBuffer()
+{
+    cancelTreeSearch();
+    cancelListSearch();
+    cancelBrowserSearch();
+    if (d.globalSearch)
+        d.globalSearch->hide();
+    if (!d.quickSwitcher)
+        d.quickSwitcher = new QuickSwitcher(d.page, d.switchIndex);
+    d.quickSwitcher->popup();
+}
+
+QList<IrcBuffer*> Finder::frequentBuffers(int limit) const
+{
+    // an empty query ranks by frecency alone
+    return d.switchIndex->match(QString(), limit, QDateTime::currentMSecsSinceEpoch());
+}
+
+void Finder::addBuffer(IrcBuffer* buffer)
+{
+    // the index follows every buffer, the palette only reads it
+    d.switchIndex->insert(buffer);
+}
+
+void Finder::removeBuffer(IrcBuffer* buffer)
+{
+    d.switchIndex->remove(buffer);
+}
+
+void Finder::visitBuffer(IrcBuffer* buffer)
+{
+    d.switchIndex->visit(buffer);
+}
+
+void Finder::releaseDocument(TextDocument* document)
+{
+    if (d.globalSearch)
+        d.globalSearch->releaseDocument(document);
+}
+
 void Finder::findAgain()
 {
     switch (d.lastSearch) {
@@ -35,8 +35,13 @@
 #include <QShortcut>
 
 class ChatPage;
+class IrcBuffer;
 class BufferView;
+class GlobalSearch;
+class SwitchIndex;
+class QuickSwitcher;
 class AbstractFinder;
+class TextDocument;
 
 class Finder : public QObject
 {
@@ -45,6 +50,8 @@ class Finder : public QObject
 public:
     explicit Finder(ChatPage* page);
 
+    QList<IrcBuffer*> frequentBuffers(int limit) const;
+
 public slots:
     void searchTree();
     void cancelTreeSearch();
@@ -55,6 +62,14 @@ public slots:
     void searchBrowser(BufferView* view = 0);
     void cancelBrowserSearch(BufferView* view = 0);
 
+    void searchAll();
+    void switchBuffer();
+
+    void addBuffer(IrcBuffer* buffer);
+    void removeBuffer(IrcBuffer* buffer);
+    void visitBuffer(IrcBuffer* buffer);
+    void releaseDocument(TextDocument* document);
+
 private slots:
     void findAgain();
     void findNext();
@@ -77,6 +92,9 @@ private:
         QShortcut* cancelShortcut;
         SearchMode lastSearch;
         QPointer<AbstractFinder> currentFinder;
+        GlobalSearch* globalSearch;
+        SwitchIndex* switchIndex;
+        QuickSwitcher* quickSwitcher;
     } d;
 };
 
@@ -8,11 +8,21 @@ INCLUDEPATH += $$PWD
 HEADERS += $$PWD/abstractfinder.h
 HEADERS += $$PWD/browserfinder.h
 HEADERS += $$PWD/finder.h
+HEADERS += $$PWD/globalsearch.h
 HEADERS += $$PWD/listfinder.h
+HEADERS += $$PWD/quickswitcher.h
+HEADERS += $$PWD/searchquery.h
+HEADERS += $$PWD/switchindex.h
+HEADERS += $$PWD/titleindex.h
 HEADERS += $$PWD/treefinder.h
 
 SOURCES += $$PWD/abstractfinder.cpp
 SOURCES += $$PWD/browserfinder.cpp
 SOURCES += $$PWD/finder.cpp
+SOURCES += $$PWD/globalsearch.cpp
 SOURCES += $$PWD/listfinder.cpp
+SOURCES += $$PWD/quickswitcher.cpp
+SOURCES += $$PWD/searchquery.cpp
+SOURCES += $$PWD/switchindex.cpp
+SOURCES += $$PWD/titleindex.cpp
 SOURCES += $$PWD/treefinder.cpp
@@ -0,0 +1,302 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "globalsearch.h"
+#include "searchquery.h"
+#include "textdocument.h"
+#include "textbrowser.h"
+#include "messagedata.h"
+#include "bufferview.h"
+#include "splitview.h"
+#include "chatpage.h"
+#include <QCoreApplication>
+#include <QListWidgetItem>
+#include <QListWidget>
+#include <QVBoxLayout>
+#include <QTimerEvent>
+#include <QTextCursor>
+#include <QTextBlock>
+#include <QKeyEvent>
+#include <QLineEdit>
+#include <QRunnable>
+#include <IrcMessage>
+#include <IrcBuffer>
+
+// searches start this many milliseconds after the last keystroke
+static const int DebounceInterval = 200;
+// at most this many results are collected per document and listed in total
+static const int MaxDocumentResults = 100;
+static const int MaxResults = 500;
+
+enum ResultRole {
+    TargetRole = Qt::UserRole,
+    RowRole,
+    MSecsRole,
+    DataRole
+};
+
+static QString messageText(IrcMessage* message)
+{
+    if (message->type() == IrcMessage::Private)
+        return static_cast<IrcPrivateMessage*>(message)->content();
+    if (message->type() == IrcMessage::Notice)
+        return static_cast<IrcNoticeMessage*>(message)->content();
+    return message->parameters().join(" ");
+}
+
+class SearchTask : public QRunnable
+{
+public:
+    SearchTask(QObject* receiver, QAtomicInt* current, int generation, int target, const SearchQuery& query, const QList<MessageData>& rows)
+        : m_receiver(receiver), m_current(current), m_generation(generation), m_target(target), m_query(query), m_rows(rows)
+    {
+    }
+
+    void run()
+    {
+        // newest rows first, and give up as soon as the query is superseded
+        QVariantList results;
+        for (int row = m_rows.count() - 1; row >= 0 && results.count() < MaxDocumentResults; --row) {
+            if (m_current->load() != m_generation)
+                return;
+            const MessageData& data = m_rows.at(row);
+            if (data.data().isEmpty())
+                continue;
+            IrcMessage* message = IrcMessage::fromData(data.data(), 0);
+            if (!message)
+                continue;
+            const QString text = messageText(message);
+            delete message;
+            if (!m_query.matches(data, text))
+                continue;
+
+            QVariantMap result;
+            result.insert("row", row);
+            result.insert("msecs", data.msecs());
+            result.insert("nick", data.nick());
+            result.insert("text", text);
+            result.insert("data", data.data());
+            results += result;
+        }
+        if (!results.isEmpty())
+            QMetaObject::invokeMethod(m_receiver, "addResults", Qt::QueuedConnection,
+                                      Q_ARG(int, m_generation), Q_ARG(int, m_target), Q_ARG(QVariantList, results));
+    }
+
+private:
+    QObject* m_receiver;
+    QAtomicInt* m_current;
+    int m_generation;
+    int m_target;
+    SearchQuery m_query;
+    QList<MessageData> m_rows;
+};
+
+GlobalSearch::GlobalSearch(ChatPage* page) : QFrame(page)
+{
+    d.page = page;
+    d.generation.store(0);
+
+    setObjectName("globalSearch");
+    setFrameStyle(QFrame::StyledPanel | QFrame::Raised);
+    setAutoFillBackground(true);
+    hide();
+
+    d.lineEdit = new QLineEdit(this);
+    d.lineEdit->setAttribute(Qt::WA_MacShowFocusRect, false);
+    d.lineEdit->setPlaceholderText(tr("Search all buffers"));
+    d.lineEdit->installEventFilter(this);
+    connect(d.lineEdit, SIGNAL(textEdited(QString)), this, SLOT(textEdited()));
+
+    d.results = new QListWidget(this);
+    d.results->setUniformItemSizes(true);
+    d.results->setAttribute(Qt::WA_MacShowFocusRect, false);
+    connect(d.results, SIGNAL(itemActivated(QListWidgetItem*)), this, SLOT(activate(QListWidgetItem*)));
+
+    QVBoxLayout* layout = new QVBoxLayout(this);
+    layout->addWidget(d.lineEdit);
+    layout->addWidget(d.results);
+    layout->setSpacing(0);
+    layout->setMargin(0);
+}
+
+GlobalSearch::~GlobalSearch()
+{
+    d.generation.ref();
+    d.pool.waitForDone();
+}
+
+bool GlobalSearch::eventFilter(QObject* object, QEvent* event)
+{
+    if (object == d.lineEdit && event->type() == QEvent::KeyPress) {
+        QKeyEvent* ke = static_cast<QKeyEvent*>(event);
+        if (ke->key() == Qt::Key_Escape) {
+            hide();
+            return true;
+        }
+        if (ke->key() == Qt::Key_Down || ke->key() == Qt::Key_Up) {
+            // the list keeps the selection while typing continues
+            QCoreApplication::sendEvent(d.results, event);
+            return true;
+        }
+        if (ke->key() == Qt::Key_Return || ke->key() == Qt::Key_Enter) {
+            activate(d.results->currentItem());
+            return true;
+        }
+    }
+    return QFrame::eventFilter(object, event);
+}
+
+void GlobalSearch::popup()
+{
+    const QRect r = d.page->rect();
+    setGeometry(r.adjusted(r.width() / 5, 0, -r.width() / 5, -r.height() / 3));
+    show();
+    raise();
+    d.lineEdit->setFocus(Qt::ShortcutFocusReason);
+    d.lineEdit->selectAll();
+}
+
+void GlobalSearch::search(const QString& text)
+{
+    // bumping the generation cancels the tasks of the previous query
+    const int generation = d.generation.fetchAndAddOrdered(1) + 1;
+    d.results->clear();
+    d.targets.clear();
+
+    const SearchQuery query(text);
+    if (query.isEmpty() || !query.isValid())
+        return;
+
+    // the workers get snapshots, event groups keep growing on this thread
+    foreach (TextDocument* doc, d.page->documents()) {
+        QList<MessageData> rows;
+        const int count = doc->totalCount();
+        rows.reserve(count);
+        for (int row = 0; row < count; ++row)
+            rows += doc->message(row).snapshot();
+        d.targets += doc;
+        d.pool.start(new SearchTask(this, &d.generation, generation, d.targets.count() - 1, query, rows));
+    }
+}
+
+void GlobalSearch::releaseDocument(TextDocument* document)
+{
+    // the results carry copies of the rows, a cleared buffer takes them along
+    const int target = d.targets.indexOf(document);
+    if (target == -1)
+        return;
+
+    d.targets[target] = 0;
+    for (int i = d.results->count() - 1; i >= 0; --i) {
+        if (d.results->item(i)->data(TargetRole).toInt() == target)
+            delete d.results->takeItem(i);
+    }
+}
+
+void GlobalSearch::timerEvent(QTimerEvent* event)
+{
+    if (event->timerId() == d.debounce.timerId()) {
+        d.debounce.stop();
+        search(d.lineEdit->text());
+        return;
+    }
+    QFrame::timerEvent(event);
+}
+
+void GlobalSearch::textEdited()
+{
+    d.debounce.start(DebounceInterval, this);
+}
+
+void GlobalSearch::addResults(int generation, int target, const QVariantList& results)
+{
+    TextDocument* doc = d.targets.value(target);
+    if (generation != d.generation.load() || !doc)
+        return;
+
+    const QString title = doc->buffer()->title();
+    foreach (const QVariant& value, results) {
+        const QVariantMap result = value.toMap();
+        const qint64 msecs = result.value("msecs").toLongLong();
+
+        // the list stays ranked by recency, newest first
+        int lo = 0, hi = d.results->count();
+        while (lo < hi) {
+            const int mid = (lo + hi) / 2;
+            if (d.results->item(mid)->data(MSecsRole).toLongLong() >= msecs)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        if (lo >= MaxResults)
+            continue;
+
+        const QString time = QDateTime::fromMSecsSinceEpoch(msecs).toString("yyyy-MM-dd hh:mm");
+        QListWidgetItem* item = new QListWidgetItem(tr("%1 [%2] %3: %4").arg(time, title, result.value("nick").toString(), result.value("text").toString()));
+        item->setData(TargetRole, target);
+        item->setData(RowRole, result.value("row"));
+        item->setData(MSecsRole, msecs);
+        item->setData(DataRole, result.value("data"));
+        d.results->insertItem(lo, item);
+        if (d.results->count() > MaxResults)
+            delete d.results->takeItem(d.results->count() - 1);
+    }
+    if (!d.results->currentItem() && d.results->count() > 0)
+        d.results->setCurrentRow(0);
+}
+
+void GlobalSearch::activate(QListWidgetItem* item)
+{
+    if (!item)
+        return;
+    TextDocument* doc = d.targets.value(item->data(TargetRole).toInt());
+    if (!doc)
+        return;
+
+    d.page->splitView()->setCurrentBuffer(doc->buffer());
+    BufferView* view = d.page->currentView();
+    if (!view)
+        return;
+
+    // rows only ever leave from the top, so the message is at or above its old row
+    TextBrowser* browser = view->textBrowser();
+    TextDocument* shown = browser->document();
+    const QByteArray data = item->data(DataRole).toByteArray();
+    for (int row = qMin(item->data(RowRole).toInt(), shown->totalCount() - 1); row >= 0; --row) {
+        if (shown->message(row).data() == data) {
+            const QTextBlock block = shown->findBlockByNumber(row);
+            if (block.isValid()) {
+                browser->setTextCursor(QTextCursor(block));
+                browser->ensureCursorVisible();
+            }
+            break;
+        }
+    }
+    hide();
+}
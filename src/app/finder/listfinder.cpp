@@ -29,10 +29,13 @@
 #include "listfinder.h"
 #include "listview.h"
 #include <Irc>
+#include <algorithm>
 
 ListFinder::ListFinder(ListView* list) : AbstractFinder(list)
 {
     d.list = list;
+    d.model = 0;
+    d.dirty = true;
     connect(this, SIGNAL(returnPressed()), this, SLOT(onReturnPressed()));
 }
 
@@ -42,39 +45,131 @@ void ListFinder::find(const QString& text, bool forward, bool backward, bool typ
     if (!d.list || !d.list->model() || text.isEmpty())
         return;
 
+    updateIndex();
+    const QList<int> rows = matchingRows(text);
     QAbstractItemModel* model = d.list->model();
+    const int current = d.list->currentIndex().row();
     if (typed) {
-        QList<QModelIndex> indexes = model->match(model->index(0, 0), Irc::NameRole, text, -1, Qt::MatchExactly | Qt::MatchWrap);
-        if (indexes.isEmpty())
-            indexes = model->match(model->index(0, 0), Irc::NameRole, text, -1, Qt::MatchContains | Qt::MatchWrap);
-        if (!indexes.isEmpty() && !indexes.contains(d.list->currentIndex()))
-            d.list->setCurrentIndex(indexes.first());
-        setError(indexes.isEmpty());
-    } else {
-        QModelIndex index = d.list->currentIndex();
-        if (index.isValid()) {
-            if (forward)
-                index = index.sibling(index.row() + 1, index.column());
-            else
-                index = index.sibling(index.row() - 1, index.column());
-            bool wrapped = false;
-            while (index.isValid()) {
-                if (index.data(Irc::NameRole).toString().contains(text, Qt::CaseInsensitive)) {
-                    d.list->setCurrentIndex(index);
-                    return;
-                }
-                if (forward)
-                    index = index.sibling(index.row() + 1, index.column());
-                else
-                    index = index.sibling(index.row() - 1, index.column());
-                if (!index.isValid() && !wrapped) {
-                    if (forward)
-                        index = model->index(0, 0);
-                    else
-                        index = model->index(model->rowCount() - 1, 0);
-                    wrapped = true;
-                }
-            }
+        if (!rows.isEmpty() && !rows.contains(current))
+            d.list->setCurrentIndex(model->index(rows.first(), 0));
+        setError(rows.isEmpty());
+    } else if (d.list->currentIndex().isValid() && !rows.isEmpty()) {
+        // the next match in either direction, wrapping around
+        int row = forward ? rows.first() : rows.last();
+        if (forward) {
+            QList<int>::const_iterator it = std::upper_bound(rows.constBegin(), rows.constEnd(), current);
+            if (it != rows.constEnd())
+                row = *it;
+        } else {
+            QList<int>::const_iterator it = std::lower_bound(rows.constBegin(), rows.constEnd(), current);
+            if (it != rows.constBegin())
+                row = *(--it);
+        }
+        d.list->setCurrentIndex(model->index(row, 0));
+    }
+}
+
+QList<int> ListFinder::matchingRows(const QString& text) const
+{
+    // exact names win over partial matches, like the model lookups did
+    QVector<int> ids = d.index.exact(text);
+    if (ids.isEmpty())
+        ids = d.index.contains(text);
+
+    QList<int> rows;
+    foreach (int id, ids) {
+        const QPersistentModelIndex& index = d.rows.at(id);
+        if (index.isValid())
+            rows += index.row();
+    }
+    std::sort(rows.begin(), rows.end());
+    return rows;
+}
+
+void ListFinder::updateIndex()
+{
+    QAbstractItemModel* model = d.list->model();
+    if (model != d.model) {
+        if (d.model)
+            disconnect(d.model, 0, this, 0);
+        d.model = model;
+        d.dirty = true;
+        connect(model, SIGNAL(modelReset()), this, SLOT(invalidate()));
+        connect(model, SIGNAL(rowsInserted(QModelIndex,int,int)), this, SLOT(onRowsInserted(QModelIndex,int,int)));
+        connect(model, SIGNAL(rowsAboutToBeRemoved(QModelIndex,int,int)), this, SLOT(onRowsAboutToBeRemoved(QModelIndex,int,int)));
+        connect(model, SIGNAL(dataChanged(QModelIndex,QModelIndex)), this, SLOT(onDataChanged(QModelIndex,QModelIndex)));
+    }
+
+    if (d.dirty) {
+        d.index.clear();
+        d.rows.clear();
+        d.ids.clear();
+        const int count = model->rowCount();
+        d.rows.reserve(count);
+        for (int row = 0; row < count; ++row)
+            addRow(model->index(row, 0));
+        d.dirty = false;
+    }
+}
+
+void ListFinder::addRow(const QModelIndex& index)
+{
+    const QString name = index.data(Irc::NameRole).toString();
+    const int id = d.rows.count();
+    d.rows += QPersistentModelIndex(index);
+    d.ids.insert(name, id);
+    d.index.insert(id, name);
+}
+
+void ListFinder::invalidate()
+{
+    d.dirty = true;
+}
+
+void ListFinder::onRowsInserted(const QModelIndex& parent, int first, int last)
+{
+    // persistent indexes follow the rows, so only new rows need indexing
+    if (d.dirty || parent.isValid())
+        return;
+    for (int row = first; row <= last; ++row)
+        addRow(d.model->index(row, 0));
+}
+
+void ListFinder::onRowsAboutToBeRemoved(const QModelIndex& parent, int first, int last)
+{
+    if (d.dirty || parent.isValid())
+        return;
+    for (int row = first; row <= last; ++row) {
+        const QString name = d.model->index(row, 0).data(Irc::NameRole).toString();
+        const int id = d.ids.value(name, -1);
+        if (id != -1) {
+            d.ids.remove(name);
+            d.index.remove(id);
+            d.rows[id] = QPersistentModelIndex();
+        }
+    }
+    // rebuilt once mostly holes are left
+    if (d.ids.count() * 2 < d.rows.count())
+        d.dirty = true;
+}
+
+void ListFinder::onDataChanged(const QModelIndex& topLeft, const QModelIndex& bottomRight)
+{
+    // renames are rare, so the old entry is looked up the slow way
+    if (d.dirty || topLeft.parent().isValid())
+        return;
+    for (int row = topLeft.row(); row <= bottomRight.row(); ++row) {
+        const QModelIndex index = d.model->index(row, 0);
+        const QString name = index.data(Irc::NameRole).toString();
+        if (d.ids.contains(name))
+            continue;
+        const int id = d.rows.indexOf(QPersistentModelIndex(index));
+        if (id != -1) {
+            d.ids.remove(d.ids.key(id));
+            d.ids.insert(name, id);
+            d.index.insert(id, name);
+        } else {
+            addRow(index);
         }
     }
 }
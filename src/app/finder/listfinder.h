@@ -30,8 +30,13 @@
 #define LISTFINDER_H
 
 #include "abstractfinder.h"
+#include "titleindex.h"
+#include <QPersistentModelIndex>
+#include <QVector>
+#include <QHash>
 
 class ListView;
+class QAbstractItemModel;
 
 class ListFinder : public AbstractFinder
 {
@@ -46,10 +51,23 @@ protected slots:
 
 private slots:
     void onReturnPressed();
+    void invalidate();
+    void onRowsInserted(const QModelIndex& parent, int first, int last);
+    void onRowsAboutToBeRemoved(const QModelIndex& parent, int first, int last);
+    void onDataChanged(const QModelIndex& topLeft, const QModelIndex& bottomRight);
 
 private:
+    void updateIndex();
+    void addRow(const QModelIndex& index);
+    QList<int> matchingRows(const QString& text) const;
+
     struct Private {
         ListView* list;
+        QAbstractItemModel* model;
+        bool dirty;
+        TitleIndex index;
+        QVector<QPersistentModelIndex> rows;
+        QHash<QString, int> ids;
     } d;
 };
 
@@ -0,0 +1,129 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "quickswitcher.h"
+#include "switchindex.h"
+#include "splitview.h"
+#include "chatpage.h"
+#include <QCoreApplication>
+#include <QListWidgetItem>
+#include <QListWidget>
+#include <QVBoxLayout>
+#include <QDateTime>
+#include <QKeyEvent>
+#include <QLineEdit>
+#include <IrcNetwork>
+#include <IrcBuffer>
+
+// the palette lists no more than this many buffers
+static const int MaxResults = 20;
+
+QuickSwitcher::QuickSwitcher(ChatPage* page, SwitchIndex* index) : QFrame(page)
+{
+    d.page = page;
+    d.index = index;
+
+    setObjectName("quickSwitcher");
+    setFrameStyle(QFrame::StyledPanel | QFrame::Raised);
+    setAutoFillBackground(true);
+    hide();
+
+    d.lineEdit = new QLineEdit(this);
+    d.lineEdit->setAttribute(Qt::WA_MacShowFocusRect, false);
+    d.lineEdit->setPlaceholderText(tr("Switch to view"));
+    d.lineEdit->installEventFilter(this);
+    connect(d.lineEdit, SIGNAL(textEdited(QString)), this, SLOT(refresh()));
+
+    d.results = new QListWidget(this);
+    d.results->setUniformItemSizes(true);
+    d.results->setAttribute(Qt::WA_MacShowFocusRect, false);
+    connect(d.results, SIGNAL(itemActivated(QListWidgetItem*)), this, SLOT(activate(QListWidgetItem*)));
+
+    QVBoxLayout* layout = new QVBoxLayout(this);
+    layout->addWidget(d.lineEdit);
+    layout->addWidget(d.results);
+    layout->setSpacing(0);
+    layout->setMargin(0);
+}
+
+bool QuickSwitcher::eventFilter(QObject* object, QEvent* event)
+{
+    if (object == d.lineEdit && event->type() == QEvent::KeyPress) {
+        QKeyEvent* ke = static_cast<QKeyEvent*>(event);
+        if (ke->key() == Qt::Key_Escape) {
+            hide();
+            return true;
+        }
+        if (ke->key() == Qt::Key_Down || ke->key() == Qt::Key_Up) {
+            QCoreApplication::sendEvent(d.results, event);
+            return true;
+        }
+        if (ke->key() == Qt::Key_Return || ke->key() == Qt::Key_Enter) {
+            activate(d.results->currentItem());
+            return true;
+        }
+    }
+    return QFrame::eventFilter(object, event);
+}
+
+void QuickSwitcher::popup()
+{
+    const QRect r = d.page->rect();
+    setGeometry(r.adjusted(r.width() / 4, 0, -r.width() / 4, -r.height() / 2));
+    d.lineEdit->clear();
+    refresh();
+    show();
+    raise();
+    d.lineEdit->setFocus(Qt::ShortcutFocusReason);
+}
+
+void QuickSwitcher::refresh()
+{
+    // the index answers well within a keystroke, no need to debounce
+    d.results->clear();
+    d.targets.clear();
+    foreach (IrcBuffer* buffer, d.index->match(d.lineEdit->text(), MaxResults, QDateTime::currentMSecsSinceEpoch())) {
+        const QString network = buffer->network()->name();
+        QListWidgetItem* item = new QListWidgetItem(buffer->isSticky() || network.isEmpty() ? buffer->title() : tr("%1 (%2)").arg(buffer->title(), network));
+        item->setData(Qt::UserRole, d.targets.count());
+        d.targets += buffer;
+        d.results->addItem(item);
+    }
+    if (d.results->count() > 0)
+        d.results->setCurrentRow(0);
+}
+
+void QuickSwitcher::activate(QListWidgetItem* item)
+{
+    if (!item)
+        return;
+    IrcBuffer* buffer = d.targets.value(item->data(Qt::UserRole).toInt());
+    if (buffer)
+        d.page->splitView()->setCurrentBuffer(buffer);
+    hide();
+}
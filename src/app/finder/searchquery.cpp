@@ -0,0 +1,249 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "searchquery.h"
+#include "messagedata.h"
+#include <QStringList>
+#include <IrcMessage>
+#include <QHash>
+#include <algorithm>
+
+static QStringList tokenize(const QString& query)
+{
+    // whitespace separates terms, except inside "quoted phrases" and /regexes/
+    QStringList tokens;
+    QString token;
+    QChar quote;
+    for (int i = 0; i < query.length(); ++i) {
+        const QChar c = query.at(i);
+        if (!quote.isNull()) {
+            token += c;
+            if (c == quote)
+                quote = QChar();
+        } else if (c.isSpace()) {
+            if (!token.isEmpty())
+                tokens += token;
+            token.clear();
+        } else {
+            if ((c == QLatin1Char('"') || c == QLatin1Char('/')) && (token.isEmpty() || token == QLatin1String("-") || token.endsWith(QLatin1Char(':'))))
+                quote = c;
+            token += c;
+        }
+    }
+    if (!token.isEmpty())
+        tokens += token;
+    return tokens;
+}
+
+static int messageType(const QString& name)
+{
+    static QHash<QString, int> types;
+    if (types.isEmpty()) {
+        types.insert("message", IrcMessage::Private);
+        types.insert("privmsg", IrcMessage::Private);
+        types.insert("notice", IrcMessage::Notice);
+        types.insert("join", IrcMessage::Join);
+        types.insert("part", IrcMessage::Part);
+        types.insert("quit", IrcMessage::Quit);
+        types.insert("kick", IrcMessage::Kick);
+        types.insert("mode", IrcMessage::Mode);
+        types.insert("nick", IrcMessage::Nick);
+        types.insert("topic", IrcMessage::Topic);
+        types.insert("error", IrcMessage::Error);
+    }
+    return types.value(name.toLower(), -1);
+}
+
+static QDateTime parseTime(const QString& value)
+{
+    QDateTime time = QDateTime::fromString(value, Qt::ISODate);
+    if (time.isValid())
+        return time;
+    const QDate date = QDate::fromString(value, Qt::ISODate);
+    if (date.isValid())
+        return QDateTime(date);
+    const QTime clock = QTime::fromString(value, "hh:mm");
+    if (clock.isValid())
+        return QDateTime(QDate::currentDate(), clock);
+    return QDateTime();
+}
+
+SearchQuery::SearchQuery(const QString& query)
+{
+    d.valid = true;
+    d.plain = true;
+
+    // terms are ANDed, OR starts another group
+    QList<Term> group;
+    int predicates = 0;
+    foreach (const QString& token, tokenize(query)) {
+        if (token == QLatin1String("OR")) {
+            d.plain = false;
+            if (!group.isEmpty())
+                d.groups += group;
+            group.clear();
+            predicates = 0;
+            continue;
+        }
+        Term term;
+        if (!parseTerm(token, &term)) {
+            d.valid = false;
+            continue;
+        }
+        if (term.kind != Term::Text || term.negated || token.startsWith(QLatin1Char('"')))
+            d.plain = false;
+        // cheap metadata predicates are evaluated before any text
+        if (term.kind == Term::Text || term.kind == Term::Regex)
+            group += term;
+        else
+            group.insert(predicates++, term);
+    }
+    if (!group.isEmpty())
+        d.groups += group;
+    if (d.groups.count() != 1 || d.groups.first().count() != 1)
+        d.plain = false;
+}
+
+bool SearchQuery::isEmpty() const
+{
+    return d.groups.isEmpty();
+}
+
+bool SearchQuery::isValid() const
+{
+    return d.valid;
+}
+
+bool SearchQuery::isPlain() const
+{
+    return d.plain;
+}
+
+bool SearchQuery::matches(const MessageData& data, const QString& text) const
+{
+    foreach (const QList<Term>& group, d.groups) {
+        bool all = true;
+        foreach (const Term& term, group) {
+            if (matchesTerm(term, data, text) == term.negated) {
+                all = false;
+                break;
+            }
+        }
+        if (all)
+            return true;
+    }
+    return false;
+}
+
+QList<QPair<int, int> > SearchQuery::ranges(const QString& text) const
+{
+    QList<QPair<int, int> > spans;
+    foreach (const QList<Term>& group, d.groups) {
+        foreach (const Term& term, group) {
+            if (term.negated)
+                continue;
+            if (term.kind == Term::Text) {
+                int pos = 0;
+                while ((pos = text.indexOf(term.text, pos, Qt::CaseInsensitive)) != -1) {
+                    spans += qMakePair(pos, term.text.length());
+                    pos += term.text.length();
+                }
+            } else if (term.kind == Term::Regex) {
+                QRegularExpressionMatchIterator it = term.regex.globalMatch(text);
+                while (it.hasNext()) {
+                    const QRegularExpressionMatch match = it.next();
+                    if (match.capturedLength() > 0)
+                        spans += qMakePair(match.capturedStart(), match.capturedLength());
+                }
+            }
+        }
+    }
+    std::sort(spans.begin(), spans.end());
+    return spans;
+}
+
+bool SearchQuery::parseTerm(const QString& token, Term* term)
+{
+    QString value = token;
+    term->negated = value.length() > 1 && value.startsWith(QLatin1Char('-'));
+    if (term->negated)
+        value.remove(0, 1);
+    term->type = -1;
+
+    const int colon = value.indexOf(QLatin1Char(':'));
+    const QString field = colon > 0 ? value.left(colon).toLower() : QString();
+    const QString arg = colon > 0 ? value.mid(colon + 1) : value;
+    if (field == QLatin1String("nick")) {
+        term->kind = Term::Nick;
+        term->text = arg;
+        return !arg.isEmpty();
+    }
+    if (field == QLatin1String("type")) {
+        term->kind = Term::Type;
+        term->type = messageType(arg);
+        return term->type != -1;
+    }
+    if (field == QLatin1String("after") || field == QLatin1String("before")) {
+        term->kind = field == QLatin1String("after") ? Term::After : Term::Before;
+        term->time = parseTime(arg);
+        return term->time.isValid();
+    }
+
+    if (value.length() > 2 && value.startsWith(QLatin1Char('/')) && value.endsWith(QLatin1Char('/'))) {
+        // compiled once per query, not per block
+        term->kind = Term::Regex;
+        term->regex = QRegularExpression(value.mid(1, value.length() - 2), QRegularExpression::CaseInsensitiveOption);
+        term->regex.optimize();
+        return term->regex.isValid();
+    }
+
+    term->kind = Term::Text;
+    term->text = value;
+    if (term->text.length() > 1 && term->text.startsWith(QLatin1Char('"')) && term->text.endsWith(QLatin1Char('"')))
+        term->text = term->text.mid(1, term->text.length() - 2);
+    return !term->text.isEmpty();
+}
+
+bool SearchQuery::matchesTerm(const Term& term, const MessageData& data, const QString& text)
+{
+    switch (term.kind) {
+    case Term::Nick:
+        return data.nick().compare(term.text, Qt::CaseInsensitive) == 0 || (data.eventCount() > 1 && data.eventNicks().contains(term.text));
+    case Term::Type:
+        return data.type() == term.type || (data.eventCount() > 1 && data.eventKinds().contains(term.type));
+    case Term::After:
+        return data.timestamp().isValid() && data.timestamp() >= term.time;
+    case Term::Before:
+        return data.timestamp().isValid() && data.timestamp() < term.time;
+    case Term::Regex:
+        return term.regex.match(text).hasMatch();
+    case Term::Text:
+    default:
+        return text.contains(term.text, Qt::CaseInsensitive);
+    }
+}
@@ -0,0 +1,194 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "switchindex.h"
+#include <QDateTime>
+#include <QPair>
+#include <IrcBuffer>
+#include <algorithm>
+#include <cmath>
+
+// a visit is worth half as much after this many milliseconds
+static const double HalfLife = 3 * 24 * 60 * 60 * 1000.0;
+// how much a fully fresh visit weighs against the quality of the match
+static const double FrecencyWeight = 4.0;
+
+static quint64 charMask(const QString& text)
+{
+    // one bit per letter and digit, the rest share the upper bits
+    quint64 mask = 0;
+    foreach (const QChar& c, text) {
+        const ushort u = c.unicode();
+        if (u >= 'a' && u <= 'z')
+            mask |= Q_UINT64_C(1) << (u - 'a');
+        else if (u >= '0' && u <= '9')
+            mask |= Q_UINT64_C(1) << (26 + u - '0');
+        else
+            mask |= Q_UINT64_C(1) << (36 + u % 28);
+    }
+    return mask;
+}
+
+static bool isBoundary(const QString& title, int pos)
+{
+    return pos == 0 || !title.at(pos - 1).isLetterOrNumber();
+}
+
+static int fuzzyScore(const QString& title, const QString& text)
+{
+    // greedy subsequence match, runs and word starts are worth more
+    int score = 0;
+    int last = -2;
+    int pos = 0;
+    foreach (const QChar& c, text) {
+        pos = title.indexOf(c, pos);
+        if (pos == -1)
+            return -1;
+        score += 1;
+        if (pos == last + 1)
+            score += 2;
+        if (isBoundary(title, pos))
+            score += 3;
+        last = pos++;
+    }
+    if (title.startsWith(text))
+        score += 4;
+    // shorter titles are closer to what was typed
+    return score * 16 - qMin(title.length() - text.length(), 15);
+}
+
+static double decayed(double frecency, qint64 visited, qint64 msecs)
+{
+    if (frecency <= 0)
+        return 0;
+    return frecency * std::pow(0.5, qMax<qint64>(0, msecs - visited) / HalfLife);
+}
+
+SwitchIndex::SwitchIndex(QObject* parent) : QObject(parent)
+{
+}
+
+bool SwitchIndex::isEmpty() const
+{
+    return m_entries.isEmpty();
+}
+
+void SwitchIndex::clear()
+{
+    foreach (const Entry& entry, m_entries)
+        disconnect(entry.buffer, SIGNAL(titleChanged(QString)), this, SLOT(rename()));
+    m_entries.clear();
+    m_slots.clear();
+}
+
+QList<IrcBuffer*> SwitchIndex::match(const QString& text, int limit, qint64 msecs) const
+{
+    typedef QPair<double, int> Candidate;
+
+    const QString folded = text.toCaseFolded();
+    const quint64 mask = charMask(folded);
+
+    QVector<Candidate> candidates;
+    candidates.reserve(m_entries.count());
+    for (int i = 0; i < m_entries.count(); ++i) {
+        const Entry& entry = m_entries.at(i);
+        // titles missing any of the typed characters never reach the scan
+        if ((entry.mask & mask) != mask)
+            continue;
+        const int score = folded.isEmpty() ? 0 : fuzzyScore(entry.title, folded);
+        if (score < 0)
+            continue;
+        const double frecency = decayed(entry.frecency, entry.visited, msecs);
+        candidates += Candidate(-(score + FrecencyWeight * 16 * frecency / (frecency + 1.0)), i);
+    }
+
+    // only the head of the ranking is ever shown
+    const int count = qMin(limit, candidates.count());
+    std::partial_sort(candidates.begin(), candidates.begin() + count, candidates.end());
+
+    QList<IrcBuffer*> buffers;
+    buffers.reserve(count);
+    for (int i = 0; i < count; ++i)
+        buffers += m_entries.at(candidates.at(i).second).buffer;
+    return buffers;
+}
+
+void SwitchIndex::insert(IrcBuffer* buffer)
+{
+    if (m_slots.contains(buffer))
+        return;
+
+    Entry entry;
+    entry.buffer = buffer;
+    entry.title = buffer->title().toCaseFolded();
+    entry.mask = charMask(entry.title);
+    entry.frecency = 0;
+    entry.visited = 0;
+    m_slots.insert(buffer, m_entries.count());
+    m_entries += entry;
+    connect(buffer, SIGNAL(titleChanged(QString)), this, SLOT(rename()));
+}
+
+void SwitchIndex::remove(IrcBuffer* buffer)
+{
+    // only the key is used, the buffer may be half destroyed,
+    // and the last entry moves into the gap
+    QHash<IrcBuffer*, int>::iterator it = m_slots.find(buffer);
+    if (it == m_slots.end())
+        return;
+    const int slot = it.value();
+    m_slots.erase(it);
+    if (slot != m_entries.count() - 1) {
+        m_entries[slot] = m_entries.last();
+        m_slots[m_entries.at(slot).buffer] = slot;
+    }
+    m_entries.removeLast();
+}
+
+void SwitchIndex::visit(IrcBuffer* buffer)
+{
+    QHash<IrcBuffer*, int>::const_iterator it = m_slots.constFind(buffer);
+    if (it == m_slots.constEnd())
+        return;
+    const qint64 msecs = QDateTime::currentMSecsSinceEpoch();
+    Entry& entry = m_entries[it.value()];
+    entry.frecency = decayed(entry.frecency, entry.visited, msecs) + 1.0;
+    entry.visited = msecs;
+}
+
+void SwitchIndex::rename()
+{
+    // a rename keeps the visits of the entry
+    IrcBuffer* buffer = qobject_cast<IrcBuffer*>(sender());
+    QHash<IrcBuffer*, int>::const_iterator it = m_slots.constFind(buffer);
+    if (it == m_slots.constEnd())
+        return;
+    Entry& entry = m_entries[it.value()];
+    entry.title = buffer->title().toCaseFolded();
+    entry.mask = charMask(entry.title);
+}
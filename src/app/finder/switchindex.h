@@ -0,0 +1,73 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SWITCHINDEX_H
+#define SWITCHINDEX_H
+
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QVector>
+#include <QString>
+
+class IrcBuffer;
+
+class SwitchIndex : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit SwitchIndex(QObject* parent = 0);
+
+    bool isEmpty() const;
+    void clear();
+
+    QList<IrcBuffer*> match(const QString& text, int limit, qint64 msecs) const;
+
+public slots:
+    void insert(IrcBuffer* buffer);
+    void remove(IrcBuffer* buffer);
+    void visit(IrcBuffer* buffer);
+
+private slots:
+    void rename();
+
+private:
+    struct Entry {
+        IrcBuffer* buffer;
+        QString title;
+        quint64 mask;
+        double frecency;
+        qint64 visited;
+    };
+
+    QVector<Entry> m_entries;
+    QHash<IrcBuffer*, int> m_slots;
+};
+
+#endif // SWITCHINDEX_H
@@ -0,0 +1,126 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "titleindex.h"
+#include <algorithm>
+#include <climits>
+
+static quint64 trigram(const QString& text, int pos)
+{
+    return (quint64(text.at(pos).unicode()) << 32) | (quint64(text.at(pos + 1).unicode()) << 16) | text.at(pos + 2).unicode();
+}
+
+TitleIndex::TitleIndex()
+{
+}
+
+bool TitleIndex::isEmpty() const
+{
+    return m_titles.isEmpty();
+}
+
+void TitleIndex::clear()
+{
+    m_sorted.clear();
+    m_titles.clear();
+    m_trigrams.clear();
+}
+
+void TitleIndex::insert(int id, const QString& title)
+{
+    remove(id);
+
+    const QString folded = title.toCaseFolded();
+    m_titles.insert(id, folded);
+    const Entry entry(folded, id);
+    m_sorted.insert(std::lower_bound(m_sorted.begin(), m_sorted.end(), entry), entry);
+    for (int i = 0; i + 2 < folded.length(); ++i) {
+        QVector<int>& postings = m_trigrams[trigram(folded, i)];
+        if (postings.isEmpty() || postings.last() != id)
+            postings += id;
+    }
+}
+
+void TitleIndex::remove(int id)
+{
+    // postings of removed titles are dropped lazily, when they are looked up
+    QHash<int, QString>::iterator it = m_titles.find(id);
+    if (it == m_titles.end())
+        return;
+    const Entry entry(it.value(), id);
+    QVector<Entry>::iterator pos = std::lower_bound(m_sorted.begin(), m_sorted.end(), entry);
+    if (pos != m_sorted.end() && *pos == entry)
+        m_sorted.erase(pos);
+    m_titles.erase(it);
+}
+
+QVector<int> TitleIndex::exact(const QString& text) const
+{
+    QVector<int> ids;
+    const QString folded = text.toCaseFolded();
+    QVector<Entry>::const_iterator it = std::lower_bound(m_sorted.constBegin(), m_sorted.constEnd(), Entry(folded, INT_MIN));
+    for (; it != m_sorted.constEnd() && it->first == folded; ++it)
+        ids += it->second;
+    return ids;
+}
+
+QVector<int> TitleIndex::contains(const QString& text) const
+{
+    QVector<int> ids;
+    const QString folded = text.toCaseFolded();
+    if (folded.isEmpty())
+        return ids;
+
+    if (folded.length() < 3) {
+        // too short for a trigram, but still cheaper than asking the model
+        foreach (const Entry& entry, m_sorted) {
+            if (entry.first.contains(folded))
+                ids += entry.second;
+        }
+        return ids;
+    }
+
+    // the rarest trigram of the query yields the fewest candidates
+    const QVector<int>* rarest = 0;
+    for (int i = 0; i + 2 < folded.length(); ++i) {
+        QHash<quint64, QVector<int> >::const_iterator it = m_trigrams.constFind(trigram(folded, i));
+        if (it == m_trigrams.constEnd())
+            return ids;
+        if (!rarest || it.value().count() < rarest->count())
+            rarest = &it.value();
+    }
+    foreach (int id, *rarest) {
+        QHash<int, QString>::const_iterator it = m_titles.constFind(id);
+        if (it != m_titles.constEnd() && it.value().contains(folded))
+            ids += id;
+    }
+    // re-inserted titles may be listed twice
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    return ids;
+}
@@ -28,12 +28,22 @@
 
 #include "treefinder.h"
 #include "treewidget.h"
+#include <algorithm>
 
 TreeFinder::TreeFinder(TreeWidget* tree) : AbstractFinder(tree)
 {
     d.tree = tree;
-    if (tree)
+    d.dirty = true;
+    if (tree) {
         tree->blockItemReset(true);
+        // ids follow the tree order, so any structural change rebuilds
+        QAbstractItemModel* model = tree->model();
+        connect(model, SIGNAL(modelReset()), this, SLOT(invalidate()));
+        connect(model, SIGNAL(layoutChanged()), this, SLOT(invalidate()));
+        connect(model, SIGNAL(rowsInserted(QModelIndex,int,int)), this, SLOT(invalidate()));
+        connect(model, SIGNAL(rowsAboutToBeRemoved(QModelIndex,int,int)), this, SLOT(invalidate()));
+        connect(model, SIGNAL(dataChanged(QModelIndex,QModelIndex)), this, SLOT(onDataChanged(QModelIndex,QModelIndex)));
+    }
     connect(this, SIGNAL(returnPressed()), this, SLOT(animateHide()));
 }
 
@@ -50,40 +60,64 @@ void TreeFinder::find(const QString& text, bool forward, bool backward, bool typ
     if (!d.tree || text.isEmpty())
         return;
 
+    updateIndex();
+    QVector<int> ids = d.index.exact(text);
+    if (ids.isEmpty())
+        ids = d.index.contains(text);
+    std::sort(ids.begin(), ids.end());
+
+    QTreeWidgetItem* current = d.tree->currentItem();
+    const int position = d.items.indexOf(current);
     if (typed) {
-        QList<QTreeWidgetItem*> items = d.tree->findItems(text, Qt::MatchExactly | Qt::MatchWrap | Qt::MatchRecursive);
-        if (items.isEmpty())
-            items = d.tree->findItems(text, Qt::MatchContains | Qt::MatchWrap | Qt::MatchRecursive);
-        if (!items.isEmpty() && !items.contains(d.tree->currentItem()))
-            d.tree->setCurrentItem(items.first());
-        setError(items.isEmpty());
-    } else {
-        QTreeWidgetItem* item = d.tree->currentItem();
-        if (item) {
-            QTreeWidgetItemIterator it(item);
-            if (forward)
-                ++it;
-            else
-                --it;
-            bool wrapped = false;
-            while (*it) {
-                if ((*it)->text(0).contains(text, Qt::CaseInsensitive)) {
-                    d.tree->setCurrentItem(*it);
-                    return;
-                }
-                if (forward)
-                    ++it;
-                else
-                    --it;
-                if (!(*it) && !wrapped) {
-                    if (forward)
-                        it = QTreeWidgetItemIterator(d.tree);
-                    else
-                        it = QTreeWidgetItemIterator(lastItem());
-                    wrapped = true;
-                }
-            }
+        if (!ids.isEmpty() && !ids.contains(position))
+            d.tree->setCurrentItem(d.items.at(ids.first()));
+        setError(ids.isEmpty());
+    } else if (current && !ids.isEmpty()) {
+        // the next match in tree order, wrapping around
+        int id = forward ? ids.first() : ids.last();
+        if (forward) {
+            QVector<int>::const_iterator it = std::upper_bound(ids.constBegin(), ids.constEnd(), position);
+            if (it != ids.constEnd())
+                id = *it;
+        } else {
+            QVector<int>::const_iterator it = std::lower_bound(ids.constBegin(), ids.constEnd(), position);
+            if (it != ids.constBegin())
+                id = *(--it);
         }
+        d.tree->setCurrentItem(d.items.at(id));
+    }
+}
+
+void TreeFinder::updateIndex()
+{
+    if (!d.dirty)
+        return;
+
+    d.index.clear();
+    d.items.clear();
+    d.titles.clear();
+    for (QTreeWidgetItemIterator it(d.tree); *it; ++it) {
+        const QString title = (*it)->text(0);
+        d.index.insert(d.items.count(), title);
+        d.titles.insert(title);
+        d.items += *it;
+    }
+    d.dirty = false;
+}
+
+void TreeFinder::invalidate()
+{
+    d.dirty = true;
+}
+
+void TreeFinder::onDataChanged(const QModelIndex& topLeft, const QModelIndex& bottomRight)
+{
+    // badges and highlights change all the time, only renames matter here
+    if (d.dirty)
+        return;
+    for (int row = topLeft.row(); row <= bottomRight.row() && !d.dirty; ++row) {
+        if (!d.titles.contains(topLeft.sibling(row, 0).data().toString()))
+            d.dirty = true;
     }
 }
 
@@ -97,11 +131,3 @@ void TreeFinder::relocate()
     setGeometry(r);
     raise();
 }
-
-QTreeWidgetItem* TreeFinder::lastItem() const
-{
-    QTreeWidgetItem* item = d.tree->topLevelItem(d.tree->topLevelItemCount() - 1);
-    if (item && item->childCount() > 0)
-        item = item->child(item->childCount() - 1);
-    return item;
-}
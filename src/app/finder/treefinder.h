@@ -30,7 +30,10 @@
 #define TREEFINDER_H
 
 #include "abstractfinder.h"
+#include "titleindex.h"
 #include <QTreeWidgetItem>
+#include <QVector>
+#include <QSet>
 
 class TreeWidget;
 
@@ -47,11 +50,19 @@ protected slots:
     void find(const QString& text, bool forward = false, bool backward = false, bool typed = true);
     void relocate();
 
+private slots:
+    void invalidate();
+    void onDataChanged(const QModelIndex& topLeft, const QModelIndex& bottomRight);
+
 private:
-    QTreeWidgetItem* lastItem() const;
+    void updateIndex();
 
     struct Private {
         TreeWidget* tree;
+        bool dirty;
+        TitleIndex index;
+        QVector<QTreeWidgetItem*> items;
+        QSet<QString> titles;
     } d;
 };
 
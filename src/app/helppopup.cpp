@@ -97,6 +97,7 @@ void HelpPopup::popup()
     shortcuts += row.arg(tr("Find:"), QKeySequence("Ctrl+F").toString(QKeySequence::NativeText));
     shortcuts += row.arg(tr("Search views:"), QKeySequence("Ctrl+S").toString(QKeySequence::NativeText));
     shortcuts += row.arg(tr("Search users:"), QKeySequence("Ctrl+U").toString(QKeySequence::NativeText));
+    shortcuts += row.arg(tr("Switch view:"), QKeySequence("Ctrl+K").toString(QKeySequence::NativeText));
     shortcuts += "</table>";
 
     QString commands;
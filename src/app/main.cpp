@@ -27,7 +27,11 @@
 */
 
 #include "mainwindow.h"
+#include "coreclient.h"
+#include "coreserver.h"
 #include "pluginloader.h"
+#include "trafficreplay.h"
+#include "startuptimeline.h"
 #include <QApplication>
 #include <QNetworkProxy>
 #include <QSettings>
@@ -47,6 +51,8 @@ static void setApplicationProxy(QUrl url)
 
 int main(int argc, char* argv[])
 {
+    StartupTimeline::mark("main");
+
 #ifdef Q_OS_MAC
     // QTBUG-32789 - GUI widgets use the wrong font on OS X Mavericks
     QFont::insertSubstitution(".Lucida Grande UI", "Lucida Grande");
@@ -66,6 +72,8 @@ int main(int argc, char* argv[])
                                                                      .arg(app.applicationVersion())
                                                                      .arg(app.organizationDomain()));
 
+    StartupTimeline::mark("application");
+
     foreach (const QString& path, PluginLoader::paths())
         app.addLibraryPath(path);
 
@@ -81,7 +89,45 @@ int main(int argc, char* argv[])
         proxy = QUrl(qgetenv("http_proxy"));
     setApplicationProxy(proxy);
 
+    // -replay <capture> [-speed <factor>] feeds a recorded session through
+    // the whole pipeline and prints where the time went, -platform offscreen
+    // runs it without a window
+    index = args.indexOf("-replay");
+    if (index != -1) {
+        // throwaway settings, the real connections and read markers stay as they are
+        app.setApplicationName("Communi Replay");
+        QSettings().clear();
+
+        TrafficReplay* replay = new TrafficReplay(args.value(index + 1), &app);
+        int speed = args.indexOf("-speed");
+        if (speed != -1)
+            replay->setSpeed(args.value(speed + 1).toDouble());
+        if (!replay->start()) {
+            qWarning("Unable to replay %s", qPrintable(args.value(index + 1)));
+            return 1;
+        }
+    }
+
+    // -core <name> serves the connections to GUIs attaching over a local
+    // socket, -attach <name> syncs from such a core and prints what arrived
+    index = args.indexOf("-attach");
+    if (index != -1) {
+        CoreClient* client = new CoreClient(&app);
+        QObject::connect(client, SIGNAL(synced()), client, SLOT(report()));
+        QObject::connect(client, SIGNAL(synced()), &app, SLOT(quit()));
+        QObject::connect(client, SIGNAL(detached()), &app, SLOT(quit()));
+        client->attach(args.value(index + 1));
+        app.exec();
+        return client->isSynced() ? 0 : 1;
+    }
+
+    index = args.indexOf("-core");
+    if (index != -1 && !CoreServer::instance()->listen(args.value(index + 1)))
+        return 1;
+
     MainWindow window;
+    StartupTimeline::mark("window");
     window.show();
+    StartupTimeline::mark("shown");
     return app.exec();
 }
@@ -29,12 +29,19 @@
 #include "mainwindow.h"
 #include "settingspage.h"
 #include "systemmonitor.h"
+#include "reconnectscheduler.h"
+#include "connectsocket.h"
+#include "flushscheduler.h"
+#include "taskscheduler.h"
+#include "settingscache.h"
 #include "pluginloader.h"
 #include "textdocument.h"
+#include "memorybudget.h"
 #include "connectpage.h"
 #include "bufferview.h"
 #include "helppopup.h"
 #include "chatpage.h"
+#include "startuptimeline.h"
 #include "dock.h"
 #include <IrcCommandQueue>
 #include <IrcBufferModel>
@@ -45,13 +52,15 @@
 #include <QPushButton>
 #include <IrcBuffer>
 #include <QShortcut>
-#include <QSettings>
 #include <QMenuBar>
 #include <QTimer>
 #include <QUuid>
 #include <QMenu>
 #include <QDir>
 
+// a couple of hundred lines of typical traffic
+static const int ReadBufferSize = 64 * 1024;
+
 MainWindow::MainWindow(QWidget* parent) : QMainWindow(parent)
 {
     d.view = 0;
@@ -116,15 +125,30 @@ MainWindow::MainWindow(QWidget* parent) : QMainWindow(parent)
     connect(d.monitor, SIGNAL(screenSaverStarted()), d.dock, SLOT(activateAlert()));
     connect(d.monitor, SIGNAL(screenSaverStopped()), d.dock, SLOT(deactivateAlert()));
 
-    PluginLoader::instance()->windowCreated(this);
-    PluginLoader::instance()->setConnectionsList(&(d.connections));
+    d.reconnects = new ReconnectScheduler(this);
+    connect(d.monitor, SIGNAL(wake()), this, SLOT(scheduleReconnect()));
+    connect(d.monitor, SIGNAL(online()), this, SLOT(scheduleReconnect()));
+    connect(d.monitor, SIGNAL(sleep()), d.reconnects, SLOT(cancel()));
+    connect(d.monitor, SIGNAL(offline()), d.reconnects, SLOT(cancel()));
 
-    restoreState();
-    d.save = true;
+    connect(d.monitor, SIGNAL(memoryLow()), MemoryBudget::instance(), SLOT(relieve()));
 
-    if (d.connections.isEmpty())
-        doConnect();
+    d.sleeping = false;
+    connect(d.monitor, SIGNAL(sleep()), this, SLOT(onSleep()));
+    connect(d.monitor, SIGNAL(wake()), this, SLOT(onWake()));
+
+    PluginLoader::instance()->windowCreated(this);
+    PluginLoader::instance()->setConnectionsList(&(d.connections));
 
+    // the window paints first, the rest of the state comes in idle steps
+    SettingsCache* settings = SettingsCache::instance();
+    if (settings->contains("geometry"))
+        restoreGeometry(settings->value("geometry").toByteArray());
+    d.startup = StartupSettings;
+    d.startupQueued = false;
+    d.stack->installEventFilter(this);
+    QTimer::singleShot(1000, this, SLOT(startRestore()));
+    StartupTimeline::mark("main window");
 }
 
 MainWindow::~MainWindow()
@@ -138,10 +162,10 @@ void MainWindow::saveState()
     if (!d.save)
         return;
 
-    QSettings settings;
-    settings.setValue("geometry", saveGeometry());
-    settings.setValue("settings", d.chatPage->saveSettings());
-    settings.setValue("state", d.chatPage->saveState());
+    SettingsCache* settings = SettingsCache::instance();
+    settings->setValue("geometry", saveGeometry());
+    settings->setValue("settings", d.chatPage->saveSettings());
+    settings->setValue("state", d.chatPage->saveState());
 
     QVariantList states;
     foreach (IrcConnection* connection, d.connections) {
@@ -152,49 +176,92 @@ void MainWindow::saveState()
             state.insert("model", model->saveState());
         states += state;
     }
-    settings.setValue("connections", states);
+    settings->setValue("connections", states);
 }
 
 void MainWindow::restoreState()
 {
-    QSettings settings;
-    if (settings.contains("geometry"))
-        restoreGeometry(settings.value("geometry").toByteArray());
-
-    d.chatPage->restoreSettings(settings.value("settings").toByteArray());
+    // the remaining steps at once, for whoever cannot wait
+    while (d.startup < StartupDone)
+        restoreStep();
+}
 
-    foreach (const QVariant& v, settings.value("connections").toList()) {
-        QVariantMap state = v.toMap();
-        IrcConnection* connection = new IrcConnection(d.chatPage);
-        connection->restoreState(state.value("connection").toByteArray());
-        addConnection(connection);
-        IrcBufferModel* model = connection->findChild<IrcBufferModel*>();
-        if (model)
-            model->restoreState(state.value("model").toByteArray());
+void MainWindow::startRestore()
+{
+    // never painted, such as when started hidden
+    if (!d.startupQueued) {
+        d.startupQueued = true;
+        d.stack->removeEventFilter(this);
+        restoreStep();
     }
+}
 
-    d.chatPage->restoreState(settings.value("state").toByteArray());
+void MainWindow::restoreStep()
+{
+    SettingsCache* settings = SettingsCache::instance();
+    switch (d.startup) {
+    case StartupSettings:
+        // loads the theme
+        d.chatPage->restoreSettings(settings->value("settings").toByteArray());
+        StartupTimeline::mark("settings");
+        break;
+
+    case StartupConnections:
+        // restored buffers reach the plugins in one go
+        PluginLoader::instance()->beginBatch();
+        foreach (const QVariant& v, settings->value("connections").toList()) {
+            QVariantMap state = v.toMap();
+            IrcConnection* connection = new IrcConnection(d.chatPage);
+            connection->restoreState(state.value("connection").toByteArray());
+            addConnection(connection);
+            IrcBufferModel* model = connection->findChild<IrcBufferModel*>();
+            if (model)
+                model->restoreState(state.value("model").toByteArray());
+        }
+        PluginLoader::instance()->endBatch();
+        StartupTimeline::mark("connections");
+        break;
 
-    if (!settings.value("loggingLocation").isValid()) {
+    case StartupState:
+        d.chatPage->restoreState(settings->value("state").toByteArray());
+        StartupTimeline::mark("state");
+        break;
+
+    case StartupPlugins:
+        if (!settings->value("loggingLocation").isValid()) {
 #if QT_VERSION >= 0x050400
-        settings.setValue("loggingLocation", QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/logs");
+            settings->setValue("loggingLocation", QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/logs");
 #else
-        settings.setValue("loggingLocation", QStandardPaths::writableLocation(QStandardPaths::DataLocation) + "/logs");
+            settings->setValue("loggingLocation", QStandardPaths::writableLocation(QStandardPaths::DataLocation) + "/logs");
 #endif
-    }
+        }
 
-    d.settingsPage->setTheme(d.chatPage->theme());
-    d.settingsPage->setLoggingEnabled(settings.value("loggingEnabled", false).toBool());
-    d.settingsPage->setLoggingLocation(settings.value("loggingLocation").toString());
+        d.settingsPage->setTheme(d.chatPage->theme());
+        d.settingsPage->setLoggingEnabled(settings->value("loggingEnabled", false).toBool());
+        d.settingsPage->setLoggingLocation(settings->value("loggingLocation").toString());
 
-    PluginLoader::instance()->settingsChanged();
+        PluginLoader::instance()->settingsChanged();
 
-    if (d.settingsPage->loggingEnabled()) {
-        PluginLoader::instance()->enablePlugin("libloggerplugin");
-    }
-    else {
-        PluginLoader::instance()->disablePlugin("libloggerplugin");
+        if (d.settingsPage->loggingEnabled()) {
+            PluginLoader::instance()->enablePlugin("libloggerplugin");
+        }
+        else {
+            PluginLoader::instance()->disablePlugin("libloggerplugin");
+        }
+
+        d.save = true;
+        if (d.connections.isEmpty())
+            doConnect();
+        StartupTimeline::mark("plugins");
+        break;
+
+    default:
+        return;
     }
+
+    // one step per event loop turn, input and painting go in between
+    if (++d.startup < StartupDone)
+        QMetaObject::invokeMethod(this, "restoreStep", Qt::QueuedConnection);
 }
 
 BufferView* MainWindow::currentView() const
@@ -237,8 +304,17 @@ void MainWindow::addConnection(IrcConnection* connection)
                                                                   .arg(connection->isSecure() ? "+" : "")
                                                                   .arg(connection->port()));
 
-    connect(d.monitor, SIGNAL(wake()), connection, SLOT(open()));
-    connect(d.monitor, SIGNAL(online()), connection, SLOT(open()));
+    // staggered instead of all at once, see scheduleReconnect()
+    d.reconnects->addConnection(connection);
+
+    // resumed tls sessions and raced addresses, put back whenever libcommuni
+    // swaps in a socket of its own when going secure or back
+    AddressRace::install(connection);
+    connect(connection, SIGNAL(secureChanged(bool)), this, SLOT(installSocket()));
+
+    // the socket may be replaced when going secure, so this is applied per attempt
+    connect(connection, SIGNAL(statusChanged(IrcConnection::Status)), this, SLOT(limitReadBuffer()));
+    limitReadBuffer(connection);
 
     connect(d.monitor, SIGNAL(sleep()), connection, SLOT(quit()));
     connect(d.monitor, SIGNAL(sleep()), connection, SLOT(close()));
@@ -253,8 +329,27 @@ void MainWindow::addConnection(IrcConnection* connection)
     saveState();
 }
 
+void MainWindow::installSocket()
+{
+    IrcConnection* connection = qobject_cast<IrcConnection*>(sender());
+    if (connection)
+        AddressRace::install(connection);
+}
+
+void MainWindow::limitReadBuffer(IrcConnection* connection)
+{
+    // a bounded read buffer hands a flood over in slices, each readyRead
+    // parses at most this much before painting and input get their turn
+    if (!connection)
+        connection = qobject_cast<IrcConnection*>(sender());
+    QAbstractSocket* socket = connection ? connection->socket() : 0;
+    if (socket && socket->readBufferSize() != ReadBufferSize)
+        socket->setReadBufferSize(ReadBufferSize);
+}
+
 void MainWindow::removeConnection(IrcConnection* connection)
 {
+    d.reconnects->removeConnection(connection);
     if (d.connections.removeOne(connection))
         emit connectionRemoved(connection);
     if (d.connections.isEmpty())
@@ -263,6 +358,13 @@ void MainWindow::removeConnection(IrcConnection* connection)
         saveState();
 }
 
+void MainWindow::scheduleReconnect()
+{
+    IrcBuffer* buffer = d.view ? d.view->buffer() : 0;
+    d.reconnects->setCurrentConnection(buffer ? buffer->connection() : 0);
+    d.reconnects->schedule();
+}
+
 void MainWindow::push(QWidget* page)
 {
     QWidget* prev = d.stack->currentWidget();
@@ -335,9 +437,55 @@ void MainWindow::closeEvent(QCloseEvent* event)
     }
 }
 
+bool MainWindow::eventFilter(QObject* object, QEvent* event)
+{
+    if (object == d.stack && event->type() == QEvent::Paint && d.startup == StartupSettings && !d.startupQueued) {
+        d.startupQueued = true;
+        d.stack->removeEventFilter(this);
+        StartupTimeline::mark("first paint");
+        QMetaObject::invokeMethod(this, "restoreStep", Qt::QueuedConnection);
+    }
+    return QMainWindow::eventFilter(object, event);
+}
+
 void MainWindow::showEvent(QShowEvent* event)
 {
     PluginLoader::instance()->windowShowEvent(this, event);
+    updateBackground();
+}
+
+void MainWindow::hideEvent(QHideEvent* event)
+{
+    QMainWindow::hideEvent(event);
+    updateBackground();
+}
+
+void MainWindow::changeEvent(QEvent* event)
+{
+    QMainWindow::changeEvent(event);
+    if (event->type() == QEvent::WindowStateChange)
+        updateBackground();
+}
+
+void MainWindow::updateBackground()
+{
+    // hidden, minimized or asleep, messages only update the stores and
+    // counters, and the documents catch up once the window is back
+    const bool background = d.sleeping || !isVisible() || isMinimized();
+    FlushScheduler::instance()->setSuspended(background);
+    TaskScheduler::instance()->setThrottled(background);
+}
+
+void MainWindow::onSleep()
+{
+    d.sleeping = true;
+    updateBackground();
+}
+
+void MainWindow::onWake()
+{
+    d.sleeping = false;
+    updateBackground();
 }
 
 void MainWindow::doConnect()
@@ -399,9 +547,9 @@ void MainWindow::onSettingsAccepted()
         saveState();
         pop();
 
-        QSettings settings;
-        settings.setValue("loggingEnabled", page->loggingEnabled());
-        settings.setValue("loggingLocation", page->loggingLocation());
+        SettingsCache* settings = SettingsCache::instance();
+        settings->setValue("loggingEnabled", page->loggingEnabled());
+        settings->setValue("loggingLocation", page->loggingLocation());
 
         PluginLoader::instance()->settingsChanged();
 
@@ -42,6 +42,7 @@ class IrcMessage;
 class BufferView;
 class IrcConnection;
 class SystemMonitor;
+class ReconnectScheduler;
 
 class MainWindow : public QMainWindow
 {
@@ -77,8 +78,11 @@ protected slots:
 protected:
     QSize sizeHint() const;
     bool event(QEvent* event);
+    bool eventFilter(QObject* object, QEvent* event);
     void closeEvent(QCloseEvent* event);
     void showEvent(QShowEvent* event);
+    void hideEvent(QHideEvent* event);
+    void changeEvent(QEvent* event);
 
 private slots:
     void doConnect();
@@ -90,15 +94,29 @@ private slots:
     void showHelp();
     void editConnection(IrcConnection* connection);
     void toggleFullScreen();
+    void scheduleReconnect();
+    void updateBackground();
+    void onSleep();
+    void onWake();
+    void startRestore();
+    void installSocket();
+    void limitReadBuffer(IrcConnection* connection = 0);
+    void restoreStep();
 
 private:
+    enum StartupStep { StartupSettings, StartupConnections, StartupState, StartupPlugins, StartupDone };
+
     struct Private {
         bool save;
+        int startup;
+        bool startupQueued;
+        bool sleeping;
         Dock* dock;
         ChatPage* chatPage;
         SettingsPage* settingsPage;
         QStackedWidget* stack;
         SystemMonitor* monitor;
+        ReconnectScheduler* reconnects;
         QPointer<BufferView> view;
         QList<IrcConnection*> connections;
     } d;
@@ -0,0 +1,431 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "connectsocket.h"
+#include "allocstats.h"
+#include <IrcConnection>
+#include <QCryptographicHash>
+#include <QStandardPaths>
+#include <QTimerEvent>
+#include <QDataStream>
+#include <QDateTime>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QFile>
+#include <QDir>
+#ifdef Q_OS_UNIX
+#include <unistd.h>
+#endif
+
+// the head start one address gets before the next is tried, see RFC 8305
+static const int AttemptDelay = 250;
+static const int SessionLifeTime = 3600;
+
+AddressRace::AddressRace(QObject* parent) : QObject(parent)
+{
+    d.lookup = -1;
+    d.port = 0;
+}
+
+void AddressRace::start(const QString& host, quint16 port)
+{
+    cancel();
+    d.port = port;
+    d.lookup = QHostInfo::lookupHost(host, this, SLOT(lookedUp(QHostInfo)));
+}
+
+void AddressRace::cancel()
+{
+    if (d.lookup != -1) {
+        QHostInfo::abortHostLookup(d.lookup);
+        d.lookup = -1;
+    }
+    d.timer.stop();
+    d.addresses.clear();
+    foreach (QTcpSocket* socket, d.attempts) {
+        socket->disconnect(this);
+        socket->abort();
+        socket->deleteLater();
+    }
+    d.attempts.clear();
+}
+
+bool AddressRace::isRunning() const
+{
+    return d.lookup != -1 || d.timer.isActive() || !d.attempts.isEmpty();
+}
+
+void AddressRace::install(IrcConnection* connection)
+{
+    // libcommuni puts in a plain socket of its own when going secure or back
+    QAbstractSocket* socket = connection->socket();
+    if (connection->isActive() || qobject_cast<PlainSocket*>(socket))
+        return;
+#ifndef QT_NO_SSL
+    if (qobject_cast<SecureSocket*>(socket))
+        return;
+    if (connection->isSecure()) {
+        ParseStage::install(connection, new SecureSocket(connection));
+        return;
+    }
+#endif
+    ParseStage::install(connection, new PlainSocket(connection));
+}
+
+void AddressRace::timerEvent(QTimerEvent* event)
+{
+    if (event->timerId() == d.timer.timerId())
+        attempt();
+    else
+        QObject::timerEvent(event);
+}
+
+void AddressRace::lookedUp(const QHostInfo& info)
+{
+    d.lookup = -1;
+
+    // the families take turns, starting with the one the resolver put first
+    QList<QHostAddress> first;
+    QList<QHostAddress> second;
+    foreach (const QHostAddress& address, info.addresses()) {
+        if (first.isEmpty() || address.protocol() == first.first().protocol())
+            first += address;
+        else
+            second += address;
+    }
+    while (!first.isEmpty() || !second.isEmpty()) {
+        if (!first.isEmpty())
+            d.addresses += first.takeFirst();
+        if (!second.isEmpty())
+            d.addresses += second.takeFirst();
+    }
+
+    if (d.addresses.isEmpty()) {
+        emit finished(0);
+    } else {
+        emit hostFound();
+        attempt();
+    }
+}
+
+void AddressRace::attempt()
+{
+    d.timer.stop();
+    if (d.addresses.isEmpty())
+        return;
+
+    QTcpSocket* socket = new QTcpSocket(this);
+    connect(socket, SIGNAL(connected()), this, SLOT(attemptConnected()));
+    connect(socket, SIGNAL(error(QAbstractSocket::SocketError)), this, SLOT(attemptFailed()));
+    d.attempts += socket;
+    socket->connectToHost(d.addresses.takeFirst(), d.port);
+    if (!d.addresses.isEmpty())
+        d.timer.start(AttemptDelay, this);
+}
+
+void AddressRace::attemptConnected()
+{
+    QTcpSocket* socket = qobject_cast<QTcpSocket*>(sender());
+    if (!socket)
+        return;
+
+    // the winner is handed over, the others are dropped
+    d.attempts.removeOne(socket);
+    socket->disconnect(this);
+    cancel();
+    emit finished(socket);
+    socket->deleteLater();
+}
+
+void AddressRace::attemptFailed()
+{
+    QTcpSocket* socket = qobject_cast<QTcpSocket*>(sender());
+    if (!socket || !d.attempts.removeOne(socket))
+        return;
+    socket->disconnect(this);
+    socket->deleteLater();
+
+    // a refused address does not wait for its turn to pass
+    if (!d.addresses.isEmpty())
+        attempt();
+    else if (d.attempts.isEmpty())
+        emit finished(0);
+}
+
+// only unix descriptors can be handed over, elsewhere the winner would be
+// thrown away and connected again, so the socket connects on its own there
+static bool canAdopt()
+{
+#ifdef Q_OS_UNIX
+    return true;
+#else
+    return false;
+#endif
+}
+
+static bool adopt(QAbstractSocket* target, QTcpSocket* socket, QIODevice::OpenMode mode)
+{
+    // the connected descriptor is taken over, the race socket closes its own
+    // copy once that worked, otherwise it is left as it was
+#ifdef Q_OS_UNIX
+    const int fd = ::dup(int(socket->socketDescriptor()));
+    if (fd == -1)
+        return false;
+    if (!target->setSocketDescriptor(fd, QAbstractSocket::ConnectedState, mode)) {
+        ::close(fd);
+        return false;
+    }
+    socket->abort();
+    return true;
+#else
+    Q_UNUSED(target);
+    Q_UNUSED(socket);
+    Q_UNUSED(mode);
+#endif
+    return false;
+}
+
+ParseStage::ParseStage(QObject* parent) : QObject(parent)
+{
+    d.previous = AllocStats::Other;
+}
+
+// connected around the connection's own slot, which runs in between
+void ParseStage::install(IrcConnection* connection, QAbstractSocket* socket)
+{
+    ParseStage* stage = AllocStats::isEnabled() ? new ParseStage(socket) : 0;
+    if (stage)
+        connect(socket, SIGNAL(readyRead()), stage, SLOT(enter()));
+    connection->setSocket(socket);
+    if (stage)
+        connect(socket, SIGNAL(readyRead()), stage, SLOT(leave()));
+}
+
+void ParseStage::enter()
+{
+    d.previous = AllocStats::enter(AllocStats::Parse);
+}
+
+void ParseStage::leave()
+{
+    AllocStats::leave(d.previous);
+}
+
+PlainSocket::PlainSocket(QObject* parent) : QTcpSocket(parent)
+{
+    d.port = 0;
+    d.mode = ReadWrite;
+    d.race = new AddressRace(this);
+    connect(d.race, SIGNAL(hostFound()), this, SLOT(racing()));
+    connect(d.race, SIGNAL(finished(QTcpSocket*)), this, SLOT(raced(QTcpSocket*)));
+}
+
+void PlainSocket::connectToHost(const QString& host, quint16 port, OpenMode mode, NetworkLayerProtocol protocol)
+{
+    // literal addresses and pinned protocols have nothing to race
+    if (!canAdopt() || protocol != AnyIPProtocol || !QHostAddress(host).isNull()) {
+        QTcpSocket::connectToHost(host, port, mode, protocol);
+        return;
+    }
+    d.host = host;
+    d.port = port;
+    d.mode = mode;
+
+    // the race has no socket engine, the states are reported as it goes
+    setSocketState(HostLookupState);
+    emit stateChanged(HostLookupState);
+    d.race->start(host, port);
+}
+
+// IrcConnection::close() calls abort() and disconnectFromHost(), abort()
+// ends up here once the socket is no longer unconnected
+void PlainSocket::disconnectFromHost()
+{
+    cancelRace();
+    QTcpSocket::disconnectFromHost();
+}
+
+void PlainSocket::close()
+{
+    cancelRace();
+    QTcpSocket::close();
+}
+
+void PlainSocket::cancelRace()
+{
+    if (!d.race->isRunning())
+        return;
+    d.race->cancel();
+    setSocketState(UnconnectedState);
+    emit stateChanged(UnconnectedState);
+}
+
+void PlainSocket::racing()
+{
+    emit hostFound();
+    setSocketState(ConnectingState);
+    emit stateChanged(ConnectingState);
+}
+
+void PlainSocket::raced(QTcpSocket* socket)
+{
+    // the winning address once more, or the host name for the real error
+    const QString host = socket ? socket->peerAddress().toString() : d.host;
+    if (socket && adopt(this, socket, d.mode)) {
+        emit connected();
+        return;
+    }
+
+    if (socket)
+        socket->abort();
+    setSocketState(UnconnectedState);
+    QTcpSocket::connectToHost(host, d.port, d.mode);
+}
+
+#ifndef QT_NO_SSL
+SecureSocket::SecureSocket(QObject* parent) : QSslSocket(parent)
+{
+    d.port = 0;
+    d.mode = ReadWrite;
+    d.race = new AddressRace(this);
+    connect(d.race, SIGNAL(hostFound()), this, SLOT(racing()));
+    connect(d.race, SIGNAL(finished(QTcpSocket*)), this, SLOT(raced(QTcpSocket*)));
+    connect(this, SIGNAL(encrypted()), this, SLOT(saveSession()));
+#if QT_VERSION >= QT_VERSION_CHECK(5, 15, 0)
+    // tls 1.3 hands out its tickets after the handshake
+    connect(this, SIGNAL(newSessionTicketReceived()), this, SLOT(saveSession()));
+#endif
+}
+
+void SecureSocket::connectToHost(const QString& host, quint16 port, OpenMode mode, NetworkLayerProtocol protocol)
+{
+    d.host = host;
+    d.port = port;
+    d.mode = mode;
+
+    // the ticket of the last session to this host, if it has not expired
+    QSslConfiguration config = sslConfiguration();
+    config.setSslOption(QSsl::SslOptionDisableSessionPersistence, false);
+    config.setSessionTicket(QByteArray());
+    QFile file(sessionFile());
+    if (file.open(QFile::ReadOnly)) {
+        QDataStream in(&file);
+        qint64 expires = 0;
+        QByteArray ticket;
+        in >> expires >> ticket;
+        if (in.status() == QDataStream::Ok && expires > QDateTime::currentMSecsSinceEpoch())
+            config.setSessionTicket(ticket);
+    }
+    setSslConfiguration(config);
+
+    // the certificate is checked against the host, whichever address answers
+    setPeerVerifyName(host);
+    if (!canAdopt() || protocol != AnyIPProtocol || !QHostAddress(host).isNull()) {
+        QSslSocket::connectToHost(host, port, mode, protocol);
+        return;
+    }
+    setSocketState(HostLookupState);
+    emit stateChanged(HostLookupState);
+    d.race->start(host, port);
+}
+
+void SecureSocket::disconnectFromHost()
+{
+    cancelRace();
+    QSslSocket::disconnectFromHost();
+}
+
+void SecureSocket::close()
+{
+    cancelRace();
+    QSslSocket::close();
+}
+
+void SecureSocket::cancelRace()
+{
+    if (!d.race->isRunning())
+        return;
+    d.race->cancel();
+    setSocketState(UnconnectedState);
+    emit stateChanged(UnconnectedState);
+}
+
+void SecureSocket::racing()
+{
+    emit hostFound();
+    setSocketState(ConnectingState);
+    emit stateChanged(ConnectingState);
+}
+
+void SecureSocket::raced(QTcpSocket* socket)
+{
+    const QString host = socket ? socket->peerAddress().toString() : d.host;
+    if (socket && adopt(this, socket, d.mode)) {
+        emit connected();
+        return;
+    }
+
+    if (socket)
+        socket->abort();
+    setSocketState(UnconnectedState);
+    QSslSocket::connectToHost(host, d.port, d.mode);
+}
+
+void SecureSocket::saveSession()
+{
+    const QByteArray ticket = sslConfiguration().sessionTicket();
+    if (ticket.isEmpty())
+        return;
+
+    // the ticket holds the session secret, so only the user may read it
+    const int hint = sslConfiguration().sessionTicketLifeTimeHint();
+    const qint64 expires = QDateTime::currentMSecsSinceEpoch() + qint64(hint > 0 ? hint : SessionLifeTime) * 1000;
+    const QString filePath = sessionFile();
+    const QString dirPath = QFileInfo(filePath).path();
+    QDir().mkpath(dirPath);
+    QFile::setPermissions(dirPath, QFile::ReadOwner | QFile::WriteOwner | QFile::ExeOwner);
+
+    // the file is replaced in one go, a crash leaves the previous ticket in place
+    QSaveFile file(filePath);
+    if (!file.open(QFile::WriteOnly) || !file.setPermissions(QFile::ReadOwner | QFile::WriteOwner)) {
+        file.cancelWriting();
+        return;
+    }
+    QDataStream out(&file);
+    out << expires << ticket;
+    if (out.status() != QDataStream::Ok)
+        file.cancelWriting();
+    file.commit();
+}
+
+QString SecureSocket::sessionFile() const
+{
+    const QByteArray key = QCryptographicHash::hash(QString(d.host + ":" + QString::number(d.port)).toUtf8(), QCryptographicHash::Sha1).toHex();
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/tls/" + QString::fromLatin1(key) + ".session";
+}
+#endif // QT_NO_SSL
@@ -0,0 +1,166 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CONNECTSOCKET_H
+#define CONNECTSOCKET_H
+
+#include <QList>
+#include <QObject>
+#include <QHostInfo>
+#include <QTcpSocket>
+#include <QBasicTimer>
+#include <QHostAddress>
+#ifndef QT_NO_SSL
+#include <QSslSocket>
+#endif
+
+class IrcConnection;
+
+// connects to every resolved address of a host, each attempt started a
+// moment after the previous one, and the first to get through wins
+class AddressRace : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit AddressRace(QObject* parent = 0);
+
+    void start(const QString& host, quint16 port);
+    void cancel();
+    bool isRunning() const;
+
+    // installs one of the sockets below, see MainWindow::addConnection()
+    static void install(IrcConnection* connection);
+
+signals:
+    // the host resolved and the first attempt is under way
+    void hostFound();
+
+    // a connected socket, or none when every address failed
+    void finished(QTcpSocket* socket);
+
+protected:
+    void timerEvent(QTimerEvent* event);
+
+private slots:
+    void lookedUp(const QHostInfo& info);
+    void attemptConnected();
+    void attemptFailed();
+
+private:
+    void attempt();
+
+    struct Private {
+        int lookup;
+        quint16 port;
+        QBasicTimer timer;
+        QList<QHostAddress> addresses;
+        QList<QTcpSocket*> attempts;
+    } d;
+};
+
+// whatever libcommuni allocates reading, parsing and processing what came
+// in counts as parse, see AllocStats
+class ParseStage : public QObject
+{
+    Q_OBJECT
+
+public:
+    static void install(IrcConnection* connection, QAbstractSocket* socket);
+
+private slots:
+    void enter();
+    void leave();
+
+private:
+    explicit ParseStage(QObject* parent);
+
+    struct Private {
+        int previous;
+    } d;
+};
+
+class PlainSocket : public QTcpSocket
+{
+    Q_OBJECT
+
+public:
+    explicit PlainSocket(QObject* parent = 0);
+
+    void connectToHost(const QString& host, quint16 port, OpenMode mode = ReadWrite, NetworkLayerProtocol protocol = AnyIPProtocol) Q_DECL_OVERRIDE;
+    void disconnectFromHost() Q_DECL_OVERRIDE;
+    void close() Q_DECL_OVERRIDE;
+
+private slots:
+    void racing();
+    void raced(QTcpSocket* socket);
+
+private:
+    void cancelRace();
+
+    struct Private {
+        QString host;
+        quint16 port;
+        OpenMode mode;
+        AddressRace* race;
+    } d;
+};
+
+#ifndef QT_NO_SSL
+// resumes the tls session of the previous connection to the same host,
+// the tickets are kept on disk across restarts
+class SecureSocket : public QSslSocket
+{
+    Q_OBJECT
+
+public:
+    explicit SecureSocket(QObject* parent = 0);
+
+    void connectToHost(const QString& host, quint16 port, OpenMode mode = ReadWrite, NetworkLayerProtocol protocol = AnyIPProtocol) Q_DECL_OVERRIDE;
+    void disconnectFromHost() Q_DECL_OVERRIDE;
+    void close() Q_DECL_OVERRIDE;
+
+private slots:
+    void racing();
+    void raced(QTcpSocket* socket);
+    void saveSession();
+
+private:
+    void cancelRace();
+    QString sessionFile() const;
+
+    struct Private {
+        QString host;
+        quint16 port;
+        OpenMode mode;
+        AddressRace* race;
+    } d;
+};
+#endif // QT_NO_SSL
+
+#endif // CONNECTSOCKET_H
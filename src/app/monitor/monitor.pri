@@ -5,7 +5,12 @@
 DEPENDPATH += $$PWD
 INCLUDEPATH += $$PWD
 
+HEADERS += $$PWD/connectsocket.h
+HEADERS += $$PWD/reconnectscheduler.h
 HEADERS += $$PWD/systemmonitor.h
+
+SOURCES += $$PWD/connectsocket.cpp
+SOURCES += $$PWD/reconnectscheduler.cpp
 SOURCES += $$PWD/systemmonitor.cpp
 
 mac {
@@ -15,9 +20,11 @@ mac {
     LIBS += -framework SystemConfiguration -framework AppKit
 } else:win32 {
     DEFINES += _WIN32_WINNT=0x0600
+    HEADERS += $$PWD/win/memorymonitor.h
     HEADERS += $$PWD/win/netlistmgr_util.h
     HEADERS += $$PWD/win/networkmonitor.h
     HEADERS += $$PWD/win/screenmonitor.h
+    SOURCES += $$PWD/win/memorymonitor.cpp
     SOURCES += $$PWD/win/networkmonitor.cpp
     SOURCES += $$PWD/win/screenmonitor.cpp
     SOURCES += $$PWD/systemmonitor_win.cpp
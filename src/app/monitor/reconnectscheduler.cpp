@@ -0,0 +1,201 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "reconnectscheduler.h"
+#include <IrcBufferModel>
+#include <IrcConnection>
+#include <QTimerEvent>
+#include <QDateTime>
+#include <QSettings>
+#include <climits>
+
+static const int TickInterval = 250;
+static const int StaggerDelay = 500;
+static const int MaximumBackoff = 300;
+
+ReconnectScheduler::ReconnectScheduler(QObject* parent) : QObject(parent)
+{
+    d.concurrency = 2;
+    d.jitter = 2000;
+    d.next = 0;
+}
+
+void ReconnectScheduler::addConnection(IrcConnection* connection)
+{
+    if (!d.connections.contains(connection)) {
+        d.connections += connection;
+        connect(connection, SIGNAL(connected()), this, SLOT(onConnected()));
+        connect(connection, SIGNAL(disconnected()), this, SLOT(onDisconnected()));
+        connect(connection, SIGNAL(socketError(QAbstractSocket::SocketError)), this, SLOT(onDisconnected()));
+        connect(connection, SIGNAL(destroyed(QObject*)), this, SLOT(onDestroyed(QObject*)));
+    }
+}
+
+void ReconnectScheduler::removeConnection(IrcConnection* connection)
+{
+    if (d.connections.removeOne(connection)) {
+        disconnect(connection, 0, this, 0);
+        release(connection);
+    }
+}
+
+IrcConnection* ReconnectScheduler::currentConnection() const
+{
+    return d.current;
+}
+
+void ReconnectScheduler::setCurrentConnection(IrcConnection* connection)
+{
+    d.current = connection;
+}
+
+void ReconnectScheduler::schedule()
+{
+    QSettings settings;
+    d.concurrency = qMax(1, settings.value("reconnectConcurrency", 2).toInt());
+    d.jitter = qMax(0, settings.value("reconnectJitter", 2000).toInt());
+
+    // a fresh wake starts over, failures from before the sleep are forgotten
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    foreach (IrcConnection* connection, d.connections) {
+        if (connection->isEnabled() && !connection->isActive() && !d.opening.contains(connection)) {
+            d.attempts.remove(connection);
+            enqueue(connection, now);
+        }
+    }
+}
+
+void ReconnectScheduler::cancel()
+{
+    foreach (IrcConnection* connection, d.connections)
+        release(connection);
+    d.timer.stop();
+}
+
+void ReconnectScheduler::timerEvent(QTimerEvent* event)
+{
+    if (event->timerId() != d.timer.timerId()) {
+        QObject::timerEvent(event);
+        return;
+    }
+
+    // the queue is sorted by priority, each one waits for its backoff
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    if (now >= d.next && d.opening.count() < d.concurrency) {
+        foreach (IrcConnection* connection, d.queue) {
+            if (d.due.value(connection) > now)
+                continue;
+            d.queue.removeOne(connection);
+            d.due.remove(connection);
+            if (!connection->isEnabled() || connection->isActive())
+                continue;
+
+            // libcommuni's own retry would bypass the cap and the backoff
+            if (!d.delays.contains(connection))
+                d.delays.insert(connection, connection->reconnectDelay());
+            connection->setReconnectDelay(0);
+            d.opening += connection;
+            connection->open();
+            d.next = now + StaggerDelay + (d.jitter > 0 ? qrand() % d.jitter : 0);
+            break;
+        }
+    }
+
+    if (d.queue.isEmpty())
+        d.timer.stop();
+}
+
+void ReconnectScheduler::onConnected()
+{
+    IrcConnection* connection = qobject_cast<IrcConnection*>(sender());
+    if (connection && d.opening.removeOne(connection)) {
+        d.attempts.remove(connection);
+        if (d.delays.contains(connection))
+            connection->setReconnectDelay(d.delays.take(connection));
+    }
+}
+
+void ReconnectScheduler::onDisconnected()
+{
+    // failed before registration completed, retried with a backoff
+    IrcConnection* connection = qobject_cast<IrcConnection*>(sender());
+    if (connection && d.opening.removeOne(connection) && connection->isEnabled()) {
+        const int attempt = d.attempts.value(connection) + 1;
+        d.attempts.insert(connection, attempt);
+        const int base = qMax(1, d.delays.value(connection, connection->reconnectDelay()));
+        const qint64 backoff = qMin<qint64>(qint64(base) << qMin(attempt - 1, 16), MaximumBackoff) * 1000;
+        const qint64 jitter = d.jitter > 0 ? qrand() % d.jitter : 0;
+        enqueue(connection, QDateTime::currentMSecsSinceEpoch() + backoff + jitter);
+    }
+}
+
+void ReconnectScheduler::onDestroyed(QObject* connection)
+{
+    // only the pointer is used, the connection is already gone
+    IrcConnection* conn = static_cast<IrcConnection*>(connection);
+    d.connections.removeOne(conn);
+    d.queue.removeOne(conn);
+    d.due.remove(conn);
+    d.attempts.remove(conn);
+    d.delays.remove(conn);
+    d.opening.removeOne(conn);
+}
+
+int ReconnectScheduler::priority(IrcConnection* connection) const
+{
+    // the one being looked at first, then by the number of open buffers
+    if (connection == d.current)
+        return INT_MAX;
+    IrcBufferModel* model = connection->findChild<IrcBufferModel*>();
+    return model ? model->count() : 0;
+}
+
+void ReconnectScheduler::enqueue(IrcConnection* connection, qint64 due)
+{
+    d.queue.removeOne(connection);
+    d.due.insert(connection, due);
+
+    const int prio = priority(connection);
+    int index = 0;
+    while (index < d.queue.count() && priority(d.queue.at(index)) >= prio)
+        ++index;
+    d.queue.insert(index, connection);
+
+    if (!d.timer.isActive())
+        d.timer.start(TickInterval, this);
+}
+
+void ReconnectScheduler::release(IrcConnection* connection)
+{
+    d.queue.removeOne(connection);
+    d.due.remove(connection);
+    d.attempts.remove(connection);
+    d.opening.removeOne(connection);
+    if (d.delays.contains(connection))
+        connection->setReconnectDelay(d.delays.take(connection));
+}
@@ -0,0 +1,85 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef RECONNECTSCHEDULER_H
+#define RECONNECTSCHEDULER_H
+
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QPointer>
+#include <QBasicTimer>
+
+class IrcConnection;
+
+class ReconnectScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ReconnectScheduler(QObject* parent = 0);
+
+    void addConnection(IrcConnection* connection);
+    void removeConnection(IrcConnection* connection);
+
+    IrcConnection* currentConnection() const;
+    void setCurrentConnection(IrcConnection* connection);
+
+public slots:
+    void schedule();
+    void cancel();
+
+protected:
+    void timerEvent(QTimerEvent* event);
+
+private slots:
+    void onConnected();
+    void onDisconnected();
+    void onDestroyed(QObject* connection);
+
+private:
+    int priority(IrcConnection* connection) const;
+    void enqueue(IrcConnection* connection, qint64 due);
+    void release(IrcConnection* connection);
+
+    struct Private {
+        int concurrency;
+        int jitter;
+        qint64 next;
+        QBasicTimer timer;
+        QPointer<IrcConnection> current;
+        QList<IrcConnection*> connections;
+        QList<IrcConnection*> queue;
+        QHash<IrcConnection*, qint64> due;
+        QHash<IrcConnection*, int> attempts;
+        QHash<IrcConnection*, int> delays;
+        QList<IrcConnection*> opening;
+    } d;
+};
+
+#endif // RECONNECTSCHEDULER_H
@@ -50,6 +50,7 @@ signals:
     void screenUnlocked();
     void screenSaverStarted();
     void screenSaverStopped();
+    void memoryLow();
 
 protected:
     void initialize();
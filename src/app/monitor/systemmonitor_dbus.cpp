@@ -27,18 +27,93 @@
 */
 
 #include "systemmonitor.h"
+#include <QSocketNotifier>
+#include <QTimer>
+#include <QFile>
 #include <QtDBus>
+#ifdef Q_OS_LINUX
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// a stall of 150ms within 2s, the shortest window the kernel allows unprivileged
+static const char PressureTrigger[] = "some 150000 2000000";
+// the fallback polls the ten second average instead
+static const int PressureInterval = 10000;
+static const double PressureThreshold = 10.0;
 
 class SystemMonitorPrivate : public QObject
 {
     Q_OBJECT
 
 public:
-    SystemMonitorPrivate(SystemMonitor* monitor) : monitor(monitor)
+    SystemMonitorPrivate(SystemMonitor* monitor) : monitor(monitor), fd(-1), notifier(0), timer(0)
+    {
+    }
+
+    ~SystemMonitorPrivate()
+    {
+#ifdef Q_OS_LINUX
+        delete notifier;
+        if (fd != -1)
+            ::close(fd);
+#endif
+    }
+
+    void watchPressure()
     {
+#ifdef Q_OS_LINUX
+        // the cgroup of the process first, a container or a systemd scope
+        // runs out long before the whole machine does
+        QFile cgroups("/proc/self/cgroup");
+        if (cgroups.open(QIODevice::ReadOnly)) {
+            foreach (const QByteArray& line, cgroups.readAll().split('\n')) {
+                if (line.startsWith("0::")) {
+                    const QString filePath = "/sys/fs/cgroup" + QString::fromLocal8Bit(line.mid(3)) + "/memory.pressure";
+                    if (QFile::exists(filePath))
+                        path = filePath;
+                }
+            }
+        }
+        if (path.isEmpty() && QFile::exists("/proc/pressure/memory"))
+            path = "/proc/pressure/memory";
+        if (path.isEmpty())
+            return;
+
+        fd = ::open(QFile::encodeName(path).constData(), O_RDWR | O_NONBLOCK);
+        if (fd != -1 && ::write(fd, PressureTrigger, sizeof(PressureTrigger)) > 0) {
+            notifier = new QSocketNotifier(fd, QSocketNotifier::Exception);
+            connect(notifier, SIGNAL(activated(int)), this, SLOT(memoryPressure()));
+            return;
+        }
+        if (fd != -1)
+            ::close(fd);
+        fd = -1;
+
+        timer = new QTimer(this);
+        connect(timer, SIGNAL(timeout()), this, SLOT(pollPressure()));
+        timer->start(PressureInterval);
+#endif
     }
 
 private slots:
+    void memoryPressure()
+    {
+        QMetaObject::invokeMethod(monitor, "memoryLow");
+    }
+
+    void pollPressure()
+    {
+        // "some avg10=1.23 avg60=... avg300=... total=..."
+        QFile file(path);
+        if (!file.open(QIODevice::ReadOnly))
+            return;
+        const QByteArray line = file.readLine();
+        const int pos = line.indexOf("avg10=");
+        if (pos != -1 && line.mid(pos + 6).split(' ').value(0).toDouble() >= PressureThreshold)
+            memoryPressure();
+    }
+
     void networkStateChanged(uint state)
     {
         static const uint NM_STATE_DISCONNECTED = 20;
@@ -60,6 +135,10 @@ private slots:
 
 private:
     SystemMonitor* monitor;
+    QString path;
+    int fd;
+    QSocketNotifier* notifier;
+    QTimer* timer;
 };
 
 void SystemMonitor::initialize()
@@ -80,6 +159,8 @@ void SystemMonitor::initialize()
                     "org.freedesktop.ScreenSaver", "ActiveChanged", d, SLOT(screenSaverActiveChanged(bool)));
     session.connect("org.gnome.ScreenSaver", "/org/gnome/ScreenSaver",
                     "org.gnome.ScreenSaver", "ActiveChanged", d, SLOT(screenSaverActiveChanged(bool)));
+
+    d->watchPressure();
 }
 
 void SystemMonitor::uninitialize()
@@ -42,6 +42,7 @@ class SystemMonitorPrivate
 public:
     Reachability* reachability;
     CocoaSystemMonitor* notifier;
+    dispatch_source_t pressure;
 };
 
 @implementation CocoaSystemMonitor
@@ -128,10 +129,26 @@ void SystemMonitor::initialize()
     [d->notifier setMonitor: this];
     d->reachability = [[Reachability reachabilityForInternetConnection] retain];
     [d->reachability startNotifier];
+
+    // warnings come before the system starts compressing and swapping us out
+    d->pressure = dispatch_source_create(DISPATCH_SOURCE_TYPE_MEMORYPRESSURE, 0,
+                                         DISPATCH_MEMORYPRESSURE_WARN | DISPATCH_MEMORYPRESSURE_CRITICAL,
+                                         dispatch_get_main_queue());
+    if (d->pressure) {
+        SystemMonitor* monitor = this;
+        dispatch_source_set_event_handler(d->pressure, ^{
+            QMetaObject::invokeMethod(monitor, "memoryLow", Qt::QueuedConnection);
+        });
+        dispatch_resume(d->pressure);
+    }
 }
 
 void SystemMonitor::uninitialize()
 {
+    if (d->pressure) {
+        dispatch_source_cancel(d->pressure);
+        dispatch_release(d->pressure);
+    }
     [d->notifier release];
     [d->reachability release];
     delete d;
@@ -29,6 +29,7 @@
 #include "systemmonitor.h"
 #include "win/screenmonitor.h"
 #include "win/networkmonitor.h"
+#include "win/memorymonitor.h"
 
 #include <qt_windows.h>
 #include <qabstracteventdispatcher.h>
@@ -62,6 +63,7 @@ public:
     SystemMonitor* monitor;
     NetworkMonitor network;
     ScreenMonitor screen;
+    MemoryMonitor memory;
 };
 
 void SystemMonitor::initialize()
@@ -76,6 +78,8 @@ void SystemMonitor::initialize()
     connect(&d->screen, SIGNAL(screenUnlocked()), this, SIGNAL(screenUnlocked()));
     connect(&d->screen, SIGNAL(screenSaverStarted()), this, SIGNAL(screenSaverStarted()));
     connect(&d->screen, SIGNAL(screenSaverStopped()), this, SIGNAL(screenSaverStopped()));
+
+    connect(&d->memory, SIGNAL(memoryLow()), this, SIGNAL(memoryLow()));
 }
 
 void SystemMonitor::uninitialize()
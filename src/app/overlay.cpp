@@ -29,12 +29,14 @@
 #include "overlay.h"
 #include "bufferview.h"
 #include "textbrowser.h"
+#include "perfstats.h"
 #include <QStyleOptionButton>
 #include <QPropertyAnimation>
 #include <QCoreApplication>
 #include <QStylePainter>
 #include <IrcConnection>
 #include <QPushButton>
+#include <QLabel>
 #include <QShortcut>
 #include <IrcBuffer>
 #include <QPointer>
@@ -185,6 +187,13 @@ Overlay::Overlay(BufferView* view) : QFrame(view)
     d.button = new OverlayButton(view);
     connect(d.button, SIGNAL(clicked()), this, SLOT(toggle()));
 
+    // the stats sit in a corner, toggled with /STATS overlay
+    d.stats = new QLabel(view);
+    d.stats->setVisible(false);
+    d.stats->setMargin(6);
+    d.stats->setAutoFillBackground(true);
+    d.stats->setAttribute(Qt::WA_TransparentForMouseEvents);
+
     d.shortcut = new QShortcut(Qt::Key_Space, view);
     d.shortcut->setContext(Qt::WidgetWithChildrenShortcut);
     connect(d.shortcut, SIGNAL(activated()), this, SLOT(toggle()));
@@ -205,6 +214,34 @@ BufferView* Overlay::view() const
     return d.view;
 }
 
+bool Overlay::isStatsVisible() const
+{
+    return !d.stats->isHidden();
+}
+
+void Overlay::setStatsVisible(bool visible)
+{
+    if (visible == isStatsVisible())
+        return;
+
+    // only a visible hud pays for the report
+    if (visible) {
+        connect(PerfStats::instance(), SIGNAL(updated()), this, SLOT(updateStats()));
+        updateStats();
+    } else {
+        disconnect(PerfStats::instance(), SIGNAL(updated()), this, SLOT(updateStats()));
+    }
+    d.stats->setVisible(visible);
+    d.stats->raise();
+}
+
+void Overlay::updateStats()
+{
+    d.stats->setText(PerfStats::instance()->report().join("\n"));
+    d.stats->adjustSize();
+    relayout();
+}
+
 bool Overlay::eventFilter(QObject* object, QEvent* event)
 {
     Q_UNUSED(object);
@@ -230,6 +267,8 @@ void Overlay::relayout()
 {
     resize(parentWidget()->size());
     d.button->setGeometry(QStyle::alignedRect(layoutDirection(), Qt::AlignCenter, d.button->size(), rect()));
+    if (!d.stats->isHidden())
+        d.stats->setGeometry(QStyle::alignedRect(layoutDirection(), Qt::AlignTop | Qt::AlignRight, d.stats->size(), rect().adjusted(0, 0, -20, 0)));
 }
 
 void Overlay::toggle()
@@ -34,6 +34,7 @@
 
 class IrcBuffer;
 class BufferView;
+class QLabel;
 class OverlayButton;
 
 class Overlay : public QFrame
@@ -45,6 +46,9 @@ public:
 
     BufferView* view() const;
 
+    bool isStatsVisible() const;
+    void setStatsVisible(bool visible);
+
 protected:
     bool eventFilter(QObject* object, QEvent* event);
 
@@ -53,6 +57,7 @@ private slots:
     void relayout();
     void toggle();
     void init(IrcBuffer* buffer);
+    void updateStats();
 
 private:
     struct Private {
@@ -60,6 +65,7 @@ private:
         IrcBuffer* buffer;
         QShortcut* shortcut;
         OverlayButton* button;
+        QLabel* stats;
     } d;
 };
 
@@ -0,0 +1,242 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "perfstats.h"
+#include "memorybudget.h"
+#include "textdocument.h"
+#include "messageformatter.h"
+#include "hookstats.h"
+#include "handshake.h"
+#include <QCoreApplication>
+#include <IrcConnection>
+#include <QTimerEvent>
+#include <QStandardPaths>
+#include <QDir>
+#include <IrcBuffer>
+#include <algorithm>
+
+// a late heartbeat is what the user perceives as a frozen window
+static const int HeartbeatInterval = 100;
+static const int TickInterval = 1000;
+static const int TopBuffers = 5;
+
+PerfStats::PerfStats(QObject* parent) : QObject(parent)
+{
+    d.lag = 0;
+    d.maxLag = 0;
+    d.worstLag = 0;
+    d.tick.start(TickInterval, this);
+    d.heartbeat.start(HeartbeatInterval, this);
+    d.beat.start();
+}
+
+PerfStats* PerfStats::instance()
+{
+    static QPointer<PerfStats> stats;
+    if (!stats)
+        stats = new PerfStats(QCoreApplication::instance());
+    return stats;
+}
+
+void PerfStats::addConnection(IrcConnection* connection)
+{
+    d.rates.insert(connection, Rate());
+    connect(connection, SIGNAL(messageReceived(IrcMessage*)), this, SLOT(countMessage()));
+}
+
+void PerfStats::removeConnection(IrcConnection* connection)
+{
+    d.rates.remove(connection);
+    disconnect(connection, SIGNAL(messageReceived(IrcMessage*)), this, SLOT(countMessage()));
+}
+
+void PerfStats::countMessage()
+{
+    IrcConnection* connection = static_cast<IrcConnection*>(sender());
+    QHash<IrcConnection*, Rate>::iterator it = d.rates.find(connection);
+    if (it != d.rates.end())
+        ++it->count;
+}
+
+void PerfStats::timerEvent(QTimerEvent* event)
+{
+    if (event->timerId() == d.heartbeat.timerId()) {
+        d.maxLag = qMax(d.maxLag, d.beat.restart() - HeartbeatInterval);
+    } else if (event->timerId() == d.tick.timerId()) {
+        QHash<IrcConnection*, Rate>::iterator it;
+        for (it = d.rates.begin(); it != d.rates.end(); ++it) {
+            it->rate = it->count;
+            it->count = 0;
+        }
+        d.lag = d.maxLag;
+        d.worstLag = qMax(d.worstLag, d.maxLag);
+        d.maxLag = 0;
+        emit updated();
+    }
+}
+
+QString PerfStats::traceFilePath()
+{
+    const QString dirPath = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+    QDir().mkpath(dirPath);
+    return dirPath + "/trace.json";
+}
+
+static QString latency(const QString& name, const char* counter)
+{
+    HookStats::Counter* c = HookStats::instance()->counter(QString::fromLatin1(counter));
+    if (!c->calls)
+        return PerfStats::tr("%1: -").arg(name);
+    return PerfStats::tr("%1: %2 us avg, %3 us p99").arg(name)
+                                                    .arg(c->nsecs / c->calls / 1000)
+                                                    .arg(c->percentile(99) / 1000);
+}
+
+static bool usageGreaterThan(const QPair<qint64, TextDocument*>& one, const QPair<qint64, TextDocument*>& another)
+{
+    return one.first > another.first;
+}
+
+// computed on demand, none of it is touched per message
+QStringList PerfStats::report() const
+{
+    QStringList lines;
+
+    QHash<IrcConnection*, Rate>::const_iterator it;
+    for (it = d.rates.constBegin(); it != d.rates.constEnd(); ++it) {
+        const Handshake* handshake = Handshake::instance(it.key());
+        if (handshake->readyTime() < 0)
+            lines += tr("%1: %2 msg/s").arg(it.key()->displayName()).arg(it->rate);
+        else
+            lines += tr("%1: %2 msg/s, ready in %3 ms%4").arg(it.key()->displayName()).arg(it->rate).arg(handshake->readyTime())
+                                                         .arg(handshake->isPipelined() ? tr(" (pipelined)") : QString());
+    }
+
+    lines += latency(tr("format"), "MessageFormatter::formatText");
+    lines += latency(tr("insert"), "TextDocument::flush");
+    // per frame, scrolling and resorting show up here as they happen
+    lines += latency(tr("key press to paint"), "TextInput::latency");
+    lines += latency(tr("paint text"), "TextBrowser::paint");
+    lines += latency(tr("paint tree"), "TreeWidget::paint");
+    lines += latency(tr("paint users"), "ListView::paint");
+    lines += latency(tr("resort"), "TreeWidget::applySorting");
+
+    QList<QPair<qint64, TextDocument*> > usage;
+    const QHash<TextDocument*, qint64> documents = MemoryBudget::instance()->usage();
+    int pending = 0;
+    int busiest = 0;
+    int textHits = 0;
+    int textMisses = 0;
+    TextDocument* busiestDocument = 0;
+    QHash<TextDocument*, qint64>::const_iterator doc;
+    for (doc = documents.constBegin(); doc != documents.constEnd(); ++doc) {
+        const MessageFormatter::Stats stats = doc.key()->formatter()->stats();
+        textHits += stats.textHits;
+        textMisses += stats.textMisses;
+        const int count = doc.key()->pendingCount();
+        pending += count;
+        if (count > busiest) {
+            busiest = count;
+            busiestDocument = doc.key();
+        }
+        usage += qMakePair(doc.value(), doc.key());
+    }
+    if (busiestDocument)
+        lines += tr("queued: %1 lines in %2 documents, %3 in %4").arg(pending).arg(documents.count()).arg(busiest).arg(busiestDocument->buffer()->title());
+    else
+        lines += tr("queued: none in %1 documents").arg(documents.count());
+    lines += tr("format cache: %1 hits, %2 misses").arg(textHits).arg(textMisses);
+
+    lines += tr("event loop lag: %1 ms, worst %2 ms").arg(d.lag).arg(d.worstLag);
+
+    std::sort(usage.begin(), usage.end(), usageGreaterThan);
+    lines += tr("memory: %1 kB").arg(MemoryBudget::instance()->totalUsage() / 1024);
+    for (int i = 0; i < qMin(TopBuffers, usage.count()); ++i)
+        lines += tr("  %1: %2 kB").arg(usage.at(i).second->buffer()->title()).arg(usage.at(i).first / 1024);
+    return lines;
+}
+
+static bool footprintGreaterThan(const QPair<TextDocument::Footprint, TextDocument*>& one, const QPair<TextDocument::Footprint, TextDocument*>& another)
+{
+    return one.first.total() > another.first.total();
+}
+
+static QString kiloBytes(qint64 bytes)
+{
+    return QString::number(bytes / 1024);
+}
+
+// measured afresh, this walks every row of every document
+QStringList PerfStats::memoryReport() const
+{
+    QStringList lines;
+
+    QList<IrcConnection*> connections = d.rates.keys();
+    foreach (IrcConnection* connection, connections) {
+        int users = 0;
+        const qint64 bytes = MemoryBudget::userUsage(connection, &users);
+        lines += tr("%1: %2 users, %3 kB").arg(connection->displayName()).arg(users).arg(kiloBytes(bytes));
+    }
+
+    QList<QPair<TextDocument::Footprint, TextDocument*> > footprints;
+    qint64 total = 0;
+    qint64 cold = 0;
+    qint64 coldRaw = 0;
+    foreach (TextDocument* document, MemoryBudget::instance()->usage().keys()) {
+        const TextDocument::Footprint footprint = document->measure();
+        footprints += qMakePair(footprint, document);
+        total += footprint.total();
+        cold += footprint.cold;
+        coldRaw += footprint.coldRaw;
+    }
+    std::sort(footprints.begin(), footprints.end(), footprintGreaterThan);
+
+    lines += tr("documents: %1 kB in %2, budget %3 kB").arg(kiloBytes(total)).arg(footprints.count()).arg(kiloBytes(MemoryBudget::instance()->budget()));
+    lines += tr("cold rows: %1 kB compressed from %2 kB, ratio %3").arg(kiloBytes(cold)).arg(kiloBytes(coldRaw)).arg(cold > 0 ? qreal(coldRaw) / cold : 0.0, 0, 'f', 1);
+    lines += tr("raw lines: keeping %1, %2 kB released").arg(MessageData::rawPolicy() == MessageData::KeepEventRaw ? tr("events only") : tr("all")).arg(kiloBytes(MessageData::rawReleased()));
+    for (int i = 0; i < footprints.count(); ++i) {
+        const TextDocument::Footprint& footprint = footprints.at(i).first;
+        TextDocument* document = footprints.at(i).second;
+        lines += tr("  %1%2: %3 kB, %4 rows, %5 blocks, html %6 kB, raw %7 kB, layout %8 kB, events %9 kB, index %10 kB, caches %11 kB, cold %12 kB of %13 kB (%14 slots)")
+                    .arg(document->buffer()->title())
+                    .arg(document->isClone() ? tr(" (clone)") : document->isHibernated() ? tr(" (hibernated)") : QString())
+                    .arg(kiloBytes(footprint.total()))
+                    .arg(footprint.rows)
+                    .arg(footprint.blocks)
+                    .arg(kiloBytes(footprint.html))
+                    .arg(kiloBytes(footprint.raw))
+                    .arg(kiloBytes(footprint.layout))
+                    .arg(kiloBytes(footprint.events))
+                    .arg(kiloBytes(footprint.index))
+                    .arg(kiloBytes(footprint.caches))
+                    .arg(kiloBytes(footprint.cold))
+                    .arg(kiloBytes(footprint.coldRaw))
+                    .arg(footprint.slots);
+    }
+    return lines;
+}
@@ -27,15 +27,26 @@
 */
 
 #include "pluginloader.h"
+#include "pluginthread.h"
 
 #include <QDir>
 #include <QFileInfo>
 #include <QApplication>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QSettings>
+#include <QStandardPaths>
 #include <QSet>
+#include <QThread>
+#include <QJsonObject>
 #include <QtPlugin>
 #include <QDebug>
 
 #include "bufferview.h"
+#include "hookstats.h"
+#include "tracer.h"
+#include "allocstats.h"
+#include "inputlatency.h"
 #include "bufferplugin.h"
 #include "connectionplugin.h"
 #include "dockplugin.h"
@@ -45,15 +56,43 @@
 #include "windowplugin.h"
 #include "settingsplugin.h"
 #include "genericplugin.h"
+#include "storageplugin.h"
+#include "threadplugin.h"
+#include "segmentstorage.h"
+#include <IrcBuffer>
 
-static QMap<QString, QObject*> loadPlugins(const QStringList& paths)
+#define COMMUNI_PLUGIN_IID(T, I) \
+    if (qobject_cast<T*>(I)) \
+        iids += QLatin1String(qobject_interface_iid<T*>());
+
+static QStringList pluginInterfaces(QObject* instance)
 {
-    QMap<QString, QObject*> result;
+    QStringList iids;
+    COMMUNI_PLUGIN_IID(BufferPlugin, instance)
+    COMMUNI_PLUGIN_IID(ConnectionPlugin, instance)
+    COMMUNI_PLUGIN_IID(DockPlugin, instance)
+    COMMUNI_PLUGIN_IID(DocumentPlugin, instance)
+    COMMUNI_PLUGIN_IID(ThemePlugin, instance)
+    COMMUNI_PLUGIN_IID(ViewPlugin, instance)
+    COMMUNI_PLUGIN_IID(WindowPlugin, instance)
+    COMMUNI_PLUGIN_IID(SettingsPlugin, instance)
+    COMMUNI_PLUGIN_IID(StoragePlugin, instance)
+    COMMUNI_PLUGIN_IID(GenericPlugin, instance)
+    COMMUNI_PLUGIN_IID(ThreadPlugin, instance)
+    return iids;
+}
+
+// the manifest remembers the interfaces of each library by its mtime and
+// size, so that libraries are loaded only once one of them is needed
+void PluginLoader::scan(const QStringList& paths)
+{
+    bool dirty = false;
+    QSet<QString> seen;
 
     foreach (const QString& path, paths) {
         foreach (const QFileInfo& file, QDir(path).entryInfoList(QDir::Files)) {
             const QString base = file.baseName();
-            if (result.contains(base))
+            if (d.plugins.contains(base))
                 continue;
             // blacklisted obsolete plugins
             if (base.startsWith("monitorplugin") || base.startsWith("libmonitorplugin"))
@@ -68,22 +107,150 @@ static QMap<QString, QObject*> loadPlugins(const QStringList& paths)
             if (!base.startsWith("lib"))
                 continue;
 #endif
-            QPluginLoader loader(file.absoluteFilePath());
-            if (loader.load()) {
-                result.insert(base, loader.instance());
+            const QString filePath = file.absoluteFilePath();
+            const QVariantList entry = d.manifest.value(filePath).toList();
+            seen.insert(filePath);
+
+            Plugin plugin;
+            plugin.path = filePath;
+            if (entry.count() == 3 && entry.at(0).toLongLong() == file.lastModified().toMSecsSinceEpoch()
+                    && entry.at(1).toLongLong() == file.size()) {
+                plugin.known = true;
+                plugin.interfaces = entry.at(2).toStringList();
+            } else if (QPluginLoader(filePath).metaData().isEmpty()) {
+                // not a Qt plugin at all, never worth loading
+                plugin.known = true;
+                d.manifest.insert(filePath, QVariantList() << file.lastModified().toMSecsSinceEpoch() << file.size() << QStringList());
+                dirty = true;
             }
+            if (!plugin.known || !plugin.interfaces.isEmpty())
+                d.plugins.insert(base, plugin);
         }
     }
 
-    return result;
+    foreach (const QString& filePath, d.manifest.keys()) {
+        if (!seen.contains(filePath)) {
+            d.manifest.remove(filePath);
+            dirty = true;
+        }
+    }
+    if (dirty)
+        QSettings().setValue("pluginManifest", d.manifest);
+}
+
+bool PluginLoader::load(const QString& name)
+{
+    QMap<QString, Plugin>::iterator it = d.plugins.find(name);
+    if (it == d.plugins.end())
+        return false;
+
+    Plugin& plugin = it.value();
+    if (!plugin.loaded) {
+        plugin.loaded = true;
+        QPluginLoader loader(plugin.path);
+        if (loader.load())
+            plugin.instance = loader.instance();
+        plugin.interfaces = pluginInterfaces(plugin.instance);
+
+        // slow plugins ask for a thread of their own with "thread": true
+        const QJsonObject meta = loader.metaData().value("MetaData").toObject();
+        if (meta.value("thread").toBool()) {
+            if (PluginThread::isThreadable(plugin.instance))
+                plugin.thread = new PluginThread(plugin.instance, meta.value("settings").toVariant().toStringList(), QCoreApplication::instance());
+            else
+                qWarning() << name << "asks for a thread, but does not implement ThreadPlugin alone";
+        }
+        plugin.known = true;
+
+        const QFileInfo file(plugin.path);
+        d.manifest.insert(plugin.path, QVariantList() << file.lastModified().toMSecsSinceEpoch() << file.size() << plugin.interfaces);
+        QSettings().setValue("pluginManifest", d.manifest);
+
+        if (plugin.instance && !d.disabledPlugins.contains(name)) {
+            d.enabledPlugins.insert(name, plugin.instance);
+            updatePlugins();
+        }
+    }
+    return plugin.instance;
+}
+
+void PluginLoader::require(const char* iid)
+{
+    const QString key = QLatin1String(iid);
+    if (!d.requested.contains(key)) {
+        d.requested.insert(key);
+        QMap<QString, Plugin>::const_iterator it;
+        for (it = d.plugins.constBegin(); it != d.plugins.constEnd(); ++it) {
+            const Plugin& plugin = it.value();
+            if (!plugin.loaded && !d.disabledPlugins.contains(it.key())
+                    && (!plugin.known || plugin.interfaces.contains(key)))
+                load(it.key());
+        }
+    }
+}
+
+template <typename T>
+static QList<T*> castPlugins(const QMap<QString, QObject*>& instances)
+{
+    QList<T*> plugins;
+    foreach (QObject* instance, instances) {
+        // threaded plugins are posted to, see PluginThread
+        if (instance->thread() != QThread::currentThread())
+            continue;
+        T* plugin = qobject_cast<T*>(instance);
+        if (plugin)
+            plugins += plugin;
+    }
+    return plugins;
+}
+
+// dispatch walks these instead of casting every plugin on every call
+void PluginLoader::updatePlugins()
+{
+    d.bufferPlugins = castPlugins<BufferPlugin>(d.enabledPlugins);
+    d.connectionPlugins = castPlugins<ConnectionPlugin>(d.enabledPlugins);
+    d.dockPlugins = castPlugins<DockPlugin>(d.enabledPlugins);
+    d.documentPlugins = castPlugins<DocumentPlugin>(d.enabledPlugins);
+    d.themePlugins = castPlugins<ThemePlugin>(d.enabledPlugins);
+    d.viewPlugins = castPlugins<ViewPlugin>(d.enabledPlugins);
+    d.windowPlugins = castPlugins<WindowPlugin>(d.enabledPlugins);
+    d.settingsPlugins = castPlugins<SettingsPlugin>(d.enabledPlugins);
+    d.storagePlugins = castPlugins<StoragePlugin>(d.enabledPlugins);
+    d.genericPlugins = castPlugins<GenericPlugin>(d.enabledPlugins);
+
+    d.pluginThreads.clear();
+    QMap<QString, QObject*>::const_iterator it;
+    for (it = d.enabledPlugins.constBegin(); it != d.enabledPlugins.constEnd(); ++it) {
+        PluginThread* thread = d.plugins.value(it.key()).thread;
+        if (thread)
+            d.pluginThreads += thread;
+    }
 }
 
 void PluginLoader::enablePlugin(const QString &plugin)
 {
     if (d.disabledPlugins.contains(plugin)) {
-        QObject *instance = d.disabledPlugins[plugin];
-        d.enabledPlugins.insert(plugin, instance);
         d.disabledPlugins.remove(plugin);
+        QSettings().setValue("disabledPlugins", QStringList(d.disabledPlugins.toList()));
+
+        QObject *instance = 0;
+        if (d.plugins.value(plugin).loaded)
+            instance = d.plugins.value(plugin).instance;
+        else if (load(plugin))
+            instance = d.plugins.value(plugin).instance;
+        if (!instance)
+            return;
+        d.enabledPlugins.insert(plugin, instance);
+        updatePlugins();
+
+        PluginThread* thread = d.plugins.value(plugin).thread;
+        if (thread) {
+            thread->post(PluginThread::SettingsChanged);
+            thread->post(PluginThread::PluginEnabled);
+            foreach (IrcBuffer* buffer, d.buffers)
+                thread->post(PluginThread::BufferAdded, PluginThread::copy(buffer));
+            return;
+        }
 
         // Special case for SettingsPlugin instances so that they don't remain in an obsolete state
         SettingsPlugin *settingPluginInstance = qobject_cast<SettingsPlugin*>(instance);
@@ -100,11 +267,18 @@ void PluginLoader::enablePlugin(const QString &plugin)
 
 void PluginLoader::disablePlugin(const QString &plugin)
 {
-    if (d.enabledPlugins.contains(plugin)) {
-        QObject *instance = d.enabledPlugins[plugin];
-        d.disabledPlugins.insert(plugin, instance);
-        d.enabledPlugins.remove(plugin);
+    if (d.plugins.contains(plugin) && !d.disabledPlugins.contains(plugin)) {
+        d.disabledPlugins.insert(plugin);
+        QSettings().setValue("disabledPlugins", QStringList(d.disabledPlugins.toList()));
+
+        QObject *instance = d.enabledPlugins.take(plugin);
+        updatePlugins();
 
+        PluginThread* thread = d.plugins.value(plugin).thread;
+        if (thread) {
+            thread->post(PluginThread::PluginDisabled);
+            return;
+        }
         GenericPlugin *genericPluginInstance = qobject_cast<GenericPlugin*>(instance);
         if (genericPluginInstance) {
             genericPluginInstance->pluginDisabled();
@@ -130,7 +304,13 @@ QStringList PluginLoader::paths()
 PluginLoader::PluginLoader(QObject* parent) : QObject(parent)
 {
     qRegisterMetaType<BufferView*>();
-    d.enabledPlugins = loadPlugins(QApplication::libraryPaths());
+    d.batch = 0;
+    d.defaultStorage = 0;
+
+    QSettings settings;
+    d.manifest = settings.value("pluginManifest").toMap();
+    d.disabledPlugins = settings.value("disabledPlugins").toStringList().toSet();
+    scan(QApplication::libraryPaths());
 }
 
 PluginLoader* PluginLoader::instance()
@@ -139,94 +319,224 @@ PluginLoader* PluginLoader::instance()
     return &loader;
 }
 
-#define COMMUNI_PLUGIN_CALL(T, F) \
-    foreach (QObject* instance, d.enabledPlugins) { \
-        T* plugin = qobject_cast<T*>(instance); \
-        if (plugin) \
-            plugin->F; \
+template <typename T>
+static HookStats::Counter* hookCounter(T* plugin, const char* call)
+{
+    QObject* instance = dynamic_cast<QObject*>(plugin);
+    const QString name = instance ? QString::fromLatin1(instance->metaObject()->className()) : QString("?");
+    return HookStats::instance()->counter(name + "::" + QString::fromLatin1(call).section('(', 0, 0));
+}
+
+// plugins implementing T are loaded on the first call at each site,
+// and every call is timed into a counter per plugin and hook
+#define COMMUNI_PLUGIN_CALL(T, L, F) \
+    static bool required = false; \
+    static QHash<T*, HookStats::Counter*> counters; \
+    if (!required) { \
+        required = true; \
+        require(qobject_interface_iid<T*>()); \
+    } \
+    foreach (T* plugin, d.L) { \
+        HookStats::Counter*& counter = counters[plugin]; \
+        if (!counter) \
+            counter = hookCounter(plugin, #F); \
+        COMMUNI_TRACE(#T "::" #F); \
+        COMMUNI_ALLOC_STAGE(Plugins); \
+        InputLatency::note(#T "::" #F); \
+        QElapsedTimer timer; \
+        timer.start(); \
+        plugin->F; \
+        counter->add(timer.nsecsElapsed()); \
     }
 
+// threaded plugins get a copy of the same hook, see ThreadPlugin
+#define COMMUNI_PLUGIN_POST(...) \
+    static bool posted = false; \
+    if (!posted) { \
+        posted = true; \
+        require(qobject_interface_iid<ThreadPlugin*>()); \
+    } \
+    foreach (PluginThread* thread, d.pluginThreads) \
+        thread->post(__VA_ARGS__);
+
+// an enabled storage plugin replaces the segment files, the first one wins
+StoragePlugin* PluginLoader::storage()
+{
+    static bool required = false;
+    if (!required) {
+        required = true;
+        require(qobject_interface_iid<StoragePlugin*>());
+    }
+    if (!d.storagePlugins.isEmpty())
+        return d.storagePlugins.first();
+
+    if (!d.defaultStorage) {
+#if QT_VERSION >= 0x050400
+        const QString dataDir = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+#else
+        const QString dataDir = QStandardPaths::writableLocation(QStandardPaths::DataLocation);
+#endif
+        d.defaultStorage = new SegmentStorage(dataDir + "/storage", this);
+    }
+    return d.defaultStorage;
+}
+
+// buffers and documents added in between are handed over in one call
+void PluginLoader::beginBatch()
+{
+    ++d.batch;
+}
+
+void PluginLoader::endBatch()
+{
+    if (d.batch > 0 && --d.batch == 0) {
+        const QList<IrcBuffer*> buffers = d.addedBuffers;
+        const QList<TextDocument*> documents = d.addedDocuments;
+        d.addedBuffers.clear();
+        d.addedDocuments.clear();
+        if (!buffers.isEmpty()) {
+            COMMUNI_PLUGIN_CALL(BufferPlugin, bufferPlugins, buffersAdded(buffers))
+            foreach (IrcBuffer* buffer, buffers) {
+                COMMUNI_PLUGIN_POST(PluginThread::BufferAdded, PluginThread::copy(buffer))
+            }
+        }
+        if (!documents.isEmpty()) {
+            COMMUNI_PLUGIN_CALL(DocumentPlugin, documentPlugins, documentsAdded(documents))
+        }
+    }
+}
+
 void PluginLoader::bufferAdded(IrcBuffer* buffer)
 {
-    COMMUNI_PLUGIN_CALL(BufferPlugin, bufferAdded(buffer))
+    d.buffers += buffer;
+    connect(buffer, SIGNAL(messageReceived(IrcMessage*)), this, SLOT(postMessage(IrcMessage*)), Qt::UniqueConnection);
+    if (d.batch) {
+        d.addedBuffers += buffer;
+        return;
+    }
+    COMMUNI_PLUGIN_CALL(BufferPlugin, bufferPlugins, bufferAdded(buffer))
+    COMMUNI_PLUGIN_POST(PluginThread::BufferAdded, PluginThread::copy(buffer))
 }
 
 void PluginLoader::bufferRemoved(IrcBuffer* buffer)
 {
-    COMMUNI_PLUGIN_CALL(BufferPlugin, bufferRemoved(buffer))
+    d.buffers.removeOne(buffer);
+    disconnect(buffer, SIGNAL(messageReceived(IrcMessage*)), this, SLOT(postMessage(IrcMessage*)));
+    if (d.addedBuffers.removeOne(buffer))
+        return;
+    COMMUNI_PLUGIN_CALL(BufferPlugin, bufferPlugins, bufferRemoved(buffer))
+    COMMUNI_PLUGIN_POST(PluginThread::BufferRemoved, PluginThread::copy(buffer))
+}
+
+void PluginLoader::postMessage(IrcMessage* message)
+{
+    // the message is gone once this returns, the threads get a copy
+    IrcBuffer* buffer = qobject_cast<IrcBuffer*>(sender());
+    if (!buffer || d.pluginThreads.isEmpty())
+        return;
+    const ThreadMessage copy = PluginThread::copy(buffer, message);
+    foreach (PluginThread* thread, d.pluginThreads)
+        thread->post(copy);
 }
 
 void PluginLoader::connectionAdded(IrcConnection* connection)
 {
-    COMMUNI_PLUGIN_CALL(ConnectionPlugin, connectionAdded(connection))
+    COMMUNI_PLUGIN_CALL(ConnectionPlugin, connectionPlugins, connectionAdded(connection))
 }
 
 void PluginLoader::connectionRemoved(IrcConnection* connection)
 {
-    COMMUNI_PLUGIN_CALL(ConnectionPlugin, connectionRemoved(connection))
+    COMMUNI_PLUGIN_CALL(ConnectionPlugin, connectionPlugins, connectionRemoved(connection))
 }
 
 void PluginLoader::setConnectionsList(const QList<IrcConnection*>* list)
 {
-    COMMUNI_PLUGIN_CALL(ConnectionPlugin, setConnectionsList(list))
+    COMMUNI_PLUGIN_CALL(ConnectionPlugin, connectionPlugins, setConnectionsList(list))
 }
 
 void PluginLoader::viewAdded(BufferView* view)
 {
-    COMMUNI_PLUGIN_CALL(ViewPlugin, viewAdded(view))
+    COMMUNI_PLUGIN_CALL(ViewPlugin, viewPlugins, viewAdded(view))
 }
 
 void PluginLoader::viewRemoved(BufferView* view)
 {
-    COMMUNI_PLUGIN_CALL(ViewPlugin, viewRemoved(view))
+    COMMUNI_PLUGIN_CALL(ViewPlugin, viewPlugins, viewRemoved(view))
+}
+
+void PluginLoader::viewPooled(BufferView* view)
+{
+    COMMUNI_PLUGIN_CALL(ViewPlugin, viewPlugins, viewPooled(view))
+}
+
+void PluginLoader::viewRecycled(BufferView* view)
+{
+    COMMUNI_PLUGIN_CALL(ViewPlugin, viewPlugins, viewRecycled(view))
 }
 
 void PluginLoader::documentAdded(TextDocument* doc)
 {
-    COMMUNI_PLUGIN_CALL(DocumentPlugin, documentAdded(doc))
+    if (d.batch) {
+        d.addedDocuments += doc;
+        return;
+    }
+    COMMUNI_PLUGIN_CALL(DocumentPlugin, documentPlugins, documentAdded(doc))
 }
 
 void PluginLoader::documentRemoved(TextDocument* doc)
 {
-    COMMUNI_PLUGIN_CALL(DocumentPlugin, documentRemoved(doc))
+    if (d.addedDocuments.removeOne(doc))
+        return;
+    COMMUNI_PLUGIN_CALL(DocumentPlugin, documentPlugins, documentRemoved(doc))
+}
+
+void PluginLoader::documentReleased(TextDocument* doc)
+{
+    COMMUNI_PLUGIN_CALL(DocumentPlugin, documentPlugins, documentReleased(doc))
 }
 
 void PluginLoader::themeChanged(const ThemeInfo& theme)
 {
-    COMMUNI_PLUGIN_CALL(ThemePlugin, themeChanged(theme))
+    COMMUNI_PLUGIN_CALL(ThemePlugin, themePlugins, themeChanged(theme))
 }
 
 void PluginLoader::windowCreated(QMainWindow* window)
 {
-    COMMUNI_PLUGIN_CALL(WindowPlugin, windowCreated(window))
+    COMMUNI_PLUGIN_CALL(WindowPlugin, windowPlugins, windowCreated(window))
 }
 
 void PluginLoader::windowDestroyed(QMainWindow* window)
 {
-    COMMUNI_PLUGIN_CALL(WindowPlugin, windowDestroyed(window))
+    COMMUNI_PLUGIN_CALL(WindowPlugin, windowPlugins, windowDestroyed(window))
 }
 
 void PluginLoader::windowShowEvent(QMainWindow* window, QShowEvent* event)
 {
-    COMMUNI_PLUGIN_CALL(WindowPlugin, windowShowEvent(window, event))
+    COMMUNI_PLUGIN_CALL(WindowPlugin, windowPlugins, windowShowEvent(window, event))
 }
 
 void PluginLoader::dockAlert(IrcMessage* message)
 {
-    COMMUNI_PLUGIN_CALL(DockPlugin, dockAlert(message))
+    COMMUNI_PLUGIN_CALL(DockPlugin, dockPlugins, dockAlert(message))
+}
+
+void PluginLoader::dockBadgeChanged(int unread, int alerts)
+{
+    COMMUNI_PLUGIN_CALL(DockPlugin, dockPlugins, dockBadgeChanged(unread, alerts))
 }
 
 void PluginLoader::setupTrayIcon(QSystemTrayIcon* tray)
 {
-    COMMUNI_PLUGIN_CALL(DockPlugin, setupTrayIcon(tray))
+    COMMUNI_PLUGIN_CALL(DockPlugin, dockPlugins, setupTrayIcon(tray))
 }
 
 void PluginLoader::setupMuteAction(QAction* action)
 {
-    COMMUNI_PLUGIN_CALL(DockPlugin, setupMuteAction(action))
+    COMMUNI_PLUGIN_CALL(DockPlugin, dockPlugins, setupMuteAction(action))
 }
 
 void PluginLoader::settingsChanged()
 {
-    COMMUNI_PLUGIN_CALL(SettingsPlugin, settingsChanged())
+    COMMUNI_PLUGIN_CALL(SettingsPlugin, settingsPlugins, settingsChanged())
+    COMMUNI_PLUGIN_POST(PluginThread::SettingsChanged)
 }
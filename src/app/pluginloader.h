@@ -30,7 +30,10 @@
 #define PLUGINLOADER_H
 
 #include <QPluginLoader>
+#include <QStringList>
+#include <QVariant>
 #include <QMap>
+#include <QSet>
 
 class IrcBuffer;
 class ThemeInfo;
@@ -38,6 +41,17 @@ class BufferView;
 class IrcMessage;
 class TextDocument;
 class IrcConnection;
+class DockPlugin;
+class ViewPlugin;
+class ThemePlugin;
+class BufferPlugin;
+class WindowPlugin;
+class GenericPlugin;
+class DocumentPlugin;
+class SettingsPlugin;
+class StoragePlugin;
+class ConnectionPlugin;
+class PluginThread;
 
 QT_FORWARD_DECLARE_CLASS(QAction)
 QT_FORWARD_DECLARE_CLASS(QMainWindow)
@@ -56,6 +70,11 @@ public:
     void enablePlugin(const QString &plugin);
     void disablePlugin(const QString &plugin);
 
+    void beginBatch();
+    void endBatch();
+
+    StoragePlugin* storage();
+
 public slots:
     void bufferAdded(IrcBuffer* buffer);
     void bufferRemoved(IrcBuffer* buffer);
@@ -66,9 +85,12 @@ public slots:
 
     void viewAdded(BufferView* view);
     void viewRemoved(BufferView* view);
+    void viewPooled(BufferView* view);
+    void viewRecycled(BufferView* view);
 
     void documentAdded(TextDocument* doc);
     void documentRemoved(TextDocument* doc);
+    void documentReleased(TextDocument* doc);
 
     void themeChanged(const ThemeInfo& theme);
 
@@ -77,16 +99,55 @@ public slots:
     void windowShowEvent(QMainWindow* window, QShowEvent *event);
 
     void dockAlert(IrcMessage* message);
+    void dockBadgeChanged(int unread, int alerts);
     void setupTrayIcon(QSystemTrayIcon* tray);
     void setupMuteAction(QAction* action);
 
     void settingsChanged();
 
+private slots:
+    void postMessage(IrcMessage* message);
+
 private:
     PluginLoader(QObject* parent = 0);
+
+    void scan(const QStringList& paths);
+    bool load(const QString& plugin);
+    void require(const char* iid);
+    void updatePlugins();
+
+    struct Plugin {
+        Plugin() : known(false), loaded(false), instance(0), thread(0) { }
+        QString path;
+        bool known;
+        bool loaded;
+        QObject* instance;
+        PluginThread* thread;
+        QStringList interfaces;
+    };
+
     struct Private {
+        QMap<QString, Plugin> plugins;
         QMap<QString, QObject*> enabledPlugins;
-        QMap<QString, QObject*> disabledPlugins;
+        QSet<QString> disabledPlugins;
+        QSet<QString> requested;
+        QVariantMap manifest;
+        int batch;
+        QList<IrcBuffer*> buffers;
+        QList<IrcBuffer*> addedBuffers;
+        QList<TextDocument*> addedDocuments;
+        QList<BufferPlugin*> bufferPlugins;
+        QList<ConnectionPlugin*> connectionPlugins;
+        QList<DockPlugin*> dockPlugins;
+        QList<DocumentPlugin*> documentPlugins;
+        QList<ThemePlugin*> themePlugins;
+        QList<ViewPlugin*> viewPlugins;
+        QList<WindowPlugin*> windowPlugins;
+        QList<SettingsPlugin*> settingsPlugins;
+        QList<StoragePlugin*> storagePlugins;
+        StoragePlugin* defaultStorage;
+        QList<GenericPlugin*> genericPlugins;
+        QList<PluginThread*> pluginThreads;
     } d;
 };
 
@@ -0,0 +1,233 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "pluginthread.h"
+#include "bufferplugin.h"
+#include "connectionplugin.h"
+#include "dockplugin.h"
+#include "documentplugin.h"
+#include "genericplugin.h"
+#include "settingscache.h"
+#include "settingsplugin.h"
+#include "storageplugin.h"
+#include "themeplugin.h"
+#include "viewplugin.h"
+#include "windowplugin.h"
+#include <QCoreApplication>
+#include <QMutexLocker>
+#include <IrcConnection>
+#include <IrcNetwork>
+#include <IrcMessage>
+#include <IrcBuffer>
+#include <QEvent>
+#include <QDebug>
+
+// a burst is taken in as a whole, past this messages are dropped
+static const int MaximumPending = 1024;
+
+// how long a poster waits for room before the plugin starts losing messages
+static const int MaximumWait = 20;
+
+static const QEvent::Type HookEventType = static_cast<QEvent::Type>(QEvent::registerEventType());
+
+// lives in the plugin thread, one event delivers everything queued since
+class HookReceiver : public QObject
+{
+public:
+    HookReceiver(PluginThread* thread) : thread(thread) { }
+
+    bool event(QEvent* event)
+    {
+        if (event->type() != HookEventType)
+            return QObject::event(event);
+        thread->deliver();
+        return true;
+    }
+
+private:
+    PluginThread* thread;
+};
+
+PluginThread::PluginThread(QObject* plugin, const QStringList& settings, QObject* parent) : QThread(parent)
+{
+    d.plugin = qobject_cast<ThreadPlugin*>(plugin);
+    d.instance = plugin;
+    d.settings = settings;
+    d.pending = 0;
+    d.dropped = 0;
+    d.overflow = false;
+    d.receiver = new HookReceiver(this);
+    d.receiver->moveToThread(this);
+    plugin->moveToThread(this);
+    setObjectName(plugin->metaObject()->className());
+    start(LowPriority);
+}
+
+PluginThread::~PluginThread()
+{
+    quit();
+    wait();
+
+    // the thread is gone, whatever it did not get to is delivered from here
+    deliver();
+    delete d.receiver;
+}
+
+QObject* PluginThread::plugin() const
+{
+    return d.instance;
+}
+
+int PluginThread::pending() const
+{
+    QMutexLocker locker(&d.mutex);
+    return d.pending;
+}
+
+int PluginThread::dropped() const
+{
+    QMutexLocker locker(&d.mutex);
+    return d.dropped;
+}
+
+bool PluginThread::isThreadable(QObject* plugin)
+{
+    // every other interface hands out objects of the gui thread
+    return qobject_cast<ThreadPlugin*>(plugin)
+            && !qobject_cast<BufferPlugin*>(plugin) && !qobject_cast<ConnectionPlugin*>(plugin)
+            && !qobject_cast<DockPlugin*>(plugin) && !qobject_cast<DocumentPlugin*>(plugin)
+            && !qobject_cast<GenericPlugin*>(plugin) && !qobject_cast<SettingsPlugin*>(plugin)
+            && !qobject_cast<StoragePlugin*>(plugin) && !qobject_cast<ThemePlugin*>(plugin)
+            && !qobject_cast<ViewPlugin*>(plugin) && !qobject_cast<WindowPlugin*>(plugin);
+}
+
+ThreadBuffer PluginThread::copy(IrcBuffer* buffer)
+{
+    ThreadBuffer copy;
+    copy.network = buffer->network()->name();
+    copy.title = buffer->title();
+    copy.channel = buffer->isChannel();
+    return copy;
+}
+
+ThreadMessage PluginThread::copy(IrcBuffer* buffer, IrcMessage* message)
+{
+    ThreadMessage copy;
+    copy.buffer = PluginThread::copy(buffer);
+    copy.type = message->type();
+    copy.own = message->isOwn();
+    copy.nick = message->nick();
+    copy.data = message->toData();
+    copy.timeStamp = message->timeStamp();
+    return copy;
+}
+
+void PluginThread::post(Hook hook)
+{
+    Call call;
+    call.hook = hook;
+    if (hook == SettingsChanged) {
+        SettingsCache* settings = SettingsCache::instance();
+        foreach (const QString& key, d.settings)
+            call.settings.insert(key, settings->value(key));
+    }
+    enqueue(call);
+}
+
+void PluginThread::post(Hook hook, const ThreadBuffer& buffer)
+{
+    Call call;
+    call.hook = hook;
+    call.buffer = buffer;
+    enqueue(call);
+}
+
+void PluginThread::post(const ThreadMessage& message)
+{
+    Call call;
+    call.hook = MessagesReceived;
+    call.messages += message;
+    enqueue(call);
+}
+
+void PluginThread::enqueue(const Call& call)
+{
+    QMutexLocker locker(&d.mutex);
+
+    // a full queue holds the poster up once, briefly, and never on the
+    // plugin thread itself. while the plugin is behind, messages are dropped,
+    // the other hooks are rare and always queued
+    if (d.pending >= MaximumPending && !d.overflow && QThread::currentThread() != this)
+        d.drained.wait(&d.mutex, MaximumWait);
+    if (d.pending >= MaximumPending && call.hook == MessagesReceived) {
+        if (!d.overflow)
+            qWarning() << objectName() << "is behind, dropping messages";
+        d.overflow = true;
+        ++d.dropped;
+        return;
+    }
+
+    const bool wake = d.calls.isEmpty();
+    if (call.hook == MessagesReceived && !wake && d.calls.last().hook == MessagesReceived)
+        d.calls.last().messages += call.messages;
+    else
+        d.calls += call;
+    ++d.pending;
+    if (wake)
+        QCoreApplication::postEvent(d.receiver, new QEvent(HookEventType));
+}
+
+void PluginThread::deliver()
+{
+    QList<Call> calls;
+    {
+        QMutexLocker locker(&d.mutex);
+        calls.swap(d.calls);
+        d.pending = 0;
+        d.overflow = false;
+        d.drained.wakeAll();
+    }
+
+    foreach (const Call& call, calls)
+        run(call);
+}
+
+void PluginThread::run(const Call& call)
+{
+    if (!d.plugin)
+        return;
+
+    switch (call.hook) {
+    case BufferAdded: d.plugin->bufferAdded(call.buffer); break;
+    case BufferRemoved: d.plugin->bufferRemoved(call.buffer); break;
+    case MessagesReceived: d.plugin->messagesReceived(call.messages); break;
+    case SettingsChanged: d.plugin->settingsChanged(call.settings); break;
+    case PluginEnabled: d.plugin->pluginEnabled(); break;
+    case PluginDisabled: d.plugin->pluginDisabled(); break;
+    }
+}
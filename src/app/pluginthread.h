@@ -0,0 +1,97 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef PLUGINTHREAD_H
+#define PLUGINTHREAD_H
+
+#include <QList>
+#include <QMutex>
+#include <QThread>
+#include <QStringList>
+#include <QVariantMap>
+#include <QWaitCondition>
+#include "threadplugin.h"
+
+class IrcBuffer;
+class IrcMessage;
+
+// a plugin that asks for a thread of its own in its metadata lives here,
+// its hooks are copied and delivered in batches, see ThreadPlugin
+class PluginThread : public QThread
+{
+    Q_OBJECT
+
+public:
+    enum Hook { BufferAdded, BufferRemoved, MessagesReceived, SettingsChanged, PluginEnabled, PluginDisabled };
+
+    PluginThread(QObject* plugin, const QStringList& settings, QObject* parent = 0);
+    ~PluginThread();
+
+    QObject* plugin() const;
+    int pending() const;
+    int dropped() const;
+
+    static bool isThreadable(QObject* plugin);
+
+    static ThreadBuffer copy(IrcBuffer* buffer);
+    static ThreadMessage copy(IrcBuffer* buffer, IrcMessage* message);
+
+    void post(Hook hook);
+    void post(Hook hook, const ThreadBuffer& buffer);
+    void post(const ThreadMessage& message);
+
+private:
+    friend class HookReceiver;
+    void deliver();
+
+    struct Call {
+        Call() : hook(SettingsChanged) { }
+        Hook hook;
+        ThreadBuffer buffer;
+        QList<ThreadMessage> messages;
+        QVariantMap settings;
+    };
+
+    void enqueue(const Call& call);
+    void run(const Call& call);
+
+    struct Private {
+        ThreadPlugin* plugin;
+        QObject* instance;
+        QObject* receiver;
+        QStringList settings;
+        mutable QMutex mutex;
+        QWaitCondition drained;
+        QList<Call> calls;
+        int pending;
+        int dropped;
+        bool overflow;
+    } d;
+};
+
+#endif // PLUGINTHREAD_H
@@ -0,0 +1,10 @@
+######################################################################
+# Communi
+######################################################################
+
+DEPENDPATH += $$PWD
+INCLUDEPATH += $$PWD
+
+HEADERS += $$PWD/trafficreplay.h
+
+SOURCES += $$PWD/trafficreplay.cpp
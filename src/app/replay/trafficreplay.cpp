@@ -0,0 +1,264 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "trafficreplay.h"
+#include "memorybudget.h"
+#include "textdocument.h"
+#include "settingscache.h"
+#include <QCoreApplication>
+#include <IrcConnection>
+#include <QTextStream>
+#include <QStringList>
+#include <IrcBuffer>
+#include <QDateTime>
+#include <QFileInfo>
+#include <QFile>
+#include <QMap>
+#include <algorithm>
+
+// lines per event loop turn when replaying as fast as possible
+static const int BurstSize = 500;
+static const int PaceInterval = 5;
+static const int HeartbeatInterval = 10;
+static const int StallLimits[] = { 16, 50, 100, 250, 1000 };
+static const int StallBuckets = sizeof(StallLimits) / sizeof(StallLimits[0]) + 1;
+static const char* EndToken = "communi-replay";
+
+static qint64 timeTag(const QByteArray& line)
+{
+    // @time=2016-01-01T12:00:00.000Z;other=tags :prefix COMMAND ...
+    if (!line.startsWith('@'))
+        return -1;
+    const QList<QByteArray> tags = line.mid(1, line.indexOf(' ') - 1).split(';');
+    foreach (const QByteArray& tag, tags) {
+        if (tag.startsWith("time=")) {
+            const QDateTime time = QDateTime::fromString(QString::fromLatin1(tag.mid(5)), Qt::ISODate);
+            if (time.isValid())
+                return time.toMSecsSinceEpoch();
+        }
+    }
+    return -1;
+}
+
+TrafficReplay::TrafficReplay(const QString& filePath, QObject* parent) : QObject(parent)
+{
+    d.filePath = filePath;
+    d.speed = 1.0;
+    d.next = 0;
+    d.first = -1;
+    d.started = 0;
+    d.stalls.fill(0, StallBuckets);
+    d.worstStall = 0;
+    connect(&d.server, SIGNAL(newConnection()), this, SLOT(accept()));
+}
+
+double TrafficReplay::speed() const
+{
+    return d.speed;
+}
+
+void TrafficReplay::setSpeed(double speed)
+{
+    // zero or less sends everything as fast as the pipeline takes it
+    d.speed = speed;
+}
+
+bool TrafficReplay::start()
+{
+    load();
+    if (d.lines.isEmpty() || !d.server.listen(QHostAddress::LocalHost))
+        return false;
+
+    // the window restores this like any saved connection and opens it
+    IrcConnection connection;
+    connection.setHost("127.0.0.1");
+    connection.setPort(d.server.serverPort());
+    connection.setNickName(d.nickName);
+    connection.setUserName(d.nickName);
+    connection.setRealName(d.nickName);
+    connection.setDisplayName(QFileInfo(d.filePath).fileName());
+
+    QVariantMap state;
+    state.insert("connection", connection.saveState());
+    SettingsCache* settings = SettingsCache::instance();
+    settings->setValue("connections", QVariantList() << state);
+
+    d.heartbeat.start(HeartbeatInterval, this);
+    d.beat.start();
+    return true;
+}
+
+void TrafficReplay::load()
+{
+    QFile file(d.filePath);
+    if (!file.open(QIODevice::ReadOnly))
+        return;
+
+    qint64 msecs = -1;
+    while (!file.atEnd()) {
+        const QByteArray data = file.readLine().trimmed();
+        if (data.isEmpty())
+            continue;
+
+        // untagged lines go out along with the previous one
+        const qint64 time = timeTag(data);
+        if (time != -1)
+            msecs = time;
+        if (d.first == -1)
+            d.first = msecs;
+
+        Line line;
+        line.data = data + "\r\n";
+        line.msecs = msecs;
+        d.lines += line;
+
+        // the capture's own nick, so that its joins create the buffers
+        if (d.nickName.isEmpty()) {
+            const QList<QByteArray> params = data.split(' ');
+            const int index = params.indexOf("001");
+            if (index > 0 && index + 1 < params.count())
+                d.nickName = QString::fromUtf8(params.at(index + 1));
+        }
+    }
+    if (d.nickName.isEmpty())
+        d.nickName = "communi";
+}
+
+void TrafficReplay::accept()
+{
+    QTcpSocket* socket = d.server.nextPendingConnection();
+    if (d.socket) {
+        socket->deleteLater();
+        return;
+    }
+    d.socket = socket;
+    connect(socket, SIGNAL(readyRead()), this, SLOT(receive()));
+}
+
+void TrafficReplay::receive()
+{
+    const QByteArray data = d.socket->readAll();
+
+    // the client registers first, then the capture starts
+    if (!d.clock.isValid()) {
+        if (!d.lines.first().data.contains(" 001 "))
+            d.socket->write(":communi 001 " + d.nickName.toUtf8() + " :Replaying " + QFile::encodeName(d.filePath) + "\r\n");
+        d.clock.start();
+        d.pacer.start(d.speed > 0 ? PaceInterval : 0, this);
+    }
+
+    // answered once everything before it went through the filters and models
+    if (data.contains("PONG") && data.contains(EndToken))
+        finish();
+}
+
+void TrafficReplay::timerEvent(QTimerEvent* event)
+{
+    if (event->timerId() == d.pacer.timerId()) {
+        send();
+    } else if (event->timerId() == d.heartbeat.timerId()) {
+        const qint64 late = d.beat.restart() - HeartbeatInterval;
+        int bucket = 0;
+        while (bucket < StallBuckets - 1 && late >= StallLimits[bucket])
+            ++bucket;
+        ++d.stalls[bucket];
+        d.worstStall = qMax(d.worstStall, late);
+    }
+}
+
+void TrafficReplay::send()
+{
+    if (!d.socket)
+        return;
+
+    QByteArray data;
+    const qint64 now = d.clock.elapsed();
+    int count = 0;
+    while (d.next < d.lines.count()) {
+        const Line& line = d.lines.at(d.next);
+        if (d.speed > 0) {
+            if (line.msecs != -1 && (line.msecs - d.first) / d.speed > now)
+                break;
+        } else if (count >= BurstSize) {
+            break;
+        }
+        data += line.data;
+        ++d.next;
+        ++count;
+    }
+    if (!data.isEmpty())
+        d.socket->write(data);
+
+    if (d.next >= d.lines.count()) {
+        d.pacer.stop();
+        d.socket->write(QByteArray("PING :") + EndToken + "\r\n");
+    }
+}
+
+void TrafficReplay::finish()
+{
+    if (!d.heartbeat.isActive())
+        return;
+
+    d.heartbeat.stop();
+    report();
+    QCoreApplication::quit();
+}
+
+static bool usageGreaterThan(const QPair<qint64, QString>& one, const QPair<qint64, QString>& another)
+{
+    return one.first > another.first;
+}
+
+void TrafficReplay::report()
+{
+    QTextStream out(stdout);
+    const qint64 elapsed = qMax<qint64>(1, d.clock.elapsed());
+    out << "lines: " << d.lines.count() << " in " << elapsed << " ms, "
+        << qRound64(d.lines.count() * 1000.0 / elapsed) << " lines/s" << endl;
+
+    out << "stalls:";
+    for (int i = 0; i < StallBuckets; ++i) {
+        if (i < StallBuckets - 1)
+            out << " <" << StallLimits[i] << "ms " << d.stalls.at(i);
+        else
+            out << " >=" << StallLimits[i - 1] << "ms " << d.stalls.at(i);
+    }
+    out << ", worst " << d.worstStall << " ms" << endl;
+
+    QList<QPair<qint64, QString> > usage;
+    QHash<TextDocument*, qint64> documents = MemoryBudget::instance()->usage();
+    QHash<TextDocument*, qint64>::const_iterator it;
+    for (it = documents.constBegin(); it != documents.constEnd(); ++it)
+        usage += qMakePair(it.value(), it.key()->buffer()->title());
+    std::sort(usage.begin(), usage.end(), usageGreaterThan);
+
+    out << "memory: " << MemoryBudget::instance()->totalUsage() / 1024 << " kB total" << endl;
+    for (int i = 0; i < usage.count(); ++i)
+        out << "  " << usage.at(i).second << ": " << usage.at(i).first / 1024 << " kB" << endl;
+}
@@ -27,8 +27,11 @@
 */
 
 #include "scrollbarstyle.h"
+#include "textbrowser.h"
 #include <QStyleOptionComplex>
 #include <QStyleFactory>
+#include <QPainter>
+#include <QVariant>
 
 ScrollBarStyle::ScrollBarStyle(bool expand) :
     QProxyStyle(QStyleFactory::create("fusion")), expand(expand)
@@ -67,4 +70,24 @@ void ScrollBarStyle::drawComplexControl(ComplexControl control, const QStyleOpti
         }
     }
     QProxyStyle::drawComplexControl(control, option, painter, widget);
+
+    // tick marks laid over the groove, as fractions of the document height
+    if (control == CC_ScrollBar && widget) {
+        const QVariantList marks = widget->property("marks").toList();
+        if (!marks.isEmpty()) {
+            const QRect groove = subControlRect(CC_ScrollBar, option, SC_ScrollBarGroove, widget).adjusted(2, 0, -2, 0);
+            painter->save();
+            foreach (const QVariant& mark, marks) {
+                const QPointF point = mark.toPointF();
+                QColor color = option->palette.color(QPalette::Highlight);
+                if (int(point.y()) == TextBrowser::SearchMark)
+                    color = QColor(Qt::darkYellow);
+                else if (int(point.y()) == TextBrowser::MarkerMark)
+                    color = option->palette.color(QPalette::Mid);
+                const int y = groove.top() + qRound(qBound(0.0, point.x(), 1.0) * (groove.height() - 2));
+                painter->fillRect(QRect(groove.left(), y, groove.width(), 2), color);
+            }
+            painter->restore();
+        }
+    }
 }
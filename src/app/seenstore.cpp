@@ -0,0 +1,175 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "seenstore.h"
+#include "taskscheduler.h"
+#include <QSaveFile>
+#include <QRunnable>
+#include <QFileInfo>
+#include <QFile>
+#include <QDir>
+
+// changes are appended a second later, whatever changed meanwhile goes in one write
+static const int FlushDelay = 1000;
+// the file is rewritten once stale records outnumber the live ones this much
+static const int CompactRatio = 4;
+static const int CompactMinimum = 256;
+
+static QByteArray record(const QString& key, qint64 msecs)
+{
+    return key.toUtf8() + '\t' + QByteArray::number(msecs) + '\n';
+}
+
+class SeenCompactor : public QRunnable
+{
+public:
+    SeenCompactor(SeenStore* store, const QString& filePath, const QHash<QString, qint64>& values)
+        : store(store), filePath(filePath), values(values) { }
+
+    void run()
+    {
+        // QSaveFile renames over the old file only once all of it is written
+        QSaveFile file(filePath);
+        bool ok = file.open(QIODevice::WriteOnly);
+        if (ok) {
+            QByteArray data;
+            QHash<QString, qint64>::const_iterator it;
+            for (it = values.constBegin(); it != values.constEnd(); ++it)
+                data += record(it.key(), it.value());
+            ok = file.write(data) == data.size() && file.commit();
+        }
+        QMetaObject::invokeMethod(store, "compacted", Qt::QueuedConnection, Q_ARG(bool, ok));
+    }
+
+private:
+    SeenStore* store;
+    QString filePath;
+    QHash<QString, qint64> values;
+};
+
+SeenStore::SeenStore(const QString& filePath, QObject* parent) : QObject(parent)
+{
+    d.filePath = filePath;
+    d.compacting = false;
+    d.records = 0;
+    d.compactor.setMaxThreadCount(1);
+    load();
+}
+
+SeenStore::~SeenStore()
+{
+    d.compactor.waitForDone();
+    d.compacting = false;
+    flush();
+}
+
+bool SeenStore::contains(const QString& key) const
+{
+    return d.values.contains(key);
+}
+
+QDateTime SeenStore::value(const QString& key) const
+{
+    if (!d.values.contains(key))
+        return QDateTime();
+    return QDateTime::fromMSecsSinceEpoch(d.values.value(key));
+}
+
+void SeenStore::setValue(const QString& key, const QDateTime& timestamp)
+{
+    if (!timestamp.isValid())
+        return;
+
+    const qint64 msecs = timestamp.toMSecsSinceEpoch();
+    if (d.values.value(key, -1) == msecs)
+        return;
+
+    d.values.insert(key, msecs);
+    d.pending.insert(key, msecs);
+    TaskScheduler::instance()->schedule(TaskScheduler::Flush, this, "flush", FlushDelay);
+}
+
+void SeenStore::flush()
+{
+    // held back while the compactor replaces the file, it catches up after
+    if (d.pending.isEmpty() || d.compacting)
+        return;
+
+    QFile file(d.filePath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Append))
+        return;
+
+    QByteArray data;
+    QHash<QString, qint64>::const_iterator it;
+    for (it = d.pending.constBegin(); it != d.pending.constEnd(); ++it)
+        data += record(it.key(), it.value());
+    if (file.write(data) != data.size())
+        return;
+
+    d.records += d.pending.count();
+    d.pending.clear();
+
+    if (d.records > CompactMinimum && d.records > CompactRatio * d.values.count())
+        compact();
+}
+
+void SeenStore::load()
+{
+    QFile file(d.filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        QDir().mkpath(QFileInfo(d.filePath).absolutePath());
+        return;
+    }
+
+    // later records win, a line cut short by a crash is simply dropped
+    while (!file.atEnd()) {
+        const QByteArray line = file.readLine();
+        if (!line.endsWith('\n'))
+            break;
+        const int tab = line.lastIndexOf('\t');
+        bool ok = false;
+        const qint64 msecs = line.mid(tab + 1).trimmed().toLongLong(&ok);
+        if (tab > 0 && ok)
+            d.values.insert(QString::fromUtf8(line.left(tab)), msecs);
+        ++d.records;
+    }
+}
+
+void SeenStore::compact()
+{
+    d.compacting = true;
+    d.compactor.start(new SeenCompactor(this, d.filePath, d.values));
+}
+
+void SeenStore::compacted(bool ok)
+{
+    d.compacting = false;
+    if (ok)
+        d.records = d.values.count() - d.pending.count();
+    flush();
+}
@@ -0,0 +1,208 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "sessionsnapshot.h"
+#include <QDataStream>
+#include <QSaveFile>
+#include <QRunnable>
+#include <QFileInfo>
+#include <QDir>
+
+static const quint32 SnapshotMagic = 0x434e5331;
+static const quint32 SnapshotVersion = 1;
+
+class SnapshotWriter : public QRunnable
+{
+public:
+    SnapshotWriter(const QString& filePath, const QHash<QString, QByteArray>& blobs)
+        : filePath(filePath), blobs(blobs) { }
+
+    void run()
+    {
+        // a directory of keys, offsets and sizes goes first, so that the
+        // reader maps the file and only decodes the buffers it asks for
+        QByteArray header;
+        QDataStream out(&header, QIODevice::WriteOnly);
+        out.setVersion(QDataStream::Qt_5_0);
+        out << SnapshotMagic << SnapshotVersion << qint32(blobs.count());
+        qint64 offset = 0;
+        QHash<QString, QByteArray>::const_iterator it;
+        for (it = blobs.constBegin(); it != blobs.constEnd(); ++it) {
+            out << it.key() << offset << qint64(it.value().size());
+            offset += it.value().size();
+        }
+
+        // QSaveFile renames over the old file only once all of it is written
+        QSaveFile file(filePath);
+        bool ok = file.open(QIODevice::WriteOnly) && file.write(header) == header.size();
+        for (it = blobs.constBegin(); ok && it != blobs.constEnd(); ++it)
+            ok = file.write(it.value()) == it.value().size();
+        if (ok)
+            file.commit();
+    }
+
+private:
+    QString filePath;
+    QHash<QString, QByteArray> blobs;
+};
+
+SessionSnapshot::SessionSnapshot(const QString& filePath, QObject* parent) : QObject(parent)
+{
+    d.filePath = filePath;
+    d.data = 0;
+    d.writer.setMaxThreadCount(1);
+    load();
+}
+
+SessionSnapshot::~SessionSnapshot()
+{
+    d.writer.waitForDone();
+    unmap();
+}
+
+bool SessionSnapshot::contains(const QString& key) const
+{
+    return d.blobs.contains(key);
+}
+
+QList<MessageData> SessionSnapshot::take(const QString& key, QList<int>* highlights)
+{
+    // decoded once, when the document of the buffer is created
+    QList<MessageData> rows;
+    const QByteArray blob = d.blobs.take(key);
+    if (!blob.isEmpty()) {
+        QDataStream in(blob);
+        in.setVersion(QDataStream::Qt_5_0);
+        QList<int> lights;
+        in >> rows >> lights;
+        if (in.status() != QDataStream::Ok)
+            return QList<MessageData>();
+        if (highlights)
+            *highlights = lights;
+    }
+    return rows;
+}
+
+void SessionSnapshot::insert(const QString& key, const QList<MessageData>& rows, const QList<int>& highlights)
+{
+    // serialized right away, the rows may share payloads with live documents
+    QByteArray blob;
+    QDataStream out(&blob, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_0);
+    out << rows << highlights;
+    d.pending.insert(key, blob);
+}
+
+void SessionSnapshot::save(bool wait)
+{
+    // buffers that never got a document keep what the last snapshot had
+    unmap();
+    QHash<QString, QByteArray> blobs = d.pending;
+    QHash<QString, QByteArray>::const_iterator it;
+    for (it = d.blobs.constBegin(); it != d.blobs.constEnd(); ++it) {
+        if (!blobs.contains(it.key()))
+            blobs.insert(it.key(), it.value());
+    }
+    d.pending.clear();
+
+    d.writer.start(new SnapshotWriter(d.filePath, blobs));
+    if (wait)
+        d.writer.waitForDone();
+}
+
+void SessionSnapshot::clear()
+{
+    d.writer.waitForDone();
+    unmap();
+    d.blobs.clear();
+    d.pending.clear();
+    QFile::remove(d.filePath);
+}
+
+void SessionSnapshot::load()
+{
+    d.file.setFileName(d.filePath);
+    if (!d.file.open(QIODevice::ReadOnly)) {
+        QDir().mkpath(QFileInfo(d.filePath).absolutePath());
+        return;
+    }
+
+    const qint64 size = d.file.size();
+    d.data = size > 0 ? d.file.map(0, size) : 0;
+    if (!d.data) {
+        d.file.close();
+        return;
+    }
+
+    // the blobs point into the mapping until save() or clear() lets go of it
+    const QByteArray bytes = QByteArray::fromRawData(reinterpret_cast<const char*>(d.data), size);
+    QDataStream in(bytes);
+    in.setVersion(QDataStream::Qt_5_0);
+    quint32 magic = 0, version = 0;
+    qint32 count = 0;
+    in >> magic >> version >> count;
+    if (magic != SnapshotMagic || version != SnapshotVersion || count < 0) {
+        unmap();
+        return;
+    }
+
+    QList<QPair<QString, QPair<qint64, qint64> > > entries;
+    for (int i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+        QString key;
+        qint64 offset = 0, length = 0;
+        in >> key >> offset >> length;
+        entries += qMakePair(key, qMakePair(offset, length));
+    }
+    const qint64 base = in.device()->pos();
+    if (in.status() != QDataStream::Ok) {
+        unmap();
+        return;
+    }
+
+    for (int i = 0; i < entries.count(); ++i) {
+        const qint64 offset = base + entries.at(i).second.first;
+        const qint64 length = entries.at(i).second.second;
+        if (offset < base || length < 0 || offset + length > size)
+            continue;
+        d.blobs.insert(entries.at(i).first, QByteArray::fromRawData(reinterpret_cast<const char*>(d.data) + offset, length));
+    }
+}
+
+void SessionSnapshot::unmap()
+{
+    if (!d.data)
+        return;
+
+    // whatever is left is copied out before the file goes
+    QHash<QString, QByteArray>::iterator it;
+    for (it = d.blobs.begin(); it != d.blobs.end(); ++it)
+        it.value() = QByteArray(it.value().constData(), it.value().size());
+    d.file.unmap(d.data);
+    d.file.close();
+    d.data = 0;
+}
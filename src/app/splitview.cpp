@@ -40,8 +40,14 @@
 #include <QAction>
 #include <QMenu>
 
+static const int kMaxPooledViews = 4;
+
 SplitView::SplitView(QWidget* parent) : QSplitter(parent)
 {
+    // not a child, the splitter would adopt it as a pane
+    d.shelf = new QWidget;
+    d.shelf->hide();
+
     d.current = createBufferView(this);
     connect(d.current, SIGNAL(bufferChanged(IrcBuffer*)), this, SIGNAL(currentBufferChanged(IrcBuffer*)));
     connect(qApp, SIGNAL(focusChanged(QWidget*,QWidget*)), this, SLOT(onFocusChanged(QWidget*,QWidget*)));
@@ -62,6 +68,13 @@ SplitView::SplitView(QWidget* parent) : QSplitter(parent)
 
     connect(this, SIGNAL(viewAdded(BufferView*)), this, SLOT(updateActions()));
     connect(this, SIGNAL(viewRemoved(BufferView*)), this, SLOT(updateActions()));
+    connect(this, SIGNAL(viewPooled(BufferView*)), this, SLOT(updateActions()));
+    connect(this, SIGNAL(viewRecycled(BufferView*)), this, SLOT(updateActions()));
+}
+
+SplitView::~SplitView()
+{
+    delete d.shelf;
 }
 
 IrcBuffer* SplitView::currentBuffer() const
@@ -135,10 +148,11 @@ void SplitView::split(BufferView* view, Qt::Orientation orientation)
         if (container) {
             int index = container->indexOf(view);
             BufferView* bv = 0;
+            const bool recycled = !d.pool.isEmpty();
             const int size = (orientation == Qt::Horizontal ? container->width() : container->height()) - container->handleWidth();
             if (container->count() == 1 || container->orientation() == orientation) {
                 container->setOrientation(orientation);
-                bv = createBufferView(container, index + 1);
+                bv = recycleBufferView(container, index + 1);
                 QList<int> sizes;
                 for (int i = 0; i < container->count(); ++i)
                     sizes += size / container->count();
@@ -148,13 +162,16 @@ void SplitView::split(BufferView* view, Qt::Orientation orientation)
                 QSplitter* splitter = wrap(view, orientation);
                 if (splitter) {
                     container->setSizes(sizes);
-                    bv = createBufferView(splitter);
+                    bv = recycleBufferView(splitter);
                     splitter->setSizes(QList<int>() << size/2 << size/2);
                 }
             }
             if (bv) {
                 bv->setBuffer(view->buffer());
-                emit viewAdded(bv);
+                if (recycled)
+                    emit viewRecycled(bv);
+                else
+                    emit viewAdded(bv);
             }
         }
     }
@@ -228,6 +245,56 @@ BufferView* SplitView::createBufferView(QSplitter* splitter, int index)
     return view;
 }
 
+BufferView* SplitView::recycleBufferView(QSplitter* splitter, int index)
+{
+    if (d.pool.isEmpty())
+        return createBufferView(splitter, index);
+
+    // the widget tree, menus and plugin state stay, only the binding changes
+    BufferView* view = d.pool.takeLast();
+    view->textBrowser()->setFont(QFont());
+    d.views += view;
+    splitter->insertWidget(index, view);
+    splitter->setCollapsible(splitter->indexOf(view), false);
+    view->show();
+    return view;
+}
+
+void SplitView::poolBufferView(BufferView* view)
+{
+    int index = d.views.indexOf(view);
+    if (index == -1)
+        return;
+
+    if (d.pool.count() >= kMaxPooledViews) {
+        view->deleteLater();
+        return;
+    }
+
+    d.views.removeAt(index);
+    QSplitter* splitter = qobject_cast<QSplitter*>(view->parentWidget());
+    view->setBuffer(0);
+    view->setObjectName(QString());
+    view->hide();
+    view->setParent(d.shelf);
+    d.pool += view;
+    emit viewPooled(view);
+
+    if (splitter && splitter != this && splitter->count() == 0)
+        splitter->deleteLater();
+
+    if (view == d.current) {
+        disconnect(view, SIGNAL(bufferChanged(IrcBuffer*)), this, SIGNAL(currentBufferChanged(IrcBuffer*)));
+        d.current = d.views.value(qMax(0, index - 1));
+        if (d.current) {
+            connect(d.current, SIGNAL(bufferChanged(IrcBuffer*)), this, SIGNAL(currentBufferChanged(IrcBuffer*)));
+            emit currentViewChanged(d.current, view);
+            emit currentBufferChanged(d.current->buffer());
+        }
+        setCurrentView(d.current);
+    }
+}
+
 void SplitView::activateNextView()
 {
     if (d.views.count() > 1) {
@@ -248,6 +315,11 @@ void SplitView::activatePreviousView()
 
 void SplitView::onViewRemoved(BufferView* view)
 {
+    if (d.pool.removeOne(view)) {
+        emit viewRemoved(view);
+        return;
+    }
+
     int index = d.views.indexOf(view);
     if (index != -1) {
         d.views.removeAt(index);
@@ -398,7 +470,7 @@ void SplitView::unsplit()
 {
     BufferView* view = targetView();
     if (view)
-        view->deleteLater();
+        poolBufferView(view);
 }
 
 void SplitView::zoomIn()
@@ -43,6 +43,7 @@ class SplitView : public QSplitter
 
 public:
     SplitView(QWidget* parent = 0);
+    ~SplitView();
 
     IrcBuffer* currentBuffer() const;
     BufferView* currentView() const;
@@ -66,11 +67,15 @@ public slots:
 signals:
     void viewAdded(BufferView* view);
     void viewRemoved(BufferView* view);
+    void viewPooled(BufferView* view);
+    void viewRecycled(BufferView* view);
     void currentBufferChanged(IrcBuffer* buffer);
     void currentViewChanged(BufferView* current, BufferView* previous = 0);
 
 protected:
     BufferView* createBufferView(QSplitter* splitter, int index = -1);
+    BufferView* recycleBufferView(QSplitter* splitter, int index = -1);
+    void poolBufferView(BufferView* view);
 
 private slots:
     void activateNextView();
@@ -105,6 +110,8 @@ private:
 
     struct Private {
         QList<BufferView*> views;
+        QList<BufferView*> pool;
+        QWidget* shelf;
         QPointer<BufferView> current;
         QList<QPointer<QAction> > unsplitters;
     } d;
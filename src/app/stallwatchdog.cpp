@@ -0,0 +1,157 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "stallwatchdog.h"
+#include "textdocument.h"
+#include "perfstats.h"
+#include "chatpage.h"
+#include "tracer.h"
+#include <QTimerEvent>
+#include <IrcBuffer>
+
+// the gui thread stamps this often, the watchdog looks a little less often
+static const int HeartbeatInterval = 100;
+static const int CheckInterval = 250;
+// pending queues and the current buffer are sampled once a second
+static const int SnapshotBeats = 10;
+
+StallWatchdog::StallWatchdog(ChatPage* page) : QThread(page)
+{
+    d.page = page;
+    d.beats = 0;
+    d.quit = false;
+    d.threshold = 2000;
+    d.traceFilePath = PerfStats::traceFilePath();
+    d.clock.start();
+    d.beat = 0;
+    d.heartbeat.start(HeartbeatInterval, this);
+    snapshot();
+    start(LowPriority);
+}
+
+StallWatchdog::~StallWatchdog()
+{
+    d.mutex.lock();
+    d.quit = true;
+    d.wakeup.wakeAll();
+    d.mutex.unlock();
+    wait();
+}
+
+int StallWatchdog::threshold() const
+{
+    return d.threshold.load();
+}
+
+void StallWatchdog::setThreshold(int msecs)
+{
+    d.threshold = qMax(HeartbeatInterval * 2, msecs);
+}
+
+void StallWatchdog::setCurrentBuffer(IrcBuffer* buffer)
+{
+    d.buffer = buffer;
+    snapshot();
+}
+
+qint64 StallWatchdog::elapsed() const
+{
+    return d.clock.elapsed();
+}
+
+void StallWatchdog::timerEvent(QTimerEvent* event)
+{
+    if (event->timerId() == d.heartbeat.timerId()) {
+        d.beat = elapsed();
+        if (++d.beats >= SnapshotBeats) {
+            d.beats = 0;
+            snapshot();
+        }
+    }
+}
+
+// gui thread, what the watchdog reports along with a stall
+void StallWatchdog::snapshot()
+{
+    int pending = 0;
+    int busiest = 0;
+    QString busiestTitle;
+    foreach (TextDocument* document, d.page->documents()) {
+        const int count = document->pendingCount();
+        pending += count;
+        if (count > busiest) {
+            busiest = count;
+            busiestTitle = document->buffer()->title();
+        }
+    }
+
+    QString context = QString("buffer %1, %2 lines queued").arg(d.buffer ? d.buffer->title() : QString("-")).arg(pending);
+    if (busiest > 0)
+        context += QString(", %1 in %2").arg(busiest).arg(busiestTitle);
+
+    QMutexLocker locker(&d.mutex);
+    d.context = context;
+}
+
+// watchdog thread, must not touch anything the gui thread owns
+void StallWatchdog::run()
+{
+    bool stalled = false;
+    qint64 worst = 0;
+
+    QMutexLocker locker(&d.mutex);
+    while (!d.quit) {
+        d.wakeup.wait(&d.mutex, CheckInterval);
+        if (d.quit)
+            break;
+
+        const qint64 lag = elapsed() - d.beat.load();
+        if (lag >= d.threshold.load()) {
+            worst = qMax(worst, lag);
+            if (!stalled) {
+                stalled = true;
+                const QString context = d.context;
+                const char* operation = Tracer::isEnabled() ? Tracer::operation() : 0;
+                locker.unlock();
+
+                QString trace;
+                if (Tracer::isEnabled() && Tracer::dump(d.traceFilePath))
+                    trace = ", trace in " + d.traceFilePath;
+                qWarning("Event loop stalled for %lld ms in %s, %s%s", lag,
+                         operation ? operation : (Tracer::isEnabled() ? "event loop" : "unknown operation"),
+                         qPrintable(context), qPrintable(trace));
+
+                locker.relock();
+            }
+        } else if (stalled) {
+            qWarning("Event loop resumed after %lld ms", worst);
+            stalled = false;
+            worst = 0;
+        }
+    }
+}
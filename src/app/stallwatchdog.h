@@ -0,0 +1,82 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef STALLWATCHDOG_H
+#define STALLWATCHDOG_H
+
+#include <QMutex>
+#include <QThread>
+#include <QString>
+#include <QPointer>
+#include <QAtomicInteger>
+#include <QBasicTimer>
+#include <QElapsedTimer>
+#include <QWaitCondition>
+
+class ChatPage;
+class IrcBuffer;
+
+class StallWatchdog : public QThread
+{
+    Q_OBJECT
+
+public:
+    explicit StallWatchdog(ChatPage* page);
+    ~StallWatchdog();
+
+    int threshold() const;
+    void setThreshold(int msecs);
+
+public slots:
+    void setCurrentBuffer(IrcBuffer* buffer);
+
+protected:
+    void run();
+    void timerEvent(QTimerEvent* event);
+
+private:
+    void snapshot();
+    qint64 elapsed() const;
+
+    struct Private {
+        ChatPage* page;
+        QPointer<IrcBuffer> buffer;
+        QBasicTimer heartbeat;
+        QElapsedTimer clock;
+        QString traceFilePath;
+        QAtomicInteger<qint64> beat;
+        QAtomicInt threshold;
+        int beats;
+        bool quit;
+        QMutex mutex;
+        QWaitCondition wakeup;
+        QString context;
+    } d;
+};
+
+#endif // STALLWATCHDOG_H
@@ -0,0 +1,66 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "startuptimeline.h"
+#include <QElapsedTimer>
+#include <QCoreApplication>
+#include <QList>
+#include <QPair>
+
+// the first mark starts the clock, main() makes that the very first thing
+struct Timeline
+{
+    Timeline() { clock.start(); }
+    QElapsedTimer clock;
+    QList<QPair<QString, qint64> > phases;
+};
+
+static Timeline& timeline()
+{
+    static Timeline timeline;
+    return timeline;
+}
+
+void StartupTimeline::mark(const QString& phase)
+{
+    Timeline& t = timeline();
+    t.phases += qMakePair(phase, t.clock.elapsed());
+}
+
+QStringList StartupTimeline::report()
+{
+    QStringList lines;
+    qint64 previous = 0;
+    const Timeline& t = timeline();
+    for (int i = 0; i < t.phases.count(); ++i) {
+        const qint64 at = t.phases.at(i).second;
+        lines += QCoreApplication::translate("StartupTimeline", "%1: %2 ms, at %3 ms").arg(t.phases.at(i).first).arg(at - previous).arg(at);
+        previous = at;
+    }
+    return lines;
+}
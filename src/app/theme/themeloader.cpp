@@ -29,39 +29,53 @@
 #include "themeloader.h"
 #include <QApplication>
 #include <QFileInfo>
+#include <QDateTime>
+#include <QSettings>
 #include <QDebug>
 
 ThemeLoader::ThemeLoader(QObject* parent) : QObject(parent)
 {
-    ThemeInfo info;
-    if (!info.load(":/themes/cute/cute.theme"))
-        qWarning() << "Failed to load cute.theme";
-    d.themes.append(info.name());
-    d.infos.insert(info.name(), info);
+    // the catalog remembers the name of each theme file by its mtime,
+    // themes themselves are loaded once they are asked for
+    QSettings settings;
+    d.dirty = false;
+    d.catalog = settings.value("themeCatalog").toMap();
+
+    add(":/themes/cute/cute.theme");
 
     QDir inst(COMMUNI_INSTALL_THEMES);
     if (inst.exists())
-        load(inst);
+        scan(inst);
 
 #if defined(Q_OS_MAC)
     QDir dir(QApplication::applicationDirPath());
     if (dir.dirName() == "MacOS" && dir.cd("../Resources/themes"))
-        load(dir);
+        scan(dir);
 #elif defined(Q_OS_WIN)
     QDir dir(QApplication::applicationDirPath());
     if (dir.cd("themes") || (dir.cdUp() && dir.cd("themes")))
-        load(dir);
+        scan(dir);
 #elif defined(Q_OS_UNIX)
     QDir sys("/usr/share/themes/communi");
     if (sys != inst && sys.exists())
-        load(sys);
+        scan(sys);
     QDir home = QDir::home();
     if (home.cd(".local/share/themes/communi"))
-        load(home);
+        scan(home);
     QDir dev(QApplication::applicationDirPath());
     if (dev.cdUp() && dev.cd("themes"))
-        load(dev);
+        scan(dev);
 #endif
+
+    foreach (const QString& filePath, d.catalog.keys()) {
+        if (!d.seen.contains(filePath)) {
+            d.catalog.remove(filePath);
+            d.dirty = true;
+        }
+    }
+    d.seen.clear();
+    if (d.dirty)
+        settings.setValue("themeCatalog", d.catalog);
 }
 
 ThemeLoader* ThemeLoader::instance()
@@ -77,25 +91,50 @@ QStringList ThemeLoader::themes() const
 
 ThemeInfo ThemeLoader::theme(const QString& name) const
 {
-    return d.infos.value(name, d.infos.value("Cute"));
+    QHash<QString, ThemeInfo>::const_iterator it = d.infos.constFind(name);
+    if (it == d.infos.constEnd()) {
+        ThemeInfo info;
+        const QString filePath = d.files.value(name);
+        if (!filePath.isEmpty() && !info.load(filePath))
+            qWarning() << "Failed to load" << filePath;
+        it = d.infos.insert(name, info);
+    }
+    if (!it->isValid() && name != "Cute")
+        return theme("Cute");
+    return *it;
 }
 
-void ThemeLoader::load(QDir dir)
+void ThemeLoader::scan(QDir dir)
 {
     QStringList dirs = dir.entryList(QDir::NoDotAndDotDot | QDir::Dirs);
     foreach (const QString& sd, dirs) {
         if (dir.cd(sd)) {
             QStringList files = dir.entryList(QStringList("*.theme"), QDir::Files);
-            foreach (const QString& fn, files) {
-                ThemeInfo info;
-                if (info.load(dir.filePath(fn))) {
-                    if (!d.infos.contains(info.name())) {
-                        d.themes.append(info.name());
-                        d.infos.insert(info.name(), info);
-                    }
-                }
-            }
+            foreach (const QString& fn, files)
+                add(dir.filePath(fn));
             dir.cdUp();
         }
     }
 }
+
+void ThemeLoader::add(const QString& filePath)
+{
+    const qint64 mtime = QFileInfo(filePath).lastModified().toMSecsSinceEpoch();
+    const QVariantList entry = d.catalog.value(filePath).toList();
+
+    QString name;
+    if (entry.count() == 2 && entry.at(1).toLongLong() == mtime) {
+        name = entry.at(0).toString();
+    } else {
+        QSettings file(filePath, QSettings::IniFormat);
+        name = file.value("Theme/name").toString();
+        d.catalog.insert(filePath, QVariantList() << name << mtime);
+        d.dirty = true;
+    }
+    d.seen.insert(filePath);
+
+    if (!name.isEmpty() && !d.files.contains(name)) {
+        d.themes.append(name);
+        d.files.insert(name, filePath);
+    }
+}
@@ -30,8 +30,10 @@
 #define THEMELOADER_H
 
 #include <QDir>
+#include <QSet>
 #include <QHash>
 #include <QObject>
+#include <QVariant>
 #include <QStringList>
 #include "themeinfo.h"
 
@@ -48,11 +50,16 @@ public:
 private:
     ThemeLoader(QObject* parent = 0);
 
-    void load(QDir dir);
+    void scan(QDir dir);
+    void add(const QString& filePath);
 
     struct Private {
+        bool dirty;
         QStringList themes;
-        QHash<QString, ThemeInfo> infos;
+        QSet<QString> seen;
+        QVariantMap catalog;
+        QHash<QString, QString> files;
+        mutable QHash<QString, ThemeInfo> infos;
     } d;
 };
 
@@ -32,14 +32,26 @@
 #include "bufferview.h"
 #include "splitview.h"
 #include "chatpage.h"
+#include "themeloader.h"
+#include "taskscheduler.h"
 #include <IrcBufferModel>
 #include <IrcConnection>
 #include <IrcChannel>
 #include <IrcMessage>
 #include <IrcBuffer>
+#include <QCryptographicHash>
+#include <QStandardPaths>
+#include <QApplication>
+#include <QRunnable>
+#include <QFileInfo>
 #include <QPainter>
 #include <QPixmap>
-#include <QTimer>
+#include <QFile>
+#include <QDir>
+
+static const int PreviewWidth = 960;
+static const int PreviewHeight = 600;
+static const int RenderDelay = 250;
 
 class Channel : public IrcChannel
 {
@@ -127,30 +139,86 @@ static ChatPage* createChatPage(QWidget* parent = 0)
     return page;
 }
 
-ThemeWidget::ThemeWidget(QWidget* parent) : QLabel(parent)
+class PreviewTask : public QRunnable
 {
-    d.page = createChatPage();
-    d.page->setVisible(false);
-    d.page->resize(960, 600);
+public:
+    enum Kind { Lookup, Store };
+
+    PreviewTask(ThemeWidget* widget, Kind kind) : widget(widget), kind(kind) { }
+
+    void run()
+    {
+        if (kind == Store) {
+            // written aside and renamed, a half written preview is never picked up
+            QDir().mkpath(QFileInfo(filePath).path());
+            if (image.save(filePath + ".part", "PNG")) {
+                QFile::remove(filePath);
+                QFile::rename(filePath + ".part", filePath);
+            }
+            return;
+        }
+
+        // the key changes with any file of the theme, its look or the screen
+        QCryptographicHash hash(QCryptographicHash::Sha1);
+        QDir dir(themePath);
+        foreach (const QString& fileName, dir.entryList(QDir::Files, QDir::Name)) {
+            QFile file(dir.filePath(fileName));
+            if (file.open(QIODevice::ReadOnly)) {
+                hash.addData(fileName.toUtf8());
+                hash.addData(file.readAll());
+            }
+        }
+        hash.addData(salt.toUtf8());
+        const QString key = QString::fromLatin1(hash.result().toHex());
+
+        QImage cached(cachePath + "/" + key + ".png");
+        QMetaObject::invokeMethod(widget, "previewLoaded", Qt::QueuedConnection,
+                                  Q_ARG(QString, theme), Q_ARG(QString, key), Q_ARG(QImage, cached));
+    }
+
+    ThemeWidget* widget;
+    Kind kind;
+    QString theme;
+    QString themePath;
+    QString salt;
+    QString cachePath;
+    QString filePath;
+    QImage image;
+};
 
-    QTimer::singleShot(0, this, SLOT(updatePreview()));
+ThemeWidget::ThemeWidget(QWidget* parent) : QLabel(parent)
+{
+    // the fake page is only built once a preview is missing from the cache
+    d.page = 0;
+    d.pool.setMaxThreadCount(1);
+    d.cachePath = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/themes";
 }
 
 ThemeWidget::~ThemeWidget()
 {
+    TaskScheduler::instance()->unschedule(this, "renderPreview");
+    d.pool.waitForDone();
     delete d.page;
 }
 
 QString ThemeWidget::theme() const
 {
-    return d.page->theme();
+    return d.theme;
 }
 
 void ThemeWidget::setTheme(const QString& theme)
 {
-    if (theme != d.page->theme()) {
-        d.page->setTheme(theme);
-        updatePreview();
+    if (theme != d.theme) {
+        d.theme = theme;
+        d.key.clear();
+        TaskScheduler::instance()->unschedule(this, "renderPreview");
+
+        PreviewTask* task = new PreviewTask(this, PreviewTask::Lookup);
+        task->theme = theme;
+        task->themePath = ThemeLoader::instance()->theme(theme).path();
+        task->salt = QString("%1x%2@%3 %4").arg(PreviewWidth).arg(PreviewHeight).arg(pixelRatio()).arg(QApplication::font().toString());
+        task->cachePath = d.cachePath;
+        d.pool.start(task);
     }
 }
 
@@ -162,16 +230,68 @@ void ThemeWidget::resizeEvent(QResizeEvent* event)
 
 void ThemeWidget::updatePreview()
 {
-    qreal dpr = 1.0;
-#if QT_VERSION >= 0x050600
-    dpr = devicePixelRatioF();
-#endif
+    // resizing only scales what is there, rendering is left to renderPreview()
+    if (d.preview.isNull())
+        return;
 
-    QPixmap pixmap(d.page->size() * dpr);
+    const qreal dpr = pixelRatio();
+    QPixmap pixmap = QPixmap::fromImage(d.preview.scaled(contentsRect().size() * dpr, Qt::KeepAspectRatio, Qt::SmoothTransformation));
 #if QT_VERSION >= 0x050600
     pixmap.setDevicePixelRatio(dpr);
 #endif
-    QPainter painter(&pixmap);
+    setPixmap(pixmap);
+}
+
+void ThemeWidget::renderPreview()
+{
+    if (d.key.isEmpty())
+        return;
+
+    if (!d.page) {
+        d.page = createChatPage();
+        d.page->setVisible(false);
+        d.page->resize(PreviewWidth, PreviewHeight);
+    }
+    d.page->setTheme(d.theme);
+
+    const qreal dpr = pixelRatio();
+    QImage image(d.page->size() * dpr, QImage::Format_ARGB32_Premultiplied);
+    image.setDevicePixelRatio(dpr);
+    image.fill(Qt::transparent);
+    QPainter painter(&image);
     d.page->render(&painter);
-    setPixmap(pixmap.scaled(contentsRect().size() * dpr, Qt::KeepAspectRatio, Qt::SmoothTransformation));
+    painter.end();
+
+    d.preview = image;
+    updatePreview();
+
+    PreviewTask* task = new PreviewTask(this, PreviewTask::Store);
+    task->filePath = d.cachePath + "/" + d.key + ".png";
+    task->image = image;
+    d.pool.start(task);
+}
+
+void ThemeWidget::previewLoaded(const QString& theme, const QString& key, const QImage& image)
+{
+    // a lookup for a theme that was switched away from is of no use
+    if (theme != d.theme)
+        return;
+
+    d.key = key;
+    if (!image.isNull()) {
+        d.preview = image;
+        updatePreview();
+    } else {
+        // let the settings page show up before the fake page is rendered
+        TaskScheduler::instance()->schedule(TaskScheduler::Pacing, this, "renderPreview", RenderDelay);
+    }
+}
+
+qreal ThemeWidget::pixelRatio() const
+{
+#if QT_VERSION >= 0x050600
+    return devicePixelRatioF();
+#else
+    return 1.0;
+#endif
 }
@@ -30,6 +30,8 @@
 #define THEMEWIDGET_H
 
 #include <QLabel>
+#include <QImage>
+#include <QThreadPool>
 
 class ChatPage;
 
@@ -51,10 +53,19 @@ protected:
 
 private slots:
     void updatePreview();
+    void renderPreview();
+    void previewLoaded(const QString& theme, const QString& key, const QImage& image);
 
 private:
+    qreal pixelRatio() const;
+
     struct Private {
         ChatPage* page;
+        QString theme;
+        QString key;
+        QImage preview;
+        QString cachePath;
+        QThreadPool pool;
     } d;
 };
 
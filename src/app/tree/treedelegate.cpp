@@ -42,10 +42,20 @@
 #include <QLabel>
 #include <QStyle>
 #include <QColor>
+#include <QEvent>
+#include <cmath>
+
+// messages per minute at which the heat tint is at its strongest
+static const double HeatScale = 120.0;
+static const int HeatAlpha = 96;
 
 TreeDelegate::TreeDelegate(QObject* parent) : QStyledItemDelegate(parent)
 {
     d.transient = false;
+
+    QWidget* widget = qobject_cast<QWidget*>(parent);
+    if (widget)
+        widget->installEventFilter(this);
 }
 
 bool TreeDelegate::isTransient() const
@@ -53,6 +63,18 @@ bool TreeDelegate::isTransient() const
     return d.transient;
 }
 
+bool TreeDelegate::eventFilter(QObject* object, QEvent* event)
+{
+    // a theme change restyles the view, the cached renderings are stale then
+    if (object != parent())
+        return QStyledItemDelegate::eventFilter(object, event);
+    if (event->type() == QEvent::StyleChange || event->type() == QEvent::PaletteChange || event->type() == QEvent::FontChange) {
+        d.pixmaps.clear();
+        d.rowHeights.clear();
+    }
+    return false;
+}
+
 static QSize treeHeaderSize()
 {
     // QMacStyle wants a QHeaderView that is a child of QTreeView :/
@@ -63,19 +85,26 @@ static QSize treeHeaderSize()
 
 QSize TreeDelegate::sizeHint(const QStyleOptionViewItem& option, const QModelIndex& index) const
 {
-    QSize sz = QStyledItemDelegate::sizeHint(option, index);
-    if (!index.parent().isValid()) {
-        static const QSize headerSize = treeHeaderSize();
-        QSize ss = headerSize;
-        TreeHeader* header = TreeHeader::instance(const_cast<QWidget*>(option.widget));
-        if (header->minimumSize().isValid())
-            ss = ss.expandedTo(header->minimumSize());
-        if (header->maximumSize().isValid())
-            ss = ss.boundedTo(header->maximumSize());
-        if (ss.isValid())
-            return ss;
+    if (index.parent().isValid()) {
+        // buffer rows share one height per font, the width is never used
+        // because the title column stretches, so skip the text layout
+        const int key = option.fontMetrics.height();
+        QHash<int, int>::const_iterator it = d.rowHeights.constFind(key);
+        if (it == d.rowHeights.constEnd())
+            it = d.rowHeights.insert(key, QStyledItemDelegate::sizeHint(option, index).height());
+        return QSize(option.rect.width(), it.value());
     }
-    return sz;
+
+    static const QSize headerSize = treeHeaderSize();
+    QSize ss = headerSize;
+    TreeHeader* header = TreeHeader::instance(const_cast<QWidget*>(option.widget));
+    if (header->minimumSize().isValid())
+        ss = ss.expandedTo(header->minimumSize());
+    if (header->maximumSize().isValid())
+        ss = ss.boundedTo(header->maximumSize());
+    if (ss.isValid())
+        return ss;
+    return QStyledItemDelegate::sizeHint(option, index);
 }
 
 void TreeDelegate::paint(QPainter* painter, const QStyleOptionViewItem& option, const QModelIndex& index) const
@@ -86,12 +115,13 @@ void TreeDelegate::paint(QPainter* painter, const QStyleOptionViewItem& option,
 
     if (!index.parent().isValid()) {
         TreeHeader* header = TreeHeader::instance(const_cast<QWidget*>(option.widget));
-        header->setText(index.data(Qt::DisplayRole).toString());
-        header->setState(option.state);
-        header->setGeometry(option.rect);
-        painter->translate(option.rect.topLeft());
-        header->render(painter);
-        painter->translate(-option.rect.topLeft());
+        const QString text = index.data(Qt::DisplayRole).toString();
+        const QString key = pixmapKey(painter, option, QString("h%1:%2").arg(int(option.state)).arg(text));
+        if (!drawPixmap(painter, option.rect, key)) {
+            header->setText(text);
+            header->setState(option.state);
+            drawWidget(painter, option.rect, header, key);
+        }
         QStyle* style = option.widget->style();
         QIcon icon = index.data(Qt::DecorationRole).value<QIcon>();
         style->drawItemPixmap(painter, option.rect.translated(2, 0), Qt::AlignLeft | Qt::AlignVCenter, icon.pixmap(16, 16));
@@ -111,6 +141,14 @@ void TreeDelegate::paint(QPainter* painter, const QStyleOptionViewItem& option,
 
         d.transient = !active && option.state & QStyle::State_Selected;
 
+        // busy buffers glow behind the title, see TreeWidget::setHeatVisible()
+        const double rate = index.data(TreeRole::Rate).toDouble();
+        if (rate > 0) {
+            QColor color = option.palette.color(QPalette::Highlight);
+            color.setAlpha(qMin(HeatAlpha, int(HeatAlpha * std::log(1.0 + rate) / std::log(1.0 + HeatScale))));
+            painter->fillRect(option.rect, color);
+        }
+
         QStyledItemDelegate::paint(painter, option, index);
 
         if (d.transient) {
@@ -126,18 +164,66 @@ void TreeDelegate::paint(QPainter* painter, const QStyleOptionViewItem& option,
                 inactiveParent = new QWidget(const_cast<QWidget*>(option.widget), Qt::Window);
 
             TreeBadge* badge = TreeBadge::instance(hilite ? const_cast<QWidget*>(option.widget) : inactiveParent.data());
-            badge->setNum(num);
-            badge->setNoticed(notice);
-            badge->setHighlighted(hilite);
-
-            badge->setGeometry(option.rect);
-            painter->translate(option.rect.topLeft());
-            badge->render(painter);
-            painter->translate(-option.rect.topLeft());
+            const QString key = pixmapKey(painter, option, QString("b%1:%2").arg(int(notice) | int(hilite) << 1).arg(num));
+            if (!drawPixmap(painter, option.rect, key)) {
+                badge->setGeometry(option.rect);
+                badge->setNum(num);
+                badge->setNoticed(notice);
+                badge->setHighlighted(hilite);
+                drawWidget(painter, option.rect, badge, key);
+            }
         }
     }
 }
 
+static qreal pixelRatio(QPainter* painter)
+{
+#if QT_VERSION >= 0x050600
+    return painter->device()->devicePixelRatioF();
+#else
+    Q_UNUSED(painter);
+    return 1.0;
+#endif
+}
+
+QString TreeDelegate::pixmapKey(QPainter* painter, const QStyleOptionViewItem& option, const QString& content)
+{
+    return QString("%1:%2x%3@%4:%5").arg(option.palette.cacheKey())
+                                    .arg(option.rect.width()).arg(option.rect.height())
+                                    .arg(pixelRatio(painter)).arg(content);
+}
+
+bool TreeDelegate::drawPixmap(QPainter* painter, const QRect& rect, const QString& key) const
+{
+    // rendering a widget for every row on every repaint is expensive,
+    // blinking highlights especially, so the results are blitted instead
+    QHash<QString, QPixmap>::const_iterator it = d.pixmaps.constFind(key);
+    if (it == d.pixmaps.constEnd())
+        return false;
+    painter->drawPixmap(rect.topLeft(), it.value());
+    return true;
+}
+
+void TreeDelegate::drawWidget(QPainter* painter, const QRect& rect, QWidget* widget, const QString& key) const
+{
+    if (d.pixmaps.count() >= 512)
+        d.pixmaps.clear();
+
+    const qreal dpr = pixelRatio(painter);
+    widget->setGeometry(rect);
+    QPixmap pixmap(rect.size() * dpr);
+#if QT_VERSION >= 0x050600
+    pixmap.setDevicePixelRatio(dpr);
+#endif
+    pixmap.fill(Qt::transparent);
+    QPainter pp(&pixmap);
+    widget->render(&pp);
+    pp.end();
+
+    d.pixmaps.insert(key, pixmap);
+    painter->drawPixmap(rect.topLeft(), pixmap);
+}
+
 void TreeDelegate::initStyleOption(QStyleOptionViewItem* option, const QModelIndex& index) const
 {
     QStyledItemDelegate::initStyleOption(option, index);
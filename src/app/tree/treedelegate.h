@@ -29,6 +29,8 @@
 #ifndef TREEDELEGATE_H
 #define TREEDELEGATE_H
 
+#include <QHash>
+#include <QPixmap>
 #include <QStyledItemDelegate>
 
 class TreeDelegate : public QStyledItemDelegate
@@ -43,12 +45,20 @@ public:
     QSize sizeHint(const QStyleOptionViewItem& option, const QModelIndex& index) const;
     void paint(QPainter* painter, const QStyleOptionViewItem& option, const QModelIndex& index) const;
 
+    bool eventFilter(QObject* object, QEvent* event);
+
 protected:
     void initStyleOption(QStyleOptionViewItem* option, const QModelIndex& index) const;
 
 private:
+    static QString pixmapKey(QPainter* painter, const QStyleOptionViewItem& option, const QString& content);
+    bool drawPixmap(QPainter* painter, const QRect& rect, const QString& key) const;
+    void drawWidget(QPainter* painter, const QRect& rect, QWidget* widget, const QString& key) const;
+
     struct Private {
         mutable bool transient;
+        mutable QHash<int, int> rowHeights;
+        mutable QHash<QString, QPixmap> pixmaps;
     } d;
 };
 
@@ -32,6 +32,7 @@
 #include "treespinner.h"
 #include "treeindicator.h"
 #include "treedelegate.h"
+#include "activitymeter.h"
 #include <IrcConnection>
 #include <IrcLagTimer>
 #include <IrcBuffer>
@@ -65,6 +66,9 @@ TreeItem::TreeItem(IrcBuffer* buffer, TreeWidget* parent) : QObject(buffer), QTr
 
 void TreeItem::init(IrcBuffer* buffer)
 {
+    d.badge = 0;
+    d.notice = 0;
+    d.highlight = 0;
     d.buffer = buffer;
     setObjectName(buffer->title());
     setFlags(Qt::ItemIsEnabled | Qt::ItemIsSelectable);
@@ -112,14 +116,48 @@ QVariant TreeItem::data(int column, int role) const
             return d.buffer->title();
         return "";
     }
+    if (column == 1 && role == TreeRole::Badge)
+        return d.badge;
+    if (column == 0 && role == TreeRole::Rate && d.buffer) {
+        TreeWidget* tree = treeWidget();
+        if (tree && tree->isHeatVisible())
+            return ActivityMeter::instance()->rate(d.buffer);
+        return QVariant();
+    }
+    if ((column == 0 || column == 1) && role == TreeRole::Highlight)
+        return bool(d.highlight & (1 << column));
+    if ((column == 0 || column == 1) && role == TreeRole::Notice)
+        return bool(d.notice & (1 << column));
     return QTreeWidgetItem::data(column, role);
 }
 
 void TreeItem::setData(int column, int role, const QVariant& value)
 {
+    // badge and highlight state lives in plain fields instead of the
+    // per-role variant vectors, and only actual changes are repainted
+    if (column == 1 && role == TreeRole::Badge) {
+        const int badge = value.toInt();
+        if (d.badge != badge) {
+            d.badge = badge;
+            emitDataChanged();
+            TreeWidget* tree = treeWidget();
+            if (tree)
+                tree->updateActivity(this);
+        }
+        return;
+    }
+    if ((column == 0 || column == 1) && (role == TreeRole::Highlight || role == TreeRole::Notice)) {
+        quint8& bits = role == TreeRole::Highlight ? d.highlight : d.notice;
+        const quint8 bit = 1 << column;
+        if (bool(bits & bit) != value.toBool()) {
+            bits ^= bit;
+            emitDataChanged();
+            if (!parentItem())
+                updateIcon();
+        }
+        return;
+    }
     QTreeWidgetItem::setData(column, role, value);
-    if ((role == TreeRole::Highlight || role == TreeRole::Notice) && !parentItem())
-        updateIcon();
 }
 
 bool TreeItem::operator<(const QTreeWidgetItem& other) const
@@ -130,6 +168,9 @@ bool TreeItem::operator<(const QTreeWidgetItem& other) const
 void TreeItem::refresh()
 {
     emitDataChanged();
+    TreeWidget* tree = treeWidget();
+    if (tree)
+        tree->scheduleSort();
 }
 
 void TreeItem::updateIcon()
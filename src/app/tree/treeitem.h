@@ -76,6 +76,9 @@ private:
     void init(IrcBuffer* buffer);
 
     struct Private {
+        int badge;
+        quint8 notice;
+        quint8 highlight;
         IrcBuffer* buffer;
         IrcLagTimer* timer;
         QVariantAnimation* anim;
@@ -36,7 +36,8 @@ namespace TreeRole {
         Active = Qt::UserRole,
         Badge,
         Notice,
-        Highlight
+        Highlight,
+        Rate
     };
 }
 
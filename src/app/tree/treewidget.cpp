@@ -30,8 +30,11 @@
 #include "treedelegate.h"
 #include "textdocument.h"
 #include "sharedtimer.h"
+#include "taskscheduler.h"
+#include "tracer.h"
 #include "treeitem.h"
 #include "treerole.h"
+#include "hookstats.h"
 #include <IrcBufferModel>
 #include <IrcConnection>
 #include <QSignalMapper>
@@ -45,18 +48,27 @@
 #include <IrcBuffer>
 #include <QShortcut>
 #include <QBitArray>
+#include <QDateTime>
 #include <QToolTip>
 #include <QAction>
 #include <QStyle>
-#include <QTimer>
+#include <QWindow>
 #include <QMenu>
 
+// the heat tint follows the message rates this often
+static const int HeatInterval = 2000;
+
 TreeWidget::TreeWidget(QWidget* parent) : QTreeWidget(parent)
 {
     d.block = false;
     d.blink = false;
+    d.blinking = false;
+    d.watching = false;
+    d.heat = false;
     d.pressedItem = 0;
     d.sortingBlocked = false;
+    d.sortPending = false;
+    d.activityTick = 0;
 
     qRegisterMetaType<TreeItem*>();
 
@@ -74,7 +86,8 @@ TreeWidget::TreeWidget(QWidget* parent) : QTreeWidget(parent)
 
     setItemDelegate(new TreeDelegate(this));
 
-    setSortingEnabled(true);
+    // sorting runs in deferred batches, see scheduleSort()
+    setSortingEnabled(false);
     sortByColumn(0, Qt::AscendingOrder);
 
     header()->setStretchLastSection(false);
@@ -187,7 +200,25 @@ void TreeWidget::setSortingBlocked(bool blocked)
 {
     if (d.sortingBlocked != blocked) {
         d.sortingBlocked = blocked;
-        setSortingEnabled(!blocked);
+        if (!blocked)
+            scheduleSort();
+    }
+}
+
+bool TreeWidget::isHeatVisible() const
+{
+    return d.heat;
+}
+
+void TreeWidget::setHeatVisible(bool visible)
+{
+    if (d.heat != visible) {
+        d.heat = visible;
+        viewport()->update();
+        if (visible)
+            TaskScheduler::instance()->schedule(TaskScheduler::Pacing, this, "updateHeat", HeatInterval);
+        else
+            TaskScheduler::instance()->unschedule(this, "updateHeat");
     }
 }
 
@@ -222,6 +253,7 @@ void TreeWidget::restoreState(const QByteArray& data)
     if (state.contains("sorting")) {
         d.sorting = state.value("sorting").toMap();
         restoreSortOrder();
+        scheduleSort();
     }
 }
 
@@ -235,9 +267,12 @@ void TreeWidget::addBuffer(IrcBuffer* buffer)
         IrcConnection* connection = buffer->connection();
         d.connectionItems.insert(connection, item);
         d.connections.append(connection);
+        connect(buffer->model(), SIGNAL(layoutChanged()), this, SLOT(scheduleSort()), Qt::UniqueConnection);
+        scheduleSort();
     } else {
         TreeItem* parent = d.connectionItems.value(buffer->connection());
         item = new TreeItem(buffer, parent);
+        insertSorted(item);
     }
     connect(item, SIGNAL(destroyed(TreeItem*)), this, SLOT(onItemDestroyed(TreeItem*)));
     d.bufferItems.insert(buffer, item);
@@ -288,41 +323,48 @@ void TreeWidget::moveToPrevItem()
 
 void TreeWidget::moveToNextActiveItem()
 {
-    QTreeWidgetItem* item = findNextItem(currentItem(), 1, TreeRole::Badge);
+    QTreeWidgetItem* item = findActiveItem(currentItem(), true);
     if (item)
         setCurrentItem(item);
 }
 
 void TreeWidget::moveToPrevActiveItem()
 {
-    QTreeWidgetItem* item = findPrevItem(currentItem(), 1, TreeRole::Badge);
+    QTreeWidgetItem* item = findActiveItem(currentItem(), false);
     if (item)
         setCurrentItem(item);
 }
 
-void TreeWidget::moveToMostActiveItem()
+QList<IrcBuffer*> TreeWidget::likelyBuffers(int limit) const
 {
-    QTreeWidgetItem* mostActive = 0;
-    QTreeWidgetItemIterator it(this, QTreeWidgetItemIterator::Unselected);
-    while (*it) {
-        QTreeWidgetItem* item = *it;
+    // what moveToMostActiveItem() and alt+up/down would switch to
+    QList<IrcBuffer*> buffers;
+    QMap<Activity, TreeItem*>::const_iterator it;
+    for (it = d.activityQueue.constBegin(); it != d.activityQueue.constEnd() && buffers.count() < limit; ++it) {
+        IrcBuffer* buffer = it.value()->buffer();
+        if (buffer && !it.value()->isSelected() && !buffers.contains(buffer))
+            buffers += buffer;
+    }
+    QList<QTreeWidgetItem*> neighbors;
+    neighbors << nextItem(currentItem()) << previousItem(currentItem());
+    foreach (QTreeWidgetItem* item, neighbors) {
+        IrcBuffer* buffer = item ? static_cast<TreeItem*>(item)->buffer() : 0;
+        if (buffer && buffers.count() < limit && !buffers.contains(buffer))
+            buffers += buffer;
+    }
+    return buffers;
+}
 
-        if (d.highlightedItems.contains(item)) {
-            // we found a channel hilight or PM to us
-            setCurrentItem(item);
+void TreeWidget::moveToMostActiveItem()
+{
+    // the queue is ordered by highlight, private, unread and recency
+    QMap<Activity, TreeItem*>::const_iterator it;
+    for (it = d.activityQueue.constBegin(); it != d.activityQueue.constEnd(); ++it) {
+        if (!it.value()->isSelected()) {
+            setCurrentItem(it.value());
             return;
         }
-
-        // as a backup, store the most active window with any sort of activity
-        const int badge = item->data(1, TreeRole::Badge).toInt();
-        if (badge > 0 && (!mostActive || mostActive->data(1, TreeRole::Badge).toInt() < badge))
-            mostActive = item;
-
-        it++;
     }
-
-    if (mostActive)
-        setCurrentItem(mostActive);
 }
 
 void TreeWidget::expandCurrentConnection()
@@ -351,6 +393,42 @@ QSize TreeWidget::sizeHint() const
     return QSize(w, QTreeWidget::sizeHint().height());
 }
 
+bool TreeWidget::eventFilter(QObject* object, QEvent* event)
+{
+    // minimizing and covering the window pause the blinking, see blinkItems()
+    if (object == window() || object == window()->windowHandle()) {
+        if (event->type() == QEvent::Expose || event->type() == QEvent::Show || event->type() == QEvent::WindowStateChange)
+            updateBlinking();
+        return false;
+    }
+    return QTreeWidget::eventFilter(object, event);
+}
+
+void TreeWidget::showEvent(QShowEvent* event)
+{
+    QTreeWidget::showEvent(event);
+    if (!d.watching && window()->windowHandle()) {
+        window()->installEventFilter(this);
+        window()->windowHandle()->installEventFilter(this);
+        d.watching = true;
+    }
+    updateBlinking();
+}
+
+void TreeWidget::dataChanged(const QModelIndex& topLeft, const QModelIndex& bottomRight, const QVector<int>& roles)
+{
+    // QTreeWidgetItem::emitDataChanged() spans all columns of a row, which
+    // would repaint the whole viewport, so the cells are passed on one by one
+    if (topLeft.isValid() && topLeft != bottomRight && topLeft.row() == bottomRight.row() && topLeft.parent() == bottomRight.parent()) {
+        for (int column = topLeft.column(); column <= bottomRight.column(); ++column) {
+            const QModelIndex index = topLeft.sibling(topLeft.row(), column);
+            QTreeWidget::dataChanged(index, index, roles);
+        }
+        return;
+    }
+    QTreeWidget::dataChanged(topLeft, bottomRight, roles);
+}
+
 bool TreeWidget::viewportEvent(QEvent* event)
 {
     if (event->type() == QEvent::ToolTip) {
@@ -372,6 +450,11 @@ bool TreeWidget::viewportEvent(QEvent* event)
         }
         return true;
     }
+    if (event->type() == QEvent::Paint) {
+        // one sample per frame, delegates and badges included
+        HookStats::Scope scope("TreeWidget::paint");
+        return QTreeWidget::viewportEvent(event);
+    }
     return QTreeWidget::viewportEvent(event);
 }
 
@@ -426,16 +509,28 @@ void TreeWidget::mouseReleaseEvent(QMouseEvent* event)
 
 void TreeWidget::resetBadge(QTreeWidgetItem* item)
 {
-    if (!item && !d.resetBadges.isEmpty())
-        item = d.resetBadges.dequeue();
-    if (item)
+    if (item) {
         item->setData(1, TreeRole::Badge, 0);
+        return;
+    }
+
+    // delayed resets share a single scheduled tick, which keeps the
+    // earliest due time, so only the items that are due are reset
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    while (!d.resetBadges.isEmpty() && d.resetBadges.head().second <= now) {
+        TreeItem* queued = d.resetBadges.dequeue().first;
+        if (queued)
+            queued->setData(1, TreeRole::Badge, 0);
+    }
+    if (!d.resetBadges.isEmpty())
+        TaskScheduler::instance()->schedule(TaskScheduler::Animation, this, "resetBadge", int(d.resetBadges.head().second - now));
 }
 
 void TreeWidget::delayedResetBadge(QTreeWidgetItem* item)
 {
-    d.resetBadges.enqueue(static_cast<TreeItem*>(item));
-    QTimer::singleShot(500, this, SLOT(resetBadge()));
+    const qint64 due = QDateTime::currentMSecsSinceEpoch() + 500;
+    d.resetBadges.enqueue(qMakePair(QPointer<TreeItem>(static_cast<TreeItem*>(item)), due));
+    TaskScheduler::instance()->schedule(TaskScheduler::Animation, this, "resetBadge", 500);
 }
 
 void TreeWidget::onItemExpanded(QTreeWidgetItem* item)
@@ -468,13 +563,32 @@ void TreeWidget::onCurrentItemChanged(QTreeWidgetItem* current, QTreeWidgetItem*
 
 void TreeWidget::onItemDestroyed(TreeItem* item)
 {
-    d.resetBadges.removeOne(item);
+    for (int i = d.resetBadges.count() - 1; i >= 0; --i) {
+        if (!d.resetBadges.at(i).first || d.resetBadges.at(i).first == item)
+            d.resetBadges.removeAt(i);
+    }
     d.highlightedItems.remove(item);
+    updateBlinking();
+    d.activityQueue.remove(d.activities.take(item));
     d.bufferItems.remove(item->buffer());
 }
 
+void TreeWidget::updateHeat()
+{
+    // the rates fade between messages, so the tint is repainted as a whole
+    if (!d.heat)
+        return;
+    if (isVisible())
+        viewport()->update();
+    TaskScheduler::instance()->schedule(TaskScheduler::Pacing, this, "updateHeat", HeatInterval);
+}
+
 void TreeWidget::blinkItems()
 {
+    if (!canBlink()) {
+        updateBlinking();
+        return;
+    }
     foreach (QTreeWidgetItem* item, d.highlightedItems)
         updateHighlight(item);
     d.blink = !d.blink;
@@ -490,6 +604,47 @@ void TreeWidget::resetItems()
     }
 }
 
+void TreeWidget::scheduleSort()
+{
+    // coalesces adds, renames and activity changes into one pass per event loop tick
+    if (!d.sortPending) {
+        d.sortPending = true;
+        QMetaObject::invokeMethod(this, "applySorting", Qt::QueuedConnection);
+    }
+}
+
+void TreeWidget::applySorting()
+{
+    COMMUNI_TRACE("TreeWidget::applySorting");
+    HookStats::Scope scope("TreeWidget::applySorting");
+    d.sortPending = false;
+    if (!d.sortingBlocked)
+        sortItems(0, Qt::AscendingOrder);
+}
+
+void TreeWidget::insertSorted(TreeItem* item)
+{
+    // new children are appended, move them into place by binary search
+    COMMUNI_TRACE("TreeWidget::insertSorted");
+    TreeItem* parent = item->parentItem();
+    if (!parent || d.sortingBlocked)
+        return;
+    const int last = parent->childCount() - 1;
+    int lo = 0;
+    int hi = last;
+    while (lo < hi) {
+        const int mid = (lo + hi) / 2;
+        if (lessThan(item, static_cast<TreeItem*>(parent->child(mid))))
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    if (lo < last) {
+        parent->takeChild(last);
+        parent->insertChild(lo, item);
+    }
+}
+
 void TreeWidget::onEditTriggered()
 {
     QAction* action = qobject_cast<QAction*>(sender());
@@ -571,9 +726,9 @@ void TreeWidget::noticeItem(QTreeWidgetItem *item, bool notice)
 void TreeWidget::highlightItem(QTreeWidgetItem* item)
 {
     if (item && !d.highlightedItems.contains(item)) {
-        if (d.highlightedItems.isEmpty())
-            SharedTimer::instance()->registerReceiver(this, "blinkItems");
         d.highlightedItems.insert(item);
+        updateBlinking();
+        updateActivity(static_cast<TreeItem*>(item));
         updateHighlight(item);
     }
 }
@@ -582,8 +737,8 @@ void TreeWidget::unhighlightItem(QTreeWidgetItem* item)
 {
     if (item && d.highlightedItems.contains(item)) {
         d.highlightedItems.remove(item);
-        if (d.highlightedItems.isEmpty())
-            SharedTimer::instance()->unregisterReceiver(this, "blinkItems");
+        updateBlinking();
+        updateActivity(static_cast<TreeItem*>(item));
         updateHighlight(item);
     }
 }
@@ -601,6 +756,26 @@ void TreeWidget::updateHighlight(QTreeWidgetItem* item)
     }
 }
 
+void TreeWidget::updateBlinking()
+{
+    // the shared timer is only subscribed to while the blinking is seen
+    const bool blinking = !d.highlightedItems.isEmpty() && canBlink();
+    if (d.blinking != blinking) {
+        d.blinking = blinking;
+        if (blinking)
+            SharedTimer::instance()->registerReceiver(this, "blinkItems");
+        else
+            SharedTimer::instance()->unregisterReceiver(this, "blinkItems");
+    }
+}
+
+bool TreeWidget::canBlink() const
+{
+    const QWidget* win = window();
+    const QWindow* handle = win->windowHandle();
+    return isVisible() && !win->isMinimized() && (!handle || handle->isExposed());
+}
+
 QTreeWidgetItem* TreeWidget::lastItem() const
 {
     QTreeWidgetItem* item = topLevelItem(topLevelItemCount() - 1);
@@ -633,30 +808,68 @@ QTreeWidgetItem* TreeWidget::previousItem(QTreeWidgetItem* from) const
     return *it;
 }
 
-QTreeWidgetItem* TreeWidget::findNextItem(QTreeWidgetItem* from, int column, int role) const
+QTreeWidgetItem* TreeWidget::findActiveItem(QTreeWidgetItem* from, bool forward) const
 {
-    if (from) {
-        QTreeWidgetItemIterator it(from);
-        while (*++it && *it != from) {
-            QTreeWidgetItem* item = *it;
-            if (item->data(column, role).toBool())
-                return item;
+    // only items with unread messages are candidates, the tree is not walked
+    if (!from)
+        return 0;
+    TreeItem* found = 0;
+    qint64 best = 0;
+    const qint64 pos = itemPosition(from);
+    QHash<TreeItem*, Activity>::const_iterator it;
+    for (it = d.activities.constBegin(); it != d.activities.constEnd(); ++it) {
+        if (it.value().badge <= 0)
+            continue;
+        const qint64 p = itemPosition(it.key());
+        if ((forward ? p > pos : p < pos) && (!found || (forward ? p < best : p > best))) {
+            found = it.key();
+            best = p;
         }
     }
-    return 0;
+    return found;
 }
 
-QTreeWidgetItem* TreeWidget::findPrevItem(QTreeWidgetItem* from, int column, int role) const
+qint64 TreeWidget::itemPosition(QTreeWidgetItem* item) const
 {
-    if (from) {
-        QTreeWidgetItemIterator it(from);
-        while (*--it && *it != from) {
-            QTreeWidgetItem* item = *it;
-            if (item->data(column, role).toBool())
-                return item;
-        }
+    QTreeWidgetItem* parent = item->parent();
+    if (!parent)
+        return qint64(indexOfTopLevelItem(item)) << 32;
+    return (qint64(indexOfTopLevelItem(parent)) << 32) + parent->indexOfChild(item) + 1;
+}
+
+void TreeWidget::updateActivity(TreeItem* item)
+{
+    Activity activity = d.activities.value(item);
+    const bool known = d.activities.contains(item);
+    if (known)
+        d.activityQueue.remove(activity);
+
+    const int badge = item->data(1, TreeRole::Badge).toInt();
+    const bool highlight = d.highlightedItems.contains(item);
+    if (badge <= 0 && !highlight) {
+        d.activities.remove(item);
+        return;
     }
-    return 0;
+
+    // unique ticks keep the queue keys distinct
+    if (!known || badge > activity.badge || (highlight && !activity.highlight))
+        activity.tick = ++d.activityTick;
+    activity.badge = badge;
+    activity.highlight = highlight;
+    activity.priv = item->parentItem() && item->buffer() && !item->buffer()->isChannel();
+    d.activities.insert(item, activity);
+    d.activityQueue.insert(activity, item);
+}
+
+bool TreeWidget::Activity::operator<(const Activity& other) const
+{
+    if (highlight != other.highlight)
+        return highlight;
+    if (priv != other.priv)
+        return priv;
+    if (badge != other.badge)
+        return badge > other.badge;
+    return tick > other.tick;
 }
 
 // TODO
@@ -667,14 +880,17 @@ class FriendlyModel : public IrcBufferModel
 
 bool TreeWidget::lessThan(const TreeItem* one, const TreeItem* another) const
 {
-    QStringList order;
+    // the saved orders are hashed, comparisons must not scan them
+    static const QHash<QString, int> none;
+    const QHash<QString, int>* order = &none;
     const TreeItem* parent = one->parentItem();
+    QHash<QString, QHash<QString, int> >::const_iterator it;
     if (!parent)
-        order = d.parentOrder;
-    else if (!isSortingBlocked())
-        order = d.childrenOrders.value(parent->text(0));
-    const int oidx = order.indexOf(one->text(0));
-    const int aidx = order.indexOf(another->text(0));
+        order = &d.parentIndexes;
+    else if (!isSortingBlocked() && (it = d.childrenIndexes.constFind(parent->text(0))) != d.childrenIndexes.constEnd())
+        order = &it.value();
+    const int oidx = order->value(one->text(0), -1);
+    const int aidx = order->value(another->text(0), -1);
     if (oidx == -1  || aidx == -1) {
         if (!one->parentItem()) {
             QList<IrcConnection*> connections = one->treeWidget()->d.connections;
@@ -701,6 +917,7 @@ void TreeWidget::initSortOrder()
         d.childrenOrders.insert(parent->text(0), lst);
         d.parentOrder += parent->text(0);
     }
+    indexSortOrder();
 }
 
 void TreeWidget::saveSortOrder()
@@ -724,6 +941,23 @@ void TreeWidget::restoreSortOrder()
         d.childrenOrders.insert(it.key(), it.value().toStringList());
     }
     d.parentOrder = d.sorting.value("parents").toStringList();
+    indexSortOrder();
+}
+
+void TreeWidget::indexSortOrder()
+{
+    // first occurrences win, like QStringList::indexOf() did
+    d.parentIndexes.clear();
+    for (int i = d.parentOrder.count() - 1; i >= 0; --i)
+        d.parentIndexes.insert(d.parentOrder.at(i), i);
+    d.childrenIndexes.clear();
+    QHashIterator<QString, QStringList> it(d.childrenOrders);
+    while (it.hasNext()) {
+        it.next();
+        QHash<QString, int>& indexes = d.childrenIndexes[it.key()];
+        for (int i = it.value().count() - 1; i >= 0; --i)
+            indexes.insert(it.value().at(i), i);
+    }
 }
 
 QMenu* TreeWidget::createContextMenu(TreeItem* item)
@@ -30,8 +30,10 @@
 #define TREEWIDGET_H
 
 #include <QElapsedTimer>
+#include <QMap>
 #include <QHash>
 #include <QQueue>
+#include <QPair>
 #include <QPointer>
 #include <QTreeWidget>
 #include <QStringList>
@@ -55,6 +57,7 @@ public:
     IrcBuffer* currentBuffer() const;
     TreeItem* bufferItem(IrcBuffer* buffer) const;
     TreeItem* connectionItem(IrcConnection* connection) const;
+    QList<IrcBuffer*> likelyBuffers(int limit) const;
 
     TreeDelegate* itemDelegate() const;
 
@@ -63,6 +66,9 @@ public:
     bool isSortingBlocked() const;
     void setSortingBlocked(bool blocked);
 
+    bool isHeatVisible() const;
+    void setHeatVisible(bool visible);
+
     QByteArray saveState() const;
     void restoreState(const QByteArray& state);
 
@@ -96,7 +102,10 @@ signals:
 
 protected:
     QSize sizeHint() const;
+    bool eventFilter(QObject* object, QEvent* event);
     bool viewportEvent(QEvent* event);
+    void showEvent(QShowEvent* event);
+    void dataChanged(const QModelIndex& topLeft, const QModelIndex& bottomRight, const QVector<int>& roles = QVector<int>());
     void contextMenuEvent(QContextMenuEvent* event);
     void mousePressEvent(QMouseEvent* event);
     void mouseMoveEvent(QMouseEvent* event);
@@ -110,7 +119,10 @@ private slots:
     void onCurrentItemChanged(QTreeWidgetItem* current, QTreeWidgetItem* previous);
     void onItemDestroyed(TreeItem* item);
     void blinkItems();
+    void updateHeat();
     void resetItems();
+    void scheduleSort();
+    void applySorting();
 
     void onEditTriggered();
     void onWhoisTriggered();
@@ -120,36 +132,61 @@ private slots:
 
 private:
     void updateHighlight(QTreeWidgetItem* item);
+    void updateBlinking();
+    bool canBlink() const;
     void swapItems(QTreeWidgetItem* source, QTreeWidgetItem* target);
 
     QTreeWidgetItem* lastItem() const;
     QTreeWidgetItem* nextItem(QTreeWidgetItem* from) const;
     QTreeWidgetItem* previousItem(QTreeWidgetItem* from) const;
-    QTreeWidgetItem* findNextItem(QTreeWidgetItem* from, int column, int role) const;
-    QTreeWidgetItem* findPrevItem(QTreeWidgetItem* from, int column, int role) const;
+    QTreeWidgetItem* findActiveItem(QTreeWidgetItem* from, bool forward) const;
+    qint64 itemPosition(QTreeWidgetItem* item) const;
+    void updateActivity(TreeItem* item);
 
     void initSortOrder();
     void saveSortOrder();
     void restoreSortOrder();
+    void indexSortOrder();
+    void insertSorted(TreeItem* item);
 
     friend class TreeItem;
     bool lessThan(const TreeItem* one, const TreeItem* another) const;
 
     QMenu* createContextMenu(TreeItem* item);
 
+    // the most important activity sorts first
+    struct Activity {
+        Activity() : highlight(false), priv(false), badge(0), tick(0) { }
+        bool operator<(const Activity& other) const;
+        bool highlight;
+        bool priv;
+        int badge;
+        quint64 tick;
+    };
+
     struct Private {
         bool block;
         bool blink;
+        bool blinking;
+        bool watching;
+        bool heat;
         QVariantMap sorting;
         bool sortingBlocked;
+        bool sortPending;
         QElapsedTimer pressedTime;
         QPoint pressedPoint;
         QStringList parentOrder;
         QTreeWidgetItem* pressedItem;
         QHashStringList childrenOrders;
+        QHash<QString, int> parentIndexes;
+        QHash<QString, QHash<QString, int> > childrenIndexes;
         QList<IrcConnection*> connections;
-        QQueue<QPointer<TreeItem> > resetBadges;
+        // items with the time their badge is due to be reset
+        QQueue<QPair<QPointer<TreeItem>, qint64> > resetBadges;
         QSet<QTreeWidgetItem*> highlightedItems;
+        quint64 activityTick;
+        QMap<Activity, TreeItem*> activityQueue;
+        QHash<TreeItem*, Activity> activities;
         QHash<IrcBuffer*, TreeItem*> bufferItems;
         QHash<IrcConnection*, TreeItem*> connectionItems;
     } d;
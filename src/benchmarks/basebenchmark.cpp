@@ -0,0 +1,198 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "basebenchmark.h"
+#include "benchsession.h"
+#include "benchstats.h"
+#include "textdocument.h"
+#include "formatpipeline.h"
+#include "messageformatter.h"
+#include <QCoreApplication>
+#include <IrcChannel>
+#include <IrcMessage>
+#include <QtTest>
+
+static const int ChannelUsers = 10000;
+static const int SplitUsers = 2000;
+static const int Blocks = 1000;
+static const int LineLength = 400;
+static const int PageWidth = 800;
+
+// the formatting pool hands its results back through the event loop
+static void drain()
+{
+    while (FormatPipeline::instance()->pendingCount() > 0)
+        QCoreApplication::processEvents(QEventLoop::AllEvents, 10);
+}
+
+static QList<MessageData> formatLines(IrcChannel* channel, const QList<QByteArray>& lines)
+{
+    MessageFormatter formatter;
+    formatter.setBuffer(channel);
+    QList<MessageData> rows;
+    foreach (const QByteArray& line, lines) {
+        IrcMessage* msg = IrcMessage::fromData(line, channel->connection());
+        rows += formatter.formatMessage(msg);
+        delete msg;
+    }
+    return rows;
+}
+
+void BaseBenchmark::initTestCase()
+{
+    d.session = new BenchSession(this);
+    d.nicks = BenchSession::nicks(ChannelUsers);
+    d.channel = d.session->join("#bench", d.nicks);
+    QVERIFY(d.channel);
+
+    // a quarter of the lines are long and coloured, the rest chatter
+    d.start = QDateTime(QDate::currentDate(), QTime(8, 0));
+    QList<QByteArray> lines;
+    for (int i = 0; i < Blocks; ++i) {
+        const QString text = i % 4 ? BenchSession::plainText(i) : BenchSession::colouredText(i, LineLength);
+        lines += BenchSession::privmsg(d.nicks.at(i * 7 % ChannelUsers), "#bench", text, d.start.toMSecsSinceEpoch() + i * 1000);
+    }
+
+    // formatted once up front, the document cases measure the document alone
+    d.rows = formatLines(d.channel, lines);
+    d.quits = formatLines(d.channel, BenchSession::netsplit(d.nicks.mid(0, SplitUsers), d.start.toMSecsSinceEpoch()));
+}
+
+void BaseBenchmark::init()
+{
+    BenchStats::begin();
+}
+
+void BaseBenchmark::cleanup()
+{
+    BenchStats::end();
+}
+
+TextDocument* BaseBenchmark::createDocument(IrcChannel* channel) const
+{
+    // shown, so the rows are laid out like in the current view
+    TextDocument* doc = new TextDocument(channel);
+    doc->setTextWidth(PageWidth);
+    doc->setVisible(true);
+    return doc;
+}
+
+void BaseBenchmark::append()
+{
+    TextDocument* doc = createDocument(d.channel);
+    QBENCHMARK_ONCE {
+        foreach (const MessageData& row, d.rows)
+            doc->append(row);
+    }
+    QCOMPARE(doc->totalCount(), Blocks);
+    delete doc;
+}
+
+void BaseBenchmark::flush()
+{
+    TextDocument* doc = createDocument(d.channel);
+    foreach (const MessageData& row, d.rows)
+        doc->append(row);
+    QBENCHMARK_ONCE {
+        QMetaObject::invokeMethod(doc, "flush");
+    }
+    QCOMPARE(doc->pendingCount(), 0);
+    delete doc;
+}
+
+void BaseBenchmark::rebuild()
+{
+    TextDocument* doc = createDocument(d.channel);
+    foreach (const MessageData& row, d.rows)
+        doc->append(row);
+    QMetaObject::invokeMethod(doc, "flush");
+    QBENCHMARK_ONCE {
+        QMetaObject::invokeMethod(doc, "rebuild");
+        QMetaObject::invokeMethod(doc, "flush");
+    }
+    QCOMPARE(doc->pendingCount(), 0);
+    delete doc;
+}
+
+void BaseBenchmark::netsplit()
+{
+    // a channel of its own, the quits empty it
+    const QStringList nicks = d.nicks.mid(0, SplitUsers);
+    IrcChannel* channel = d.session->join("#netsplit", nicks);
+    QVERIFY(channel);
+    TextDocument* doc = createDocument(channel);
+    const QList<QByteArray> lines = BenchSession::netsplit(nicks, d.start.toMSecsSinceEpoch());
+    QBENCHMARK_ONCE {
+        foreach (const QByteArray& line, lines)
+            d.session->receive(line);
+        drain();
+        QMetaObject::invokeMethod(doc, "flush");
+    }
+    delete doc;
+}
+
+void BaseBenchmark::formatText_data()
+{
+    QTest::addColumn<QStringList>("texts");
+
+    // more distinct lines than the formatter caches
+    QStringList plain, nicks, coloured;
+    for (int i = 0; i < Blocks; ++i) {
+        plain += BenchSession::plainText(i);
+        nicks += QString("%1: %2 %3").arg(d.nicks.at(i * 13 % ChannelUsers)).arg(BenchSession::plainText(i)).arg(d.nicks.at(i * 31 % ChannelUsers));
+        coloured += BenchSession::colouredText(i, LineLength);
+    }
+    QTest::newRow("plain") << plain;
+    QTest::newRow("nicks") << nicks;
+    QTest::newRow("coloured") << coloured;
+}
+
+void BaseBenchmark::formatText()
+{
+    QFETCH(QStringList, texts);
+
+    MessageFormatter formatter;
+    formatter.setBuffer(d.channel);
+    QBENCHMARK {
+        foreach (const QString& text, texts)
+            formatter.formatText(text);
+    }
+}
+
+void BaseBenchmark::merge()
+{
+    QBENCHMARK {
+        MessageData group;
+        foreach (const MessageData& quit, d.quits) {
+            MessageData next = quit;
+            if (!group.isEmpty())
+                next.merge(group);
+            group = next;
+        }
+    }
+}
@@ -0,0 +1,32 @@
+######################################################################
+# Communi
+######################################################################
+
+TEMPLATE = app
+TARGET = benchmarks
+
+CONFIG += communi
+COMMUNI += core model util
+CONFIG += communi_base
+QT += testlib
+
+DESTDIR = ../../bin
+DEPENDPATH += $$PWD $$PWD/../app
+INCLUDEPATH += $$PWD $$PWD/../app
+
+HEADERS += $$PWD/basebenchmark.h
+HEADERS += $$PWD/benchsession.h
+HEADERS += $$PWD/benchstats.h
+HEADERS += $$PWD/paintbenchmark.h
+
+SOURCES += $$PWD/basebenchmark.cpp
+SOURCES += $$PWD/benchsession.cpp
+SOURCES += $$PWD/benchstats.cpp
+SOURCES += $$PWD/main.cpp
+SOURCES += $$PWD/paintbenchmark.cpp
+
+# the buffer tree lives in the app, its items need the activity meter
+HEADERS += $$PWD/../app/activitymeter.h
+SOURCES += $$PWD/../app/activitymeter.cpp
+
+include(../app/tree/tree.pri)
@@ -0,0 +1,159 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "benchsession.h"
+#include <IrcBufferModel>
+#include <IrcProtocol>
+#include <IrcChannel>
+#include <IrcMessage>
+#include <QDateTime>
+
+static const char* Words[] = {
+    "the", "netsplit", "is", "over", "again", "who", "broke", "build", "on",
+    "master", "please", "rebase", "before", "merging", "works", "for", "me"
+};
+static const int WordCount = sizeof(Words) / sizeof(Words[0]);
+
+// names replies are split like servers do, about 400 bytes a line
+static const int NamesPerReply = 40;
+
+class BenchProtocol : public IrcProtocol
+{
+public:
+    explicit BenchProtocol(IrcConnection* connection) : IrcProtocol(connection)
+    {
+        setNickName("bench");
+        setStatus(IrcConnection::Connected);
+    }
+
+    void open() { }
+    void close() { }
+    void read() { }
+    bool write(const QByteArray&) { return true; }
+
+    void feed(const QByteArray& line)
+    {
+        receiveMessage(IrcMessage::fromData(line, connection()));
+    }
+};
+
+static QByteArray timeTag(qint64 msecs)
+{
+    return "@time=" + QDateTime::fromMSecsSinceEpoch(msecs).toUTC().toString("yyyy-MM-ddThh:mm:ss.zzzZ").toLatin1() + " ";
+}
+
+BenchSession::BenchSession(QObject* parent) : IrcConnection(parent)
+{
+    setHost("bench.invalid");
+    setUserName("bench");
+    setNickName("bench");
+    setRealName("bench");
+
+    d.protocol = new BenchProtocol(this);
+    setProtocol(d.protocol);
+
+    d.bufferModel = new IrcBufferModel(this);
+    d.bufferModel->setSortMethod(Irc::SortByTitle);
+    receive(":bench.invalid 001 bench :Welcome to the benchmarks");
+}
+
+IrcBufferModel* BenchSession::bufferModel() const
+{
+    return d.bufferModel;
+}
+
+void BenchSession::receive(const QByteArray& line)
+{
+    d.protocol->feed(line);
+}
+
+IrcChannel* BenchSession::join(const QString& channel, const QStringList& nicks)
+{
+    // a few ops and voices, the rest plain, like a large public channel
+    QStringList names;
+    for (int i = 0; i < nicks.count(); ++i) {
+        if (i % 100 == 0)
+            names += "@" + nicks.at(i);
+        else if (i % 20 == 0)
+            names += "+" + nicks.at(i);
+        else
+            names += nicks.at(i);
+    }
+
+    receive(":bench!bench@bench.invalid JOIN " + channel.toUtf8());
+    for (int i = 0; i < names.count(); i += NamesPerReply)
+        receive(":bench.invalid 353 bench = " + channel.toUtf8() + " :" + names.mid(i, NamesPerReply).join(" ").toUtf8());
+    receive(":bench.invalid 366 bench " + channel.toUtf8() + " :End of /NAMES list.");
+
+    IrcBuffer* buffer = d.bufferModel->find(channel);
+    return buffer ? buffer->toChannel() : 0;
+}
+
+QStringList BenchSession::nicks(int count)
+{
+    QStringList nicks;
+    for (int i = 0; i < count; ++i)
+        nicks += QString("%1%2").arg(Words[i % WordCount]).arg(i);
+    return nicks;
+}
+
+QString BenchSession::plainText(int seed)
+{
+    QStringList words;
+    for (int i = 0; i < 12; ++i)
+        words += Words[(seed + i * 7) % WordCount];
+    return words.join(" ") + QString::number(seed);
+}
+
+QString BenchSession::colouredText(int seed, int length)
+{
+    // the kind of mIRC art bots and relays paste, a colour code every word
+    QString text;
+    for (int i = 0; text.length() < length; ++i) {
+        text += QString("\x03%1,%2").arg((seed + i) % 16, 2, 10, QChar('0')).arg((seed + i * 3) % 16, 2, 10, QChar('0'));
+        if (i % 5 == 0)
+            text += '\x02';
+        text += Words[(seed + i) % WordCount];
+        text += ' ';
+    }
+    return text + QString::number(seed);
+}
+
+QByteArray BenchSession::privmsg(const QString& nick, const QString& channel, const QString& text, qint64 msecs)
+{
+    return timeTag(msecs) + ":" + nick.toUtf8() + "!user@host.invalid PRIVMSG " + channel.toUtf8() + " :" + text.toUtf8();
+}
+
+QList<QByteArray> BenchSession::netsplit(const QStringList& nicks, qint64 msecs)
+{
+    // everyone quits within moments with the split servers as reason
+    QList<QByteArray> lines;
+    foreach (const QString& nick, nicks)
+        lines += timeTag(msecs++) + ":" + nick.toUtf8() + "!user@host.invalid QUIT :hub.invalid leaf.invalid";
+    return lines;
+}
@@ -0,0 +1,68 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef BENCHSESSION_H
+#define BENCHSESSION_H
+
+#include <QList>
+#include <QByteArray>
+#include <QStringList>
+#include <IrcConnection>
+
+class IrcChannel;
+class IrcBufferModel;
+class BenchProtocol;
+
+// a connection fed with synthetic lines, they go through the same message
+// filters and models as lines read from a socket
+class BenchSession : public IrcConnection
+{
+    Q_OBJECT
+
+public:
+    explicit BenchSession(QObject* parent = 0);
+
+    IrcBufferModel* bufferModel() const;
+
+    void receive(const QByteArray& line);
+    IrcChannel* join(const QString& channel, const QStringList& nicks);
+
+    static QStringList nicks(int count);
+    static QString plainText(int seed);
+    static QString colouredText(int seed, int length);
+    static QByteArray privmsg(const QString& nick, const QString& channel, const QString& text, qint64 msecs);
+    static QList<QByteArray> netsplit(const QStringList& nicks, qint64 msecs);
+
+private:
+    struct Private {
+        BenchProtocol* protocol;
+        IrcBufferModel* bufferModel;
+    } d;
+};
+
+#endif // BENCHSESSION_H
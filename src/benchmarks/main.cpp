@@ -0,0 +1,71 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "basebenchmark.h"
+#include "paintbenchmark.h"
+#include <QApplication>
+#include <QStringList>
+#include <QSettings>
+#include <QtTest>
+
+// benchmarks [Class] [QtTest options], e.g. -csv or -xml for machine
+// readable results, a class name as the first argument runs that one only
+int main(int argc, char* argv[])
+{
+    // the widgets are painted into images, no window shows up
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+
+    QApplication app(argc, argv);
+    app.setOrganizationName("Communi");
+    app.setApplicationName("Communi Benchmarks");
+    QSettings().clear();
+
+    QStringList args = app.arguments();
+    const QString only = args.value(1).startsWith('-') ? QString() : args.value(1);
+
+    BaseBenchmark base;
+    PaintBenchmark paint;
+    QList<QObject*> benchmarks;
+    benchmarks += &base;
+    benchmarks += &paint;
+
+    int result = 0;
+    foreach (QObject* benchmark, benchmarks) {
+        const QString name = benchmark->metaObject()->className();
+        if (only.isEmpty())
+            result |= QTest::qExec(benchmark, args);
+        else if (only == name)
+            return QTest::qExec(benchmark, QStringList(args.first()) + args.mid(2));
+    }
+    if (!only.isEmpty()) {
+        qWarning("Unknown benchmark %s", qPrintable(only));
+        return 1;
+    }
+    return result;
+}
@@ -0,0 +1,227 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "paintbenchmark.h"
+#include "benchsession.h"
+#include "benchstats.h"
+#include "textdocument.h"
+#include "textbrowser.h"
+#include "messageformatter.h"
+#include "treewidget.h"
+#include "listview.h"
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <IrcBufferModel>
+#include <QScrollBar>
+#include <IrcChannel>
+#include <IrcMessage>
+#include <QDateTime>
+#include <QVector>
+#include <QImage>
+#include <QtTest>
+#include <algorithm>
+
+// 15 networks of 100 buffers, a busy bouncer user
+static const int Connections = 15;
+static const int BuffersPerConnection = 100;
+static const int ChannelUsers = 10000;
+static const int Blocks = 1000;
+static const int LineLength = 400;
+static const int HighlightInterval = 10;
+static const int Frames = 100;
+
+static QImage frameImage(QWidget* widget)
+{
+    QImage image(widget->size(), QImage::Format_ARGB32_Premultiplied);
+    image.fill(Qt::transparent);
+    return image;
+}
+
+// the average frame is the result, the spread goes to the log
+static void report(QVector<qint64> frames)
+{
+    if (frames.isEmpty())
+        return;
+    std::sort(frames.begin(), frames.end());
+    qint64 total = 0;
+    foreach (qint64 frame, frames)
+        total += frame;
+    qDebug("%d frames, p50 %.2f ms, p99 %.2f ms, worst %.2f ms", frames.count(),
+           frames.at(frames.count() / 2) / 1e6, frames.at(frames.count() * 99 / 100) / 1e6, frames.last() / 1e6);
+    QTest::setBenchmarkResult(total / 1e6 / frames.count(), QTest::WalltimeMilliseconds);
+}
+
+void PaintBenchmark::initTestCase()
+{
+    d.tree = new TreeWidget;
+    d.tree->resize(240, 800);
+    const QStringList names = BenchSession::nicks(BuffersPerConnection);
+    for (int i = 0; i < Connections; ++i) {
+        BenchSession* session = new BenchSession(this);
+        session->setDisplayName(QString("network%1").arg(i));
+        d.sessions += session;
+
+        IrcBuffer* server = session->bufferModel()->add(session->displayName());
+        server->setSticky(true);
+        d.tree->addBuffer(server);
+        foreach (const QString& name, names)
+            d.tree->addBuffer(session->bufferModel()->add("#" + name));
+    }
+    QMetaObject::invokeMethod(d.tree, "applySorting");
+
+    // the users and the document share one channel, like a view does
+    IrcChannel* channel = d.sessions.first()->join("#bench", BenchSession::nicks(ChannelUsers));
+    QVERIFY(channel);
+
+    d.list = new ListView;
+    d.list->resize(200, 800);
+    d.list->setChannel(channel);
+
+    d.document = new TextDocument(channel);
+    MessageFormatter formatter;
+    formatter.setBuffer(channel);
+    const qint64 start = QDateTime(QDate::currentDate(), QTime(8, 0)).toMSecsSinceEpoch();
+    const QStringList nicks = BenchSession::nicks(Blocks);
+    for (int i = 0; i < Blocks; ++i) {
+        const QString text = i % 4 ? BenchSession::plainText(i) : BenchSession::colouredText(i, LineLength);
+        IrcMessage* msg = IrcMessage::fromData(BenchSession::privmsg(nicks.at(i), "#bench", text, start + i * 1000), channel->connection());
+        d.document->append(formatter.formatMessage(msg));
+        delete msg;
+    }
+    QMetaObject::invokeMethod(d.document, "flush");
+    for (int i = 0; i < Blocks; i += HighlightInterval)
+        d.document->addHighlight(i);
+
+    d.browser = new TextBrowser;
+    d.browser->resize(800, 800);
+    d.browser->setDocument(d.document);
+
+    // offscreen, shown so the views fill their models and lay out
+    d.tree->show();
+    d.list->show();
+    d.browser->show();
+    QCoreApplication::processEvents();
+}
+
+void PaintBenchmark::cleanupTestCase()
+{
+    delete d.browser;
+    delete d.document;
+    delete d.list;
+    delete d.tree;
+}
+
+void PaintBenchmark::init()
+{
+    BenchStats::begin();
+}
+
+void PaintBenchmark::cleanup()
+{
+    BenchStats::end();
+}
+
+void PaintBenchmark::paint(QWidget* widget)
+{
+    QImage image = frameImage(widget);
+    QVector<qint64> frames;
+    QElapsedTimer timer;
+    for (int i = 0; i < Frames; ++i) {
+        timer.start();
+        widget->render(&image);
+        frames += timer.nsecsElapsed();
+    }
+    report(frames);
+}
+
+void PaintBenchmark::scroll(QAbstractScrollArea* area)
+{
+    // top to bottom in even steps, each step scrolled and painted
+    QScrollBar* bar = area->verticalScrollBar();
+    QVERIFY(bar->maximum() > bar->minimum());
+    const int step = qMax(1, (bar->maximum() - bar->minimum()) / Frames);
+
+    QImage image = frameImage(area);
+    QVector<qint64> frames;
+    QElapsedTimer timer;
+    for (int value = bar->minimum(); value <= bar->maximum(); value += step) {
+        timer.start();
+        bar->setValue(value);
+        area->render(&image);
+        frames += timer.nsecsElapsed();
+    }
+    report(frames);
+}
+
+void PaintBenchmark::treePaint()
+{
+    paint(d.tree);
+}
+
+void PaintBenchmark::treeScroll()
+{
+    scroll(d.tree);
+}
+
+void PaintBenchmark::treeResort()
+{
+    // every frame highlights another buffer, which moves up in the order
+    QImage image = frameImage(d.tree);
+    QVector<qint64> frames;
+    QElapsedTimer timer;
+    for (int i = 0; i < Frames; ++i) {
+        QTreeWidgetItem* parent = d.tree->topLevelItem(i % d.tree->topLevelItemCount());
+        QTreeWidgetItem* item = parent->child(parent->childCount() - 1 - i / d.tree->topLevelItemCount());
+        timer.start();
+        d.tree->highlightItem(item);
+        QMetaObject::invokeMethod(d.tree, "applySorting");
+        d.tree->render(&image);
+        frames += timer.nsecsElapsed();
+    }
+    report(frames);
+}
+
+void PaintBenchmark::listPaint()
+{
+    paint(d.list);
+}
+
+void PaintBenchmark::listScroll()
+{
+    scroll(d.list);
+}
+
+void PaintBenchmark::browserPaint()
+{
+    paint(d.browser);
+}
+
+void PaintBenchmark::browserScroll()
+{
+    scroll(d.browser);
+}
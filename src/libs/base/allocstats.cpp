@@ -0,0 +1,162 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "allocstats.h"
+#include <QCoreApplication>
+#include <QAtomicInteger>
+#include <cstdlib>
+
+static const char* StageNames[] = { "other", "parse", "classify", "format", "insert", "log", "plugins" };
+
+// plain zero initialized atomics, counted before any constructor has run
+static QBasicAtomicInteger<qint64> counts[AllocStats::StageCount];
+static QBasicAtomicInteger<qint64> sizes[AllocStats::StageCount];
+static QBasicAtomicInteger<qint64> processed;
+
+#if defined(COMMUNI_ALLOCS) && defined(__GLIBC__)
+#define COMMUNI_ALLOC_HOOKS
+
+// initial exec, a lazily allocated tls block would call malloc from malloc
+static __thread int current __attribute__((tls_model("initial-exec"))) = AllocStats::Other;
+
+static inline void count(size_t size)
+{
+    counts[current].fetchAndAddRelaxed(1);
+    sizes[current].fetchAndAddRelaxed(qint64(size));
+}
+
+// interposes the allocator of the whole process, qt containers and
+// operator new come through here as well
+extern "C" {
+void* __libc_malloc(size_t size) __THROW;
+void* __libc_calloc(size_t count, size_t size) __THROW;
+void* __libc_realloc(void* ptr, size_t size) __THROW;
+
+void* malloc(size_t size) __THROW
+{
+    count(size);
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t n, size_t size) __THROW
+{
+    count(n * size);
+    return __libc_calloc(n, size);
+}
+
+void* realloc(void* ptr, size_t size) __THROW
+{
+    count(size);
+    return __libc_realloc(ptr, size);
+}
+}
+#endif // COMMUNI_ALLOCS && __GLIBC__
+
+bool AllocStats::isEnabled()
+{
+#ifdef COMMUNI_ALLOC_HOOKS
+    return true;
+#else
+    return false;
+#endif
+}
+
+int AllocStats::enter(Stage stage)
+{
+#ifdef COMMUNI_ALLOC_HOOKS
+    const int previous = current;
+    current = stage;
+    return previous;
+#else
+    Q_UNUSED(stage);
+    return Other;
+#endif
+}
+
+void AllocStats::leave(int previous)
+{
+#ifdef COMMUNI_ALLOC_HOOKS
+    current = previous;
+#else
+    Q_UNUSED(previous);
+#endif
+}
+
+void AllocStats::countMessage()
+{
+    processed.fetchAndAddRelaxed(1);
+}
+
+qint64 AllocStats::messages()
+{
+    return processed.load();
+}
+
+qint64 AllocStats::allocations(Stage stage)
+{
+    return counts[stage].load();
+}
+
+qint64 AllocStats::bytes(Stage stage)
+{
+    return sizes[stage].load();
+}
+
+const char* AllocStats::stageName(Stage stage)
+{
+    return StageNames[stage];
+}
+
+QStringList AllocStats::report()
+{
+    QStringList lines;
+    if (!isEnabled()) {
+        lines += QCoreApplication::translate("AllocStats", "Allocation counting is not built in, rebuild with CONFIG+=allocs.");
+        return lines;
+    }
+
+    const qint64 total = qMax(Q_INT64_C(1), messages());
+    lines += QCoreApplication::translate("AllocStats", "messages: %1").arg(messages());
+    for (int i = Parse; i < StageCount; ++i) {
+        const Stage stage = static_cast<Stage>(i);
+        lines += QCoreApplication::translate("AllocStats", "%1: %2 allocs, %3 bytes per message").arg(stageName(stage))
+                                                                                                  .arg(allocations(stage) / double(total), 0, 'f', 1)
+                                                                                                  .arg(bytes(stage) / total);
+    }
+    lines += QCoreApplication::translate("AllocStats", "other: %1 allocs, %2 kB in total").arg(allocations(Other)).arg(bytes(Other) / 1024);
+    return lines;
+}
+
+void AllocStats::reset()
+{
+    for (int i = 0; i < StageCount; ++i) {
+        counts[i].store(0);
+        sizes[i].store(0);
+    }
+    processed.store(0);
+}
@@ -0,0 +1,74 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef ALLOCSTATS_H
+#define ALLOCSTATS_H
+
+#include <QStringList>
+#include "baseglobal.h"
+
+// built with CONFIG+=allocs, the stages compile away otherwise
+#ifdef COMMUNI_ALLOCS
+#define COMMUNI_ALLOC_STAGE(stage) AllocScope communiAllocScope(AllocStats::stage)
+#else
+#define COMMUNI_ALLOC_STAGE(stage) do { } while (0)
+#endif
+
+// counts heap allocations and their bytes by the pipeline stage that is
+// innermost on the allocating thread, see COMMUNI_ALLOC_STAGE()
+class BASE_EXPORT AllocStats
+{
+public:
+    enum Stage { Other, Parse, Classify, Format, Insert, Log, Plugins, StageCount };
+
+    static bool isEnabled();
+
+    static int enter(Stage stage);
+    static void leave(int previous);
+
+    static void countMessage();
+    static qint64 messages();
+    static qint64 allocations(Stage stage);
+    static qint64 bytes(Stage stage);
+    static const char* stageName(Stage stage);
+
+    static QStringList report();
+    static void reset();
+};
+
+class AllocScope
+{
+public:
+    explicit AllocScope(AllocStats::Stage stage) : previous(AllocStats::enter(stage)) { }
+    ~AllocScope() { AllocStats::leave(previous); }
+
+private:
+    int previous;
+};
+
+#endif // ALLOCSTATS_H
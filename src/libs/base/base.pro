@@ -6,6 +6,7 @@ TEMPLATE = lib
 TARGET = Communi
 CONFIG += communi
 COMMUNI += core model util
+QT += network
 
 DESTDIR = $$BUILD_TREE/lib
 DLLDESTDIR = $$BUILD_TREE/bin
@@ -23,27 +24,81 @@ DEFINES += BUILD_BASE
     INSTALLS += target dlltarget
 }
 
+HEADERS += $$PWD/allocstats.h
 HEADERS += $$PWD/bufferview.h
+HEADERS += $$PWD/coldstore.h
+HEADERS += $$PWD/completionindex.h
+HEADERS += $$PWD/documentstub.h
 HEADERS += $$PWD/eventformatter.h
+HEADERS += $$PWD/flushscheduler.h
+HEADERS += $$PWD/formatpipeline.h
+HEADERS += $$PWD/handshake.h
+HEADERS += $$PWD/highlightmatcher.h
+HEADERS += $$PWD/hookstats.h
+HEADERS += $$PWD/inputlatency.h
+HEADERS += $$PWD/joinpacer.h
+HEADERS += $$PWD/linkpreview.h
 HEADERS += $$PWD/listview.h
+HEADERS += $$PWD/memorybudget.h
 HEADERS += $$PWD/messagedata.h
 HEADERS += $$PWD/messageformatter.h
+HEADERS += $$PWD/messagequeue.h
+HEADERS += $$PWD/messagestore.h
+HEADERS += $$PWD/messagetemplate.h
+HEADERS += $$PWD/nickmatcher.h
+HEADERS += $$PWD/segmentstorage.h
+HEADERS += $$PWD/sendqueue.h
+HEADERS += $$PWD/settingscache.h
+HEADERS += $$PWD/spillstore.h
+HEADERS += $$PWD/storagereply.h
+HEADERS += $$PWD/stringpool.h
+HEADERS += $$PWD/taskscheduler.h
 HEADERS += $$PWD/textbrowser.h
 HEADERS += $$PWD/textdocument.h
+HEADERS += $$PWD/textexport.h
 HEADERS += $$PWD/textinput.h
 HEADERS += $$PWD/themeinfo.h
 HEADERS += $$PWD/titlebar.h
+HEADERS += $$PWD/tracer.h
+HEADERS += $$PWD/userindex.h
 
+SOURCES += $$PWD/allocstats.cpp
 SOURCES += $$PWD/bufferview.cpp
+SOURCES += $$PWD/coldstore.cpp
+SOURCES += $$PWD/completionindex.cpp
+SOURCES += $$PWD/documentstub.cpp
 SOURCES += $$PWD/eventformatter.cpp
+SOURCES += $$PWD/flushscheduler.cpp
+SOURCES += $$PWD/formatpipeline.cpp
+SOURCES += $$PWD/handshake.cpp
+SOURCES += $$PWD/highlightmatcher.cpp
+SOURCES += $$PWD/hookstats.cpp
+SOURCES += $$PWD/inputlatency.cpp
+SOURCES += $$PWD/joinpacer.cpp
+SOURCES += $$PWD/linkpreview.cpp
 SOURCES += $$PWD/listview.cpp
+SOURCES += $$PWD/memorybudget.cpp
 SOURCES += $$PWD/messagedata.cpp
 SOURCES += $$PWD/messageformatter.cpp
+SOURCES += $$PWD/messagequeue.cpp
+SOURCES += $$PWD/messagestore.cpp
+SOURCES += $$PWD/messagetemplate.cpp
+SOURCES += $$PWD/nickmatcher.cpp
+SOURCES += $$PWD/segmentstorage.cpp
+SOURCES += $$PWD/sendqueue.cpp
+SOURCES += $$PWD/settingscache.cpp
+SOURCES += $$PWD/spillstore.cpp
+SOURCES += $$PWD/storagereply.cpp
+SOURCES += $$PWD/stringpool.cpp
+SOURCES += $$PWD/taskscheduler.cpp
 SOURCES += $$PWD/textbrowser.cpp
 SOURCES += $$PWD/textdocument.cpp
+SOURCES += $$PWD/textexport.cpp
 SOURCES += $$PWD/textinput.cpp
 SOURCES += $$PWD/themeinfo.cpp
 SOURCES += $$PWD/titlebar.cpp
+SOURCES += $$PWD/tracer.cpp
+SOURCES += $$PWD/userindex.cpp
 
 include(shared/shared.pri)
 include(plugins/plugins.pri)
@@ -28,20 +28,27 @@
 
 #include "bufferview.h"
 #include "textdocument.h"
+#include "documentstub.h"
 #include "textbrowser.h"
 #include "textinput.h"
 #include "listview.h"
 #include "titlebar.h"
+#include "sendqueue.h"
+#include "taskscheduler.h"
 #include <IrcBufferModel>
 #include <QApplication>
+#include <QProgressBar>
 #include <QVBoxLayout>
 #include <IrcChannel>
 #include <IrcBuffer>
 #include <QShortcut>
+#include <QScrollBar>
 
 BufferView::BufferView(QWidget* parent) : QWidget(parent)
 {
     d.buffer = 0;
+    d.parkedAtBottom = true;
+    d.parkedOffset = 0;
 
     d.titleBar = new TitleBar(this);
     d.listView = new ListView(this);
@@ -51,6 +58,11 @@ BufferView::BufferView(QWidget* parent) : QWidget(parent)
 
     d.textBrowser->setFocusPolicy(Qt::ClickFocus);
     d.textBrowser->viewport()->setAttribute(Qt::WA_AcceptTouchEvents, false);
+    d.textBrowser->installEventFilter(this);
+
+    d.progress = new QProgressBar(this);
+    d.progress->setFormat(tr("Sending %v/%m"));
+    d.progress->setVisible(false);
 
     d.splitter = new QSplitter(this);
     d.splitter->setSizePolicy(QSizePolicy::Preferred, QSizePolicy::Expanding);
@@ -83,6 +95,7 @@ BufferView::BufferView(QWidget* parent) : QWidget(parent)
     layout->setSpacing(0);
     layout->setMargin(0);
     layout->addWidget(d.splitter);
+    layout->addWidget(d.progress);
     layout->addWidget(d.textInput);
     layout->setStretchFactor(d.splitter, 1);
 
@@ -136,6 +149,17 @@ void BufferView::setBuffer(IrcBuffer* buffer)
 {
     if (d.buffer != buffer) {
         d.buffer = buffer;
+        d.parked = 0;
+
+        SendQueue* queue = SendQueue::instance(buffer ? buffer->connection() : 0);
+        if (d.queue != queue) {
+            if (d.queue)
+                disconnect(d.queue, SIGNAL(progressChanged(int,int)), this, SLOT(updateProgress(int,int)));
+            if (queue)
+                connect(queue, SIGNAL(progressChanged(int,int)), this, SLOT(updateProgress(int,int)));
+            d.queue = queue;
+        }
+        updateProgress(0, queue ? queue->pending() : 0);
 
         IrcChannel* channel = qobject_cast<IrcChannel*>(buffer);
         d.listView->setChannel(channel);
@@ -143,41 +167,140 @@ void BufferView::setBuffer(IrcBuffer* buffer)
 
         d.titleBar->setBuffer(buffer);
         d.textInput->setBuffer(buffer);
-        if (buffer) {
-            TextDocument* doc = 0;
-            QList<TextDocument*> documents = d.buffer->findChildren<TextDocument*>();
-            // there might be multiple clones, but at least one instance
-            // must always remain there to avoid losing history...
-            Q_ASSERT(!documents.isEmpty());
-            foreach (TextDocument* d, documents) {
-                if (!d->isVisible())
-                    doc = d;
-            }
-            if (!doc) {
-                doc = documents.first()->clone();
-                emit cloned(doc);
-            }
-            d.textBrowser->setDocument(doc);
-        } else {
-            d.textBrowser->setDocument(0);
-        }
+        attachDocument();
 
+        scheduleAttachment();
         emit bufferChanged(buffer);
     }
 }
 
+void BufferView::attachDocument()
+{
+    IrcBuffer* buffer = d.buffer;
+    if (buffer) {
+        TextDocument* doc = 0;
+        QList<TextDocument*> documents = d.buffer->findChildren<TextDocument*>();
+        // buffers nobody looked at yet only have a stub
+        DocumentStub* stub = DocumentStub::find(buffer);
+        if (documents.isEmpty() && stub) {
+            stub->request();
+            documents = d.buffer->findChildren<TextDocument*>();
+        }
+        // there might be multiple clones, but at least one instance
+        // must always remain there to avoid losing history...
+        Q_ASSERT(!documents.isEmpty());
+        foreach (TextDocument* d, documents) {
+            if (!d->isVisible())
+                doc = d;
+        }
+        if (!doc) {
+            doc = documents.first()->clone();
+            emit cloned(doc);
+        }
+        d.textBrowser->setDocument(doc);
+    } else {
+        d.textBrowser->setDocument(0);
+    }
+}
+
 void BufferView::closeBuffer()
 {
     if (d.buffer)
         emit bufferClosed(d.buffer);
 }
 
+bool BufferView::eventFilter(QObject* object, QEvent* event)
+{
+    switch (event->type()) {
+    case QEvent::Resize:
+    case QEvent::Show:
+    case QEvent::Hide:
+        if (object == d.textBrowser)
+            scheduleAttachment();
+        break;
+    case QEvent::WindowStateChange:
+        if (object == d.window)
+            scheduleAttachment();
+        break;
+    default:
+        break;
+    }
+    return QWidget::eventFilter(object, event);
+}
+
+void BufferView::hideEvent(QHideEvent* event)
+{
+    QWidget::hideEvent(event);
+    scheduleAttachment();
+}
+
 void BufferView::resizeEvent(QResizeEvent* event)
 {
     QWidget::resizeEvent(event);
     int tbh = d.titleBar->minimumSizeHint().height();
     d.titleBar->resize(width(), tbh);
     layout()->setContentsMargins(0, tbh + d.titleBar->baseOffset(), 0, 0);
+    scheduleAttachment();
+}
+
+void BufferView::showEvent(QShowEvent* event)
+{
+    QWidget::showEvent(event);
+
+    // minimizing is only seen by the window, which changes when pooled views move
+    if (d.window != window()) {
+        if (d.window)
+            d.window->removeEventFilter(this);
+        d.window = window();
+        d.window->installEventFilter(this);
+    }
+    scheduleAttachment();
+}
+
+bool BufferView::isEffectivelyVisible() const
+{
+    return isVisible() && d.textBrowser->isVisible() && !d.textBrowser->size().isEmpty()
+            && !(d.window && d.window->isMinimized());
+}
+
+void BufferView::scheduleAttachment()
+{
+    TaskScheduler::instance()->schedule(TaskScheduler::Animation, this, "updateAttachment");
+}
+
+void BufferView::updateAttachment()
+{
+    if (!d.buffer)
+        return;
+
+    // collapsed, minimized and zero-sized views keep no live layout, their
+    // document hibernates and queues rows until the view is shown again
+    TextDocument* doc = d.textBrowser->document();
+    const bool visible = isEffectivelyVisible();
+    if (!visible && doc) {
+        d.parked = doc;
+        d.parkedAtBottom = d.textBrowser->isAtBottom();
+        d.parkedOffset = d.textBrowser->verticalScrollBar()->value();
+        d.textBrowser->setDocument(0);
+    } else if (visible && !doc) {
+        doc = d.parked;
+        d.parked = 0;
+        if (doc && !doc->isVisible() && doc->buffer() == d.buffer) {
+            d.textBrowser->setDocument(doc);
+            if (!d.parkedAtBottom)
+                d.textBrowser->verticalScrollBar()->setValue(d.parkedOffset);
+        } else {
+            // another view took the document meanwhile
+            attachDocument();
+        }
+    }
+}
+
+void BufferView::updateProgress(int sent, int total)
+{
+    d.progress->setVisible(total > 0);
+    d.progress->setRange(0, total);
+    d.progress->setValue(sent);
 }
 
 void BufferView::openBuffer(const QString& title)
@@ -29,10 +29,13 @@
 #ifndef BUFFERVIEW_H
 #define BUFFERVIEW_H
 
+#include <QPointer>
 #include <QSplitter>
 #include "baseglobal.h"
 
 class TitleBar;
+class SendQueue;
+class QProgressBar;
 class ListView;
 class IrcBuffer;
 class TextInput;
@@ -68,16 +71,33 @@ signals:
     void cloned(TextDocument* doc);
 
 protected:
+    bool eventFilter(QObject* object, QEvent* event);
+    void hideEvent(QHideEvent* event);
     void resizeEvent(QResizeEvent* event);
+    void showEvent(QShowEvent* event);
+
+private slots:
+    void updateProgress(int sent, int total);
+    void updateAttachment();
 
 private:
+    void attachDocument();
+    bool isEffectivelyVisible() const;
+    void scheduleAttachment();
+
     struct Private {
         IrcBuffer* buffer;
         TitleBar* titleBar;
         ListView* listView;
         TextInput* textInput;
         TextBrowser* textBrowser;
+        QProgressBar* progress;
+        QPointer<SendQueue> queue;
         QSplitter* splitter;
+        QPointer<QWidget> window;
+        QPointer<TextDocument> parked;
+        bool parkedAtBottom;
+        int parkedOffset;
     } d;
 };
 
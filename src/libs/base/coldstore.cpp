@@ -0,0 +1,259 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "coldstore.h"
+#include "textdocument.h"
+#include <QCoreApplication>
+#include <QMutexLocker>
+#include <QDataStream>
+#include <QRunnable>
+
+// rows per chunk, reading one row decodes no more than this
+static const int chunkRows = 256;
+
+ColdStore::ColdStore()
+{
+    d.count = 0;
+    d.skip = 0;
+    d.compressed = 0;
+    d.raw = 0;
+    d.decoded = -1;
+}
+
+int ColdStore::count() const
+{
+    return d.count;
+}
+
+bool ColdStore::isEmpty() const
+{
+    return !d.count;
+}
+
+qint64 ColdStore::compressedSize() const
+{
+    return d.compressed;
+}
+
+qint64 ColdStore::rawFootprint() const
+{
+    return d.raw;
+}
+
+qint64 ColdStore::cacheFootprint() const
+{
+    qint64 bytes = 0;
+    foreach (const MessageData& row, d.rows)
+        bytes += row.footprint();
+    return bytes;
+}
+
+MessageData ColdStore::at(int row) const
+{
+    if (row < 0 || row >= d.count)
+        return MessageData();
+
+    // reads mostly walk the rows in order, so the last chunk is kept decoded
+    row += d.skip;
+    const int chunk = row / chunkRows;
+    if (chunk != d.decoded) {
+        d.rows = decode(d.chunks.at(chunk).data);
+        d.decoded = chunk;
+    }
+    return d.rows.value(row % chunkRows);
+}
+
+QList<MessageData> ColdStore::messages() const
+{
+    QList<MessageData> rows;
+    rows.reserve(d.count);
+    foreach (const Chunk& chunk, d.chunks)
+        rows += decode(chunk.data);
+    return rows.mid(d.skip);
+}
+
+QList<MessageData> ColdStore::takeFirst(int count)
+{
+    // the head chunk is only skipped into until all of its rows are gone
+    QList<MessageData> rows;
+    count = qMin(count, d.count);
+    for (int i = 0; i < count; ++i)
+        rows += at(i);
+    d.skip += count;
+    d.count -= count;
+    while (!d.chunks.isEmpty() && d.skip >= chunkRows) {
+        const Chunk chunk = d.chunks.takeFirst();
+        d.compressed -= chunk.data.size();
+        d.raw -= chunk.raw;
+        d.skip -= chunkRows;
+        if (--d.decoded < 0)
+            releaseCache();
+    }
+    if (!d.count)
+        clear();
+    return rows;
+}
+
+void ColdStore::releaseCache()
+{
+    d.rows.clear();
+    d.decoded = -1;
+}
+
+void ColdStore::clear()
+{
+    d.count = 0;
+    d.skip = 0;
+    d.compressed = 0;
+    d.raw = 0;
+    d.chunks.clear();
+    releaseCache();
+}
+
+ColdStore ColdStore::compress(const QList<MessageData>& rows)
+{
+    // the lazy flag is not part of the stream, those rows still need their html
+    ColdStore store;
+    for (int i = 0; i < rows.count(); i += chunkRows) {
+        QByteArray payload;
+        QDataStream out(&payload, QIODevice::WriteOnly);
+        const int end = qMin(i + chunkRows, rows.count());
+        Chunk chunk;
+        chunk.raw = 0;
+        out << static_cast<qint32>(end - i);
+        for (int j = i; j < end; ++j) {
+            const MessageData& row = rows.at(j);
+            out << row << row.isLazy();
+            chunk.raw += row.footprint();
+        }
+        chunk.data = qCompress(payload);
+        store.d.chunks += chunk;
+        store.d.compressed += chunk.data.size();
+        store.d.raw += chunk.raw;
+        store.d.count += end - i;
+    }
+    return store;
+}
+
+QList<MessageData> ColdStore::decode(const QByteArray& chunk)
+{
+    QList<MessageData> rows;
+    const QByteArray payload = qUncompress(chunk);
+    QDataStream in(payload);
+    qint32 count = 0;
+    in >> count;
+    for (int i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+        MessageData row;
+        bool lazy = false;
+        in >> row >> lazy;
+        row.setLazy(lazy);
+        rows += row;
+    }
+    return rows;
+}
+
+class ColdTask : public QRunnable
+{
+public:
+    ColdTask(ColdCompressor* compressor, int id, const QList<MessageData>& rows)
+        : compressor(compressor), id(id), rows(rows) { }
+
+    void run()
+    {
+        const ColdStore store = ColdStore::compress(rows);
+        // the hot copies go here, the document dropped its own on delivery
+        rows.clear();
+        compressor->post(id, store);
+    }
+
+private:
+    ColdCompressor* compressor;
+    int id;
+    QList<MessageData> rows;
+};
+
+ColdCompressor::ColdCompressor(QObject* parent) : QObject(parent)
+{
+    d.nextId = 0;
+    d.pool.setMaxThreadCount(1);
+}
+
+ColdCompressor::~ColdCompressor()
+{
+    d.pool.waitForDone();
+}
+
+ColdCompressor* ColdCompressor::instance()
+{
+    static QPointer<ColdCompressor> compressor;
+    if (!compressor)
+        compressor = new ColdCompressor(QCoreApplication::instance());
+    return compressor;
+}
+
+void ColdCompressor::compress(TextDocument* document, int generation, const QList<MessageData>& rows)
+{
+    Target target;
+    target.id = ++d.nextId;
+    target.generation = generation;
+    target.document = document;
+    d.targets += target;
+    d.pool.start(new ColdTask(this, target.id, rows));
+}
+
+void ColdCompressor::post(int id, const ColdStore& store)
+{
+    QMutexLocker locker(&d.mutex);
+    const bool wake = d.results.isEmpty();
+    Result result;
+    result.id = id;
+    result.store = store;
+    d.results += result;
+    if (wake)
+        QMetaObject::invokeMethod(this, "deliver", Qt::QueuedConnection);
+}
+
+void ColdCompressor::deliver()
+{
+    QList<Result> results;
+    {
+        QMutexLocker locker(&d.mutex);
+        results.swap(d.results);
+    }
+
+    foreach (const Result& result, results) {
+        for (int i = 0; i < d.targets.count(); ++i) {
+            if (d.targets.at(i).id == result.id) {
+                const Target target = d.targets.takeAt(i);
+                if (target.document)
+                    target.document->coldStored(target.generation, result.store);
+                break;
+            }
+        }
+    }
+}
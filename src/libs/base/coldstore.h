@@ -0,0 +1,126 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef COLDSTORE_H
+#define COLDSTORE_H
+
+#include <QList>
+#include <QMutex>
+#include <QObject>
+#include <QPointer>
+#include <QByteArray>
+#include <QThreadPool>
+#include "baseglobal.h"
+#include "messagedata.h"
+
+class TextDocument;
+
+// the rows of a hibernated document, serialized and compressed in chunks
+// that are decoded one at a time when read
+class BASE_EXPORT ColdStore
+{
+public:
+    ColdStore();
+
+    int count() const;
+    bool isEmpty() const;
+
+    qint64 compressedSize() const;
+    qint64 rawFootprint() const;
+    qint64 cacheFootprint() const;
+
+    MessageData at(int row) const;
+    QList<MessageData> messages() const;
+    QList<MessageData> takeFirst(int count);
+
+    void releaseCache();
+    void clear();
+
+    static ColdStore compress(const QList<MessageData>& rows);
+
+private:
+    static QList<MessageData> decode(const QByteArray& chunk);
+
+    struct Chunk {
+        QByteArray data;
+        qint64 raw;
+    };
+
+    struct Private {
+        int count;
+        int skip;
+        qint64 compressed;
+        qint64 raw;
+        QList<Chunk> chunks;
+        mutable int decoded;
+        mutable QList<MessageData> rows;
+    } d;
+};
+
+// compresses on a single pool thread and hands the result back to the
+// document on the gui thread, unless it went away or changed in between
+class BASE_EXPORT ColdCompressor : public QObject
+{
+    Q_OBJECT
+
+public:
+    static ColdCompressor* instance();
+    ~ColdCompressor();
+
+    void compress(TextDocument* document, int generation, const QList<MessageData>& rows);
+
+private slots:
+    void deliver();
+
+private:
+    ColdCompressor(QObject* parent = 0);
+
+    friend class ColdTask;
+    void post(int id, const ColdStore& store);
+
+    struct Result {
+        int id;
+        ColdStore store;
+    };
+
+    struct Target {
+        int id;
+        int generation;
+        QPointer<TextDocument> document;
+    };
+
+    struct Private {
+        int nextId;
+        QThreadPool pool;
+        QList<Target> targets;
+        QMutex mutex;
+        QList<Result> results;
+    } d;
+};
+
+#endif // COLDSTORE_H
@@ -0,0 +1,280 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "completionindex.h"
+#include "userindex.h"
+#include <IrcChannel>
+#include <IrcMessage>
+#include <IrcBuffer>
+#include <IrcUser>
+#include <QSet>
+#include <algorithm>
+
+struct Completion
+{
+    quint64 rank;
+    QString text;
+};
+
+// most recent first, alphabetical otherwise
+static bool rankLessThan(const Completion& one, const Completion& another)
+{
+    if (one.rank != another.rank)
+        return one.rank > another.rank;
+    return one.text.compare(another.text, Qt::CaseInsensitive) < 0;
+}
+
+CompletionTrie::CompletionTrie()
+{
+    clear();
+}
+
+int CompletionTrie::count() const
+{
+    return live;
+}
+
+bool CompletionTrie::contains(const QString& word) const
+{
+    const int n = node(word.toCaseFolded());
+    return n != -1 && nodes.at(n).word != -1;
+}
+
+void CompletionTrie::clear()
+{
+    live = 0;
+    removed = 0;
+    nodes.clear();
+    words.clear();
+    unused.clear();
+    nodes += Node();
+}
+
+void CompletionTrie::insert(const QString& word, quint64 rank)
+{
+    if (word.isEmpty())
+        return;
+
+    int n = 0;
+    foreach (const QChar& c, word.toCaseFolded()) {
+        int next = nodes.at(n).next.value(c, -1);
+        if (next == -1) {
+            next = nodes.count();
+            nodes += Node();
+            nodes[n].next.insert(c, next);
+        }
+        n = next;
+    }
+
+    int w = nodes.at(n).word;
+    if (w == -1) {
+        if (unused.isEmpty()) {
+            w = words.count();
+            words += Word();
+        } else {
+            w = unused.takeLast();
+        }
+        nodes[n].word = w;
+        ++live;
+    }
+    words[w].text = word;
+    words[w].rank = qMax(words.at(w).rank, rank);
+}
+
+void CompletionTrie::remove(const QString& word)
+{
+    const int n = node(word.toCaseFolded());
+    if (n == -1 || nodes.at(n).word == -1)
+        return;
+
+    const int w = nodes.at(n).word;
+    words[w] = Word();
+    unused += w;
+    nodes[n].word = -1;
+    --live;
+
+    // the nodes of removed words stay, rebuild once they dominate
+    if (++removed > 1024 && removed > live)
+        compact();
+}
+
+void CompletionTrie::touch(const QString& word, quint64 rank)
+{
+    const int n = node(word.toCaseFolded());
+    if (n != -1 && nodes.at(n).word != -1)
+        words[nodes.at(n).word].rank = rank;
+}
+
+QStringList CompletionTrie::complete(const QString& prefix) const
+{
+    // only the subtree below the prefix is visited
+    const int start = node(prefix.toCaseFolded());
+    if (start == -1)
+        return QStringList();
+
+    QVector<int> stack;
+    QVector<Completion> found;
+    stack += start;
+    while (!stack.isEmpty()) {
+        const Node& n = nodes.at(stack.takeLast());
+        if (n.word != -1) {
+            Completion completion;
+            completion.rank = words.at(n.word).rank;
+            completion.text = words.at(n.word).text;
+            found += completion;
+        }
+        foreach (int next, n.next)
+            stack += next;
+    }
+    std::sort(found.begin(), found.end(), rankLessThan);
+
+    QStringList result;
+    result.reserve(found.count());
+    foreach (const Completion& completion, found)
+        result += completion.text;
+    return result;
+}
+
+int CompletionTrie::node(const QString& key) const
+{
+    int n = 0;
+    foreach (const QChar& c, key) {
+        n = nodes.at(n).next.value(c, -1);
+        if (n == -1)
+            break;
+    }
+    return n;
+}
+
+void CompletionTrie::compact()
+{
+    QVector<Word> alive;
+    alive.reserve(live);
+    foreach (const Word& word, words) {
+        if (!word.text.isEmpty())
+            alive += word;
+    }
+    clear();
+    foreach (const Word& word, alive)
+        insert(word.text, word.rank);
+}
+
+CompletionIndex::CompletionIndex(IrcBuffer* buffer) : QObject(buffer)
+{
+    d.tick = 0;
+    d.buffer = buffer;
+
+    // built from the shared user index, see UserIndex
+    d.users = new UserView(Irc::SortByTitle, this);
+    connect(d.users, SIGNAL(modelReset()), this, SLOT(reset()));
+    connect(d.users, SIGNAL(added(IrcUser*)), this, SLOT(addUser(IrcUser*)));
+    connect(d.users, SIGNAL(removed(IrcUser*)), this, SLOT(removeUser(IrcUser*)));
+    connect(buffer, SIGNAL(titleChanged(QString)), this, SLOT(reset()));
+    connect(buffer, SIGNAL(messageReceived(IrcMessage*)), this, SLOT(touch(IrcMessage*)));
+    d.users->setChannel(buffer->toChannel());
+    reset();
+}
+
+CompletionIndex* CompletionIndex::instance(IrcBuffer* buffer)
+{
+    if (!buffer)
+        return 0;
+
+    CompletionIndex* index = buffer->findChild<CompletionIndex*>(QString(), Qt::FindDirectChildrenOnly);
+    if (!index)
+        index = new CompletionIndex(buffer);
+    return index;
+}
+
+QStringList CompletionIndex::complete(const QString& prefix) const
+{
+    return d.trie.complete(prefix);
+}
+
+void CompletionIndex::reset()
+{
+    if (!d.buffer->isChannel()) {
+        d.names.clear();
+        d.trie.clear();
+        d.trie.insert(d.buffer->title());
+        return;
+    }
+
+    // names that survive a reconnect keep their rank, see MessageFormatter::indexNames()
+    if (d.users->isDetached() && !d.users->count())
+        return;
+
+    QSet<QString> stale;
+    foreach (const QString& name, d.names)
+        stale.insert(name);
+    d.names.clear();
+
+    foreach (IrcUser* user, d.users->users()) {
+        d.names.insert(user, user->name());
+        connect(user, SIGNAL(nameChanged(QString)), this, SLOT(renameUser(QString)), Qt::UniqueConnection);
+        if (!stale.remove(user->name()))
+            d.trie.insert(user->name());
+    }
+    foreach (const QString& name, stale)
+        d.trie.remove(name);
+}
+
+void CompletionIndex::addUser(IrcUser* user)
+{
+    if (!user || d.names.contains(user))
+        return;
+
+    d.names.insert(user, user->name());
+    d.trie.insert(user->name());
+    connect(user, SIGNAL(nameChanged(QString)), this, SLOT(renameUser(QString)));
+}
+
+void CompletionIndex::removeUser(IrcUser* user)
+{
+    if (d.names.contains(user)) {
+        d.trie.remove(d.names.take(user));
+        disconnect(user, SIGNAL(nameChanged(QString)), this, SLOT(renameUser(QString)));
+    }
+}
+
+void CompletionIndex::renameUser(const QString& name)
+{
+    IrcUser* user = qobject_cast<IrcUser*>(sender());
+    if (user && d.names.contains(user)) {
+        d.trie.remove(d.names.value(user));
+        d.names.insert(user, name);
+        d.trie.insert(name, ++d.tick);
+    }
+}
+
+void CompletionIndex::touch(IrcMessage* message)
+{
+    // recent speakers complete first
+    if (message->type() == IrcMessage::Private || message->type() == IrcMessage::Notice)
+        d.trie.touch(message->nick(), ++d.tick);
+}
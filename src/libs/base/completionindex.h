@@ -0,0 +1,108 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef COMPLETIONINDEX_H
+#define COMPLETIONINDEX_H
+
+#include <QHash>
+#include <QChar>
+#include <QObject>
+#include <QVector>
+#include <QStringList>
+#include "baseglobal.h"
+
+class IrcUser;
+class IrcBuffer;
+class IrcMessage;
+class UserView;
+
+class BASE_EXPORT CompletionTrie
+{
+public:
+    CompletionTrie();
+
+    int count() const;
+    bool contains(const QString& word) const;
+
+    void clear();
+    void insert(const QString& word, quint64 rank = 0);
+    void remove(const QString& word);
+    void touch(const QString& word, quint64 rank);
+
+    QStringList complete(const QString& prefix) const;
+
+private:
+    int node(const QString& key) const;
+    void compact();
+
+    struct Node {
+        Node() : word(-1) { }
+        QHash<QChar, int> next;
+        int word;
+    };
+    struct Word {
+        Word() : rank(0) { }
+        QString text;
+        quint64 rank;
+    };
+    int live;
+    int removed;
+    QVector<Node> nodes;
+    QVector<Word> words;
+    QVector<int> unused;
+};
+
+class BASE_EXPORT CompletionIndex : public QObject
+{
+    Q_OBJECT
+
+public:
+    static CompletionIndex* instance(IrcBuffer* buffer);
+
+    QStringList complete(const QString& prefix) const;
+
+private slots:
+    void reset();
+    void addUser(IrcUser* user);
+    void removeUser(IrcUser* user);
+    void renameUser(const QString& name);
+    void touch(IrcMessage* message);
+
+private:
+    explicit CompletionIndex(IrcBuffer* buffer);
+
+    struct Private {
+        quint64 tick;
+        IrcBuffer* buffer;
+        UserView* users;
+        CompletionTrie trie;
+        QHash<IrcUser*, QString> names;
+    } d;
+};
+
+#endif // COMPLETIONINDEX_H
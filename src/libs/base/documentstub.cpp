@@ -0,0 +1,133 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "documentstub.h"
+#include "textdocument.h"
+#include <IrcConnection>
+#include <IrcMessage>
+#include <IrcBuffer>
+
+// past this much chatter the real document is cheaper than the replay
+static const int maximumLines = 200;
+
+DocumentStub::DocumentStub(IrcBuffer* buffer) : QObject(buffer)
+{
+    d.requested = false;
+    d.buffer = buffer;
+    connect(buffer, SIGNAL(messageReceived(IrcMessage*)), this, SLOT(receiveMessage(IrcMessage*)));
+}
+
+DocumentStub* DocumentStub::find(IrcBuffer* buffer)
+{
+    if (!buffer)
+        return 0;
+    return buffer->findChild<DocumentStub*>(QString(), Qt::FindDirectChildrenOnly);
+}
+
+IrcBuffer* DocumentStub::buffer() const
+{
+    return d.buffer;
+}
+
+int DocumentStub::pendingCount() const
+{
+    return d.lines.count();
+}
+
+QDateTime DocumentStub::latestMessageSeen() const
+{
+    return d.latestMessageSeen;
+}
+
+void DocumentStub::setLatestMessageSeen(const QDateTime& timestamp)
+{
+    d.latestMessageSeen = timestamp;
+}
+
+QDateTime DocumentStub::latestMessageReceived() const
+{
+    if (d.lines.isEmpty())
+        return QDateTime();
+    return d.lines.last().timestamp;
+}
+
+void DocumentStub::request()
+{
+    // whoever creates the document calls replay(), which retires the stub
+    if (!d.requested) {
+        d.requested = true;
+        emit documentRequested(d.buffer);
+    }
+}
+
+void DocumentStub::replay(TextDocument* document)
+{
+    disconnect(d.buffer, SIGNAL(messageReceived(IrcMessage*)), this, SLOT(receiveMessage(IrcMessage*)));
+
+    QList<Line> lines = d.lines;
+    d.lines.clear();
+    foreach (const Line& line, lines) {
+        IrcMessage* message = IrcMessage::fromData(line.data, d.buffer->connection());
+        if (message) {
+            message->setTimeStamp(line.timestamp);
+            document->receiveMessage(message);
+            delete message;
+        }
+    }
+
+    // out of find() right away, the document answers from now on
+    setParent(0);
+    deleteLater();
+}
+
+void DocumentStub::receiveMessage(IrcMessage* message)
+{
+    if (d.requested || message->property("filtered").toBool())
+        return;
+
+    // batches do not survive a round trip through their data, the document
+    // is created right away and gets the live message instead
+    if (message->type() == IrcMessage::Batch) {
+        request();
+        TextDocument* document = d.buffer->findChild<TextDocument*>(QString(), Qt::FindDirectChildrenOnly);
+        if (document)
+            document->receiveMessage(message);
+        return;
+    }
+
+    Line line;
+    line.data = message->toData();
+    line.timestamp = message->timeStamp();
+    d.lines += line;
+
+    // anything that counts as unread or may highlight needs the real thing,
+    // as does anything past the cap, joins and parts just wait
+    const IrcMessage::Type type = message->type();
+    if (type == IrcMessage::Private || type == IrcMessage::Notice || d.lines.count() > maximumLines)
+        request();
+}
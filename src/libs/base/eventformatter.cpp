@@ -27,6 +27,12 @@
 */
 
 #include "eventformatter.h"
+#include "messagetemplate.h"
+
+static inline const MessageTemplate& tmpl(const char* source)
+{
+    return MessageTemplate::translate("EventFormatter", source);
+}
 
 EventFormatter::EventFormatter(QObject* parent) : MessageFormatter(parent)
 {
@@ -34,47 +40,47 @@ EventFormatter::EventFormatter(QObject* parent) : MessageFormatter(parent)
 
 QString EventFormatter::formatEvent(const QString& event) const
 {
-    return tr("<span class='event'>%1 %2</span>").arg(formatExpander("!"), event);
+    return tmpl(QT_TR_NOOP("<span class='event'>%1 %2</span>")).fill(formatExpander("!"), event);
 }
 
 QString EventFormatter::formatInviteMessage(IrcInviteMessage* msg)
 {
-    return tr("! %1 invited to %2").arg(formatSender(msg),
-                                        styledText(msg->channel(), Bold));
+    return tmpl(QT_TR_NOOP("! %1 invited to %2")).fill(formatSender(msg),
+                                                       styledText(msg->channel(), Bold));
 }
 
 QString EventFormatter::formatJoinMessage(IrcJoinMessage* msg)
 {
-    return tr("! %1 joined").arg(formatSender(msg));
+    return tmpl(QT_TR_NOOP("! %1 joined")).fill(formatSender(msg));
 }
 
 QString EventFormatter::formatKickMessage(IrcKickMessage* msg)
 {
     if (msg->reason().isEmpty() || msg->reason() == msg->user())
-        return tr("! %1 kicked %2").arg(formatSender(msg),
-                                        styledText(msg->user(), Bold|Color));
+        return tmpl(QT_TR_NOOP("! %1 kicked %2")).fill(formatSender(msg),
+                                                       styledText(msg->user(), Bold|Color));
 
-    return tr("! %1 kicked %2 (%3)").arg(formatSender(msg),
-                                         styledText(msg->user(), Bold|Color),
-                                         formatText(msg->reason()));
+    return tmpl(QT_TR_NOOP("! %1 kicked %2 (%3)")).fill(formatSender(msg),
+                                                        styledText(msg->user(), Bold|Color),
+                                                        formatText(msg->reason()));
 }
 
 QString EventFormatter::formatModeMessage(IrcModeMessage* msg)
 {
     if (msg->isReply())
-        return tr("! %1 mode is %2 %3").arg(styledText(msg->target(), Bold),
-                                            styledText(msg->mode(), Bold),
-                                            styledText(msg->argument(), Bold));
+        return tmpl(QT_TR_NOOP("! %1 mode is %2 %3")).fill(styledText(msg->target(), Bold),
+                                                           styledText(msg->mode(), Bold),
+                                                           styledText(msg->argument(), Bold));
 
-    return tr("! %1 sets mode %2 %3").arg(formatSender(msg),
-                                          styledText(msg->mode(), Bold),
-                                          styledText(msg->argument(), Bold));
+    return tmpl(QT_TR_NOOP("! %1 sets mode %2 %3")).fill(formatSender(msg),
+                                                         styledText(msg->mode(), Bold),
+                                                         styledText(msg->argument(), Bold));
 }
 
 QString EventFormatter::formatNickMessage(IrcNickMessage* msg)
 {
-    return tr("! %1 changed nick to %2").arg(formatSender(msg),
-                                             styledText(msg->newNick(), Bold|Color));
+    return tmpl(QT_TR_NOOP("! %1 changed nick to %2")).fill(formatSender(msg),
+                                                            styledText(msg->newNick(), Bold|Color));
 }
 
 QString EventFormatter::formatNoticeMessage(IrcNoticeMessage* msg)
@@ -90,10 +96,10 @@ QString EventFormatter::formatNumericMessage(IrcNumericMessage* msg)
 QString EventFormatter::formatPartMessage(IrcPartMessage* msg)
 {
     if (msg->reason().isEmpty() || msg->reason() == msg->nick())
-        return tr("! %1 left").arg(formatSender(msg));
+        return tmpl(QT_TR_NOOP("! %1 left")).fill(formatSender(msg));
 
-    return tr("! %1 left (%2)").arg(formatSender(msg),
-                                    formatText(msg->reason()));
+    return tmpl(QT_TR_NOOP("! %1 left (%2)")).fill(formatSender(msg),
+                                                   formatText(msg->reason()));
 }
 
 QString EventFormatter::formatPongMessage(IrcPongMessage* msg)
@@ -104,24 +110,24 @@ QString EventFormatter::formatPongMessage(IrcPongMessage* msg)
 QString EventFormatter::formatPrivateMessage(IrcPrivateMessage* msg)
 {
     if (msg->isRequest())
-        return tr("! %1 requested %2").arg(formatSender(msg),
-                                           msg->content().split(" ").value(0).toUpper());
+        return tmpl(QT_TR_NOOP("! %1 requested %2")).fill(formatSender(msg),
+                                                          msg->content().split(" ").value(0).toUpper());
 
     if (msg->isAction())
-        return tr("* %1 %2").arg(formatSender(msg),
-                                 formatText(msg->content()));
+        return tmpl(QT_TR_NOOP("* %1 %2")).fill(formatSender(msg),
+                                                formatText(msg->content()));
 
-    return tr("&lt;%1&gt; %2").arg(formatSender(msg),
-                                   formatText(msg->content()));
+    return tmpl(QT_TR_NOOP("&lt;%1&gt; %2")).fill(formatSender(msg),
+                                                  formatText(msg->content()));
 }
 
 QString EventFormatter::formatQuitMessage(IrcQuitMessage* msg)
 {
     if (msg->reason().isEmpty() || msg->reason() == msg->nick())
-        return tr("! %1 quit").arg(formatSender(msg));
+        return tmpl(QT_TR_NOOP("! %1 quit")).fill(formatSender(msg));
 
-    return tr("! %1 quit (%2)").arg(formatSender(msg),
-                                    formatText(msg->reason()));
+    return tmpl(QT_TR_NOOP("! %1 quit (%2)")).fill(formatSender(msg),
+                                                   formatText(msg->reason()));
 }
 
 QString EventFormatter::formatTopicMessage(IrcTopicMessage* msg)
@@ -130,23 +136,23 @@ QString EventFormatter::formatTopicMessage(IrcTopicMessage* msg)
         return QString();
 
     if (msg->topic().isEmpty())
-        return tr("! %1 cleared topic").arg(formatSender(msg));
+        return tmpl(QT_TR_NOOP("! %1 cleared topic")).fill(formatSender(msg));
 
-    return tr("! %1 changed topic to \"%2\"").arg(formatSender(msg),
-                                                  formatText(msg->topic()));
+    return tmpl(QT_TR_NOOP("! %1 changed topic to \"%2\"")).fill(formatSender(msg),
+                                                                 formatText(msg->topic()));
 }
 
 QString EventFormatter::formatUnknownMessage(IrcMessage* msg)
 {
-    return tr("? %2 %3 %4").arg(formatSender(msg),
-                                msg->command(),
-                                msg->parameters().join(" "));
+    return tmpl(QT_TR_NOOP("? %2 %3 %4")).fill(formatSender(msg),
+                                               msg->command(),
+                                               msg->parameters().join(" "));
 }
 
 QString EventFormatter::formatSender(IrcMessage* msg) const
 {
     QString prefix = styledText(msg->nick(), Bold | (msg->isOwn() ? Dim : Color));
     if (!msg->ident().isEmpty() && !msg->host().isEmpty())
-        return tr("%1&nbsp;(%2@%3)").arg(prefix, msg->ident(), msg->host());
+        return tmpl(QT_TR_NOOP("%1&nbsp;(%2@%3)")).fill(prefix, msg->ident(), msg->host());
     return styledText(msg->nick(), Bold|Color);
 }
@@ -0,0 +1,174 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "flushscheduler.h"
+#include "textdocument.h"
+#include "taskscheduler.h"
+#include <IrcBuffer>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+
+FlushScheduler::FlushScheduler(QObject* parent) : QObject(parent)
+{
+    d.budget = 4;
+    d.chunk = 50;
+    d.depth = 0;
+    d.suspended = false;
+}
+
+FlushScheduler* FlushScheduler::instance()
+{
+    static QPointer<FlushScheduler> scheduler;
+    if (!scheduler)
+        scheduler = new FlushScheduler(QCoreApplication::instance());
+    return scheduler;
+}
+
+int FlushScheduler::budget() const
+{
+    return d.budget;
+}
+
+void FlushScheduler::setBudget(int msecs)
+{
+    d.budget = qMax(1, msecs);
+}
+
+int FlushScheduler::chunkSize() const
+{
+    return d.chunk;
+}
+
+void FlushScheduler::setChunkSize(int lines)
+{
+    d.chunk = qMax(1, lines);
+}
+
+int FlushScheduler::queueDepth() const
+{
+    return d.depth;
+}
+
+bool FlushScheduler::isSuspended() const
+{
+    return d.suspended;
+}
+
+void FlushScheduler::setSuspended(bool suspended)
+{
+    // while nobody looks, documents only queue up and the drain waits,
+    // resuming drains them visible first in the usual chunks
+    if (d.suspended != suspended) {
+        d.suspended = suspended;
+        if (suspended)
+            TaskScheduler::instance()->unschedule(this, "drain");
+        else if (!d.documents.isEmpty())
+            TaskScheduler::instance()->schedule(TaskScheduler::Flush, this, "drain");
+    }
+}
+
+void FlushScheduler::schedule(TextDocument* document)
+{
+    if (document && !d.documents.contains(document)) {
+        d.documents += document;
+        if (!d.suspended)
+            TaskScheduler::instance()->schedule(TaskScheduler::Flush, this, "drain");
+    }
+}
+
+void FlushScheduler::unschedule(TextDocument* document)
+{
+    d.documents.removeAll(document);
+}
+
+void FlushScheduler::prioritize(TextDocument* document)
+{
+    if (d.documents.removeAll(document))
+        d.documents.prepend(document);
+}
+
+IrcBuffer* FlushScheduler::currentBuffer() const
+{
+    return d.current;
+}
+
+void FlushScheduler::setCurrentBuffer(IrcBuffer* buffer)
+{
+    d.current = buffer;
+}
+
+// private messages, highlights and the current buffer do not wait behind
+// the chatter and events of channels nobody is looking at
+FlushScheduler::Lane FlushScheduler::lane(TextDocument* document) const
+{
+    IrcBuffer* buffer = document->buffer();
+    if (buffer == d.current || (!buffer->isChannel() && !buffer->isSticky()) || document->hasPendingHighlight())
+        return Urgent;
+    return document->isVisible() || document->isWarm() ? Visible : Hidden;
+}
+
+void FlushScheduler::drain()
+{
+    // lanes are served in order, each round-robin in chunks, and the rows
+    // of a document always go in in the order they arrived
+    QList<QPointer<TextDocument> > lanes[LaneCount];
+    foreach (const QPointer<TextDocument>& doc, d.documents) {
+        if (doc && doc->pendingCount() > 0)
+            lanes[lane(doc)] += doc;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < LaneCount; ++i) {
+        QList<QPointer<TextDocument> >& queue = lanes[i];
+        while (!queue.isEmpty() && timer.elapsed() < d.budget) {
+            QPointer<TextDocument> doc = queue.takeFirst();
+            if (doc && doc->flushQueue(d.chunk) > 0 && doc->pendingCount() > 0)
+                queue += doc;
+        }
+    }
+    d.documents = lanes[Urgent] + lanes[Visible] + lanes[Hidden];
+
+    // one chunk round per frame, the rest waits for the next one
+    if (!d.documents.isEmpty() && !d.suspended)
+        TaskScheduler::instance()->schedule(TaskScheduler::Flush, this, "drain");
+    updateQueueDepth();
+}
+
+void FlushScheduler::updateQueueDepth()
+{
+    int depth = 0;
+    foreach (const QPointer<TextDocument>& doc, d.documents) {
+        if (doc)
+            depth += doc->pendingCount();
+    }
+    if (d.depth != depth) {
+        d.depth = depth;
+        emit queueDepthChanged(depth);
+    }
+}
@@ -0,0 +1,232 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "formatpipeline.h"
+#include "messageformatter.h"
+#include "textdocument.h"
+#include <QCoreApplication>
+#include <QSharedPointer>
+#include <QSemaphore>
+#include <QRunnable>
+#include <QThread>
+
+struct FormatResult
+{
+    QPointer<TextDocument> document;
+    int sequence;
+    int version;
+    QString format;
+    QStringList texts;
+    QStringList htmls;
+    FormatResult* next;
+};
+
+class FormatTask : public QRunnable
+{
+public:
+    FormatTask(FormatPipeline* pipeline, FormatResult* result, const QStringList& texts, const NickMatcher& names)
+        : pipeline(pipeline), result(result), texts(texts), names(names) { }
+
+    void run()
+    {
+        int plain = 0;
+        result->format = MessageFormatter::formatDeferred(result->format, texts, names, &plain, &result->htmls);
+        result->texts = texts;
+        pipeline->d.texts.fetchAndAddRelaxed(texts.count());
+        pipeline->d.plainTexts.fetchAndAddRelaxed(plain);
+        pipeline->post(result);
+    }
+
+private:
+    FormatPipeline* pipeline;
+    FormatResult* result;
+    QStringList texts;
+    NickMatcher names;
+};
+
+// chunks are claimed from the end, the tail is what the views show
+struct FormatBatch
+{
+    FormatJob* jobs;
+    int count;
+    int chunk;
+    int chunks;
+    NickMatcher names;
+    QAtomicInt next;
+    QSemaphore done;
+};
+
+class FormatChunkTask : public QRunnable
+{
+public:
+    FormatChunkTask(FormatPipeline* pipeline, const QSharedPointer<FormatBatch>& batch)
+        : pipeline(pipeline), batch(batch) { }
+
+    void run()
+    {
+        const NickMatcher names = batch->names;
+        int claimed = batch->next.fetchAndAddRelaxed(1);
+        while (claimed < batch->chunks) {
+            const int from = (batch->chunks - 1 - claimed) * batch->chunk;
+            const int to = qMin(batch->count, from + batch->chunk);
+            int texts = 0;
+            int plain = 0;
+            for (int i = from; i < to; ++i) {
+                FormatJob& job = batch->jobs[i];
+                job.format = MessageFormatter::formatDeferred(job.format, job.texts, names, &plain);
+                texts += job.texts.count();
+            }
+            pipeline->d.texts.fetchAndAddRelaxed(texts);
+            pipeline->d.plainTexts.fetchAndAddRelaxed(plain);
+            batch->done.release();
+            claimed = batch->next.fetchAndAddRelaxed(1);
+        }
+    }
+
+private:
+    FormatPipeline* pipeline;
+    QSharedPointer<FormatBatch> batch;
+};
+
+FormatPipeline::FormatPipeline(QObject* parent) : QObject(parent)
+{
+    d.pending = 0;
+    d.pool.setMaxThreadCount(qMax(1, QThread::idealThreadCount() - 1));
+}
+
+FormatPipeline::~FormatPipeline()
+{
+    d.pool.waitForDone();
+    FormatResult* result = d.results.fetchAndStoreAcquire(0);
+    while (result) {
+        FormatResult* next = result->next;
+        delete result;
+        result = next;
+    }
+}
+
+FormatPipeline* FormatPipeline::instance()
+{
+    static QPointer<FormatPipeline> pipeline;
+    if (!pipeline)
+        pipeline = new FormatPipeline(QCoreApplication::instance());
+    return pipeline;
+}
+
+bool FormatPipeline::isEnabled() const
+{
+    // a single core gains nothing from the handoff
+    return QThread::idealThreadCount() > 1;
+}
+
+int FormatPipeline::pendingCount() const
+{
+    return d.pending;
+}
+
+int FormatPipeline::formattedTexts() const
+{
+    return d.texts.load();
+}
+
+int FormatPipeline::plainTexts() const
+{
+    return d.plainTexts.load();
+}
+
+void FormatPipeline::submit(TextDocument* document, int sequence, const QString& format,
+                            const QStringList& texts, const NickMatcher& names)
+{
+    FormatResult* result = new FormatResult;
+    result->document = document;
+    result->sequence = sequence;
+    result->version = document->formatter()->cacheVersion();
+    result->format = format;
+    result->next = 0;
+    ++d.pending;
+    d.pool.start(new FormatTask(this, result, texts, names));
+}
+
+void FormatPipeline::formatAll(QVector<FormatJob>& jobs, const NickMatcher& names, int chunk)
+{
+    if (jobs.isEmpty())
+        return;
+
+    QSharedPointer<FormatBatch> batch(new FormatBatch);
+    batch->jobs = jobs.data();
+    batch->count = jobs.count();
+    batch->chunk = qMax(1, chunk);
+    batch->chunks = (batch->count + batch->chunk - 1) / batch->chunk;
+    batch->names = names;
+
+    // the gui thread works along and returns once every chunk is done,
+    // helpers that start late find nothing left to claim
+    const int helpers = isEnabled() ? qMin(batch->chunks - 1, d.pool.maxThreadCount()) : 0;
+    for (int i = 0; i < helpers; ++i)
+        d.pool.start(new FormatChunkTask(this, batch));
+    FormatChunkTask(this, batch).run();
+    batch->done.acquire(batch->chunks);
+}
+
+void FormatPipeline::post(FormatResult* result)
+{
+    // lock-free push, only the push onto an empty stack wakes up the gui thread
+    FormatResult* head = 0;
+    do {
+        head = d.results.loadAcquire();
+        result->next = head;
+    } while (!d.results.testAndSetRelease(head, result));
+
+    if (!head)
+        QMetaObject::invokeMethod(this, "deliver", Qt::QueuedConnection);
+}
+
+void FormatPipeline::deliver()
+{
+    FormatResult* result = d.results.fetchAndStoreAcquire(0);
+
+    // the stack is newest first
+    FormatResult* ordered = 0;
+    while (result) {
+        FormatResult* next = result->next;
+        result->next = ordered;
+        ordered = result;
+        result = next;
+    }
+
+    while (ordered) {
+        FormatResult* next = ordered->next;
+        --d.pending;
+        if (ordered->document) {
+            ordered->document->formatter()->cacheTexts(ordered->version, ordered->texts, ordered->htmls);
+            ordered->document->completeFormat(ordered->sequence, ordered->format);
+        }
+        delete ordered;
+        ordered = next;
+    }
+}
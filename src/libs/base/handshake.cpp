@@ -0,0 +1,130 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "handshake.h"
+#include "hookstats.h"
+#include "allocstats.h"
+#include <IrcConnection>
+#include <IrcNetwork>
+#include <IrcMessage>
+#include <QSettings>
+
+Handshake::Handshake(IrcConnection* connection) : QObject(connection)
+{
+    d.connection = connection;
+    d.ready = -1;
+
+    HookStats::installMessageFilter(connection, this);
+    connect(connection, SIGNAL(connecting()), this, SLOT(onConnecting()));
+    connect(connection, SIGNAL(connected()), this, SLOT(onConnected()));
+}
+
+Handshake* Handshake::instance(IrcConnection* connection)
+{
+    if (!connection)
+        return 0;
+
+    Handshake* handshake = connection->findChild<Handshake*>(QString(), Qt::FindDirectChildrenOnly);
+    if (!handshake)
+        handshake = new Handshake(connection);
+    return handshake;
+}
+
+bool Handshake::isPipelined() const
+{
+    return !d.requested.isEmpty();
+}
+
+qint64 Handshake::readyTime() const
+{
+    return d.ready;
+}
+
+bool Handshake::messageFilter(IrcMessage* message)
+{
+    // every message of every connection passes here once
+    AllocStats::countMessage();
+
+    // a refused request means the listing changed, the regular handshake
+    // that follows CAP LS is still on its way and takes over
+    if (message->type() == IrcMessage::Capability && !d.requested.isEmpty()) {
+        IrcCapabilityMessage* cap = static_cast<IrcCapabilityMessage*>(message);
+        if (cap->subCommand() == "NAK") {
+            QSettings settings;
+            settings.remove(cacheKey());
+            d.requested.clear();
+        }
+    }
+    return false;
+}
+
+void Handshake::onConnecting()
+{
+    d.ready = -1;
+    d.requested.clear();
+    d.clock.start();
+
+    // queued behind the opening lines of the protocol and the start of
+    // tls, but still in the same flight as CAP LS, NICK and USER
+    QMetaObject::invokeMethod(this, "request", Qt::QueuedConnection);
+}
+
+void Handshake::request()
+{
+    // the ACK and the SASL exchange overlap the listing round trip
+    if (d.connection->status() != IrcConnection::Connecting)
+        return;
+
+    IrcNetwork* network = d.connection->network();
+    const QStringList cached = QSettings().value(cacheKey()).toStringList();
+    foreach (const QString& capability, network->requestedCapabilities()) {
+        if (cached.contains(capability))
+            d.requested += capability;
+    }
+    if (cached.contains("sasl") && !d.connection->saslMechanism().isEmpty() && !d.connection->password().isEmpty())
+        d.requested += "sasl";
+    d.requested.removeDuplicates();
+    if (!d.requested.isEmpty())
+        d.connection->sendData("CAP REQ :" + d.requested.join(" ").toUtf8());
+}
+
+void Handshake::onConnected()
+{
+    if (d.clock.isValid())
+        d.ready = d.clock.elapsed();
+
+    // what the server listed this time is requested up front next time
+    const QStringList available = d.connection->network()->availableCapabilities();
+    if (!available.isEmpty())
+        QSettings().setValue(cacheKey(), available);
+}
+
+QString Handshake::cacheKey() const
+{
+    return "capabilities/" + d.connection->host() + ":" + QString::number(d.connection->port());
+}
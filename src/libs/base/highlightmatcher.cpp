@@ -0,0 +1,168 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "highlightmatcher.h"
+#include <IrcConnection>
+#include <IrcMessage>
+#include <QQueue>
+
+static int keywordGeneration = 1;
+static QStringList userKeywords;
+
+HighlightMatcher::HighlightMatcher(IrcConnection* connection) : QObject(connection)
+{
+    d.generation = 0;
+    d.connection = connection;
+
+    connect(connection, SIGNAL(nickNameChanged(QString)), this, SLOT(invalidate()));
+}
+
+HighlightMatcher* HighlightMatcher::instance(IrcConnection* connection)
+{
+    if (!connection)
+        return 0;
+
+    HighlightMatcher* matcher = connection->findChild<HighlightMatcher*>(QString(), Qt::FindDirectChildrenOnly);
+    if (!matcher)
+        matcher = new HighlightMatcher(connection);
+    return matcher;
+}
+
+QStringList HighlightMatcher::keywords()
+{
+    return userKeywords;
+}
+
+void HighlightMatcher::setKeywords(const QStringList& keywords)
+{
+    if (userKeywords != keywords) {
+        userKeywords = keywords;
+        ++keywordGeneration;
+    }
+}
+
+static inline bool isWordChar(const QChar& c)
+{
+    return c.isLetterOrNumber() || c == QLatin1Char('_');
+}
+
+bool HighlightMatcher::matches(const QString& text) const
+{
+    if (d.generation != keywordGeneration)
+        compile();
+
+    // one pass over the case folded text, whatever the number of keywords
+    int state = 0;
+    const int count = text.length();
+    for (int i = 0; i < count; ++i) {
+        const ushort c = text.at(i).toCaseFolded().unicode();
+        while (state && !d.states.at(state).next.contains(c))
+            state = d.states.at(state).fail;
+        state = d.states.at(state).next.value(c, 0);
+
+        // a keyword counts where it is not part of a longer word
+        foreach (int length, d.states.at(state).lengths) {
+            const int start = i - length + 1;
+            if ((start == 0 || !isWordChar(text.at(start - 1))) && (i + 1 == count || !isWordChar(text.at(i + 1))))
+                return true;
+        }
+    }
+    return false;
+}
+
+bool HighlightMatcher::isHighlight(IrcMessage* message) const
+{
+    // documents, clones, the dock and the tray all look at the same message
+    const QVariant cached = message->property("highlight");
+    if (cached.isValid())
+        return cached.toBool();
+
+    QString content;
+    if (message->type() == IrcMessage::Private)
+        content = static_cast<IrcPrivateMessage*>(message)->content();
+    else if (message->type() == IrcMessage::Notice)
+        content = static_cast<IrcNoticeMessage*>(message)->content();
+
+    const bool highlight = !content.isEmpty() && matches(content);
+    message->setProperty("highlight", highlight);
+    return highlight;
+}
+
+void HighlightMatcher::invalidate()
+{
+    d.generation = 0;
+}
+
+void HighlightMatcher::compile() const
+{
+    HighlightMatcher* that = const_cast<HighlightMatcher*>(this);
+    QVector<State>& states = that->d.states;
+    states.clear();
+    states.append(State());
+
+    QStringList words = userKeywords;
+    words.prepend(d.connection->nickName());
+    foreach (const QString& word, words) {
+        const QString folded = word.trimmed().toCaseFolded();
+        if (folded.isEmpty())
+            continue;
+        int state = 0;
+        foreach (const QChar& c, folded) {
+            int next = states.at(state).next.value(c.unicode(), 0);
+            if (!next) {
+                next = states.count();
+                states[state].next.insert(c.unicode(), next);
+                states.append(State());
+            }
+            state = next;
+        }
+        if (!states.at(state).lengths.contains(folded.length()))
+            states[state].lengths += folded.length();
+    }
+
+    // breadth first, so that fail links always point to finished states
+    QQueue<int> queue;
+    foreach (int child, states.at(0).next)
+        queue.enqueue(child);
+    while (!queue.isEmpty()) {
+        const int state = queue.dequeue();
+        QHash<ushort, int>::const_iterator it;
+        for (it = states.at(state).next.constBegin(); it != states.at(state).next.constEnd(); ++it) {
+            const int child = it.value();
+            int fail = states.at(state).fail;
+            while (fail && !states.at(fail).next.contains(it.key()))
+                fail = states.at(fail).fail;
+            fail = states.at(fail).next.value(it.key(), 0);
+            states[child].fail = fail;
+            states[child].lengths += states.at(fail).lengths;
+            queue.enqueue(child);
+        }
+    }
+
+    that->d.generation = keywordGeneration;
+}
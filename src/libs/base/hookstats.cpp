@@ -0,0 +1,304 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "hookstats.h"
+#include "tracer.h"
+#include "allocstats.h"
+#include "inputlatency.h"
+#include <QCoreApplication>
+#include <IrcCommandFilter>
+#include <IrcMessageFilter>
+#include <IrcConnection>
+#include <QElapsedTimer>
+#include <QPointer>
+#include <QThread>
+#include <QFile>
+#include <algorithm>
+
+// enough samples for a meaningful p99 of the recent past
+static const int MaxSamples = 1000;
+
+// stands in for a plugin's filter in the connection's chain and times it
+class HookFilter : public QObject, public IrcMessageFilter, public IrcCommandFilter
+{
+    Q_OBJECT
+    Q_INTERFACES(IrcMessageFilter IrcCommandFilter)
+
+public:
+    HookFilter(QObject* filter, IrcConnection* connection) : QObject(connection), target(filter),
+        messages(0), commands(0), messageCounter(0), commandCounter(0)
+    {
+        setObjectName(QString::number(quintptr(filter)));
+    }
+
+    bool messageFilter(IrcMessage* message)
+    {
+        if (!target || !messages)
+            return false;
+        COMMUNI_TRACE("messageFilter");
+        COMMUNI_ALLOC_STAGE(Plugins);
+        InputLatency::note("messageFilter");
+        QElapsedTimer timer;
+        timer.start();
+        const bool filtered = messages->messageFilter(message);
+        messageCounter->add(timer.nsecsElapsed());
+        return filtered;
+    }
+
+    bool commandFilter(IrcCommand* command)
+    {
+        if (!target || !commands)
+            return false;
+        COMMUNI_TRACE("commandFilter");
+        COMMUNI_ALLOC_STAGE(Plugins);
+        QElapsedTimer timer;
+        timer.start();
+        const bool filtered = commands->commandFilter(command);
+        commandCounter->add(timer.nsecsElapsed());
+        return filtered;
+    }
+
+    static HookFilter* find(IrcConnection* connection, QObject* filter)
+    {
+        return connection->findChild<HookFilter*>(QString::number(quintptr(filter)), Qt::FindDirectChildrenOnly);
+    }
+
+    void release()
+    {
+        if (!messages && !commands)
+            deleteLater();
+    }
+
+    QPointer<QObject> target;
+    IrcMessageFilter* messages;
+    IrcCommandFilter* commands;
+    HookStats::Counter* messageCounter;
+    HookStats::Counter* commandCounter;
+};
+
+void HookStats::Counter::add(qint64 elapsed)
+{
+    ++calls;
+    nsecs += elapsed;
+    if (samples.count() < MaxSamples)
+        samples += elapsed;
+    else
+        samples[next] = elapsed;
+    next = (next + 1) % MaxSamples;
+}
+
+qint64 HookStats::Counter::percentile(int percent) const
+{
+    if (samples.isEmpty())
+        return 0;
+    QVector<qint64> sorted = samples;
+    QVector<qint64>::iterator nth = sorted.begin() + (sorted.count() - 1) * percent / 100;
+    std::nth_element(sorted.begin(), nth, sorted.end());
+    return *nth;
+}
+
+HookStats::Scope::Scope(const char* name) : counter(0)
+{
+    // counters are not shared with the format workers
+    QCoreApplication* app = QCoreApplication::instance();
+    if (!app || QThread::currentThread() != app->thread())
+        return;
+
+    HookStats* stats = instance();
+    counter = stats->d.scopes.value(name);
+    if (!counter) {
+        counter = stats->counter(QString::fromLatin1(name));
+        stats->d.scopes.insert(name, counter);
+    }
+    InputLatency::note(name);
+    timer.start();
+}
+
+HookStats::Scope::~Scope()
+{
+    if (counter)
+        counter->add(timer.nsecsElapsed());
+}
+
+HookStats::HookStats(QObject* parent) : QObject(parent)
+{
+}
+
+HookStats::~HookStats()
+{
+    // COMMUNI_STATS=<file> leaves the numbers of a run behind for comparison
+    const QString filePath = QString::fromLocal8Bit(qgetenv("COMMUNI_STATS"));
+    if (!filePath.isEmpty())
+        writeCsv(filePath);
+    qDeleteAll(d.counters);
+}
+
+HookStats* HookStats::instance()
+{
+    static QPointer<HookStats> stats;
+    if (!stats)
+        stats = new HookStats(QCoreApplication::instance());
+    return stats;
+}
+
+HookStats::Counter* HookStats::counter(const QString& name)
+{
+    Counter* counter = d.counters.value(name);
+    if (!counter) {
+        counter = new Counter;
+        counter->name = name;
+        d.counters.insert(name, counter);
+    }
+    return counter;
+}
+
+// sizes of plugin state, such as caches, listed along with the timings
+void HookStats::setCount(const QString& name, int count)
+{
+    d.counts.insert(name, count);
+}
+
+static bool totalGreaterThan(const HookStats::Counter* one, const HookStats::Counter* another)
+{
+    return one->nsecs > another->nsecs;
+}
+
+QStringList HookStats::report() const
+{
+    QList<Counter*> counters = d.counters.values();
+    std::sort(counters.begin(), counters.end(), totalGreaterThan);
+
+    QStringList lines;
+    foreach (const Counter* counter, counters) {
+        if (!counter->calls)
+            continue;
+        lines += tr("%1: %2 calls, %3 ms total, %4 us avg, %5 us p99").arg(counter->name)
+                                                                      .arg(counter->calls)
+                                                                      .arg(counter->nsecs / 1000000.0, 0, 'f', 1)
+                                                                      .arg(counter->nsecs / counter->calls / 1000)
+                                                                      .arg(counter->percentile(99) / 1000);
+    }
+    QMap<QString, int>::const_iterator it;
+    for (it = d.counts.constBegin(); it != d.counts.constEnd(); ++it)
+        lines += tr("%1: %2 entries").arg(it.key()).arg(it.value());
+    return lines;
+}
+
+bool HookStats::writeCsv(const QString& filePath) const
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+
+    QByteArray data("name,calls,total_ns,avg_ns,p50_ns,p99_ns\n");
+    QMap<QString, Counter*> counters;
+    foreach (Counter* counter, d.counters)
+        counters.insert(counter->name, counter);
+    foreach (const Counter* counter, counters) {
+        if (!counter->calls)
+            continue;
+        data += counter->name.toUtf8() + ',' + QByteArray::number(counter->calls)
+                + ',' + QByteArray::number(counter->nsecs)
+                + ',' + QByteArray::number(counter->nsecs / counter->calls)
+                + ',' + QByteArray::number(counter->percentile(50))
+                + ',' + QByteArray::number(counter->percentile(99)) + '\n';
+    }
+    QMap<QString, int>::const_iterator it;
+    for (it = d.counts.constBegin(); it != d.counts.constEnd(); ++it)
+        data += it.key().toUtf8() + ',' + QByteArray::number(it.value()) + ",,,,\n";
+
+    // allocations and bytes per message with CONFIG+=allocs
+    const qint64 messages = qMax(Q_INT64_C(1), AllocStats::messages());
+    for (int i = 0; AllocStats::isEnabled() && i < AllocStats::StageCount; ++i) {
+        const AllocStats::Stage stage = static_cast<AllocStats::Stage>(i);
+        data += QByteArray("allocs/") + AllocStats::stageName(stage) + ',' + QByteArray::number(AllocStats::allocations(stage) / messages) + ",,,,\n";
+        data += QByteArray("bytes/") + AllocStats::stageName(stage) + ',' + QByteArray::number(AllocStats::bytes(stage) / messages) + ",,,,\n";
+    }
+    return file.write(data) == data.size();
+}
+
+void HookStats::reset()
+{
+    foreach (Counter* counter, d.counters) {
+        counter->calls = 0;
+        counter->nsecs = 0;
+        counter->next = 0;
+        counter->samples.clear();
+    }
+}
+
+static QString filterName(QObject* filter, const char* hook)
+{
+    return QString::fromLatin1(filter->metaObject()->className()) + "::" + hook;
+}
+
+void HookStats::installMessageFilter(IrcConnection* connection, QObject* filter)
+{
+    HookFilter* hook = HookFilter::find(connection, filter);
+    if (!hook)
+        hook = new HookFilter(filter, connection);
+    if (!hook->messages) {
+        hook->messages = qobject_cast<IrcMessageFilter*>(filter);
+        hook->messageCounter = instance()->counter(filterName(filter, "messageFilter"));
+        connection->installMessageFilter(hook);
+    }
+}
+
+void HookStats::removeMessageFilter(IrcConnection* connection, QObject* filter)
+{
+    HookFilter* hook = HookFilter::find(connection, filter);
+    if (hook && hook->messages) {
+        connection->removeMessageFilter(hook);
+        hook->messages = 0;
+        hook->release();
+    }
+}
+
+void HookStats::installCommandFilter(IrcConnection* connection, QObject* filter)
+{
+    HookFilter* hook = HookFilter::find(connection, filter);
+    if (!hook)
+        hook = new HookFilter(filter, connection);
+    if (!hook->commands) {
+        hook->commands = qobject_cast<IrcCommandFilter*>(filter);
+        hook->commandCounter = instance()->counter(filterName(filter, "commandFilter"));
+        connection->installCommandFilter(hook);
+    }
+}
+
+void HookStats::removeCommandFilter(IrcConnection* connection, QObject* filter)
+{
+    HookFilter* hook = HookFilter::find(connection, filter);
+    if (hook && hook->commands) {
+        connection->removeCommandFilter(hook);
+        hook->commands = 0;
+        hook->release();
+    }
+}
+
+#include "hookstats.moc"
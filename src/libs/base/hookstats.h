@@ -0,0 +1,98 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef HOOKSTATS_H
+#define HOOKSTATS_H
+
+#include <QMap>
+#include <QHash>
+#include <QObject>
+#include <QVector>
+#include <QStringList>
+#include <QElapsedTimer>
+#include "baseglobal.h"
+
+class IrcConnection;
+
+class BASE_EXPORT HookStats : public QObject
+{
+    Q_OBJECT
+
+public:
+    static HookStats* instance();
+
+    struct BASE_EXPORT Counter
+    {
+        Counter() : calls(0), nsecs(0), next(0) { }
+        void add(qint64 elapsed);
+        qint64 percentile(int percent) const;
+
+        QString name;
+        qint64 calls;
+        qint64 nsecs;
+        int next;
+        QVector<qint64> samples;
+    };
+
+    // times the enclosing block on the gui thread, names are static literals
+    class BASE_EXPORT Scope
+    {
+    public:
+        explicit Scope(const char* name);
+        ~Scope();
+
+    private:
+        Counter* counter;
+        QElapsedTimer timer;
+    };
+
+    Counter* counter(const QString& name);
+    void setCount(const QString& name, int count);
+    QStringList report() const;
+    bool writeCsv(const QString& filePath) const;
+
+    static void installMessageFilter(IrcConnection* connection, QObject* filter);
+    static void removeMessageFilter(IrcConnection* connection, QObject* filter);
+    static void installCommandFilter(IrcConnection* connection, QObject* filter);
+    static void removeCommandFilter(IrcConnection* connection, QObject* filter);
+
+public slots:
+    void reset();
+
+private:
+    HookStats(QObject* parent = 0);
+    ~HookStats();
+
+    struct Private {
+        QHash<QString, Counter*> counters;
+        QHash<const char*, Counter*> scopes;
+        QMap<QString, int> counts;
+    } d;
+};
+
+#endif // HOOKSTATS_H
@@ -0,0 +1,136 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "inputlatency.h"
+#include "hookstats.h"
+#include <QCoreApplication>
+#include <QElapsedTimer>
+
+// upper bounds in milliseconds, the last bucket takes the rest
+static const int Buckets[] = { 2, 4, 8, 16, 33, 50, 100, 250, 1000 };
+static const int BucketCount = sizeof(Buckets) / sizeof(Buckets[0]) + 1;
+
+static const int MaxNotes = 32;
+
+struct LatencyState
+{
+    LatencyState() : pending(false), threshold(-1), notes(0)
+    {
+        timer.start();
+        bool ok = false;
+        const int ms = qgetenv("COMMUNI_INPUT_TRACE").toInt(&ok);
+        if (ok)
+            threshold = ms;
+        for (int i = 0; i < BucketCount; ++i)
+            counts[i] = 0;
+    }
+
+    bool pending;
+    int threshold;
+    qint64 pressed;
+    QElapsedTimer timer;
+    int counts[BucketCount];
+    int notes;
+    const char* names[MaxNotes];
+};
+
+Q_GLOBAL_STATIC(LatencyState, state)
+
+void InputLatency::keyPressed()
+{
+    // the buddy forwarding path reports the same press twice, the first counts
+    LatencyState* s = state();
+    if (!s->pending) {
+        s->pending = true;
+        s->pressed = s->timer.nsecsElapsed();
+        s->notes = 0;
+    }
+}
+
+void InputLatency::painted()
+{
+    LatencyState* s = state();
+    if (!s->pending)
+        return;
+
+    s->pending = false;
+    const qint64 elapsed = s->timer.nsecsElapsed() - s->pressed;
+    HookStats::instance()->counter(QStringLiteral("TextInput::latency"))->add(elapsed);
+
+    const qint64 ms = elapsed / 1000000;
+    int bucket = 0;
+    while (bucket < BucketCount - 1 && ms >= Buckets[bucket])
+        ++bucket;
+    ++s->counts[bucket];
+
+    if (s->threshold >= 0 && ms >= s->threshold) {
+        QStringList names;
+        for (int i = 0; i < qMin(s->notes, MaxNotes); ++i)
+            names += QString::fromLatin1(s->names[i]);
+        if (s->notes > MaxNotes)
+            names += QString("+%1").arg(s->notes - MaxNotes);
+        qWarning("Key press took %lld ms to paint, %s", ms, qPrintable(names.join(", ")));
+    }
+}
+
+void InputLatency::note(const char* name)
+{
+    LatencyState* s = state();
+    if (s->pending && s->threshold >= 0) {
+        if (s->notes < MaxNotes)
+            s->names[s->notes] = name;
+        ++s->notes;
+    }
+}
+
+QStringList InputLatency::report()
+{
+    LatencyState* s = state();
+    const HookStats::Counter* counter = HookStats::instance()->counter(QStringLiteral("TextInput::latency"));
+
+    QStringList lines;
+    if (!counter->calls) {
+        lines += QCoreApplication::translate("InputLatency", "No key presses recorded.");
+        return lines;
+    }
+    lines += QCoreApplication::translate("InputLatency", "key press to paint: %1 presses, %2 us avg, %3 us p99")
+                .arg(counter->calls).arg(counter->nsecs / counter->calls / 1000).arg(counter->percentile(99) / 1000);
+    for (int i = 0; i < BucketCount; ++i) {
+        const QString range = i < BucketCount - 1 ? QString("< %1 ms").arg(Buckets[i]) : QString(">= %1 ms").arg(Buckets[i - 1]);
+        lines += QCoreApplication::translate("InputLatency", "  %1: %2").arg(range).arg(s->counts[i]);
+    }
+    return lines;
+}
+
+void InputLatency::reset()
+{
+    LatencyState* s = state();
+    s->pending = false;
+    for (int i = 0; i < BucketCount; ++i)
+        s->counts[i] = 0;
+}
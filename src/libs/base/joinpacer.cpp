@@ -0,0 +1,153 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "joinpacer.h"
+#include "sendqueue.h"
+#include "taskscheduler.h"
+#include <IrcConnection>
+#include <IrcCommand>
+#include <QHash>
+
+static const int kMaxTargets = 10;
+static const int kMaxLength = 400;
+
+JoinPacer::JoinPacer(IrcConnection* connection) : QObject(connection)
+{
+    d.connection = connection;
+
+    // installed after the send queue, so that swallowed joins spend no tokens
+    SendQueue::instance(connection);
+    connection->installCommandFilter(this);
+    connect(connection, SIGNAL(disconnected()), this, SLOT(clear()));
+}
+
+JoinPacer* JoinPacer::instance(IrcConnection* connection)
+{
+    if (!connection)
+        return 0;
+
+    JoinPacer* pacer = connection->findChild<JoinPacer*>(QString(), Qt::FindDirectChildrenOnly);
+    if (!pacer)
+        pacer = new JoinPacer(connection);
+    return pacer;
+}
+
+QStringList JoinPacer::priority() const
+{
+    return d.priority;
+}
+
+void JoinPacer::setPriority(const QStringList& channels)
+{
+    d.priority.clear();
+    foreach (const QString& channel, channels)
+        d.priority += channel.toLower();
+    d.priority.removeDuplicates();
+}
+
+int JoinPacer::pending() const
+{
+    return d.joins.count();
+}
+
+bool JoinPacer::commandFilter(IrcCommand* command)
+{
+    // typed joins go out as they are, the rest is gathered for one tick
+    if (command->type() != IrcCommand::Join || command->property("TextInput").toBool() || command->property("JoinPacer").toBool())
+        return false;
+
+    const QStringList channels = command->parameters().value(0).split(",", QString::SkipEmptyParts);
+    const QStringList keys = command->parameters().value(1).split(",");
+    for (int i = 0; i < channels.count(); ++i) {
+        Join join;
+        join.channel = channels.at(i);
+        join.key = keys.value(i);
+        d.joins += join;
+    }
+
+    TaskScheduler::instance()->schedule(TaskScheduler::Pacing, this, "flush");
+    return true;
+}
+
+void JoinPacer::clear()
+{
+    TaskScheduler::instance()->unschedule(this, "flush");
+    d.joins.clear();
+}
+
+void JoinPacer::flush()
+{
+    QList<Join> hidden;
+    QHash<QString, Join> joins;
+    foreach (const Join& join, d.joins) {
+        const QString lower = join.channel.toLower();
+        if (joins.contains(lower))
+            continue;
+        joins.insert(lower, join);
+        if (!d.priority.contains(lower))
+            hidden += join;
+    }
+    d.joins.clear();
+
+    // visible channels jump ahead of the rest, in the order they were given
+    QList<Join> visible;
+    foreach (const QString& channel, d.priority) {
+        if (joins.contains(channel))
+            visible += joins.value(channel);
+    }
+    send(visible, true);
+    send(hidden, false);
+}
+
+void JoinPacer::send(const QList<Join>& joins, bool interactive)
+{
+    int index = 0;
+    while (index < joins.count()) {
+        // keys are positional, so keyed channels lead each line
+        QStringList keyed, keys, plain;
+        int length = 0;
+        while (index < joins.count() && keyed.count() + plain.count() < kMaxTargets) {
+            const Join& join = joins.at(index);
+            const int size = join.channel.length() + join.key.length() + 2;
+            if (length && length + size > kMaxLength)
+                break;
+            if (join.key.isEmpty()) {
+                plain += join.channel;
+            } else {
+                keyed += join.channel;
+                keys += join.key;
+            }
+            length += size;
+            ++index;
+        }
+
+        IrcCommand* command = IrcCommand::createJoin(keyed + plain, keys);
+        command->setProperty("JoinPacer", true);
+        SendQueue::instance(d.connection)->send(command, interactive ? SendQueue::Interactive : SendQueue::Bulk);
+    }
+}
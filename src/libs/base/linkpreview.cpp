@@ -0,0 +1,409 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "linkpreview.h"
+#include "taskscheduler.h"
+#include <QTextDocumentFragment>
+#include <QCryptographicHash>
+#include <QNetworkAccessManager>
+#include <QNetworkRequest>
+#include <QNetworkReply>
+#include <QCoreApplication>
+#include <QStandardPaths>
+#include <QImageReader>
+#include <QDataStream>
+#include <QRunnable>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QBuffer>
+#include <QRegExp>
+#include <QFile>
+#include <QDir>
+
+static bool previewsEnabled = false;
+
+// no host gets more than two at a time, and all of them share the bandwidth
+static const int MaxPerHost = 2;
+static const int MaxActive = 6;
+static const int BytesPerSecond = 256 * 1024;
+static const int ReadChunk = 16 * 1024;
+static const int PumpInterval = 100;
+// pages are only read up to their head, images up to a sane size
+static const int MaxPageBytes = 256 * 1024;
+static const int MaxImageBytes = 4 * 1024 * 1024;
+static const int ThumbnailWidth = 160;
+static const int ThumbnailHeight = 120;
+static const int ExpiryDays = 7;
+
+struct PreviewResult
+{
+    PreviewResult() : done(false) { }
+
+    QString url;
+    bool done;
+    QString title;
+    QString image;
+    QString imageUrl;
+    QImage thumbnail;
+};
+
+static QString hashOf(const QByteArray& data)
+{
+    return QString::fromLatin1(QCryptographicHash::hash(data, QCryptographicHash::Sha1).toHex());
+}
+
+class PreviewTask : public QRunnable
+{
+public:
+    enum Kind { Lookup, Parse, Decode };
+
+    PreviewTask(LinkPreview* preview, Kind kind, const QString& url)
+        : preview(preview), kind(kind), cachePath(preview->d.cachePath), url(url) { }
+
+    void run()
+    {
+        PreviewResult* result = new PreviewResult;
+        result->url = url;
+        switch (kind) {
+        case Lookup: lookup(result); break;
+        case Parse: parse(result); break;
+        case Decode: decode(result); break;
+        }
+        if (result->done && kind != Lookup)
+            store(result);
+        preview->post(result);
+    }
+
+    LinkPreview* preview;
+    Kind kind;
+    QString cachePath;
+    QString url;
+    QString title;
+    QByteArray body;
+
+private:
+    QString entryPath() const
+    {
+        return cachePath + "/" + hashOf(url.toUtf8()) + ".entry";
+    }
+
+    void lookup(PreviewResult* result)
+    {
+        // entries expire, the thumbnails they point to are shared by content
+        QFile file(entryPath());
+        if (QFileInfo(file).lastModified().daysTo(QDateTime::currentDateTime()) >= ExpiryDays || !file.open(QIODevice::ReadOnly))
+            return;
+        QDataStream in(&file);
+        in >> result->title >> result->image;
+        result->done = in.status() == QDataStream::Ok;
+        if (result->done && !result->image.isEmpty())
+            result->thumbnail = QImage(cachePath + "/" + result->image + ".png");
+    }
+
+    void parse(PreviewResult* result)
+    {
+        const QString html = QString::fromUtf8(body);
+        QRegExp ogTitle("<meta[^>]+property=[\"']og:title[\"'][^>]+content=[\"']([^\"']*)[\"']", Qt::CaseInsensitive);
+        QRegExp ogImage("<meta[^>]+property=[\"']og:image[\"'][^>]+content=[\"']([^\"']*)[\"']", Qt::CaseInsensitive);
+        QRegExp plainTitle("<title[^>]*>([^<]*)</title>", Qt::CaseInsensitive);
+
+        QString text;
+        if (ogTitle.indexIn(html) != -1)
+            text = ogTitle.cap(1);
+        else if (plainTitle.indexIn(html) != -1)
+            text = plainTitle.cap(1);
+        result->title = QTextDocumentFragment::fromHtml(text).toPlainText().simplified().left(200);
+
+        if (ogImage.indexIn(html) != -1) {
+            const QUrl image = QUrl(url).resolved(QUrl(QTextDocumentFragment::fromHtml(ogImage.cap(1)).toPlainText()));
+            if (image.scheme() == "http" || image.scheme() == "https")
+                result->imageUrl = image.toString();
+        }
+        result->done = result->imageUrl.isEmpty();
+    }
+
+    void decode(PreviewResult* result)
+    {
+        result->title = title;
+        result->done = true;
+
+        QBuffer buffer(&body);
+        buffer.open(QIODevice::ReadOnly);
+        QImageReader reader(&buffer);
+        QSize size = reader.size();
+        if (size.isValid()) {
+            size.scale(qMin(size.width(), ThumbnailWidth), qMin(size.height(), ThumbnailHeight), Qt::KeepAspectRatio);
+            reader.setScaledSize(size);
+        }
+        const QImage image = reader.read();
+        if (image.isNull())
+            return;
+
+        result->image = hashOf(body);
+        result->thumbnail = image;
+        const QString filePath = cachePath + "/" + result->image + ".png";
+        if (!QFile::exists(filePath))
+            image.save(filePath, "PNG");
+    }
+
+    void store(PreviewResult* result)
+    {
+        QFile file(entryPath());
+        if (file.open(QIODevice::WriteOnly)) {
+            QDataStream out(&file);
+            out << result->title << result->image;
+        }
+    }
+};
+
+LinkPreview::LinkPreview(QObject* parent) : QObject(parent)
+{
+    d.active = 0;
+    d.budget = BytesPerSecond;
+    d.network = new QNetworkAccessManager(this);
+    d.thumbnails.setMaxCost(64);
+    d.pool.setMaxThreadCount(1);
+    d.cachePath = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/previews";
+    QDir().mkpath(d.cachePath);
+}
+
+LinkPreview::~LinkPreview()
+{
+    d.pool.waitForDone();
+    qDeleteAll(d.results);
+}
+
+LinkPreview* LinkPreview::instance()
+{
+    static QPointer<LinkPreview> preview;
+    if (!preview)
+        preview = new LinkPreview(QCoreApplication::instance());
+    return preview;
+}
+
+bool LinkPreview::isEnabled()
+{
+    return previewsEnabled;
+}
+
+void LinkPreview::setEnabled(bool enabled)
+{
+    previewsEnabled = enabled;
+}
+
+LinkPreview::Preview LinkPreview::preview(const QString& url) const
+{
+    return d.previews.value(url);
+}
+
+QImage LinkPreview::thumbnail(const QString& image) const
+{
+    QImage* cached = d.thumbnails.object(image);
+    if (cached)
+        return *cached;
+
+    const QImage thumbnail(d.cachePath + "/" + image + ".png");
+    if (!thumbnail.isNull())
+        d.thumbnails.insert(image, new QImage(thumbnail));
+    return thumbnail;
+}
+
+void LinkPreview::fetch(const QString& url)
+{
+    if (!previewsEnabled || d.requested.contains(url))
+        return;
+
+    // the disk cache is asked first, off the GUI thread like the rest
+    d.requested.insert(url);
+    d.pool.start(new PreviewTask(this, PreviewTask::Lookup, url));
+}
+
+QString LinkPreview::firstUrl(const QString& html)
+{
+    QRegExp rx("href=[\"'](https?://[^\"']+)[\"']", Qt::CaseInsensitive);
+    if (rx.indexIn(html) == -1)
+        return QString();
+    return QTextDocumentFragment::fromHtml(rx.cap(1)).toPlainText();
+}
+
+void LinkPreview::pump()
+{
+    // the budget refills with time and is spent by whatever reads next
+    if (d.refill.isValid())
+        d.budget = qMin<qint64>(BytesPerSecond, d.budget + d.refill.restart() * BytesPerSecond / 1000);
+    else
+        d.refill.start();
+
+    bool throttled = false;
+    foreach (QNetworkReply* reply, d.bodies.keys()) {
+        // an abort finishes the reply right away, which takes it off the list
+        if (d.bodies.contains(reply) && !receive(reply))
+            throttled = true;
+    }
+
+    int i = 0;
+    while (d.active < MaxActive && i < d.queue.count()) {
+        const QString host = QUrl(d.queue.at(i).url).host();
+        if (d.hosts.value(host) >= MaxPerHost) {
+            ++i;
+            continue;
+        }
+        const Job job = d.queue.takeAt(i);
+        request(job.url, job.page);
+    }
+
+    if (throttled || (!d.queue.isEmpty() && d.active < MaxActive))
+        TaskScheduler::instance()->schedule(TaskScheduler::Pacing, this, "pump", PumpInterval);
+}
+
+void LinkPreview::deliver()
+{
+    QList<PreviewResult*> results;
+    {
+        QMutexLocker locker(&d.mutex);
+        results.swap(d.results);
+    }
+
+    foreach (PreviewResult* result, results) {
+        if (result->done) {
+            if (!result->thumbnail.isNull())
+                d.thumbnails.insert(result->image, new QImage(result->thumbnail));
+            complete(result->url, result->title, result->image);
+        } else if (!result->imageUrl.isEmpty()) {
+            // the page named an image, which is fetched next for the thumbnail
+            d.previews[result->url].title = result->title;
+            Job job = { result->imageUrl, result->url };
+            d.queue += job;
+        } else {
+            Job job = { result->url, QString() };
+            d.queue += job;
+        }
+        delete result;
+    }
+    pump();
+}
+
+void LinkPreview::onReadyRead()
+{
+    QNetworkReply* reply = qobject_cast<QNetworkReply*>(sender());
+    if (reply && d.bodies.contains(reply) && !receive(reply))
+        TaskScheduler::instance()->schedule(TaskScheduler::Pacing, this, "pump", PumpInterval);
+}
+
+void LinkPreview::onFinished()
+{
+    QNetworkReply* reply = qobject_cast<QNetworkReply*>(sender());
+    if (!reply || !d.bodies.contains(reply))
+        return;
+
+    // whatever is still buffered counts against the next refill
+    const QByteArray rest = reply->readAll();
+    d.budget -= rest.size();
+    const QByteArray body = d.bodies.take(reply) + rest;
+    const QString host = reply->request().url().host();
+    if (--d.hosts[host] <= 0)
+        d.hosts.remove(host);
+    --d.active;
+
+    const QString page = reply->property("page").toString();
+    const QString url = page.isEmpty() ? reply->request().url().toString() : page;
+    const QString type = reply->header(QNetworkRequest::ContentTypeHeader).toString();
+    reply->deleteLater();
+
+    if (body.isEmpty()) {
+        complete(url, d.previews.value(url).title, QString());
+    } else if (type.startsWith("image/")) {
+        PreviewTask* task = new PreviewTask(this, PreviewTask::Decode, url);
+        task->title = d.previews.value(url).title;
+        task->body = body;
+        d.pool.start(task);
+    } else if (page.isEmpty() && type.contains("html")) {
+        PreviewTask* task = new PreviewTask(this, PreviewTask::Parse, url);
+        task->body = body;
+        d.pool.start(task);
+    } else {
+        complete(url, d.previews.value(url).title, QString());
+    }
+    pump();
+}
+
+void LinkPreview::post(PreviewResult* result)
+{
+    QMutexLocker locker(&d.mutex);
+    const bool wake = d.results.isEmpty();
+    d.results += result;
+    if (wake)
+        QMetaObject::invokeMethod(this, "deliver", Qt::QueuedConnection);
+}
+
+void LinkPreview::request(const QString& url, const QString& page)
+{
+    QNetworkRequest request((QUrl(url)));
+#if QT_VERSION >= 0x050600
+    request.setAttribute(QNetworkRequest::FollowRedirectsAttribute, true);
+#endif
+    QNetworkReply* reply = d.network->get(request);
+    // a small read buffer makes the socket wait for the budget
+    reply->setReadBufferSize(ReadChunk);
+    reply->setProperty("page", page);
+    connect(reply, SIGNAL(readyRead()), this, SLOT(onReadyRead()));
+    connect(reply, SIGNAL(finished()), this, SLOT(onFinished()));
+
+    d.bodies.insert(reply, QByteArray());
+    ++d.hosts[QUrl(url).host()];
+    ++d.active;
+}
+
+bool LinkPreview::receive(QNetworkReply* reply)
+{
+    QByteArray& body = d.bodies[reply];
+    while (d.budget > 0 && reply->bytesAvailable() > 0) {
+        const QByteArray chunk = reply->read(qMin<qint64>(d.budget, ReadChunk));
+        d.budget -= chunk.size();
+        body += chunk;
+    }
+
+    // the head of a page is all that is needed, oversized images are dropped
+    const bool image = reply->header(QNetworkRequest::ContentTypeHeader).toString().startsWith("image/");
+    if ((!image && (body.size() > MaxPageBytes || body.contains("</head>"))) || (image && body.size() > MaxImageBytes)) {
+        if (image)
+            body.clear();
+        reply->abort();
+        return true;
+    }
+    return reply->bytesAvailable() == 0;
+}
+
+void LinkPreview::complete(const QString& url, const QString& title, const QString& image)
+{
+    Preview& preview = d.previews[url];
+    preview.ready = true;
+    preview.title = title;
+    preview.image = image;
+    emit previewReady(url);
+}
@@ -0,0 +1,115 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef LINKPREVIEW_H
+#define LINKPREVIEW_H
+
+#include <QSet>
+#include <QHash>
+#include <QList>
+#include <QImage>
+#include <QMutex>
+#include <QCache>
+#include <QObject>
+#include <QPointer>
+#include <QThreadPool>
+#include <QElapsedTimer>
+#include "baseglobal.h"
+
+class QNetworkReply;
+class QNetworkAccessManager;
+struct PreviewResult;
+
+class BASE_EXPORT LinkPreview : public QObject
+{
+    Q_OBJECT
+
+public:
+    static LinkPreview* instance();
+    ~LinkPreview();
+
+    static bool isEnabled();
+    static void setEnabled(bool enabled);
+
+    struct Preview {
+        Preview() : ready(false) { }
+        bool ready;
+        QString title;
+        QString image;
+    };
+
+    Preview preview(const QString& url) const;
+    QImage thumbnail(const QString& image) const;
+
+    void fetch(const QString& url);
+
+    static QString firstUrl(const QString& html);
+
+signals:
+    void previewReady(const QString& url);
+
+private slots:
+    void pump();
+    void deliver();
+    void onReadyRead();
+    void onFinished();
+
+private:
+    LinkPreview(QObject* parent = 0);
+
+    void post(PreviewResult* result);
+    void request(const QString& url, const QString& page);
+    bool receive(QNetworkReply* reply);
+    void complete(const QString& url, const QString& title, const QString& image);
+
+    friend class PreviewTask;
+
+    struct Job {
+        QString url;
+        QString page;
+    };
+
+    struct Private {
+        QString cachePath;
+        QNetworkAccessManager* network;
+        QThreadPool pool;
+        QList<Job> queue;
+        QHash<QString, int> hosts;
+        QHash<QNetworkReply*, QByteArray> bodies;
+        int active;
+        qint64 budget;
+        QElapsedTimer refill;
+        QHash<QString, Preview> previews;
+        QSet<QString> requested;
+        mutable QCache<QString, QImage> thumbnails;
+        QMutex mutex;
+        QList<PreviewResult*> results;
+    } d;
+};
+
+#endif // LINKPREVIEW_H
@@ -27,9 +27,11 @@
 */
 
 #include "listview.h"
+#include "userindex.h"
+#include "hookstats.h"
 #include <QStyledItemDelegate>
 #include <QContextMenuEvent>
-#include <IrcUserModel>
+#include <QResizeEvent>
 #include <QFontMetrics>
 #include <QScrollBar>
 #include <IrcCommand>
@@ -55,6 +57,12 @@ public:
 
 ListView::ListView(QWidget* parent) : QListView(parent)
 {
+    // all rows have the same height, lay them out in batches so that
+    // a big NAMES reply does not freeze the event loop
+    setUniformItemSizes(true);
+    setLayoutMode(Batched);
+    setBatchSize(500);
+
     setFocusPolicy(Qt::NoFocus);
     setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
 #ifdef Q_OS_MAC
@@ -62,8 +70,7 @@ ListView::ListView(QWidget* parent) : QListView(parent)
 #endif
     setItemDelegate(new ListDelegate(this));
 
-    d.model = new IrcUserModel(this);
-    d.model->setSortMethod(Irc::SortByTitle);
+    d.model = new UserView(Irc::SortByTitle, this);
     setModel(d.model);
 
     connect(this, SIGNAL(doubleClicked(QModelIndex)), this, SLOT(onDoubleClicked(QModelIndex)));
@@ -71,23 +78,52 @@ ListView::ListView(QWidget* parent) : QListView(parent)
 
 IrcChannel* ListView::channel() const
 {
-    return d.model->channel();
+    return d.channel;
 }
 
 void ListView::setChannel(IrcChannel* channel)
 {
-    if (d.model->channel() != channel) {
-        d.model->setChannel(channel);
+    if (d.channel != channel) {
+        d.channel = channel;
+        populate();
         emit channelChanged(channel);
     }
 }
 
+void ListView::populate()
+{
+    // the model is only filled while the pane can be seen, a hidden or
+    // collapsed pane does not pay for keeping thousands of users sorted
+    IrcChannel* channel = isVisible() && width() > 0 ? d.channel : 0;
+    if (d.model->channel() != channel)
+        d.model->setChannel(channel);
+}
+
 QSize ListView::sizeHint() const
 {
     const int w = 16 * fontMetrics().horizontalAdvance('#') + verticalScrollBar()->sizeHint().width();
     return QSize(w, QListView::sizeHint().height());
 }
 
+void ListView::showEvent(QShowEvent* event)
+{
+    QListView::showEvent(event);
+    populate();
+}
+
+void ListView::resizeEvent(QResizeEvent* event)
+{
+    QListView::resizeEvent(event);
+    if ((event->size().width() > 0) != (event->oldSize().width() > 0))
+        populate();
+}
+
+void ListView::paintEvent(QPaintEvent* event)
+{
+    HookStats::Scope scope("ListView::paint");
+    QListView::paintEvent(event);
+}
+
 void ListView::contextMenuEvent(QContextMenuEvent* event)
 {
     QModelIndex index = indexAt(event->pos());
@@ -29,11 +29,12 @@
 #ifndef LISTVIEW_H
 #define LISTVIEW_H
 
+#include <QPointer>
 #include <QListView>
 #include "baseglobal.h"
 
 class IrcChannel;
-class IrcUserModel;
+class UserView;
 
 class BASE_EXPORT ListView : public QListView
 {
@@ -54,6 +55,9 @@ signals:
 
 protected:
     QSize sizeHint() const;
+    void showEvent(QShowEvent* event);
+    void resizeEvent(QResizeEvent* event);
+    void paintEvent(QPaintEvent* event);
     void contextMenuEvent(QContextMenuEvent* event);
 
 private slots:
@@ -67,9 +71,11 @@ private slots:
 
 private:
     QMenu* createContextMenu(const QModelIndex& index);
+    void populate();
 
     struct Private {
-        IrcUserModel* model;
+        QPointer<IrcChannel> channel;
+        UserView* model;
     } d;
 };
 
@@ -0,0 +1,233 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "memorybudget.h"
+#include "textdocument.h"
+#include <QCoreApplication>
+#include <QTimerEvent>
+#include <QPixmapCache>
+#include "userindex.h"
+#include <IrcBufferModel>
+#include <IrcConnection>
+#include <IrcUserModel>
+#include <IrcChannel>
+#include <IrcBuffer>
+#include <IrcUser>
+#include <algorithm>
+
+// hibernated documents are shrunk down to this many rows at most
+static const int minimumRows = 100;
+// an IrcUser with its private data and the model's bookkeeping
+static const int userSize = 256;
+// the system keeps warning while memory stays low, once in a while is enough
+static const int relieveInterval = 30000;
+
+struct IdleLessThan
+{
+    bool operator()(TextDocument* one, TextDocument* another) const
+    {
+        return one->idleTime() > another->idleTime();
+    }
+};
+
+MemoryBudget::MemoryBudget(QObject* parent) : QObject(parent)
+{
+    d.timer = 0;
+    d.interval = 30000;
+    d.budget = Q_INT64_C(512) * 1024 * 1024;
+    d.total = 0;
+}
+
+MemoryBudget* MemoryBudget::instance()
+{
+    static QPointer<MemoryBudget> budget;
+    if (!budget)
+        budget = new MemoryBudget(QCoreApplication::instance());
+    return budget;
+}
+
+qint64 MemoryBudget::budget() const
+{
+    return d.budget;
+}
+
+void MemoryBudget::setBudget(qint64 bytes)
+{
+    if (d.budget != bytes) {
+        d.budget = qMax(Q_INT64_C(0), bytes);
+        enforce();
+    }
+}
+
+int MemoryBudget::interval() const
+{
+    return d.interval;
+}
+
+void MemoryBudget::setInterval(int msecs)
+{
+    d.interval = qMax(1000, msecs);
+    if (d.timer) {
+        killTimer(d.timer);
+        d.timer = startTimer(d.interval);
+    }
+}
+
+qint64 MemoryBudget::totalUsage() const
+{
+    return d.total;
+}
+
+QHash<TextDocument*, qint64> MemoryBudget::usage() const
+{
+    return d.usage;
+}
+
+// channel members as the user models hold them, not part of the budget
+qint64 MemoryBudget::userUsage(IrcConnection* connection, int* count)
+{
+    qint64 bytes = 0;
+    int users = 0;
+    IrcBufferModel* model = connection ? connection->findChild<IrcBufferModel*>() : 0;
+    if (model) {
+        foreach (IrcChannel* channel, model->channels()) {
+            // the shared index when something created it, a throwaway model otherwise
+            UserIndex* index = channel->findChild<UserIndex*>(QString(), Qt::FindDirectChildrenOnly);
+            IrcUserModel scratch;
+            IrcUserModel* userModel = index ? index->model() : &scratch;
+            if (!index)
+                scratch.setChannel(channel);
+            foreach (IrcUser* user, userModel->users())
+                bytes += userSize + 2 * (user->name().size() + user->prefix().size() + user->mode().size());
+            users += userModel->count();
+        }
+    }
+    if (count)
+        *count = users;
+    return bytes;
+}
+
+void MemoryBudget::add(TextDocument* document)
+{
+    if (document && !d.documents.contains(document)) {
+        d.documents += document;
+        if (!d.timer)
+            d.timer = startTimer(d.interval);
+    }
+}
+
+void MemoryBudget::remove(TextDocument* document)
+{
+    d.documents.removeAll(document);
+    d.usage.remove(document);
+}
+
+void MemoryBudget::enforce()
+{
+    QList<TextDocument*> candidates;
+    QList<TextDocument*> protect;
+
+    d.usage.clear();
+    d.total = 0;
+    QList<QPointer<TextDocument> >::iterator it = d.documents.begin();
+    while (it != d.documents.end()) {
+        TextDocument* doc = *it;
+        if (!doc) {
+            it = d.documents.erase(it);
+            continue;
+        }
+        const qint64 bytes = doc->footprint();
+        d.usage.insert(doc, bytes);
+        d.total += bytes;
+        if (!doc->isVisible() && !doc->isClone())
+            (isProtected(doc) ? protect : candidates) += doc;
+        ++it;
+    }
+
+    if (d.budget > 0 && d.total > d.budget) {
+        // the least recently viewed go first, private and highlighted ones last
+        std::sort(candidates.begin(), candidates.end(), IdleLessThan());
+        std::sort(protect.begin(), protect.end(), IdleLessThan());
+        candidates += protect;
+
+        // dropping the layout is cheap to undo, so try that everywhere first
+        for (int pass = 0; pass < 2 && d.total > d.budget; ++pass) {
+            foreach (TextDocument* doc, candidates) {
+                if (d.total <= d.budget)
+                    break;
+                if (pass == 0)
+                    doc->hibernate();
+                else
+                    doc->shrink(minimumRows);
+                const qint64 bytes = doc->footprint();
+                d.total -= d.usage.value(doc) - bytes;
+                d.usage.insert(doc, bytes);
+            }
+        }
+    }
+
+    emit usageChanged(d.total);
+}
+
+void MemoryBudget::relieve()
+{
+    // the system is low on memory, whatever the budget says: hidden documents
+    // go to sleep with their scrollback spilled, visible ones drop what can be rebuilt
+    if (d.relieved.isValid() && d.relieved.elapsed() < relieveInterval)
+        return;
+    d.relieved.start();
+
+    foreach (TextDocument* doc, d.documents) {
+        if (!doc)
+            continue;
+        if (!doc->isVisible() && !doc->isClone()) {
+            doc->hibernate();
+            doc->shrink(minimumRows);
+        } else {
+            doc->releaseHistory();
+            doc->releaseCaches();
+        }
+    }
+    QPixmapCache::clear();
+    enforce();
+}
+
+void MemoryBudget::timerEvent(QTimerEvent* event)
+{
+    if (event->timerId() == d.timer)
+        enforce();
+    else
+        QObject::timerEvent(event);
+}
+
+bool MemoryBudget::isProtected(TextDocument* document)
+{
+    IrcBuffer* buffer = document->buffer();
+    const bool query = buffer && !buffer->isChannel() && !buffer->isSticky();
+    return query || document->unreadHighlights() > 0;
+}
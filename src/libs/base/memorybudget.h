@@ -0,0 +1,88 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef MEMORYBUDGET_H
+#define MEMORYBUDGET_H
+
+#include <QHash>
+#include <QObject>
+#include <QPointer>
+#include <QElapsedTimer>
+#include "baseglobal.h"
+
+class TextDocument;
+class IrcConnection;
+
+class BASE_EXPORT MemoryBudget : public QObject
+{
+    Q_OBJECT
+
+public:
+    static MemoryBudget* instance();
+
+    qint64 budget() const;
+    void setBudget(qint64 bytes);
+
+    int interval() const;
+    void setInterval(int msecs);
+
+    qint64 totalUsage() const;
+    QHash<TextDocument*, qint64> usage() const;
+
+    static qint64 userUsage(IrcConnection* connection, int* count = 0);
+
+    void add(TextDocument* document);
+    void remove(TextDocument* document);
+
+public slots:
+    void enforce();
+    void relieve();
+
+signals:
+    void usageChanged(qint64 bytes);
+
+protected:
+    void timerEvent(QTimerEvent* event);
+
+private:
+    MemoryBudget(QObject* parent = 0);
+
+    static bool isProtected(TextDocument* document);
+
+    struct Private {
+        int timer;
+        int interval;
+        qint64 budget;
+        qint64 total;
+        QElapsedTimer relieved;
+        QHash<TextDocument*, qint64> usage;
+        QList<QPointer<TextDocument> > documents;
+    } d;
+};
+
+#endif // MEMORYBUDGET_H
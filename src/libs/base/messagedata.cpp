@@ -27,124 +27,350 @@
 */
 
 #include "messagedata.h"
+#include "stringpool.h"
+#include "hookstats.h"
+#include "allocstats.h"
+#include <QStringMatcher>
+#include <QVector>
+#include <QHash>
 
-MessageData::MessageData()
+// merged events share one growing group, so that merging another event
+// and summarizing the group do not need to copy or walk the whole list
+struct MessageEvents
 {
-    d.own = false;
-    d.error = false;
-    d.reply = false;
-    d.type = IrcMessage::Unknown;
+    void add(const MessageData& event)
+    {
+        const int kind = event.type() == IrcMessage::Quit && event.isError() ? int(IrcMessage::Error) : int(event.type());
+        if (!kinds.contains(kind))
+            kinds += kind;
+        nicks.insert(event.nick());
+        events += event;
+    }
+
+    QList<int> kinds;
+    QSet<QString> nicks;
+    QList<MessageData> events;
+};
+
+// msecs of messages without a timestamp, such as date markers
+static const qint64 InvalidMSecs = Q_INT64_C(-0x7fffffffffffffff);
+
+// only touched by the gui thread
+static MessageData::RawPolicy currentRawPolicy = MessageData::KeepAllRaw;
+static qint64 releasedRawBytes = 0;
+
+MessageData::MessageData() : d(new Private)
+{
+    d->msecs = InvalidMSecs;
 }
 
-IrcMessage::Type MessageData::effectiveType(const IrcMessage* msg)
+struct MessageClassifier
 {
-    QString intent = msg->tag("intent").toString();
-    if (!intent.isEmpty()) {
-        if (intent == "JOIN")
-            return IrcMessage::Join;
-        if (intent == "PART")
-            return IrcMessage::Part;
-        if (intent == "QUIT")
-            return IrcMessage::Quit;
-        if (intent == "NICK")
-            return IrcMessage::Nick;
-        if (intent == "MODE")
-            return IrcMessage::Mode;
-        if (intent == "TOPIC")
-            return IrcMessage::Topic;
-        if (intent == "KICK")
-            return IrcMessage::Kick;
+    MessageClassifier() : intent(QStringLiteral("intent"))
+    {
+        intents.insert(QStringLiteral("JOIN"), IrcMessage::Join);
+        intents.insert(QStringLiteral("PART"), IrcMessage::Part);
+        intents.insert(QStringLiteral("QUIT"), IrcMessage::Quit);
+        intents.insert(QStringLiteral("NICK"), IrcMessage::Nick);
+        intents.insert(QStringLiteral("MODE"), IrcMessage::Mode);
+        intents.insert(QStringLiteral("TOPIC"), IrcMessage::Topic);
+        intents.insert(QStringLiteral("KICK"), IrcMessage::Kick);
+
+        errors += QStringMatcher(QStringLiteral("Ping timeout"));
+        errors += QStringMatcher(QStringLiteral("Connection reset by peer"));
+        errors += QStringMatcher(QStringLiteral("Remote host closed the connection"));
+    }
+
+    bool isError(const QString& reason) const
+    {
+        foreach (const QStringMatcher& matcher, errors) {
+            if (matcher.indexIn(reason) != -1)
+                return true;
+        }
+        return false;
     }
-    return msg->type();
+
+    const QString intent;
+    QHash<QString, IrcMessage::Type> intents;
+    QVector<QStringMatcher> errors;
+};
+
+Q_GLOBAL_STATIC(MessageClassifier, classifier)
+
+MessageData::Class MessageData::classify(const IrcMessage* msg)
+{
+    // classified once, the formatter, the document and plugins share the result
+    const QVariant cached = msg->property("class");
+    if (cached.isValid()) {
+        const int value = cached.toInt();
+        Class result = { static_cast<IrcMessage::Type>(value >> 1), bool(value & 1) };
+        return result;
+    }
+
+    COMMUNI_ALLOC_STAGE(Classify);
+    const MessageClassifier* c = classifier();
+    Class result = { msg->type(), false };
+    const QVariantMap tags = msg->tags();
+    if (!tags.isEmpty()) {
+        const QString intent = tags.value(c->intent).toString();
+        if (!intent.isEmpty())
+            result.type = c->intents.value(intent, msg->type());
+    }
+    if (msg->type() == IrcMessage::Quit)
+        result.error = c->isError(static_cast<const IrcQuitMessage*>(msg)->reason());
+
+    const_cast<IrcMessage*>(msg)->setProperty("class", (int(result.type) << 1) | int(result.error));
+    return result;
+}
+
+IrcMessage::Type MessageData::effectiveType(const IrcMessage* msg)
+{
+    return classify(msg).type;
+}
+
+MessageData::RawPolicy MessageData::rawPolicy()
+{
+    return currentRawPolicy;
+}
+
+void MessageData::setRawPolicy(RawPolicy policy)
+{
+    currentRawPolicy = policy;
+}
+
+qint64 MessageData::rawReleased()
+{
+    return releasedRawBytes;
 }
 
 bool MessageData::isEmpty() const
 {
-    return d.format.isEmpty();
+    return d->format.isEmpty() && !d->lazy;
+}
+
+bool MessageData::isLazy() const
+{
+    return d->lazy;
+}
+
+void MessageData::setLazy(bool lazy)
+{
+    d->lazy = lazy;
 }
 
 bool MessageData::isEvent() const
 {
-    return !d.reply &&
-           (d.type == IrcMessage::Join ||
-            d.type == IrcMessage::Kick ||
-            d.type == IrcMessage::Mode ||
-            d.type == IrcMessage::Nick ||
-            d.type == IrcMessage::Part ||
-            d.type == IrcMessage::Quit ||
-            d.type == IrcMessage::Topic);
+    return !d->reply &&
+           (d->type == IrcMessage::Join ||
+            d->type == IrcMessage::Kick ||
+            d->type == IrcMessage::Mode ||
+            d->type == IrcMessage::Nick ||
+            d->type == IrcMessage::Part ||
+            d->type == IrcMessage::Quit ||
+            d->type == IrcMessage::Topic);
 }
 
 bool MessageData::isError() const
 {
-    return d.error || d.type == IrcMessage::Error;
+    return d->error || d->type == IrcMessage::Error;
+}
+
+int MessageData::eventCount() const
+{
+    return d->group ? d->events : 1;
 }
 
 QList<MessageData> MessageData::getEvents() const
 {
-    QList<MessageData> events = d.events;
-    if (events.isEmpty())
-        events += *this;
-    return events;
+    if (d->group)
+        return d->group->events.mid(0, d->events);
+    return QList<MessageData>() << *this;
+}
+
+QList<int> MessageData::eventKinds() const
+{
+    if (d->group && d->group->events.count() == d->events)
+        return d->group->kinds;
+
+    MessageEvents group;
+    foreach (const MessageData& event, getEvents())
+        group.add(event);
+    return group.kinds;
+}
+
+QSet<QString> MessageData::eventNicks() const
+{
+    if (d->group && d->group->events.count() == d->events)
+        return d->group->nicks;
+
+    MessageEvents group;
+    foreach (const MessageData& event, getEvents())
+        group.add(event);
+    return group.nicks;
 }
 
 bool MessageData::canMerge(const MessageData& other) const
 {
-    return isEvent() && (!d.own || d.type != IrcMessage::Join)
-           && other.isEvent() && (!other.d.own || other.d.type != IrcMessage::Join)
-           && d.timestamp.date() == other.d.timestamp.date();
+    return isEvent() && (!d->own || d->type != IrcMessage::Join)
+           && other.isEvent() && (!other.d->own || other.d->type != IrcMessage::Join)
+           && timestamp().date() == other.timestamp().date();
+}
+
+bool MessageData::canGroup(const MessageData& other, int window) const
+{
+    // consecutive lines of the same sender, both formatted already
+    return window > 0 && !isEvent() && !isLazy() && !other.isLazy()
+           && (d->type == IrcMessage::Private || d->type == IrcMessage::Notice)
+           && other.d->type == d->type && other.d->own == d->own && other.d->nick == d->nick
+           && d->msecs != InvalidMSecs && other.d->msecs != InvalidMSecs
+           && other.d->msecs >= d->msecs && other.d->msecs - d->msecs <= window
+           && timestamp().date() == other.timestamp().date();
+}
+
+bool MessageData::isGroup() const
+{
+    return d->events > 0 && !isEvent();
 }
 
 void MessageData::merge(const MessageData& other)
 {
-    d.events = other.getEvents() << *this;
+    HookStats::Scope scope("MessageData::merge");
+    MessageData event = *this;
+    event.d->group.clear();
+    event.d->events = 0;
+
+    // adopt the group in place unless a newer event was already merged into it
+    if (other.d->group && other.d->group->events.count() == other.d->events) {
+        d->group = other.d->group;
+    } else {
+        d->group = QSharedPointer<MessageEvents>(new MessageEvents);
+        foreach (const MessageData& previous, other.getEvents())
+            d->group->add(previous);
+    }
+    d->group->add(event);
+    d->events = d->group->events.count();
+}
+
+// merge() grows a group in place for whoever adopted it, a copy handed to
+// another thread takes its events along in a group of its own instead
+MessageData MessageData::snapshot() const
+{
+    if (!d->group)
+        return *this;
+
+    MessageData copy = *this;
+    QSharedPointer<MessageEvents> group(new MessageEvents);
+    foreach (const MessageData& event, getEvents())
+        group->add(event);
+    copy.d->group = group;
+    return copy;
 }
 
 void MessageData::initFrom(IrcMessage* message)
 {
-    d.timestamp = message->timeStamp();
-    d.data = message->toData();
-    d.nick = message->nick();
-    d.type = effectiveType(message);
-    d.own = message->isOwn();
-    d.reply = message->property("reply").toBool();
-
-    if (message->type() == IrcMessage::Quit) {
-        QString reason = static_cast<IrcQuitMessage*>(message)->reason();
-        if (reason.contains("Ping timeout")
-                || reason.contains("Connection reset by peer")
-                || reason.contains("Remote host closed the connection")) {
-            d.error = true;
-        }
-    }
+    const QDateTime timestamp = message->timeStamp();
+    d->msecs = timestamp.isValid() ? timestamp.toMSecsSinceEpoch() : InvalidMSecs;
+    d->utc = timestamp.timeSpec() == Qt::UTC;
+    d->data = message->toData();
+    StringPool* pool = StringPool::instance(message->connection());
+    d->nick = pool ? pool->intern(message->nick()) : message->nick();
+    const Class cls = classify(message);
+    d->type = cls.type;
+    d->error = cls.error;
+    d->own = message->isOwn();
+    d->reply = message->property("reply").toBool();
 }
 
 QString MessageData::format() const
 {
-    return d.format;
+    return d->format;
 }
 
 void MessageData::setFormat(const QString& format)
 {
-    d.format = format;
+    d->format = format;
+    d->lazy = false;
+
+    // once formatted, only events still need the raw line, for their tooltip
+    if (currentRawPolicy == KeepEventRaw && !d->data.isEmpty() && !isEvent()) {
+        releasedRawBytes += d->data.size();
+        d->data = QByteArray();
+    }
 }
 
 QString MessageData::nick() const
 {
-    return d.nick;
+    return d->nick;
 }
 
 QByteArray MessageData::data() const
 {
-    return d.data;
+    return d->data;
 }
 
 QDateTime MessageData::timestamp() const
 {
-    return d.timestamp;
+    if (d->msecs == InvalidMSecs)
+        return QDateTime();
+    return QDateTime::fromMSecsSinceEpoch(d->msecs, d->utc ? Qt::UTC : Qt::LocalTime);
+}
+
+qint64 MessageData::msecs() const
+{
+    return d->msecs;
 }
 
 IrcMessage::Type MessageData::type() const
 {
-    return d.type;
+    return static_cast<IrcMessage::Type>(d->type);
+}
+
+int MessageData::footprint() const
+{
+    // shared copies are counted in full, which errs on the safe side
+    const int bytes = sizeof(Private) + d->data.size() + 2 * (d->nick.size() + d->format.size());
+    return bytes + eventFootprint();
+}
+
+// the merged joins, parts and quits held along with an event row
+int MessageData::eventFootprint() const
+{
+    return d->group ? d->group->events.count() * int(sizeof(Private)) : 0;
+}
+
+QDataStream& operator<<(QDataStream& out, const MessageData& data)
+{
+    out << bool(data.d->own) << bool(data.d->error) << bool(data.d->reply);
+    out << data.d->nick << data.d->format << data.d->data << data.timestamp();
+    out << static_cast<qint32>(data.d->type);
+    out << (data.d->group ? data.getEvents() : QList<MessageData>());
+    return out;
+}
+
+QDataStream& operator>>(QDataStream& in, MessageData& data)
+{
+    qint32 type = IrcMessage::Unknown;
+    bool own = false, error = false, reply = false;
+    QDateTime timestamp;
+    QList<MessageData> events;
+    in >> own >> error >> reply;
+    in >> data.d->nick >> data.d->format >> data.d->data >> timestamp;
+    in >> type >> events;
+    data.d->own = own;
+    data.d->error = error;
+    data.d->reply = reply;
+    data.d->msecs = timestamp.isValid() ? timestamp.toMSecsSinceEpoch() : InvalidMSecs;
+    data.d->utc = timestamp.timeSpec() == Qt::UTC;
+    // lazy rows are the only ones stored without a format
+    data.d->lazy = data.d->format.isEmpty() && !data.d->data.isEmpty();
+    data.d->type = type;
+    data.d->group.clear();
+    data.d->events = 0;
+    if (!events.isEmpty()) {
+        data.d->group = QSharedPointer<MessageEvents>(new MessageEvents);
+        foreach (const MessageData& event, events)
+            data.d->group->add(event);
+        data.d->events = events.count();
+    }
+    return in;
 }
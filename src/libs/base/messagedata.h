@@ -29,26 +29,53 @@
 #ifndef MESSAGEDATA_H
 #define MESSAGEDATA_H
 
+#include <QSet>
 #include <QList>
 #include <QString>
 #include <QDateTime>
+#include <QDataStream>
+#include <QMetaType>
+#include <QSharedPointer>
+#include <QSharedDataPointer>
 #include <IrcMessage>
 #include "baseglobal.h"
 
+struct MessageEvents;
+
 class BASE_EXPORT MessageData
 {
 public:
     MessageData();
 
+    struct Class {
+        IrcMessage::Type type;
+        bool error;
+    };
+
+    static Class classify(const IrcMessage* msg);
     static IrcMessage::Type effectiveType(const IrcMessage* msg);
 
+    enum RawPolicy { KeepAllRaw, KeepEventRaw };
+
+    static RawPolicy rawPolicy();
+    static void setRawPolicy(RawPolicy policy);
+    static qint64 rawReleased();
+
     bool isEmpty() const;
+    bool isLazy() const;
+    void setLazy(bool lazy);
     bool isEvent() const;
     bool isError() const;
 
+    int eventCount() const;
     QList<MessageData> getEvents() const;
+    QList<int> eventKinds() const;
+    QSet<QString> eventNicks() const;
     bool canMerge(const MessageData& other) const;
+    bool canGroup(const MessageData& other, int window) const;
+    bool isGroup() const;
     void merge(const MessageData& other);
+    MessageData snapshot() const;
     void initFrom(IrcMessage* message);
 
     QString format() const;
@@ -57,20 +84,38 @@ public:
     QString nick() const;
     QByteArray data() const;
     QDateTime timestamp() const;
+    qint64 msecs() const;
     IrcMessage::Type type() const;
 
+    int footprint() const;
+    int eventFootprint() const;
+
 private:
-    struct Private {
-        bool own;
-        bool error;
-        bool reply;
+    friend BASE_EXPORT QDataStream& operator<<(QDataStream& out, const MessageData& data);
+    friend BASE_EXPORT QDataStream& operator>>(QDataStream& in, MessageData& data);
+
+    // copies are cheap handle copies, the payload is shared until modified
+    struct Private : public QSharedData {
+        Private() : own(false), error(false), reply(false), utc(false), lazy(false), type(IrcMessage::Unknown), events(0), msecs(0) { }
+        quint8 own : 1;
+        quint8 error : 1;
+        quint8 reply : 1;
+        quint8 utc : 1;
+        quint8 lazy : 1;
+        quint8 type;
+        int events;
+        qint64 msecs;
         QString nick;
         QString format;
         QByteArray data;
-        QDateTime timestamp;
-        IrcMessage::Type type;
-        QList<MessageData> events;
-    } d;
+        QSharedPointer<MessageEvents> group;
+    };
+    QSharedDataPointer<Private> d;
 };
 
+BASE_EXPORT QDataStream& operator<<(QDataStream& out, const MessageData& data);
+BASE_EXPORT QDataStream& operator>>(QDataStream& in, MessageData& data);
+
+Q_DECLARE_METATYPE(MessageData)
+
 #endif // MESSAGEDATA_H
@@ -27,18 +27,74 @@
 */
 
 #include "messageformatter.h"
+#include "stringpool.h"
+#include "messagetemplate.h"
+#include "userindex.h"
+#include "hookstats.h"
+#include "allocstats.h"
+#include "tracer.h"
 #include <IrcTextFormat>
 #include <IrcConnection>
-#include <IrcUserModel>
+#include <IrcUser>
 #include <IrcMessage>
 #include <IrcPalette>
 #include <IrcChannel>
+#include <IrcNetwork>
 #include <Irc>
 #include <QHash>
+#include <QSet>
 #include <QTime>
 #include <QColor>
 #include <QCoreApplication>
 #include <QTextBoundaryFinder>
+#include <QThreadStorage>
+#include <algorithm>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+static const int maximumNames = 200;
+
+static inline const MessageTemplate& tmpl(const char* source)
+{
+    return MessageTemplate::translate("MessageFormatter", source);
+}
+
+// texts left for formatDeferred() are marked with noncharacters
+static const QChar DeferredBegin(0xfdd0);
+static const QChar DeferredEnd(0xfdd1);
+
+// the order of Irc::SortByTitle: by the highest prefix, then by name
+struct TitleLessThan
+{
+    TitleLessThan(const QString& prefixes) : prefixes(prefixes) { }
+
+    int rank(const QString& title) const
+    {
+        const int index = title.isEmpty() ? -1 : prefixes.indexOf(title.at(0));
+        return index == -1 ? prefixes.length() : index;
+    }
+
+    QStringRef name(const QString& title) const
+    {
+        int i = 0;
+        while (i < title.length() && prefixes.contains(title.at(i)))
+            ++i;
+        return title.midRef(i);
+    }
+
+    bool operator()(const QString& one, const QString& another) const
+    {
+        const int r1 = rank(one);
+        const int r2 = rank(another);
+        if (r1 != r2)
+            return r1 < r2;
+        return QStringRef::compare(name(one), name(another), Qt::CaseInsensitive) < 0;
+    }
+
+    QString prefixes;
+};
 
 static QString formatSeconds(int secs)
 {
@@ -61,14 +117,213 @@ static QString formatDuration(int secs)
     return idle.join(" ");
 }
 
+static bool decodeEntity(const QString& html, int& pos, QString& text)
+{
+    const int end = html.indexOf(QLatin1Char(';'), pos);
+    if (end == -1 || end - pos > 8)
+        return false;
+    const QStringRef name = html.midRef(pos + 1, end - pos - 1);
+    if (name == QLatin1String("amp"))
+        text += QLatin1Char('&');
+    else if (name == QLatin1String("lt"))
+        text += QLatin1Char('<');
+    else if (name == QLatin1String("gt"))
+        text += QLatin1Char('>');
+    else if (name == QLatin1String("quot"))
+        text += QLatin1Char('"');
+    else if (name == QLatin1String("apos"))
+        text += QLatin1Char('\'');
+    else if (name == QLatin1String("nbsp"))
+        text += QChar(QChar::Nbsp);
+    else if (name.startsWith(QLatin1Char('#'))) {
+        bool ok = false;
+        const uint code = name.startsWith(QLatin1String("#x")) ? name.mid(2).toUInt(&ok, 16) : name.mid(1).toUInt(&ok);
+        if (!ok || code == 0 || code > 0xffff)
+            return false;
+        text += QChar(code);
+    } else {
+        return false;
+    }
+    pos = end + 1;
+    return true;
+}
+
+static QString attributeValue(const QString& tag, const QString& name, int* from = 0, int* to = 0)
+{
+    const int pos = tag.indexOf(QLatin1Char(' ') + name + QLatin1Char('='));
+    if (pos == -1)
+        return QString();
+    const int begin = pos + name.length() + 2;
+    const QChar quote = tag.value(begin);
+    if (quote != QLatin1Char('\'') && quote != QLatin1Char('"'))
+        return QString();
+    const int end = tag.indexOf(quote, begin + 1);
+    if (end == -1)
+        return QString();
+    if (from)
+        *from = pos;
+    if (to)
+        *to = end + 1;
+    return tag.mid(begin + 1, end - begin - 1);
+}
+
+static void appendRun(MessageFormatter::FormatRuns* runs, QHash<QString, int>& formats, const QString& tags, const QString& anchor, QString& text)
+{
+    if (text.isEmpty())
+        return;
+    QHash<QString, int>::const_iterator it = formats.constFind(tags);
+    if (it == formats.constEnd()) {
+        it = formats.insert(tags, runs->formats.count());
+        runs->formats += tags;
+    }
+    MessageFormatter::FormatRun run;
+    run.text = text;
+    run.format = *it;
+    run.anchor = anchor;
+    runs->runs += run;
+    text.clear();
+}
+
+// printable ascii without '@' and without anything that IrcTextFormat would
+// have to turn into formatting or links, ie. text that only needs escaping
+static bool isPlainText(const QString& text)
+{
+    const ushort* data = reinterpret_cast<const ushort*>(text.constData());
+    const int length = text.length();
+    int i = 0;
+#ifdef __SSE2__
+    const __m128i low = _mm_set1_epi16(0x20);
+    const __m128i high = _mm_set1_epi16(0x7e);
+    const __m128i at = _mm_set1_epi16('@');
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 8 <= length; i += 8) {
+        const __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        __m128i bad = _mm_or_si128(_mm_subs_epu16(low, chars), _mm_subs_epu16(chars, high));
+        bad = _mm_or_si128(bad, _mm_cmpeq_epi16(chars, at));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi16(bad, zero)) != 0xffff)
+            return false;
+    }
+#endif
+    for (; i < length; ++i) {
+        const ushort c = data[i];
+        if (c < 0x20 || c > 0x7e || c == '@')
+            return false;
+    }
+    return !text.contains(QLatin1String("://"))
+        && !text.contains(QLatin1String("www."), Qt::CaseInsensitive)
+        && !text.contains(QLatin1String("  "));
+}
+
+static QString styleFragment(const QString& text, MessageFormatter::Style style)
+{
+    QString fmt = text;
+    if (style & MessageFormatter::Bold)
+        fmt = MessageFormatter::tr("<b>%1</b>").arg(fmt);
+    if (style & (MessageFormatter::Color | MessageFormatter::Dim)) {
+        int bucket = (qHash(text) % 9) + 1;
+        if (style & MessageFormatter::Dim) {
+            bucket = 0;
+        }
+        fmt = MessageFormatter::tr("<span class='nick%2'>%1</span>").arg(fmt, QString::number(bucket));
+    }
+    return fmt;
+}
+
+// links channels and nicks, styled through the formatter's cache when there
+// is one, which is not the case on worker threads
+static QString linkify(const QString& msg, const NickMatcher& names, const MessageFormatter* styler)
+{
+    if (names.isEmpty())
+        return msg;
+
+    // copy unchanged spans of msg straight to the output and insert the
+    // links in between, so that msg itself and its boundaries never change
+    QString out;
+    QTextBoundaryFinder finder(QTextBoundaryFinder::Word, msg);
+    const int length = msg.length();
+    int copied = 0;
+    int pos = 0;
+    while (pos < length) {
+        const QChar c = msg.at(pos);
+        if (c.isSpace()) {
+            ++pos;
+            continue;
+        }
+        if (c == '<') {
+            // do not format nicks within links or tags
+            const bool link = msg.midRef(pos, 3) == "<a ";
+            const int end = link ? msg.indexOf("</a>", pos + 3) : msg.indexOf('>', pos + 1);
+            if (end != -1) {
+                pos = end + (link ? 4 : 1);
+                continue;
+            }
+        } else if (c == '&') {
+            // nor within entities
+            const int end = msg.indexOf(';', pos + 1);
+            if (end != -1 && end - pos <= 8) {
+                pos = end + 1;
+                continue;
+            }
+        } else if (c == '#') {
+            int end = pos + 1;
+            if (end < length && msg.at(end) == '#')
+                ++end;
+            while (end < length) {
+                const QChar nextChar = msg.at(end);
+                if (!nextChar.isLetterOrNumber() && (nextChar != '-') && (nextChar != '_'))
+                    break;
+                ++end;
+            }
+            if (end - pos < 2) {
+                ++pos;
+                continue;
+            }
+
+            const QString channel = msg.mid(pos, end - pos);
+            out += msg.midRef(copied, pos - copied);
+            out += QString("<a style='text-decoration:none;' href='channel:%1'>%2</a>").arg(channel, styler ? styler->styledText(channel, MessageFormatter::Bold | MessageFormatter::Color) : styleFragment(channel, MessageFormatter::Bold | MessageFormatter::Color));
+            pos = copied = end;
+            continue;
+        }
+        // test word start boundary
+        finder.setPosition(pos);
+        if (finder.isAtBoundary()) {
+            // the longest nick starting here that also ends at a word boundary
+            const int match = names.longestMatch(msg, pos, &finder);
+            if (match > 0) {
+                const QString user = msg.mid(pos, match);
+                out += msg.midRef(copied, pos - copied);
+                out += QString("<a style='text-decoration:none;' href='nick:%1'>%2</a>").arg(user, styler ? styler->styledText(user, MessageFormatter::Bold | MessageFormatter::Color) : styleFragment(user, MessageFormatter::Bold | MessageFormatter::Color));
+                pos = copied = pos + match;
+                continue;
+            }
+        }
+        ++pos;
+    }
+
+    if (copied == 0)
+        return msg;
+    out += msg.midRef(copied);
+    return out;
+}
+
+
 MessageFormatter::MessageFormatter(QObject* parent) : QObject(parent)
 {
+    d.version = 0;
     d.buffer = 0;
+    d.deferred = false;
+    d.collecting = false;
     d.textFormat = new IrcTextFormat(this);
     d.textFormat->setSpanFormat(IrcTextFormat::SpanClass);
-
-    d.userModel = new IrcUserModel(this);
-    connect(d.userModel, SIGNAL(namesChanged(QStringList)), this, SLOT(indexNames(QStringList)));
+    d.styles.setMaxCost(1024);
+    d.texts.setMaxCost(256);
+    resetStats();
+
+    d.userModel = new UserView(Irc::SortByTitle, this);
+    connect(d.userModel, SIGNAL(modelReset()), this, SLOT(indexNames()));
+    connect(d.userModel, SIGNAL(added(IrcUser*)), this, SLOT(addUser(IrcUser*)));
+    connect(d.userModel, SIGNAL(removed(IrcUser*)), this, SLOT(removeUser(IrcUser*)));
 }
 
 IrcBuffer* MessageFormatter::buffer() const
@@ -81,6 +336,7 @@ void MessageFormatter::setBuffer(IrcBuffer* buffer)
     if (d.buffer != buffer) {
         d.buffer = buffer;
         d.userModel->setChannel(qobject_cast<IrcChannel*>(buffer));
+        indexNames();
     }
 }
 
@@ -91,13 +347,243 @@ IrcTextFormat* MessageFormatter::textFormat() const
 
 void MessageFormatter::setTextFormat(IrcTextFormat* format)
 {
+    // worker threads only know the default format
     d.textFormat = format;
+    d.deferred = false;
+    ++d.version;
+}
+
+bool MessageFormatter::isDeferred() const
+{
+    return d.deferred;
+}
+
+void MessageFormatter::setDeferred(bool deferred)
+{
+    d.deferred = deferred && d.textFormat->parent() == this;
+}
+
+QStringList MessageFormatter::takeDeferredTexts()
+{
+    QStringList texts;
+    texts.swap(d.deferredTexts);
+    return texts;
+}
+
+const NickMatcher& MessageFormatter::nickMatcher() const
+{
+    return d.names;
+}
+
+QString MessageFormatter::formatDeferred(const QString& format, const QStringList& texts, const NickMatcher& names, int* plain, QStringList* htmls)
+{
+    static QThreadStorage<IrcTextFormat*> formats;
+    if (!formats.hasLocalData()) {
+        IrcTextFormat* textFormat = new IrcTextFormat;
+        textFormat->setSpanFormat(IrcTextFormat::SpanClass);
+        formats.setLocalData(textFormat);
+    }
+    IrcTextFormat* textFormat = formats.localData();
+
+    QString out;
+    int copied = 0;
+    int pos = format.indexOf(DeferredBegin);
+    while (pos != -1) {
+        const int end = format.indexOf(DeferredEnd, pos + 1);
+        if (end == -1)
+            break;
+
+        const int index = format.midRef(pos + 1, end - pos - 1).toInt();
+        const QString text = texts.value(index);
+        QString html;
+        const bool isPlain = isPlainText(text);
+        if (isPlain) {
+            if (plain)
+                ++*plain;
+            html = text.toHtmlEscaped();
+        } else {
+            textFormat->parse(text);
+            html = textFormat->html();
+        }
+        html = linkify(html, names, 0);
+
+        // handed back to the formatter's text cache, see cacheTexts()
+        if (htmls && !isPlain && index >= 0 && index < texts.count()) {
+            while (htmls->count() < texts.count())
+                *htmls += QString();
+            (*htmls)[index] = html;
+        }
+
+        out += format.midRef(copied, pos - copied);
+        out += html;
+        copied = end + 1;
+        pos = format.indexOf(DeferredBegin, copied);
+    }
+    out += format.midRef(copied);
+    return out;
+}
+
+MessageFormatter::Stats MessageFormatter::stats() const
+{
+    return d.stats;
+}
+
+void MessageFormatter::resetStats()
+{
+    d.stats.texts = 0;
+    d.stats.plainTexts = 0;
+    d.stats.styleHits = 0;
+    d.stats.styleMisses = 0;
+    d.stats.textHits = 0;
+    d.stats.textMisses = 0;
+}
+
+bool MessageFormatter::formatRuns(const QString& format, FormatRuns* runs)
+{
+    // only the inline tags the formatter and IrcTextFormat write, anything
+    // else (previews, tables, a newline) is left to the html importer
+    static const QStringList inlineTags = QStringList() << "a" << "b" << "i" << "u" << "s" << "span" << "font";
+
+    QHash<QString, int> formats;
+    QStringList names;
+    QStringList tags;
+    QString anchor;
+    QString text;
+    int pos = 0;
+    const int count = format.length();
+    while (pos < count) {
+        const QChar c = format.at(pos);
+        if (c == QLatin1Char('<')) {
+            const int end = format.indexOf(QLatin1Char('>'), pos);
+            if (end == -1)
+                return false;
+            QString tag = format.mid(pos, end - pos + 1);
+            pos = end + 1;
+
+            appendRun(runs, formats, tags.join(QString()), anchor, text);
+            if (tag.startsWith(QLatin1String("</"))) {
+                const QString name = tag.mid(2, tag.length() - 3).trimmed().toLower();
+                if (names.isEmpty() || names.last() != name)
+                    return false;
+                names.removeLast();
+                tags.removeLast();
+                if (name == QLatin1String("a"))
+                    anchor.clear();
+                continue;
+            }
+
+            int length = 1;
+            while (length < tag.length() && tag.at(length).isLetterOrNumber())
+                ++length;
+            const QString name = tag.mid(1, length - 1).toLower();
+            if (name == QLatin1String("br")) {
+                text = QChar(QChar::LineSeparator);
+                appendRun(runs, formats, tags.join(QString()), anchor, text);
+                continue;
+            }
+            if (tag.endsWith(QLatin1String("/>")) || !inlineTags.contains(name))
+                return false;
+
+            if (name == QLatin1String("a")) {
+                // the href goes into the run, so that all links share a format
+                int from = 0, to = 0;
+                if (!anchor.isEmpty() || names.contains(name))
+                    return false;
+                QString href = attributeValue(tag, "href", &from, &to);
+                if (href.isEmpty())
+                    return false;
+                QString decoded;
+                for (int i = 0; i < href.length(); ) {
+                    if (href.at(i) == QLatin1Char('&')) {
+                        if (!decodeEntity(href, i, decoded))
+                            return false;
+                    } else {
+                        decoded += href.at(i++);
+                    }
+                }
+                anchor = decoded;
+                tag.replace(from, to - from, QLatin1String(" href='#'"));
+            }
+            names += name;
+            tags += tag;
+        } else if (c == QLatin1Char('&')) {
+            if (!decodeEntity(format, pos, text))
+                return false;
+        } else if (c == QLatin1Char('\n') || c == QLatin1Char('\r')) {
+            return false;
+        } else {
+            text += c;
+            ++pos;
+        }
+    }
+    appendRun(runs, formats, tags.join(QString()), anchor, text);
+    return true;
+}
+
+qint64 MessageFormatter::cacheFootprint() const
+{
+    // estimated bytes, both caches are bounded anyway
+    qint64 bytes = 0;
+    foreach (const QString& key, d.styles.keys()) {
+        const QString* style = d.styles.object(key);
+        bytes += 32 + 2 * (key.size() + (style ? style->size() : 0));
+    }
+    foreach (const QString& key, d.texts.keys()) {
+        const CachedText* text = d.texts.object(key);
+        bytes += 32 + 2 * (key.size() + (text ? text->html.size() : 0));
+    }
+    return bytes;
+}
+
+void MessageFormatter::clearStyleCache()
+{
+    d.styles.clear();
+    d.texts.clear();
+    ++d.version;
+}
+
+int MessageFormatter::cacheVersion() const
+{
+    return d.version;
+}
+
+void MessageFormatter::cacheTexts(int version, const QStringList& texts, const QStringList& htmls)
+{
+    // results formatted on the pool for an older name index are of no use
+    if (version != d.version)
+        return;
+
+    for (int i = 0; i < qMin(texts.count(), htmls.count()); ++i) {
+        if (!htmls.at(i).isEmpty()) {
+            CachedText* cached = new CachedText;
+            cached->version = version;
+            cached->html = htmls.at(i);
+            d.texts.insert(texts.at(i), cached);
+        }
+    }
 }
 
 MessageData MessageFormatter::formatMessage(IrcMessage* msg)
 {
+    COMMUNI_TRACE("MessageFormatter::formatMessage");
+    COMMUNI_ALLOC_STAGE(Format);
+
+    // quits and nick changes arrive once per shared channel, the first
+    // buffer formats them and the others share the same body
+    const IrcMessage::Type type = MessageData::effectiveType(msg);
+    const bool shared = (type == IrcMessage::Quit || type == IrcMessage::Nick) && metaObject() == &MessageFormatter::staticMetaObject;
+    if (shared) {
+        const QVariant cached = msg->property("formatted");
+        if (cached.isValid())
+            return cached.value<MessageData>();
+    }
+
+    // the bulk of the traffic leaves its texts to formatDeferred()
+    d.deferredTexts.clear();
+    d.collecting = d.deferred && (type == IrcMessage::Private || type == IrcMessage::Notice);
+
     QString fmt;
-    switch (MessageData::effectiveType(msg)) {
+    switch (type) {
         case IrcMessage::Away:
             fmt = formatAwayMessage(static_cast<IrcAwayMessage*>(msg));
             break;
@@ -161,148 +647,129 @@ MessageData MessageFormatter::formatMessage(IrcMessage* msg)
         default:
             break;
     }
-    return formatClass(fmt, msg);
+    d.collecting = false;
+
+    const MessageData data = formatClass(fmt, msg);
+    if (shared)
+        msg->setProperty("formatted", QVariant::fromValue(data));
+    return data;
 }
 
 QString MessageFormatter::formatText(const QString& text) const
 {
-    d.textFormat->parse(text);
-
-    QString msg = d.textFormat->html();
-    if (!d.names.isEmpty()) {
-        QTextBoundaryFinder finder = QTextBoundaryFinder(QTextBoundaryFinder::Word, msg);
-        int pos = 0;
-        while (pos < msg.length()) {
-            const QChar c = msg.at(pos);
-            if (!c.isSpace()) {
-                // do not format nicks within links
-                if (c == '<' && msg.midRef(pos, 3) == "<a ") {
-                    const int end = msg.indexOf("</a>", pos + 3);
-                    if (end != -1) {
-                        pos = end + 4;
-                        continue;
-                    }
-                } else if (c == '#') {
-                    int end = pos + 1;
-                    const int length = msg.length();
-                    if (end < length && msg.at(end) == '#')
-                        ++end;
-                    while (end < length) {
-                        const QChar nextChar = msg.at(end);
-                        if (!nextChar.isLetterOrNumber() && (nextChar != '-') && (nextChar != '_'))
-                            break;
-                        ++end;
-                    }
-                    if (end - pos < 2) {
-                        ++pos;
-                        continue;
-                    }
+    // bots and relays repeat the same coloured lines, those are formatted
+    // once per version of the name index and the style sheet
+    const bool plain = isPlainText(text);
+    if (!plain) {
+        const CachedText* cached = d.texts.object(text);
+        if (cached && cached->version == d.version) {
+            ++d.stats.textHits;
+            return cached->html;
+        }
+    }
 
-                    const QString channel = msg.mid(pos, end - pos);
+    if (!plain)
+        ++d.stats.textMisses;
 
-                    const QString formatted = QString("<a style='text-decoration:none;' href='channel:%1'>%2</a>").arg(channel, styledText(channel, Bold | Color));
-                    msg.replace(pos, channel.length(), formatted);
-                    pos += formatted.length();
-                    continue;
-                }
-                // test word start boundary
-                finder.setPosition(pos);
-                if (finder.isAtBoundary()) {
-                    QMultiHash<QChar, QString>::const_iterator it = d.names.find(c);
-                    while (it != d.names.constEnd() && it.key() == c) {
-                        const QString& user = it.value();
-                        if (msg.midRef(pos, user.length()) == user) {
-                            // test word end boundary
-                            finder.setPosition(pos + user.length());
-                            if (finder.isAtBoundary()) {
-                                const QString formatted = QString("<a style='text-decoration:none;' href='nick:%1'>%2</a>").arg(user, styledText(user, Bold | Color));
-                                msg.replace(pos, user.length(), formatted);
-                                pos += formatted.length();
-                                finder = QTextBoundaryFinder(QTextBoundaryFinder::Word, msg);
-                            }
-                        }
-                        ++it;
-                    }
-                }
-            }
-            ++pos;
-        }
+    if (d.collecting) {
+        d.deferredTexts += text;
+        return DeferredBegin + QString::number(d.deferredTexts.count() - 1) + DeferredEnd;
+    }
+
+    ++d.stats.texts;
+    HookStats::Scope scope("MessageFormatter::formatText");
+    COMMUNI_TRACE("MessageFormatter::formatText");
+
+    QString msg;
+    if (plain) {
+        ++d.stats.plainTexts;
+        msg = text.toHtmlEscaped();
+    } else {
+        d.textFormat->parse(text);
+        msg = d.textFormat->html();
+    }
+    msg = linkify(msg, d.names, this);
+
+    if (!plain) {
+        CachedText* cached = new CachedText;
+        cached->version = d.version;
+        cached->html = msg;
+        d.texts.insert(text, cached);
     }
     return msg;
 }
 
 QString MessageFormatter::formatExpander(const QString& expander) const
 {
-    return tr("<a href='expand:' class='event' style='text-decoration:none;'>%1</a>").arg(expander);
+    return tmpl(QT_TR_NOOP("<a href='expand:' class='event' style='text-decoration:none;'>%1</a>")).fill(expander);
 }
 
 QString MessageFormatter::styledText(const QString& text, Style style) const
 {
-    QString fmt = text;
-    if (style & Bold)
-        fmt = tr("<b>%1</b>").arg(fmt);
-    if (style & (Color | Dim)) {
-        int bucket = (qHash(text) % 9) + 1;
-        if (style & Dim) {
-            bucket = 0;
-        }
-        fmt = tr("<span class='nick%2'>%1</span>").arg(fmt, QString::number(bucket));
+    const QString key = QChar(ushort(style)) + text;
+    if (const QString* cached = d.styles.object(key)) {
+        ++d.stats.styleHits;
+        return *cached;
     }
+    ++d.stats.styleMisses;
+
+    const QString fmt = styleFragment(text, style);
+    d.styles.insert(key, new QString(fmt));
     return fmt;
 }
 
 QString MessageFormatter::formatAwayMessage(IrcAwayMessage* msg)
 {
     if (msg->isOwn())
-        return tr("! %1").arg(formatText(msg->content()));
+        return tmpl(QT_TR_NOOP("! %1")).fill(formatText(msg->content()));
     else if (!msg->content().isEmpty())
-        return tr("! %1 is away (%2)").arg(formatSender(msg),
-                                           formatText(msg->content()));
-    return tr("! %1 is back").arg(formatSender(msg));
+        return tmpl(QT_TR_NOOP("! %1 is away (%2)")).fill(formatSender(msg),
+                                                          formatText(msg->content()));
+    return tmpl(QT_TR_NOOP("! %1 is back")).fill(formatSender(msg));
 }
 
 QString MessageFormatter::formatInviteMessage(IrcInviteMessage* msg)
 {
     if (msg->isReply())
-        return tr("! invited %1 to %2").arg(styledText(msg->user(), Bold),
-                                            styledText(msg->channel(), Bold));
+        return tmpl(QT_TR_NOOP("! invited %1 to %2")).fill(styledText(msg->user(), Bold),
+                                                           styledText(msg->channel(), Bold));
 
-    return tr("%1 %2 invited to %3").arg(formatExpander("!"),
-                                         formatSender(msg),
-                                         styledText(msg->channel(), Bold));
+    return tmpl(QT_TR_NOOP("%1 %2 invited to %3")).fill(formatExpander("!"),
+                                                        formatSender(msg),
+                                                        styledText(msg->channel(), Bold));
 }
 
 QString MessageFormatter::formatJoinMessage(IrcJoinMessage* msg)
 {
-    return tr("%1 %2 joined").arg(formatExpander("!"),
-                                  formatSender(msg));
+    return tmpl(QT_TR_NOOP("%1 %2 joined")).fill(formatExpander("!"),
+                                                 formatSender(msg));
 }
 
 QString MessageFormatter::formatKickMessage(IrcKickMessage* msg)
 {
-    return tr("%1 %2 kicked %3").arg(formatExpander("!"),
-                                     formatSender(msg),
-                                     styledText(msg->user(), Bold));
+    return tmpl(QT_TR_NOOP("%1 %2 kicked %3")).fill(formatExpander("!"),
+                                                    formatSender(msg),
+                                                    styledText(msg->user(), Bold));
 }
 
 QString MessageFormatter::formatModeMessage(IrcModeMessage* msg)
 {
     if (msg->isReply())
-        return tr("%1 %2 mode is %3 %4").arg(formatExpander("!"),
-                                             styledText(msg->target(), Bold),
-                                             styledText(msg->mode(), Bold),
-                                             styledText(msg->argument(), Bold));
-
-    return tr("%1 %2 sets mode %3 %4").arg(formatExpander("!"),
-                                           formatSender(msg),
-                                           styledText(msg->mode(), Bold),
-                                           styledText(msg->argument(), Bold));
+        return tmpl(QT_TR_NOOP("%1 %2 mode is %3 %4")).fill(formatExpander("!"),
+                                                            styledText(msg->target(), Bold),
+                                                            styledText(msg->mode(), Bold),
+                                                            styledText(msg->argument(), Bold));
+
+    return tmpl(QT_TR_NOOP("%1 %2 sets mode %3 %4")).fill(formatExpander("!"),
+                                                          formatSender(msg),
+                                                          styledText(msg->mode(), Bold),
+                                                          styledText(msg->argument(), Bold));
 }
 
 QString MessageFormatter::formatMotdMessage(IrcMotdMessage *msg)
 {
     foreach (const QString& line, msg->lines()) {
-        MessageData data = formatClass(tr("[MOTD] %1").arg(formatText(line)), msg);
+        MessageData data = formatClass(tmpl(QT_TR_NOOP("[MOTD] %1")).fill(formatText(line)), msg);
         emit formatted(data);
     }
     return QString();
@@ -314,12 +781,17 @@ QString MessageFormatter::formatNamesMessage(IrcNamesMessage* msg)
         return QString();
 
     if (d.buffer) {
-        IrcUserModel userModel(d.buffer);
-        userModel.setSortMethod(Irc::SortByTitle);
-        QStringList titles = userModel.titles();
-        for (int i = 0; i < titles.count(); i += 10) {
-            QStringList row = titles.mid(i, 10);
-            MessageData data = formatClass(tr("[NAMES] %1").arg(row.join(tr(" "))), msg);
+        // sort a snapshot of the titles the formatter already tracks
+        d.namesSnapshot = d.userModel->titles();
+        std::sort(d.namesSnapshot.begin(), d.namesSnapshot.end(), TitleLessThan(d.buffer->network()->prefixes().join(QString())));
+
+        const int total = d.namesSnapshot.count();
+        const int count = qMin(total, maximumNames);
+        for (int i = 0; i < count; i += 10) {
+            QString row = QStringList(d.namesSnapshot.mid(i, qMin(10, count - i))).join(tr(" "));
+            if (i + 10 >= count && count < total)
+                row = tmpl(QT_TR_NOOP("%1 %2")).fill(row, formatExpander(tmpl(QT_TR_NOOP("and %1 more")).fill(QString::number(total - count))));
+            MessageData data = formatClass(tmpl(QT_TR_NOOP("[NAMES] %1")).fill(row), msg);
             emit formatted(data);
         }
     }
@@ -327,10 +799,18 @@ QString MessageFormatter::formatNamesMessage(IrcNamesMessage* msg)
     return QString();
 }
 
+QString MessageFormatter::formatNamesOverflow() const
+{
+    QStringList rows;
+    for (int i = maximumNames; i < d.namesSnapshot.count(); i += 10)
+        rows += QStringList(d.namesSnapshot.mid(i, 10)).join(tr(" "));
+    return rows.join("<br/>");
+}
+
 QString MessageFormatter::formatNickMessage(IrcNickMessage* msg)
 {
-    return tr("%1 %2 changed nick").arg(formatExpander("!"),
-                                        styledText(msg->newNick(), Bold));
+    return tmpl(QT_TR_NOOP("%1 %2 changed nick")).fill(formatExpander("!"),
+                                                       styledText(msg->newNick(), Bold));
 }
 
 QString MessageFormatter::formatNoticeMessage(IrcNoticeMessage* msg)
@@ -340,13 +820,13 @@ QString MessageFormatter::formatNoticeMessage(IrcNoticeMessage* msg)
         const QString cmd = params.value(0);
         if (cmd.toUpper() == "PING") {
             const QString secs = formatSeconds(params.value(1).toInt());
-            return tr("! %1 replied in %2").arg(formatSender(msg), secs);
+            return tmpl(QT_TR_NOOP("! %1 replied in %2")).fill(formatSender(msg), secs);
         } else if (cmd.toUpper() == "TIME") {
             const QString rest = QStringList(params.mid(1)).join(" ");
-            return tr("! %1 time is %2").arg(formatSender(msg), rest);
+            return tmpl(QT_TR_NOOP("! %1 time is %2")).fill(formatSender(msg), rest);
         } else if (cmd.toUpper() == "VERSION") {
             const QString rest = QStringList(params.mid(1)).join(" ");
-            return tr("! %1 version is %2").arg(formatSender(msg), rest);
+            return tmpl(QT_TR_NOOP("! %1 version is %2")).fill(formatSender(msg), rest);
         }
     }
 
@@ -355,14 +835,14 @@ QString MessageFormatter::formatNoticeMessage(IrcNoticeMessage* msg)
         pfx = styledText(":" + pfx, Dim);
 
     if (msg->isPrivate())
-        return tr("[%1%2] %3").arg(formatSender(msg),
-                                   pfx,
-                                   formatText(msg->content()));
-
-    return tr("&lt;%1%2&gt; [%3] %4").arg(formatSender(msg),
-                                          pfx,
-                                          msg->target(),
-                                          formatText(msg->content()));
+        return tmpl(QT_TR_NOOP("[%1%2] %3")).fill(formatSender(msg),
+                                                  pfx,
+                                                  formatText(msg->content()));
+
+    return tmpl(QT_TR_NOOP("&lt;%1%2&gt; [%3] %4")).fill(formatSender(msg),
+                                                         pfx,
+                                                         msg->target(),
+                                                         formatText(msg->content()));
 }
 
 #define P_(x) msg->parameters().value(x)
@@ -371,14 +851,14 @@ QString MessageFormatter::formatNoticeMessage(IrcNoticeMessage* msg)
 QString MessageFormatter::formatNumericMessage(IrcNumericMessage* msg)
 {
     if (msg->code() < 300)
-        return tr("[INFO] %1").arg(formatText(MID_(1)));
+        return tmpl(QT_TR_NOOP("[INFO] %1")).fill(formatText(MID_(1)));
 
     switch (msg->code()) {
         case Irc::RPL_VERSION: // TODO: IrcVersionMessage?
-            return tr("! %1 version is %2").arg(styledText(msg->nick(), Bold), P_(1));
+            return tmpl(QT_TR_NOOP("! %1 version is %2")).fill(styledText(msg->nick(), Bold), P_(1));
 
         case Irc::RPL_TIME: // TODO: IrcTimeMessage?
-            return tr("! %1 time is %2").arg(styledText(P_(1), Bold), P_(2));
+            return tmpl(QT_TR_NOOP("! %1 time is %2")).fill(styledText(P_(1), Bold), P_(2));
 
         default:
             break;
@@ -389,51 +869,51 @@ QString MessageFormatter::formatNumericMessage(IrcNumericMessage* msg)
 
     // if you change this, change formatErrorMessage too
     if (Irc::codeToString(msg->code()).startsWith("ERR_"))
-        return tr("[ERROR] %1").arg(formatText(MID_(1)));
+        return tmpl(QT_TR_NOOP("[ERROR] %1")).fill(formatText(MID_(1)));
 
     if (msg->code() == Irc::RPL_CHANNEL_URL)
-        return tr("[Channel URL] %1").arg(d.textFormat->toHtml(MID_(1)));
+        return tmpl(QT_TR_NOOP("[Channel URL] %1")).fill(d.textFormat->toHtml(MID_(1)));
 
-    return tr("[%1] %2").arg(msg->code()).arg(d.textFormat->toHtml(MID_(1)));
+    return tmpl(QT_TR_NOOP("[%1] %2")).fill(QString::number(msg->code()), d.textFormat->toHtml(MID_(1)));
 }
 
 QString MessageFormatter::formatErrorMessage(IrcErrorMessage* msg)
 {
     // if you change this, change ERR_ in formatNumericMessage too
-    return tr("[ERROR] %1").arg(msg->error());
+    return tmpl(QT_TR_NOOP("[ERROR] %1")).fill(msg->error());
 }
 
 QString MessageFormatter::formatPartMessage(IrcPartMessage* msg)
 {
-    return tr("%1 %2 left").arg(formatExpander("!"),
-                                formatSender(msg));
+    return tmpl(QT_TR_NOOP("%1 %2 left")).fill(formatExpander("!"),
+                                               formatSender(msg));
 }
 
 QString MessageFormatter::formatPongMessage(IrcPongMessage* msg)
 {
     const QString secs = formatSeconds(msg->argument().toInt());
-    return tr("! %1 replied in %2").arg(formatSender(msg), secs);
+    return tmpl(QT_TR_NOOP("! %1 replied in %2")).fill(formatSender(msg), secs);
 }
 
 QString MessageFormatter::formatPrivateMessage(IrcPrivateMessage* msg)
 {
     if (msg->isRequest())
-        return tr("%1 %2 requested %3").arg(formatExpander("!"),
-                                            formatSender(msg),
-                                            msg->content().split(" ").value(0).toUpper());
+        return tmpl(QT_TR_NOOP("%1 %2 requested %3")).fill(formatExpander("!"),
+                                                           formatSender(msg),
+                                                           msg->content().split(" ").value(0).toUpper());
 
     if (msg->isAction())
-        return tr("* %1 %2").arg(formatSender(msg),
-                                 formatText(msg->content()));
+        return tmpl(QT_TR_NOOP("* %1 %2")).fill(formatSender(msg),
+                                                formatText(msg->content()));
 
     QString pfx = msg->statusPrefix();
     if (!pfx.isEmpty())
         pfx = styledText(":" + pfx, Dim);
 
-    return tr("&lt;<a style='text-decoration:none;' href='nick:%1'>%2</a>%3&gt; %4").arg(msg->nick(),
-                                                                                         formatSender(msg),
-                                                                                         pfx,
-                                                                                         formatText(msg->content()));
+    return tmpl(QT_TR_NOOP("&lt;<a style='text-decoration:none;' href='nick:%1'>%2</a>%3&gt; %4")).fill(msg->nick(),
+                                                                                                        formatSender(msg),
+                                                                                                        pfx,
+                                                                                                        formatText(msg->content()));
 }
 
 QString MessageFormatter::formatQuitMessage(IrcQuitMessage* msg)
@@ -442,11 +922,11 @@ QString MessageFormatter::formatQuitMessage(IrcQuitMessage* msg)
     if (reason.contains("Ping timeout")
             || reason.contains("Connection reset by peer")
             || reason.contains("Remote host closed the connection")) {
-        return tr("%1 %2 disconnected").arg(formatExpander("!"),
-                                            formatSender(msg));
+        return tmpl(QT_TR_NOOP("%1 %2 disconnected")).fill(formatExpander("!"),
+                                                           formatSender(msg));
     }
-    return tr("%1 %2 quit").arg(formatExpander("!"),
-                                formatSender(msg));
+    return tmpl(QT_TR_NOOP("%1 %2 quit")).fill(formatExpander("!"),
+                                               formatSender(msg));
 }
 
 QString MessageFormatter::formatTopicMessage(IrcTopicMessage* msg)
@@ -457,55 +937,55 @@ QString MessageFormatter::formatTopicMessage(IrcTopicMessage* msg)
     if (msg->isReply()) {
         if (msg->topic().isEmpty())
             return tr("! no topic");
-        return tr("[TOPIC] %1").arg(formatText(msg->topic()));
+        return tmpl(QT_TR_NOOP("[TOPIC] %1")).fill(formatText(msg->topic()));
     }
 
     if (msg->topic().isEmpty())
-        return tr("%1 %2 cleared topic").arg(formatExpander("!"),
-                                             formatSender(msg));
+        return tmpl(QT_TR_NOOP("%1 %2 cleared topic")).fill(formatExpander("!"),
+                                                            formatSender(msg));
 
-    return tr("%1 %2 changed topic").arg(formatExpander("!"),
-                                         formatSender(msg));
+    return tmpl(QT_TR_NOOP("%1 %2 changed topic")).fill(formatExpander("!"),
+                                                        formatSender(msg));
 }
 
 QString MessageFormatter::formatUnknownMessage(IrcMessage* msg)
 {
-    return tr("%1 %2 %3 %4").arg(formatExpander("?"),
-                                 formatSender(msg),
-                                 msg->command(),
-                                 msg->parameters().join(" "));
+    return tmpl(QT_TR_NOOP("%1 %2 %3 %4")).fill(formatExpander("?"),
+                                                formatSender(msg),
+                                                msg->command(),
+                                                msg->parameters().join(" "));
 }
 
 QString MessageFormatter::formatWhoisMessage(IrcWhoisMessage* msg)
 {
-    emit formatted(formatClass(tr("[WHOIS] %1 is %2@%3 (%4)").arg(msg->nick(), msg->ident(), msg->host(), formatText(msg->realName())), msg));
-    emit formatted(formatClass(tr("[WHOIS] %1 is connected via %2 (%3)").arg(msg->nick(), msg->server(), msg->info()), msg));
-    emit formatted(formatClass(tr("[WHOIS] %1 is connected since %2 (idle %3)").arg(msg->nick(), msg->since().toString(), formatDuration(msg->idle())), msg));
+    emit formatted(formatClass(tmpl(QT_TR_NOOP("[WHOIS] %1 is %2@%3 (%4)")).fill(msg->nick(), msg->ident(), msg->host(), formatText(msg->realName())), msg));
+    emit formatted(formatClass(tmpl(QT_TR_NOOP("[WHOIS] %1 is connected via %2 (%3)")).fill(msg->nick(), msg->server(), msg->info()), msg));
+    emit formatted(formatClass(tmpl(QT_TR_NOOP("[WHOIS] %1 is connected since %2 (idle %3)")).fill(msg->nick(), msg->since().toString(), formatDuration(msg->idle())), msg));
     if (!msg->awayReason().isEmpty())
-        emit formatted(formatClass(tr("[WHOIS] %1 is away: %2").arg(msg->nick(), msg->awayReason()), msg));
+        emit formatted(formatClass(tmpl(QT_TR_NOOP("[WHOIS] %1 is away: %2")).fill(msg->nick(), msg->awayReason()), msg));
     if (!msg->account().isEmpty())
-        emit formatted(formatClass(tr("[WHOIS] %1 is logged in as %2").arg(msg->nick(), msg->account()), msg));
+        emit formatted(formatClass(tmpl(QT_TR_NOOP("[WHOIS] %1 is logged in as %2")).fill(msg->nick(), msg->account()), msg));
     if (!msg->address().isEmpty())
-        emit formatted(formatClass(tr("[WHOIS] %1 is connected from %2").arg(msg->nick(), msg->address()), msg));
+        emit formatted(formatClass(tmpl(QT_TR_NOOP("[WHOIS] %1 is connected from %2")).fill(msg->nick(), msg->address()), msg));
     if (msg->isSecure())
-        emit formatted(formatClass(tr("[WHOIS] %1 is using a secure connection").arg(msg->nick()), msg));
+        emit formatted(formatClass(tmpl(QT_TR_NOOP("[WHOIS] %1 is using a secure connection")).fill(msg->nick()), msg));
     if (!msg->channels().isEmpty())
-        emit formatted(formatClass(tr("[WHOIS] %1 is on %2").arg(msg->nick(), msg->channels().join(" ")), msg));
+        emit formatted(formatClass(tmpl(QT_TR_NOOP("[WHOIS] %1 is on %2")).fill(msg->nick(), msg->channels().join(" ")), msg));
     return QString();
 }
 
 QString MessageFormatter::formatWhowasMessage(IrcWhowasMessage* msg)
 {
-    emit formatted(formatClass(tr("[WHOWAS] %1 was %2@%3 (%4)").arg(msg->nick(), msg->ident(), msg->host(), formatText(msg->realName())), msg));
-    emit formatted(formatClass(tr("[WHOWAS] %1 was connected via %2 (%3)").arg(msg->nick(), msg->server(), msg->info()), msg));
+    emit formatted(formatClass(tmpl(QT_TR_NOOP("[WHOWAS] %1 was %2@%3 (%4)")).fill(msg->nick(), msg->ident(), msg->host(), formatText(msg->realName())), msg));
+    emit formatted(formatClass(tmpl(QT_TR_NOOP("[WHOWAS] %1 was connected via %2 (%3)")).fill(msg->nick(), msg->server(), msg->info()), msg));
     if (!msg->account().isEmpty())
-        emit formatted(formatClass(tr("[WHOWAS] %1 was logged in as %2").arg(msg->nick(), msg->account()), msg));
+        emit formatted(formatClass(tmpl(QT_TR_NOOP("[WHOWAS] %1 was logged in as %2")).fill(msg->nick(), msg->account()), msg));
     return QString();
 }
 
 QString MessageFormatter::formatWhoReplyMessage(IrcWhoReplyMessage* msg)
 {
-    QString format = tr("[WHO] %1 (%2)").arg(formatSender(msg), msg->realName());
+    QString format = tmpl(QT_TR_NOOP("[WHO] %1 (%2)")).fill(formatSender(msg), msg->realName());
     if (msg->isAway())
         format += tr(" - away");
     if (msg->isServOp())
@@ -560,7 +1040,7 @@ MessageData MessageFormatter::formatClass(const QString& format, IrcMessage* msg
     }
 
     if (!format.isEmpty())
-        data.setFormat(tr("<span class='%1'>%2</span>").arg(cls, format));
+        data.setFormat(tmpl(QT_TR_NOOP("<span class='%1'>%2</span>")).fill(cls, format));
     return data;
 }
 
@@ -575,11 +1055,71 @@ QString MessageFormatter::formatSender(IrcMessage* msg) const
     return styledText(msg->nick(), style);
 }
 
-void MessageFormatter::indexNames(const QStringList& names)
+// a reset after a reconnect has mostly the same names, only the difference
+// touches the name index. the old users may be gone already, so they are
+// never dereferenced, their connections went away with them
+void MessageFormatter::indexNames()
+{
+    if (d.userModel->isDetached() && !d.userModel->count())
+        return;
+
+    QSet<QString> stale;
+    foreach (const QString& name, d.users)
+        stale.insert(name);
+    d.users.clear();
+
+    bool changed = false;
+    StringPool* pool = d.buffer ? StringPool::instance(d.buffer->connection()) : 0;
+    foreach (IrcUser* user, d.userModel->users()) {
+        const QString name = pool ? pool->intern(user->name()) : user->name();
+        d.users.insert(user, name);
+        connect(user, SIGNAL(nameChanged(QString)), this, SLOT(renameUser(QString)), Qt::UniqueConnection);
+        if (!stale.remove(name)) {
+            d.names.addName(name);
+            changed = true;
+        }
+    }
+    foreach (const QString& name, stale) {
+        d.names.removeName(name);
+        changed = true;
+    }
+    if (changed)
+        ++d.version;
+}
+
+void MessageFormatter::addUser(IrcUser* user)
+{
+    if (!user || d.users.contains(user))
+        return;
+
+    StringPool* pool = d.buffer ? StringPool::instance(d.buffer->connection()) : 0;
+    const QString name = pool ? pool->intern(user->name()) : user->name();
+    d.users.insert(user, name);
+    d.names.addName(name);
+    ++d.version;
+    connect(user, SIGNAL(nameChanged(QString)), this, SLOT(renameUser(QString)));
+}
+
+void MessageFormatter::removeUser(IrcUser* user)
+{
+    QHash<IrcUser*, QString>::iterator it = d.users.find(user);
+    if (it != d.users.end()) {
+        d.names.removeName(it.value());
+        d.users.erase(it);
+        ++d.version;
+        disconnect(user, SIGNAL(nameChanged(QString)), this, SLOT(renameUser(QString)));
+    }
+}
+
+void MessageFormatter::renameUser(const QString& name)
 {
-    d.names.clear();
-    foreach (const QString& name, names) {
-        if (!name.isEmpty())
-            d.names.insert(name.at(0), name);
+    IrcUser* user = static_cast<IrcUser*>(sender());
+    QHash<IrcUser*, QString>::iterator it = d.users.find(user);
+    if (it != d.users.end()) {
+        StringPool* pool = d.buffer ? StringPool::instance(d.buffer->connection()) : 0;
+        const QString interned = pool ? pool->intern(name) : name;
+        d.names.renameName(it.value(), interned);
+        it.value() = interned;
+        ++d.version;
     }
 }
@@ -30,16 +30,20 @@
 #define MESSAGEFORMATTER_H
 
 #include <QHash>
+#include <QCache>
 #include <QColor>
 #include <QString>
+#include <QStringList>
 #include <QDateTime>
 #include <IrcGlobal>
 #include <IrcMessage>
 #include "baseglobal.h"
 #include "messagedata.h"
+#include "nickmatcher.h"
 
+class IrcUser;
 class IrcBuffer;
-class IrcUserModel;
+class UserView;
 class IrcTextFormat;
 
 class BASE_EXPORT MessageFormatter : public QObject
@@ -60,6 +64,29 @@ public:
     MessageData formatMessage(IrcMessage* msg);
     QString formatText(const QString& text) const;
 
+    bool isDeferred() const;
+    void setDeferred(bool deferred);
+    QStringList takeDeferredTexts();
+    const NickMatcher& nickMatcher() const;
+
+    static QString formatDeferred(const QString& format, const QStringList& texts,
+                                  const NickMatcher& names, int* plain = 0, QStringList* htmls = 0);
+
+    // a formatted line as text runs, each in the tag stack it sits in
+    struct FormatRun {
+        QString text;
+        int format;
+        QString anchor;
+    };
+    struct FormatRuns {
+        QStringList formats;
+        QList<FormatRun> runs;
+    };
+    static bool formatRuns(const QString& format, FormatRuns* runs);
+
+    int cacheVersion() const;
+    void cacheTexts(int version, const QStringList& texts, const QStringList& htmls);
+
     enum StyleFlag
     {
         None = 0x0,
@@ -70,6 +97,25 @@ public:
     Q_DECLARE_FLAGS(Style, StyleFlag)
 
     QString styledText(const QString& text, Style style) const;
+    QString formatNamesOverflow() const;
+
+    struct Stats
+    {
+        int texts;
+        int plainTexts;
+        int styleHits;
+        int styleMisses;
+        int textHits;
+        int textMisses;
+    };
+
+    Stats stats() const;
+    void resetStats();
+
+    qint64 cacheFootprint() const;
+
+public slots:
+    void clearStyleCache();
 
 signals:
     void formatted(const MessageData& msg);
@@ -101,14 +147,31 @@ protected:
     virtual QString formatExpander(const QString& expander) const;
 
 private slots:
-    void indexNames(const QStringList& names);
+    void indexNames();
+    void addUser(IrcUser* user);
+    void removeUser(IrcUser* user);
+    void renameUser(const QString& name);
 
 private:
+    struct CachedText {
+        int version;
+        QString html;
+    };
+
     struct Private {
+        int version;
         IrcBuffer* buffer;
-        IrcUserModel* userModel;
+        UserView* userModel;
         IrcTextFormat* textFormat;
-        QMultiHash<QChar, QString> names;
+        bool deferred;
+        bool collecting;
+        mutable QStringList deferredTexts;
+        NickMatcher names;
+        QHash<IrcUser*, QString> users;
+        QStringList namesSnapshot;
+        mutable Stats stats;
+        mutable QCache<QString, QString> styles;
+        mutable QCache<QString, CachedText> texts;
     } d;
 };
 
@@ -0,0 +1,170 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "messagequeue.h"
+
+// the slots are a ring that wraps around at its allocated size, which
+// grows towards the capacity and only past it while the queue has to
+
+static const int minimumSlots = 16;
+
+MessageQueue::MessageQueue()
+{
+    d.head = 0;
+    d.count = 0;
+    d.capacity = 0;
+}
+
+int MessageQueue::count() const
+{
+    return d.count;
+}
+
+bool MessageQueue::isEmpty() const
+{
+    return !d.count;
+}
+
+int MessageQueue::capacity() const
+{
+    return d.capacity;
+}
+
+void MessageQueue::setCapacity(int capacity)
+{
+    d.capacity = qMax(0, capacity);
+}
+
+int MessageQueue::allocated() const
+{
+    return d.slots.size();
+}
+
+MessageData MessageQueue::at(int pos) const
+{
+    if (pos < 0 || pos >= d.count)
+        return MessageData();
+    return d.slots.at(slot(pos));
+}
+
+MessageData MessageQueue::last() const
+{
+    return at(d.count - 1);
+}
+
+QList<MessageData> MessageQueue::mid(int pos, int count) const
+{
+    QList<MessageData> rows;
+    pos = qMax(0, pos);
+    count = qMin(count, d.count - pos);
+    rows.reserve(qMax(0, count));
+    for (int i = 0; i < count; ++i)
+        rows += d.slots.at(slot(pos + i));
+    return rows;
+}
+
+void MessageQueue::append(const MessageData& data)
+{
+    reserve(d.count + 1);
+    d.slots[slot(d.count)] = data;
+    ++d.count;
+}
+
+void MessageQueue::insert(int pos, const MessageData& data)
+{
+    // late rows land close to the end, so the tail is moved up by one
+    pos = qBound(0, pos, d.count);
+    reserve(d.count + 1);
+    for (int i = d.count; i > pos; --i)
+        d.slots[slot(i)] = d.slots.at(slot(i - 1));
+    d.slots[slot(pos)] = data;
+    ++d.count;
+}
+
+void MessageQueue::replace(int pos, const MessageData& data)
+{
+    if (pos >= 0 && pos < d.count)
+        d.slots[slot(pos)] = data;
+}
+
+void MessageQueue::removeFirst(int count)
+{
+    count = qMin(count, d.count);
+    if (count <= 0)
+        return;
+
+    // vacated slots let go of their rows right away
+    for (int i = 0; i < count; ++i)
+        d.slots[slot(i)] = MessageData();
+    d.head = slot(count);
+    d.count -= count;
+    if (!d.count)
+        d.head = 0;
+}
+
+void MessageQueue::prepend(const QList<MessageData>& rows)
+{
+    if (rows.isEmpty())
+        return;
+
+    reserve(d.count + rows.count());
+    const int size = d.slots.size();
+    d.head = (d.head - rows.count() % size + size) % size;
+    d.count += rows.count();
+    for (int i = 0; i < rows.count(); ++i)
+        d.slots[slot(i)] = rows.at(i);
+}
+
+void MessageQueue::clear()
+{
+    d.head = 0;
+    d.count = 0;
+    d.slots.clear();
+}
+
+int MessageQueue::slot(int pos) const
+{
+    return (d.head + pos) % d.slots.size();
+}
+
+void MessageQueue::reserve(int size)
+{
+    if (size <= d.slots.size())
+        return;
+
+    int allocated = qMax(minimumSlots, d.slots.size() * 2);
+    if (d.capacity >= size)
+        allocated = qMin(allocated, d.capacity);
+    allocated = qMax(allocated, size);
+
+    QVector<MessageData> slots(allocated);
+    for (int i = 0; i < d.count; ++i)
+        slots[i] = d.slots.at(slot(i));
+    d.slots.swap(slots);
+    d.head = 0;
+}
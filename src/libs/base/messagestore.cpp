@@ -0,0 +1,345 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "messagestore.h"
+#include "spillstore.h"
+#include <QCoreApplication>
+#include <QDataStream>
+
+// spilled rows are framed as [payload][qint32 payload size], so that
+// SpillStore reads the most recent ones back from the end of a segment
+
+// rows without a timestamp (date markers) inherit the previous stamp,
+// which keeps the stamp index sorted for binary searching
+static qint64 stampOf(const MessageData& data, qint64 previous)
+{
+    const QDateTime timestamp = data.timestamp();
+    if (timestamp.isValid())
+        return timestamp.toMSecsSinceEpoch();
+    return previous;
+}
+
+MessageStore::MessageStore()
+{
+    d.summed = 0;
+    d.filledCount = 0;
+    d.firstFilled = -1;
+    d.lastFilled = -1;
+}
+
+int MessageStore::count() const
+{
+    return d.rows.count();
+}
+
+bool MessageStore::isEmpty() const
+{
+    return d.rows.isEmpty();
+}
+
+MessageData MessageStore::at(int row) const
+{
+    return d.rows.value(row);
+}
+
+MessageData MessageStore::first() const
+{
+    if (d.rows.isEmpty())
+        return MessageData();
+    return d.rows.first();
+}
+
+MessageData MessageStore::last() const
+{
+    if (d.rows.isEmpty())
+        return MessageData();
+    return d.rows.last();
+}
+
+QList<MessageData> MessageStore::messages() const
+{
+    return d.rows;
+}
+
+int MessageStore::firstRowAfter(const QDateTime& timestamp) const
+{
+    if (d.stamps.isEmpty())
+        return -1;
+    if (!timestamp.isValid())
+        return 0;
+
+    QList<qint64>::const_iterator it = std::upper_bound(d.stamps.constBegin(), d.stamps.constEnd(), timestamp.toMSecsSinceEpoch());
+    if (it == d.stamps.constEnd())
+        return -1;
+    return it - d.stamps.constBegin();
+}
+
+void MessageStore::append(const MessageData& data)
+{
+    d.rows.append(data);
+    d.heights.append(-1);
+    d.filled.append(false);
+    d.stamps.append(stampOf(data, d.stamps.isEmpty() ? Q_INT64_C(0) : d.stamps.last()));
+}
+
+void MessageStore::insert(int row, const MessageData& data)
+{
+    row = qBound(0, row, d.rows.count());
+    d.rows.insert(row, data);
+    d.heights.insert(row, -1);
+    d.filled.insert(row, false);
+    if (d.lastFilled >= row) {
+        ++d.lastFilled;
+        if (d.firstFilled >= row)
+            ++d.firstFilled;
+    }
+    d.summed = qMin(d.summed, row);
+    d.stamps.insert(row, stampOf(data, row > 0 ? d.stamps.at(row - 1) : Q_INT64_C(0)));
+}
+
+void MessageStore::replace(int row, const MessageData& data)
+{
+    if (row >= 0 && row < d.rows.count()) {
+        d.rows.replace(row, data);
+        d.heights.replace(row, -1);
+        d.summed = qMin(d.summed, row);
+        d.stamps.replace(row, stampOf(data, row > 0 ? d.stamps.at(row - 1) : Q_INT64_C(0)));
+    }
+}
+
+void MessageStore::removeFirst(int count)
+{
+    count = qMin(count, d.rows.count());
+    if (count > 0)
+        spill(d.rows.mid(0, count));
+    for (int i = 0; i < count; ++i) {
+        d.rows.removeFirst();
+        d.heights.removeFirst();
+        if (d.filled.takeFirst())
+            --d.filledCount;
+        d.stamps.removeFirst();
+    }
+    if (count > 0) {
+        d.summed = 0;
+        shrinkFilled(d.firstFilled - count, d.lastFilled - count);
+    }
+}
+
+void MessageStore::removeLast()
+{
+    if (!d.rows.isEmpty()) {
+        d.rows.removeLast();
+        d.heights.removeLast();
+        if (d.filled.takeLast())
+            --d.filledCount;
+        shrinkFilled(d.firstFilled, qMin(d.lastFilled, d.rows.count() - 1));
+        d.stamps.removeLast();
+        d.summed = qMin(d.summed, d.rows.count());
+    }
+}
+
+void MessageStore::prepend(const QList<MessageData>& rows)
+{
+    QList<qint64> stamps;
+    foreach (const MessageData& data, rows)
+        stamps += stampOf(data, stamps.isEmpty() ? Q_INT64_C(0) : stamps.last());
+    for (int i = rows.count() - 1; i >= 0; --i) {
+        d.rows.prepend(rows.at(i));
+        d.heights.prepend(-1);
+        d.filled.prepend(false);
+        d.stamps.prepend(stamps.at(i));
+    }
+    if (!rows.isEmpty() && d.lastFilled >= 0) {
+        d.firstFilled += rows.count();
+        d.lastFilled += rows.count();
+    }
+    if (!rows.isEmpty())
+        d.summed = 0;
+}
+
+void MessageStore::clear()
+{
+    d.rows.clear();
+    d.heights.clear();
+    d.filled.clear();
+    d.filledCount = 0;
+    d.firstFilled = -1;
+    d.lastFilled = -1;
+    d.stamps.clear();
+    d.offsets.clear();
+    d.summed = 0;
+}
+
+int MessageStore::rowHeight(int row) const
+{
+    return d.heights.value(row, -1);
+}
+
+bool MessageStore::isFilled(int row) const
+{
+    return d.filled.value(row, false);
+}
+
+void MessageStore::setFilled(int row, bool filled)
+{
+    if (row < 0 || row >= d.filled.count() || d.filled.at(row) == filled)
+        return;
+
+    d.filled.replace(row, filled);
+    d.filledCount += filled ? 1 : -1;
+    if (!filled) {
+        shrinkFilled(d.firstFilled, d.lastFilled);
+    } else if (d.lastFilled < 0) {
+        d.firstFilled = row;
+        d.lastFilled = row;
+    } else {
+        d.firstFilled = qMin(d.firstFilled, row);
+        d.lastFilled = qMax(d.lastFilled, row);
+    }
+}
+
+int MessageStore::filledCount() const
+{
+    return d.filledCount;
+}
+
+bool MessageStore::filledRange(int* first, int* last) const
+{
+    *first = d.firstFilled;
+    *last = d.lastFilled;
+    return d.lastFilled >= 0;
+}
+
+// the range only grows when rows get filled, and is narrowed from its ends
+// down to the outermost filled rows as those are emptied or removed
+void MessageStore::shrinkFilled(int first, int last)
+{
+    first = qMax(0, first);
+    last = qMin(last, d.filled.count() - 1);
+    while (first <= last && !d.filled.at(first))
+        ++first;
+    while (last >= first && !d.filled.at(last))
+        --last;
+    d.firstFilled = first <= last ? first : -1;
+    d.lastFilled = first <= last ? last : -1;
+}
+
+void MessageStore::setRowHeight(int row, int height)
+{
+    if (row >= 0 && row < d.heights.count() && d.heights.at(row) != height) {
+        d.heights.replace(row, height);
+        d.summed = qMin(d.summed, row);
+    }
+}
+
+void MessageStore::invalidateHeights()
+{
+    for (int i = 0; i < d.heights.count(); ++i)
+        d.heights[i] = -1;
+    d.summed = 0;
+}
+
+int MessageStore::rowOffset(int row, int* unmeasured) const
+{
+    // the sum of the heights above the row, extended lazily from the last
+    // change down, or -1 with the first row whose height is not known yet
+    row = qBound(0, row, d.heights.count());
+    if (d.offsets.count() < d.heights.count() + 1)
+        d.offsets.resize(d.heights.count() + 1);
+    d.offsets[0] = 0;
+    for (; d.summed < row; ++d.summed) {
+        const int height = d.heights.at(d.summed);
+        if (height < 0) {
+            if (unmeasured)
+                *unmeasured = d.summed;
+            return -1;
+        }
+        d.offsets[d.summed + 1] = d.offsets.at(d.summed) + height;
+    }
+    return d.offsets.at(row);
+}
+
+QString MessageStore::spillName() const
+{
+    return d.spill;
+}
+
+void MessageStore::setSpillName(const QString& name)
+{
+    // the first document starts the spill thread, which clears out
+    // whatever the previous session left
+    d.spill = name;
+    if (!name.isEmpty())
+        SpillStore::instance();
+}
+
+void MessageStore::spill(const QList<MessageData>& rows)
+{
+    if (rows.isEmpty() || d.spill.isEmpty())
+        return;
+
+    // serialized here, written by the spill thread
+    QList<QByteArray> records;
+    records.reserve(rows.count());
+    foreach (const MessageData& row, rows) {
+        QByteArray record;
+        QDataStream stream(&record, QIODevice::WriteOnly);
+        stream << row;
+        stream << static_cast<qint32>(record.size());
+        records += record;
+    }
+    SpillStore::instance()->append(d.spill, records);
+}
+
+bool MessageStore::hasSpilled() const
+{
+    return !d.spill.isEmpty() && SpillStore::instance()->size(d.spill) > 0;
+}
+
+QList<MessageData> MessageStore::takeSpilled(int count)
+{
+    QList<MessageData> rows;
+    if (d.spill.isEmpty())
+        return rows;
+
+    // the taken rows are back in memory and get spilled again once evicted
+    foreach (const QByteArray& payload, SpillStore::instance()->takeLast(d.spill, count)) {
+        MessageData data;
+        QDataStream stream(payload);
+        stream >> data;
+        rows += data;
+    }
+    return rows;
+}
+
+void MessageStore::discardSpilled()
+{
+    // on the way out the spill thread removes everything itself
+    if (!d.spill.isEmpty() && !QCoreApplication::closingDown())
+        SpillStore::instance()->remove(d.spill);
+}
@@ -0,0 +1,100 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef MESSAGESTORE_H
+#define MESSAGESTORE_H
+
+#include <QList>
+#include <QVector>
+#include <QString>
+#include "baseglobal.h"
+#include "messagedata.h"
+
+class BASE_EXPORT MessageStore
+{
+public:
+    MessageStore();
+
+    int count() const;
+    bool isEmpty() const;
+
+    MessageData at(int row) const;
+    MessageData first() const;
+    MessageData last() const;
+    QList<MessageData> messages() const;
+
+    int firstRowAfter(const QDateTime& timestamp) const;
+
+    void append(const MessageData& data);
+    void insert(int row, const MessageData& data);
+    void replace(int row, const MessageData& data);
+    void removeFirst(int count = 1);
+    void removeLast();
+    void prepend(const QList<MessageData>& rows);
+    void clear();
+
+    // the stream of the document in SpillStore, empty for clones
+    QString spillName() const;
+    void setSpillName(const QString& name);
+
+    void spill(const QList<MessageData>& rows);
+    bool hasSpilled() const;
+    QList<MessageData> takeSpilled(int count);
+    void discardSpilled();
+
+    // whether the block of the row has its html or only stands in for it
+    bool isFilled(int row) const;
+    void setFilled(int row, bool filled);
+    int filledCount() const;
+    bool filledRange(int* first, int* last) const;
+
+    int rowHeight(int row) const;
+    void setRowHeight(int row, int height);
+    void invalidateHeights();
+    int rowOffset(int row, int* unmeasured = 0) const;
+
+private:
+    void shrinkFilled(int first, int last);
+
+    struct Private {
+        QList<MessageData> rows;
+        QList<int> heights;
+        QList<bool> filled;
+        int filledCount;
+        // no row outside is filled, -1 while none is
+        int firstFilled;
+        int lastFilled;
+        // prefix sums of the heights, valid up to and including row "summed"
+        mutable QVector<int> offsets;
+        mutable int summed;
+        QList<qint64> stamps;
+        QString spill;
+    } d;
+};
+
+#endif // MESSAGESTORE_H
@@ -0,0 +1,161 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "messagetemplate.h"
+#include <QCoreApplication>
+#include <QPointer>
+#include <QEvent>
+#include <QHash>
+#include <QPair>
+#include <algorithm>
+
+// patterns are compiled once per locale, an installed translator
+// sends LanguageChange to the application and drops them
+class TemplateCache : public QObject
+{
+public:
+    TemplateCache(QObject* parent) : QObject(parent) { parent->installEventFilter(this); }
+
+    bool eventFilter(QObject* object, QEvent* event)
+    {
+        if (event->type() == QEvent::LanguageChange)
+            templates.clear();
+        return QObject::eventFilter(object, event);
+    }
+
+    QHash<QPair<const char*, const char*>, MessageTemplate> templates;
+};
+
+MessageTemplate::MessageTemplate(const QString& pattern)
+{
+    d.pattern = pattern;
+
+    // split into literal spans and %1-%99 markers, like QString::arg() would
+    const int length = pattern.length();
+    int literal = 0;
+    int pos = 0;
+    while (pos < length) {
+        if (pattern.at(pos) != QLatin1Char('%') || pos + 1 >= length || !pattern.at(pos + 1).isDigit()) {
+            ++pos;
+            continue;
+        }
+        int end = pos + 1;
+        int arg = pattern.at(end++).digitValue();
+        if (end < length && pattern.at(end).isDigit())
+            arg = arg * 10 + pattern.at(end++).digitValue();
+        if (arg == 0) {
+            pos = end;
+            continue;
+        }
+
+        if (pos > literal) {
+            Segment text = { -1, literal, pos - literal };
+            d.segments += text;
+        }
+        Segment marker = { arg - 1, pos, end - pos };
+        d.segments += marker;
+        pos = literal = end;
+    }
+    if (length > literal) {
+        Segment text = { -1, literal, length - literal };
+        d.segments += text;
+    }
+
+    // the n-th argument replaces the n-th lowest marker number
+    QVector<int> numbers;
+    foreach (const Segment& segment, d.segments) {
+        if (segment.arg >= 0)
+            numbers += segment.arg;
+    }
+    std::sort(numbers.begin(), numbers.end());
+    numbers.erase(std::unique(numbers.begin(), numbers.end()), numbers.end());
+    for (int i = 0; i < d.segments.count(); ++i) {
+        if (d.segments.at(i).arg >= 0)
+            d.segments[i].arg = std::lower_bound(numbers.begin(), numbers.end(), d.segments.at(i).arg) - numbers.begin();
+    }
+}
+
+const MessageTemplate& MessageTemplate::translate(const char* context, const char* source)
+{
+    // only used on the gui thread
+    static QPointer<TemplateCache> cache;
+    if (!cache)
+        cache = new TemplateCache(QCoreApplication::instance());
+
+    const QPair<const char*, const char*> key(context, source);
+    QHash<QPair<const char*, const char*>, MessageTemplate>::const_iterator it = cache->templates.constFind(key);
+    if (it == cache->templates.constEnd())
+        it = cache->templates.insert(key, MessageTemplate(QCoreApplication::translate(context, source)));
+    return it.value();
+}
+
+QString MessageTemplate::pattern() const
+{
+    return d.pattern;
+}
+
+QString MessageTemplate::fill(const QString& a1) const
+{
+    const QString* args[] = { &a1 };
+    return fill(args, 1);
+}
+
+QString MessageTemplate::fill(const QString& a1, const QString& a2) const
+{
+    const QString* args[] = { &a1, &a2 };
+    return fill(args, 2);
+}
+
+QString MessageTemplate::fill(const QString& a1, const QString& a2, const QString& a3) const
+{
+    const QString* args[] = { &a1, &a2, &a3 };
+    return fill(args, 3);
+}
+
+QString MessageTemplate::fill(const QString& a1, const QString& a2, const QString& a3, const QString& a4) const
+{
+    const QString* args[] = { &a1, &a2, &a3, &a4 };
+    return fill(args, 4);
+}
+
+QString MessageTemplate::fill(const QString* const* args, int count) const
+{
+    int size = 0;
+    foreach (const Segment& segment, d.segments)
+        size += segment.arg >= 0 && segment.arg < count ? args[segment.arg]->length() : segment.length;
+
+    QString result;
+    result.reserve(size);
+    foreach (const Segment& segment, d.segments) {
+        if (segment.arg >= 0 && segment.arg < count)
+            result += *args[segment.arg];
+        else
+            result += d.pattern.midRef(segment.offset, segment.length);
+    }
+    return result;
+}
@@ -0,0 +1,65 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef MESSAGETEMPLATE_H
+#define MESSAGETEMPLATE_H
+
+#include <QString>
+#include <QVector>
+#include "baseglobal.h"
+
+class BASE_EXPORT MessageTemplate
+{
+public:
+    explicit MessageTemplate(const QString& pattern = QString());
+
+    static const MessageTemplate& translate(const char* context, const char* source);
+
+    QString pattern() const;
+
+    QString fill(const QString& a1) const;
+    QString fill(const QString& a1, const QString& a2) const;
+    QString fill(const QString& a1, const QString& a2, const QString& a3) const;
+    QString fill(const QString& a1, const QString& a2, const QString& a3, const QString& a4) const;
+
+private:
+    QString fill(const QString* const* args, int count) const;
+
+    struct Segment {
+        int arg;
+        int offset;
+        int length;
+    };
+
+    struct Private {
+        QString pattern;
+        QVector<Segment> segments;
+    } d;
+};
+
+#endif // MESSAGETEMPLATE_H
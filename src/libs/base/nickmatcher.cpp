@@ -0,0 +1,164 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "nickmatcher.h"
+#include <QTextBoundaryFinder>
+
+// The names are kept in a trie whose edges live in one hash keyed by
+// (node, character). Nicks only match at word starts, so the text is
+// walked down the trie from each word start and no failure links are
+// needed, which keeps adding and removing a name O(length).
+
+static inline quint64 edgeKey(int node, ushort c)
+{
+    return (quint64(node) << 16) | c;
+}
+
+NickMatcher::NickMatcher()
+{
+    d.chars = 0;
+    d.terminals += 0;
+}
+
+bool NickMatcher::isEmpty() const
+{
+    return d.names.isEmpty();
+}
+
+int NickMatcher::count() const
+{
+    return d.names.count();
+}
+
+bool NickMatcher::contains(const QString& name) const
+{
+    return d.names.contains(name);
+}
+
+void NickMatcher::clear()
+{
+    d.chars = 0;
+    d.terminals.clear();
+    d.terminals += 0;
+    d.edges.clear();
+    d.names.clear();
+}
+
+void NickMatcher::setNames(const QStringList& names)
+{
+    clear();
+    d.edges.reserve(names.count() * 8);
+    foreach (const QString& name, names)
+        addName(name);
+}
+
+void NickMatcher::addName(const QString& name)
+{
+    if (name.isEmpty())
+        return;
+
+    int& refs = d.names[name];
+    if (refs++ == 0) {
+        d.chars += name.length();
+        insertPath(name, 1);
+    }
+}
+
+void NickMatcher::removeName(const QString& name)
+{
+    QHash<QString, int>::iterator it = d.names.find(name);
+    if (it == d.names.end())
+        return;
+
+    if (--it.value() == 0) {
+        d.names.erase(it);
+        d.chars -= name.length();
+        insertPath(name, -1);
+
+        // removed names leave dead nodes behind, rebuild once they pile up
+        if (d.terminals.count() > 2 * d.chars + 64)
+            compact();
+    }
+}
+
+void NickMatcher::renameName(const QString& from, const QString& to)
+{
+    removeName(from);
+    addName(to);
+}
+
+int NickMatcher::longestMatch(const QString& text, int pos, QTextBoundaryFinder* finder) const
+{
+    int node = 0;
+    int best = 0;
+    const int length = text.length();
+    for (int i = pos; i < length; ++i) {
+        QHash<quint64, int>::const_iterator it = d.edges.constFind(edgeKey(node, text.at(i).unicode()));
+        if (it == d.edges.constEnd())
+            break;
+        node = it.value();
+        if (d.terminals.at(node) > 0) {
+            if (finder)
+                finder->setPosition(i + 1);
+            if (!finder || finder->isAtBoundary())
+                best = i - pos + 1;
+        }
+    }
+    return best;
+}
+
+void NickMatcher::insertPath(const QString& name, int diff)
+{
+    int node = 0;
+    foreach (const QChar& c, name) {
+        const quint64 key = edgeKey(node, c.unicode());
+        QHash<quint64, int>::const_iterator it = d.edges.constFind(key);
+        if (it != d.edges.constEnd()) {
+            node = it.value();
+        } else {
+            if (diff < 0)
+                return;
+            const int next = d.terminals.count();
+            d.terminals += 0;
+            d.edges.insert(key, next);
+            node = next;
+        }
+    }
+    d.terminals[node] += diff;
+}
+
+void NickMatcher::compact()
+{
+    const QHash<QString, int> names = d.names;
+    clear();
+    for (QHash<QString, int>::const_iterator it = names.constBegin(); it != names.constEnd(); ++it) {
+        d.names.insert(it.key(), it.value());
+        d.chars += it.key().length();
+        insertPath(it.key(), 1);
+    }
+}
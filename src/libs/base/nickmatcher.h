@@ -0,0 +1,69 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef NICKMATCHER_H
+#define NICKMATCHER_H
+
+#include <QHash>
+#include <QVector>
+#include <QString>
+#include <QStringList>
+#include "baseglobal.h"
+
+class QTextBoundaryFinder;
+
+class BASE_EXPORT NickMatcher
+{
+public:
+    NickMatcher();
+
+    bool isEmpty() const;
+    int count() const;
+    bool contains(const QString& name) const;
+
+    void clear();
+    void setNames(const QStringList& names);
+    void addName(const QString& name);
+    void removeName(const QString& name);
+    void renameName(const QString& from, const QString& to);
+
+    int longestMatch(const QString& text, int pos, QTextBoundaryFinder* finder = 0) const;
+
+private:
+    void insertPath(const QString& name, int diff);
+    void compact();
+
+    struct Private {
+        int chars;
+        QVector<int> terminals;
+        QHash<quint64, int> edges;
+        QHash<QString, int> names;
+    } d;
+};
+
+#endif // NICKMATCHER_H
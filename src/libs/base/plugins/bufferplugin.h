@@ -29,6 +29,7 @@
 #ifndef BUFFERPLUGIN_H
 #define BUFFERPLUGIN_H
 
+#include <QList>
 #include <QtPlugin>
 
 class IrcBuffer;
@@ -40,6 +41,13 @@ public:
 
     virtual void bufferAdded(IrcBuffer*) {}
     virtual void bufferRemoved(IrcBuffer*) {}
+
+    // bursts, such as restoring a session, arrive in one call
+    virtual void buffersAdded(const QList<IrcBuffer*>& buffers)
+    {
+        foreach (IrcBuffer* buffer, buffers)
+            bufferAdded(buffer);
+    }
 };
 
 Q_DECLARE_INTERFACE(BufferPlugin, "Communi.BufferPlugin")
@@ -41,6 +41,7 @@ public:
     virtual ~DockPlugin() {}
 
     virtual void dockAlert(IrcMessage*) {}
+    virtual void dockBadgeChanged(int, int) {}
     virtual void setupTrayIcon(QSystemTrayIcon*) {}
     virtual void setupMuteAction(QAction*) {}
 };
@@ -29,6 +29,7 @@
 #ifndef DOCUMENTPLUGIN_H
 #define DOCUMENTPLUGIN_H
 
+#include <QList>
 #include <QtPlugin>
 
 class TextDocument;
@@ -40,6 +41,16 @@ public:
 
     virtual void documentAdded(TextDocument*) {}
     virtual void documentRemoved(TextDocument*) {}
+
+    // drop whatever is kept per document, see TextDocument::releaseCaches()
+    virtual void documentReleased(TextDocument*) {}
+
+    // bursts, such as restoring a session, arrive in one call
+    virtual void documentsAdded(const QList<TextDocument*>& documents)
+    {
+        foreach (TextDocument* document, documents)
+            documentAdded(document);
+    }
 };
 
 Q_DECLARE_INTERFACE(DocumentPlugin, "Communi.DocumentPlugin")
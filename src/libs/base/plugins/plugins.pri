@@ -8,6 +8,8 @@ HEADERS += $$PWD/settingsplugin.h
 HEADERS += $$PWD/connectionplugin.h
 HEADERS += $$PWD/dockplugin.h
 HEADERS += $$PWD/documentplugin.h
+HEADERS += $$PWD/storageplugin.h
 HEADERS += $$PWD/themeplugin.h
+HEADERS += $$PWD/threadplugin.h
 HEADERS += $$PWD/viewplugin.h
 HEADERS += $$PWD/windowplugin.h
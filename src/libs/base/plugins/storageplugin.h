@@ -0,0 +1,62 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef STORAGEPLUGIN_H
+#define STORAGEPLUGIN_H
+
+#include <QList>
+#include <QString>
+#include <QDateTime>
+#include <QtPlugin>
+#include "storagereply.h"
+
+// a backend for whatever is kept on disk in streams of records, such as
+// logs, spilled scrollback and snapshots. appends are batched by the
+// backend, reads complete asynchronously through the returned reply.
+class StoragePlugin
+{
+public:
+    virtual ~StoragePlugin() {}
+
+    virtual void append(const QString& stream, const QList<StorageRecord>& records) = 0;
+
+    // the latest records in [from, to), at most limit of them if positive
+    virtual StorageReply* read(const QString& stream, const QDateTime& from, const QDateTime& to, int limit = 0) = 0;
+
+    // the latest records appended with the given key
+    virtual StorageReply* query(const QString& stream, const QByteArray& key, int limit = 0) = 0;
+
+    virtual void remove(const QString& stream) = 0;
+
+    // blocks until whatever was appended is on disk
+    virtual void flush() = 0;
+};
+
+Q_DECLARE_INTERFACE(StoragePlugin, "Communi.StoragePlugin")
+
+#endif // STORAGEPLUGIN_H
@@ -0,0 +1,82 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef THREADPLUGIN_H
+#define THREADPLUGIN_H
+
+#include <QList>
+#include <QString>
+#include <QDateTime>
+#include <QByteArray>
+#include <QVariantMap>
+#include <QtPlugin>
+
+// a buffer as seen from a plugin thread, copied on the gui thread
+struct ThreadBuffer
+{
+    ThreadBuffer() : channel(false) { }
+    QString network;
+    QString title;
+    bool channel;
+};
+
+// a received message, copied before libcommuni deletes it
+struct ThreadMessage
+{
+    ThreadMessage() : type(0), own(false) { }
+    ThreadBuffer buffer;
+    int type;
+    bool own;
+    QString nick;
+    QByteArray data;
+    QDateTime timeStamp;
+};
+
+// a plugin with "thread": true in its metadata runs on a thread of its own
+// and is handed values only, nothing that points back into the gui thread.
+// the keys listed under "settings" in the metadata reach settingsChanged().
+class ThreadPlugin
+{
+public:
+    virtual ~ThreadPlugin() {}
+
+    virtual void bufferAdded(const ThreadBuffer&) {}
+    virtual void bufferRemoved(const ThreadBuffer&) {}
+
+    // one call per burst
+    virtual void messagesReceived(const QList<ThreadMessage>&) {}
+
+    virtual void settingsChanged(const QVariantMap&) {}
+
+    virtual void pluginEnabled() {}
+    virtual void pluginDisabled() {}
+};
+
+Q_DECLARE_INTERFACE(ThreadPlugin, "Communi.ThreadPlugin")
+
+#endif // THREADPLUGIN_H
@@ -40,6 +40,10 @@ public:
 
     virtual void viewAdded(BufferView*) {}
     virtual void viewRemoved(BufferView*) {}
+
+    // unsplit views are parked, and handed out again instead of new ones
+    virtual void viewPooled(BufferView*) {}
+    virtual void viewRecycled(BufferView*) {}
 };
 
 Q_DECLARE_INTERFACE(ViewPlugin, "Communi.ViewPlugin")
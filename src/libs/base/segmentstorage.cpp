@@ -0,0 +1,381 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "segmentstorage.h"
+#include "taskscheduler.h"
+#include <QScopedPointer>
+#include <QDataStream>
+#include <QRunnable>
+#include <QFileInfo>
+#include <QFile>
+#include <QUrl>
+#include <QDir>
+
+static const int CommitDelay = 250;
+static const int DefaultSegmentSize = 4 * 1024 * 1024;
+
+struct SegmentLocation
+{
+    QString segment;
+    qint64 offset;
+};
+
+struct SegmentIndex
+{
+    QHash<QByteArray, QVector<SegmentLocation> > keys;
+    QHash<QString, qint64> scanned;
+};
+
+static QStringList segmentFiles(const QString& dirPath)
+{
+    // zero padded start times, so that name order is time order
+    return QDir(dirPath).entryList(QStringList("*.seg"), QDir::Files, QDir::Name);
+}
+
+static QString segmentName(qint64 msecs)
+{
+    return QString::number(msecs).rightJustified(16, '0') + ".seg";
+}
+
+class SegmentMap
+{
+public:
+    SegmentMap(const QString& filePath) : m_file(filePath), m_data(0), m_size(0)
+    {
+        if (m_file.open(QIODevice::ReadOnly) && m_file.size() > 0) {
+            m_size = m_file.size();
+            m_data = m_file.map(0, m_size);
+        }
+    }
+
+    ~SegmentMap()
+    {
+        if (m_data)
+            m_file.unmap(m_data);
+    }
+
+    qint64 size() const { return m_data ? m_size : 0; }
+
+    // a record cut short by a crash ends the segment
+    bool readRecord(qint64& offset, StorageRecord& record) const
+    {
+        if (!m_data || offset >= m_size)
+            return false;
+        const QByteArray bytes = QByteArray::fromRawData(reinterpret_cast<const char*>(m_data), m_size);
+        QDataStream in(bytes);
+        in.setVersion(QDataStream::Qt_5_0);
+        in.device()->seek(offset);
+        in >> record.msecs >> record.key >> record.data;
+        if (in.status() != QDataStream::Ok)
+            return false;
+        offset = in.device()->pos();
+        return true;
+    }
+
+private:
+    QFile m_file;
+    uchar* m_data;
+    qint64 m_size;
+};
+
+class SegmentTask : public QRunnable
+{
+public:
+    enum Kind { Write, Read, Query, Remove };
+
+    SegmentTask(SegmentStorage* storage, Kind kind, const QString& stream)
+        : storage(storage), kind(kind), stream(stream), id(0), from(0), to(0), limit(0) { }
+
+    void run()
+    {
+        switch (kind) {
+        case Write: write(); break;
+        case Read: storage->post(id, read()); break;
+        case Query: storage->post(id, query()); break;
+        case Remove: remove(); break;
+        }
+    }
+
+    SegmentStorage* storage;
+    Kind kind;
+    QString stream;
+    int id;
+    qint64 from;
+    qint64 to;
+    int limit;
+    QByteArray key;
+    QList<StorageRecord> records;
+
+private:
+    QString dirPath() const
+    {
+        return storage->streamPath(stream);
+    }
+
+    void write()
+    {
+        const QString path = dirPath();
+        QDir().mkpath(path);
+        SegmentIndex* index = storage->d.indexes.value(stream);
+
+        QFile file;
+        QDataStream out;
+        out.setVersion(QDataStream::Qt_5_0);
+        QStringList segments = segmentFiles(path);
+        if (!segments.isEmpty()) {
+            file.setFileName(path + "/" + segments.last());
+            if (file.size() >= storage->d.segmentSize || !file.open(QIODevice::WriteOnly | QIODevice::Append))
+                file.setFileName(QString());
+        }
+
+        foreach (const StorageRecord& record, records) {
+            if (!file.isOpen() || file.size() >= storage->d.segmentSize) {
+                file.close();
+                qint64 start = record.msecs;
+                while (QFile::exists(path + "/" + segmentName(start)))
+                    ++start;
+                file.setFileName(path + "/" + segmentName(start));
+                if (!file.open(QIODevice::WriteOnly | QIODevice::Append))
+                    return;
+            }
+            out.setDevice(&file);
+            const qint64 offset = file.size();
+            out << record.msecs << record.key << record.data;
+            if (index) {
+                const QString segment = QFileInfo(file).fileName();
+                if (!record.key.isEmpty()) {
+                    SegmentLocation location = { segment, offset };
+                    index->keys[record.key] += location;
+                }
+                index->scanned[segment] = file.size();
+            }
+        }
+    }
+
+    QList<StorageRecord> read() const
+    {
+        // walks back from the latest segment until the range or limit is covered
+        QList<StorageRecord> result;
+        const QString path = dirPath();
+        const QStringList segments = segmentFiles(path);
+        for (int i = segments.count() - 1; i >= 0; --i) {
+            const qint64 start = segments.at(i).section('.', 0, 0).toLongLong();
+            if (to > 0 && start >= to)
+                continue;
+
+            QList<StorageRecord> chunk;
+            SegmentMap map(path + "/" + segments.at(i));
+            qint64 offset = 0;
+            StorageRecord record;
+            while (map.readRecord(offset, record)) {
+                if (record.msecs >= from && (to <= 0 || record.msecs < to))
+                    chunk += record;
+            }
+            result = chunk + result;
+
+            if ((limit > 0 && result.count() >= limit) || (from > 0 && start <= from))
+                break;
+        }
+        if (limit > 0 && result.count() > limit)
+            result = result.mid(result.count() - limit);
+        return result;
+    }
+
+    QList<StorageRecord> query() const
+    {
+        SegmentIndex* index = storage->d.indexes.value(stream);
+        if (!index) {
+            index = new SegmentIndex;
+            storage->d.indexes.insert(stream, index);
+        }
+
+        // catches up with whatever was written before the index existed
+        const QString path = dirPath();
+        foreach (const QString& segment, segmentFiles(path)) {
+            SegmentMap map(path + "/" + segment);
+            qint64 offset = index->scanned.value(segment);
+            if (offset >= map.size())
+                continue;
+            qint64 position = offset;
+            StorageRecord record;
+            while (map.readRecord(offset, record)) {
+                if (!record.key.isEmpty()) {
+                    SegmentLocation location = { segment, position };
+                    index->keys[record.key] += location;
+                }
+                position = offset;
+            }
+            index->scanned[segment] = position;
+        }
+
+        QVector<SegmentLocation> locations = index->keys.value(key);
+        if (limit > 0 && locations.count() > limit)
+            locations = locations.mid(locations.count() - limit);
+
+        QList<StorageRecord> result;
+        QScopedPointer<SegmentMap> map;
+        QString current;
+        foreach (const SegmentLocation& location, locations) {
+            if (location.segment != current) {
+                current = location.segment;
+                map.reset(new SegmentMap(path + "/" + current));
+            }
+            qint64 offset = location.offset;
+            StorageRecord record;
+            if (map->readRecord(offset, record))
+                result += record;
+        }
+        return result;
+    }
+
+    void remove()
+    {
+        delete storage->d.indexes.take(stream);
+        QDir(dirPath()).removeRecursively();
+    }
+};
+
+SegmentStorage::SegmentStorage(const QString& dirPath, QObject* parent) : QObject(parent)
+{
+    d.nextId = 0;
+    d.dirPath = dirPath;
+    d.segmentSize = DefaultSegmentSize;
+    d.pool.setMaxThreadCount(1);
+}
+
+SegmentStorage::~SegmentStorage()
+{
+    flush();
+    qDeleteAll(d.indexes);
+}
+
+QString SegmentStorage::dirPath() const
+{
+    return d.dirPath;
+}
+
+int SegmentStorage::segmentSize() const
+{
+    return d.segmentSize;
+}
+
+void SegmentStorage::setSegmentSize(int size)
+{
+    flush();
+    d.segmentSize = qMax(4096, size);
+}
+
+void SegmentStorage::append(const QString& stream, const QList<StorageRecord>& records)
+{
+    if (records.isEmpty())
+        return;
+    d.pending[stream] += records;
+    TaskScheduler::instance()->schedule(TaskScheduler::Flush, this, "commit", CommitDelay);
+}
+
+StorageReply* SegmentStorage::read(const QString& stream, const QDateTime& from, const QDateTime& to, int limit)
+{
+    SegmentTask* task = new SegmentTask(this, SegmentTask::Read, stream);
+    task->from = from.isValid() ? from.toMSecsSinceEpoch() : 0;
+    task->to = to.isValid() ? to.toMSecsSinceEpoch() : 0;
+    task->limit = limit;
+    return submit(task);
+}
+
+StorageReply* SegmentStorage::query(const QString& stream, const QByteArray& key, int limit)
+{
+    SegmentTask* task = new SegmentTask(this, SegmentTask::Query, stream);
+    task->key = key;
+    task->limit = limit;
+    return submit(task);
+}
+
+void SegmentStorage::remove(const QString& stream)
+{
+    d.pending.remove(stream);
+    d.pool.start(new SegmentTask(this, SegmentTask::Remove, stream));
+}
+
+void SegmentStorage::flush()
+{
+    commit();
+    d.pool.waitForDone();
+}
+
+void SegmentStorage::commit()
+{
+    TaskScheduler::instance()->unschedule(this, "commit");
+    QHash<QString, QList<StorageRecord> >::const_iterator it;
+    for (it = d.pending.constBegin(); it != d.pending.constEnd(); ++it) {
+        SegmentTask* task = new SegmentTask(this, SegmentTask::Write, it.key());
+        task->records = it.value();
+        d.pool.start(task);
+    }
+    d.pending.clear();
+}
+
+void SegmentStorage::deliver()
+{
+    QHash<int, QList<StorageRecord> > results;
+    {
+        QMutexLocker locker(&d.mutex);
+        results.swap(d.results);
+    }
+
+    QHash<int, QList<StorageRecord> >::const_iterator it;
+    for (it = results.constBegin(); it != results.constEnd(); ++it) {
+        StorageReply* reply = d.replies.take(it.key());
+        if (reply)
+            reply->finish(it.value());
+    }
+}
+
+QString SegmentStorage::streamPath(const QString& stream) const
+{
+    return d.dirPath + "/" + QString::fromLatin1(QUrl::toPercentEncoding(stream));
+}
+
+StorageReply* SegmentStorage::submit(SegmentTask* task)
+{
+    // reads queue up behind pending appends, so that they see them
+    commit();
+    task->id = ++d.nextId;
+    StorageReply* reply = new StorageReply(this);
+    d.replies.insert(task->id, reply);
+    d.pool.start(task);
+    return reply;
+}
+
+void SegmentStorage::post(int id, const QList<StorageRecord>& records)
+{
+    QMutexLocker locker(&d.mutex);
+    const bool wake = d.results.isEmpty();
+    d.results.insert(id, records);
+    if (wake)
+        QMetaObject::invokeMethod(this, "deliver", Qt::QueuedConnection);
+}
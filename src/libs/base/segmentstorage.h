@@ -0,0 +1,91 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SEGMENTSTORAGE_H
+#define SEGMENTSTORAGE_H
+
+#include <QHash>
+#include <QMutex>
+#include <QObject>
+#include <QPointer>
+#include <QThreadPool>
+#include "baseglobal.h"
+#include "storageplugin.h"
+
+class SegmentTask;
+struct SegmentIndex;
+
+// the default StoragePlugin, each stream is a directory of append-only
+// segment files that are memory-mapped for reading. all file access runs
+// in order on a single pool thread.
+class BASE_EXPORT SegmentStorage : public QObject, public StoragePlugin
+{
+    Q_OBJECT
+    Q_INTERFACES(StoragePlugin)
+
+public:
+    explicit SegmentStorage(const QString& dirPath, QObject* parent = 0);
+    ~SegmentStorage();
+
+    QString dirPath() const;
+
+    int segmentSize() const;
+    void setSegmentSize(int size);
+
+    void append(const QString& stream, const QList<StorageRecord>& records);
+    StorageReply* read(const QString& stream, const QDateTime& from, const QDateTime& to, int limit = 0);
+    StorageReply* query(const QString& stream, const QByteArray& key, int limit = 0);
+    void remove(const QString& stream);
+    void flush();
+
+private slots:
+    void commit();
+    void deliver();
+
+private:
+    QString streamPath(const QString& stream) const;
+    StorageReply* submit(SegmentTask* task);
+    void post(int id, const QList<StorageRecord>& records);
+
+    friend class SegmentTask;
+
+    struct Private {
+        int segmentSize;
+        int nextId;
+        QString dirPath;
+        QThreadPool pool;
+        QHash<QString, QList<StorageRecord> > pending;
+        QHash<int, QPointer<StorageReply> > replies;
+        // touched by the pool thread only
+        QHash<QString, SegmentIndex*> indexes;
+        QMutex mutex;
+        QHash<int, QList<StorageRecord> > results;
+    } d;
+};
+
+#endif // SEGMENTSTORAGE_H
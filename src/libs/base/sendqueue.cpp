@@ -0,0 +1,194 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "sendqueue.h"
+#include <IrcConnection>
+#include <IrcCommand>
+#include <IrcMessage>
+#include <QTimerEvent>
+#include <QSettings>
+
+SendQueue::SendQueue(IrcConnection* connection) : QObject(connection)
+{
+    QSettings settings;
+    d.burst = qMax(1, settings.value("floodBurst", 5).toInt());
+    d.interval = qMax(1, settings.value("floodInterval", 2000).toInt());
+    d.sent = 0;
+    d.total = 0;
+    d.sending = false;
+    d.tokens = d.burst;
+    d.clock.start();
+    d.connection = connection;
+
+    connection->installCommandFilter(this);
+    connect(connection, SIGNAL(disconnected()), this, SLOT(clear()));
+}
+
+SendQueue* SendQueue::instance(IrcConnection* connection)
+{
+    if (!connection)
+        return 0;
+
+    SendQueue* queue = connection->findChild<SendQueue*>(QString(), Qt::FindDirectChildrenOnly);
+    if (!queue)
+        queue = new SendQueue(connection);
+    return queue;
+}
+
+int SendQueue::burst() const
+{
+    return d.burst;
+}
+
+void SendQueue::setBurst(int burst)
+{
+    d.burst = qMax(1, burst);
+    d.tokens = qMin<qreal>(d.tokens, d.burst);
+}
+
+int SendQueue::interval() const
+{
+    return d.interval;
+}
+
+void SendQueue::setInterval(int msecs)
+{
+    d.interval = qMax(1, msecs);
+}
+
+int SendQueue::pending() const
+{
+    int count = 0;
+    for (int i = Urgent; i <= Bulk; ++i)
+        count += d.lanes[i].count();
+    return count;
+}
+
+bool SendQueue::send(IrcCommand* command, Lane lane)
+{
+    if (!command)
+        return false;
+
+    // client side commands never reach the wire, and keep-alives must not wait
+    const IrcCommand::Type type = command->type();
+    if (type == IrcCommand::Custom || type == IrcCommand::Ping || type == IrcCommand::Pong || type == IrcCommand::Quit)
+        lane = Urgent;
+
+    refill();
+    if (lane == Urgent || !d.connection->isConnected() || (!pending() && d.tokens >= 1))
+        return d.connection->sendCommand(command);
+
+    command->setParent(this);
+    d.lanes[lane].enqueue(command);
+    ++d.total;
+    emit progressChanged(d.sent, d.total);
+    if (!d.timer.isActive())
+        d.timer.start(qMax(10, qRound((1 - d.tokens) * d.interval)), this);
+    return true;
+}
+
+IrcMessage* SendQueue::echo(IrcCommand* command) const
+{
+    // the local line is shown before the command is sent, the command and
+    // the line share a label the server echo is matched against, see
+    // TextDocument::confirmEcho()
+    static int label = 0;
+    IrcMessage* message = command ? command->toMessage(d.connection->nickName(), d.connection) : 0;
+    if (message) {
+        label = qMax(1, label + 1); // overflow -> 1
+        message->setProperty("echo", label);
+        command->setProperty("echo", label);
+    }
+    return message;
+}
+
+bool SendQueue::commandFilter(IrcCommand* command)
+{
+    // whatever is sent around the queue still spends from the same bucket
+    if (!d.sending && command->type() != IrcCommand::Custom) {
+        refill();
+        d.tokens = qMax<qreal>(0, d.tokens - 1);
+    }
+    return false;
+}
+
+void SendQueue::clear()
+{
+    for (int i = Urgent; i <= Bulk; ++i) {
+        qDeleteAll(d.lanes[i]);
+        d.lanes[i].clear();
+    }
+    d.timer.stop();
+    if (d.total) {
+        d.sent = 0;
+        d.total = 0;
+        emit progressChanged(0, 0);
+    }
+}
+
+void SendQueue::timerEvent(QTimerEvent* event)
+{
+    if (event->timerId() == d.timer.timerId())
+        flush();
+    else
+        QObject::timerEvent(event);
+}
+
+void SendQueue::refill()
+{
+    d.tokens = qMin<qreal>(d.burst, d.tokens + qreal(d.clock.restart()) / d.interval);
+}
+
+void SendQueue::flush()
+{
+    refill();
+    int lane = Urgent;
+    while (d.tokens >= 1 && lane <= Bulk) {
+        if (d.lanes[lane].isEmpty()) {
+            ++lane;
+            continue;
+        }
+        IrcCommand* command = d.lanes[lane].dequeue();
+        d.sending = true;
+        d.connection->sendCommand(command);
+        d.sending = false;
+        delete command;
+        d.tokens -= 1;
+        ++d.sent;
+    }
+
+    if (pending()) {
+        d.timer.start(qMax(10, qRound((1 - d.tokens) * d.interval)), this);
+        emit progressChanged(d.sent, d.total);
+    } else {
+        d.timer.stop();
+        d.sent = 0;
+        d.total = 0;
+        emit progressChanged(0, 0);
+    }
+}
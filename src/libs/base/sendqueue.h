@@ -0,0 +1,95 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SENDQUEUE_H
+#define SENDQUEUE_H
+
+#include <QQueue>
+#include <QObject>
+#include <QBasicTimer>
+#include <QElapsedTimer>
+#include <IrcCommandFilter>
+#include "baseglobal.h"
+
+class IrcCommand;
+class IrcMessage;
+class IrcConnection;
+
+class BASE_EXPORT SendQueue : public QObject, public IrcCommandFilter
+{
+    Q_OBJECT
+    Q_INTERFACES(IrcCommandFilter)
+
+public:
+    enum Lane { Urgent, Interactive, Bulk };
+
+    static SendQueue* instance(IrcConnection* connection);
+
+    int burst() const;
+    void setBurst(int burst);
+
+    int interval() const;
+    void setInterval(int msecs);
+
+    int pending() const;
+
+    bool send(IrcCommand* command, Lane lane = Interactive);
+    IrcMessage* echo(IrcCommand* command) const;
+
+    bool commandFilter(IrcCommand* command);
+
+public slots:
+    void clear();
+
+signals:
+    void progressChanged(int sent, int total);
+
+protected:
+    void timerEvent(QTimerEvent* event);
+
+private:
+    explicit SendQueue(IrcConnection* connection);
+
+    void refill();
+    void flush();
+
+    struct Private {
+        int burst;
+        int interval;
+        int sent;
+        int total;
+        bool sending;
+        qreal tokens;
+        QBasicTimer timer;
+        QElapsedTimer clock;
+        IrcConnection* connection;
+        QQueue<IrcCommand*> lanes[Bulk + 1];
+    } d;
+};
+
+#endif // SENDQUEUE_H
@@ -0,0 +1,167 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "settingscache.h"
+#include "taskscheduler.h"
+#include <QCoreApplication>
+#include <QRunnable>
+#include <QSettings>
+#include <QPointer>
+
+// dirty keys are written back this many milliseconds after the last change
+static const int WriteBackDelay = 1000;
+
+class SettingsTask : public QRunnable
+{
+public:
+    SettingsTask(bool clear, const QVariantMap& values, const QStringList& removed)
+        : m_clear(clear), m_values(values), m_removed(removed)
+    {
+    }
+
+    void run()
+    {
+        // a private instance, nothing is shared with the main thread
+        QSettings settings;
+        if (m_clear)
+            settings.clear();
+        foreach (const QString& key, m_removed)
+            settings.remove(key);
+        for (QVariantMap::const_iterator it = m_values.constBegin(); it != m_values.constEnd(); ++it)
+            settings.setValue(it.key(), it.value());
+        settings.sync();
+    }
+
+private:
+    bool m_clear;
+    QVariantMap m_values;
+    QStringList m_removed;
+};
+
+SettingsCache::SettingsCache(QObject* parent) : QObject(parent)
+{
+    d.cleared = false;
+    // one writer keeps the write-backs in order
+    d.pool.setMaxThreadCount(1);
+
+    // the one and only read, everything after is served from memory
+    QSettings settings;
+    foreach (const QString& key, settings.allKeys())
+        d.values.insert(key, settings.value(key));
+
+    connect(QCoreApplication::instance(), SIGNAL(aboutToQuit()), this, SLOT(sync()));
+}
+
+SettingsCache::~SettingsCache()
+{
+    // the scheduler may be gone already, late changes are written right away
+    flush();
+    d.pool.waitForDone();
+}
+
+SettingsCache* SettingsCache::instance()
+{
+    static QPointer<SettingsCache> cache;
+    if (!cache)
+        cache = new SettingsCache(QCoreApplication::instance());
+    return cache;
+}
+
+bool SettingsCache::contains(const QString& key) const
+{
+    return d.values.contains(key);
+}
+
+QVariant SettingsCache::value(const QString& key, const QVariant& defaultValue) const
+{
+    return d.values.value(key, defaultValue);
+}
+
+void SettingsCache::setValue(const QString& key, const QVariant& value)
+{
+    QVariantMap::iterator it = d.values.find(key);
+    if (it != d.values.end() && it.value() == value)
+        return;
+    d.values.insert(key, value);
+    markDirty(key);
+    emit valueChanged(key, value);
+}
+
+void SettingsCache::remove(const QString& key)
+{
+    if (d.values.remove(key) == 0)
+        return;
+    markDirty(key);
+    emit valueChanged(key, QVariant());
+}
+
+void SettingsCache::clear()
+{
+    const QStringList keys = d.values.keys();
+    d.values.clear();
+    d.dirty.clear();
+    d.cleared = true;
+    TaskScheduler::instance()->schedule(TaskScheduler::Flush, this, "flush", WriteBackDelay);
+    foreach (const QString& key, keys)
+        emit valueChanged(key, QVariant());
+}
+
+void SettingsCache::sync()
+{
+    // blocks until everything so far is on disk
+    TaskScheduler::instance()->unschedule(this, "flush");
+    flush();
+    d.pool.waitForDone();
+}
+
+void SettingsCache::flush()
+{
+    if (!d.cleared && d.dirty.isEmpty())
+        return;
+
+    // the worker gets a copy of the dirty values, later changes go in the next round
+    QVariantMap values;
+    QStringList removed;
+    foreach (const QString& key, d.dirty) {
+        QVariantMap::const_iterator it = d.values.constFind(key);
+        if (it != d.values.constEnd())
+            values.insert(key, it.value());
+        else
+            removed += key;
+    }
+    d.pool.start(new SettingsTask(d.cleared, values, removed));
+    d.dirty.clear();
+    d.cleared = false;
+}
+
+void SettingsCache::markDirty(const QString& key)
+{
+    // the first change starts the clock, later ones go along with it
+    d.dirty.insert(key);
+    TaskScheduler::instance()->schedule(TaskScheduler::Flush, this, "flush", WriteBackDelay);
+}
@@ -0,0 +1,332 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "spillstore.h"
+#include <QCoreApplication>
+#include <QStandardPaths>
+#include <QMutexLocker>
+#include <QDataStream>
+#include <QPointer>
+#include <QFile>
+#include <QDir>
+
+// a segment is closed once it grows past this, a document keeps at most
+// so many of them, and all documents together stay below the total
+static const qint64 SegmentSize = 2 * 1024 * 1024;
+static const int MaximumSegments = 32;
+static const qint64 MaximumTotal = Q_INT64_C(512) * 1024 * 1024;
+static const int MaximumOpenFiles = 16;
+
+SpillStore* SpillStore::instance()
+{
+    static QPointer<SpillStore> store;
+    if (!store)
+        store = new SpillStore(QCoreApplication::instance());
+    return store;
+}
+
+SpillStore::SpillStore(QObject* parent) : QThread(parent)
+{
+    d.dirPath = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/scrollback";
+    d.quit = false;
+    d.posted = 0;
+    d.finished = 0;
+    d.total = 0;
+    setObjectName("SpillStore");
+    start(LowPriority);
+}
+
+SpillStore::~SpillStore()
+{
+    {
+        QMutexLocker locker(&d.mutex);
+        d.quit = true;
+        d.wakeup.wakeAll();
+    }
+    wait();
+}
+
+QString SpillStore::dirPath() const
+{
+    return d.dirPath;
+}
+
+void SpillStore::append(const QString& name, const QList<QByteArray>& records)
+{
+    if (name.isEmpty() || records.isEmpty())
+        return;
+
+    Job job;
+    job.kind = Job::Append;
+    job.name = name;
+    job.records = records;
+    qint64 bytes = 0;
+    foreach (const QByteArray& record, records)
+        bytes += record.size();
+    {
+        QMutexLocker locker(&d.mutex);
+        d.sizes[name] += bytes;
+    }
+    enqueue(job);
+}
+
+QList<QByteArray> SpillStore::takeLast(const QString& name, int count)
+{
+    if (name.isEmpty() || count <= 0 || size(name) <= 0)
+        return QList<QByteArray>();
+
+    Job job;
+    job.kind = Job::Take;
+    job.name = name;
+    job.count = count;
+    const quint64 ticket = enqueue(job);
+
+    QMutexLocker locker(&d.mutex);
+    while (d.finished < ticket)
+        d.done.wait(&d.mutex);
+    return d.results.take(ticket);
+}
+
+void SpillStore::remove(const QString& name)
+{
+    if (name.isEmpty())
+        return;
+
+    Job job;
+    job.kind = Job::Remove;
+    job.name = name;
+    {
+        QMutexLocker locker(&d.mutex);
+        d.sizes.remove(name);
+    }
+    enqueue(job);
+}
+
+qint64 SpillStore::size(const QString& name) const
+{
+    QMutexLocker locker(&d.mutex);
+    return d.sizes.value(name);
+}
+
+quint64 SpillStore::enqueue(const Job& job)
+{
+    QMutexLocker locker(&d.mutex);
+    Job queued = job;
+    queued.ticket = ++d.posted;
+    d.queue += queued;
+    d.wakeup.wakeAll();
+    return queued.ticket;
+}
+
+void SpillStore::run()
+{
+    // whatever an earlier session left behind is of no use to this one
+    QDir(d.dirPath).removeRecursively();
+    QDir().mkpath(d.dirPath);
+
+    forever {
+        QList<Job> jobs;
+        {
+            QMutexLocker locker(&d.mutex);
+            while (d.queue.isEmpty() && !d.quit)
+                d.wakeup.wait(&d.mutex);
+            if (d.quit)
+                break;
+            jobs.swap(d.queue);
+        }
+
+        foreach (const Job& job, jobs) {
+            QList<QByteArray> rows;
+            if (job.kind == Job::Append)
+                write(job.name, job.records);
+            else if (job.kind == Job::Take)
+                rows = take(job.name, job.count);
+            else
+                erase(job.name);
+
+            QMutexLocker locker(&d.mutex);
+            if (job.kind == Job::Take)
+                d.results.insert(job.ticket, rows);
+            d.finished = job.ticket;
+            d.done.wakeAll();
+        }
+
+        // one flush per file for the whole batch
+        foreach (QFile* file, d.files)
+            file->flush();
+        prune();
+    }
+
+    qDeleteAll(d.files);
+    d.files.clear();
+    QDir(d.dirPath).removeRecursively();
+}
+
+void SpillStore::write(const QString& name, const QList<QByteArray>& records)
+{
+    Segments& segments = d.segments[name];
+    QFile* current = 0;
+    qint64 dropped = 0;
+    foreach (const QByteArray& record, records) {
+        if (segments.indexes.isEmpty() || d.bytes.value(segmentPath(name, segments.indexes.last())) >= SegmentSize) {
+            segments.indexes += segments.next;
+            d.order += qMakePair(name, segments.next);
+            ++segments.next;
+            if (segments.indexes.count() > MaximumSegments)
+                dropped += drop(name, segments.indexes.first());
+            current = 0;
+        }
+        if (!current) {
+            current = file(name, segments.indexes.last());
+            if (!current || !current->seek(current->size()))
+                break;
+        }
+        if (current->write(record) != record.size())
+            break;
+        d.bytes[current->fileName()] += record.size();
+        d.total += record.size();
+    }
+
+    if (dropped > 0) {
+        QMutexLocker locker(&d.mutex);
+        if (d.sizes.contains(name))
+            d.sizes[name] = qMax(Q_INT64_C(0), d.sizes.value(name) - dropped);
+    }
+}
+
+QList<QByteArray> SpillStore::take(const QString& name, int count)
+{
+    // records end in their qint32 size, so they are read back from the end
+    QList<QByteArray> payloads;
+    qint64 taken = 0;
+    Segments& segments = d.segments[name];
+    while (payloads.count() < count && !segments.indexes.isEmpty()) {
+        const int index = segments.indexes.last();
+        QFile* file = this->file(name, index);
+        if (!file)
+            break;
+
+        const qint64 end = file->size();
+        qint64 pos = end;
+        QDataStream in(file);
+        while (payloads.count() < count && pos > qint64(sizeof(qint32))) {
+            qint32 size = 0;
+            if (!file->seek(pos - sizeof(qint32)))
+                break;
+            in >> size;
+            const qint64 start = pos - sizeof(qint32) - size;
+            if (size <= 0 || start < 0 || !file->seek(start))
+                break;
+            const QByteArray payload = file->read(size);
+            if (payload.size() != size)
+                break;
+            payloads.prepend(payload);
+            pos = start;
+        }
+
+        // a segment read up to its start, or one that is damaged, goes away
+        if (payloads.count() < count || pos == 0) {
+            taken += end;
+            drop(name, index);
+        } else {
+            taken += end - pos;
+            d.total -= end - pos;
+            d.bytes[file->fileName()] = pos;
+            file->resize(pos);
+        }
+    }
+
+    QMutexLocker locker(&d.mutex);
+    if (d.sizes.contains(name))
+        d.sizes[name] = qMax(Q_INT64_C(0), d.sizes.value(name) - taken);
+    return payloads;
+}
+
+void SpillStore::erase(const QString& name)
+{
+    const QList<int> indexes = d.segments.value(name).indexes;
+    foreach (int index, indexes)
+        drop(name, index);
+    d.segments.remove(name);
+}
+
+qint64 SpillStore::drop(const QString& name, int index)
+{
+    const QString path = segmentPath(name, index);
+    delete d.files.take(path);
+    d.recent.removeOne(path);
+    d.order.removeOne(qMakePair(name, index));
+    const qint64 bytes = d.bytes.take(path);
+    d.total -= bytes;
+    QFile::remove(path);
+    if (d.segments.contains(name))
+        d.segments[name].indexes.removeOne(index);
+    return bytes;
+}
+
+void SpillStore::prune()
+{
+    // all documents together are held below the total, oldest segment first
+    while (d.total > MaximumTotal && !d.order.isEmpty()) {
+        const QPair<QString, int> oldest = d.order.first();
+        const qint64 bytes = drop(oldest.first, oldest.second);
+
+        QMutexLocker locker(&d.mutex);
+        if (d.sizes.contains(oldest.first))
+            d.sizes[oldest.first] = qMax(Q_INT64_C(0), d.sizes.value(oldest.first) - bytes);
+    }
+}
+
+QFile* SpillStore::file(const QString& name, int index)
+{
+    // the most recently used files stay open, the rest are reopened on demand
+    const QString path = segmentPath(name, index);
+    QFile* file = d.files.value(path);
+    if (file) {
+        d.recent.removeOne(path);
+        d.recent += path;
+        return file;
+    }
+
+    while (d.files.count() >= MaximumOpenFiles && !d.recent.isEmpty())
+        delete d.files.take(d.recent.takeFirst());
+
+    file = new QFile(path);
+    if (!file->open(QIODevice::ReadWrite)) {
+        delete file;
+        return 0;
+    }
+    d.files.insert(path, file);
+    d.recent += path;
+    return file;
+}
+
+QString SpillStore::segmentPath(const QString& name, int index) const
+{
+    return d.dirPath + "/" + name + "-" + QString::number(index) + ".seg";
+}
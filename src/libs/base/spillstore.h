@@ -0,0 +1,120 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SPILLSTORE_H
+#define SPILLSTORE_H
+
+#include <QHash>
+#include <QList>
+#include <QPair>
+#include <QMutex>
+#include <QThread>
+#include <QString>
+#include <QByteArray>
+#include <QWaitCondition>
+#include "baseglobal.h"
+
+class QFile;
+
+// the scrollback trimmed off documents, see MessageStore::spill(). each
+// document appends to a few capped segments, written in batches by a
+// thread of its own that keeps only a handful of files open at a time.
+// nothing outlives the session, leftovers are removed on startup.
+class BASE_EXPORT SpillStore : public QThread
+{
+    Q_OBJECT
+
+public:
+    static SpillStore* instance();
+    ~SpillStore();
+
+    QString dirPath() const;
+
+    // records are framed by the caller, the newest come last
+    void append(const QString& name, const QList<QByteArray>& records);
+
+    // blocks until the appends before it are written
+    QList<QByteArray> takeLast(const QString& name, int count);
+
+    void remove(const QString& name);
+    qint64 size(const QString& name) const;
+
+protected:
+    void run();
+
+private:
+    explicit SpillStore(QObject* parent);
+
+    struct Job {
+        enum Kind { Append, Take, Remove };
+        Job() : kind(Append), count(0), ticket(0) { }
+        Kind kind;
+        QString name;
+        QList<QByteArray> records;
+        int count;
+        quint64 ticket;
+    };
+
+    struct Segments {
+        Segments() : next(0) { }
+        QList<int> indexes;
+        int next;
+    };
+
+    quint64 enqueue(const Job& job);
+    void write(const QString& name, const QList<QByteArray>& records);
+    QList<QByteArray> take(const QString& name, int count);
+    void erase(const QString& name);
+    qint64 drop(const QString& name, int index);
+    void prune();
+    QFile* file(const QString& name, int index);
+    QString segmentPath(const QString& name, int index) const;
+
+    struct Private {
+        QString dirPath;
+        mutable QMutex mutex;
+        QWaitCondition wakeup;
+        QWaitCondition done;
+        QList<Job> queue;
+        bool quit;
+        quint64 posted;
+        quint64 finished;
+        QHash<QString, qint64> sizes;
+        QHash<quint64, QList<QByteArray> > results;
+
+        // only touched by the spill thread
+        QHash<QString, Segments> segments;
+        QHash<QString, qint64> bytes;
+        QList<QPair<QString, int> > order;
+        QHash<QString, QFile*> files;
+        QList<QString> recent;
+        qint64 total;
+    } d;
+};
+
+#endif // SPILLSTORE_H
@@ -0,0 +1,112 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "stringpool.h"
+#include <IrcConnection>
+#include <QStringList>
+
+StringPool::StringPool(IrcConnection* connection) : QObject(connection)
+{
+    d.hits = 0;
+    d.misses = 0;
+    d.threshold = 1024;
+}
+
+StringPool* StringPool::instance(IrcConnection* connection)
+{
+    if (!connection)
+        return 0;
+
+    StringPool* pool = connection->findChild<StringPool*>(QString(), Qt::FindDirectChildrenOnly);
+    if (!pool)
+        pool = new StringPool(connection);
+    return pool;
+}
+
+QString StringPool::intern(const QString& str)
+{
+    if (str.isEmpty())
+        return str;
+
+    QSet<QString>::const_iterator it = d.strings.constFind(str);
+    if (it != d.strings.constEnd()) {
+        ++d.hits;
+        return *it;
+    }
+
+    ++d.misses;
+    d.strings.insert(str);
+    if (d.strings.count() >= d.threshold)
+        squeeze();
+    return str;
+}
+
+QStringList StringPool::intern(const QStringList& list)
+{
+    QStringList interned;
+    interned.reserve(list.count());
+    foreach (const QString& str, list)
+        interned += intern(str);
+    return interned;
+}
+
+int StringPool::count() const
+{
+    return d.strings.count();
+}
+
+int StringPool::hits() const
+{
+    return d.hits;
+}
+
+int StringPool::misses() const
+{
+    return d.misses;
+}
+
+qint64 StringPool::bytes() const
+{
+    qint64 bytes = 0;
+    foreach (const QString& str, d.strings)
+        bytes += str.capacity() * sizeof(QChar);
+    return bytes;
+}
+
+void StringPool::squeeze()
+{
+    // drop the strings nobody but the pool refers to anymore
+    QSet<QString>::iterator it = d.strings.begin();
+    while (it != d.strings.end()) {
+        if (it->isDetached())
+            it = d.strings.erase(it);
+        else
+            ++it;
+    }
+    d.threshold = qMax(1024, 2 * d.strings.count());
+}
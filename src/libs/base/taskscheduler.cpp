@@ -0,0 +1,167 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "taskscheduler.h"
+#include "hookstats.h"
+#include "inputlatency.h"
+#include <QCoreApplication>
+#include <QTimerEvent>
+
+// every wakeup lands on this grid, so tasks due close together share it
+static const int FrameInterval = 20;
+static const int ThrottleFactor = 4;
+
+static const int TaskFrames[] = { 2, 1, 10 };
+static const char* TaskNames[] = { "task/animation", "task/flush", "task/pacing" };
+
+TaskScheduler::TaskScheduler(QObject* parent) : QObject(parent)
+{
+    d.throttled = false;
+    d.wakeup = -1;
+    d.clock.start();
+}
+
+TaskScheduler* TaskScheduler::instance()
+{
+    static QPointer<TaskScheduler> scheduler;
+    if (!scheduler)
+        scheduler = new TaskScheduler(QCoreApplication::instance());
+    return scheduler;
+}
+
+int TaskScheduler::interval(Task task) const
+{
+    // in the background or on battery, everything ticks less often
+    const int interval = TaskFrames[task] * FrameInterval;
+    return d.throttled ? interval * ThrottleFactor : interval;
+}
+
+bool TaskScheduler::isThrottled() const
+{
+    return d.throttled;
+}
+
+void TaskScheduler::setThrottled(bool throttled)
+{
+    if (d.throttled != throttled) {
+        d.throttled = throttled;
+        restart();
+    }
+}
+
+void TaskScheduler::schedule(Task task, QObject* receiver, const char* member, int delay)
+{
+    // aligned up to the task's own period, a pending entry is not pushed back
+    const int period = interval(task);
+    const qint64 wanted = d.clock.elapsed() + qMax(0, delay);
+    const qint64 due = (wanted + period - 1) / period * period;
+
+    for (int i = 0; i < d.entries.count(); ++i) {
+        Entry& entry = d.entries[i];
+        if (entry.receiver == receiver && entry.member == member) {
+            entry.due = qMin(entry.due, due);
+            restart();
+            return;
+        }
+    }
+
+    Entry entry;
+    entry.task = task;
+    entry.due = due;
+    entry.receiver = receiver;
+    entry.member = member;
+    d.entries += entry;
+    restart();
+}
+
+void TaskScheduler::unschedule(QObject* receiver, const char* member)
+{
+    for (int i = d.entries.count() - 1; i >= 0; --i) {
+        const Entry& entry = d.entries.at(i);
+        if (entry.receiver == receiver && entry.member == member)
+            d.entries.removeAt(i);
+    }
+}
+
+bool TaskScheduler::isScheduled(QObject* receiver, const char* member) const
+{
+    foreach (const Entry& entry, d.entries) {
+        if (entry.receiver == receiver && entry.member == member)
+            return true;
+    }
+    return false;
+}
+
+void TaskScheduler::timerEvent(QTimerEvent* event)
+{
+    if (event->timerId() != d.timer.timerId()) {
+        QObject::timerEvent(event);
+        return;
+    }
+
+    d.timer.stop();
+    d.wakeup = -1;
+
+    // everything due runs in this wakeup, what it schedules waits for the next
+    const qint64 now = d.clock.elapsed();
+    QList<Entry> due;
+    for (int i = d.entries.count() - 1; i >= 0; --i) {
+        if (d.entries.at(i).due <= now)
+            due.prepend(d.entries.takeAt(i));
+    }
+
+    foreach (const Entry& entry, due) {
+        if (!entry.receiver)
+            continue;
+        InputLatency::note(TaskNames[entry.task]);
+        QElapsedTimer timer;
+        timer.start();
+        QMetaObject::invokeMethod(entry.receiver, entry.member.constData());
+        HookStats::instance()->counter(TaskNames[entry.task])->add(timer.nsecsElapsed());
+    }
+    restart();
+}
+
+void TaskScheduler::restart()
+{
+    qint64 wakeup = -1;
+    for (int i = d.entries.count() - 1; i >= 0; --i) {
+        if (!d.entries.at(i).receiver)
+            d.entries.removeAt(i);
+        else if (wakeup == -1 || d.entries.at(i).due < wakeup)
+            wakeup = d.entries.at(i).due;
+    }
+
+    if (wakeup == -1) {
+        d.timer.stop();
+        d.wakeup = -1;
+    } else if (wakeup != d.wakeup || !d.timer.isActive()) {
+        d.wakeup = wakeup;
+        d.timer.start(qMax<qint64>(0, wakeup - d.clock.elapsed()), this);
+    }
+}
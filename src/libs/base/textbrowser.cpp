@@ -28,8 +28,15 @@
 
 #include "textbrowser.h"
 #include "textdocument.h"
+#include "taskscheduler.h"
+#include "textexport.h"
+#include "hookstats.h"
+#include "inputlatency.h"
 #include <QAbstractTextDocumentLayout>
 #include <QDesktopServices>
+#include <QProgressDialog>
+#include <QStandardPaths>
+#include <QFileDialog>
 #include <QStylePainter>
 #include <QStyleOption>
 #include <QApplication>
@@ -42,11 +49,27 @@
 #include <QToolTip>
 #include <QAction>
 #include <QMenu>
+#if QT_VERSION >= 0x050400 && !defined(QT_NO_OPENGL)
+#include <QOpenGLWidget>
+#endif
+
+static bool acceleratedViewports = false;
+
+// selections spanning more rows than this are copied on a worker
+static const int StreamedCopyRows = 500;
+
+// marks are recomputed at most this often, and clicked within this many pixels
+static const int MarksInterval = 100;
+static const int MarkTolerance = 4;
 
 TextBrowser::TextBrowser(QWidget* parent) : QTextBrowser(parent)
 {
     d.bud = 0;
     d.events = true;
+    d.bottom = false;
+    d.delta = 0;
+    d.zoom = 0;
+    d.accelerated = false;
 
     setOpenLinks(false);
     setTabChangesFocus(true);
@@ -54,6 +77,10 @@ TextBrowser::TextBrowser(QWidget* parent) : QTextBrowser(parent)
     setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
 
     connect(this, SIGNAL(anchorClicked(QUrl)), this, SLOT(onAnchorClicked(QUrl)));
+    connect(verticalScrollBar(), SIGNAL(valueChanged(int)), this, SLOT(onScrolled(int)));
+    verticalScrollBar()->installEventFilter(this);
+
+    setAccelerated(acceleratedViewports);
 }
 
 TextBrowser::~TextBrowser()
@@ -86,19 +113,33 @@ void TextBrowser::setDocument(TextDocument* document)
     if (doc != document) {
         if (doc) {
             doc->setVisible(false);
+            doc->setViewportLimited(true);
             disconnect(doc->documentLayout(), SIGNAL(documentSizeChanged(QSizeF)), this, SLOT(keepAtBottom()));
             disconnect(doc, SIGNAL(lineRemoved(int)), this, SLOT(keepPosition(int)));
+            disconnect(doc, SIGNAL(linesPrepended(int)), this, SLOT(keepOffset(int)));
+            disconnect(doc->documentLayout(), SIGNAL(update(QRectF)), this, SLOT(invalidateCache(QRectF)));
+            disconnect(doc->documentLayout(), SIGNAL(documentSizeChanged(QSizeF)), this, SLOT(scheduleMarks()));
         }
         if (document) {
             document->setVisible(true);
             document->setDefaultFont(font());
             connect(document->documentLayout(), SIGNAL(documentSizeChanged(QSizeF)), this, SLOT(keepAtBottom()));
             connect(document, SIGNAL(lineRemoved(int)), this, SLOT(keepPosition(int)));
+            connect(document, SIGNAL(linesPrepended(int)), this, SLOT(keepOffset(int)));
+            connect(document->documentLayout(), SIGNAL(update(QRectF)), this, SLOT(invalidateCache(QRectF)));
+            connect(document->documentLayout(), SIGNAL(documentSizeChanged(QSizeF)), this, SLOT(scheduleMarks()));
         }
+        d.cache = QPixmap();
+        d.searchRows.clear();
+        scheduleMarks();
         connect(this, SIGNAL(textChanged()), this, SLOT(moveCursorToBottom()));
         QTextBrowser::setDocument(document);
         disconnect(this, SIGNAL(textChanged()), this, SLOT(moveCursorToBottom()));
+        TaskScheduler::instance()->unschedule(this, "applyAnchor");
+        d.bottom = false;
+        d.delta = 0;
         scrollToBottom();
+        updateViewport();
         emit documentChanged(document);
     }
 }
@@ -156,6 +197,7 @@ void TextBrowser::keyPressEvent(QKeyEvent* event)
                 break;
             default:
                 if (!event->matches(QKeySequence::Copy) && !event->matches(QKeySequence::SelectAll)) {
+                    InputLatency::keyPressed();
                     QCoreApplication::sendEvent(d.bud, event);
                     QWidget* focus = qApp->focusWidget();
                     if (!focus || !focus->inherits("QLineEdit") || (focus->inherits("TextInput") && !isAncestorOf(focus)))
@@ -165,6 +207,10 @@ void TextBrowser::keyPressEvent(QKeyEvent* event)
                 break;
         }
     }
+    if (event->matches(QKeySequence::Copy)) {
+        copySelection();
+        return;
+    }
     QTextBrowser::keyPressEvent(event);
 }
 
@@ -174,6 +220,7 @@ void TextBrowser::resizeEvent(QResizeEvent* event)
 
     // http://www.qtsoftware.com/developer/task-tracker/index_html?method=entry&id=240940
     QMetaObject::invokeMethod(this, "scrollToBottom", Qt::QueuedConnection);
+    TaskScheduler::instance()->schedule(TaskScheduler::Animation, this, "updateViewport");
 }
 
 bool TextBrowser::isAtTop() const
@@ -186,6 +233,21 @@ bool TextBrowser::isAtBottom() const
     return verticalScrollBar()->value() >= verticalScrollBar()->maximum();
 }
 
+bool TextBrowser::isViewportLimited() const
+{
+    TextDocument* doc = document();
+    return !doc || doc->isViewportLimited();
+}
+
+void TextBrowser::setViewportLimited(bool limited)
+{
+    TextDocument* doc = document();
+    if (doc && doc->isViewportLimited() != limited) {
+        doc->setViewportLimited(limited);
+        updateViewport();
+    }
+}
+
 bool TextBrowser::isZoomed() const
 {
     QFont f = font();
@@ -255,9 +317,88 @@ QMenu* TextBrowser::createContextMenu(const QPoint& pos)
         channelAction->setText(channel);
         joinAction->setData(channel);
     }
+
+    // large selections take the streamed path, see copySelection()
+    QAction* copyAction = menu->findChild<QAction*>("edit-copy");
+    if (copyAction) {
+        disconnect(copyAction, SIGNAL(triggered()), 0, 0);
+        connect(copyAction, SIGNAL(triggered()), this, SLOT(copySelection()));
+    }
+
+    menu->addSeparator();
+    QAction* exportAction = menu->addAction(tr("Export..."));
+    exportAction->setEnabled(document() != 0);
+    connect(exportAction, SIGNAL(triggered()), this, SLOT(exportToFile()));
     return menu;
 }
 
+static bool hasPlaceholders(TextDocument* doc, int first, int last)
+{
+    for (int row = first; row <= last; ++row) {
+        if (doc->isPlaceholder(row))
+            return true;
+    }
+    return false;
+}
+
+void TextBrowser::copySelection()
+{
+    // the layout converts a selection to html and text in one go on this
+    // thread, the rows in the store are cheaper to walk in the background,
+    // and placeholders have no text for the layout to copy in the first place
+    int first = 0, last = 0;
+    if (!selectedRows(&first, &last) || (last - first < StreamedCopyRows && !hasPlaceholders(document(), first, last))) {
+        copy();
+        return;
+    }
+    TextExport* job = new TextExport(document(), first, last, this);
+    runExport(job, tr("Copying %n lines...", 0, job->count()));
+    job->toClipboard();
+}
+
+void TextBrowser::exportToFile()
+{
+    TextDocument* doc = document();
+    if (!doc)
+        return;
+
+    // the selection if any, the whole buffer otherwise
+    int first = 0, last = doc->totalCount() - 1;
+    selectedRows(&first, &last);
+
+    const QString dirPath = QStandardPaths::writableLocation(QStandardPaths::DocumentsLocation);
+    const QString filePath = QFileDialog::getSaveFileName(this, tr("Export"), dirPath + "/" + buffer()->title() + ".txt",
+                                                          tr("Plain text (*.txt);;HTML (*.html);;JSON lines (*.jsonl)"));
+    if (filePath.isEmpty())
+        return;
+
+    TextExport* job = new TextExport(doc, first, last, this);
+    runExport(job, tr("Exporting %n lines...", 0, job->count()));
+    job->toFile(filePath, TextExport::formatOf(filePath));
+}
+
+bool TextBrowser::selectedRows(int* first, int* last) const
+{
+    // every row is a block of its own
+    const QTextCursor cursor = textCursor();
+    if (!document() || !cursor.hasSelection())
+        return false;
+    *first = QTextBrowser::document()->findBlock(cursor.selectionStart()).blockNumber();
+    *last = QTextBrowser::document()->findBlock(cursor.selectionEnd()).blockNumber();
+    return true;
+}
+
+void TextBrowser::runExport(TextExport* job, const QString& label)
+{
+    // quick ones are done before the dialog would show up
+    QProgressDialog* dialog = new QProgressDialog(label, tr("Cancel"), 0, job->count(), this);
+    dialog->setMinimumDuration(500);
+    connect(job, SIGNAL(progress(int)), dialog, SLOT(setValue(int)));
+    connect(dialog, SIGNAL(canceled()), job, SLOT(cancel()));
+    connect(job, SIGNAL(finished(bool)), dialog, SLOT(deleteLater()));
+    connect(job, SIGNAL(finished(bool)), job, SLOT(deleteLater()));
+}
+
 void TextBrowser::clear()
 {
     QTextBrowser::clear();
@@ -268,11 +409,26 @@ void TextBrowser::clear()
 
 void TextBrowser::resetZoom()
 {
+    TaskScheduler::instance()->unschedule(this, "applyZoom");
+    d.zoom = 0;
+
     QFont f = font();
     f.setPointSize(QFont().pointSize());
     setFont(f);
 }
 
+void TextBrowser::zoomIn(int range)
+{
+    // every font change relayouts the whole document, held keys collapse into one
+    d.zoom += range;
+    TaskScheduler::instance()->schedule(TaskScheduler::Animation, this, "applyZoom");
+}
+
+void TextBrowser::zoomOut(int range)
+{
+    zoomIn(-range);
+}
+
 void TextBrowser::scrollToTop()
 {
     verticalScrollBar()->triggerAction(QScrollBar::SliderToMinimum);
@@ -304,26 +460,209 @@ void TextBrowser::scrollToPreviousPage()
     scrollPage(verticalScrollBar(), -0.667);
 }
 
+bool TextBrowser::acceleration()
+{
+    return acceleratedViewports;
+}
+
+void TextBrowser::setAcceleration(bool enabled)
+{
+    acceleratedViewports = enabled;
+}
+
+bool TextBrowser::isAccelerated() const
+{
+    return d.accelerated;
+}
+
+void TextBrowser::setAccelerated(bool accelerated)
+{
+#if QT_VERSION >= 0x050400 && !defined(QT_NO_OPENGL)
+    if (d.accelerated == accelerated)
+        return;
+
+    // the text layer stays a raster cache, scrolling composites it on the gpu
+    QWidget* viewport = accelerated ? new QOpenGLWidget : new QWidget;
+    viewport->setMouseTracking(true);
+    viewport->setAttribute(Qt::WA_AcceptTouchEvents, false);
+    setViewport(viewport);
+    d.accelerated = accelerated;
+    d.cache = QPixmap();
+    d.dirty = QRegion();
+#else
+    Q_UNUSED(accelerated);
+#endif
+}
+
 void TextBrowser::paintEvent(QPaintEvent* event)
 {
+    HookStats::Scope scope("TextBrowser::paint");
     const int hoffset = horizontalScrollBar()->value();
     const int voffset = verticalScrollBar()->value();
-    const QRect bounds = rect().translated(hoffset, voffset);
 
+    // selections are painted by the text control, they take the slow path
     TextDocument* doc = document();
-    if (doc) {
-        QPainter painter(viewport());
-        painter.translate(-hoffset, -voffset);
-        doc->drawBackground(&painter, bounds);
+    if (!doc || textCursor().hasSelection() || !extraSelections().isEmpty()) {
+        const QRect bounds = rect().translated(hoffset, voffset);
+        if (doc) {
+            QPainter painter(viewport());
+            painter.translate(-hoffset, -voffset);
+            doc->drawBackground(&painter, bounds);
+        }
+
+        QTextBrowser::paintEvent(event);
+
+        if (doc) {
+            QPainter painter(viewport());
+            painter.translate(-hoffset, -voffset);
+            doc->drawForeground(&painter, bounds);
+        }
+        return;
     }
 
-    QTextBrowser::paintEvent(event);
+    updateCache(QPoint(hoffset, voffset));
+
+    // highlights under the cached text, the marker over it
+    const QRect bounds = event->rect().translated(hoffset, voffset);
+    QPainter painter(viewport());
+    painter.setClipRegion(event->region());
+    painter.translate(-hoffset, -voffset);
+    doc->drawBackground(&painter, bounds);
+    painter.resetTransform();
+    painter.drawPixmap(0, 0, d.cache);
+    painter.translate(-hoffset, -voffset);
+    doc->drawForeground(&painter, bounds);
+}
 
-    if (doc) {
-        QPainter painter(viewport());
-        painter.translate(-hoffset, -voffset);
-        doc->drawForeground(&painter, bounds);
+void TextBrowser::changeEvent(QEvent* event)
+{
+    if (event->type() == QEvent::PaletteChange || event->type() == QEvent::FontChange || event->type() == QEvent::StyleChange)
+        d.cache = QPixmap();
+    QTextBrowser::changeEvent(event);
+}
+
+void TextBrowser::invalidateCache(const QRectF& rect)
+{
+    const QPoint offset(horizontalScrollBar()->value(), verticalScrollBar()->value());
+    d.dirty += rect.toAlignedRect().translated(-offset).intersected(viewport()->rect());
+}
+
+QList<int> TextBrowser::searchRows() const
+{
+    return d.searchRows;
+}
+
+void TextBrowser::setSearchRows(const QList<int>& rows)
+{
+    if (d.searchRows != rows) {
+        d.searchRows = rows;
+        scheduleMarks();
+    }
+}
+
+void TextBrowser::scheduleMarks()
+{
+    TaskScheduler::instance()->schedule(TaskScheduler::Pacing, this, "updateMarks", MarksInterval);
+}
+
+void TextBrowser::updateMarks()
+{
+    // positions come from the measured row heights of the store, the layout
+    // is only asked for rows that were never measured
+    QVariantList marks;
+    TextDocument* doc = document();
+    const qreal height = doc ? doc->documentLayout()->documentSize().height() : 0;
+    if (doc && height > viewport()->height()) {
+        const qreal margin = doc->documentMargin();
+        foreach (int row, doc->highlightedRows())
+            marks += QPointF((margin + doc->rowOffset(row)) / height, HighlightMark);
+        foreach (int row, d.searchRows) {
+            if (row < doc->totalCount() - doc->pendingCount())
+                marks += QPointF((margin + doc->rowOffset(row)) / height, SearchMark);
+        }
+        const int marker = doc->scrollbackMarkerRow();
+        if (marker != -1)
+            marks += QPointF((margin + doc->rowOffset(marker)) / height, MarkerMark);
+    }
+    verticalScrollBar()->setProperty("marks", marks);
+    verticalScrollBar()->update();
+}
+
+bool TextBrowser::eventFilter(QObject* object, QEvent* event)
+{
+    // a click on a tick jumps to its row instead of paging
+    QScrollBar* bar = verticalScrollBar();
+    if (object == bar && event->type() == QEvent::MouseButtonPress) {
+        QMouseEvent* mouse = static_cast<QMouseEvent*>(event);
+        const QVariantList marks = bar->property("marks").toList();
+        if (mouse->button() == Qt::LeftButton && !marks.isEmpty()) {
+            QStyleOptionSlider option;
+            option.initFrom(bar);
+            option.orientation = bar->orientation();
+            option.minimum = bar->minimum();
+            option.maximum = bar->maximum();
+            option.sliderPosition = bar->sliderPosition();
+            option.sliderValue = bar->value();
+            option.singleStep = bar->singleStep();
+            option.pageStep = bar->pageStep();
+            option.subControls = QStyle::SC_All;
+            const QRect groove = bar->style()->subControlRect(QStyle::CC_ScrollBar, &option, QStyle::SC_ScrollBarGroove, bar);
+            const QRect slider = bar->style()->subControlRect(QStyle::CC_ScrollBar, &option, QStyle::SC_ScrollBarSlider, bar);
+            if (!slider.contains(mouse->pos()) && groove.height() > 0) {
+                const qreal height = document()->documentLayout()->documentSize().height();
+                foreach (const QVariant& mark, marks) {
+                    const qreal fraction = mark.toPointF().x();
+                    if (qAbs(groove.top() + fraction * groove.height() - mouse->pos().y()) <= MarkTolerance) {
+                        bar->setValue(qRound(fraction * height) - viewport()->height() / 3);
+                        return true;
+                    }
+                }
+            }
+        }
+    }
+    return QTextBrowser::eventFilter(object, event);
+}
+
+void TextBrowser::updateCache(const QPoint& offset)
+{
+    // the text layer is kept per scroll position, scrolling shifts it and
+    // only the exposed strip and whatever the layout touched is rendered again
+    const QRect rect = viewport()->rect();
+    const qreal ratio = devicePixelRatioF();
+    if (d.cache.isNull() || d.cache.devicePixelRatio() != ratio || d.cache.size() != rect.size() * ratio) {
+        d.cache = QPixmap(rect.size() * ratio);
+        d.cache.setDevicePixelRatio(ratio);
+        d.dirty = rect;
+    } else if (offset != d.offset) {
+        const QPoint delta = d.offset - offset;
+        if (qAbs(delta.x()) < rect.width() && qAbs(delta.y()) < rect.height()) {
+            d.cache.scroll(qRound(delta.x() * ratio), qRound(delta.y() * ratio), d.cache.rect());
+            d.dirty = d.dirty.translated(delta) + (QRegion(rect) - QRegion(rect.translated(delta)));
+        } else {
+            d.dirty = rect;
+        }
     }
+    d.offset = offset;
+
+    d.dirty &= rect;
+    if (d.dirty.isEmpty())
+        return;
+
+    // laying out while drawing may report more dirt, that goes to the next paint
+    const QRegion dirty = d.dirty;
+    d.dirty = QRegion();
+
+    QPainter painter(&d.cache);
+    painter.setClipRegion(dirty);
+    painter.setCompositionMode(QPainter::CompositionMode_Source);
+    painter.fillRect(dirty.boundingRect(), Qt::transparent);
+    painter.setCompositionMode(QPainter::CompositionMode_SourceOver);
+    painter.translate(-offset);
+
+    QAbstractTextDocumentLayout::PaintContext context;
+    context.palette = palette();
+    context.clip = dirty.boundingRect().translated(offset);
+    document()->documentLayout()->draw(&painter, context);
 }
 
 void TextBrowser::wheelEvent(QWheelEvent* event)
@@ -338,14 +677,113 @@ void TextBrowser::wheelEvent(QWheelEvent* event)
 
 void TextBrowser::keepAtBottom()
 {
-    if (isAtBottom())
-        QMetaObject::invokeMethod(this, "scrollToBottom", Qt::QueuedConnection);
+    // a busy channel grows many times per frame, one scroll covers all of it
+    if (isAtBottom()) {
+        d.bottom = true;
+        TaskScheduler::instance()->schedule(TaskScheduler::Animation, this, "applyAnchor");
+        TaskScheduler::instance()->schedule(TaskScheduler::Animation, this, "updateViewport");
+    }
 }
 
 void TextBrowser::keepPosition(int delta)
 {
-    if (!isAtBottom())
-        verticalScrollBar()->setValue(verticalScrollBar()->value() - delta);
+    if (!d.bottom && !isAtBottom()) {
+        d.delta += delta;
+        TaskScheduler::instance()->schedule(TaskScheduler::Animation, this, "applyAnchor");
+    }
+}
+
+void TextBrowser::keepOffset(int height)
+{
+    // lines prepended above the view push the content down
+    applyAnchor();
+    verticalScrollBar()->setValue(verticalScrollBar()->value() + height);
+}
+
+void TextBrowser::applyZoom()
+{
+    const int range = d.zoom;
+    d.zoom = 0;
+    if (!range)
+        return;
+
+    // the row at the top stays in place, or the view keeps following the bottom
+    const bool bottom = isAtBottom();
+    TextDocument* doc = document();
+    const int row = doc && !bottom ? doc->rowAt(QPoint(0, verticalScrollBar()->value())) : -1;
+
+    QTextBrowser::zoomIn(range);
+
+    if (bottom) {
+        scrollToBottom();
+    } else if (row != -1) {
+        const QTextBlock block = doc->findBlockByNumber(row);
+        if (block.isValid())
+            verticalScrollBar()->setValue(qRound(doc->documentLayout()->blockBoundingRect(block).top()));
+    }
+    TaskScheduler::instance()->schedule(TaskScheduler::Animation, this, "updateViewport");
+}
+
+void TextBrowser::applyAnchor()
+{
+    TaskScheduler::instance()->unschedule(this, "applyAnchor");
+
+    // sticking to the bottom wins over whatever was trimmed off the head
+    QScrollBar* bar = verticalScrollBar();
+    if (d.bottom)
+        scrollToBottom();
+    else if (d.delta)
+        bar->setValue(bar->value() - d.delta);
+    d.bottom = false;
+    d.delta = 0;
+}
+
+void TextBrowser::onScrolled(int value)
+{
+    TextDocument* doc = document();
+    if (!doc)
+        return;
+
+    QScrollBar* bar = verticalScrollBar();
+    if (value <= bar->minimum()) {
+        // page in older lines from the scrollback spill, or from the log
+        // store or the server once that runs dry, linesPrepended() anchors
+        const int count = qMax(50, bar->pageStep() / qMax(1, fontMetrics().lineSpacing()) * 2);
+        if (doc->hasHistory())
+            doc->loadHistory(count);
+        else
+            doc->fetchHistory(count);
+    } else if (value >= bar->maximum() && value > bar->minimum()) {
+        doc->releaseHistory();
+    }
+    TaskScheduler::instance()->schedule(TaskScheduler::Animation, this, "updateViewport");
+}
+
+static int rowTop(TextDocument* doc, int row)
+{
+    const QTextBlock block = doc->findBlockByNumber(row);
+    return block.isValid() ? qRound(doc->documentLayout()->blockBoundingRect(block).top()) : 0;
+}
+
+void TextBrowser::updateViewport()
+{
+    TaskScheduler::instance()->unschedule(this, "updateViewport");
+    TextDocument* doc = document();
+    if (!doc)
+        return;
+
+    // the row at the top stays in place while the rows above it get their real height
+    QScrollBar* bar = verticalScrollBar();
+    const bool bottom = isAtBottom();
+    const int first = doc->rowAt(QPoint(0, bar->value()));
+    const int last = doc->rowAt(QPoint(0, bar->value() + viewport()->height()));
+    const int top = rowTop(doc, first);
+    if (doc->setViewportRows(first, last, bottom)) {
+        if (bottom)
+            scrollToBottom();
+        else if (first != -1)
+            bar->setValue(bar->value() + rowTop(doc, first) - top);
+    }
 }
 
 void TextBrowser::moveCursorToBottom()
@@ -29,10 +29,13 @@
 #ifndef TEXTBROWSER_H
 #define TEXTBROWSER_H
 
+#include <QPixmap>
+#include <QRegion>
 #include <QTextBrowser>
 #include "baseglobal.h"
 
 class IrcBuffer;
+class TextExport;
 class TextDocument;
 
 class BASE_EXPORT TextBrowser : public QTextBrowser
@@ -55,16 +58,38 @@ public:
     bool isAtBottom() const;
     bool isZoomed() const;
 
+    static bool acceleration();
+    static void setAcceleration(bool enabled);
+
+    bool isAccelerated() const;
+    void setAccelerated(bool accelerated);
+
+    // see TextDocument::setViewportRows()
+    bool isViewportLimited() const;
+    void setViewportLimited(bool limited);
+
     QMenu* createContextMenu(const QPoint& pos);
 
+    // tick marks on the vertical scroll bar, see ScrollBarStyle
+    enum Mark { HighlightMark, SearchMark, MarkerMark };
+
+    QList<int> searchRows() const;
+    void setSearchRows(const QList<int>& rows);
+
+    bool eventFilter(QObject* object, QEvent* event);
+
 public slots:
     void clear();
     void resetZoom();
+    void zoomIn(int range = 1);
+    void zoomOut(int range = 1);
     void scrollToTop();
     void scrollToBottom();
     void scrollToNextPage();
     void scrollToPreviousPage();
     void moveCursorToBottom();
+    void copySelection();
+    void exportToFile();
 
 signals:
     void joined(const QString &channel);
@@ -76,12 +101,21 @@ protected:
     void mouseMoveEvent(QMouseEvent* event);
     void keyPressEvent(QKeyEvent* event);
     void paintEvent(QPaintEvent* event);
+    void changeEvent(QEvent* event);
     void resizeEvent(QResizeEvent* event);
     void wheelEvent(QWheelEvent* event);
 
 private slots:
     void keepAtBottom();
     void keepPosition(int delta);
+    void keepOffset(int height);
+    void applyAnchor();
+    void applyZoom();
+    void invalidateCache(const QRectF& rect);
+    void scheduleMarks();
+    void updateMarks();
+    void onScrolled(int value);
+    void updateViewport();
     void onAnchorClicked(const QUrl& url);
 
     void onWhoisTriggered();
@@ -89,9 +123,21 @@ private slots:
     void onJoinTriggered();
 
 private:
+    void updateCache(const QPoint& offset);
+    bool selectedRows(int* first, int* last) const;
+    void runExport(TextExport* job, const QString& label);
+
     struct Private {
         bool events;
+        bool bottom;
+        bool accelerated;
+        int delta;
+        int zoom;
         QWidget* bud;
+        QPoint offset;
+        QPixmap cache;
+        QRegion dirty;
+        QList<int> searchRows;
     } d;
 };
 
@@ -28,9 +28,21 @@
 
 #include "textdocument.h"
 #include "eventformatter.h"
+#include "flushscheduler.h"
+#include "formatpipeline.h"
+#include "messagetemplate.h"
+#include "memorybudget.h"
+#include "hookstats.h"
+#include "allocstats.h"
+#include "highlightmatcher.h"
+#include "taskscheduler.h"
+#include "linkpreview.h"
+#include "coldstore.h"
+#include "tracer.h"
 #include <QAbstractTextDocumentLayout>
 #include <QTextDocumentFragment>
-#include <QTextBlockUserData>
+#include <QCache>
+#include <QCryptographicHash>
 #include <IrcConnection>
 #include <QStylePainter>
 #include <QApplication>
@@ -41,11 +53,114 @@
 #include <IrcBuffer>
 #include <QPalette>
 #include <QPointer>
+#include <QPair>
+#include <QDrawUtil>
 #include <QPainter>
+#include <QPixmap>
+#include <QDateTime>
 #include <QFrame>
+#include <QFontMetricsF>
 #include <qmath.h>
+#include <limits>
+
+static const int maximumBlocks = 1000;
+static const int maximumTimeStamps = 4096;
+static const int maximumRecent = 256;
+static const int historyTimeout = 10000;
+static const int noSerial = std::numeric_limits<int>::min();
+static const int maximumGroupLines = 16;
+static const int firehoseFrame = 250;
+static const int firehoseVisibleLines = 100;
+static const int maximumRunFormats = 512;
+static const int freezeDelay = 5000;
+static const int minimumColdRows = 64;
+static const int maximumEchoes = 64;
+static const int viewportMargin = 100;
+
+// only touched by the gui thread, 0 keeps every line in a block of its own
+static int currentGroupWindow = 0;
+static bool directRuns = true;
+
+// lines mostly share their second with the previous line, so the timestamp
+// text is cached per second (or per millisecond for formats that show it)
+static QString cachedTimeStamp(QHash<qint64, QString>& cache, const QDateTime& timestamp, const QString& format)
+{
+    qint64 key = timestamp.toMSecsSinceEpoch();
+    if (!format.contains(QLatin1Char('z')))
+        key -= key % 1000;
+
+    QHash<qint64, QString>::const_iterator it = cache.constFind(key);
+    if (it != cache.constEnd())
+        return it.value();
+
+    if (cache.count() >= maximumTimeStamps)
+        cache.clear();
+    return cache.insert(key, timestamp.time().toString(format)).value();
+}
+
+enum MessageFlag {
+    SeenFlag = 0x1,
+    ReceivedFlag = 0x2,
+    HighlightedFlag = 0x4,
+    PrivateFlag = 0x8
+};
+
+static QTextBlockFormat rowFormat(Qt::Alignment alignment)
+{
+    QTextBlockFormat format;
+    format.setLineHeight(125, QTextBlockFormat::ProportionalHeight);
+    format.setAlignment(alignment);
+    return format;
+}
 
-static int delay = 1000;
+// an empty block that takes the height of the row it stands in for
+static QTextBlockFormat placeholderFormat(const MessageData& data, int height)
+{
+    QTextBlockFormat format = rowFormat(data.type() == IrcMessage::Unknown ? Qt::AlignRight : Qt::AlignLeft);
+    format.setLineHeight(height, QTextBlockFormat::FixedHeight);
+    return format;
+}
+
+static bool isUnreadType(const MessageData& data)
+{
+    return data.type() == IrcMessage::Private || data.type() == IrcMessage::Notice;
+}
+
+// a grouped row counts as many unread lines as it holds
+static int unreadLines(const MessageData& data, const QDateTime& seen)
+{
+    if (!isUnreadType(data))
+        return 0;
+    if (!data.isGroup())
+        return data.timestamp() > seen ? 1 : 0;
+
+    int unread = 0;
+    foreach (const MessageData& line, data.getEvents()) {
+        if (line.timestamp() > seen)
+            ++unread;
+    }
+    return unread;
+}
+
+static void insertTimeStamp(QList<QDateTime>& timestamps, const QDateTime& timestamp)
+{
+    timestamps.insert(std::upper_bound(timestamps.begin(), timestamps.end(), timestamp), timestamp);
+}
+
+static QByteArray restoreKey(IrcMessage* message)
+{
+    const QByteArray msgid = message->tag("msgid").toString().toUtf8();
+    if (!msgid.isEmpty())
+        return msgid;
+    return QByteArray::number(message->timeStamp().toMSecsSinceEpoch()) + ' ' + message->prefix().toUtf8()
+            + ' ' + message->command().toUtf8() + ' ' + message->parameters().join(" ").toUtf8();
+}
+
+static QString spillName(IrcBuffer* buffer)
+{
+    const QString uuid = buffer->connection()->userData().value("uuid").toString();
+    return QString::fromLatin1(QCryptographicHash::hash(QString(uuid + buffer->title()).toUtf8(), QCryptographicHash::Sha1).toHex());
+}
 
 class TextFrame : public QFrame
 {
@@ -64,6 +179,41 @@ public:
         QStylePainter painter(this);
         painter.drawPrimitive(QStyle::PE_Widget, option);
     }
+
+    // the frame is rendered once and stretched as a nine-patch
+    void draw(QPainter* painter, const QRect& rect)
+    {
+        static const int edge = 8;
+        if (d.cache.isNull()) {
+            ensurePolished();
+            resize(3 * edge, 3 * edge);
+            qreal dpr = 1.0;
+#if QT_VERSION >= 0x050600
+            dpr = painter->device()->devicePixelRatioF();
+#endif
+            d.cache = QPixmap(size() * dpr);
+#if QT_VERSION >= 0x050600
+            d.cache.setDevicePixelRatio(dpr);
+#endif
+            d.cache.fill(Qt::transparent);
+            render(&d.cache, QPoint(), QRegion(), QWidget::DrawChildren);
+        }
+        const QMargins margins(edge, edge, edge, edge);
+        qDrawBorderPixmap(painter, rect, margins, d.cache, QRect(QPoint(), size()), margins);
+    }
+
+protected:
+    void changeEvent(QEvent* event)
+    {
+        if (event->type() == QEvent::StyleChange || event->type() == QEvent::PaletteChange)
+            d.cache = QPixmap();
+        QFrame::changeEvent(event);
+    }
+
+private:
+    struct Private {
+        QPixmap cache;
+    } d;
 };
 
 class TextHighlight : public TextFrame
@@ -80,36 +230,66 @@ public:
     TextLowlight(QWidget* parent = 0) : TextFrame(parent) { }
 };
 
-struct TextBlockMessageData : QTextBlockUserData
-{
-    TextBlockMessageData(const MessageData& data) : data(data) { }
-    MessageData data;
-};
-
 TextDocument::TextDocument(IrcBuffer* buffer) : QTextDocument(buffer)
 {
     qRegisterMetaType<TextDocument*>();
 
-    d.scrollbackMarkerPosition = -1;
-    d.dirty = -1;
+    d.serialBase = 0;
+    d.scrollbackMarkerPosition = noSerial;
+    d.queue.setCapacity(maximumBlocks);
     d.rebuild = -1;
-    d.lowlight = -1;
+    d.lowlight = noSerial;
+    d.history = 0;
+    d.fetching = 0;
+    d.fetched = false;
+    d.stale = false;
+    d.restyle = false;
     d.clone = false;
+    d.source = 0;
     d.batch = false;
     d.buffer = buffer;
     d.visible = false;
+    d.warm = false;
+    d.hibernated = false;
+    d.coldGeneration = 0;
+    d.echo = 0;
+    d.firehose = buffer->property("firehose").toBool();
+    d.firehoseCount = 0;
+    d.firehoseSince = QDateTime::currentMSecsSinceEpoch();
+    d.firehoseLines.setCapacity(maximumBlocks);
+    d.hiddenSince = QDateTime::currentMSecsSinceEpoch();
+    d.storeWidth = -1;
+    d.limited = true;
+    d.viewportFirst = -1;
+    d.viewportLast = -1;
+    d.viewportRows = firehoseVisibleLines;
+    d.fillFirst = 0;
+    d.fillLast = std::numeric_limits<int>::max();
+    d.parkedBase = 0;
+
+    d.tooltips.setMaxCost(256);
 
     d.formatter = new MessageFormatter(this);
-    connect(d.formatter, SIGNAL(formatted(MessageData)), this, SLOT(append(MessageData)));
+    connect(d.formatter, SIGNAL(formatted(MessageData)), this, SLOT(appendFormatted(MessageData)));
     d.formatter->setBuffer(buffer);
+    d.formatter->setDeferred(FormatPipeline::instance()->isEnabled());
 
     setUndoRedoEnabled(false);
-    setMaximumBlockCount(1000);
+    setMaximumBlockCount(maximumBlocks);
+    d.store.setSpillName(spillName(buffer));
 
+    connect(this, SIGNAL(blockCountChanged(int)), this, SLOT(trimStore(int)));
+    MemoryBudget::instance()->add(this);
     connect(buffer->connection(), SIGNAL(disconnected()), this, SLOT(lowlight()));
     connect(buffer, SIGNAL(messageReceived(IrcMessage*)), this, SLOT(receiveMessage(IrcMessage*)));
 }
 
+TextDocument::~TextDocument()
+{
+    // the segments go with the buffer, clones have none of their own
+    d.store.discardSpilled();
+}
+
 QString TextDocument::timeStampFormat() const
 {
     return d.timeStampFormat;
@@ -118,8 +298,13 @@ QString TextDocument::timeStampFormat() const
 void TextDocument::setTimeStampFormat(const QString& format)
 {
     if (d.timeStampFormat != format) {
+        const QString previous = d.timeStampFormat;
+        QHash<qint64, QString> previousTexts;
+        previousTexts.swap(d.timeStamps);
         d.timeStampFormat = format;
-        scheduleRebuild();
+        d.tooltips.clear();
+        if (!updateTimeStamps(previous, previousTexts))
+            scheduleRebuild();
     }
 }
 
@@ -132,28 +317,51 @@ void TextDocument::setStyleSheet(const QString& css)
 {
     if (d.css != css) {
         d.css = css;
-        setDefaultStyleSheet(css);
-        scheduleRebuild();
+        d.tooltips.clear();
+        d.formatter->clearStyleCache();
+        // hidden documents parse the sheet once they are shown again
+        if (d.visible) {
+            setDefaultStyleSheet(css);
+            d.runFormats.clear();
+            scheduleRebuild();
+        } else {
+            d.restyle = true;
+            d.stale = true;
+        }
     }
 }
 
 TextDocument* TextDocument::clone()
 {
-    if (d.dirty > 0)
+    if (!d.queue.isEmpty())
         flush();
 
     TextDocument* doc = new TextDocument(d.buffer);
+
+    // clones mirror what the source formats instead of formatting on their own
+    TextDocument* source = d.clone ? d.source : this;
+    disconnect(d.buffer, SIGNAL(messageReceived(IrcMessage*)), doc, SLOT(receiveMessage(IrcMessage*)));
+    connect(source, SIGNAL(messageAppended(MessageData,bool)), doc, SLOT(appendMirrored(MessageData,bool)));
+    doc->d.source = source;
+
     doc->setDefaultStyleSheet(defaultStyleSheet());
     QTextCursor(doc).insertFragment(QTextDocumentFragment(this));
     doc->rootFrame()->setFrameFormat(rootFrame()->frameFormat());
 
     // TODO:
+    doc->d.serialBase = d.serialBase;
     doc->d.scrollbackMarkerPosition = d.scrollbackMarkerPosition;
     doc->d.css = d.css;
+    doc->d.restyle = d.restyle;
+    doc->d.stale = d.restyle;
     doc->d.lowlight = d.lowlight;
     doc->d.buffer = d.buffer;
     doc->d.highlights = d.highlights;
     doc->d.timeStampFormat = d.timeStampFormat;
+    doc->d.store = d.store;
+    doc->d.store.setSpillName(QString());
+    doc->d.history = d.history;
+    doc->setMaximumBlockCount(maximumBlockCount());
     doc->d.clone = true;
 
     return doc;
@@ -164,6 +372,50 @@ bool TextDocument::isClone() const
     return d.clone;
 }
 
+bool TextDocument::isFirehose() const
+{
+    return d.firehose;
+}
+
+void TextDocument::setFirehose(bool firehose)
+{
+    if (d.firehose == firehose)
+        return;
+
+    d.firehose = firehose;
+    if (!firehose) {
+        // whatever is waiting for a frame goes in the regular way
+        QList<MessageData> lines = d.firehoseLines.mid(0, d.firehoseLines.count());
+        d.firehoseLines.clear();
+        foreach (const MessageData& line, lines)
+            post(line, false, QStringList());
+        TaskScheduler::instance()->unschedule(this, "renderFirehose");
+        d.buffer->setProperty("firehoseRate", QVariant());
+    }
+}
+
+int TextDocument::groupWindow()
+{
+    return currentGroupWindow;
+}
+
+void TextDocument::setGroupWindow(int msecs)
+{
+    // applies to lines appended from now on, existing blocks stay as they are
+    currentGroupWindow = qMax(0, msecs);
+}
+
+bool TextDocument::directInsert()
+{
+    return directRuns;
+}
+
+void TextDocument::setDirectInsert(bool direct)
+{
+    // off sends every line through the html importer, as before
+    directRuns = direct;
+}
+
 IrcBuffer* TextDocument::buffer() const
 {
     return d.buffer;
@@ -174,14 +426,242 @@ MessageFormatter* TextDocument::formatter() const
     return d.formatter;
 }
 
+int TextDocument::pendingCount() const
+{
+    return d.cold.count() + d.queue.count();
+}
+
+// a highlight among the rows still queued, see FlushScheduler::drain()
+bool TextDocument::hasPendingHighlight() const
+{
+    return !d.queue.isEmpty() && !d.highlights.isEmpty()
+            && d.highlights.last() >= serialOf(totalCount() - d.queue.count());
+}
+
 int TextDocument::totalCount() const
 {
-    int count = d.queue.count();
+    int count = d.cold.count() + d.queue.count();
     if (!isEmpty())
         count += blockCount();
     return count;
 }
 
+MessageData TextDocument::message(int row) const
+{
+    if (row >= d.store.count()) {
+        row -= d.store.count();
+        if (row < d.cold.count())
+            return d.cold.at(row);
+        return d.queue.at(row - d.cold.count());
+    }
+    return d.store.at(row);
+}
+
+int TextDocument::rowAt(const QPoint& pos) const
+{
+    const int cursor = documentLayout()->hitTest(pos, Qt::FuzzyHit);
+    const QTextBlock block = findBlock(cursor);
+    if (!block.isValid() || block.blockNumber() >= d.store.count())
+        return -1;
+    return block.blockNumber();
+}
+
+int TextDocument::rowHeight(int row) const
+{
+    if (row < 0 || row >= d.store.count())
+        return -1;
+
+    int height = cachedRowHeight(row);
+    if (height == -1) {
+        const QTextBlock block = findBlockByNumber(row);
+        if (!block.isValid())
+            return -1;
+        height = qRound(documentLayout()->blockBoundingRect(block).height());
+        const_cast<TextDocument*>(this)->d.store.setRowHeight(row, height);
+    }
+    return height;
+}
+
+int TextDocument::rowOffset(int row) const
+{
+    // the store keeps the sums, only rows that were never measured hit the layout
+    cachedRowHeight(0);
+    int unmeasured = -1;
+    int offset = d.store.rowOffset(row, &unmeasured);
+    while (offset == -1) {
+        if (rowHeight(unmeasured) == -1)
+            const_cast<TextDocument*>(this)->d.store.setRowHeight(unmeasured, 0);
+        offset = d.store.rowOffset(row, &unmeasured);
+    }
+    return offset;
+}
+
+QList<int> TextDocument::highlightedRows() const
+{
+    QList<int> rows;
+    foreach (int serial, d.highlights) {
+        const int row = rowOfSerial(serial);
+        if (row >= 0 && row < d.store.count())
+            rows += row;
+    }
+    return rows;
+}
+
+int TextDocument::scrollbackMarkerRow() const
+{
+    const int row = rowOfSerial(d.scrollbackMarkerPosition);
+    return row >= 0 && row < d.store.count() ? row : -1;
+}
+
+int TextDocument::cachedRowHeight(int row) const
+{
+    // row heights depend on the layout width and the zoomed font, so discard them when either changes
+    if (!qFuzzyCompare(d.storeWidth, textWidth()) || d.storeFont != defaultFont()) {
+        TextDocument* that = const_cast<TextDocument*>(this);
+        that->d.storeWidth = textWidth();
+        that->d.storeFont = defaultFont();
+        that->d.store.invalidateHeights();
+    }
+    return d.store.rowHeight(row);
+}
+
+void TextDocument::measureRows(int from)
+{
+    // rows are measured right after they have been laid out, which is cheap,
+    // so that trimming the head later on never has to query the layout
+    if (d.visible) {
+        for (int row = qMax(0, from); row < d.store.count(); ++row)
+            rowHeight(row);
+    }
+}
+
+bool TextDocument::isPlaceholder(int row) const
+{
+    return row >= 0 && row < d.store.count() && !d.store.isFilled(row);
+}
+
+bool TextDocument::isViewportLimited() const
+{
+    return d.limited;
+}
+
+// the finder searches the text of the blocks, while it is open every row is filled
+void TextDocument::setViewportLimited(bool limited)
+{
+    d.limited = limited;
+}
+
+bool TextDocument::setViewportRows(int first, int last, bool bottom)
+{
+    if (first >= 0 && last >= first)
+        d.viewportRows = last - first + 1;
+    d.viewportFirst = bottom || first < 0 ? -1 : first;
+    d.viewportLast = qMax(first, last);
+    return layoutRows();
+}
+
+void TextDocument::updateFillRange()
+{
+    // a margin around the viewport is filled so that scrolling a few pages shows laid out rows
+    if (!d.limited) {
+        d.fillFirst = 0;
+        d.fillLast = std::numeric_limits<int>::max();
+    } else if (d.viewportFirst < 0) {
+        d.fillFirst = totalCount() - d.viewportRows - viewportMargin;
+        d.fillLast = std::numeric_limits<int>::max();
+    } else {
+        d.fillFirst = d.viewportFirst - viewportMargin;
+        d.fillLast = d.viewportLast + viewportMargin;
+    }
+}
+
+bool TextDocument::fillsRow(int row) const
+{
+    return (d.visible || d.warm) && row >= d.fillFirst && row <= d.fillLast;
+}
+
+bool TextDocument::layoutRows()
+{
+    // rows entering the range get their html, rows well past it are emptied
+    // again, so a relayout for a new width or font only touches the range
+    updateFillRange();
+    if ((!d.visible && !d.warm) || d.store.isEmpty())
+        return false;
+
+    // only the rows kept around the range and the ones that may still be
+    // filled past it are looked at, whatever the size of the scrollback
+    const int count = d.store.count();
+    const int keepFirst = qMax(0, d.fillFirst - viewportMargin);
+    const int keepLast = d.fillLast >= count ? count - 1 : qMin(count - 1, d.fillLast + viewportMargin);
+
+    // the heights are measured before any edit, the rows below stay in place
+    QList<QPair<int, int> > empties;
+    int first = 0, last = -1;
+    if (d.limited && d.store.filledRange(&first, &last)) {
+        for (int row = first; row <= last; ++row) {
+            if (row >= keepFirst && row <= keepLast)
+                row = keepLast;
+            else if (d.store.isFilled(row))
+                empties += qMakePair(row, qMax(1, rowHeight(row)));
+        }
+    }
+
+    QList<int> fills;
+    if (d.store.filledCount() < count) {
+        for (int row = qMax(0, d.fillFirst); row <= qMin(count - 1, d.fillLast); ++row) {
+            if (!d.store.isFilled(row))
+                fills += row;
+        }
+    }
+    if (fills.isEmpty() && empties.isEmpty())
+        return false;
+
+    QTextCursor cursor(this);
+    cursor.beginEditBlock();
+    foreach (int row, fills) {
+        const MessageData data = realize(d.store.at(row));
+        cursor.setPosition(findBlockByNumber(row).position());
+        insertRow(cursor, data, true);
+        d.store.replace(row, data);
+        d.store.setFilled(row, true);
+    }
+    for (int i = 0; i < empties.count(); ++i) {
+        const int row = empties.at(i).first;
+        const QTextBlock block = findBlockByNumber(row);
+        cursor.setPosition(block.position());
+        cursor.movePosition(QTextCursor::EndOfBlock, QTextCursor::KeepAnchor);
+        cursor.removeSelectedText();
+        cursor.setBlockFormat(placeholderFormat(d.store.at(row), empties.at(i).second));
+        d.store.setFilled(row, false);
+    }
+    cursor.endEditBlock();
+    if (d.visible) {
+        foreach (int row, fills)
+            rowHeight(row);
+    }
+    return true;
+}
+
+int TextDocument::estimatedRowHeight() const
+{
+    // most rows are a single line, see rowFormat()
+    return qCeil(QFontMetricsF(defaultFont()).lineSpacing() * 1.25);
+}
+
+void TextDocument::patchRow(int row, const MessageData& data)
+{
+    // a placeholder only takes the row, it is formatted once it gets filled
+    if (!isPlaceholder(row)) {
+        QTextCursor cursor(findBlockByNumber(row));
+        cursor.beginEditBlock();
+        cursor.movePosition(QTextCursor::StartOfBlock);
+        cursor.movePosition(QTextCursor::EndOfBlock, QTextCursor::KeepAnchor);
+        insertFormat(cursor, formatRow(data));
+        cursor.endEditBlock();
+    }
+    d.store.replace(row, data);
+}
+
 bool TextDocument::isVisible() const
 {
     return d.visible;
@@ -193,45 +673,201 @@ void TextDocument::setVisible(bool visible)
         return;
 
     if (visible) {
-        if (d.dirty > 0)
-            flush();
+        d.visible = true;
+        d.warm = false;
+        warmUp();
 
         // Update scroll marker position before updating seen message timestamp
         if (latestMessageReceived() > latestMessageSeen()) {
             Q_ASSERT(d.queue.isEmpty());
-            QTextBlock block = lastBlock();
-            while (block.isValid()) {
-                TextBlockMessageData* blockData = static_cast<TextBlockMessageData*>(block.userData());
-                if (blockData && blockData->data.timestamp() <= latestMessageSeen())
-                    break;
-
-                d.scrollbackMarkerPosition = block.blockNumber();
-                block = block.previous();
-            }
+            const int row = d.store.firstRowAfter(latestMessageSeen());
+            if (row != -1)
+                d.scrollbackMarkerPosition = serialOf(row);
         }
 
         setLatestMessageSeen(latestMessageReceived());
     } else {
-        d.scrollbackMarkerPosition = -1;
+        d.scrollbackMarkerPosition = noSerial;
+        d.hiddenSince = QDateTime::currentMSecsSinceEpoch();
     }
 
     d.visible = visible;
 }
 
-QDateTime TextDocument::latestMessageReceived() const
+qint64 TextDocument::idleTime() const
 {
+    if (d.visible)
+        return 0;
+    return QDateTime::currentMSecsSinceEpoch() - d.hiddenSince;
+}
+
+void TextDocument::warmUp()
+{
+    d.hibernated = false;
+    thaw();
+
+    if (d.restyle) {
+        d.restyle = false;
+        setDefaultStyleSheet(d.css);
+        d.runFormats.clear();
+    }
+
+    // the buffer is shown right away or is about to, so this one is not spread over frames,
+    // rows that arrived while hidden are placeholders and those in view get filled
+    if (d.stale)
+        rebuild();
+    else
+        layoutRows();
     if (!d.queue.isEmpty())
-        return d.queue.last().timestamp();
+        flush();
+    if (d.firehose && !d.firehoseLines.isEmpty())
+        renderFirehose();
+}
+
+bool TextDocument::isWarm() const
+{
+    return d.warm;
+}
 
-    QTextBlock block = lastBlock();
-    while (block.isValid()) {
-        if (TextBlockMessageData* blockData = static_cast<TextBlockMessageData*>(block.userData()))
-            return blockData->data.timestamp();
+// a warm document gets its html and layout as if it was shown, so that
+// showing it only places the marker, rows keep coming in formatted
+void TextDocument::setWarm(bool warm)
+{
+    if (d.warm == warm || d.visible || d.clone)
+        return;
 
-        block = block.previous();
+    d.warm = warm;
+    if (warm) {
+        // realize() and rebuild() go by visibility
+        d.visible = true;
+        warmUp();
+        d.visible = false;
+        documentLayout()->documentSize();
     }
+}
 
-    return QDateTime();
+bool TextDocument::isHibernated() const
+{
+    return d.hibernated;
+}
+
+qint64 TextDocument::footprint() const
+{
+    return measure().total();
+}
+
+qint64 TextDocument::cacheFootprint() const
+{
+    qint64 bytes = d.formatter->cacheFootprint();
+    foreach (const QString& key, d.tooltips.keys()) {
+        const QString* tooltip = d.tooltips.object(key);
+        bytes += 32 + 2 * (key.size() + (tooltip ? tooltip->size() : 0));
+    }
+    bytes += qint64(d.timeStamps.count()) * (32 + 2 * d.timeStampFormat.size());
+    foreach (const QString& tags, d.runFormats.keys())
+        bytes += 64 + 2 * tags.size();
+    bytes += d.cold.cacheFootprint();
+    return bytes;
+}
+
+TextDocument::Footprint TextDocument::measure() const
+{
+    Footprint footprint;
+    footprint.rows = totalCount();
+    for (int row = 0; row < footprint.rows; ++row) {
+        // cold rows are only counted compressed, measuring them would decode them
+        if (row >= d.store.count() && row < d.store.count() + d.cold.count())
+            continue;
+        const MessageData data = message(row);
+        const int events = data.eventFootprint();
+        footprint.raw += data.footprint() - events;
+        footprint.events += events;
+    }
+    footprint.cold = d.cold.compressedSize();
+    footprint.coldRaw = d.cold.rawFootprint();
+
+    // blocks carry no user data, the rows are indexed by the store and the
+    // queue, whose slots are allocated in bulk and reused as rows come and go
+    footprint.slots = d.queue.allocated();
+    footprint.index = qint64(d.store.count()) * (sizeof(MessageData) + sizeof(int) + sizeof(qint64))
+                    + qint64(footprint.slots) * sizeof(MessageData);
+
+    footprint.caches = cacheFootprint();
+
+    // a rough guess for the rich text fragments and their layout
+    if (!d.hibernated) {
+        footprint.blocks = blockCount();
+        footprint.html = qint64(characterCount()) * 2;
+        footprint.layout = qint64(footprint.blocks) * 512 + qint64(characterCount()) * 6;
+    }
+    return footprint;
+}
+
+void TextDocument::shrink(int rows)
+{
+    // only hibernated documents hold all of their rows in the queue
+    if (d.hibernated)
+        dropRows(totalCount() - qMax(0, rows));
+}
+
+void TextDocument::hibernate()
+{
+    if (d.visible || d.warm || d.clone || d.hibernated)
+        return;
+
+    // keep only the rows, the blocks and their layout are rebuilt when shown
+    releaseHistory();
+    FlushScheduler::instance()->unschedule(this);
+    d.queue.prepend(d.store.messages());
+    d.store.clear();
+    clear();
+    releaseCaches();
+    if (d.rebuild > 0) {
+        killTimer(d.rebuild);
+        d.rebuild = 0;
+    }
+    d.stale = false;
+    d.hibernated = true;
+    dropRows(d.queue.count() - d.queue.capacity());
+    TaskScheduler::instance()->schedule(TaskScheduler::Pacing, this, "freeze", freezeDelay);
+}
+
+void TextDocument::freeze()
+{
+    // the last row stays hot, merges and late lines look at it
+    const int count = d.queue.count() - 1;
+    if (!d.hibernated || !d.cold.isEmpty() || count < minimumColdRows)
+        return;
+    ColdCompressor::instance()->compress(this, d.coldGeneration, d.queue.mid(0, count));
+}
+
+void TextDocument::coldStored(int generation, const ColdStore& store)
+{
+    // anything that touched the queue in between bumped the generation
+    if (generation != d.coldGeneration || !d.hibernated || !d.cold.isEmpty() || store.count() >= d.queue.count())
+        return;
+    d.queue.removeFirst(store.count());
+    d.cold = store;
+}
+
+void TextDocument::thaw()
+{
+    // rows are edited in place and flushed from the queue only
+    ++d.coldGeneration;
+    if (!d.cold.isEmpty()) {
+        d.queue.prepend(d.cold.messages());
+        d.cold.clear();
+    }
+    if (d.hibernated)
+        TaskScheduler::instance()->schedule(TaskScheduler::Pacing, this, "freeze", freezeDelay);
+}
+
+QDateTime TextDocument::latestMessageReceived() const
+{
+    if (!d.queue.isEmpty())
+        return d.queue.last().timestamp();
+
+    return d.store.last().timestamp();
 }
 
 QDateTime TextDocument::latestMessageSeen() const
@@ -244,53 +880,309 @@ void TextDocument::setLatestMessageSeen(const QDateTime& timestamp)
     if (d.latestMessageSeen == timestamp)
         return;
 
+    const bool forward = !d.latestMessageSeen.isValid() || timestamp > d.latestMessageSeen;
     d.latestMessageSeen = timestamp;
+
+    // the unread timestamps are sorted, so moving forward only drops from the front
+    if (forward) {
+        const int unread = d.unread.count();
+        const int highlights = d.unreadHighlights.count();
+        while (!d.unread.isEmpty() && d.unread.first() <= timestamp)
+            d.unread.removeFirst();
+        while (!d.unreadHighlights.isEmpty() && d.unreadHighlights.first() <= timestamp)
+            d.unreadHighlights.removeFirst();
+        if (unread != d.unread.count() || highlights != d.unreadHighlights.count())
+            emit unreadCountChanged();
+    } else {
+        recountUnread();
+    }
+
     emit latestMessageSeenChanged(timestamp);
 }
 
 int TextDocument::unreadMessages() const
 {
-    int unread = 0;
+    return d.unread.count();
+}
+
+int TextDocument::unreadHighlights() const
+{
+    return d.unreadHighlights.count();
+}
+
+void TextDocument::recountUnread()
+{
+    d.unread.clear();
+    d.unreadHighlights.clear();
+    for (int row = 0; row < totalCount(); ++row) {
+        const MessageData data = message(row);
+        if (!unreadLines(data, d.latestMessageSeen))
+            continue;
+        if (data.isGroup()) {
+            foreach (const MessageData& line, data.getEvents()) {
+                if (line.timestamp() > d.latestMessageSeen)
+                    d.unread += line.timestamp();
+            }
+        } else {
+            d.unread += data.timestamp();
+        }
+    }
+    foreach (int highlight, d.highlights) {
+        const QDateTime timestamp = message(highlight - d.serialBase).timestamp();
+        if (timestamp > d.latestMessageSeen)
+            d.unreadHighlights += timestamp;
+    }
+    std::sort(d.unread.begin(), d.unread.end());
+    std::sort(d.unreadHighlights.begin(), d.unreadHighlights.end());
+    emit unreadCountChanged();
+}
+
+bool TextDocument::hasHistory() const
+{
+    return !d.clone && d.store.hasSpilled();
+}
+
+int TextDocument::loadHistory(int count)
+{
+    if (d.clone)
+        return 0;
+
+    if (!d.queue.isEmpty())
+        flush();
+
+    QList<MessageData> lines = d.store.takeSpilled(count);
+    if (lines.isEmpty())
+        return 0;
+    prependRows(lines);
+    return lines.count();
+}
+
+bool TextDocument::fetchHistory(int count)
+{
+    // log stores answer historyRequested() in place, servers answer
+    // remoteHistoryRequested() later on with a batch, see receiveBatch()
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    if (d.clone || d.fetched || isFetchingHistory())
+        return false;
 
-    // Note: The following logic assumes the queue and blocks are ordered by time
+    if (!d.queue.isEmpty())
+        flush();
+    const QDateTime before = d.store.first().timestamp();
+    if (!before.isValid())
+        return false;
+
+    d.fetching = now;
+    emit historyRequested(before, count);
+    if (isFetchingHistory())
+        emit remoteHistoryRequested(before, count);
+    return true;
+}
 
-    QListIterator<MessageData> iterator(d.queue);
-    iterator.toBack();
-    while (iterator.hasPrevious()) {
-        MessageData message = iterator.previous();
-        if (message.timestamp() <= d.latestMessageSeen)
-            return unread;
+bool TextDocument::isFetchingHistory() const
+{
+    return d.fetching > 0 && QDateTime::currentMSecsSinceEpoch() - d.fetching < historyTimeout;
+}
 
-        if (message.type() != IrcMessage::Private && message.type() != IrcMessage::Notice)
+int TextDocument::prependHistory(const QList<IrcMessage*>& messages)
+{
+    if (d.clone)
+        return 0;
+
+    if (!d.queue.isEmpty())
+        flush();
+    const QDateTime first = d.store.first().timestamp();
+
+    // only what is older than the head, the rest is already in place
+    QList<MessageData> lines;
+    const bool deferred = d.formatter->isDeferred();
+    d.formatter->setDeferred(false);
+    foreach (IrcMessage* msg, messages) {
+        if (first.isValid() && msg->timeStamp() >= first)
             continue;
+        const MessageData data = prepare(msg);
+        if (!data.isEmpty())
+            lines += data;
+    }
+    d.formatter->setDeferred(deferred);
+    if (lines.isEmpty())
+        return 0;
 
-        ++unread;
+    d.fetching = 0;
+    prependRows(lines);
+    return lines.count();
+}
+
+void TextDocument::prependRows(QList<MessageData> lines)
+{
+    // the rows in view move down by as many, those next to them are filled
+    d.fillFirst += lines.count();
+    if (d.fillLast < std::numeric_limits<int>::max() - lines.count())
+        d.fillLast += lines.count();
+    for (int i = 0; i < lines.count(); ++i) {
+        if (fillsRow(i))
+            lines[i] = realize(lines.at(i));
     }
 
-    for (QTextBlock block = lastBlock(); block.isValid(); block = block.previous()) {
-        TextBlockMessageData* blockData = static_cast<TextBlockMessageData*>(block.userData());
-        if (!blockData)
-            continue;
+    d.history += lines.count();
+    setMaximumBlockCount(maximumBlocks + d.history);
 
-        MessageData message = blockData->data;
-        if (message.timestamp() <= d.latestMessageSeen)
-            break;
+    const qreal height = size().height();
+    QTextCursor cursor(this);
+    cursor.beginEditBlock();
+    if (isEmpty()) {
+        foreach (const MessageData& data, lines)
+            insert(cursor, data);
+    } else {
+        cursor.movePosition(QTextCursor::Start);
+        foreach (const MessageData& data, lines) {
+            cursor.insertBlock();
+            cursor.movePosition(QTextCursor::PreviousBlock);
+            insertRow(cursor, data, fillsRow(cursor.blockNumber()));
+            cursor.movePosition(QTextCursor::NextBlock);
+        }
+        d.store.prepend(lines);
+        for (int i = 0; i < lines.count(); ++i)
+            d.store.setFilled(i, fillsRow(i));
+    }
+    cursor.endEditBlock();
+
+    shiftLights(-lines.count());
+    recountUnread();
+    emit linesPrepended(qRound(size().height() - height));
+}
 
-        if (message.type() != IrcMessage::Private && message.type() != IrcMessage::Notice)
+void TextDocument::restore(const QList<IrcMessage*>& messages)
+{
+    // seeds the tail without notifications, playback of the same lines is skipped later
+    foreach (IrcMessage* msg, messages) {
+        // a warm start may have brought the same lines already
+        const QByteArray key = restoreKey(msg);
+        if (d.restored.contains(key))
             continue;
+        const MessageData data = prepare(msg);
+        if (data.isEmpty())
+            continue;
+        d.restored.insert(key);
+        d.restoredUntil = qMax(d.restoredUntil, msg->timeStamp());
+        post(data, false, d.formatter->takeDeferredTexts());
+    }
+    if (!d.queue.isEmpty() && d.visible)
+        scheduleFlush();
+}
+
+int TextDocument::echoRow(int echo) const
+{
+    if (!d.echoes.contains(echo))
+        return -1;
+    return rowOfSerial(d.echoes.value(echo));
+}
 
-        ++unread;
+bool TextDocument::confirmEcho(int echo, IrcMessage* reply)
+{
+    const int row = echoRow(echo);
+    d.echoes.remove(echo);
+    if (row < 0 || row >= totalCount())
+        return false;
+    if (!reply)
+        return true;
+
+    // the row stays where it was shown, it only takes over the stamp and
+    // msgid of the echo, so that playback of the same line is skipped
+    isDuplicate(reply);
+    const bool deferred = d.formatter->isDeferred();
+    d.formatter->setDeferred(false);
+    MessageData data = d.formatter->formatMessage(reply);
+    d.formatter->setDeferred(deferred);
+    if (data.isEmpty())
+        return true;
+
+    // a preview patched into the pending row is kept
+    const MessageData pending = message(row);
+    if (pending.format().startsWith(data.format()))
+        data.setFormat(pending.format());
+
+    if (row >= d.store.count()) {
+        thaw();
+        d.queue.replace(row - d.store.count(), data);
+    } else if (formatRow(data) != formatRow(pending)) {
+        patchRow(row, data);
+        if (d.visible)
+            rowHeight(row);
+    } else {
+        d.store.replace(row, data);
     }
 
-    return unread;
+    if (d.visible && data.timestamp() > d.latestMessageSeen)
+        setLatestMessageSeen(data.timestamp());
+    return true;
+}
+
+QList<MessageData> TextDocument::snapshot(int count, QList<int>* highlights) const
+{
+    // rows are handle copies, formatted html and all, see restoreSnapshot()
+    QList<MessageData> rows;
+    const int total = totalCount();
+    const int first = qMax(0, total - count);
+    for (int row = first; row < total; ++row)
+        rows += message(row);
+    if (highlights) {
+        foreach (int serial, d.highlights) {
+            const int row = rowOfSerial(serial);
+            if (row >= first && row < total)
+                *highlights += row - first;
+        }
+    }
+    return rows;
+}
+
+void TextDocument::restoreSnapshot(const QList<MessageData>& rows, const QList<int>& highlights)
+{
+    if (d.clone || totalCount() > 0 || rows.isEmpty())
+        return;
+
+    // the rows go in as they were formatted, later log and playback
+    // lines of the same messages are skipped like after restore()
+    foreach (const MessageData& row, rows) {
+        d.queue.append(row);
+        foreach (const MessageData& line, row.getEvents()) {
+            if (line.data().isEmpty())
+                continue;
+            IrcMessage* msg = IrcMessage::fromData(line.data(), d.buffer->connection());
+            if (msg) {
+                msg->setTimeStamp(line.timestamp());
+                d.restored.insert(restoreKey(msg));
+                d.restoredUntil = qMax(d.restoredUntil, line.timestamp());
+                delete msg;
+            }
+        }
+    }
+    foreach (int row, highlights) {
+        if (row >= 0 && row < rows.count())
+            d.highlights += serialOf(row);
+    }
+    std::sort(d.highlights.begin(), d.highlights.end());
+    recountUnread();
+
+    trimQueue();
+    if (d.visible)
+        scheduleFlush();
+}
+
+void TextDocument::releaseHistory()
+{
+    if (d.history > 0) {
+        d.history = 0;
+        setMaximumBlockCount(maximumBlocks);
+    }
 }
 
 void TextDocument::lowlight(int block)
 {
     if (block == -1)
         block = totalCount() - 1;
-    if (d.lowlight != block) {
-        d.lowlight = block;
+    const int serial = serialOf(block);
+    if (d.lowlight != serial) {
+        d.lowlight = serial;
         updateBlock(block);
     }
 }
@@ -301,77 +1193,205 @@ void TextDocument::addHighlight(int block)
     if (block == -1)
         block = max;
     if (block >= 0 && block <= max) {
-        QList<int>::iterator it = std::lower_bound(d.highlights.begin(), d.highlights.end(), block);
-        d.highlights.insert(it, block);
+        const int serial = serialOf(block);
+        QList<int>::iterator it = std::lower_bound(d.highlights.begin(), d.highlights.end(), serial);
+        d.highlights.insert(it, serial);
         updateBlock(block);
     }
 }
 
 void TextDocument::removeHighlight(int block)
 {
-    if (d.highlights.removeOne(block) && block >= 0 && block < totalCount())
+    if (block >= 0 && block < totalCount() && d.highlights.removeOne(serialOf(block)))
         updateBlock(block);
 }
 
 void TextDocument::reset()
 {
-    d.scrollbackMarkerPosition = -1;
-    d.lowlight = -1;
+    d.serialBase = 0;
+    d.scrollbackMarkerPosition = noSerial;
+    d.lowlight = noSerial;
     d.highlights.clear();
+    d.echoes.clear();
     d.queue.clear();
+    d.cold.clear();
+    ++d.coldGeneration;
+    d.parkedBase += d.parked.count();
+    d.parked.clear();
+    d.previews.clear();
+    d.store.clear();
+    d.store.discardSpilled();
+    d.fetching = 0;
+    d.fetched = false;
+    if (!d.unread.isEmpty() || !d.unreadHighlights.isEmpty()) {
+        d.unread.clear();
+        d.unreadHighlights.clear();
+        emit unreadCountChanged();
+    }
+    if (d.history > 0) {
+        d.history = 0;
+        setMaximumBlockCount(maximumBlocks);
+    }
+    releaseCaches();
+}
+
+qint64 TextDocument::releaseCaches()
+{
+    // rebuilt on demand, the rows stay, see ChatPage::onCachesReleased()
+    const qint64 before = cacheFootprint();
+    d.tooltips.clear();
+    d.timeStamps.clear();
+    d.runFormats.clear();
+    d.cold.releaseCache();
+    d.formatter->clearStyleCache();
+    emit cachesReleased();
+
+    const qint64 after = cacheFootprint();
+    Q_ASSERT(after == 0);
+    return before - after;
 }
 
 void TextDocument::append(const MessageData& data)
 {
+    appendRow(data);
+}
+
+int TextDocument::appendRow(const MessageData& data)
+{
+    HookStats::Scope scope("TextDocument::append");
+    COMMUNI_ALLOC_STAGE(Insert);
     if (!data.isEmpty()) {
         MessageData last;
         if (!d.queue.isEmpty())
             last = d.queue.last();
-        else if (TextBlockMessageData* block = static_cast<TextBlockMessageData*>(lastBlock().userData()))
-            last = block->data;
+        else
+            last = d.store.last();
 
-        if (!last.isEmpty() && data.type() != IrcMessage::Unknown && data.timestamp().date() != last.timestamp().date()) {
+        // late playback and other bouncers' server time are sorted in
+        const bool late = data.timestamp().isValid() && last.timestamp().isValid() && data.timestamp() < last.timestamp();
+
+        if (!late && !last.isEmpty() && data.type() != IrcMessage::Unknown && data.timestamp().date() != last.timestamp().date()) {
             MessageData dc;
             dc.setFormat(QString("<p class='date'>%1</p>").arg(data.timestamp().date().toString(Qt::ISODate)));
-            append(dc);
+            appendRow(dc);
+        }
+
+        const bool unread = isUnreadType(data) && data.timestamp() > d.latestMessageSeen;
+        if (unread) {
+            insertTimeStamp(d.unread, data.timestamp());
+            emit unreadCountChanged();
         }
 
+        if (late)
+            return insertLate(data, unread);
+
         MessageData msg = data;
         const bool merge = last.canMerge(data);
+        const bool group = !merge && last.eventCount() < maximumGroupLines && last.canGroup(data, currentGroupWindow);
         if (merge) {
             msg.merge(last);
-            msg.setFormat(formatSummary(msg.getEvents()));
-            if (!d.queue.isEmpty())
-                d.queue.replace(d.queue.count() - 1, msg);
+            msg.setFormat(formatSummary(msg));
+        } else if (group) {
+            // the lines stay in the row's events, formatRow() joins them
+            msg.merge(last);
         }
-        if (!d.batch && (d.dirty == 0 || d.visible)) {
+        if ((merge || group) && !d.queue.isEmpty()) {
+            d.queue.replace(d.queue.count() - 1, msg);
+        } else if (merge || group) {
+            // a merge into an already inserted block is patched in place right away
+            patchRow(d.store.count() - 1, msg);
+            measureRows(d.store.count() - 1);
+        } else if (!d.batch && d.visible && d.queue.isEmpty() && !FlushScheduler::instance()->isSuspended()) {
             QTextCursor cursor(this);
             cursor.beginEditBlock();
-            if (merge) {
-                cursor.movePosition(QTextCursor::End);
-                cursor.movePosition(QTextCursor::StartOfBlock, QTextCursor::KeepAnchor);
-                cursor.removeSelectedText();
-                cursor.deletePreviousChar();
-            }
             insert(cursor, msg);
             cursor.endEditBlock();
+            measureRows(d.store.count() - 1);
         } else {
-            if (!d.batch && d.dirty <= 0) {
-                d.dirty = startTimer(delay);
-                delay += 1000;
-            }
-            if (!merge)
-                d.queue += msg;
+            d.queue.append(msg);
+            trimQueue();
+        }
+    }
+    return totalCount() - 1;
+}
+
+int TextDocument::insertLate(const MessageData& data, bool unread)
+{
+    // queued rows are few and late lines land close to the end, so those
+    // are searched from the back, inserted rows through the stamp index
+    thaw();
+    int pos = d.queue.count();
+    while (pos > 0 && (!d.queue.at(pos - 1).timestamp().isValid() || d.queue.at(pos - 1).timestamp() > data.timestamp()))
+        --pos;
+
+    int row = d.store.count() + pos;
+    if (pos == 0) {
+        row = d.store.firstRowAfter(data.timestamp());
+        if (row == -1)
+            row = d.store.count();
+    }
+
+    // the row indexes are moved before any head trimming moves them back
+    const int total = totalCount();
+    shiftRows(row, unread);
+
+    if (row >= d.store.count() && (pos > 0 || !d.queue.isEmpty())) {
+        d.queue.insert(pos, data);
+        trimQueue();
+    } else {
+        QTextCursor cursor(this);
+        cursor.beginEditBlock();
+        if (row >= d.store.count()) {
+            insert(cursor, data);
+        } else {
+            if (d.visible && blockCount() >= maximumBlockCount())
+                rowHeight(0);
+            const bool fill = d.visible && fillsRow(row);
+            const MessageData msg = fill ? realize(data) : data;
+            cursor.setPosition(findBlockByNumber(row).position());
+            cursor.insertBlock();
+            cursor.movePosition(QTextCursor::PreviousBlock);
+            insertRow(cursor, msg, fill);
+            d.store.insert(row, msg);
+            d.store.setFilled(row, fill);
         }
+        cursor.endEditBlock();
+    }
+    row -= total + 1 - totalCount();
+    if (row >= 0 && row < d.store.count())
+        measureRows(row);
+    return row;
+}
+
+void TextDocument::shiftRows(int row, bool unread)
+{
+    // only a line sorted in ahead of existing rows moves the serials after it
+    const int serial = serialOf(row);
+    QList<int>::iterator it = std::lower_bound(d.highlights.begin(), d.highlights.end(), serial);
+    for (; it != d.highlights.end(); ++it)
+        ++*it;
+    if (d.lowlight != noSerial && d.lowlight >= serial)
+        ++d.lowlight;
+    for (QMap<int, int>::iterator echo = d.echoes.begin(); echo != d.echoes.end(); ++echo) {
+        if (echo.value() >= serial)
+            ++echo.value();
+    }
+    if (d.scrollbackMarkerPosition != noSerial && serial <= d.scrollbackMarkerPosition) {
+        // an unread line sorted in ahead of the marker becomes the first unread one
+        if (unread)
+            d.scrollbackMarkerPosition = serial;
+        else
+            ++d.scrollbackMarkerPosition;
     }
 }
 
 void TextDocument::drawForeground(QPainter* painter, const QRect& bounds)
 {
-    if (d.scrollbackMarkerPosition <= 0)
+    const int marker = rowOfSerial(d.scrollbackMarkerPosition);
+    if (marker <= 0)
         return;
 
-    QTextBlock block = findBlockByNumber(d.scrollbackMarkerPosition);
+    QTextBlock block = findBlockByNumber(marker);
     if (!block.isValid())
         return;
 
@@ -394,7 +1414,8 @@ void TextDocument::drawForeground(QPainter* painter, const QRect& bounds)
 
 void TextDocument::drawBackground(QPainter* painter, const QRect& bounds)
 {
-    if (d.highlights.isEmpty() && d.lowlight == -1)
+    COMMUNI_TRACE("TextDocument::drawBackground");
+    if (d.highlights.isEmpty() && d.lowlight == noSerial)
         return;
 
     const int margin = qCeil(documentMargin());
@@ -408,33 +1429,37 @@ void TextDocument::drawBackground(QPainter* painter, const QRect& bounds)
     if (!highlightFrame)
         highlightFrame = new TextHighlight(static_cast<QWidget*>(painter->device()));
 
-    if (d.lowlight != -1) {
-        const QAbstractTextDocumentLayout* layout = documentLayout();
-        const int margin = qCeil(documentMargin());
-        const QTextBlock to = findBlockByNumber(d.lowlight);
+    if (d.lowlight != noSerial) {
+        const QTextBlock to = findBlockByNumber(rowOfSerial(d.lowlight));
         if (to.isValid()) {
             QRect br = layout->blockBoundingRect(to).toAlignedRect();
             br.setTop(0);
             if (bounds.intersects(br)) {
                 br.adjust(-margin - 1, 0, margin + 1, 2);
-                painter->translate(br.topLeft());
-                lowlightFrame->setGeometry(br);
-                lowlightFrame->render(painter);
-                painter->translate(-br.topLeft());
+                lowlightFrame->draw(painter, br);
             }
         }
     }
 
-    foreach (int highlight, d.highlights) {
-        QTextBlock block = findBlockByNumber(highlight);
+    if (d.highlights.isEmpty())
+        return;
+
+    // only the highlights within the visible row range are touched
+    int first = rowAt(bounds.topLeft());
+    int last = rowAt(bounds.bottomLeft());
+    if (first == -1)
+        first = 0;
+    if (last == -1)
+        last = d.store.count() - 1;
+
+    QList<int>::const_iterator it = std::lower_bound(d.highlights.constBegin(), d.highlights.constEnd(), serialOf(first));
+    for (; it != d.highlights.constEnd() && *it <= serialOf(last); ++it) {
+        const QTextBlock block = findBlockByNumber(*it - d.serialBase);
         if (block.isValid()) {
             QRect br = layout->blockBoundingRect(block).toAlignedRect();
             if (bounds.intersects(br)) {
                 br.adjust(-margin - 1, 0, margin + 1, 2);
-                painter->translate(br.topLeft());
-                highlightFrame->setGeometry(br);
-                highlightFrame->render(painter);
-                painter->translate(-br.topLeft());
+                highlightFrame->draw(painter, br);
             }
         }
     }
@@ -442,12 +1467,22 @@ void TextDocument::drawBackground(QPainter* painter, const QRect& bounds)
 
 QString TextDocument::tooltip(const QPoint& point) const
 {
-    const int pos = documentLayout()->hitTest(point, Qt::FuzzyHit);
-    const QTextBlock block = findBlock(pos);
-    TextBlockMessageData* blockData = static_cast<TextBlockMessageData*>(block.userData());
-    if (blockData)
-        return formatEvents(blockData->data.getEvents());
-    return QString();
+    const int row = rowAt(point);
+    if (row == -1)
+        return QString();
+
+    // expanding re-parses every merged event, so the result is kept around
+    const MessageData data = d.store.at(row);
+    if (data.type() == IrcMessage::Names && !data.eventCount())
+        return d.formatter->formatNamesOverflow();
+
+    const QString key = QString("%1:%2:%3").arg(data.timestamp().toMSecsSinceEpoch()).arg(data.eventCount()).arg(data.nick());
+    if (QString* cached = d.tooltips.object(key))
+        return *cached;
+
+    const QString tooltip = formatEvents(data.getEvents());
+    d.tooltips.insert(key, new QString(tooltip), qMax(1, tooltip.length() / 1024));
+    return tooltip;
 }
 
 void TextDocument::updateBlock(int number)
@@ -462,153 +1497,772 @@ void TextDocument::updateBlock(int number)
 void TextDocument::timerEvent(QTimerEvent* event)
 {
     QTextDocument::timerEvent(event);
-    if (event->timerId() == d.dirty) {
-        delay -= 1000;
-        flush();
-    } else if (event->timerId() == d.rebuild) {
+    if (event->timerId() == d.rebuild) {
         rebuild();
     }
 }
 
 void TextDocument::flush()
 {
-    if (!d.queue.isEmpty()) {
+    thaw();
+    flushQueue(d.queue.count());
+    FlushScheduler::instance()->unschedule(this);
+}
+
+int TextDocument::flushQueue(int count)
+{
+    HookStats::Scope scope("TextDocument::flush");
+    COMMUNI_TRACE("TextDocument::flush");
+    COMMUNI_ALLOC_STAGE(Insert);
+    if (!d.cold.isEmpty())
+        thaw();
+    count = qMin(count, d.queue.count());
+    if (count > 0) {
+        updateFillRange();
         QTextCursor cursor(this);
         cursor.beginEditBlock();
-        foreach (const MessageData& data, d.queue)
-            insert(cursor, data);
+        for (int i = 0; i < count; ++i)
+            insert(cursor, d.queue.at(i));
         cursor.endEditBlock();
-        d.queue.clear();
-    }
-
-    if (d.dirty > 0) {
-        killTimer(d.dirty);
-        d.dirty = 0;
+        d.queue.removeFirst(count);
+        measureRows(d.store.count() - count);
     }
+    return qMax(0, count);
 }
 
 void TextDocument::receiveMessage(IrcMessage* message)
 {
+    COMMUNI_TRACE("TextDocument::receiveMessage");
     if (message->type() == IrcMessage::Batch) {
-        IrcBatchMessage* batch = static_cast<IrcBatchMessage*>(message);
-        d.batch = true;
-        foreach (IrcMessage* msg, batch->messages())
-            receiveMessage(msg);
-        d.batch = false;
-        if (!d.queue.isEmpty()) {
-            if (d.visible) {
-                flush();
-            } else if (d.dirty <= 0) {
-                d.dirty = startTimer(delay);
-                delay += 1000;
-            }
+        receiveBatch(static_cast<IrcBatchMessage*>(message));
+        return;
+    }
+    // dropped by a filter before it costs any formatting
+    if (isRestored(message) || isDuplicate(message) || message->property("filtered").toBool())
+        return;
+
+    if (d.firehose && !d.clone) {
+        receiveFirehose(message);
+        return;
+    }
+
+    const MessageData data = prepare(message);
+    if (data.isEmpty())
+        return;
+
+    d.echo = message->property("echo").toInt();
+    const int flags = processMessage(message, data);
+    d.echo = 0;
+    if (flags & SeenFlag)
+        setLatestMessageSeen(message->timeStamp());
+    if (flags & ReceivedFlag)
+        emit messageReceived(message);
+    if (flags & HighlightedFlag)
+        emit messageHighlighted(message);
+    if (flags & PrivateFlag)
+        emit privateMessageReceived(message);
+}
+
+MessageData TextDocument::prepare(IrcMessage* message)
+{
+    // hidden buffers keep chatter raw, most of it is trimmed before anyone
+    // reads it, and the html is produced once the row is about to be shown
+    const IrcMessage::Type type = MessageData::effectiveType(message);
+    const bool shown = (d.visible || d.warm) && !FlushScheduler::instance()->isSuspended();
+    const bool echo = message->property("echo").toInt() > 0;
+    if (!shown && !d.clone && !echo && (type == IrcMessage::Private || type == IrcMessage::Notice)) {
+        MessageData data;
+        data.initFrom(message);
+        data.setLazy(true);
+        return data;
+    }
+
+    // own lines are not parked behind the pipeline, they are shown right away
+    if (echo) {
+        const bool deferred = d.formatter->isDeferred();
+        d.formatter->setDeferred(false);
+        const MessageData data = d.formatter->formatMessage(message);
+        d.formatter->setDeferred(deferred);
+        return data;
+    }
+    return d.formatter->formatMessage(message);
+}
+
+MessageData TextDocument::realize(const MessageData& data)
+{
+    if (!data.isLazy())
+        return data;
+
+    MessageData realized = data;
+    IrcMessage* msg = IrcMessage::fromData(data.data(), d.buffer->connection());
+    const bool deferred = d.formatter->isDeferred();
+    d.formatter->setDeferred(false);
+    realized.setFormat(d.formatter->formatMessage(msg).format());
+    d.formatter->setDeferred(deferred);
+    delete msg;
+    return realized;
+}
+
+void TextDocument::realizeRows(QList<MessageData>& rows)
+{
+    // the templates need the buffer and are expanded here, the texts in
+    // them are formatted on the pool, see FormatPipeline::formatAll()
+    QVector<FormatJob> jobs;
+    QList<int> indexes;
+    const bool deferred = d.formatter->isDeferred();
+    d.formatter->setDeferred(FormatPipeline::instance()->isEnabled());
+    for (int i = 0; i < rows.count(); ++i) {
+        if (!rows.at(i).isLazy())
+            continue;
+
+        IrcMessage* msg = IrcMessage::fromData(rows.at(i).data(), d.buffer->connection());
+        FormatJob job;
+        job.format = d.formatter->formatMessage(msg).format();
+        job.texts = d.formatter->takeDeferredTexts();
+        delete msg;
+
+        if (job.texts.isEmpty()) {
+            rows[i].setFormat(job.format);
+        } else {
+            jobs += job;
+            indexes += i;
         }
+    }
+    d.formatter->setDeferred(deferred);
+
+    FormatPipeline::instance()->formatAll(jobs, d.formatter->nickMatcher(), FlushScheduler::instance()->chunkSize());
+    for (int i = 0; i < indexes.count(); ++i)
+        rows[indexes.at(i)].setFormat(jobs.at(i).format);
+}
+
+void TextDocument::scheduleFlush()
+{
+    // a few rows go in at once, a larger backlog a chunk per frame
+    FlushScheduler* scheduler = FlushScheduler::instance();
+    if (d.queue.count() <= scheduler->chunkSize()) {
+        flush();
     } else {
-        MessageData data = d.formatter->formatMessage(message);
-        if (!data.isEmpty()) {
-            bool unseen = message->timeStamp() > latestMessageSeen();
+        scheduler->schedule(this);
+        scheduler->prioritize(this);
+    }
+}
+
+void TextDocument::receiveBatch(IrcBatchMessage* batch)
+{
+    QList<IrcMessage*> messages = batch->messages();
+
+    // a page of older lines goes to the head in one go
+    if (isFetchingHistory() && batch->batch().endsWith("chathistory")) {
+        d.fetching = 0;
+        d.fetched = messages.isEmpty();
+        const QDateTime first = d.store.first().timestamp();
+        prependHistory(messages);
+        QList<IrcMessage*>::iterator it = messages.begin();
+        while (it != messages.end()) {
+            if (first.isValid() && (*it)->timeStamp() < first)
+                it = messages.erase(it);
+            else
+                ++it;
+        }
+    }
+    if (messages.isEmpty())
+        return;
 
-            append(data);
+    // lines already present from an overlapping playback are skipped
+    QSet<QByteArray> known;
+    const QDateTime since = messages.first()->timeStamp();
+    for (int row = totalCount() - 1; row >= 0; --row) {
+        const MessageData data = message(row);
+        if (data.timestamp().isValid() && data.timestamp() < since)
+            break;
+        if (!data.data().isEmpty())
+            known.insert(data.data());
+    }
 
-            if (unseen && isVisible() && !(message->isOwn() && data.type() == IrcMessage::Join))
-                setLatestMessageSeen(message->timeStamp());
+    IrcMessage* received = 0;
+    IrcMessage* highlighted = 0;
+    IrcMessage* priv = 0;
+    QDateTime seen;
 
-            if (data.type() == IrcMessage::Private || data.type() == IrcMessage::Notice) {
-                if (unseen)
-                    emit messageReceived(message);
-
-                if (!message->isOwn()) {
-                    QString content;
-                    bool priv = false;
-                    if (data.type() == IrcMessage::Private) {
-                        IrcPrivateMessage* pm = static_cast<IrcPrivateMessage*>(message);
-                        content = pm->content();
-                        priv = pm->isPrivate();
-                    } else {
-                        IrcNoticeMessage* nm = static_cast<IrcNoticeMessage*>(message);
-                        content = nm->content();
-                        priv = nm->isPrivate();
-                    }
-                    IrcConnection* connection = message->connection();
-                    const bool contains = content.contains(connection->nickName(), Qt::CaseInsensitive);
-                    if (contains) {
-                        if (connection->isConnected())
-                            addHighlight(totalCount() - 1);
-                        if (unseen)
-                            emit messageHighlighted(message);
-                    } else if (unseen && priv && connection->isConnected()) {
-                        emit privateMessageReceived(message);
+    d.batch = true;
+    foreach (IrcMessage* msg, messages) {
+        if (msg->type() == IrcMessage::Batch) {
+            receiveBatch(static_cast<IrcBatchMessage*>(msg));
+            d.batch = true;
+            continue;
+        }
+        if (isRestored(msg) || isDuplicate(msg))
+            continue;
+
+        const MessageData data = prepare(msg);
+        if (data.isEmpty() || (!data.data().isEmpty() && known.contains(data.data())))
+            continue;
+        known.insert(data.data());
+
+        const int flags = processMessage(msg, data);
+        if (flags & SeenFlag)
+            seen = qMax(seen, msg->timeStamp());
+        if (flags & ReceivedFlag)
+            received = msg;
+        if (flags & HighlightedFlag)
+            highlighted = msg;
+        if (flags & PrivateFlag)
+            priv = msg;
+    }
+    d.batch = false;
+
+    if (!d.queue.isEmpty()) {
+        if (d.visible && !FlushScheduler::instance()->isSuspended())
+            flush();
+        else if (!d.hibernated)
+            FlushScheduler::instance()->schedule(this);
+    }
+
+    // notify once per batch, about the latest relevant message
+    if (seen.isValid())
+        setLatestMessageSeen(seen);
+    if (received)
+        emit messageReceived(received);
+    if (highlighted)
+        emit messageHighlighted(highlighted);
+    if (priv)
+        emit privateMessageReceived(priv);
+}
+
+bool TextDocument::isRestored(IrcMessage* message)
+{
+    if (d.restored.isEmpty())
+        return false;
+
+    // the first message past the restored tail means playback caught up
+    if (message->timeStamp() > d.restoredUntil) {
+        d.restored.clear();
+        return false;
+    }
+    return d.restored.contains(restoreKey(message));
+}
+
+bool TextDocument::isDuplicate(IrcMessage* message)
+{
+    // only server stamped lines can be told apart from a repeat, which is
+    // what playback overlapping live traffic after a reconnect produces
+    if (!message->tags().contains("msgid") && !message->tags().contains("time"))
+        return false;
+
+    const QByteArray key = restoreKey(message);
+    const quint64 hash = (quint64(qHash(key)) << 32) | qHash(key, 0x9e3779b9);
+    if (d.recent.contains(hash))
+        return true;
+
+    d.recent.insert(hash);
+    d.recentOrder.enqueue(hash);
+    if (d.recentOrder.count() > maximumRecent)
+        d.recent.remove(d.recentOrder.dequeue());
+    return false;
+}
+
+int TextDocument::processMessage(IrcMessage* message, const MessageData& data)
+{
+    int flags = 0;
+    const bool unseen = message->timeStamp() > latestMessageSeen();
+    bool highlighted = false;
+
+    if (unseen && isVisible() && !(message->isOwn() && data.type() == IrcMessage::Join))
+        flags |= SeenFlag;
+
+    if (data.type() == IrcMessage::Private || data.type() == IrcMessage::Notice) {
+        if (unseen)
+            flags |= ReceivedFlag;
+
+        if (!message->isOwn()) {
+            bool priv = false;
+            if (data.type() == IrcMessage::Private)
+                priv = static_cast<IrcPrivateMessage*>(message)->isPrivate();
+            else
+                priv = static_cast<IrcNoticeMessage*>(message)->isPrivate();
+            IrcConnection* connection = message->connection();
+            if (HighlightMatcher::instance(connection)->isHighlight(message)) {
+                if (connection->isConnected()) {
+                    highlighted = true;
+                    if (message->timeStamp() > d.latestMessageSeen) {
+                        insertTimeStamp(d.unreadHighlights, message->timeStamp());
+                        emit unreadCountChanged();
                     }
                 }
+                if (unseen)
+                    flags |= HighlightedFlag;
+            } else if (unseen && priv && connection->isConnected()) {
+                flags |= PrivateFlag;
             }
         }
     }
+
+    post(data, highlighted, d.formatter->takeDeferredTexts());
+    return flags;
+}
+
+void TextDocument::receiveFirehose(IrcMessage* message)
+{
+    // feeds keep their lines raw until the next frame, only the keyword
+    // matcher runs per line, merging and unread counting are skipped
+    MessageData data;
+    data.initFrom(message);
+    data.setLazy(true);
+    d.firehoseLines.append(data);
+    d.firehoseLines.removeFirst(d.firehoseLines.count() - d.firehoseLines.capacity());
+    ++d.firehoseCount;
+
+    const IrcMessage::Type type = MessageData::effectiveType(message);
+    IrcConnection* connection = message->connection();
+    if ((type == IrcMessage::Private || type == IrcMessage::Notice) && connection->isConnected()
+            && HighlightMatcher::instance(connection)->isHighlight(message)) {
+        if (message->timeStamp() > d.latestMessageSeen) {
+            insertTimeStamp(d.unreadHighlights, message->timeStamp());
+            emit unreadCountChanged();
+        }
+        emit messageHighlighted(message);
+    }
+
+    TaskScheduler::instance()->schedule(TaskScheduler::Pacing, this, "renderFirehose", firehoseFrame);
 }
 
-void TextDocument::rebuild()
+void TextDocument::renderFirehose()
 {
-    QList<MessageData> lines;
-    QTextBlock block = firstBlock();
-    while (block.isValid()) {
-        TextBlockMessageData* blockData = static_cast<TextBlockMessageData*>(block.userData());
-        if (blockData)
-            lines += blockData->data;
-        block = block.next();
+    // the rate shown in the title bar is refreshed along with the frames
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    const qint64 elapsed = now - d.firehoseSince;
+    if (elapsed >= 1000) {
+        const int rate = int(d.firehoseCount * 1000 / elapsed);
+        if (d.buffer->property("firehoseRate").toInt() != rate)
+            d.buffer->setProperty("firehoseRate", rate);
+        d.firehoseCount = 0;
+        d.firehoseSince = now;
+    }
+
+    // only the most recent lines a view can show are formatted and inserted
+    if (d.visible && !d.hibernated && !d.firehoseLines.isEmpty()) {
+        const int count = d.firehoseLines.count();
+        const QList<MessageData> lines = d.firehoseLines.mid(qMax(0, count - firehoseVisibleLines), firehoseVisibleLines);
+        d.firehoseLines.clear();
+        if (!d.queue.isEmpty())
+            flush();
+
+        QTextCursor cursor(this);
+        cursor.beginEditBlock();
+        foreach (const MessageData& line, lines) {
+            const MessageData row = realize(line);
+            insert(cursor, row);
+            emit messageAppended(row, false);
+        }
+        cursor.endEditBlock();
+        measureRows(qMax(0, d.store.count() - lines.count()));
+        setLatestMessageSeen(lines.last().timestamp());
+    }
+
+    if (d.firehose && (!d.firehoseLines.isEmpty() || d.firehoseCount > 0 || d.buffer->property("firehoseRate").toInt() > 0))
+        TaskScheduler::instance()->schedule(TaskScheduler::Pacing, this, "renderFirehose", firehoseFrame);
+}
+
+void TextDocument::post(const MessageData& data, bool highlight, const QStringList& texts)
+{
+    if (texts.isEmpty() && d.parked.isEmpty()) {
+        publish(data, highlight);
+        return;
+    }
+
+    // the message waits for its texts, and everything after it waits for the message
+    Parked parked;
+    parked.data = data;
+    parked.highlight = highlight;
+    parked.ready = texts.isEmpty();
+    d.parked += parked;
+    if (!texts.isEmpty())
+        FormatPipeline::instance()->submit(this, d.parkedBase + d.parked.count() - 1, data.format(), texts, d.formatter->nickMatcher());
+}
+
+void TextDocument::publish(const MessageData& data, bool highlight)
+{
+    const int row = appendRow(data);
+    if (highlight && row >= 0)
+        addHighlight(row);
+    if (d.echo > 0 && row >= 0) {
+        d.echoes.insert(d.echo, serialOf(row));
+        if (d.echoes.count() > maximumEchoes)
+            d.echoes.erase(d.echoes.begin());
+    }
+    requestPreview(row, data);
+    emit messageAppended(data, highlight);
+}
+
+void TextDocument::requestPreview(int row, const MessageData& data)
+{
+    if (!LinkPreview::isEnabled() || d.firehose || row < 0 || data.isLazy() || data.type() != IrcMessage::Private)
+        return;
+
+    const QString url = LinkPreview::firstUrl(data.format());
+    if (url.isEmpty())
+        return;
+
+    // the row is patched once the preview is there, see updatePreview()
+    LinkPreview* preview = LinkPreview::instance();
+    d.previews.insert(url, serialOf(row));
+    connect(preview, SIGNAL(previewReady(QString)), this, SLOT(updatePreview(QString)), Qt::UniqueConnection);
+    if (preview->preview(url).ready)
+        updatePreview(url);
+    else
+        preview->fetch(url);
+}
+
+void TextDocument::updatePreview(const QString& url)
+{
+    if (!d.previews.contains(url))
+        return;
+
+    const QList<int> serials = d.previews.values(url);
+    d.previews.remove(url);
+    const LinkPreview::Preview preview = LinkPreview::instance()->preview(url);
+    if (preview.title.isEmpty() && preview.image.isEmpty())
+        return;
+
+    QString html = "<br/><span class='preview'>";
+    if (!preview.image.isEmpty())
+        html += QString("<a href='%1'><img src='preview:%2'/></a> ").arg(url.toHtmlEscaped(), preview.image);
+    if (!preview.title.isEmpty())
+        html += QString("<a style='text-decoration:none;' href='%1'>%2</a>").arg(url.toHtmlEscaped(), preview.title.toHtmlEscaped());
+    html += "</span>";
+
+    foreach (int serial, serials) {
+        const int row = rowOfSerial(serial);
+        if (row < 0 || row >= totalCount())
+            continue;
+
+        // grouped rows are joined from their events, those are left alone
+        MessageData data = message(row);
+        if (data.isGroup() || data.isLazy())
+            continue;
+        data.setFormat(data.format() + html);
+
+        if (row >= d.store.count()) {
+            thaw();
+            d.queue.replace(row - d.store.count(), data);
+            continue;
+        }
+
+        // only the block of the row is laid out again
+        patchRow(row, data);
+        if (d.visible)
+            rowHeight(row);
+    }
+}
+
+QVariant TextDocument::loadResource(int type, const QUrl& name)
+{
+    // thumbnails outlive the blocks, hibernation and rebuilds ask again
+    if (type == QTextDocument::ImageResource && name.scheme() == "preview")
+        return LinkPreview::instance()->thumbnail(name.path());
+    return QTextDocument::loadResource(type, name);
+}
+
+void TextDocument::completeFormat(int sequence, const QString& format)
+{
+    const int index = sequence - d.parkedBase;
+    if (index < 0 || index >= d.parked.count())
+        return;
+
+    d.parked[index].data.setFormat(format);
+    d.parked[index].ready = true;
+    while (!d.parked.isEmpty() && d.parked.first().ready) {
+        const Parked parked = d.parked.takeFirst();
+        ++d.parkedBase;
+        publish(parked.data, parked.highlight);
     }
+}
+
+void TextDocument::appendFormatted(const MessageData& data)
+{
+    post(data, false, QStringList());
+}
+
+void TextDocument::appendMirrored(const MessageData& data, bool highlight)
+{
+    const int row = appendRow(data);
+    if (highlight && row >= 0)
+        addHighlight(row);
+    requestPreview(row, data);
+}
+
+void TextDocument::rebuild()
+{
+    HookStats::Scope scope("TextDocument::rebuild");
+    COMMUNI_TRACE("TextDocument::rebuild");
+    thaw();
+    updateFillRange();
+    QList<MessageData> lines = d.store.messages();
+    d.store.clear();
     clear();
-    d.queue = lines;
-    flush();
+
+    // only the rows that are filled when flushed get their html up front
+    const int from = qBound(0, d.fillFirst, lines.count());
+    const int to = d.fillLast < lines.count() ? qMax(from, d.fillLast + 1) : lines.count();
+    QList<MessageData> near = lines.mid(from, to - from);
+    realizeRows(near);
+    for (int i = 0; i < near.count(); ++i)
+        lines[from + i] = near.at(i);
+    d.queue.prepend(lines);
+    scheduleFlush();
     if (d.rebuild > 0) {
         killTimer(d.rebuild);
         d.rebuild = 0;
     }
+    d.stale = false;
+}
+
+void TextDocument::trimStore(int blocks)
+{
+    // the maximum block count drops blocks from the head at the end of an edit block
+    dropRows(d.store.count() - blocks);
+}
+
+void TextDocument::dropRows(int removed)
+{
+    // hibernated documents keep their rows in the queue, so those go too
+    removed = qMin(removed, totalCount());
+    if (removed > 0) {
+        int height = 0;
+        int unread = 0;
+        int highlights = 0;
+        for (int row = 0; row < removed; ++row) {
+            if (row < d.store.count())
+                height += qMax(0, cachedRowHeight(row));
+            unread += unreadLines(message(row), d.latestMessageSeen);
+        }
+        foreach (int highlight, d.highlights) {
+            if (highlight - d.serialBase >= removed)
+                break;
+            if (message(highlight - d.serialBase).timestamp() > d.latestMessageSeen)
+                ++highlights;
+        }
+        if (unread > 0 || highlights > 0) {
+            d.unread = d.unread.mid(qMin(unread, d.unread.count()));
+            d.unreadHighlights = d.unreadHighlights.mid(qMin(highlights, d.unreadHighlights.count()));
+            emit unreadCountChanged();
+        }
+        const int stored = qMin(removed, d.store.count());
+        d.store.removeFirst(stored);
+        const int cold = qMin(removed - stored, d.cold.count());
+        if (cold > 0)
+            d.store.spill(d.cold.takeFirst(cold));
+        if (removed > stored + cold) {
+            thaw();
+            d.store.spill(d.queue.mid(0, removed - stored - cold));
+            d.queue.removeFirst(removed - stored - cold);
+        }
+        shiftLights(removed);
+        if (height > 0)
+            emit lineRemoved(height);
+    }
+}
+
+void TextDocument::trimQueue()
+{
+    // a hidden backlog that outgrows the blocks would push out every
+    // inserted row, so the rows that are trimmed anyway are dropped here
+    if (!d.visible && !d.hibernated && d.queue.count() > d.queue.capacity())
+        hibernate();
+
+    if (d.hibernated)
+        dropRows(pendingCount() - d.queue.capacity());
+    else if (!d.batch)
+        FlushScheduler::instance()->schedule(this);
 }
 
 void TextDocument::scheduleRebuild()
 {
-    if (d.rebuild < 0 && !isEmpty())
-        d.rebuild = startTimer(isVisible() ? 0 : 1000);
+    if (isEmpty())
+        return;
+
+    // hidden documents are rebuilt lazily once they become visible
+    if (!isVisible())
+        d.stale = true;
+    else if (d.rebuild <= 0)
+        d.rebuild = startTimer(0);
+}
+
+bool TextDocument::updateTimeStamps(const QString& previous, QHash<qint64, QString>& previousTexts)
+{
+    if (isEmpty() || d.stale)
+        return true;
+
+    QTextCursor cursor(this);
+    cursor.beginEditBlock();
+    QTextBlock block = firstBlock();
+    for (int row = 0; row < d.store.count() && block.isValid(); ++row, block = block.next()) {
+        // placeholders are formatted with the new stamps once they are filled
+        const QDateTime timestamp = d.store.at(row).timestamp();
+        if (!timestamp.isValid() || !d.store.isFilled(row))
+            continue;
+
+        const QString before = cachedTimeStamp(previousTexts, timestamp, previous);
+        const QString after = cachedTimeStamp(d.timeStamps, timestamp, d.timeStampFormat);
+        if (before.isEmpty() || !block.text().startsWith(before)) {
+            cursor.endEditBlock();
+            return false;
+        }
+
+        if (before != after) {
+            cursor.setPosition(block.position());
+            cursor.setPosition(block.position() + before.length(), QTextCursor::KeepAnchor);
+            const QTextCharFormat format = cursor.charFormat();
+            if (after.isEmpty())
+                cursor.removeSelectedText();
+            else
+                cursor.insertText(after, format);
+        }
+    }
+    cursor.endEditBlock();
+    return true;
 }
 
 void TextDocument::shiftLights(int diff)
 {
-    QList<int>::iterator it = d.highlights.begin();
-    while (it != d.highlights.end()) {
-        *it -= diff;
-        if (*it < 0)
-            it = d.highlights.erase(it);
+    // the serials stay put, only the ones trimmed off the head are dropped
+    d.serialBase += diff;
+    while (!d.highlights.isEmpty() && d.highlights.first() < d.serialBase)
+        d.highlights.removeFirst();
+    if (d.lowlight != noSerial && d.lowlight < d.serialBase)
+        d.lowlight = noSerial;
+    QMap<int, int>::iterator echo = d.echoes.begin();
+    while (echo != d.echoes.end()) {
+        if (echo.value() < d.serialBase)
+            echo = d.echoes.erase(echo);
         else
-            ++it;
+            ++echo;
     }
-    d.lowlight -= diff;
+    if (d.scrollbackMarkerPosition != noSerial && d.scrollbackMarkerPosition < d.serialBase)
+        d.scrollbackMarkerPosition = noSerial;
+}
+
+int TextDocument::serialOf(int row) const
+{
+    return row < 0 ? noSerial : d.serialBase + row;
+}
+
+int TextDocument::rowOfSerial(int serial) const
+{
+    return serial == noSerial ? -1 : serial - d.serialBase;
 }
 
 void TextDocument::insert(QTextCursor& cursor, const MessageData& data)
 {
+    COMMUNI_TRACE("TextDocument::insert");
     cursor.movePosition(QTextCursor::End);
 
     if (!isEmpty()) {
-        const int count = blockCount();
-        const int max = maximumBlockCount();
-        const QRectF br = documentLayout()->blockBoundingRect(findBlockByNumber(0));
+        // make sure the head row has a known height before it gets trimmed
+        if (d.visible && blockCount() >= maximumBlockCount())
+            rowHeight(0);
         cursor.insertBlock();
+    }
 
-        if (count >= max) {
-            emit lineRemoved(qRound(br.bottom()));
-            shiftLights(max - count + 1);
-        }
+    // hidden documents and rows away from the viewport only lay out placeholders
+    const bool fill = fillsRow(d.store.count());
+    const MessageData row = fill ? realize(data) : data;
+    insertRow(cursor, row, fill);
+    d.store.append(row);
+    d.store.setFilled(d.store.count() - 1, fill);
+}
+
+void TextDocument::insertRow(QTextCursor& cursor, const MessageData& data, bool fill)
+{
+    static const QTextBlockFormat leftFormat = rowFormat(Qt::AlignLeft);
+    static const QTextBlockFormat rightFormat = rowFormat(Qt::AlignRight);
+
+    if (fill && !data.isLazy()) {
+        insertFormat(cursor, formatRow(data));
+        cursor.setBlockFormat(data.type() == IrcMessage::Unknown ? rightFormat : leftFormat);
+    } else {
+        cursor.setBlockFormat(placeholderFormat(data, estimatedRowHeight()));
     }
+}
 
-    cursor.insertHtml(formatBlock(data.timestamp(), data.format()));
-    cursor.block().setUserData(new TextBlockMessageData(data));
+void TextDocument::insertFormat(QTextCursor& cursor, const QString& html)
+{
+    if (!insertRuns(cursor, html))
+        cursor.insertHtml(html);
+}
 
-    QTextBlockFormat format = cursor.blockFormat();
-    format.setLineHeight(125, QTextBlockFormat::ProportionalHeight);
-    if (data.type() == IrcMessage::Unknown)
-        format.setAlignment(Qt::AlignRight);
-    else
-        format.setAlignment(Qt::AlignLeft);
-    cursor.setBlockFormat(format);
+bool TextDocument::insertRuns(QTextCursor& cursor, const QString& html)
+{
+    COMMUNI_TRACE("TextDocument::insertRuns");
+    MessageFormatter::FormatRuns runs;
+    if (!directRuns || html.isEmpty() || !MessageFormatter::formatRuns(html, &runs))
+        return false;
+
+    QVector<RunFormat> formats;
+    formats.reserve(runs.formats.count());
+    foreach (const QString& tags, runs.formats)
+        formats += runFormat(tags);
+
+    // white space collapses the way the importer would, unless the sheet says pre
+    bool space = true;
+    foreach (const MessageFormatter::FormatRun& run, runs.runs) {
+        const RunFormat& format = formats.at(run.format);
+        QString text;
+        if (format.pre) {
+            text = run.text;
+        } else {
+            text.reserve(run.text.length());
+            foreach (const QChar& c, run.text) {
+                if (c == QLatin1Char(' ') || c == QLatin1Char('\t')) {
+                    if (!space)
+                        text += QLatin1Char(' ');
+                    space = true;
+                } else {
+                    text += c;
+                    space = c == QChar::LineSeparator;
+                }
+            }
+        }
+        if (format.pre && !text.isEmpty()) {
+            const QChar last = text.at(text.length() - 1);
+            space = last == QLatin1Char(' ') || last == QChar::LineSeparator;
+        }
+        if (text.isEmpty())
+            continue;
+
+        if (run.anchor.isEmpty()) {
+            cursor.insertText(text, format.format);
+        } else {
+            QTextCharFormat anchor = format.format;
+            anchor.setAnchorHref(run.anchor);
+            cursor.insertText(text, anchor);
+        }
+    }
+    if (cursor.hasSelection())
+        cursor.removeSelectedText();
+    return true;
+}
+
+TextDocument::RunFormat TextDocument::runFormat(const QString& tags) const
+{
+    QHash<QString, RunFormat>::const_iterator it = d.runFormats.constFind(tags);
+    if (it != d.runFormats.constEnd())
+        return *it;
+
+    // resolved once per tag stack by the importer itself, against the same sheet
+    QTextDocument probe;
+    probe.setDefaultStyleSheet(defaultStyleSheet());
+    QTextCursor cursor(&probe);
+    cursor.insertHtml(tags + QLatin1String("x  x"));
+
+    RunFormat format;
+    format.pre = probe.characterCount() > 4;
+    cursor.setPosition(1);
+    format.format = cursor.charFormat();
+    if (d.runFormats.count() >= maximumRunFormats)
+        d.runFormats.clear();
+    d.runFormats.insert(tags, format);
+    return format;
 }
 
 QString TextDocument::formatEvents(const QList<MessageData>& events) const
@@ -629,57 +2283,42 @@ QString TextDocument::formatEvents(const QList<MessageData>& events) const
     return QString();
 }
 
-QString TextDocument::formatSummary(const QList<MessageData>& events) const
+QString TextDocument::formatSummary(const MessageData& message) const
 {
     QStringList actions;
     QStringList changes;
-    QSet<QString> nicks;
-    QSet<IrcMessage::Type> handled;
+    const QSet<QString> nicks = message.eventNicks();
     EventFormatter formatter;
 
-    foreach (const MessageData& event, events) {
-        switch (event.type()) {
+    foreach (int kind, message.eventKinds()) {
+        switch (kind) {
         case IrcMessage::Join:
-            if (!handled.contains(event.type()))
-                actions += tr("joined");
+            actions += tr("joined");
             break;
         case IrcMessage::Part:
-            if (!handled.contains(event.type()))
-                actions += tr("left");
+            actions += tr("left");
+            break;
+        case IrcMessage::Error:
+            actions += tr("disconnected");
             break;
         case IrcMessage::Quit:
-            if (event.isError()) {
-                if (!handled.contains(IrcMessage::Error))
-                    actions += tr("disconnected");
-                nicks.insert(event.nick());
-                handled.insert(IrcMessage::Error);
-                continue;
-            } else {
-                if (!handled.contains(event.type()))
-                    actions += tr("quit");
-            }
+            actions += tr("quit");
             break;
         case IrcMessage::Kick:
-            if (!handled.contains(event.type()))
-                actions += tr("kicked");
+            actions += tr("kicked");
             break;
         case IrcMessage::Nick:
-            if (!handled.contains(event.type()))
-                changes += tr("nick");
+            changes += tr("nick");
             break;
         case IrcMessage::Mode:
-            if (!handled.contains(event.type()))
-                changes += tr("mode");
+            changes += tr("mode");
             break;
         case IrcMessage::Topic:
-            if (!handled.contains(event.type()))
-                changes += tr("topic");
+            changes += tr("topic");
             break;
         default:
             break;
         }
-        nicks.insert(event.nick());
-        handled.insert(event.type());
     }
 
     if (!changes.isEmpty())
@@ -701,8 +2340,20 @@ QString TextDocument::formatBlock(const QDateTime& timestamp, const QString& mes
     if (message.isEmpty())
         return QString();
 
-    const QString time = timestamp.time().toString(d.timeStampFormat);
-    return tr("<span class='timestamp'>%1</span> %2").arg(time, message);
+    const QString time = cachedTimeStamp(d.timeStamps, timestamp, d.timeStampFormat);
+    return MessageTemplate::translate("TextDocument", QT_TR_NOOP("<span class='timestamp'>%1</span> %2")).fill(time, message);
+}
+
+QString TextDocument::formatRow(const MessageData& data) const
+{
+    if (!data.isGroup())
+        return formatBlock(data.timestamp(), data.format());
+
+    // grouped lines share the block and are broken within it
+    QStringList lines;
+    foreach (const MessageData& line, data.getEvents())
+        lines += formatBlock(line.timestamp(), line.format());
+    return lines.join("<br/>");
 }
 
 #include "textdocument.moc"
@@ -30,13 +30,25 @@
 #define TEXTDOCUMENT_H
 
 #include <QTextDocument>
+#include <QTextFormat>
+#include <QFont>
 #include <QMetaType>
 #include <QDateTime>
+#include <QSet>
+#include <QHash>
+#include <QMap>
+#include <QCache>
+#include <QQueue>
+#include <QStringList>
 #include "baseglobal.h"
+#include "coldstore.h"
 #include "messagedata.h"
+#include "messagequeue.h"
+#include "messagestore.h"
 
 class IrcBuffer;
 class IrcMessage;
+class IrcBatchMessage;
 class MessageData;
 class MessageFormatter;
 
@@ -46,6 +58,7 @@ class BASE_EXPORT TextDocument : public QTextDocument
 
 public:
     explicit TextDocument(IrcBuffer* buffer);
+    ~TextDocument();
 
     QString timeStampFormat() const;
     void setTimeStampFormat(const QString& format);
@@ -56,19 +69,89 @@ public:
     TextDocument* clone();
     bool isClone() const;
 
+    static int groupWindow();
+    static void setGroupWindow(int msecs);
+
+    static bool directInsert();
+    static void setDirectInsert(bool direct);
+
+    bool isFirehose() const;
+    void setFirehose(bool firehose);
+
     IrcBuffer* buffer() const;
     MessageFormatter* formatter() const;
 
     int totalCount() const;
+    int pendingCount() const;
+    bool hasPendingHighlight() const;
+    int flushQueue(int count);
+
+    MessageData message(int row) const;
+    int rowAt(const QPoint& pos) const;
+    int rowHeight(int row) const;
+    int rowOffset(int row) const;
+
+    // only the rows around the viewport carry their html, the others are
+    // empty blocks of their measured height, see setViewportRows()
+    bool isPlaceholder(int row) const;
+    bool isViewportLimited() const;
+    void setViewportLimited(bool limited);
+    bool setViewportRows(int first, int last, bool bottom);
+
+    QList<int> highlightedRows() const;
+    int scrollbackMarkerRow() const;
 
     bool isVisible() const;
     void setVisible(bool visible);
+    qint64 idleTime() const;
+
+    // hidden, but laid out ahead of a likely switch
+    bool isWarm() const;
+    void setWarm(bool warm);
+
+    bool isHibernated() const;
+    qint64 footprint() const;
+    qint64 cacheFootprint() const;
+
+    // estimated bytes, see footprint()
+    struct Footprint {
+        Footprint() : rows(0), blocks(0), slots(0), html(0), raw(0), layout(0), events(0), index(0), caches(0), cold(0), coldRaw(0) { }
+        qint64 total() const { return html + raw + layout + events + index + caches + cold; }
+        int rows;
+        int blocks;
+        int slots;
+        qint64 html;
+        qint64 raw;
+        qint64 layout;
+        qint64 events;
+        qint64 index;
+        qint64 caches;
+        // compressed bytes of the cold rows and what they took uncompressed
+        qint64 cold;
+        qint64 coldRaw;
+    };
+    Footprint measure() const;
 
     QDateTime latestMessageSeen() const;
     void setLatestMessageSeen(const QDateTime& timestamp);
     QDateTime latestMessageReceived() const;
 
     int unreadMessages() const;
+    int unreadHighlights() const;
+
+    bool hasHistory() const;
+    int loadHistory(int count);
+    bool fetchHistory(int count);
+    bool isFetchingHistory() const;
+    int prependHistory(const QList<IrcMessage*>& messages);
+    void restore(const QList<IrcMessage*>& messages);
+
+    // own lines shown before they are sent, see SendQueue::echo()
+    int echoRow(int echo) const;
+    bool confirmEcho(int echo, IrcMessage* reply = 0);
+
+    QList<MessageData> snapshot(int count, QList<int>* highlights = 0) const;
+    void restoreSnapshot(const QList<MessageData>& rows, const QList<int>& highlights);
 
     void drawBackground(QPainter* painter, const QRect& bounds);
     void drawForeground(QPainter* painter, const QRect& bounds);
@@ -77,6 +160,10 @@ public:
 
 public slots:
     void reset();
+    void hibernate();
+    qint64 releaseCaches();
+    void shrink(int rows);
+    void releaseHistory();
     void lowlight(int block = -1);
     void addHighlight(int block = -1);
     void removeHighlight(int block);
@@ -90,39 +177,145 @@ signals:
     void messageHighlighted(IrcMessage* message);
     void privateMessageReceived(IrcMessage* message);
     void latestMessageSeenChanged(const QDateTime& timestamp);
+    void unreadCountChanged();
+    void messageAppended(const MessageData& message, bool highlight);
+    void linesPrepended(int height);
+    void historyRequested(const QDateTime& before, int count);
+    void remoteHistoryRequested(const QDateTime& before, int count);
+    void cachesReleased();
 
 protected:
     void updateBlock(int number);
     void timerEvent(QTimerEvent* event);
+    QVariant loadResource(int type, const QUrl& name);
 
 private slots:
     void flush();
     void rebuild();
+    void warmUp();
+    void trimStore(int blocks);
+    void appendFormatted(const MessageData& data);
+    void appendMirrored(const MessageData& data, bool highlight);
+    void renderFirehose();
+    void updatePreview(const QString& url);
+    void freeze();
 
 private:
+    void receiveFirehose(IrcMessage* message);
+    void post(const MessageData& data, bool highlight, const QStringList& texts);
+    void publish(const MessageData& data, bool highlight);
+    void requestPreview(int row, const MessageData& data);
+    int appendRow(const MessageData& data);
+    int insertLate(const MessageData& data, bool unread);
+    void shiftRows(int row, bool unread);
+    void completeFormat(int sequence, const QString& format);
+    MessageData prepare(IrcMessage* message);
+    MessageData realize(const MessageData& data);
+    void realizeRows(QList<MessageData>& rows);
+    void scheduleFlush();
+    void receiveBatch(IrcBatchMessage* batch);
+    void prependRows(QList<MessageData> rows);
+    bool isRestored(IrcMessage* message);
+    bool isDuplicate(IrcMessage* message);
+    int processMessage(IrcMessage* message, const MessageData& data);
     void scheduleRebuild();
+    void recountUnread();
+    bool updateTimeStamps(const QString& previous, QHash<qint64, QString>& previousTexts);
     void shiftLights(int diff);
+    int serialOf(int row) const;
+    int rowOfSerial(int serial) const;
+    void dropRows(int count);
+    void trimQueue();
+    void thaw();
+    void coldStored(int generation, const ColdStore& store);
+    int cachedRowHeight(int row) const;
+    void measureRows(int from);
+    void updateFillRange();
+    bool fillsRow(int row) const;
+    bool layoutRows();
+    int estimatedRowHeight() const;
+    void patchRow(int row, const MessageData& data);
+    void insertRow(QTextCursor& cursor, const MessageData& data, bool fill);
+    void insertFormat(QTextCursor& cursor, const QString& html);
+    bool insertRuns(QTextCursor& cursor, const QString& html);
 
     QString formatEvents(const QList<MessageData>& events) const;
-    QString formatSummary(const QList<MessageData>& events) const;
+    QString formatSummary(const MessageData& message) const;
     QString formatBlock(const QDateTime& timestamp, const QString& message) const;
+    QString formatRow(const MessageData& data) const;
 
     friend class TextBrowser;
+    friend class FormatPipeline;
+    friend class ColdCompressor;
+
+    struct RunFormat {
+        QTextCharFormat format;
+        bool pre;
+    };
+    RunFormat runFormat(const QString& tags) const;
+
+    struct Parked {
+        MessageData data;
+        bool highlight;
+        bool ready;
+    };
 
     struct Private {
+        // the marker, lowlight and highlights are row serials, trimming
+        // the head only moves the base, see shiftLights()
+        int serialBase;
         int scrollbackMarkerPosition;
-        int dirty;
         bool clone;
         bool batch;
+        bool stale;
+        bool restyle;
         int rebuild;
         QString css;
         int lowlight;
+        int history;
+        qint64 fetching;
+        bool fetched;
         bool visible;
+        bool warm;
+        bool hibernated;
+        bool firehose;
+        int firehoseCount;
+        qint64 firehoseSince;
+        MessageQueue firehoseLines;
+        qint64 hiddenSince;
         IrcBuffer* buffer;
+        TextDocument* source;
         QDateTime latestMessageSeen;
+        QList<QDateTime> unread;
+        QList<QDateTime> unreadHighlights;
         QList<int> highlights;
+        int echo;
+        QMap<int, int> echoes;
         QString timeStampFormat;
-        QList<MessageData> queue;
+        mutable QHash<qint64, QString> timeStamps;
+        mutable QCache<QString, QString> tooltips;
+        mutable QHash<QString, RunFormat> runFormats;
+        MessageQueue queue;
+        // hibernated rows ahead of the queue, see freeze()
+        ColdStore cold;
+        int coldGeneration;
+        QSet<QByteArray> restored;
+        QDateTime restoredUntil;
+        QSet<quint64> recent;
+        QQueue<quint64> recentOrder;
+        QList<Parked> parked;
+        QMultiHash<QString, int> previews;
+        int parkedBase;
+        MessageStore store;
+        qreal storeWidth;
+        QFont storeFont;
+        // the viewport follows the bottom while its first row is -1
+        bool limited;
+        int viewportFirst;
+        int viewportLast;
+        int viewportRows;
+        int fillFirst;
+        int fillLast;
         MessageFormatter* formatter;
     } d;
 };
@@ -0,0 +1,275 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "textexport.h"
+#include "textdocument.h"
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QApplication>
+#include <QTextStream>
+#include <QClipboard>
+#include <QMimeData>
+#include <QSaveFile>
+#include <QRunnable>
+#include <QFileInfo>
+#include <IrcMessage>
+
+// rows are rendered and written in chunks of this many, progress is reported per chunk
+static const int ChunkRows = 1000;
+
+static QString plainText(const QString& html)
+{
+    // the formatter only emits simple inline markup, a full parser is not needed
+    QString text;
+    text.reserve(html.length());
+    for (int i = 0; i < html.length(); ++i) {
+        const QChar c = html.at(i);
+        if (c == QLatin1Char('<')) {
+            const int end = html.indexOf(QLatin1Char('>'), i);
+            if (end == -1)
+                break;
+            if (html.midRef(i + 1, 2).compare(QLatin1String("br"), Qt::CaseInsensitive) == 0)
+                text += QLatin1Char('\n');
+            i = end;
+        } else if (c == QLatin1Char('&')) {
+            const int end = html.indexOf(QLatin1Char(';'), i);
+            const QStringRef entity = end == -1 ? QStringRef() : html.midRef(i + 1, end - i - 1);
+            if (entity == QLatin1String("lt"))
+                text += QLatin1Char('<');
+            else if (entity == QLatin1String("gt"))
+                text += QLatin1Char('>');
+            else if (entity == QLatin1String("amp"))
+                text += QLatin1Char('&');
+            else if (entity == QLatin1String("quot"))
+                text += QLatin1Char('"');
+            else if (entity == QLatin1String("nbsp"))
+                text += QLatin1Char(' ');
+            else if (entity.startsWith(QLatin1Char('#'))) {
+                const QString number = entity.mid(1).toString();
+                bool ok = false;
+                const uint code = number.startsWith(QLatin1Char('x')) ? number.mid(1).toUInt(&ok, 16) : number.toUInt(&ok);
+                if (!ok || code > 0xffff) {
+                    text += c;
+                    continue;
+                }
+                text += QChar(code);
+            } else {
+                text += c;
+                continue;
+            }
+            i = end;
+        } else {
+            text += c;
+        }
+    }
+    return text;
+}
+
+static QString rawText(const MessageData& data)
+{
+    // lazy rows got no html yet, the raw line is all there is
+    IrcMessage* message = IrcMessage::fromData(data.data(), 0);
+    if (!message)
+        return QString();
+    QString text;
+    if (message->type() == IrcMessage::Private)
+        text = QString("<%1> %2").arg(data.nick(), static_cast<IrcPrivateMessage*>(message)->content());
+    else if (message->type() == IrcMessage::Notice)
+        text = QString("-%1- %2").arg(data.nick(), static_cast<IrcNoticeMessage*>(message)->content());
+    else
+        text = QString("%1 %2").arg(message->command(), message->parameters().join(" "));
+    delete message;
+    return text;
+}
+
+class ExportTask : public QRunnable
+{
+public:
+    ExportTask(QObject* receiver, QAtomicInt* cancelled, const QList<MessageData>& rows,
+               const QString& timeStampFormat, const QString& css, const QString& filePath, TextExport::Format format)
+        : m_receiver(receiver), m_cancelled(cancelled), m_rows(rows), m_timeStampFormat(timeStampFormat),
+          m_css(css), m_filePath(filePath), m_format(format)
+    {
+    }
+
+    void run()
+    {
+        // an empty path collects plain text and html for the clipboard
+        QSaveFile file(m_filePath);
+        const bool clipboard = m_filePath.isEmpty();
+        if (!clipboard && !file.open(QIODevice::WriteOnly)) {
+            finish(false);
+            return;
+        }
+
+        QString text;
+        QString html;
+        QTextStream out(&file);
+        out.setCodec("UTF-8");
+
+        if (clipboard || m_format == TextExport::Html)
+            html += QString("<html><head><meta charset='utf-8'/><style>%1</style></head><body>\n").arg(m_css);
+
+        for (int row = 0; row < m_rows.count(); ++row) {
+            const MessageData& data = m_rows.at(row);
+            const QList<MessageData> lines = data.isGroup() ? data.getEvents() : QList<MessageData>() << data;
+            foreach (const MessageData& line, lines) {
+                if (line.isEmpty())
+                    continue;
+                const QString time = line.timestamp().toString(m_timeStampFormat);
+                const QString body = line.isLazy() || line.format().isEmpty() ? rawText(line).toHtmlEscaped() : line.format();
+                if (clipboard || m_format == TextExport::PlainText)
+                    text += time + QLatin1Char(' ') + plainText(body) + QLatin1Char('\n');
+                if (clipboard || m_format == TextExport::Html)
+                    html += QString("<div><span class='timestamp'>%1</span> %2</div>\n").arg(time.toHtmlEscaped(), body);
+                if (m_format == TextExport::JsonLines && !clipboard) {
+                    QJsonObject object;
+                    object.insert("msecs", double(line.msecs()));
+                    object.insert("type", int(line.type()));
+                    object.insert("nick", line.nick());
+                    object.insert("text", plainText(body));
+                    object.insert("raw", QString::fromUtf8(line.data()));
+                    text += QString::fromUtf8(QJsonDocument(object).toJson(QJsonDocument::Compact)) + QLatin1Char('\n');
+                }
+            }
+
+            if ((row + 1) % ChunkRows == 0 || row == m_rows.count() - 1) {
+                if (m_cancelled->load()) {
+                    file.cancelWriting();
+                    finish(false);
+                    return;
+                }
+                if (!clipboard) {
+                    // the file takes what the chunk produced, nothing piles up in memory
+                    out << (m_format == TextExport::Html ? html : text);
+                    text.clear();
+                    html.clear();
+                }
+                QMetaObject::invokeMethod(m_receiver, "advance", Qt::QueuedConnection, Q_ARG(int, row + 1));
+            }
+        }
+
+        if (clipboard || m_format == TextExport::Html)
+            html += QLatin1String("</body></html>\n");
+        if (clipboard) {
+            finish(true, text, html);
+            return;
+        }
+        out << html;
+        out.flush();
+        finish(file.commit());
+    }
+
+private:
+    void finish(bool ok, const QString& text = QString(), const QString& html = QString())
+    {
+        QMetaObject::invokeMethod(m_receiver, "complete", Qt::QueuedConnection,
+                                  Q_ARG(bool, ok), Q_ARG(QString, text), Q_ARG(QString, html));
+    }
+
+    QObject* m_receiver;
+    QAtomicInt* m_cancelled;
+    QList<MessageData> m_rows;
+    QString m_timeStampFormat;
+    QString m_css;
+    QString m_filePath;
+    TextExport::Format m_format;
+};
+
+TextExport::TextExport(TextDocument* document, int first, int last, QObject* parent) : QObject(parent)
+{
+    d.running = false;
+    d.cancelled.store(0);
+    d.pool.setMaxThreadCount(1);
+
+    // snapshots only, the worker never touches the document or its event groups
+    d.css = document->styleSheet();
+    d.timeStampFormat = document->timeStampFormat();
+    const int end = qMin(last, document->totalCount() - 1);
+    for (int row = qMax(0, first); row <= end; ++row)
+        d.rows += document->message(row).snapshot();
+}
+
+TextExport::~TextExport()
+{
+    d.cancelled.store(1);
+    d.pool.waitForDone();
+}
+
+int TextExport::count() const
+{
+    return d.rows.count();
+}
+
+TextExport::Format TextExport::formatOf(const QString& filePath)
+{
+    const QString suffix = QFileInfo(filePath).suffix().toLower();
+    if (suffix == "html" || suffix == "htm")
+        return Html;
+    if (suffix == "json" || suffix == "jsonl")
+        return JsonLines;
+    return PlainText;
+}
+
+void TextExport::toFile(const QString& filePath, Format format)
+{
+    if (d.running || filePath.isEmpty())
+        return;
+    d.running = true;
+    d.pool.start(new ExportTask(this, &d.cancelled, d.rows, d.timeStampFormat, d.css, filePath, format));
+}
+
+void TextExport::toClipboard()
+{
+    if (d.running)
+        return;
+    d.running = true;
+    d.pool.start(new ExportTask(this, &d.cancelled, d.rows, d.timeStampFormat, d.css, QString(), PlainText));
+}
+
+void TextExport::cancel()
+{
+    d.cancelled.store(1);
+}
+
+void TextExport::advance(int done)
+{
+    emit progress(done);
+}
+
+void TextExport::complete(bool ok, const QString& text, const QString& html)
+{
+    d.running = false;
+    if (ok && !text.isNull()) {
+        QMimeData* mime = new QMimeData;
+        mime->setText(text);
+        mime->setHtml(html);
+        QApplication::clipboard()->setMimeData(mime);
+    }
+    emit finished(ok);
+}
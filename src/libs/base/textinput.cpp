@@ -27,10 +27,13 @@
 */
 
 #include "textinput.h"
+#include "sendqueue.h"
+#include "inputlatency.h"
 #include <QStyleOptionFrame>
 #include <IrcCommandParser>
 #include <IrcBufferModel>
 #include <IrcConnection>
+#include <IrcNetwork>
 #include <QMessageBox>
 #include <QSettings>
 #include <QCheckBox>
@@ -46,12 +49,9 @@ TextInput::TextInput(QWidget* parent) : QLineEdit(parent)
     d.index = 0;
     d.buffer = 0;
     d.parser = 0;
-
-    d.completer = new IrcCompleter(this);
-    connect(this, SIGNAL(bufferChanged(IrcBuffer*)), d.completer, SLOT(setBuffer(IrcBuffer*)));
-    connect(this, SIGNAL(parserChanged(IrcCommandParser*)), d.completer, SLOT(setParser(IrcCommandParser*)));
-    connect(d.completer, SIGNAL(completed(QString,int)), this, SLOT(doComplete(QString,int)));
-    connect(this, SIGNAL(textEdited(QString)), d.completer, SLOT(reset()));
+    d.candidate = 0;
+    d.completionStart = 0;
+    d.completionLength = 0;
 
     connect(this, SIGNAL(returnPressed()), this, SLOT(sendInput()));
     connect(this, SIGNAL(textChanged(QString)), this, SLOT(updateHint(QString)));
@@ -110,6 +110,7 @@ void TextInput::setParser(IrcCommandParser* parser)
         unbind(d.buffer, d.parser);
         bind(d.buffer, parser);
         d.parser = parser;
+        d.commands.clear();
         emit parserChanged(parser);
     }
 }
@@ -117,12 +118,13 @@ void TextInput::setParser(IrcCommandParser* parser)
 bool TextInput::event(QEvent* event)
 {
     if (event->type() == QEvent::KeyPress) {
+        InputLatency::keyPressed();
         switch (static_cast<QKeyEvent*>(event)->key()) {
         case Qt::Key_Tab:
-            tryComplete(IrcCompleter::Forward);
+            tryComplete(true);
             return true;
         case Qt::Key_Backtab:
-            tryComplete(IrcCompleter::Backward);
+            tryComplete(false);
             return true;
         case Qt::Key_Up:
             goBackward();
@@ -144,6 +146,7 @@ bool TextInput::event(QEvent* event)
 void TextInput::paintEvent(QPaintEvent* event)
 {
     QLineEdit::paintEvent(event);
+    InputLatency::painted();
 
     if (!d.hint.isEmpty()) {
         QStyleOptionFrame option;
@@ -260,20 +263,25 @@ void TextInput::sendInput()
         d.index = d.history.count();
     }
 
+    // pastes go behind anything typed meanwhile
+    SendQueue* queue = SendQueue::instance(c);
+    const SendQueue::Lane lane = lines.count() > 1 ? SendQueue::Bulk : SendQueue::Interactive;
+
     bool error = false;
     foreach (const QString& line, lines) {
         if (!line.trimmed().isEmpty()) {
             IrcCommand* cmd = p->parse(line);
             if (cmd) {
                 cmd->setProperty("TextInput", true);
-                b->sendCommand(cmd);
+                // the own line is shown pending first, the echo confirms it
                 if (cmd->type() == IrcCommand::Message || cmd->type() == IrcCommand::Notice || cmd->type() == IrcCommand::CtcpAction) {
-                    IrcMessage* msg = cmd->toMessage(c->nickName(), c);
+                    IrcMessage* msg = queue->echo(cmd);
                     if (msg) {
                         b->receiveMessage(msg);
                         msg->deleteLater();
                     }
                 }
+                queue->send(cmd, lane);
             } else {
                 error = true;
             }
@@ -283,9 +291,67 @@ void TextInput::sendInput()
         clear();
 }
 
-void TextInput::tryComplete(IrcCompleter::Direction direction)
+void TextInput::tryComplete(bool forward)
+{
+    // repeated tabs cycle through the candidates found for the first one
+    if (d.candidates.isEmpty() || text() != d.completed) {
+        const QString txt = text();
+        const int cursor = cursorPosition();
+        const int start = cursor > 0 ? txt.lastIndexOf(' ', cursor - 1) + 1 : 0;
+        const QString prefix = txt.mid(start, cursor - start);
+        d.candidates = completions(prefix, start == 0);
+        if (d.candidates.isEmpty())
+            return;
+        d.candidate = forward ? -1 : d.candidates.count();
+        d.completionStart = start;
+        d.completionLength = prefix.length();
+    }
+
+    const int count = d.candidates.count();
+    d.candidate = ((forward ? d.candidate + 1 : d.candidate - 1) + count) % count;
+    const QString completion = d.candidates.at(d.candidate);
+    QString txt = text();
+    txt.replace(d.completionStart, d.completionLength, completion);
+    d.completionLength = completion.length();
+    d.completed = txt;
+    doComplete(txt, d.completionStart + d.completionLength);
+}
+
+QStringList TextInput::completions(const QString& prefix, bool first)
 {
-    d.completer->complete(text(), cursorPosition(), direction);
+    QStringList candidates;
+    if (first && prefix.startsWith('/')) {
+        if (d.parser) {
+            const QStringList commands = d.parser->commands();
+            if (d.commands.count() != commands.count()) {
+                d.commands.clear();
+                foreach (const QString& command, commands)
+                    d.commands.insert(command);
+            }
+            foreach (const QString& command, d.commands.complete(prefix.mid(1)))
+                candidates += "/" + command + " ";
+        }
+        return candidates;
+    }
+    if (!d.buffer || prefix.isEmpty())
+        return candidates;
+
+    const QStringList types = d.buffer->network()->channelTypes();
+    if (types.contains(prefix.left(1))) {
+        QStringList channels = d.buffer->model()->channels();
+        channels.sort(Qt::CaseInsensitive);
+        foreach (const QString& channel, channels) {
+            if (channel.startsWith(prefix, Qt::CaseInsensitive))
+                candidates += channel + " ";
+        }
+        return candidates;
+    }
+
+    // nicks at the start of the line address the user
+    const QString suffix = first ? ": " : " ";
+    foreach (const QString& nick, CompletionIndex::instance(d.buffer)->complete(prefix))
+        candidates += nick + suffix;
+    return candidates;
 }
 
 void TextInput::doComplete(const QString& text, int cursor)
@@ -33,8 +33,8 @@
 #include <QPointer>
 #include <QLineEdit>
 #include <QStringList>
-#include <IrcCompleter>
 #include "baseglobal.h"
+#include "completionindex.h"
 
 class IrcBuffer;
 class IrcCommandParser;
@@ -68,10 +68,11 @@ private slots:
     void goBackward();
     void goForward();
     void sendInput();
-    void tryComplete(IrcCompleter::Direction direction);
+    void tryComplete(bool forward);
     void doComplete(const QString& text, int cursor);
 
 private:
+    QStringList completions(const QString& prefix, bool first);
     QByteArray saveState() const;
     void restoreState(const QByteArray& state);
 
@@ -80,7 +81,12 @@ private:
         QString hint;
         QString current;
         QStringList history;
-        IrcCompleter* completer;
+        int candidate;
+        int completionStart;
+        int completionLength;
+        QString completed;
+        QStringList candidates;
+        CompletionTrie commands;
         IrcCommandParser* parser;
         QPointer<IrcBuffer> buffer;
         QHash<IrcBuffer*, QByteArray> states;
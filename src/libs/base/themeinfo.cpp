@@ -29,6 +29,7 @@
 #include "themeinfo.h"
 #include <QStringList>
 #include <QSettings>
+#include <QRegExp>
 #include <QFileInfo>
 #include <QFile>
 #include <QDir>
@@ -63,6 +64,11 @@ QString ThemeInfo::style() const
     return d.style;
 }
 
+QString ThemeInfo::documentStyle() const
+{
+    return d.documentStyle;
+}
+
 QString ThemeInfo::gtkThemeVariant() const
 {
     return d.gtkThemeVariant;
@@ -90,6 +96,42 @@ static QString readFile(const QDir& dir, const QString& fileName)
     return QString();
 }
 
+// keeps the rules that apply to message html, widget selectors
+// start with an upper case class name and are of no use to documents
+static QString documentRules(const QString& css)
+{
+    QRegExp comments("/\\*.*\\*/");
+    comments.setMinimal(true);
+    const QString text = QString(css).remove(comments);
+
+    QString rules;
+    int pos = 0;
+    while (pos < text.length()) {
+        const int open = text.indexOf('{', pos);
+        if (open == -1)
+            break;
+        int close = open + 1;
+        for (int depth = 1; close < text.length() && depth > 0; ++close) {
+            if (text.at(close) == '{')
+                ++depth;
+            else if (text.at(close) == '}')
+                --depth;
+        }
+
+        const QString selectors = text.mid(pos, open - pos).trimmed();
+        bool html = !selectors.isEmpty() && !selectors.startsWith('@');
+        foreach (const QString& selector, selectors.split(',')) {
+            const QString sel = selector.trimmed();
+            if (sel.isEmpty() || sel.at(0).isUpper())
+                html = false;
+        }
+        if (html)
+            rules += text.mid(pos, close - pos).trimmed() + '\n';
+        pos = close;
+    }
+    return rules;
+}
+
 bool ThemeInfo::load(const QString& filePath)
 {
     QSettings settings(filePath, QSettings::IniFormat);
@@ -104,6 +146,7 @@ bool ThemeInfo::load(const QString& filePath)
         d.version = settings.value("version").toString();
         d.description = settings.value("description").toString();
         d.style = readFile(QFileInfo(filePath).dir(), settings.value("style").toString());
+        d.documentStyle = documentRules(d.style);
         d.gtkThemeVariant = settings.value("gtk-theme-variant").toString();
         d.font = settings.value("font").toString();
         settings.endGroup();
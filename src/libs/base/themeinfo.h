@@ -44,6 +44,7 @@ public:
     QString version() const;
     QString description() const;
     QString style() const;
+    QString documentStyle() const;
     QString gtkThemeVariant() const;
     QString font() const;
     QString path() const;
@@ -55,6 +56,7 @@ private:
         QString version;
         QString description;
         QString style;
+        QString documentStyle;
         QString gtkThemeVariant;
         QString font;
         QString path;
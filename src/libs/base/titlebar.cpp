@@ -28,11 +28,12 @@
 
 #include "titlebar.h"
 #include "messageformatter.h"
+#include "userindex.h"
+#include "taskscheduler.h"
 #include <QStyleOptionHeader>
 #include <QPropertyAnimation>
 #include <QStylePainter>
 #include <IrcTextFormat>
-#include <IrcUserModel>
 #include <QApplication>
 #include <QMouseEvent>
 #include <QHeaderView>
@@ -174,6 +175,7 @@ void TitleBar::setBuffer(IrcBuffer* buffer)
                 disconnect(d.buffer, SIGNAL(destroyed(IrcBuffer*)), this, SLOT(cleanup()));
             }
             disconnect(d.buffer, SIGNAL(titleChanged(QString)), this, SLOT(refresh()));
+            d.buffer->removeEventFilter(this);
         }
         d.buffer = buffer;
         if (d.buffer) {
@@ -183,14 +185,16 @@ void TitleBar::setBuffer(IrcBuffer* buffer)
                 connect(channel, SIGNAL(topicChanged(QString)), this, SLOT(refresh()));
                 connect(channel, SIGNAL(modeChanged(QString)), this, SLOT(refresh()));
                 if (!d.model) {
-                    d.model = new IrcUserModel(this);
-                    connect(d.model, SIGNAL(countChanged(int)), this, SLOT(refresh()));
+                    d.model = new UserView(Irc::SortByTitle, this);
+                    connect(d.model, SIGNAL(countChanged(int)), this, SLOT(scheduleRefresh()));
                 }
                 d.model->setChannel(channel);
             } else {
                 connect(d.buffer, SIGNAL(destroyed(IrcBuffer*)), this, SLOT(cleanup()));
             }
             connect(d.buffer, SIGNAL(titleChanged(QString)), this, SLOT(refresh()));
+            // firehose documents publish their rate as a property, see TextDocument
+            d.buffer->installEventFilter(this);
         }
         collapse();
         refresh();
@@ -233,8 +237,11 @@ bool TitleBar::event(QEvent* event)
 
 bool TitleBar::eventFilter(QObject* object, QEvent* event)
 {
-    Q_UNUSED(object);
     switch (event->type()) {
+    case QEvent::DynamicPropertyChange:
+        if (object == d.buffer && static_cast<QDynamicPropertyChangeEvent*>(event)->propertyName() == "firehoseRate")
+            scheduleRefresh();
+        break;
     case QEvent::Hide:
         if (!underMouse())
             collapse();
@@ -308,29 +315,51 @@ void TitleBar::cleanup()
     refresh();
 }
 
+void TitleBar::scheduleRefresh()
+{
+    // joins and parts in big channels only move the count, a few updates a second do
+    TaskScheduler::instance()->schedule(TaskScheduler::Pacing, this, "refresh", 250);
+}
+
 void TitleBar::refresh()
 {
-    clear();
+    TaskScheduler::instance()->unschedule(this, "refresh");
 
     IrcChannel* channel = qobject_cast<IrcChannel*>(d.buffer);
     QString title = d.buffer ? d.buffer->title() : QString();
-    QString topic = channel ? d.formatter->formatText(channel->topic()) : QString();
+
+    // linkifying a long topic is the expensive part, redo it only when it changes
+    const QString rawTopic = channel ? channel->topic() : QString();
+    if (rawTopic != d.rawTopic) {
+        d.rawTopic = rawTopic;
+        d.topic = d.formatter->formatText(rawTopic);
+    }
+    QString topic = d.topic;
 
     QStringList info;
 //    if (channel && !channel->mode().isEmpty())
 //        info += channel->mode();
     if (d.model && d.model->count() > 0)
         info += QString::number(d.model->count());
+    if (d.buffer && d.buffer->property("firehoseRate").isValid())
+        info += tr("%1 lines/s").arg(d.buffer->property("firehoseRate").toInt());
 
+    QString text;
     if (info.isEmpty() && topic.isEmpty())
-        setText(title);
+        text = title;
     else if (topic.isEmpty())
-        setText(tr("%1 (%2)").arg(title).arg(info.join(tr(", "))));
+        text = tr("%1 (%2)").arg(title).arg(info.join(tr(", ")));
     else if (info.isEmpty())
-        setText(tr("%1: %2").arg(title).arg(topic));
+        text = tr("%1: %2").arg(title).arg(topic);
     else
-        setText(tr("%1 (%2): %3").arg(title).arg(info.join(tr(", "))).arg(topic));
+        text = tr("%1 (%2): %3").arg(title).arg(info.join(tr(", "))).arg(topic);
 
+    if (text == QLabel::text() && d.css == d.appliedCss)
+        return;
+
+    d.appliedCss = d.css;
+    clear();
+    setText(text);
     foreach (QTextDocument* doc, findChildren<QTextDocument*>())
         doc->setDefaultStyleSheet(d.css);
 }
@@ -35,7 +35,7 @@
 #include "baseglobal.h"
 
 class IrcBuffer;
-class IrcUserModel;
+class UserView;
 class MessageFormatter;
 
 class BASE_EXPORT TitleBar : public QLabel
@@ -83,6 +83,7 @@ private slots:
     void relayout();
     void cleanup();
     void refresh();
+    void scheduleRefresh();
     void edit();
 
 private:
@@ -90,12 +91,15 @@ private:
 
     struct Private {
         QString css;
+        QString appliedCss;
+        QString topic;
+        QString rawTopic;
         int baseOffset;
         IrcBuffer* buffer;
         QTextEdit* editor;
         QToolButton* menuButton;
         MessageFormatter* formatter;
-        IrcUserModel* model;
+        UserView* model;
     } d;
 };
 
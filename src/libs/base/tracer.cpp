@@ -0,0 +1,145 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "tracer.h"
+#include <QElapsedTimer>
+#include <QCoreApplication>
+#include <QAtomicPointer>
+#include <QAtomicInt>
+#include <QThread>
+#include <QFile>
+
+// a few seconds of a busy session, overwritten oldest first
+static const int RingSize = 1 << 16;
+
+struct TraceEvent
+{
+    const char* name;
+    quintptr thread;
+    qint64 start;
+    qint64 duration;
+};
+
+// written from the format workers too, a slot torn by a concurrent
+// dump shows up as one odd span, which is fine for a trace
+static TraceEvent ring[RingSize];
+static QAtomicInt next;
+static QAtomicPointer<const char> current;
+
+struct TraceClock
+{
+    TraceClock() { timer.start(); }
+    QElapsedTimer timer;
+};
+
+static QElapsedTimer& clock()
+{
+    static TraceClock clock;
+    return clock.timer;
+}
+
+bool Tracer::isEnabled()
+{
+#ifdef COMMUNI_TRACING
+    return true;
+#else
+    return false;
+#endif
+}
+
+qint64 Tracer::now()
+{
+    return clock().nsecsElapsed();
+}
+
+void Tracer::record(const char* name, qint64 start, qint64 duration)
+{
+    TraceEvent& event = ring[next.fetchAndAddRelaxed(1) & (RingSize - 1)];
+    event.name = 0;
+    event.thread = quintptr(QThread::currentThreadId());
+    event.start = start;
+    event.duration = duration;
+    event.name = name;
+}
+
+static bool isGuiThread()
+{
+    QCoreApplication* app = QCoreApplication::instance();
+    return app && QThread::currentThread() == app->thread();
+}
+
+const char* Tracer::operation()
+{
+    return current.load();
+}
+
+const char* Tracer::enter(const char* name)
+{
+    if (!isGuiThread())
+        return 0;
+    return current.fetchAndStoreRelaxed(name);
+}
+
+void Tracer::leave(const char* previous)
+{
+    if (isGuiThread())
+        current.store(previous);
+}
+
+// the chrome trace event format, loads in chrome://tracing and perfetto
+QByteArray Tracer::toJson()
+{
+    const int end = next.load();
+    const int begin = qMax(0, end - RingSize);
+
+    QByteArray json("{\"traceEvents\":[");
+    bool first = true;
+    for (int i = begin; i < end; ++i) {
+        const TraceEvent event = ring[i & (RingSize - 1)];
+        if (!event.name)
+            continue;
+        if (!first)
+            json += ',';
+        first = false;
+        json += "{\"name\":\"" + QByteArray(event.name) + "\",\"ph\":\"X\",\"pid\":1"
+                + ",\"tid\":" + QByteArray::number(quint64(event.thread))
+                + ",\"ts\":" + QByteArray::number(event.start / 1000.0, 'f', 3)
+                + ",\"dur\":" + QByteArray::number(event.duration / 1000.0, 'f', 3) + '}';
+    }
+    json += "]}\n";
+    return json;
+}
+
+bool Tracer::dump(const QString& filePath)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+    const QByteArray json = toJson();
+    return file.write(json) == json.size();
+}
@@ -0,0 +1,73 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <QString>
+#include <QByteArray>
+#include "baseglobal.h"
+
+// built with CONFIG+=trace, the spans compile away otherwise
+#ifdef COMMUNI_TRACING
+#define COMMUNI_TRACE(name) TraceSpan communiTraceSpan(name)
+#else
+#define COMMUNI_TRACE(name) do { } while (0)
+#endif
+
+class BASE_EXPORT Tracer
+{
+public:
+    static bool isEnabled();
+
+    static qint64 now();
+    static void record(const char* name, qint64 start, qint64 duration);
+
+    // the innermost span open on the gui thread, read by the stall watchdog
+    static const char* operation();
+    static const char* enter(const char* name);
+    static void leave(const char* previous);
+
+    static QByteArray toJson();
+    static bool dump(const QString& filePath);
+};
+
+class TraceSpan
+{
+public:
+    // names are static literals, only the pointer goes into the ring
+    explicit TraceSpan(const char* name) : name(name), previous(Tracer::enter(name)), start(Tracer::now()) { }
+    ~TraceSpan() { Tracer::record(name, start, Tracer::now() - start); Tracer::leave(previous); }
+
+private:
+    const char* name;
+    const char* previous;
+    qint64 start;
+};
+
+#endif // TRACER_H
@@ -0,0 +1,168 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "userindex.h"
+#include <IrcUserModel>
+#include <IrcConnection>
+#include <IrcChannel>
+#include <IrcUser>
+
+UserIndex::UserIndex(IrcChannel* channel) : QObject(channel)
+{
+    // the title order is the one the user list shows, other orders are
+    // UserViews sorting over this single model
+    d.model = new IrcUserModel(this);
+    d.model->setSortMethod(Irc::SortByTitle);
+    d.model->setChannel(channel);
+}
+
+UserIndex* UserIndex::instance(IrcChannel* channel)
+{
+    if (!channel)
+        return 0;
+
+    UserIndex* index = find(channel);
+    if (!index)
+        index = new UserIndex(channel);
+    return index;
+}
+
+UserIndex* UserIndex::find(IrcChannel* channel)
+{
+    if (!channel)
+        return 0;
+    return channel->findChild<UserIndex*>(QString(), Qt::FindDirectChildrenOnly);
+}
+
+IrcChannel* UserIndex::channel() const
+{
+    return d.model->channel();
+}
+
+IrcUserModel* UserIndex::model() const
+{
+    return d.model;
+}
+
+// gives UserView the orders IrcUserModel knows
+class FriendlyUserModel : public IrcUserModel
+{
+    friend class UserView;
+};
+
+UserView::UserView(Irc::SortMethod method, QObject* parent) : QSortFilterProxyModel(parent)
+{
+    d.method = method;
+    setDynamicSortFilter(true);
+    if (method != Irc::SortByTitle)
+        sort(0);
+}
+
+IrcChannel* UserView::channel() const
+{
+    return d.channel;
+}
+
+void UserView::setChannel(IrcChannel* channel)
+{
+    if (d.channel == channel)
+        return;
+
+    if (d.model) {
+        disconnect(d.model, SIGNAL(added(IrcUser*)), this, SIGNAL(added(IrcUser*)));
+        disconnect(d.model, SIGNAL(removed(IrcUser*)), this, SIGNAL(removed(IrcUser*)));
+        disconnect(d.model, SIGNAL(countChanged(int)), this, SIGNAL(countChanged(int)));
+    }
+    d.channel = channel;
+    UserIndex* index = UserIndex::instance(channel);
+    d.model = index ? index->model() : 0;
+    if (d.model) {
+        connect(d.model, SIGNAL(added(IrcUser*)), this, SIGNAL(added(IrcUser*)));
+        connect(d.model, SIGNAL(removed(IrcUser*)), this, SIGNAL(removed(IrcUser*)));
+        connect(d.model, SIGNAL(countChanged(int)), this, SIGNAL(countChanged(int)));
+    }
+    setSourceModel(d.model);
+    emit countChanged(count());
+}
+
+Irc::SortMethod UserView::sortMethod() const
+{
+    return d.method;
+}
+
+// a channel waiting for its rejoin, consumers keep the users they had
+// while the model is empty and reconcile the fresh names against them
+bool UserView::isDetached() const
+{
+    if (!d.channel || d.channel->isActive())
+        return false;
+    IrcConnection* connection = d.channel->connection();
+    return connection && !connection->isConnected();
+}
+
+int UserView::count() const
+{
+    return d.model ? d.model->count() : 0;
+}
+
+QList<IrcUser*> UserView::users() const
+{
+    if (!d.model)
+        return QList<IrcUser*>();
+    if (d.method == Irc::SortByTitle)
+        return d.model->users();
+
+    QList<IrcUser*> users;
+    const int rows = rowCount();
+    users.reserve(rows);
+    for (int i = 0; i < rows; ++i)
+        users += index(i, 0).data(Irc::UserRole).value<IrcUser*>();
+    return users;
+}
+
+QStringList UserView::titles() const
+{
+    if (!d.model)
+        return QStringList();
+    if (d.method == Irc::SortByTitle)
+        return d.model->titles();
+
+    QStringList titles;
+    foreach (IrcUser* user, users())
+        titles += user->title();
+    return titles;
+}
+
+bool UserView::lessThan(const QModelIndex& left, const QModelIndex& right) const
+{
+    IrcUser* one = left.data(Irc::UserRole).value<IrcUser*>();
+    IrcUser* another = right.data(Irc::UserRole).value<IrcUser*>();
+    if (!d.model || !one || !another)
+        return QSortFilterProxyModel::lessThan(left, right);
+    return static_cast<FriendlyUserModel*>(d.model.data())->lessThan(one, another, d.method);
+}
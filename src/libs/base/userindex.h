@@ -0,0 +1,99 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef USERINDEX_H
+#define USERINDEX_H
+
+#include <Irc>
+#include <QList>
+#include <QPointer>
+#include <QStringList>
+#include <QSortFilterProxyModel>
+#include "baseglobal.h"
+
+class IrcUser;
+class IrcChannel;
+class IrcUserModel;
+
+class BASE_EXPORT UserIndex : public QObject
+{
+    Q_OBJECT
+
+public:
+    static UserIndex* instance(IrcChannel* channel);
+    // the index of a channel if there is one, none is created
+    static UserIndex* find(IrcChannel* channel);
+
+    IrcChannel* channel() const;
+    IrcUserModel* model() const;
+
+private:
+    explicit UserIndex(IrcChannel* channel);
+
+    struct Private {
+        IrcUserModel* model;
+    } d;
+};
+
+class BASE_EXPORT UserView : public QSortFilterProxyModel
+{
+    Q_OBJECT
+    Q_PROPERTY(IrcChannel* channel READ channel WRITE setChannel)
+    Q_PROPERTY(int count READ count NOTIFY countChanged)
+
+public:
+    explicit UserView(Irc::SortMethod method = Irc::SortByTitle, QObject* parent = 0);
+
+    IrcChannel* channel() const;
+    void setChannel(IrcChannel* channel);
+
+    Irc::SortMethod sortMethod() const;
+
+    bool isDetached() const;
+
+    int count() const;
+    QList<IrcUser*> users() const;
+    QStringList titles() const;
+
+signals:
+    void added(IrcUser* user);
+    void removed(IrcUser* user);
+    void countChanged(int count);
+
+protected:
+    bool lessThan(const QModelIndex& left, const QModelIndex& right) const;
+
+private:
+    struct Private {
+        Irc::SortMethod method;
+        QPointer<IrcChannel> channel;
+        QPointer<IrcUserModel> model;
+    } d;
+};
+
+#endif // USERINDEX_H
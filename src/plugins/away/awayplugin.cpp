@@ -27,21 +27,38 @@
 */
 
 #include "awayplugin.h"
+#include "textdocument.h"
+#include "hookstats.h"
 #include <IrcConnection>
 #include <IrcNetwork>
 #include <IrcMessage>
 #include <IrcCommand>
 #include <IrcChannel>
-#include <QTimer>
 #include <Irc>
 
+// WHO requests in flight per connection, the next one goes out on RPL_ENDOFWHO
+static const int MaxRequests = 2;
+
+static bool isVisible(IrcChannel* channel)
+{
+    foreach (TextDocument* doc, channel->findChildren<TextDocument*>()) {
+        if (doc->isVisible())
+            return true;
+    }
+    return false;
+}
+
 AwayPlugin::AwayPlugin(QObject* parent) : QObject(parent)
 {
+    d.timer.setInterval(500);
+    d.timer.setSingleShot(true);
+    connect(&d.timer, SIGNAL(timeout()), this, SLOT(sendRequests()));
 }
 
 void AwayPlugin::connectionAdded(IrcConnection* connection)
 {
-    connection->installMessageFilter(this);
+    HookStats::installMessageFilter(connection, this);
+    connect(connection, SIGNAL(disconnected()), this, SLOT(onConnectionDisconnected()));
 
     IrcNetwork* network = connection->network();
     QStringList caps = network->requestedCapabilities();
@@ -64,19 +81,48 @@ bool AwayPlugin::messageFilter(IrcMessage* message)
     if (message->type() == IrcMessage::Numeric) {
         const int code = static_cast<IrcNumericMessage*>(message)->code();
         if (code == Irc::RPL_WHOREPLY || code == Irc::RPL_ENDOFWHO) {
-            const QString mask = message->parameters().value(1);
-            foreach (IrcChannel* channel, d.queue) {
-                if (channel->connection() == message->connection() && channel->title() == mask) {
-                    if (code == Irc::RPL_ENDOFWHO)
-                        d.queue.remove(channel);
-                    return true;
+            IrcConnection* connection = message->connection();
+            QHash<QString, IrcChannel*>& requests = d.requests[connection];
+            const QString mask = message->parameters().value(1).toLower();
+            if (requests.contains(mask)) {
+                if (code == Irc::RPL_ENDOFWHO) {
+                    requests.remove(mask);
+                    sendRequests(connection);
                 }
+                return true;
             }
         }
     }
     return false;
 }
 
+void AwayPlugin::sendRequests()
+{
+    foreach (IrcConnection* connection, d.pending.keys())
+        sendRequests(connection);
+}
+
+void AwayPlugin::sendRequests(IrcConnection* connection)
+{
+    QList<IrcChannel*>& pending = d.pending[connection];
+    QHash<QString, IrcChannel*>& requests = d.requests[connection];
+    while (!pending.isEmpty() && requests.count() < MaxRequests) {
+        // channels that are being looked at go first
+        int index = 0;
+        for (int i = 0; i < pending.count(); ++i) {
+            if (isVisible(pending.at(i))) {
+                index = i;
+                break;
+            }
+        }
+        IrcChannel* channel = pending.takeAt(index);
+        requests.insert(channel->title().toLower(), channel);
+        channel->who();
+    }
+    if (pending.isEmpty())
+        d.pending.remove(connection);
+}
+
 void AwayPlugin::onChannelActiveChanged()
 {
     queueChannel(qobject_cast<IrcChannel*>(sender()));
@@ -84,16 +130,40 @@ void AwayPlugin::onChannelActiveChanged()
 
 void AwayPlugin::onChannelDestroyed(IrcChannel* channel)
 {
-    d.queue.remove(channel);
+    QHash<IrcConnection*, QList<IrcChannel*> >::iterator it;
+    for (it = d.pending.begin(); it != d.pending.end(); ++it)
+        it.value().removeOne(channel);
+
+    // a request that will never be answered must not hold up the others
+    QHash<IrcConnection*, QHash<QString, IrcChannel*> >::iterator rit;
+    for (rit = d.requests.begin(); rit != d.requests.end(); ++rit) {
+        const QString mask = rit.value().key(channel);
+        if (!mask.isNull()) {
+            rit.value().remove(mask);
+            d.timer.start();
+        }
+    }
+}
+
+void AwayPlugin::onConnectionDisconnected()
+{
+    IrcConnection* connection = qobject_cast<IrcConnection*>(sender());
+    d.pending.remove(connection);
+    d.requests.remove(connection);
 }
 
 void AwayPlugin::queueChannel(IrcChannel* channel)
 {
-    if (channel && channel->isActive() && !d.queue.contains(channel)) {
+    if (channel && channel->isActive()) {
+        IrcConnection* connection = channel->connection();
+        QList<IrcChannel*>& pending = d.pending[connection];
+        if (pending.contains(channel) || d.requests.value(connection).contains(channel->title().toLower()))
+            return;
         IrcNetwork* network = channel->network();
         if (network && network->isCapable("away-notify")) {
-            QTimer::singleShot(500, channel, SLOT(who()));
-            d.queue.insert(channel);
+            pending += channel;
+            if (!d.timer.isActive())
+                d.timer.start();
         }
     }
 }
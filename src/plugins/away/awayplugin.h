@@ -29,7 +29,9 @@
 #ifndef AWAYPLUGIN_H
 #define AWAYPLUGIN_H
 
-#include <QSet>
+#include <QHash>
+#include <QList>
+#include <QTimer>
 #include <QtPlugin>
 #include <IrcMessageFilter>
 #include "connectionplugin.h"
@@ -53,14 +55,19 @@ public:
     bool messageFilter(IrcMessage* message);
 
 private slots:
+    void sendRequests();
     void onChannelActiveChanged();
     void onChannelDestroyed(IrcChannel* channel);
+    void onConnectionDisconnected();
 
 private:
     void queueChannel(IrcChannel* channel);
+    void sendRequests(IrcConnection* connection);
 
     struct Private {
-        QSet<IrcChannel*> queue;
+        QTimer timer;
+        QHash<IrcConnection*, QList<IrcChannel*> > pending;
+        QHash<IrcConnection*, QHash<QString, IrcChannel*> > requests;
     } d;
 };
 
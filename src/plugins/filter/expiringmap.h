@@ -0,0 +1,116 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef EXPIRINGMAP_H
+#define EXPIRINGMAP_H
+
+#include <QMap>
+#include <QHash>
+
+// a hash bounded in size and age, least recently stored entries go first
+template <typename Key, typename T>
+class ExpiringMap
+{
+public:
+    ExpiringMap(int capacity, qint64 ttl) : m_capacity(capacity), m_ttl(ttl), m_serial(0) { }
+
+    int count() const { return m_entries.count(); }
+
+    bool contains(const Key& key, qint64 now) const
+    {
+        typename QHash<Key, Entry>::const_iterator it = m_entries.constFind(key);
+        return it != m_entries.constEnd() && now - it->stamp < m_ttl;
+    }
+
+    T value(const Key& key, qint64 now) const
+    {
+        typename QHash<Key, Entry>::const_iterator it = m_entries.constFind(key);
+        if (it == m_entries.constEnd() || now - it->stamp >= m_ttl)
+            return T();
+        return it->value;
+    }
+
+    void insert(const Key& key, const T& value, qint64 now)
+    {
+        typename QHash<Key, Entry>::iterator it = m_entries.find(key);
+        if (it != m_entries.end())
+            m_order.remove(it->serial);
+        Entry entry;
+        entry.value = value;
+        entry.stamp = now;
+        entry.serial = ++m_serial;
+        m_entries.insert(key, entry);
+        m_order.insert(entry.serial, key);
+        while (m_entries.count() > m_capacity)
+            evict();
+        sweep(now);
+    }
+
+    // a live entry takes the value but keeps its age and place in the order
+    bool replace(const Key& key, const T& value, qint64 now)
+    {
+        typename QHash<Key, Entry>::iterator it = m_entries.find(key);
+        if (it == m_entries.end() || now - it->stamp >= m_ttl)
+            return false;
+        it->value = value;
+        return true;
+    }
+
+    // drops a few expired entries per call so that no call pays for all of them
+    void sweep(qint64 now, int max = 8)
+    {
+        while (max-- > 0 && !m_order.isEmpty()) {
+            const Entry& oldest = m_entries[m_order.begin().value()];
+            if (now - oldest.stamp < m_ttl)
+                break;
+            evict();
+        }
+    }
+
+private:
+    void evict()
+    {
+        typename QMap<qint64, Key>::iterator it = m_order.begin();
+        m_entries.remove(it.value());
+        m_order.erase(it);
+    }
+
+    struct Entry {
+        T value;
+        qint64 stamp;
+        qint64 serial;
+    };
+
+    int m_capacity;
+    qint64 m_ttl;
+    qint64 m_serial;
+    QHash<Key, Entry> m_entries;
+    QMap<qint64, Key> m_order;
+};
+
+#endif // EXPIRINGMAP_H
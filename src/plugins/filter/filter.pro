@@ -6,5 +6,8 @@ TEMPLATE = lib
 COMMUNI += core model util
 CONFIG += communi_plugin
 
+HEADERS += $$PWD/expiringmap.h
 HEADERS += $$PWD/filterplugin.h
+HEADERS += $$PWD/filterrules.h
 SOURCES += $$PWD/filterplugin.cpp
+SOURCES += $$PWD/filterrules.cpp
@@ -27,32 +27,80 @@
 */
 
 #include "filterplugin.h"
+#include "hookstats.h"
+#include "userindex.h"
 #include <IrcConnection>
+#include <IrcBufferModel>
+#include <IrcUserModel>
+#include <IrcChannel>
 #include <IrcMessage>
 #include <IrcCommand>
+#include <QDateTime>
+#include <QSettings>
 #include <Irc>
 
 static const int SILENCE_PERIOD = 30 * 60;
+static const int MAX_AWAY_REPLIES = 4096;
+static const int DUPLICATE_PERIOD = 60;
+
+static IrcChannel* findChannel(IrcConnection* connection, const QString& title)
+{
+    IrcBufferModel* model = connection ? connection->findChild<IrcBufferModel*>() : 0;
+    IrcBuffer* buffer = model ? model->find(title) : 0;
+    return buffer ? buffer->toChannel() : 0;
+}
+
+// a shared user model is only read where one exists already, the other
+// channels go by a tally of their names list, joins, parts and kicks, quits
+// name no channel so the tally runs high until the next names list
+static int channelSize(IrcChannel* channel)
+{
+    if (UserIndex* index = UserIndex::find(channel))
+        return index->model()->count();
+    return channel->property("filterUsers").toInt();
+}
+
+static void addUsers(IrcChannel* channel, int diff)
+{
+    if (channel)
+        channel->setProperty("filterUsers", qMax(0, channel->property("filterUsers").toInt() + diff));
+}
+
+FilterPlugin::Private::Private() : joinPartLimit(0), duplicateLimit(0),
+    sentCommands(256, SILENCE_PERIOD * 1000),
+    awayReplies(MAX_AWAY_REPLIES, SILENCE_PERIOD * 1000),
+    duplicates(MAX_AWAY_REPLIES, DUPLICATE_PERIOD * 1000)
+{
+}
 
 FilterPlugin::FilterPlugin(QObject* parent) : QObject(parent)
 {
+    settingsChanged();
 }
 
 void FilterPlugin::connectionAdded(IrcConnection* connection)
 {
-    connection->installCommandFilter(this);
-    connection->installMessageFilter(this);
+    HookStats::installCommandFilter(connection, this);
+    HookStats::installMessageFilter(connection, this);
 }
 
 void FilterPlugin::connectionRemoved(IrcConnection* connection)
 {
-    connection->removeCommandFilter(this);
-    connection->removeMessageFilter(this);
+    HookStats::removeCommandFilter(connection, this);
+    HookStats::removeMessageFilter(connection, this);
+}
+
+void FilterPlugin::settingsChanged()
+{
+    QSettings settings;
+    d.rules.compile(settings.value("filterIgnores").toStringList(), settings.value("filterPatterns").toStringList());
+    d.joinPartLimit = settings.value("filterJoinPartLimit", 0).toInt();
+    d.duplicateLimit = settings.value("filterDuplicateLimit", 0).toInt();
 }
 
 bool FilterPlugin::commandFilter(IrcCommand* command)
 {
-    d.sentCommands.insert(command->type(), qMakePair(QDateTime::currentDateTime(), command->parameters().value(0)));
+    d.sentCommands.insert(command->type(), command->parameters().value(0), QDateTime::currentMSecsSinceEpoch());
     return false;
 }
 
@@ -61,12 +109,86 @@ bool FilterPlugin::messageFilter(IrcMessage* message)
     if (message->type() == IrcMessage::Numeric) {
         int code = static_cast<IrcNumericMessage*>(message)->code();
         if (code == Irc::RPL_AWAY) {
-            QPair<QDateTime, QString> reply = d.awayReplies.value(message->prefix());
-            bool filter = reply.first.secsTo(message->timeStamp()) < SILENCE_PERIOD && reply.second == message->parameters().last();
-            if (!filter || !d.awayReplies.contains(message->prefix()))
-                d.awayReplies.insert(message->prefix(), qMakePair(message->timeStamp(), message->parameters().last()));
+            const qint64 now = message->timeStamp().toMSecsSinceEpoch();
+            const QString reason = message->parameters().last();
+            // repeats within the silence period keep their original time
+            bool filter = d.awayReplies.contains(message->prefix(), now) && d.awayReplies.value(message->prefix(), now) == reason;
+            if (!filter)
+                d.awayReplies.insert(message->prefix(), reason, now);
+            updateStats();
             return filter;
         }
+        if (code == Irc::RPL_NAMREPLY || code == Irc::RPL_ENDOFNAMES) {
+            // a names list replaces the tally once it starts coming in
+            const QStringList params = message->parameters();
+            IrcChannel* channel = findChannel(message->connection(), params.value(code == Irc::RPL_NAMREPLY ? 2 : 1));
+            if (channel && code == Irc::RPL_NAMREPLY) {
+                if (!channel->property("filterNames").toBool()) {
+                    channel->setProperty("filterNames", true);
+                    channel->setProperty("filterUsers", 0);
+                }
+                addUsers(channel, params.value(3).split(' ', QString::SkipEmptyParts).count());
+            } else if (channel) {
+                channel->setProperty("filterNames", false);
+            }
+        }
+        return false;
+    }
+
+    const IrcMessage::Type type = message->type();
+    if (type == IrcMessage::Kick)
+        addUsers(findChannel(message->connection(), static_cast<IrcKickMessage*>(message)->channel()), -1);
+
+    if (message->isOwn())
+        return false;
+
+    if (type == IrcMessage::Private || type == IrcMessage::Notice) {
+        if (d.rules.matchesPrefix(message->prefix()))
+            return true;
+        QString target, content;
+        if (type == IrcMessage::Private) {
+            target = static_cast<IrcPrivateMessage*>(message)->target();
+            content = static_cast<IrcPrivateMessage*>(message)->content();
+        } else {
+            target = static_cast<IrcNoticeMessage*>(message)->target();
+            content = static_cast<IrcNoticeMessage*>(message)->content();
+        }
+        return d.rules.matchesContent(content) || isDuplicate(target, content, message->timeStamp().toMSecsSinceEpoch());
+    }
+
+    // the models must still see membership changes, only documents skip them
+    if (type == IrcMessage::Join || type == IrcMessage::Part || type == IrcMessage::Quit || type == IrcMessage::Nick) {
+        bool filter = d.rules.matchesPrefix(message->prefix());
+        if (type == IrcMessage::Join || type == IrcMessage::Part) {
+            const QString title = type == IrcMessage::Join ? static_cast<IrcJoinMessage*>(message)->channel()
+                                                           : static_cast<IrcPartMessage*>(message)->channel();
+            IrcChannel* channel = findChannel(message->connection(), title);
+            addUsers(channel, type == IrcMessage::Join ? 1 : -1);
+            if (!filter && d.joinPartLimit > 0)
+                filter = channel && channelSize(channel) > d.joinPartLimit;
+        }
+        if (filter)
+            message->setProperty("filtered", true);
     }
     return false;
 }
+
+bool FilterPlugin::isDuplicate(const QString& target, const QString& content, qint64 now)
+{
+    if (d.duplicateLimit <= 0)
+        return false;
+    const QString key = target.toLower() + QChar('\n') + content;
+    // the period runs from the first time the line was seen, repeats only count
+    const int count = d.duplicates.value(key, now) + 1;
+    if (!d.duplicates.replace(key, count, now))
+        d.duplicates.insert(key, count, now);
+    return count > d.duplicateLimit;
+}
+
+void FilterPlugin::updateStats()
+{
+    HookStats* stats = HookStats::instance();
+    stats->setCount("FilterPlugin::awayReplies", d.awayReplies.count());
+    stats->setCount("FilterPlugin::sentCommands", d.sentCommands.count());
+    stats->setCount("FilterPlugin::duplicates", d.duplicates.count());
+}
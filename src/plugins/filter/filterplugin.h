@@ -29,34 +29,44 @@
 #ifndef FILTERPLUGIN_H
 #define FILTERPLUGIN_H
 
-#include <QPair>
-#include <QHash>
 #include <QString>
 #include <QtPlugin>
-#include <QDateTime>
 #include <IrcCommandFilter>
 #include <IrcMessageFilter>
 #include "connectionplugin.h"
+#include "settingsplugin.h"
+#include "expiringmap.h"
+#include "filterrules.h"
 
-class FilterPlugin : public QObject, public ConnectionPlugin, public IrcMessageFilter, public IrcCommandFilter
+class FilterPlugin : public QObject, public ConnectionPlugin, public SettingsPlugin, public IrcMessageFilter, public IrcCommandFilter
 {
     Q_OBJECT
-    Q_INTERFACES(ConnectionPlugin IrcCommandFilter IrcMessageFilter)
+    Q_INTERFACES(ConnectionPlugin SettingsPlugin IrcCommandFilter IrcMessageFilter)
     Q_PLUGIN_METADATA(IID "Communi.ConnectionPlugin")
+    Q_PLUGIN_METADATA(IID "Communi.SettingsPlugin")
 
 public:
     FilterPlugin(QObject* parent = 0);
 
     void connectionAdded(IrcConnection* connection);
     void connectionRemoved(IrcConnection* connection);
+    void settingsChanged();
 
     bool commandFilter(IrcCommand* command);
     bool messageFilter(IrcMessage* message);
 
 private:
+    bool isDuplicate(const QString& target, const QString& content, qint64 now);
+    void updateStats();
+
     struct Private {
-        QHash<int, QPair<QDateTime, QString> > sentCommands;
-        QHash<QString, QPair<QDateTime, QString> > awayReplies;
+        Private();
+        int joinPartLimit;
+        int duplicateLimit;
+        FilterRules rules;
+        ExpiringMap<int, QString> sentCommands;
+        ExpiringMap<QString, QString> awayReplies;
+        ExpiringMap<QString, int> duplicates;
     } d;
 };
 
@@ -0,0 +1,148 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "filterrules.h"
+#include <QDebug>
+
+static QString wildcardPattern(const QString& mask)
+{
+    QString pattern = QRegularExpression::escape(mask);
+    pattern.replace("\\*", ".*");
+    pattern.replace("\\?", ".");
+    return pattern;
+}
+
+static bool hasWildcards(const QString& str)
+{
+    return str.contains('*') || str.contains('?');
+}
+
+// backreferences, named groups, quoting, inline options and verbs change
+// meaning or swallow the rest once a pattern is wrapped and joined with others
+static bool isJoinable(const QString& pattern)
+{
+    for (int i = 0; i < pattern.length(); ++i) {
+        const QChar c = pattern.at(i);
+        const QChar next = i + 1 < pattern.length() ? pattern.at(i + 1) : QChar();
+        if (c == '\\') {
+            if (next.isDigit() || next == 'g' || next == 'k' || next == 'Q' || next.isNull())
+                return false;
+            ++i;
+        } else if (c == '(' && next == '*') {
+            return false;
+        } else if (c == '(' && next == '?') {
+            const QString kind = pattern.mid(i + 2, 2);
+            if (!kind.startsWith(':') && !kind.startsWith('=') && !kind.startsWith('!') && kind != "<=" && kind != "<!")
+                return false;
+        }
+    }
+    return true;
+}
+
+// plain nick and host masks are set lookups, everything else is folded
+// into one expression so that a message is matched in a single pass
+void FilterRules::compile(const QStringList& masks, const QStringList& patterns)
+{
+    d.nicks.clear();
+    d.hosts.clear();
+
+    QStringList wildcards;
+    foreach (QString mask, masks) {
+        mask = mask.trimmed().toLower();
+        if (mask.isEmpty())
+            continue;
+        if (!mask.contains('!') && !mask.contains('@'))
+            mask += "!*@*";
+
+        const QString nick = mask.section('!', 0, 0);
+        const QString user = mask.section('!', 1).section('@', 0, 0);
+        const QString host = mask.section('@', 1);
+        if (user == "*" && host == "*" && !hasWildcards(nick))
+            d.nicks.insert(nick);
+        else if (nick == "*" && user == "*" && !hasWildcards(host))
+            d.hosts.insert(host);
+        else
+            wildcards += wildcardPattern(mask);
+    }
+    d.masks = QRegularExpression();
+    if (!wildcards.isEmpty()) {
+        d.masks.setPattern("^(?:" + wildcards.join("|") + ")$");
+        d.masks.optimize();
+    }
+
+    // each pattern is checked on its own, the ones that cannot be joined stay separate
+    QStringList joined;
+    d.separate.clear();
+    foreach (const QString& pattern, patterns) {
+        if (pattern.isEmpty())
+            continue;
+        QRegularExpression rx(pattern, QRegularExpression::CaseInsensitiveOption);
+        if (!rx.isValid()) {
+            qWarning() << "FilterRules: ignoring invalid pattern" << pattern;
+        } else if (isJoinable(pattern)) {
+            joined += "(?:" + pattern + ")";
+        } else {
+            rx.optimize();
+            d.separate += rx;
+        }
+    }
+    d.content = QRegularExpression();
+    if (!joined.isEmpty()) {
+        d.content.setPattern(joined.join("|"));
+        d.content.setPatternOptions(QRegularExpression::CaseInsensitiveOption);
+        d.content.optimize();
+    }
+}
+
+bool FilterRules::isEmpty() const
+{
+    return d.nicks.isEmpty() && d.hosts.isEmpty() && d.masks.pattern().isEmpty() && d.content.pattern().isEmpty() && d.separate.isEmpty();
+}
+
+bool FilterRules::matchesPrefix(const QString& prefix) const
+{
+    if (prefix.isEmpty())
+        return false;
+    const QString lower = prefix.toLower();
+    if (!d.nicks.isEmpty() && d.nicks.contains(lower.section('!', 0, 0)))
+        return true;
+    if (!d.hosts.isEmpty() && d.hosts.contains(lower.section('@', 1)))
+        return true;
+    return !d.masks.pattern().isEmpty() && d.masks.match(lower).hasMatch();
+}
+
+bool FilterRules::matchesContent(const QString& content) const
+{
+    if (!d.content.pattern().isEmpty() && d.content.match(content).hasMatch())
+        return true;
+    foreach (const QRegularExpression& rx, d.separate) {
+        if (rx.match(content).hasMatch())
+            return true;
+    }
+    return false;
+}
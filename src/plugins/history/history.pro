@@ -0,0 +1,10 @@
+######################################################################
+# Communi
+######################################################################
+
+TEMPLATE = lib
+COMMUNI += core model util
+CONFIG += communi_plugin
+
+HEADERS += $$PWD/historyplugin.h
+SOURCES += $$PWD/historyplugin.cpp
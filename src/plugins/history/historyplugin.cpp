@@ -0,0 +1,69 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "historyplugin.h"
+#include "textdocument.h"
+#include "sendqueue.h"
+#include <IrcConnection>
+#include <IrcNetwork>
+#include <IrcCommand>
+#include <IrcBuffer>
+
+HistoryPlugin::HistoryPlugin(QObject* parent) : QObject(parent)
+{
+}
+
+void HistoryPlugin::connectionAdded(IrcConnection* connection)
+{
+    IrcNetwork* network = connection->network();
+    QStringList caps = network->requestedCapabilities();
+    foreach (const QString& cap, QStringList() << "batch" << "server-time" << "draft/chathistory") {
+        if (!caps.contains(cap))
+            caps += cap;
+    }
+    network->setRequestedCapabilities(caps);
+}
+
+void HistoryPlugin::documentAdded(TextDocument* document)
+{
+    if (!document->isClone())
+        connect(document, SIGNAL(remoteHistoryRequested(QDateTime,int)), this, SLOT(requestHistory(QDateTime,int)));
+}
+
+void HistoryPlugin::requestHistory(const QDateTime& before, int count)
+{
+    // The reply is a chathistory batch that TextDocument prepends
+    TextDocument* document = qobject_cast<TextDocument*>(sender());
+    IrcBuffer* buffer = document ? document->buffer() : 0;
+    if (!buffer || buffer->isSticky() || !buffer->network()->isCapable("draft/chathistory"))
+        return;
+
+    const QString timestamp = before.toUTC().toString("yyyy-MM-ddThh:mm:ss.zzzZ");
+    IrcCommand* command = IrcCommand::createRaw(QString("CHATHISTORY BEFORE %1 timestamp=%2 %3").arg(buffer->title(), timestamp).arg(count));
+    SendQueue::instance(buffer->connection())->send(command, SendQueue::Interactive);
+}
@@ -0,0 +1,87 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "logcompressor.h"
+#include <QDataStream>
+#include <QThread>
+#include <QFile>
+
+// files are compressed in chunks to keep the memory use bounded
+static const int ChunkSize = 1024 * 1024;
+
+LogCompressor::LogCompressor(const QString& fileName) : m_fileName(fileName)
+{
+}
+
+void LogCompressor::run()
+{
+    QThread::currentThread()->setPriority(QThread::LowestPriority);
+
+    // the plain file is removed only once the compressed one is complete
+    const QString target = m_fileName + ".z";
+    if (compress(m_fileName, target))
+        QFile::remove(m_fileName);
+    else
+        QFile::remove(target);
+}
+
+bool LogCompressor::compress(const QString& fileName, const QString& target)
+{
+    QFile in(fileName);
+    QFile out(target);
+    if (!in.open(QIODevice::ReadOnly) || !out.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+
+    QDataStream stream(&out);
+    while (!in.atEnd()) {
+        const QByteArray chunk = in.read(ChunkSize);
+        if (chunk.isEmpty())
+            return false;
+        stream << qCompress(chunk);
+    }
+    return stream.status() == QDataStream::Ok && out.flush();
+}
+
+bool LogCompressor::uncompress(const QString& fileName, const QString& target)
+{
+    QFile in(fileName);
+    QFile out(target);
+    if (!in.open(QIODevice::ReadOnly) || !out.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+
+    QDataStream stream(&in);
+    while (!stream.atEnd()) {
+        QByteArray chunk;
+        stream >> chunk;
+        if (stream.status() != QDataStream::Ok)
+            return false;
+        if (out.write(qUncompress(chunk)) < 0)
+            return false;
+    }
+    return true;
+}
@@ -6,5 +6,14 @@ TEMPLATE = lib
 COMMUNI += core model
 CONFIG += communi_plugin
 
+HEADERS += $$PWD/logcompressor.h
+HEADERS += $$PWD/logindex.h
 HEADERS += $$PWD/loggerplugin.h
+HEADERS += $$PWD/logsegment.h
+HEADERS += $$PWD/logwriter.h
+
+SOURCES += $$PWD/logcompressor.cpp
+SOURCES += $$PWD/logindex.cpp
 SOURCES += $$PWD/loggerplugin.cpp
+SOURCES += $$PWD/logsegment.cpp
+SOURCES += $$PWD/logwriter.cpp
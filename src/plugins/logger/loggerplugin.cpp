@@ -27,6 +27,11 @@
 */
 
 #include "loggerplugin.h"
+#include "logwriter.h"
+#include "logsegment.h"
+#include "textdocument.h"
+#include "settingscache.h"
+#include "allocstats.h"
 #include <IrcConnection>
 #include <IrcNetwork>
 #include <IrcMessage>
@@ -36,11 +41,12 @@
 #include <IrcBufferModel>
 #include <Irc>
 #include <QDir>
-#include <QTextStream>
-#include <QSettings>
 #include <QDebug>
 
 LoggerPlugin::LoggerPlugin(QObject* parent) : QObject(parent)
+    , m_binary(false)
+    , m_restore(0)
+    , m_writer(new LogWriter(this))
     , m_connections(0)
 {
     this->settingsChanged();
@@ -52,6 +58,9 @@ LoggerPlugin::~LoggerPlugin()
     foreach (IrcBuffer *buf, this->m_logitems.keys()) {
         this->removeLogitemForBuffer(buf);
     }
+
+    // Writes out whatever is still queued
+    delete this->m_writer;
 }
 
 void LoggerPlugin::setConnectionsList(const QList<IrcConnection*>* list)
@@ -96,13 +105,69 @@ void LoggerPlugin::bufferAdded(IrcBuffer* buffer)
     connect(buffer, SIGNAL(messageReceived(IrcMessage*)), this, SLOT(logMessage(IrcMessage*)));
 
     const QString filename = logfileName(buffer);
-    Item item;
-    item.logfile = new QFile(m_logDirPath + "/" + filename, this);
-    item.logfile->open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text);
-    item.textStream = new QTextStream(item.logfile);
+    this->m_logitems.insert(buffer, m_logDirPath + "/" + filename);
+    if (!this->m_binary)
+        writeToFile(buffer, "=== Logfile started on " + timestamp() + " ===");
+}
 
-    this->m_logitems.insert(buffer, item);
-    writeToFile(buffer, "=== Logfile started on " + timestamp() + " ===");
+void LoggerPlugin::documentAdded(TextDocument* document)
+{
+    connect(document, SIGNAL(historyRequested(QDateTime,int)), this, SLOT(fetchHistory(QDateTime,int)));
+
+    // Lines still queued by the writer belong to the tail as well
+    if (this->m_binary && this->m_restore > 0)
+        this->m_writer->flush();
+    restore(document);
+}
+
+void LoggerPlugin::documentsAdded(const QList<TextDocument*>& documents)
+{
+    // One flush covers the whole burst
+    if (this->m_binary && this->m_restore > 0)
+        this->m_writer->flush();
+    foreach (TextDocument* document, documents) {
+        connect(document, SIGNAL(historyRequested(QDateTime,int)), this, SLOT(fetchHistory(QDateTime,int)));
+        restore(document);
+    }
+}
+
+void LoggerPlugin::restore(TextDocument* document)
+{
+    // Seeds the document with the tail of its log, see TextDocument::restore()
+    IrcBuffer* buffer = document->buffer();
+    if (!this->m_binary || this->m_restore <= 0 || document->isClone() || buffer->network()->name().isEmpty())
+        return;
+
+    QList<IrcMessage*> messages = readTail(buffer, this->m_restore);
+    document->restore(messages);
+    qDeleteAll(messages);
+}
+
+void LoggerPlugin::fetchHistory(const QDateTime& before, int count)
+{
+    // Scrolling past the top pages in what the log has before the head
+    TextDocument* document = qobject_cast<TextDocument*>(sender());
+    IrcBuffer* buffer = document ? document->buffer() : 0;
+    if (!this->m_binary || !buffer || !this->m_logitems.contains(buffer))
+        return;
+
+    this->m_writer->flush();
+    QList<IrcMessage*> messages = readTail(buffer, count, before);
+    document->prependHistory(messages);
+    qDeleteAll(messages);
+}
+
+QList<IrcMessage*> LoggerPlugin::readTail(IrcBuffer* buffer, int count, const QDateTime& before)
+{
+    QList<IrcMessage*> messages;
+    foreach (const LogRecord& record, LogSegment::tail(m_logDirPath + "/" + logfileName(buffer), count, before)) {
+        IrcMessage* message = IrcMessage::fromData(record.line, buffer->connection());
+        if (message) {
+            message->setTimeStamp(QDateTime::fromMSecsSinceEpoch(record.msecs));
+            messages += message;
+        }
+    }
+    return messages;
 }
 
 void LoggerPlugin::bufferRemoved(IrcBuffer* buffer)
@@ -114,54 +179,73 @@ void LoggerPlugin::bufferRemoved(IrcBuffer* buffer)
 
 void LoggerPlugin::removeLogitemForBuffer(IrcBuffer *buffer) {
     if (this->m_logitems.contains(buffer)) {
-        Item item = this->m_logitems.take(buffer);
-
-        item.textStream->flush();
-        delete item.textStream;
-
-        item.logfile->close();
-        delete item.logfile;
+        // Blocks until the lines of the buffer are on disk
+        this->m_writer->close(this->m_logitems.take(buffer));
     }
 }
 
 void LoggerPlugin::settingsChanged()
 {
-    QSettings settings;
-    QString loggingLocation = settings.value("loggingLocation").toString();
+    SettingsCache* settings = SettingsCache::instance();
+    QString loggingLocation = settings->value("loggingLocation").toString();
+    bool binary = settings->value("loggingFormat").toString() == "binary";
+    this->m_restore = settings->value("loggingRestore", 0).toInt();
+    this->m_writer->setMaxOpenFiles(settings->value("loggingMaxOpenFiles", 64).toInt());
+    this->m_writer->setRotation(settings->value("loggingRotateSize", 0).toInt(),
+                                settings->value("loggingRotateDaily", false).toBool(),
+                                settings->value("loggingCompress", true).toBool());
 
-    if (m_logDirPath != loggingLocation) {
+    if (m_logDirPath != loggingLocation || m_binary != binary) {
         pluginDisabled();
 
         m_logDirPath = loggingLocation;
+        m_binary = binary;
         QDir logDir;
         if (!logDir.exists(m_logDirPath))
             logDir.mkpath(m_logDirPath);
+        this->m_writer->setIndexPath(m_logDirPath + "/search.idx");
 
         pluginEnabled();
     }
 }
 
-void LoggerPlugin::logMessage(IrcMessage *message)
+QList<LogMatch> LoggerPlugin::search(const QString &query, int limit) const
 {
-    if (message->type() != IrcMessage::Private)
-        return;
+    // Postings are maintained by the writer thread, this only reads them back
+    return this->m_writer->search(query, limit);
+}
 
+void LoggerPlugin::logMessage(IrcMessage *message)
+{
+    COMMUNI_ALLOC_STAGE(Log);
     IrcBuffer *buffer = qobject_cast<IrcBuffer*>(QObject::sender());
+    const QDateTime time = message->timeStamp().isValid() ? message->timeStamp() : QDateTime::currentDateTime();
 
-    if (buffer) {
-        IrcPrivateMessage *m = static_cast<IrcPrivateMessage*>(message);
-        writeToFile(buffer, timestamp() + " " + m->nick() + ": " + m->content());
+    if (buffer && this->m_binary) {
+        // Segments keep the raw line, LogSegment::exportText() renders it
+        LogRecord record;
+        record.msecs = time.toMSecsSinceEpoch();
+        record.type = message->type();
+        record.nick = message->nick();
+        record.line = message->toData();
+        this->m_writer->write(this->m_logitems.value(buffer), record);
+    } else if (buffer) {
+        // Server time keeps bouncer playback in place
+        writeToFile(buffer, LogSegment::textLine(timestamp(time), message));
     }
 }
 
 void LoggerPlugin::writeToFile(IrcBuffer* buffer, const QString &text)
 {
-    Item item = this->m_logitems[buffer];
-    *(item.textStream) << text << endl;
+    // Lines are batched and written by the writer thread
+    this->m_writer->write(this->m_logitems.value(buffer), text);
 }
 
 QString LoggerPlugin::logfileName(IrcBuffer *buffer) const
 {
+    // Binary logs are a directory of segments per buffer
+    if (this->m_binary)
+        return buffer->network()->name() + "_" + buffer->title();
     return buffer->network()->name() + "_" + buffer->title() + ".log";
 }
 
@@ -169,3 +253,8 @@ QString LoggerPlugin::timestamp() const
 {
     return QDateTime::currentDateTime().toString("[yyyy-MM-dd] hh:mm:ss");
 }
+
+QString LoggerPlugin::timestamp(const QDateTime &time)
+{
+    return LogSegment::timeStamp(this->m_timestamps, time.toMSecsSinceEpoch());
+}
@@ -31,54 +31,63 @@
 
 #include <QtPlugin>
 #include <QMap>
+#include <QHash>
+#include "logindex.h"
 #include <IrcMessageFilter>
 #include "bufferplugin.h"
+#include "documentplugin.h"
 #include "settingsplugin.h"
 #include "connectionplugin.h"
 #include "genericplugin.h"
 
-class QFile;
-class QTextStream;
+class LogWriter;
 
 class IrcChannel;
 class IrcPrivateMessage;
 
-class LoggerPlugin : public QObject, public BufferPlugin, public SettingsPlugin, public ConnectionPlugin, public GenericPlugin
+class LoggerPlugin : public QObject, public BufferPlugin, public DocumentPlugin, public SettingsPlugin, public ConnectionPlugin, public GenericPlugin
 {
     Q_OBJECT
-    Q_INTERFACES(BufferPlugin SettingsPlugin ConnectionPlugin GenericPlugin)
+    Q_INTERFACES(BufferPlugin DocumentPlugin SettingsPlugin ConnectionPlugin GenericPlugin)
     Q_PLUGIN_METADATA(IID "Communi.BufferPlugin")
+    Q_PLUGIN_METADATA(IID "Communi.DocumentPlugin")
     Q_PLUGIN_METADATA(IID "Communi.SettingsPlugin")
     Q_PLUGIN_METADATA(IID "Communi.ConnectionPlugin")
     Q_PLUGIN_METADATA(IID "Communi.GenericPlugin")
 
-    struct Item
-    {
-        QFile* logfile;
-        QTextStream* textStream;
-    };
-
 public:
     LoggerPlugin(QObject* parent = 0);
     ~LoggerPlugin();
     void bufferAdded(IrcBuffer* buffer);
     void bufferRemoved(IrcBuffer* buffer);
+    void documentAdded(TextDocument* document);
+    void documentsAdded(const QList<TextDocument*>& documents);
     void settingsChanged();
     void setConnectionsList(const QList<IrcConnection*>* list);
     void pluginEnabled();
     void pluginDisabled();
 
+    QList<LogMatch> search(const QString& query, int limit = 100) const;
+
 private slots:
     void logMessage(IrcMessage *message);
     void removeLogitemForBuffer(IrcBuffer *buffer);
+    void fetchHistory(const QDateTime& before, int count);
 
 private:
+    void restore(TextDocument* document);
+    QList<IrcMessage*> readTail(IrcBuffer* buffer, int count, const QDateTime& before = QDateTime());
     void writeToFile(IrcBuffer* buffer, const QString &text);
     QString logfileName(IrcBuffer *buffer) const;
     QString timestamp() const;
+    QString timestamp(const QDateTime &time);
 
     QString m_logDirPath;
-    QMap<IrcBuffer*, Item> m_logitems;
+    bool m_binary;
+    int m_restore;
+    QMap<IrcBuffer*, QString> m_logitems;
+    QHash<qint64, QString> m_timestamps;
+    LogWriter* m_writer;
     const QList<IrcConnection*>* m_connections;
 };
 
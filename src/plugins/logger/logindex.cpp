@@ -0,0 +1,232 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "logindex.h"
+#include "logsegment.h"
+#include <QMutexLocker>
+#include <QDataStream>
+#include <QFile>
+
+// postings pack the file id above a 40 bit offset
+static const int OffsetBits = 40;
+static const qint64 OffsetMask = (Q_INT64_C(1) << OffsetBits) - 1;
+
+// terms outside these bounds are not worth a posting list
+static const int MinTermLength = 2;
+static const int MaxTermLength = 64;
+
+// search stops verifying candidates after this many reads
+static const int MaxReads = 10000;
+
+static const quint32 IndexMagic = 0x4c494458; // LIDX
+static const quint32 IndexVersion = 1;
+
+static bool readLine(QFile& file, const QString& fileName, qint64 offset, QString* line)
+{
+    if (file.fileName() != fileName || !file.isOpen()) {
+        file.close();
+        file.setFileName(fileName);
+        if (!file.open(QIODevice::ReadOnly))
+            return false;
+    }
+    if (!file.seek(offset))
+        return false;
+
+    if (fileName.endsWith(".seg")) {
+        QDataStream in(&file);
+        LogRecord record;
+        if (!LogSegment::readRecord(in, record))
+            return false;
+        *line = QString::fromUtf8(record.line);
+    } else {
+        *line = QString::fromUtf8(file.readLine()).trimmed();
+    }
+    return true;
+}
+
+LogIndex::LogIndex()
+{
+}
+
+void LogIndex::add(const QString& fileName, qint64 offset, const QString& text)
+{
+    const QStringList keys = terms(text);
+    if (keys.isEmpty())
+        return;
+
+    QMutexLocker locker(&m_mutex);
+    int id = m_fileIds.value(fileName, -1);
+    if (id == -1) {
+        id = m_files.count();
+        m_files += fileName;
+        m_fileIds.insert(fileName, id);
+    }
+    const qint64 posting = (qint64(id) << OffsetBits) | (offset & OffsetMask);
+    foreach (const QString& key, keys)
+        m_postings[key] += posting;
+}
+
+void LogIndex::rename(const QString& fileName, const QString& target)
+{
+    // rotated files keep their postings under the new name
+    QMutexLocker locker(&m_mutex);
+    const int id = m_fileIds.value(fileName, -1);
+    if (id == -1)
+        return;
+    m_fileIds.remove(fileName);
+    m_files[id] = target;
+    m_fileIds.insert(target, id);
+}
+
+void LogIndex::clear()
+{
+    QMutexLocker locker(&m_mutex);
+    m_files.clear();
+    m_fileIds.clear();
+    m_postings.clear();
+}
+
+int LogIndex::termCount() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_postings.count();
+}
+
+QList<LogMatch> LogIndex::search(const QString& query, int limit) const
+{
+    QList<LogMatch> matches;
+    const QStringList words = query.split(' ', QString::SkipEmptyParts);
+    const QStringList keys = terms(query);
+    if (keys.isEmpty())
+        return matches;
+
+    // the rarest term yields the fewest candidates to verify
+    QVector<qint64> candidates;
+    QStringList files;
+    {
+        QMutexLocker locker(&m_mutex);
+        const QVector<qint64>* rarest = 0;
+        foreach (const QString& key, keys) {
+            QHash<QString, QVector<qint64> >::const_iterator it = m_postings.constFind(key);
+            if (it == m_postings.constEnd())
+                return matches;
+            if (!rarest || it.value().count() < rarest->count())
+                rarest = &it.value();
+        }
+        candidates = *rarest;
+        files = m_files;
+    }
+
+    // newest first, reading the lines back to match the words as typed
+    QFile file;
+    int reads = 0;
+    for (int i = candidates.count() - 1; i >= 0 && matches.count() < limit && reads < MaxReads; --i, ++reads) {
+        const QString fileName = files.value(int(candidates.at(i) >> OffsetBits));
+        const qint64 offset = candidates.at(i) & OffsetMask;
+        QString line;
+        if (!readLine(file, fileName, offset, &line))
+            continue;
+
+        bool found = true;
+        foreach (const QString& word, words) {
+            if (!line.contains(word, Qt::CaseInsensitive)) {
+                found = false;
+                break;
+            }
+        }
+        if (found) {
+            LogMatch match;
+            match.fileName = fileName;
+            match.offset = offset;
+            match.line = line;
+            matches += match;
+        }
+    }
+    return matches;
+}
+
+bool LogIndex::load(const QString& path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QDataStream in(&file);
+    quint32 magic = 0, version = 0;
+    in >> magic >> version;
+    if (magic != IndexMagic || version != IndexVersion)
+        return false;
+
+    QStringList files;
+    QHash<QString, QVector<qint64> > postings;
+    in >> files >> postings;
+    if (in.status() != QDataStream::Ok)
+        return false;
+
+    QMutexLocker locker(&m_mutex);
+    m_files = files;
+    m_fileIds.clear();
+    for (int i = 0; i < m_files.count(); ++i)
+        m_fileIds.insert(m_files.at(i), i);
+    m_postings = postings;
+    return true;
+}
+
+bool LogIndex::save(const QString& path) const
+{
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+
+    QMutexLocker locker(&m_mutex);
+    QDataStream out(&file);
+    out << IndexMagic << IndexVersion << m_files << m_postings;
+    return out.status() == QDataStream::Ok;
+}
+
+QStringList LogIndex::terms(const QString& text)
+{
+    QStringList keys;
+    const int length = text.length();
+    int start = -1;
+    for (int i = 0; i <= length; ++i) {
+        if (i < length && text.at(i).isLetterOrNumber()) {
+            if (start == -1)
+                start = i;
+        } else if (start != -1) {
+            const int len = i - start;
+            if (len >= MinTermLength && len <= MaxTermLength) {
+                const QString key = text.mid(start, len).toLower();
+                if (!keys.contains(key))
+                    keys += key;
+            }
+            start = -1;
+        }
+    }
+    return keys;
+}
@@ -0,0 +1,389 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "logsegment.h"
+#include <IrcMessage>
+#include <QTextStream>
+#include <QFileInfo>
+#include <QFile>
+#include <QDir>
+
+// a new segment is started once the current one reaches this size
+static const qint64 SegmentSize = 8 * 1024 * 1024;
+// an index entry is written every this many records or bytes
+static const int IndexRecords = 64;
+static const qint64 IndexBytes = 16 * 1024;
+
+// at most this many formatted time stamps are cached
+static const int MaxTimeStamps = 4096;
+
+// index entries are pairs of the latest timestamp so far and a record offset
+static const int IndexEntrySize = 2 * sizeof(qint64);
+
+QDataStream& operator<<(QDataStream& out, const LogRecord& record)
+{
+    out << record.msecs << record.type << record.nick << record.line;
+    return out;
+}
+
+QDataStream& operator>>(QDataStream& in, LogRecord& record)
+{
+    in >> record.msecs >> record.type >> record.nick >> record.line;
+    return in;
+}
+
+static QString indexFileName(const QString& segment)
+{
+    return segment.left(segment.length() - 4) + ".idx";
+}
+
+static QVector<qint64> indexOffsets(const QString& segment)
+{
+    QVector<qint64> offsets;
+    QFile index(indexFileName(segment));
+    if (index.open(QIODevice::ReadOnly)) {
+        QDataStream in(&index);
+        const qint64 count = index.size() / IndexEntrySize;
+        offsets.reserve(int(count));
+        for (qint64 i = 0; i < count; ++i) {
+            qint64 stamp = 0, offset = 0;
+            in >> stamp >> offset;
+            offsets += offset;
+        }
+    }
+    if (offsets.isEmpty() || offsets.first() != 0)
+        offsets.prepend(0);
+    return offsets;
+}
+
+static void decodeSpan(const uchar* data, qint64 from, qint64 to, QList<LogRecord>& records)
+{
+    // no copy is made of the mapped bytes, only the decoded fields are
+    const QByteArray span = QByteArray::fromRawData(reinterpret_cast<const char*>(data + from), int(to - from));
+    QDataStream in(span);
+    LogRecord record;
+    while (!in.atEnd() && LogSegment::readRecord(in, record))
+        records += record;
+}
+
+bool LogSegment::readRecord(QDataStream& in, LogRecord& record)
+{
+    quint32 size = 0;
+    in >> size;
+    if (in.status() != QDataStream::Ok || size == 0)
+        return false;
+    QByteArray payload(size, Qt::Uninitialized);
+    if (in.readRawData(payload.data(), size) != int(size))
+        return false;
+    QDataStream stream(payload);
+    stream >> record;
+    return stream.status() == QDataStream::Ok;
+}
+
+LogSegment::LogSegment(const QString& dirPath)
+    : m_dirPath(dirPath)
+    , m_data(0)
+    , m_index(0)
+    , m_maxMSecs(0)
+    , m_indexedOffset(-1)
+    , m_sinceIndex(0)
+{
+    QDir().mkpath(dirPath);
+}
+
+LogSegment::~LogSegment()
+{
+    close();
+}
+
+QString LogSegment::dirPath() const
+{
+    return m_dirPath;
+}
+
+QString LogSegment::fileName() const
+{
+    return m_data ? m_data->fileName() : QString();
+}
+
+qint64 LogSegment::append(const LogRecord& record)
+{
+    if (!m_data) {
+        const QStringList existing = segments(m_dirPath);
+        if (!existing.isEmpty() && QFileInfo(existing.last()).size() < SegmentSize)
+            resume(existing.last());
+        if (!m_data && !open(record.msecs))
+            return -1;
+    } else if (m_data->size() >= SegmentSize) {
+        close();
+        if (!open(record.msecs))
+            return -1;
+    }
+
+    QByteArray payload;
+    QDataStream stream(&payload, QIODevice::WriteOnly);
+    stream << record;
+
+    const qint64 offset = m_data->size();
+    QDataStream out(m_data);
+    out << quint32(payload.size());
+    out.writeRawData(payload.constData(), payload.size());
+
+    // the index stays sparse, seeking scans forward from the nearest entry
+    m_maxMSecs = qMax(m_maxMSecs, record.msecs);
+    if (m_indexedOffset < 0 || ++m_sinceIndex >= IndexRecords || offset - m_indexedOffset >= IndexBytes) {
+        QDataStream index(m_index);
+        index << m_maxMSecs << offset;
+        m_indexedOffset = offset;
+        m_sinceIndex = 0;
+    }
+    return out.status() == QDataStream::Ok ? offset : -1;
+}
+
+void LogSegment::flush()
+{
+    if (m_data)
+        m_data->flush();
+    if (m_index)
+        m_index->flush();
+}
+
+void LogSegment::close()
+{
+    delete m_data;
+    delete m_index;
+    m_data = 0;
+    m_index = 0;
+    m_indexedOffset = -1;
+    m_sinceIndex = 0;
+}
+
+bool LogSegment::open(qint64 msecs)
+{
+    const QString name = QString::number(msecs).rightJustified(16, '0') + ".seg";
+    const QString segment = QDir(m_dirPath).filePath(name);
+    m_data = new QFile(segment);
+    m_index = new QFile(indexFileName(segment));
+    if (!m_data->open(QIODevice::WriteOnly | QIODevice::Append) || !m_index->open(QIODevice::WriteOnly | QIODevice::Append)) {
+        close();
+        return false;
+    }
+    m_maxMSecs = msecs;
+    return true;
+}
+
+void LogSegment::resume(const QString& segment)
+{
+    m_data = new QFile(segment);
+    m_index = new QFile(indexFileName(segment));
+    if (!m_data->open(QIODevice::ReadWrite | QIODevice::Append) || !m_index->open(QIODevice::ReadWrite | QIODevice::Append)) {
+        close();
+        return;
+    }
+
+    // continue from the last index entry
+    if (m_index->size() >= IndexEntrySize && m_index->seek(m_index->size() - m_index->size() % IndexEntrySize - IndexEntrySize)) {
+        QDataStream in(m_index);
+        in >> m_maxMSecs >> m_indexedOffset;
+        m_sinceIndex = 0;
+    }
+}
+
+QStringList LogSegment::segments(const QString& dirPath)
+{
+    // zero padded timestamps sort by name
+    QDir dir(dirPath);
+    QStringList files = dir.entryList(QStringList("*.seg"), QDir::Files, QDir::Name);
+    for (int i = 0; i < files.count(); ++i)
+        files[i] = dir.filePath(files.at(i));
+    return files;
+}
+
+qint64 LogSegment::seek(const QString& segment, qint64 msecs)
+{
+    // binary search for the last entry that is still older than msecs
+    QFile index(indexFileName(segment));
+    if (!index.open(QIODevice::ReadOnly))
+        return 0;
+
+    qint64 lo = 0;
+    qint64 hi = index.size() / IndexEntrySize;
+    qint64 offset = 0;
+    QDataStream in(&index);
+    while (lo < hi) {
+        const qint64 mid = (lo + hi) / 2;
+        qint64 stamp = 0, position = 0;
+        index.seek(mid * IndexEntrySize);
+        in >> stamp >> position;
+        if (stamp < msecs) {
+            offset = position;
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return offset;
+}
+
+QList<LogRecord> LogSegment::read(const QString& dirPath, const QDateTime& from, int count)
+{
+    QList<LogRecord> records;
+    const qint64 msecs = from.toMSecsSinceEpoch();
+    const QStringList files = segments(dirPath);
+
+    // the segment names are the timestamps of their first records
+    int first = 0;
+    for (int i = files.count() - 1; i > 0; --i) {
+        if (QFileInfo(files.at(i)).completeBaseName().toLongLong() <= msecs) {
+            first = i;
+            break;
+        }
+    }
+
+    for (int i = first; i < files.count() && records.count() < count; ++i) {
+        QFile file(files.at(i));
+        if (!file.open(QIODevice::ReadOnly))
+            continue;
+        if (i == first)
+            file.seek(seek(files.at(i), msecs));
+
+        QDataStream in(&file);
+        LogRecord record;
+        while (records.count() < count && readRecord(in, record)) {
+            if (record.msecs >= msecs)
+                records += record;
+        }
+    }
+    return records;
+}
+
+QList<LogRecord> LogSegment::tail(const QString& dirPath, int count, const QDateTime& before)
+{
+    QList<LogRecord> records;
+    const qint64 until = before.isValid() ? before.toMSecsSinceEpoch() : 0;
+    const QStringList files = segments(dirPath);
+    for (int i = files.count() - 1; i >= 0 && records.count() < count; --i) {
+        // the segment names are the timestamps of their first records
+        if (until > 0 && QFileInfo(files.at(i)).completeBaseName().toLongLong() >= until)
+            continue;
+        QFile file(files.at(i));
+        if (!file.open(QIODevice::ReadOnly) || file.size() == 0)
+            continue;
+        const qint64 size = file.size();
+        uchar* data = file.map(0, size);
+        if (!data)
+            continue;
+
+        // walk the sparse index backwards, decoding only the spans needed
+        const QVector<qint64> offsets = indexOffsets(files.at(i));
+        qint64 end = size;
+        if (until > 0) {
+            const qint64 from = seek(files.at(i), until);
+            foreach (qint64 offset, offsets) {
+                if (offset > from) {
+                    end = offset;
+                    break;
+                }
+            }
+        }
+        QList<LogRecord> found;
+        for (int entry = offsets.count() - 1; entry >= 0 && records.count() + found.count() < count; --entry) {
+            if (offsets.at(entry) >= end)
+                continue;
+            QList<LogRecord> span;
+            decodeSpan(data, offsets.at(entry), end, span);
+            while (until > 0 && !span.isEmpty() && span.last().msecs >= until)
+                span.removeLast();
+            found = span + found;
+            end = offsets.at(entry);
+        }
+
+        const int wanted = count - records.count();
+        if (found.count() > wanted)
+            found = found.mid(found.count() - wanted);
+        records = found + records;
+        file.unmap(data);
+    }
+    return records;
+}
+
+bool LogSegment::exportText(const QString& dirPath, const QString& fileName)
+{
+    QFile output(fileName);
+    if (!output.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+        return false;
+
+    // the same lines the text logger writes
+    QTextStream out(&output);
+    out.setCodec("UTF-8");
+    QHash<qint64, QString> stamps;
+    foreach (const QString& segment, segments(dirPath)) {
+        QFile file(segment);
+        if (!file.open(QIODevice::ReadOnly))
+            continue;
+        QDataStream in(&file);
+        LogRecord record;
+        while (readRecord(in, record)) {
+            IrcMessage* message = IrcMessage::fromData(record.line, 0);
+            if (message)
+                out << textLine(timeStamp(stamps, record.msecs), message) << "\n";
+            delete message;
+        }
+    }
+    return out.status() == QTextStream::Ok;
+}
+
+QString LogSegment::timeStamp(QHash<qint64, QString>& cache, qint64 msecs)
+{
+    // playback bursts share a handful of seconds
+    const qint64 key = msecs - msecs % 1000;
+    QHash<qint64, QString>::const_iterator it = cache.constFind(key);
+    if (it != cache.constEnd())
+        return it.value();
+
+    if (cache.count() >= MaxTimeStamps)
+        cache.clear();
+    return cache.insert(key, QDateTime::fromMSecsSinceEpoch(key).toString("[yyyy-MM-dd] hh:mm:ss")).value();
+}
+
+QString LogSegment::textLine(const QString& timeStamp, IrcMessage* message)
+{
+    switch (message->type()) {
+    case IrcMessage::Private: {
+        IrcPrivateMessage* privateMessage = static_cast<IrcPrivateMessage*>(message);
+        if (privateMessage->isAction())
+            return timeStamp + " * " + message->nick() + " " + privateMessage->content();
+        return timeStamp + " " + message->nick() + ": " + privateMessage->content();
+    }
+    case IrcMessage::Notice:
+        return timeStamp + " -" + message->nick() + "- " + static_cast<IrcNoticeMessage*>(message)->content();
+    default:
+        // other messages keep the raw line, so that they can be replayed
+        return timeStamp + " -!- " + QString::fromUtf8(message->toData());
+    }
+}
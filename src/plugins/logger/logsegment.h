@@ -0,0 +1,92 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef LOGSEGMENT_H
+#define LOGSEGMENT_H
+
+#include <QHash>
+#include <QList>
+#include <QVector>
+#include <QString>
+#include <QDateTime>
+#include <QByteArray>
+#include <QStringList>
+#include <QDataStream>
+
+class QFile;
+class IrcMessage;
+
+struct LogRecord
+{
+    LogRecord() : msecs(0), type(0) { }
+
+    qint64 msecs;
+    qint32 type;
+    QString nick;
+    QByteArray line;
+};
+
+QDataStream& operator<<(QDataStream& out, const LogRecord& record);
+QDataStream& operator>>(QDataStream& in, LogRecord& record);
+
+class LogSegment
+{
+public:
+    explicit LogSegment(const QString& dirPath);
+    ~LogSegment();
+
+    QString dirPath() const;
+    QString fileName() const;
+
+    qint64 append(const LogRecord& record);
+    void flush();
+    void close();
+
+    static bool readRecord(QDataStream& in, LogRecord& record);
+    static QStringList segments(const QString& dirPath);
+    static qint64 seek(const QString& segment, qint64 msecs);
+    static QList<LogRecord> read(const QString& dirPath, const QDateTime& from, int count);
+    static QList<LogRecord> tail(const QString& dirPath, int count, const QDateTime& before = QDateTime());
+    static bool exportText(const QString& dirPath, const QString& fileName);
+
+    static QString timeStamp(QHash<qint64, QString>& cache, qint64 msecs);
+    static QString textLine(const QString& timeStamp, IrcMessage* message);
+
+private:
+    bool open(qint64 msecs);
+    void resume(const QString& segment);
+
+    QString m_dirPath;
+    QFile* m_data;
+    QFile* m_index;
+    qint64 m_maxMSecs;
+    qint64 m_indexedOffset;
+    int m_sinceIndex;
+};
+
+#endif // LOGSEGMENT_H
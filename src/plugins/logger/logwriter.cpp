@@ -0,0 +1,424 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "logwriter.h"
+#include "logcompressor.h"
+#include "allocstats.h"
+#include <QElapsedTimer>
+#include <QMutexLocker>
+#include <QFileInfo>
+#include <QFile>
+
+// producers wait once this many lines are pending
+static const int MaxQueue = 10000;
+// files are flushed once this many bytes or milliseconds have piled up
+static const qint64 FlushBytes = 64 * 1024;
+static const int FlushInterval = 1000;
+// at most this many log files are kept open by default
+static const int DefaultMaxFiles = 64;
+
+LogWriter::LogWriter(QObject* parent) : QThread(parent)
+    , m_quit(false)
+    , m_flushRequested(false)
+    , m_enqueued(0)
+    , m_flushed(0)
+    , m_commitPending(false)
+    , m_unflushedBytes(0)
+    , m_maxFiles(DefaultMaxFiles)
+    , m_opens(0)
+    , m_evictions(0)
+    , m_rotateSize(0)
+    , m_rotateDaily(0)
+    , m_compress(0)
+{
+    // rotated files are compressed one at a time
+    m_compressor.setMaxThreadCount(1);
+    start(QThread::LowPriority);
+}
+
+LogWriter::~LogWriter()
+{
+    commit();
+    {
+        QMutexLocker locker(&m_mutex);
+        m_quit = true;
+        m_wakeup.wakeOne();
+    }
+    wait();
+}
+
+void LogWriter::write(const QString& fileName, const QString& line)
+{
+    Entry entry;
+    entry.kind = Entry::Line;
+    entry.fileName = fileName;
+    entry.line = line;
+    stage(entry);
+}
+
+void LogWriter::write(const QString& dirPath, const LogRecord& record)
+{
+    Entry entry;
+    entry.kind = Entry::Record;
+    entry.fileName = dirPath;
+    entry.record = record;
+    stage(entry);
+}
+
+void LogWriter::close(const QString& fileName)
+{
+    Entry entry;
+    entry.kind = Entry::Close;
+    entry.fileName = fileName;
+    enqueue(entry);
+    flush();
+}
+
+void LogWriter::setIndexPath(const QString& path)
+{
+    // loading and saving happen in the writer thread
+    Entry entry;
+    entry.kind = Entry::Index;
+    entry.fileName = path;
+    enqueue(entry);
+}
+
+QList<LogMatch> LogWriter::search(const QString& query, int limit) const
+{
+    return m_index.search(query, limit);
+}
+
+int LogWriter::maxOpenFiles() const
+{
+    return m_maxFiles.load();
+}
+
+void LogWriter::setMaxOpenFiles(int count)
+{
+    m_maxFiles.store(qMax(1, count));
+}
+
+void LogWriter::setRotation(int megabytes, bool daily, bool compress)
+{
+    m_rotateSize.store(qMax(0, megabytes));
+    m_rotateDaily.store(daily);
+    m_compress.store(compress);
+}
+
+int LogWriter::openCount() const
+{
+    return m_opens.load();
+}
+
+int LogWriter::evictCount() const
+{
+    return m_evictions.load();
+}
+
+void LogWriter::flush()
+{
+    // blocks until everything queued so far is on disk
+    commit();
+    QMutexLocker locker(&m_mutex);
+    const quint64 target = m_enqueued;
+    m_flushRequested = true;
+    m_wakeup.wakeOne();
+    while (m_flushed < target && isRunning())
+        m_synced.wait(&m_mutex);
+}
+
+// lines of one event loop turn cross over to the writer thread together,
+// one lock and one wakeup instead of one per line
+void LogWriter::stage(const Entry& entry)
+{
+    m_staged += entry;
+    if (!m_commitPending) {
+        m_commitPending = true;
+        QMetaObject::invokeMethod(this, "commit", Qt::QueuedConnection);
+    }
+}
+
+void LogWriter::commit()
+{
+    m_commitPending = false;
+    if (m_staged.isEmpty())
+        return;
+
+    QMutexLocker locker(&m_mutex);
+    while (m_queue.count() >= MaxQueue && isRunning())
+        m_space.wait(&m_mutex);
+    m_queue += m_staged;
+    m_enqueued += m_staged.count();
+    m_staged.clear();
+    m_wakeup.wakeOne();
+}
+
+void LogWriter::enqueue(const Entry& entry)
+{
+    // keeps the order with whatever is still staged
+    commit();
+    QMutexLocker locker(&m_mutex);
+    while (m_queue.count() >= MaxQueue && isRunning())
+        m_space.wait(&m_mutex);
+    m_queue += entry;
+    ++m_enqueued;
+    m_wakeup.wakeOne();
+}
+
+void LogWriter::run()
+{
+    // everything this thread allocates is logging
+    COMMUNI_ALLOC_STAGE(Log);
+    QElapsedTimer dirty;
+    forever {
+        QList<Entry> batch;
+        bool quit = false;
+        bool flushRequested = false;
+        quint64 taken = 0;
+        {
+            QMutexLocker locker(&m_mutex);
+            if (m_queue.isEmpty() && !m_quit && !m_flushRequested) {
+                if (dirty.isValid())
+                    m_wakeup.wait(&m_mutex, static_cast<unsigned long>(qMax(Q_INT64_C(1), FlushInterval - dirty.elapsed())));
+                else
+                    m_wakeup.wait(&m_mutex);
+            }
+            batch.swap(m_queue);
+            taken = m_enqueued;
+            quit = m_quit;
+            flushRequested = m_flushRequested;
+            m_flushRequested = false;
+            m_space.wakeAll();
+        }
+
+        // group the batch per file, so that each file gets a single write
+        QList<QString> order;
+        QHash<QString, Chunk> chunks;
+        foreach (const Entry& entry, batch) {
+            switch (entry.kind) {
+            case Entry::Close:
+                if (chunks.contains(entry.fileName)) {
+                    writeChunk(entry.fileName, chunks.take(entry.fileName));
+                    order.removeAll(entry.fileName);
+                }
+                closeFile(entry.fileName);
+                break;
+            case Entry::Index:
+                if (!m_indexPath.isEmpty())
+                    m_index.save(m_indexPath);
+                m_index.clear();
+                m_indexPath = entry.fileName;
+                if (!m_indexPath.isEmpty())
+                    m_index.load(m_indexPath);
+                break;
+            case Entry::Record: {
+                LogSegment* s = segment(entry.fileName);
+                const qint64 offset = s ? s->append(entry.record) : -1;
+                if (offset >= 0) {
+                    m_index.add(s->fileName(), offset, QString::fromUtf8(entry.record.line));
+                    m_unflushedBytes += entry.record.line.size();
+                    if (!dirty.isValid())
+                        dirty.start();
+                }
+                break;
+            }
+            case Entry::Line: {
+                if (!chunks.contains(entry.fileName))
+                    order += entry.fileName;
+                Chunk& chunk = chunks[entry.fileName];
+                chunk.offsets += chunk.data.size();
+                chunk.lines += entry.line;
+                chunk.data += entry.line.toUtf8();
+                chunk.data += '\n';
+                break;
+            }
+            }
+        }
+        foreach (const QString& fileName, order) {
+            if (writeChunk(fileName, chunks.value(fileName)) && !dirty.isValid())
+                dirty.start();
+        }
+
+        const bool synced = quit || flushRequested || m_unflushedBytes >= FlushBytes
+                || (dirty.isValid() && dirty.elapsed() >= FlushInterval);
+        if (synced) {
+            sync();
+            dirty.invalidate();
+        }
+
+        {
+            QMutexLocker locker(&m_mutex);
+            if (synced) {
+                m_flushed = taken;
+                m_synced.wakeAll();
+            }
+            if (quit && m_queue.isEmpty())
+                break;
+        }
+    }
+
+    if (!m_indexPath.isEmpty())
+        m_index.save(m_indexPath);
+
+    foreach (QFile* f, m_files) {
+        f->close();
+        delete f;
+    }
+    m_files.clear();
+    qDeleteAll(m_segments);
+    m_segments.clear();
+    m_recent.clear();
+}
+
+void LogWriter::sync()
+{
+    foreach (QFile* f, m_files)
+        f->flush();
+    foreach (LogSegment* s, m_segments)
+        s->flush();
+    m_unflushedBytes = 0;
+}
+
+QFile* LogWriter::file(const QString& fileName)
+{
+    QFile* f = m_files.value(fileName);
+    if (f) {
+        // most recently used last
+        if (m_recent.last() != fileName) {
+            m_recent.removeOne(fileName);
+            m_recent += fileName;
+        }
+        return f;
+    }
+
+    // evicted files are transparently opened again in append mode
+    evict();
+
+    const QFileInfo info(fileName);
+    m_dates.insert(fileName, info.exists() ? info.lastModified().date() : QDate::currentDate());
+
+    f = new QFile(fileName);
+    if (!f->open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text)) {
+        delete f;
+        return 0;
+    }
+    m_opens.ref();
+    m_files.insert(fileName, f);
+    m_recent += fileName;
+    return f;
+}
+
+bool LogWriter::writeChunk(const QString& fileName, const Chunk& chunk)
+{
+    QFile* f = rotate(fileName, chunk.data.size());
+    if (!f)
+        return false;
+
+    const qint64 base = f->size();
+    if (f->write(chunk.data) <= 0)
+        return false;
+    m_unflushedBytes += chunk.data.size();
+
+    // lines are indexed as they are written
+    for (int i = 0; i < chunk.lines.count(); ++i)
+        m_index.add(fileName, base + chunk.offsets.at(i), chunk.lines.at(i));
+    return true;
+}
+
+QFile* LogWriter::rotate(const QString& fileName, qint64 incoming)
+{
+    QFile* f = file(fileName);
+    if (!f || f->size() == 0)
+        return f;
+
+    const qint64 maxBytes = qint64(m_rotateSize.load()) * 1024 * 1024;
+    const QDate date = m_dates.value(fileName);
+    const bool full = maxBytes > 0 && f->size() + incoming > maxBytes;
+    const bool stale = m_rotateDaily.load() && date < QDate::currentDate();
+    if (!full && !stale)
+        return f;
+
+    // network_title.log becomes network_title.yyyy-MM-dd[-N].log
+    QString base = fileName;
+    if (base.endsWith(".log"))
+        base.chop(4);
+    base += "." + date.toString("yyyy-MM-dd");
+    QString target = base + ".log";
+    for (int i = 2; QFile::exists(target) || QFile::exists(target + ".z"); ++i)
+        target = base + "-" + QString::number(i) + ".log";
+
+    // writing continues in a fresh file while the rotated one is compressed
+    closeFile(fileName);
+    if (QFile::rename(fileName, target)) {
+        m_index.rename(fileName, target);
+        if (m_compress.load())
+            m_compressor.start(new LogCompressor(target));
+    }
+    return file(fileName);
+}
+
+LogSegment* LogWriter::segment(const QString& dirPath)
+{
+    // segments share the pool of open files with the text logs
+    LogSegment* s = m_segments.value(dirPath);
+    if (s) {
+        if (m_recent.last() != dirPath) {
+            m_recent.removeOne(dirPath);
+            m_recent += dirPath;
+        }
+        return s;
+    }
+
+    evict();
+
+    s = new LogSegment(dirPath);
+    m_opens.ref();
+    m_segments.insert(dirPath, s);
+    m_recent += dirPath;
+    return s;
+}
+
+void LogWriter::evict()
+{
+    while (!m_recent.isEmpty() && m_files.count() + m_segments.count() >= m_maxFiles.load()) {
+        closeFile(m_recent.first());
+        m_evictions.ref();
+    }
+}
+
+void LogWriter::closeFile(const QString& fileName)
+{
+    QFile* f = m_files.take(fileName);
+    if (f) {
+        f->close();
+        delete f;
+    }
+    delete m_segments.take(fileName);
+    m_dates.remove(fileName);
+    m_recent.removeOne(fileName);
+}
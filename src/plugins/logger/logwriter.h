@@ -0,0 +1,136 @@
+/*
+  Copyright (C) 2008-2016 The Communi Project
+
+  You may use this file under the terms of BSD license as follows:
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef LOGWRITER_H
+#define LOGWRITER_H
+
+#include <QDate>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QThread>
+#include <QString>
+#include <QAtomicInt>
+#include <QThreadPool>
+#include <QWaitCondition>
+#include "logsegment.h"
+#include "logindex.h"
+
+class QFile;
+
+class LogWriter : public QThread
+{
+    Q_OBJECT
+
+public:
+    LogWriter(QObject* parent = 0);
+    ~LogWriter();
+
+    void write(const QString& fileName, const QString& line);
+    void write(const QString& dirPath, const LogRecord& record);
+    void flush();
+    void close(const QString& fileName);
+
+    void setIndexPath(const QString& path);
+    QList<LogMatch> search(const QString& query, int limit = 100) const;
+
+    int maxOpenFiles() const;
+    void setMaxOpenFiles(int count);
+
+    void setRotation(int megabytes, bool daily, bool compress);
+
+    int openCount() const;
+    int evictCount() const;
+
+protected:
+    void run();
+
+private slots:
+    void commit();
+
+private:
+    struct Entry
+    {
+        enum Kind { Line, Record, Close, Index };
+        Kind kind;
+        QString fileName;
+        QString line;
+        LogRecord record;
+    };
+
+    struct Chunk
+    {
+        QByteArray data;
+        QList<qint64> offsets;
+        QStringList lines;
+    };
+
+    void stage(const Entry& entry);
+    void enqueue(const Entry& entry);
+    void sync();
+    QFile* file(const QString& fileName);
+    QFile* rotate(const QString& fileName, qint64 incoming);
+    bool writeChunk(const QString& fileName, const Chunk& chunk);
+    LogSegment* segment(const QString& dirPath);
+    void evict();
+    void closeFile(const QString& fileName);
+
+    QMutex m_mutex;
+    QWaitCondition m_wakeup;
+    QWaitCondition m_space;
+    QWaitCondition m_synced;
+    QList<Entry> m_queue;
+    bool m_quit;
+    bool m_flushRequested;
+    quint64 m_enqueued;
+    quint64 m_flushed;
+
+    // only touched by the gui thread
+    QList<Entry> m_staged;
+    bool m_commitPending;
+
+    // only touched by the writer thread
+    QHash<QString, QFile*> m_files;
+    QHash<QString, LogSegment*> m_segments;
+    QHash<QString, QDate> m_dates;
+    QList<QString> m_recent;
+    qint64 m_unflushedBytes;
+    QString m_indexPath;
+    LogIndex m_index;
+
+    QAtomicInt m_maxFiles;
+    QAtomicInt m_opens;
+    QAtomicInt m_evictions;
+
+    QAtomicInt m_rotateSize;
+    QAtomicInt m_rotateDaily;
+    QAtomicInt m_compress;
+    QThreadPool m_compressor;
+};
+
+#endif // LOGWRITER_H
@@ -30,16 +30,20 @@
 
 #include "bufferview.h"
 #include "textdocument.h"
+#include "documentstub.h"
+#include "hookstats.h"
+#include "sendqueue.h"
+#include "taskscheduler.h"
 
 #include <IrcConnection>
 #include <IrcBufferModel>
 #include <IrcBuffer>
 #include <IrcCommand>
 
-#include <QtCore/qcoreevent.h>
 
 static const char* kMessageSeenCapability = "znc.in/message-seen";
 static const int kMessageCompressionDelay = 200;
+static const int kMaxMessagesPerTick = 20;
 
 MessageSeenPlugin::MessageSeenPlugin(QObject* parent)
     : QObject(parent), m_processingMsgSeenMessage(false)
@@ -53,12 +57,63 @@ void MessageSeenPlugin::connectionAdded(IrcConnection* connection)
     capabilities += kMessageSeenCapability;
     network->setRequestedCapabilities(capabilities);
 
-    connection->installMessageFilter(this);
+    HookStats::installMessageFilter(connection, this);
 }
 
 void MessageSeenPlugin::documentAdded(TextDocument *document)
 {
     connect(document, &TextDocument::latestMessageSeenChanged, this, &MessageSeenPlugin::latestMessageSeenChanged);
+    connect(document, &QObject::destroyed, this, &MessageSeenPlugin::documentDestroyed);
+    connect(document->buffer(), &IrcBuffer::titleChanged, this, &MessageSeenPlugin::bufferTitleChanged, Qt::UniqueConnection);
+    addDocument(document);
+}
+
+void MessageSeenPlugin::documentRemoved(TextDocument *document)
+{
+    m_dirtyDocuments.remove(document);
+    removeDocument(document);
+}
+
+void MessageSeenPlugin::documentDestroyed(QObject* document)
+{
+    // Clones go away with their view, without documentRemoved()
+    TextDocument* doc = static_cast<TextDocument*>(document);
+    m_dirtyDocuments.remove(doc);
+    removeDocument(doc);
+}
+
+void MessageSeenPlugin::bufferTitleChanged()
+{
+    IrcBuffer* buffer = qobject_cast<IrcBuffer*>(sender());
+    foreach (TextDocument* document, buffer->findChildren<TextDocument*>()) {
+        if (m_documentKeys.contains(document)) {
+            removeDocument(document);
+            addDocument(document);
+        }
+    }
+}
+
+void MessageSeenPlugin::addDocument(TextDocument* document)
+{
+    IrcBuffer* buffer = document->buffer();
+    const QString title = buffer->title().toLower();
+    m_documentKeys.insert(document, qMakePair(buffer->connection(), title));
+    m_documents[buffer->connection()].insert(title, document);
+}
+
+void MessageSeenPlugin::removeDocument(TextDocument* document)
+{
+    // Only the stored key is used, the document may be half destroyed
+    if (!m_documentKeys.contains(document))
+        return;
+
+    const QPair<IrcConnection*, QString> key = m_documentKeys.take(document);
+    QHash<IrcConnection*, QMultiHash<QString, TextDocument*> >::iterator it = m_documents.find(key.first);
+    if (it != m_documents.end()) {
+        it->remove(key.second, document);
+        if (it->isEmpty())
+            m_documents.erase(it);
+    }
 }
 
 class IrcMessageSeenCommand : public IrcCommand
@@ -106,34 +161,27 @@ void MessageSeenPlugin::latestMessageSeenChanged(const QDateTime& timestamp)
     if (!buffer->network()->isCapable(kMessageSeenCapability))
         return;
 
-    if (int timerId = m_sendTimers.take(buffer))
-        killTimer(timerId);
-
-    m_sendTimers.insert(buffer, startTimer(kMessageCompressionDelay));
+    // One tick for all buffers, whatever changed in between is sent together
+    m_dirtyDocuments.insert(document);
+    TaskScheduler::instance()->schedule(TaskScheduler::Pacing, this, "sendMessages", kMessageCompressionDelay);
 }
 
-void MessageSeenPlugin::timerEvent(QTimerEvent* event)
+void MessageSeenPlugin::sendMessages()
 {
-    IrcBuffer* buffer = m_sendTimers.key(event->timerId(), 0);
-    if (!buffer)
-        return;
-
-    foreach (TextDocument* document, buffer->findChildren<TextDocument*>()) {
-        if (document->isClone())
-            continue;
-
-        QDateTime timestamp = document->latestMessageSeen();
-        IrcCommand *command = IrcMessageSeenCommand::create(buffer->title(), timestamp);
-
-        command->setParent(this);
-        buffer->sendCommand(command);
-        command->deleteLater();
-
-        break;
+    // The send queue paces what goes out, this only bounds a single tick
+    int count = 0;
+    QSet<TextDocument*>::iterator it = m_dirtyDocuments.begin();
+    while (it != m_dirtyDocuments.end() && count++ < kMaxMessagesPerTick) {
+        TextDocument* document = *it;
+        it = m_dirtyDocuments.erase(it);
+
+        IrcBuffer* buffer = document->buffer();
+        IrcCommand *command = IrcMessageSeenCommand::create(buffer->title(), document->latestMessageSeen());
+        SendQueue::instance(buffer->connection())->send(command, SendQueue::Bulk);
     }
 
-    killTimer(event->timerId());
-    m_sendTimers.remove(buffer);
+    if (!m_dirtyDocuments.isEmpty())
+        TaskScheduler::instance()->schedule(TaskScheduler::Pacing, this, "sendMessages");
 }
 
 bool MessageSeenPlugin::messageFilter(IrcMessage* message)
@@ -156,17 +204,20 @@ bool MessageSeenPlugin::messageFilter(IrcMessage* message)
         return true;
     }
 
-    IrcConnection* connection = message->connection();
-    foreach (IrcBufferModel* bufferModel, connection->findChildren<IrcBufferModel*>()) {
-        IrcBuffer *buffer = bufferModel->find(title);
-        if (!buffer)
-            continue;
+    // Maintained from documentAdded() and documentRemoved()
+    const QList<TextDocument*> documents = m_documents.value(message->connection()).values(title.toLower());
+    foreach (TextDocument* document, documents) {
+        QDateTime previousLastSeenTimestamp = document->latestMessageSeen();
+        if (timestamp > previousLastSeenTimestamp)
+            document->setLatestMessageSeen(timestamp);
+    }
 
-        foreach (TextDocument* document, buffer->findChildren<TextDocument*>()) {
-            QDateTime previousLastSeenTimestamp = document->latestMessageSeen();
-            if (timestamp > previousLastSeenTimestamp)
-                document->setLatestMessageSeen(timestamp);
-        }
+    // Buffers without a document yet keep the timestamp on their stub
+    if (documents.isEmpty()) {
+        IrcBufferModel* model = message->connection()->findChild<IrcBufferModel*>();
+        DocumentStub* stub = DocumentStub::find(model ? model->find(title) : 0);
+        if (stub && timestamp > stub->latestMessageSeen())
+            stub->setLatestMessageSeen(timestamp);
     }
 
     m_processingMsgSeenMessage = false;
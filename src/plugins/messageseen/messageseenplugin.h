@@ -29,6 +29,9 @@
 #ifndef MSGSEENPLUGIN_H
 #define MSGSEENPLUGIN_H
 
+#include <QSet>
+#include <QHash>
+#include <QPair>
 #include <QObject>
 #include <QtPlugin>
 
@@ -57,14 +60,22 @@ public:
 
     void connectionAdded(IrcConnection*) Q_DECL_OVERRIDE;
     void documentAdded(TextDocument*) Q_DECL_OVERRIDE;
+    void documentRemoved(TextDocument*) Q_DECL_OVERRIDE;
 
 private slots:
     bool messageFilter(IrcMessage* message) Q_DECL_OVERRIDE;
     void latestMessageSeenChanged(const QDateTime& timestamp);
-    void timerEvent(QTimerEvent* event) Q_DECL_OVERRIDE;
+    void sendMessages();
+    void bufferTitleChanged();
+    void documentDestroyed(QObject* document);
 
 private:
-    QMap<IrcBuffer*, int> m_sendTimers;
+    void addDocument(TextDocument* document);
+    void removeDocument(TextDocument* document);
+
+    QHash<IrcConnection*, QMultiHash<QString, TextDocument*> > m_documents;
+    QHash<TextDocument*, QPair<IrcConnection*, QString> > m_documentKeys;
+    QSet<TextDocument*> m_dirtyDocuments;
     bool m_processingMsgSeenMessage;
 };
 
@@ -57,7 +57,13 @@ void OsxPlugin::setupTrayIcon(QSystemTrayIcon* tray)
 
 void OsxPlugin::dockAlert(IrcMessage* message)
 {
-    if (message->type() == IrcMessage::Private) {
+    // alerts come grouped per buffer, see Dock::notify()
+    const int collapsed = message->property("collapsed").toInt();
+    if (collapsed > 0) {
+        const QString content = IrcTextFormat().toPlainText(message->property("content").toString());
+        d.tray->showMessage(tr("%n new message(s) in %1", 0, collapsed + 1).arg(message->property("buffer").toString()),
+                            message->nick() + ": " + content);
+    } else if (message->type() == IrcMessage::Private) {
         IrcPrivateMessage* pm = static_cast<IrcPrivateMessage*>(message);
         if (pm->isPrivate())
             d.tray->showMessage(tr("Private message from %1").arg(pm->nick()), IrcTextFormat().toPlainText(pm->content()));
@@ -71,3 +77,10 @@ void OsxPlugin::dockAlert(IrcMessage* message)
             d.tray->showMessage(tr("Notice from %1 on %2").arg(nm->nick(), nm->target()), IrcTextFormat().toPlainText(nm->content()));
     }
 }
+
+void OsxPlugin::dockBadgeChanged(int unread, int alerts)
+{
+    Q_UNUSED(alerts);
+    if (d.tray)
+        d.tray->setToolTip(unread > 0 ? tr("Communi - %n unread message(s)", 0, unread) : tr("Communi"));
+}
@@ -47,6 +47,7 @@ public:
     void windowCreated(QMainWindow* window);
     void setupTrayIcon(QSystemTrayIcon* tray);
     void dockAlert(IrcMessage* message);
+    void dockBadgeChanged(int unread, int alerts);
 
 private:
     struct Private {
@@ -27,6 +27,7 @@
 */
 
 #include "commandverifier.h"
+#include "hookstats.h"
 #include <IrcConnection>
 #include <IrcCommand>
 #include <IrcMessage>
@@ -36,21 +37,20 @@ int CommandVerifier::Private::id = 1;
 CommandVerifier::CommandVerifier(IrcConnection* connection) : QObject(connection)
 {
     d.connection = connection;
-    connection->installMessageFilter(this);
-    connection->installCommandFilter(this);
+    HookStats::installMessageFilter(connection, this);
+    HookStats::installCommandFilter(connection, this);
 }
 
 int CommandVerifier::identify(IrcMessage* message) const
 {
+    // the oldest pending command with the same content
     if (message->type() == IrcMessage::Private || message->type() == IrcMessage::Notice) {
-        QMapIterator<int, IrcCommand*> it(d.commands);
-        while (it.hasNext()) {
-            IrcMessage* cmd = it.next().value()->toMessage(message->prefix(), message->connection());
-            if (cmd && cmd->command() == message->command() && cmd->parameters() == message->parameters()) {
-                cmd->deleteLater();
-                return it.key();
-            }
+        int id = 0;
+        foreach (int candidate, d.ids.values(key(message))) {
+            if (!id || candidate < id)
+                id = candidate;
         }
+        return id;
     }
     return 0;
 }
@@ -63,11 +63,15 @@ bool CommandVerifier::messageFilter(IrcMessage* message)
     if (message->isOwn() && (message->type() == IrcMessage::Private || message->type() == IrcMessage::Notice)) {
         IrcNetwork* network = message->network();
         if (network && network->isCapable("echo-message")) {
-            int id = identify(message);
+            // the label is exact, the content is what is left without one
+            int id = label(message);
+            if (id <= 0)
+                id = identify(message);
             if (id > 0) {
-                IrcCommand* command = d.commands.take(id);
+                const int echo = d.echoes.value(id);
+                IrcCommand* command = take(id);
                 if (command) {
-                    emit verified(id, message);
+                    emit verified(echo, message);
                     command->deleteLater();
                     return true;
                 }
@@ -79,9 +83,10 @@ bool CommandVerifier::messageFilter(IrcMessage* message)
             bool ok = false;
             int id = arg.mid(8).toInt(&ok);
             if (ok) {
-                IrcCommand* command = d.commands.take(id);
+                const int echo = d.echoes.value(id);
+                IrcCommand* command = take(id);
                 if (command) {
-                    emit verified(id);
+                    emit verified(echo);
                     command->deleteLater();
                     return true;
                 }
@@ -99,12 +104,28 @@ bool CommandVerifier::commandFilter(IrcCommand* command)
         command->setParent(this); // take ownership
         d.id = qMax(1, d.id + 1); // overflow -> 1
         d.commands.insert(d.id, command);
+        const int echo = command->property("echo").toInt();
+        if (echo > 0)
+            d.echoes.insert(d.id, echo);
+
+        // looked up for every own message, so computed once up front
+        IrcMessage* message = command->toMessage(d.connection->nickName(), d.connection);
+        if (message) {
+            const QString k = key(message);
+            d.keys.insert(d.id, k);
+            d.ids.insert(k, d.id);
+            delete message;
+        }
 
         IrcConnection* connection = command->connection();
         if (connection) {
             IrcNetwork* network = connection->network();
-            if (network && network->isCapable("echo-message"))
-                return false;
+            if (network && network->isCapable("echo-message")) {
+                if (!network->isCapable("labeled-response"))
+                    return false;
+                d.connection->sendData("@label=communi/" + QByteArray::number(d.id) + ' ' + command->toString().toUtf8());
+                return true;
+            }
         }
 
         d.connection->sendCommand(command);
@@ -113,3 +134,25 @@ bool CommandVerifier::commandFilter(IrcCommand* command)
     }
     return false;
 }
+
+QString CommandVerifier::key(IrcMessage* message)
+{
+    return message->command() + QChar(' ') + message->parameters().join(QChar(' '));
+}
+
+int CommandVerifier::label(IrcMessage* message) const
+{
+    const QString label = message->tag("label").toString();
+    if (!label.startsWith("communi/"))
+        return 0;
+    return label.mid(8).toInt();
+}
+
+IrcCommand* CommandVerifier::take(int id)
+{
+    d.echoes.remove(id);
+    const QString k = d.keys.take(id);
+    if (!k.isNull())
+        d.ids.remove(k, id);
+    return d.commands.take(id);
+}
@@ -30,6 +30,8 @@
 #define COMMANDVERIFIER_H
 
 #include <QMap>
+#include <QHash>
+#include <QMultiHash>
 #include <IrcMessageFilter>
 #include <IrcCommandFilter>
 
@@ -49,13 +51,21 @@ public:
     bool commandFilter(IrcCommand* command);
 
 signals:
-    void verified(int id, IrcMessage* message = 0);
+    // echo is the label of the local line, see SendQueue::echo()
+    void verified(int echo, IrcMessage* message = 0);
 
 private:
+    static QString key(IrcMessage* message);
+    int label(IrcMessage* message) const;
+    IrcCommand* take(int id);
+
     struct Private {
         static int id;
         IrcConnection* connection;
         QMap<int, IrcCommand*> commands;
+        QHash<int, QString> keys;
+        QMultiHash<QString, int> ids;
+        QHash<int, int> echoes;
     } d;
 };
 
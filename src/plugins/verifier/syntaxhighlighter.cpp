@@ -31,6 +31,27 @@
 
 SyntaxHighlighter::SyntaxHighlighter(QTextDocument* document) : QSyntaxHighlighter(document)
 {
+    d.format.setForeground(QPalette().color(QPalette::Disabled, QPalette::Text));
+}
+
+QTextBlock SyntaxHighlighter::takeBlock(int id)
+{
+    // blocks may have been trimmed or rewritten since, fall back to a scan
+    QTextBlock block = d.blocks.take(id);
+    if (block.isValid() && block.userState() == id)
+        return block;
+    for (block = document()->lastBlock(); block.isValid(); block = block.previous()) {
+        if (block.userState() == id)
+            return block;
+    }
+    return QTextBlock();
+}
+
+void SyntaxHighlighter::setBlock(int id, QTextBlock block)
+{
+    block.setUserState(id);
+    d.blocks.insert(id, block);
+    rehighlightBlock(block);
 }
 
 void SyntaxHighlighter::highlightBlock(const QString& text)
@@ -42,7 +63,7 @@ void SyntaxHighlighter::highlightBlock(const QString& text)
         for (QTextBlock::iterator it = block.begin(); !it.atEnd(); ++it) {
             QTextFragment fragment = it.fragment();
             if (fragment.isValid() && !fragment.charFormat().isAnchor())
-                setFormat(fragment.position() - block.position(), fragment.length(), QPalette().color(QPalette::Disabled, QPalette::Text));
+                setFormat(fragment.position() - block.position(), fragment.length(), d.format);
         }
     }
 }
@@ -29,6 +29,9 @@
 #ifndef SYNTAXHIGHLIGHTER_H
 #define SYNTAXHIGHLIGHTER_H
 
+#include <QHash>
+#include <QTextBlock>
+#include <QTextCharFormat>
 #include <QSyntaxHighlighter>
 
 class SyntaxHighlighter : public QSyntaxHighlighter
@@ -38,8 +41,17 @@ class SyntaxHighlighter : public QSyntaxHighlighter
 public:
     SyntaxHighlighter(QTextDocument* document);
 
+    QTextBlock takeBlock(int id);
+    void setBlock(int id, QTextBlock block);
+
 protected:
     void highlightBlock(const QString &text);
+
+private:
+    struct Private {
+        QTextCharFormat format;
+        QHash<int, QTextBlock> blocks;
+    } d;
 };
 
 #endif // SYNTAXHIGHLIGHTER_H
@@ -29,9 +29,10 @@
 #include "verifierplugin.h"
 #include "commandverifier.h"
 #include "syntaxhighlighter.h"
-#include "messageformatter.h"
 #include "textdocument.h"
+#include <IrcConnection>
 #include <IrcMessage>
+#include <IrcNetwork>
 #include <IrcBuffer>
 #include <qabstracttextdocumentlayout.h>
 
@@ -41,6 +42,13 @@ VerifierPlugin::VerifierPlugin(QObject* parent) : QObject(parent)
 
 void VerifierPlugin::connectionAdded(IrcConnection* connection)
 {
+    // the echo confirms own lines, the label tells which one it was
+    IrcNetwork* network = connection->network();
+    QStringList capabilities = network->requestedCapabilities();
+    capabilities += "echo-message";
+    capabilities += "labeled-response";
+    network->setRequestedCapabilities(capabilities);
+
     CommandVerifier* verifier = new CommandVerifier(connection);
     connect(verifier, SIGNAL(verified(int, IrcMessage*)), this, SLOT(onCommandVerified(int, IrcMessage*)));
     d.verifiers.insert(connection, verifier);
@@ -52,62 +60,35 @@ void VerifierPlugin::documentAdded(TextDocument* document)
     connect(document, SIGNAL(messageReceived(IrcMessage*)), this, SLOT(onMessageReceived(IrcMessage*)));
 }
 
-void VerifierPlugin::onCommandVerified(int id, IrcMessage* message)
+void VerifierPlugin::onCommandVerified(int echo, IrcMessage* message)
 {
-    foreach (TextDocument* doc, d.documents.values(id)) {
+    // the pending line is confirmed in place, see TextDocument::confirmEcho()
+    foreach (TextDocument* doc, d.documents.values(echo)) {
+        if (!doc)
+            continue;
         SyntaxHighlighter* highlighter = doc->findChild<SyntaxHighlighter*>();
         if (highlighter) {
-            QTextBlock block = doc->lastBlock();
-            while (block.isValid()) {
-                if (block.userState() == id) {
-                    block.setUserState(-1);
-
-                    // FIXME: Allow selectively updating message data, e.g. just the timestamp
-
-                    MessageData data;
-                    if (message)
-                        data = doc->formatter()->formatMessage(message);
-                    if (!data.isEmpty()) {
-                        QTextCursor cursor(block);
-                        cursor.beginEditBlock();
-                        cursor.select(QTextCursor::BlockUnderCursor);
-                        cursor.removeSelectedText();
-                        doc->insert(cursor, data);
-                        cursor.endEditBlock();
-
-                        if (doc->isVisible() && data.timestamp() > doc->latestMessageSeen())
-                            doc->setLatestMessageSeen(data.timestamp());
-
-                    } else {
-                        highlighter->rehighlightBlock(block);
-                    }
-
-                    break;
-                }
-
-                block = block.previous();
+            QTextBlock block = highlighter->takeBlock(echo);
+            if (block.isValid()) {
+                block.setUserState(-1);
+                highlighter->rehighlightBlock(block);
             }
         }
+        doc->confirmEcho(echo, message);
     }
-    d.documents.remove(id);
+    d.documents.remove(echo);
 }
 
 void VerifierPlugin::onMessageReceived(IrcMessage* message)
 {
-    if (message->isOwn()) {
-        TextDocument* doc = qobject_cast<TextDocument*>(sender());
-        CommandVerifier* verifier = d.verifiers.value(message->connection());
-        if (doc && verifier) {
-            int id = verifier->identify(message);
-            if (id > 1) {
-                SyntaxHighlighter* highlighter = doc->findChild<SyntaxHighlighter*>();
-                if (highlighter) {
-                    QTextBlock block = doc->lastBlock();
-                    block.setUserState(id);
-                    d.documents.insertMulti(id, doc);
-                    highlighter->rehighlightBlock(block);
-                }
-            }
-        }
+    // only lines shown ahead of their command carry an echo label
+    const int echo = message->property("echo").toInt();
+    TextDocument* doc = qobject_cast<TextDocument*>(sender());
+    if (echo > 0 && doc && message->isOwn()) {
+        d.documents.insertMulti(echo, doc);
+        const int row = doc->echoRow(echo);
+        SyntaxHighlighter* highlighter = doc->findChild<SyntaxHighlighter*>();
+        if (highlighter && row >= 0 && row < doc->totalCount() - doc->pendingCount())
+            highlighter->setBlock(echo, doc->findBlockByNumber(row));
     }
 }
@@ -30,6 +30,7 @@
 #define VERIFIERPLUGIN_H
 
 #include <QHash>
+#include <QPointer>
 #include <QtPlugin>
 #include <QMultiHash>
 #include "connectionplugin.h"
@@ -54,12 +55,12 @@ public:
     void documentAdded(TextDocument* document);
 
 private slots:
-    void onCommandVerified(int id, IrcMessage* message);
+    void onCommandVerified(int echo, IrcMessage* message);
     void onMessageReceived(IrcMessage* message);
 
 private:
     struct Private {
-        QMultiHash<int, TextDocument*> documents;
+        QMultiHash<int, QPointer<TextDocument> > documents;
         QHash<IrcConnection*, CommandVerifier*> verifiers;
     } d;
 };
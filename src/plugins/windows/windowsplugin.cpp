@@ -44,6 +44,19 @@ void WindowsPlugin::setupTrayIcon(QSystemTrayIcon* tray)
 void WindowsPlugin::dockAlert(IrcMessage* message)
 {
     QString content = message->property("content").toString();
-    if (!content.isEmpty())
-        d.tray->showMessage(tr("Communi"), message->nick() + ": " + IrcTextFormat().toPlainText(content));
+    if (!content.isEmpty()) {
+        // alerts come grouped per buffer, see Dock::notify()
+        QString text = message->nick() + ": " + IrcTextFormat().toPlainText(content);
+        const int collapsed = message->property("collapsed").toInt();
+        if (collapsed > 0)
+            text = tr("%n new message(s) in %1", 0, collapsed + 1).arg(message->property("buffer").toString()) + "\n" + text;
+        d.tray->showMessage(tr("Communi"), text);
+    }
+}
+
+void WindowsPlugin::dockBadgeChanged(int unread, int alerts)
+{
+    Q_UNUSED(alerts);
+    if (d.tray)
+        d.tray->setToolTip(unread > 0 ? tr("Communi - %n unread message(s)", 0, unread) : tr("Communi"));
 }
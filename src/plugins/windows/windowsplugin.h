@@ -44,6 +44,7 @@ public:
 
     void setupTrayIcon(QSystemTrayIcon* tray);
     void dockAlert(IrcMessage* message);
+    void dockBadgeChanged(int unread, int alerts);
 
 private:
     struct Private {
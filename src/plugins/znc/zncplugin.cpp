@@ -28,8 +28,13 @@
 
 #include "zncplugin.h"
 #include "zncmanager.h"
+#include "textdocument.h"
+#include "documentstub.h"
+#include "hookstats.h"
 #include <IrcConnection>
 #include <IrcBufferModel>
+#include <IrcCommand>
+#include <IrcBuffer>
 
 ZncPlugin::ZncPlugin(QObject* parent) : QObject(parent)
 {
@@ -39,4 +44,64 @@ void ZncPlugin::connectionAdded(IrcConnection* connection)
 {
     ZncManager* manager = new ZncManager(connection);
     manager->setModel(connection->findChild<IrcBufferModel*>());
+
+    HookStats::installCommandFilter(connection, this);
+}
+
+bool ZncPlugin::commandFilter(IrcCommand* command)
+{
+    // The manager only knows what arrived during this session, so the
+    // playback request is raised to what the documents already hold
+    QStringList params = command->parameters();
+    if (command->type() != IrcCommand::Message || params.count() < 2 || params.first() != "*playback")
+        return false;
+
+    QStringList args = params.at(1).split(" ", QString::SkipEmptyParts);
+    if (args.count() < 3 || args.first().toUpper() != "PLAY")
+        return false;
+
+    const QDateTime local = localTimestamp(command->connection());
+    const qint64 from = args.at(2).toDouble() * 1000;
+    if (!local.isValid() || local.toMSecsSinceEpoch() <= from)
+        return false;
+
+    args[2] = QString::number(local.toMSecsSinceEpoch() / 1000.0, 'f', 3);
+    params[1] = args.join(" ");
+    command->setParameters(params);
+    return false;
+}
+
+QDateTime ZncPlugin::localTimestamp(IrcConnection* connection) const
+{
+    // The oldest of the newest timestamps, so that no buffer misses anything.
+    // Restored log tails and the saved last seen times count as held.
+    QDateTime timestamp;
+    IrcBufferModel* model = connection ? connection->findChild<IrcBufferModel*>() : 0;
+    if (!model)
+        return timestamp;
+
+    foreach (IrcBuffer* buffer, model->buffers()) {
+        if (buffer->isSticky())
+            continue;
+        DocumentStub* stub = DocumentStub::find(buffer);
+        if (stub) {
+            // Not shown yet, the stub holds what would be in the document
+            const QDateTime newest = qMax(stub->latestMessageReceived(), stub->latestMessageSeen());
+            if (!newest.isValid())
+                return QDateTime();
+            if (!timestamp.isValid() || newest < timestamp)
+                timestamp = newest;
+            continue;
+        }
+        foreach (TextDocument* document, buffer->findChildren<TextDocument*>()) {
+            if (document->isClone())
+                continue;
+            const QDateTime newest = qMax(document->latestMessageReceived(), document->latestMessageSeen());
+            if (!newest.isValid())
+                return QDateTime();
+            if (!timestamp.isValid() || newest < timestamp)
+                timestamp = newest;
+        }
+    }
+    return timestamp;
 }
@@ -31,21 +31,28 @@
 
 #include <QObject>
 #include <QtPlugin>
+#include <QDateTime>
+#include <IrcCommandFilter>
 #include "connectionplugin.h"
 
 class IrcBuffer;
 class IrcConnection;
 
-class ZncPlugin : public QObject, public ConnectionPlugin
+class ZncPlugin : public QObject, public ConnectionPlugin, public IrcCommandFilter
 {
     Q_OBJECT
-    Q_INTERFACES(ConnectionPlugin)
+    Q_INTERFACES(ConnectionPlugin IrcCommandFilter)
     Q_PLUGIN_METADATA(IID "Communi.ConnectionPlugin")
 
 public:
     ZncPlugin(QObject* parent = 0);
 
     void connectionAdded(IrcConnection* connection);
+
+    bool commandFilter(IrcCommand* command);
+
+private:
+    QDateTime localTimestamp(IrcConnection* connection) const;
 };
 
 #endif // ZNCPLUGIN_H
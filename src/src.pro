@@ -3,5 +3,5 @@
 ######################################################################
 
 TEMPLATE = subdirs
-SUBDIRS += libs plugins app
+SUBDIRS += libs plugins app benchmarks
 CONFIG += ordered